@@ -32,6 +32,16 @@
 #endif
 #include "divsufsort.h"
 
+/* Built twice: once as is, and once with BUILD_DIVSUFSORT64 defined,
+ * giving divsufsort64()/divbwt64() for texts of 2^31 or more characters.
+ */
+#if defined(BUILD_DIVSUFSORT64)
+typedef int64_t saidx_t;
+# define divsufsort divsufsort64
+# define divbwt     divbwt64
+#else
+typedef int saidx_t;
+#endif
 
 /*- Constants -*/
 #define INLINE __inline
@@ -72,7 +82,11 @@
 #endif
 #define SS_SMERGE_STACKSIZE (32)
 #define TR_INSERTIONSORT_THRESHOLD (8)
-#define TR_STACKSIZE (64)
+#if defined(BUILD_DIVSUFSORT64)
+# define TR_STACKSIZE (96)
+#else
+# define TR_STACKSIZE (64)
+#endif
 
 
 /*- Macros -*/
@@ -123,7 +137,7 @@
 
 /*- Private Functions -*/
 
-static const int lg_table[256]= {
+static const saidx_t lg_table[256]= {
  -1,0,1,1,2,2,2,2,3,3,3,3,3,3,3,3,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,4,
   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,
   6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,6,
@@ -137,8 +151,8 @@ static const int lg_table[256]= {
 #if (SS_BLOCKSIZE == 0) || (SS_INSERTIONSORT_THRESHOLD < SS_BLOCKSIZE)
 
 static INLINE
-int
-ss_ilg(int n) {
+saidx_t
+ss_ilg(saidx_t n) {
 #if SS_BLOCKSIZE == 0
   return (n & 0xffff0000) ?
           ((n & 0xff000000) ?
@@ -160,7 +174,7 @@ ss_ilg(int n) {
 
 #if SS_BLOCKSIZE != 0
 
-static const int sqq_table[256] = {
+static const saidx_t sqq_table[256] = {
   0,  16,  22,  27,  32,  35,  39,  42,  45,  48,  50,  53,  55,  57,  59,  61,
  64,  65,  67,  69,  71,  73,  75,  76,  78,  80,  81,  83,  84,  86,  87,  89,
  90,  91,  93,  94,  96,  97,  98,  99, 101, 102, 103, 104, 106, 107, 108, 109,
@@ -180,9 +194,9 @@ static const int sqq_table[256] = {
 };
 
 static INLINE
-int
-ss_isqrt(int x) {
-  int y, e;
+saidx_t
+ss_isqrt(saidx_t x) {
+  saidx_t y, e;
 
   if(x >= (SS_BLOCKSIZE * SS_BLOCKSIZE)) { return SS_BLOCKSIZE; }
   e = (x & 0xffff0000) ?
@@ -213,10 +227,10 @@ ss_isqrt(int x) {
 
 /* Compares two suffixes. */
 static INLINE
-int
+saidx_t
 ss_compare(const unsigned char *T,
-           const int *p1, const int *p2,
-           int depth) {
+           const saidx_t *p1, const saidx_t *p2,
+           saidx_t depth) {
   const unsigned char *U1, *U2, *U1n, *U2n;
 
   for(U1 = T + depth + *p1,
@@ -240,11 +254,11 @@ ss_compare(const unsigned char *T,
 /* Insertionsort for small size groups */
 static
 void
-ss_insertionsort(const unsigned char *T, const int *PA,
-                 int *first, int *last, int depth) {
-  int *i, *j;
-  int t;
-  int r;
+ss_insertionsort(const unsigned char *T, const saidx_t *PA,
+                 saidx_t *first, saidx_t *last, saidx_t depth) {
+  saidx_t *i, *j;
+  saidx_t t;
+  saidx_t r;
 
   for(i = last - 2; first <= i; --i) {
     for(t = *i, j = i + 1; 0 < (r = ss_compare(T, PA + t, PA + *j, depth));) {
@@ -265,11 +279,11 @@ ss_insertionsort(const unsigned char *T, const int *PA,
 
 static INLINE
 void
-ss_fixdown(const unsigned char *Td, const int *PA,
-           int *SA, int i, int size) {
-  int j, k;
-  int v;
-  int c, d, e;
+ss_fixdown(const unsigned char *Td, const saidx_t *PA,
+           saidx_t *SA, saidx_t i, saidx_t size) {
+  saidx_t j, k;
+  saidx_t v;
+  saidx_t c, d, e;
 
   for(v = SA[i], c = Td[PA[v]]; (j = 2 * i + 1) < size; SA[i] = SA[k], i = k) {
     d = Td[PA[SA[k = j++]]];
@@ -282,9 +296,9 @@ ss_fixdown(const unsigned char *Td, const int *PA,
 /* Simple top-down heapsort. */
 static
 void
-ss_heapsort(const unsigned char *Td, const int *PA, int *SA, int size) {
-  int i, m;
-  int t;
+ss_heapsort(const unsigned char *Td, const saidx_t *PA, saidx_t *SA, saidx_t size) {
+  saidx_t i, m;
+  saidx_t t;
 
   m = size;
   if((size % 2) == 0) {
@@ -306,10 +320,10 @@ ss_heapsort(const unsigned char *Td, const int *PA, int *SA, int size) {
 
 /* Returns the median of three elements. */
 static INLINE
-int *
-ss_median3(const unsigned char *Td, const int *PA,
-           int *v1, int *v2, int *v3) {
-  int *t;
+saidx_t *
+ss_median3(const unsigned char *Td, const saidx_t *PA,
+           saidx_t *v1, saidx_t *v2, saidx_t *v3) {
+  saidx_t *t;
   if(Td[PA[*v1]] > Td[PA[*v2]]) { SWAP(v1, v2); }
   if(Td[PA[*v2]] > Td[PA[*v3]]) {
     if(Td[PA[*v1]] > Td[PA[*v3]]) { return v1; }
@@ -320,10 +334,10 @@ ss_median3(const unsigned char *Td, const int *PA,
 
 /* Returns the median of five elements. */
 static INLINE
-int *
-ss_median5(const unsigned char *Td, const int *PA,
-           int *v1, int *v2, int *v3, int *v4, int *v5) {
-  int *t;
+saidx_t *
+ss_median5(const unsigned char *Td, const saidx_t *PA,
+           saidx_t *v1, saidx_t *v2, saidx_t *v3, saidx_t *v4, saidx_t *v5) {
+  saidx_t *t;
   if(Td[PA[*v2]] > Td[PA[*v3]]) { SWAP(v2, v3); }
   if(Td[PA[*v4]] > Td[PA[*v5]]) { SWAP(v4, v5); }
   if(Td[PA[*v2]] > Td[PA[*v4]]) { SWAP(v2, v4); SWAP(v3, v5); }
@@ -335,10 +349,10 @@ ss_median5(const unsigned char *Td, const int *PA,
 
 /* Returns the pivot element. */
 static INLINE
-int *
-ss_pivot(const unsigned char *Td, const int *PA, int *first, int *last) {
-  int *middle;
-  int t;
+saidx_t *
+ss_pivot(const unsigned char *Td, const saidx_t *PA, saidx_t *first, saidx_t *last) {
+  saidx_t *middle;
+  saidx_t t;
 
   t = last - first;
   middle = first + t / 2;
@@ -363,11 +377,11 @@ ss_pivot(const unsigned char *Td, const int *PA, int *first, int *last) {
 
 /* Binary partition for substrings. */
 static INLINE
-int *
-ss_partition(const int *PA,
-                    int *first, int *last, int depth) {
-  int *a, *b;
-  int t;
+saidx_t *
+ss_partition(const saidx_t *PA,
+                    saidx_t *first, saidx_t *last, saidx_t depth) {
+  saidx_t *a, *b;
+  saidx_t t;
   for(a = first - 1, b = last;;) {
     for(; (++a < b) && ((PA[*a] + depth) >= (PA[*a + 1] + 1));) { *a = ~*a; }
     for(; (a < --b) && ((PA[*b] + depth) <  (PA[*b + 1] + 1));) { }
@@ -383,17 +397,17 @@ ss_partition(const int *PA,
 /* Multikey introsort for medium size groups. */
 static
 void
-ss_mintrosort(const unsigned char *T, const int *PA,
-              int *first, int *last,
-              int depth) {
+ss_mintrosort(const unsigned char *T, const saidx_t *PA,
+              saidx_t *first, saidx_t *last,
+              saidx_t depth) {
 #define STACK_SIZE SS_MISORT_STACKSIZE
-  struct { int *a, *b, c; int d; } stack[STACK_SIZE];
+  struct { saidx_t *a, *b, c; saidx_t d; } stack[STACK_SIZE];
   const unsigned char *Td;
-  int *a, *b, *c, *d, *e, *f;
-  int s, t;
-  int ssize;
-  int limit;
-  int v, x = 0;
+  saidx_t *a, *b, *c, *d, *e, *f;
+  saidx_t s, t;
+  saidx_t ssize;
+  saidx_t limit;
+  saidx_t v, x = 0;
 
   for(ssize = 0, limit = ss_ilg(last - first);;) {
 
@@ -525,8 +539,8 @@ ss_mintrosort(const unsigned char *T, const int *PA,
 
 static INLINE
 void
-ss_blockswap(int *a, int *b, int n) {
-  int t;
+ss_blockswap(saidx_t *a, saidx_t *b, saidx_t n) {
+  saidx_t t;
   for(; 0 < n; --n, ++a, ++b) {
     t = *a, *a = *b, *b = t;
   }
@@ -534,9 +548,9 @@ ss_blockswap(int *a, int *b, int n) {
 
 static INLINE
 void
-ss_rotate(int *first, int *middle, int *last) {
-  int *a, *b, t;
-  int l, r;
+ss_rotate(saidx_t *first, saidx_t *middle, saidx_t *last) {
+  saidx_t *a, *b, t;
+  saidx_t l, r;
   l = middle - first, r = last - middle;
   for(; (0 < l) && (0 < r);) {
     if(l == r) { ss_blockswap(first, middle, l); break; }
@@ -575,14 +589,14 @@ ss_rotate(int *first, int *middle, int *last) {
 
 static
 void
-ss_inplacemerge(const unsigned char *T, const int *PA,
-                int *first, int *middle, int *last,
-                int depth) {
-  const int *p;
-  int *a, *b;
-  int len, half;
-  int q, r;
-  int x;
+ss_inplacemerge(const unsigned char *T, const saidx_t *PA,
+                saidx_t *first, saidx_t *middle, saidx_t *last,
+                saidx_t depth) {
+  const saidx_t *p;
+  saidx_t *a, *b;
+  saidx_t len, half;
+  saidx_t q, r;
+  saidx_t x;
 
   for(;;) {
     if(*(last - 1) < 0) { x = 1; p = PA + ~*(last - 1); }
@@ -618,12 +632,12 @@ ss_inplacemerge(const unsigned char *T, const int *PA,
 /* Merge-forward with internal buffer. */
 static
 void
-ss_mergeforward(const unsigned char *T, const int *PA,
-                int *first, int *middle, int *last,
-                int *buf, int depth) {
-  int *a, *b, *c, *bufend;
-  int t;
-  int r;
+ss_mergeforward(const unsigned char *T, const saidx_t *PA,
+                saidx_t *first, saidx_t *middle, saidx_t *last,
+                saidx_t *buf, saidx_t depth) {
+  saidx_t *a, *b, *c, *bufend;
+  saidx_t t;
+  saidx_t r;
 
   bufend = buf + (middle - first) - 1;
   ss_blockswap(buf, first, middle - first);
@@ -668,14 +682,14 @@ ss_mergeforward(const unsigned char *T, const int *PA,
 /* Merge-backward with internal buffer. */
 static
 void
-ss_mergebackward(const unsigned char *T, const int *PA,
-                 int *first, int *middle, int *last,
-                 int *buf, int depth) {
-  const int *p1, *p2;
-  int *a, *b, *c, *bufend;
-  int t;
-  int r;
-  int x;
+ss_mergebackward(const unsigned char *T, const saidx_t *PA,
+                 saidx_t *first, saidx_t *middle, saidx_t *last,
+                 saidx_t *buf, saidx_t depth) {
+  const saidx_t *p1, *p2;
+  saidx_t *a, *b, *c, *bufend;
+  saidx_t t;
+  saidx_t r;
+  saidx_t x;
 
   bufend = buf + (last - middle) - 1;
   ss_blockswap(buf, middle, last - middle);
@@ -727,9 +741,9 @@ ss_mergebackward(const unsigned char *T, const int *PA,
 /* D&C based merge. */
 static
 void
-ss_swapmerge(const unsigned char *T, const int *PA,
-             int *first, int *middle, int *last,
-             int *buf, int bufsize, int depth) {
+ss_swapmerge(const unsigned char *T, const saidx_t *PA,
+             saidx_t *first, saidx_t *middle, saidx_t *last,
+             saidx_t *buf, saidx_t bufsize, saidx_t depth) {
 #define STACK_SIZE SS_SMERGE_STACKSIZE
 #define GETIDX(a) ((0 <= (a)) ? (a) : (~(a)))
 #define MERGE_CHECK(a, b, c)\
@@ -742,11 +756,11 @@ ss_swapmerge(const unsigned char *T, const int *PA,
       *(b) = ~*(b);\
     }\
   } while(0)
-  struct { int *a, *b, *c; int d; } stack[STACK_SIZE];
-  int *l, *r, *lm, *rm;
-  int m, len, half;
-  int ssize;
-  int check, next;
+  struct { saidx_t *a, *b, *c; saidx_t d; } stack[STACK_SIZE];
+  saidx_t *l, *r, *lm, *rm;
+  saidx_t m, len, half;
+  saidx_t ssize;
+  saidx_t check, next;
 
   for(check = 0, ssize = 0;;) {
     if((last - middle) <= bufsize) {
@@ -819,16 +833,16 @@ ss_swapmerge(const unsigned char *T, const int *PA,
 /* Substring sort */
 static
 void
-sssort(const unsigned char *T, const int *PA,
-       int *first, int *last,
-       int *buf, int bufsize,
-       int depth, int n, int lastsuffix) {
-  int *a;
+sssort(const unsigned char *T, const saidx_t *PA,
+       saidx_t *first, saidx_t *last,
+       saidx_t *buf, saidx_t bufsize,
+       saidx_t depth, saidx_t n, saidx_t lastsuffix) {
+  saidx_t *a;
 #if SS_BLOCKSIZE != 0
-  int *b, *middle, *curbuf;
-  int j, k, curbufsize, limit;
+  saidx_t *b, *middle, *curbuf;
+  saidx_t j, k, curbufsize, limit;
 #endif
-  int i;
+  saidx_t i;
 
   if(lastsuffix != 0) { ++first; }
 
@@ -879,7 +893,7 @@ sssort(const unsigned char *T, const int *PA,
 
   if(lastsuffix != 0) {
     /* Insert last type B* suffix. */
-    int PAi[2]; PAi[0] = PA[*(first - 1)], PAi[1] = n - 2;
+    saidx_t PAi[2]; PAi[0] = PA[*(first - 1)], PAi[1] = n - 2;
     for(a = first, i = *(first - 1);
         (a < last) && ((*a < 0) || (0 < ss_compare(T, &(PAi[0]), PA + *a, depth)));
         ++a) {
@@ -893,8 +907,19 @@ sssort(const unsigned char *T, const int *PA,
 /*---------------------------------------------------------------------------*/
 
 static INLINE
-int
-tr_ilg(int n) {
+saidx_t
+tr_ilg(saidx_t n) {
+#if defined(BUILD_DIVSUFSORT64)
+  if(n >> 32) {
+    return (n >> 48) ?
+            ((n >> 56) ?
+              56 + lg_table[(n >> 56) & 0xff] :
+              48 + lg_table[(n >> 48) & 0xff]) :
+            ((n >> 40) ?
+              40 + lg_table[(n >> 40) & 0xff] :
+              32 + lg_table[(n >> 32) & 0xff]);
+  }
+#endif
   return (n & 0xffff0000) ?
           ((n & 0xff000000) ?
             24 + lg_table[(n >> 24) & 0xff] :
@@ -910,9 +935,9 @@ tr_ilg(int n) {
 /* Simple insertionsort for small size groups. */
 static
 void
-tr_insertionsort(const int *ISAd, int *first, int *last) {
-  int *a, *b;
-  int t, r;
+tr_insertionsort(const saidx_t *ISAd, saidx_t *first, saidx_t *last) {
+  saidx_t *a, *b;
+  saidx_t t, r;
 
   for(a = first + 1; a < last; ++a) {
     for(t = *a, b = a - 1; 0 > (r = ISAd[t] - ISAd[*b]);) {
@@ -929,10 +954,10 @@ tr_insertionsort(const int *ISAd, int *first, int *last) {
 
 static INLINE
 void
-tr_fixdown(const int *ISAd, int *SA, int i, int size) {
-  int j, k;
-  int v;
-  int c, d, e;
+tr_fixdown(const saidx_t *ISAd, saidx_t *SA, saidx_t i, saidx_t size) {
+  saidx_t j, k;
+  saidx_t v;
+  saidx_t c, d, e;
 
   for(v = SA[i], c = ISAd[v]; (j = 2 * i + 1) < size; SA[i] = SA[k], i = k) {
     d = ISAd[SA[k = j++]];
@@ -945,9 +970,9 @@ tr_fixdown(const int *ISAd, int *SA, int i, int size) {
 /* Simple top-down heapsort. */
 static
 void
-tr_heapsort(const int *ISAd, int *SA, int size) {
-  int i, m;
-  int t;
+tr_heapsort(const saidx_t *ISAd, saidx_t *SA, saidx_t size) {
+  saidx_t i, m;
+  saidx_t t;
 
   m = size;
   if((size % 2) == 0) {
@@ -969,9 +994,9 @@ tr_heapsort(const int *ISAd, int *SA, int size) {
 
 /* Returns the median of three elements. */
 static INLINE
-int *
-tr_median3(const int *ISAd, int *v1, int *v2, int *v3) {
-  int *t;
+saidx_t *
+tr_median3(const saidx_t *ISAd, saidx_t *v1, saidx_t *v2, saidx_t *v3) {
+  saidx_t *t;
   if(ISAd[*v1] > ISAd[*v2]) { SWAP(v1, v2); }
   if(ISAd[*v2] > ISAd[*v3]) {
     if(ISAd[*v1] > ISAd[*v3]) { return v1; }
@@ -982,10 +1007,10 @@ tr_median3(const int *ISAd, int *v1, int *v2, int *v3) {
 
 /* Returns the median of five elements. */
 static INLINE
-int *
-tr_median5(const int *ISAd,
-           int *v1, int *v2, int *v3, int *v4, int *v5) {
-  int *t;
+saidx_t *
+tr_median5(const saidx_t *ISAd,
+           saidx_t *v1, saidx_t *v2, saidx_t *v3, saidx_t *v4, saidx_t *v5) {
+  saidx_t *t;
   if(ISAd[*v2] > ISAd[*v3]) { SWAP(v2, v3); }
   if(ISAd[*v4] > ISAd[*v5]) { SWAP(v4, v5); }
   if(ISAd[*v2] > ISAd[*v4]) { SWAP(v2, v4); SWAP(v3, v5); }
@@ -997,10 +1022,10 @@ tr_median5(const int *ISAd,
 
 /* Returns the pivot element. */
 static INLINE
-int *
-tr_pivot(const int *ISAd, int *first, int *last) {
-  int *middle;
-  int t;
+saidx_t *
+tr_pivot(const saidx_t *ISAd, saidx_t *first, saidx_t *last) {
+  saidx_t *middle;
+  saidx_t t;
 
   t = last - first;
   middle = first + t / 2;
@@ -1025,22 +1050,22 @@ tr_pivot(const int *ISAd, int *first, int *last) {
 
 typedef struct _trbudget_t trbudget_t;
 struct _trbudget_t {
-  int chance;
-  int remain;
-  int incval;
-  int count;
+  saidx_t chance;
+  saidx_t remain;
+  saidx_t incval;
+  saidx_t count;
 };
 
 static INLINE
 void
-trbudget_init(trbudget_t *budget, int chance, int incval) {
+trbudget_init(trbudget_t *budget, saidx_t chance, saidx_t incval) {
   budget->chance = chance;
   budget->remain = budget->incval = incval;
 }
 
 static INLINE
-int
-trbudget_check(trbudget_t *budget, int size) {
+saidx_t
+trbudget_check(trbudget_t *budget, saidx_t size) {
   if(size <= budget->remain) { budget->remain -= size; return 1; }
   if(budget->chance == 0) { budget->count += size; return 0; }
   budget->remain += budget->incval - size;
@@ -1053,12 +1078,12 @@ trbudget_check(trbudget_t *budget, int size) {
 
 static INLINE
 void
-tr_partition(const int *ISAd,
-             int *first, int *middle, int *last,
-             int **pa, int **pb, int v) {
-  int *a, *b, *c, *d, *e, *f;
-  int t, s;
-  int x = 0;
+tr_partition(const saidx_t *ISAd,
+             saidx_t *first, saidx_t *middle, saidx_t *last,
+             saidx_t **pa, saidx_t **pb, saidx_t v) {
+  saidx_t *a, *b, *c, *d, *e, *f;
+  saidx_t t, s;
+  saidx_t x = 0;
 
   for(b = middle - 1; (++b < last) && ((x = ISAd[*b]) == v);) { }
   if(((a = b) < last) && (x < v)) {
@@ -1095,13 +1120,13 @@ tr_partition(const int *ISAd,
 
 static
 void
-tr_copy(int *ISA, const int *SA,
-        int *first, int *a, int *b, int *last,
-        int depth) {
+tr_copy(saidx_t *ISA, const saidx_t *SA,
+        saidx_t *first, saidx_t *a, saidx_t *b, saidx_t *last,
+        saidx_t depth) {
   /* sort suffixes of middle partition
      by using sorted order of suffixes of left and right partition. */
-  int *c, *d, *e;
-  int s, v;
+  saidx_t *c, *d, *e;
+  saidx_t s, v;
 
   v = b - SA - 1;
   for(c = first, d = a - 1; c <= d; ++c) {
@@ -1120,12 +1145,12 @@ tr_copy(int *ISA, const int *SA,
 
 static
 void
-tr_partialcopy(int *ISA, const int *SA,
-               int *first, int *a, int *b, int *last,
-               int depth) {
-  int *c, *d, *e;
-  int s, v;
-  int rank, lastrank, newrank = -1;
+tr_partialcopy(saidx_t *ISA, const saidx_t *SA,
+               saidx_t *first, saidx_t *a, saidx_t *b, saidx_t *last,
+               saidx_t depth) {
+  saidx_t *c, *d, *e;
+  saidx_t s, v;
+  saidx_t rank, lastrank, newrank = -1;
 
   v = b - SA - 1;
   lastrank = -1;
@@ -1158,17 +1183,17 @@ tr_partialcopy(int *ISA, const int *SA,
 
 static
 void
-tr_introsort(int *ISA, const int *ISAd,
-             int *SA, int *first, int *last,
+tr_introsort(saidx_t *ISA, const saidx_t *ISAd,
+             saidx_t *SA, saidx_t *first, saidx_t *last,
              trbudget_t *budget) {
 #define STACK_SIZE TR_STACKSIZE
-  struct { const int *a; int *b, *c; int d, e; }stack[STACK_SIZE];
-  int *a, *b, *c;
-  int t;
-  int v, x = 0;
-  int incr = ISAd - ISA;
-  int limit, next;
-  int ssize, trlink = -1;
+  struct { const saidx_t *a; saidx_t *b, *c; saidx_t d, e; }stack[STACK_SIZE];
+  saidx_t *a, *b, *c;
+  saidx_t t;
+  saidx_t v, x = 0;
+  saidx_t incr = ISAd - ISA;
+  saidx_t limit, next;
+  saidx_t ssize, trlink = -1;
 
   for(ssize = 0, limit = tr_ilg(last - first);;) {
 
@@ -1385,11 +1410,11 @@ tr_introsort(int *ISA, const int *ISAd,
 /* Tandem repeat sort */
 static
 void
-trsort(int *ISA, int *SA, int n, int depth) {
-  int *ISAd;
-  int *first, *last;
+trsort(saidx_t *ISA, saidx_t *SA, saidx_t n, saidx_t depth) {
+  saidx_t *ISAd;
+  saidx_t *first, *last;
   trbudget_t budget;
-  int t, skip, unsorted;
+  saidx_t t, skip, unsorted;
 
   trbudget_init(&budget, tr_ilg(n) * 2 / 3, n);
 /*  trbudget_init(&budget, tr_ilg(n) * 3 / 4, n); */
@@ -1423,20 +1448,20 @@ trsort(int *ISA, int *SA, int n, int depth) {
 
 /* Sorts suffixes of type B*. */
 static
-int
-sort_typeBstar(const unsigned char *T, int *SA,
-               int *bucket_A, int *bucket_B,
-               int n) {
-  int *PAb, *ISAb, *buf;
+saidx_t
+sort_typeBstar(const unsigned char *T, saidx_t *SA,
+               saidx_t *bucket_A, saidx_t *bucket_B,
+               saidx_t n) {
+  saidx_t *PAb, *ISAb, *buf;
 #ifdef _OPENMP
-  int *curbuf;
-  int l;
+  saidx_t *curbuf;
+  saidx_t l;
 #endif
-  int i, j, k, t, m, bufsize;
-  int c0, c1;
+  saidx_t i, j, k, t, m, bufsize;
+  saidx_t c0, c1;
 #ifdef _OPENMP
-  int d0, d1;
-  int tmp;
+  saidx_t d0, d1;
+  saidx_t tmp;
 #endif
 
   /* Initialize bucket arrays. */
@@ -1586,12 +1611,12 @@ note:
 /* Constructs the suffix array by using the sorted order of type B* suffixes. */
 static
 void
-construct_SA(const unsigned char *T, int *SA,
-             int *bucket_A, int *bucket_B,
-             int n, int m) {
-  int *i, *j, *k;
-  int s;
-  int c0, c1, c2;
+construct_SA(const unsigned char *T, saidx_t *SA,
+             saidx_t *bucket_A, saidx_t *bucket_B,
+             saidx_t n, saidx_t m) {
+  saidx_t *i, *j, *k;
+  saidx_t s;
+  saidx_t c0, c1, c2;
 
   if(0 < m) {
     /* Construct the sorted order of type B suffixes by using
@@ -1649,13 +1674,13 @@ construct_SA(const unsigned char *T, int *SA,
 /* Constructs the burrows-wheeler transformed string directly
    by using the sorted order of type B* suffixes. */
 static
-int
-construct_BWT(const unsigned char *T, int *SA,
-              int *bucket_A, int *bucket_B,
-              int n, int m) {
-  int *i, *j, *k, *orig;
-  int s;
-  int c0, c1, c2;
+saidx_t
+construct_BWT(const unsigned char *T, saidx_t *SA,
+              saidx_t *bucket_A, saidx_t *bucket_B,
+              saidx_t n, saidx_t m) {
+  saidx_t *i, *j, *k, *orig;
+  saidx_t s;
+  saidx_t c0, c1, c2;
 
   if(0 < m) {
     /* Construct the sorted order of type B suffixes by using
@@ -1671,7 +1696,7 @@ construct_BWT(const unsigned char *T, int *SA,
           assert(((s + 1) < n) && (T[s] <= T[s + 1]));
           assert(T[s - 1] <= T[s]);
           c0 = T[--s];
-          *j = ~((int)c0);
+          *j = ~((saidx_t)c0);
           if((0 < s) && (T[s - 1] > c0)) { s = ~s; }
           if(c0 != c2) {
             if(0 <= c2) { BUCKET_B(c2, c1) = k - SA; }
@@ -1693,14 +1718,14 @@ construct_BWT(const unsigned char *T, int *SA,
   /* Construct the BWTed string by using
      the sorted order of type B suffixes. */
   k = SA + BUCKET_A(c2 = T[n - 1]);
-  *k++ = (T[n - 2] < c2) ? ~((int)T[n - 2]) : (n - 1);
+  *k++ = (T[n - 2] < c2) ? ~((saidx_t)T[n - 2]) : (n - 1);
   /* Scan the suffix array from left to right. */
   for(i = SA, j = SA + n, orig = SA; i < j; ++i) {
     if(0 < (s = *i)) {
       assert(T[s - 1] >= T[s]);
       c0 = T[--s];
       *i = c0;
-      if((0 < s) && (T[s - 1] < c0)) { s = ~((int)T[s - 1]); }
+      if((0 < s) && (T[s - 1] < c0)) { s = ~((saidx_t)T[s - 1]); }
       if(c0 != c2) {
         BUCKET_A(c2) = k - SA;
         k = SA + BUCKET_A(c2 = c0);
@@ -1722,11 +1747,11 @@ construct_BWT(const unsigned char *T, int *SA,
 
 /*- Function -*/
 
-int
-divsufsort(const unsigned char *T, int *SA, int n) {
-  int *bucket_A, *bucket_B;
-  int m;
-  int err = 0;
+saidx_t
+divsufsort(const unsigned char *T, saidx_t *SA, saidx_t n) {
+  saidx_t *bucket_A, *bucket_B;
+  saidx_t m;
+  saidx_t err = 0;
 
   /* Check arguments. */
   if((T == NULL) || (SA == NULL) || (n < 0)) { return -1; }
@@ -1734,8 +1759,8 @@ divsufsort(const unsigned char *T, int *SA, int n) {
   else if(n == 1) { SA[0] = 0; return 0; }
   else if(n == 2) { m = (T[0] < T[1]); SA[m ^ 1] = 0, SA[m] = 1; return 0; }
 
-  bucket_A = (int *)malloc(BUCKET_A_SIZE * sizeof(int));
-  bucket_B = (int *)malloc(BUCKET_B_SIZE * sizeof(int));
+  bucket_A = (saidx_t *)malloc(BUCKET_A_SIZE * sizeof(saidx_t));
+  bucket_B = (saidx_t *)malloc(BUCKET_B_SIZE * sizeof(saidx_t));
 
   /* Suffixsort. */
   if((bucket_A != NULL) && (bucket_B != NULL)) {
@@ -1758,19 +1783,19 @@ divsufsort(const unsigned char *T, int *SA, int n) {
 * @param n The length of the given string.
 * @return The primary index if no error occurred, -1 or -2 otherwise.
 */
-int
-divbwt(const unsigned char *T, unsigned char *U, int *A, int n) {
-  int *B;
-  int *bucket_A, *bucket_B;
-  int m, pidx, i;
+saidx_t
+divbwt(const unsigned char *T, unsigned char *U, saidx_t *A, saidx_t n) {
+  saidx_t *B;
+  saidx_t *bucket_A, *bucket_B;
+  saidx_t m, pidx, i;
 
   /* Check arguments. */
   if((T == NULL) || (U == NULL) || (n < 0)) { return -1; }
   else if(n <= 1) { if(n == 1) { U[0] = T[0]; } return n; }
 
-  if((B = A) == NULL) { B = (int *)malloc((size_t)(n + 1) * sizeof(int)); }
-  bucket_A = (int *)malloc(BUCKET_A_SIZE * sizeof(int));
-  bucket_B = (int *)malloc(BUCKET_B_SIZE * sizeof(int));
+  if((B = A) == NULL) { B = (saidx_t *)malloc((size_t)(n + 1) * sizeof(saidx_t)); }
+  bucket_A = (saidx_t *)malloc(BUCKET_A_SIZE * sizeof(saidx_t));
+  bucket_B = (saidx_t *)malloc(BUCKET_B_SIZE * sizeof(saidx_t));
 
   /* Burrows-Wheeler Transform. */
   if((B != NULL) && (bucket_A != NULL) && (bucket_B != NULL)) {
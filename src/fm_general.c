@@ -9,6 +9,13 @@
  */
 #include <p7_config.h>
 
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "easel.h"
 #include "esl_getopts.h"
 #include "hmmer.h"
@@ -93,7 +100,7 @@ ERROR:
  *            the next seed diagonal
  */
 int
-fm_addAmbiguityRange (FM_AMBIGLIST *list, uint32_t start, uint32_t stop) {
+fm_addAmbiguityRange (FM_AMBIGLIST *list, uint64_t start, uint64_t stop) {
   int status;
 
   if (list->count == list->size) {
@@ -130,7 +137,7 @@ ERROR:
  */
 int
 fm_updateIntervalForward( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTERVAL *interval_bk, FM_INTERVAL *interval_f) {
-  uint32_t occLT_l, occLT_u, occ_l, occ_u;
+  uint64_t occLT_l, occLT_u, occ_l, occ_u;
 
   fm_getOccCountLT (fm, cfg, interval_bk->lower - 1, c, &occ_l, &occLT_l);
   fm_getOccCountLT (fm, cfg, interval_bk->upper,     c, &occ_u, &occLT_u);
@@ -138,8 +145,8 @@ fm_updateIntervalForward( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTER
   interval_f->lower += (occLT_u - occLT_l);
   interval_f->upper = interval_f->lower + (occ_u - occ_l) - 1;
 
-  interval_bk->lower = abs((int)(fm->C[(int)c])) + occ_l;
-  interval_bk->upper = abs((int)(fm->C[(int)c])) + occ_u - 1;
+  interval_bk->lower = llabs(fm->C[(int)c]) + occ_l;
+  interval_bk->upper = llabs(fm->C[(int)c]) + occ_u - 1;
 
   return eslOK;
 }
@@ -163,8 +170,8 @@ fm_getSARangeForward( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alp
   FM_INTERVAL interval_bk;
 
   uint8_t c = inv_alph[(int)query[0]];
-  interval->lower  = interval_bk.lower = abs((int)(fm->C[c]));
-  interval->upper  = interval_bk.upper = abs((int)(fm->C[c+1]))-1;
+  interval->lower  = interval_bk.lower = llabs(fm->C[c]);
+  interval->upper  = interval_bk.upper = llabs(fm->C[c+1])-1;
 
 
   while (interval_bk.lower>=0 && interval_bk.lower <= interval_bk.upper) {
@@ -183,14 +190,14 @@ fm_getSARangeForward( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alp
 
 int
 fm_updateIntervalReverse( const FM_DATA *fm, const FM_CFG *cfg, char c, FM_INTERVAL *interval) {
-  int count1, count2;
+  int64_t count1, count2;
   //TODO: counting in these calls will often overlap
     // - might get acceleration by merging to a single redundancy-avoiding call
   count1 = fm_getOccCount (fm, cfg, interval->lower-1, c);
   count2 = fm_getOccCount (fm, cfg, interval->upper, c);
 
-  interval->lower = abs((int)(fm->C[(int)c])) + count1;
-  interval->upper = abs((int)(fm->C[(int)c])) + count2 - 1;
+  interval->lower = llabs(fm->C[(int)c]) + count1;
+  interval->upper = llabs(fm->C[(int)c]) + count2 - 1;
 
   return eslOK;
 }
@@ -212,8 +219,8 @@ fm_getSARangeReverse( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alp
   int i=0;
 
   char c = inv_alph[(int)query[0]];
-  interval->lower  = abs((int)(fm->C[(int)c]));
-  interval->upper  = abs((int)(fm->C[(int)c+1]))-1;
+  interval->lower  = llabs(fm->C[(int)c]);
+  interval->upper  = llabs(fm->C[(int)c+1])-1;
 
   while (interval->lower>=0 && interval->lower <= interval->upper) {
     c = query[++i];
@@ -245,7 +252,7 @@ fm_getSARangeReverse( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alp
  *            or one char per byte for amino acids.
  */
 uint8_t
-fm_getChar(uint8_t alph_type, int j, const uint8_t *B )
+fm_getChar(uint8_t alph_type, uint64_t j, const uint8_t *B )
 {
   uint8_t c = -1;
 
@@ -278,7 +285,7 @@ fm_getChar(uint8_t alph_type, int j, const uint8_t *B )
  *            comes before <end>, return it. Otherwise, return -1.
  */
 int32_t
-fm_findOverlappingAmbiguityBlock (const FM_DATA *fm, const FM_METADATA *meta, uint32_t start, uint32_t end)
+fm_findOverlappingAmbiguityBlock (const FM_DATA *fm, const FM_METADATA *meta, int64_t start, int64_t end)
 {
 
   int lo = fm->ambig_offset;
@@ -348,8 +355,8 @@ fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first,
       int32_t pos = fm_findOverlappingAmbiguityBlock (fm, meta, first, first+length-1 );
       if (pos != -1) {
         while (pos <= fm->ambig_offset + fm->ambig_cnt -1 && meta->ambig_list->ranges[pos].lower <= first+length-1) {
-          int start = ESL_MAX(first,          meta->ambig_list->ranges[pos].lower);
-          int end =   ESL_MIN(first+length-1, meta->ambig_list->ranges[pos].upper);
+          int64_t start = ESL_MAX((int64_t)first,            meta->ambig_list->ranges[pos].lower);
+          int64_t end   = ESL_MIN((int64_t)(first+length-1), meta->ambig_list->ranges[pos].upper);
           for (j= start; j<=end; j++)
               sq->dsq[j-first+1] = sq->abc->Kp-3; //'N'
           pos++;
@@ -367,7 +374,7 @@ fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first,
 */
   } else { // amino
     for (i = first; i<= first+length-1; i++)
-      sq->dsq[i-first+1] = fm->T[i] + (fm->T[i] < 20 ? 0 : 1); //increment by one for ambiguity codes
+      sq->dsq[i-first+1] = FM_DSQ(meta, fm->T[i]); //increment by one for ambiguity codes
 
     sq->dsq[length+1] = eslDSQ_SENTINEL;
   }
@@ -380,6 +387,106 @@ fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first,
 
 
 
+/* fm_getTarget()
+ * Put the whole target sequence whose segments are
+ * <meta->seq_data[first..last]> in <sq>, from the forward indexes
+ * <fms> of all blocks. A target too long for one block is split into
+ * segments in consecutive blocks, the next one repeating the end of
+ * the one before (makehmmerdb's block overlap); each segment adds
+ * only what lies past the residues already in <sq>. Amino indexes
+ * only, as hmmsearch and phmmer use.
+ */
+static int
+fm_getTarget( const FM_DATA *fms, const FM_METADATA *meta, uint32_t first, uint32_t last, ESL_SQ *sq )
+{
+  const FM_SEQDATA *sd;
+  uint64_t          i;
+  uint64_t          skip;
+  uint32_t          s;
+  int               b = 0;
+  int               status;
+
+  if (meta->alph_type != fm_AMINO) ESL_EXCEPTION(eslEINVAL, "can only read whole targets from an amino FM index");
+
+  sq->n = 0;
+  for (s = first; s <= last; s++) {
+    sd = meta->seq_data + s;
+    while (b < meta->block_count-1 && s >= fms[b].seq_offset + fms[b].seq_cnt) b++;
+    if (sd->target_start > sq->n + 1) ESL_EXCEPTION(eslEINCONCEIVABLE, "gap between segments of FM-index target %s", sd->name);
+
+    skip = sq->n + 1 - sd->target_start;
+    if (skip >= sd->length) continue;
+
+    if ((status = esl_sq_GrowTo(sq, sq->n + sd->length - skip)) != eslOK) return status;
+    for (i = sd->fm_start + skip; i < sd->fm_start + sd->length; i++)
+      sq->dsq[++sq->n] = FM_DSQ(meta, fms[b].T[i]);
+  }
+  sq->dsq[0]       = eslDSQ_SENTINEL;
+  sq->dsq[sq->n+1] = eslDSQ_SENTINEL;
+  sq->start = 1;
+  sq->end   = sq->n;
+  sq->C     = 0;
+  sq->W     = sq->n;
+  sq->L     = sq->n;
+
+  sd = meta->seq_data + first;
+  if ((status = esl_sq_SetName     (sq, sd->name))   != eslOK) return status;
+  if ((status = esl_sq_SetAccession(sq, sd->acc))    != eslOK) return status;
+  if ((status = esl_sq_SetDesc     (sq, sd->desc))   != eslOK) return status;
+  if ((status = esl_sq_SetSource   (sq, sd->source)) != eslOK) return status;
+  sq->idx = sd->target_id;
+  return eslOK;
+}
+
+/* Function:  fm_readSeeded()
+ * Synopsis:  Read the next flagged targets of an FM index into a block.
+ *
+ * Purpose:   Fill <block> with the next target sequences of the index,
+ *            in database order from segment <*idx> of <meta->seq_data>
+ *            on, that have any segment flagged in <seeded> (an array
+ *            of <meta->seq_count> flags, e.g. set by
+ *            <p7_Pipeline_FMSeed()>). Each target comes out whole, as
+ *            if it had been read from the sequence file: a target
+ *            split over blocks is put back together from its segments
+ *            in <fms>, the forward indexes of all blocks
+ *            (<fm_FM_readBlocks()>), and its coordinates are those of
+ *            the original sequence. Advance <*idx> past the targets
+ *            read; start with <*idx = 0>.
+ *
+ *            Like <esl_sqio_ReadBlock()>, this fills at most
+ *            <block->listSize> sequences, and sets <block->count>.
+ *
+ * Returns:   <eslOK> if <block> holds at least one target.
+ *            <eslEOF> if there are none left; <block->count> is 0.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+fm_readSeeded( const FM_DATA *fms, const FM_METADATA *meta, const uint8_t *seeded, uint32_t *idx, ESL_SQ_BLOCK *block )
+{
+  uint32_t first, last;
+  int      is_seeded;
+  int      status;
+
+  block->count = 0;
+  while (block->count < block->listSize && *idx < meta->seq_count) {
+    first     = last = *idx;
+    is_seeded = seeded[first];
+    while (last+1 < meta->seq_count && meta->seq_data[last+1].target_id == meta->seq_data[first].target_id) {
+      last++;
+      is_seeded |= seeded[last];
+    }
+    *idx = last+1;
+    if (! is_seeded) continue;
+
+    esl_sq_Reuse(block->list + block->count);
+    if ((status = fm_getTarget(fms, meta, first, last, block->list + block->count)) != eslOK) return status;
+    block->count++;
+  }
+  return (block->count > 0) ? eslOK : eslEOF;
+}
+
+
 /* Function:  fm_computeSequenceOffset()
  * Synopsis:  Search in the meta->seq_data array for the sequence id corresponding to the
  *            requested position. The matching entry is the one with the largest index i
@@ -473,22 +580,107 @@ void
 fm_FM_destroy ( FM_DATA *fm, int isMainFM)
 {
 
-  free (fm->BWT_mem);
   free (fm->C);
+  if (fm->is_view) return;
+
+  free (fm->BWT_mem);
   free (fm->occCnts_b);
   free (fm->occCnts_sb);
 
   if (isMainFM) {
      free (fm->T);
      free (fm->SA);
+     free (fm->SA64);
+  }
+}
+
+/* Function:  fm_FM_mmap()
+ * Synopsis:  Map an FM index file into memory, to search it in place.
+ *
+ * Purpose:   Map the file open as <meta->fp>, whose metadata have
+ *            already been read by <fm_readFMmeta()>. From then on,
+ *            <fm_FM_read()> doesn't allocate or read a block's text,
+ *            BWT, suffix array samples or occurrence counts: the
+ *            <FM_DATA> it fills in points straight into the mapping
+ *            (and is flagged <is_view>). Reading a block is then
+ *            nearly free, however often it's done; threads searching
+ *            the same block share one copy of it; and processes that
+ *            map the same file, or run one after another, share the
+ *            page cache instead of each reading the file.
+ *
+ *            The file stays mapped until <fm_metaDestroy()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENORESULT> if the file predates version 3 (whose
+ *            arrays are aligned for in-place use), or this system
+ *            can't map files. Nothing has changed, and blocks are
+ *            read as usual.
+ *
+ * Throws:    <eslESYS> if a system call fails. Nothing has changed.
+ */
+int
+fm_FM_mmap( FM_METADATA *meta )
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct stat  st;
+  void        *map;
+  int          status;
+
+  if (meta->version < fm_VERSION_3) return eslENORESULT;
+  if (meta->map != NULL)            return eslOK;
+
+  if (fstat(fileno(meta->fp), &st) != 0) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on FM index file");
+  if (st.st_size == 0) return eslENORESULT;
+
+  if ((map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(meta->fp), 0)) == MAP_FAILED) ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on FM index file");
+
+  meta->map  = (char *) map;
+  meta->nmap = st.st_size;
+  return eslOK;
+
+ ERROR:
+  return status;
+#else
+  return eslENORESULT;
+#endif
+}
+
+
+/* fm_nextArray()
+ * Move <meta->fp> to the start of the next array in the file, which
+ * in version 3 is on the next FM_ALIGN boundary. If the file is
+ * mapped, return the array of <nbytes> in place in <*ret_view>, and
+ * move past it; otherwise <*ret_view> is NULL, and the caller reads it.
+ */
+static int
+fm_nextArray( FM_METADATA *meta, uint64_t nbytes, void **ret_view )
+{
+  off_t pos = 0;
+
+  *ret_view = NULL;
+
+  if (meta->version >= fm_VERSION_3) {
+    if ((pos = ftello(meta->fp)) == -1)                         return eslESYS;
+    pos = FM_ALIGNED(pos);
+    if (fseeko(meta->fp, pos, SEEK_SET) != 0)                   return eslEFORMAT;
+  }
+
+  if (meta->map != NULL) {
+    if (pos + nbytes > meta->nmap)                              return eslEFORMAT;
+    if (fseeko(meta->fp, pos + nbytes, SEEK_SET) != 0)          return eslEFORMAT;
+    *ret_view = meta->map + pos;
   }
+  return eslOK;
 }
 
+
 /* Function:  fm_FM_read()
  * Synopsis:  Read the FM index off disk
  * Purpose:   Read the FM-index as written by fmbuild.
  *            First read the metadata header, then allocate space for the full index,
- *            then read it in.
+ *            then read it in. If the file is mapped (<fm_FM_mmap()>),
+ *            point into the mapping instead of allocating and reading.
  */
 int
 fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
@@ -496,21 +688,44 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   //shortcut variables
   int64_t *C               = NULL;
 
-  int i;
-  uint32_t *occCnts_sb = NULL;
-  int32_t compressed_bytes;
-  int num_freq_cnts_b;
-  int num_freq_cnts_sb;
-  int num_SA_samples;
+  int64_t i;
+  uint64_t *occCnts_sb = NULL;
+  uint32_t *occCnts_sb32;
+  uint32_t term_loc32;
+  uint64_t compressed_bytes;
+  uint64_t num_freq_cnts_b;
+  uint64_t num_freq_cnts_sb;
+  uint64_t num_SA_samples;
+  uint64_t SA_sample_size;
   int64_t prevC;
-  int cnt;
+  int64_t cnt;
   int chars_per_byte = 8/meta->charBits;
+  void *view;
   int status;
 
+  fm->T          = NULL;
+  fm->BWT_mem    = NULL;
+  fm->BWT        = NULL;
+  fm->SA         = NULL;
+  fm->SA64       = NULL;
+  fm->C          = NULL;
+  fm->occCnts_b  = NULL;
+  fm->occCnts_sb = NULL;
+  fm->is_view    = (meta->map != NULL);
+
+  if(fread(&(fm->N), sizeof(uint64_t), 1, meta->fp) !=  1)
+    {status=eslEFORMAT; goto ERROR;}
+
+  if (meta->version >= fm_VERSION_2) {
+    if (fread(&(fm->term_loc), sizeof(uint64_t), 1, meta->fp) !=  1)
+      {status=eslEFORMAT; goto ERROR;}
+  } else {
+    if (fread(&term_loc32, sizeof(uint32_t), 1, meta->fp) !=  1)
+      {status=eslEFORMAT; goto ERROR;}
+    fm->term_loc = term_loc32;
+  }
 
-  if(fread(&(fm->N), sizeof(uint64_t), 1, meta->fp) !=  1            ||
-     fread(&(fm->term_loc), sizeof(uint32_t), 1, meta->fp) !=  1     ||
-     fread(&(fm->seq_offset), sizeof(uint32_t), 1, meta->fp) !=  1   ||
+  if(fread(&(fm->seq_offset), sizeof(uint32_t), 1, meta->fp) !=  1   ||
      fread(&(fm->ambig_offset), sizeof(uint32_t), 1, meta->fp) !=  1 ||
      fread(&(fm->overlap), sizeof(uint32_t), 1, meta->fp) !=  1      ||
      fread(&(fm->seq_cnt), sizeof(uint32_t), 1, meta->fp) !=  1      ||
@@ -522,25 +737,67 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   num_freq_cnts_b  = 1+ceil((double)fm->N/meta->freq_cnt_b);
   num_freq_cnts_sb = 1+ceil((double)fm->N/meta->freq_cnt_sb);
   num_SA_samples   = 1+floor((double)fm->N/meta->freq_SA);
+  SA_sample_size   = (fm->N > UINT32_MAX ? sizeof(uint64_t) : sizeof(uint32_t));
 
-  // allocate space, then read the data
-  if (getAll) ESL_ALLOC (fm->T, sizeof(uint8_t) * compressed_bytes );
-  ESL_ALLOC (fm->BWT_mem,  sizeof(uint8_t) * (compressed_bytes + 31) ); // +31 for manual 16-byte alignment  ( typically only need +15, but this allows offset in memory, plus offset in case of <16 bytes of characters at the end)
-     fm->BWT =   (uint8_t *) (((unsigned long int)fm->BWT_mem + 15) & (~0xf));   // align vector memory on 16-byte boundaries
-  if (getAll) ESL_ALLOC (fm->SA, num_SA_samples * sizeof(uint32_t));
   ESL_ALLOC (fm->C, (1+meta->alph_size) * sizeof(int64_t));
-  ESL_ALLOC (fm->occCnts_b,  num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t)); // every freq_cnt positions, store an array of ints
-  ESL_ALLOC (fm->occCnts_sb,  num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint32_t)); // every freq_cnt positions, store an array of ints
 
+  // for each array: find it, then either view it in place, or allocate space and read it
+  if (getAll) {
+    if ((status = fm_nextArray(meta, compressed_bytes, &view)) != eslOK) goto ERROR;
+    if (view) fm->T = (uint8_t *) view;
+    else {
+      ESL_ALLOC (fm->T, sizeof(uint8_t) * compressed_bytes );
+      if (fread(fm->T, sizeof(uint8_t), compressed_bytes, meta->fp) != compressed_bytes) {status=eslEFORMAT; goto ERROR;}
+    }
+  }
 
-  if(
-     (getAll && fread(fm->T, sizeof(uint8_t), compressed_bytes, meta->fp) != compressed_bytes) ||
-     (fread(fm->BWT, sizeof(uint8_t), compressed_bytes, meta->fp)  != compressed_bytes) ||
-     (getAll && fread(fm->SA, sizeof(uint32_t), (size_t)num_SA_samples, meta->fp) != (size_t)num_SA_samples)  ||
-     (fread(fm->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, meta->fp) != (size_t)num_freq_cnts_b)  ||
-     (fread(fm->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, meta->fp) != (size_t)num_freq_cnts_sb)
-    )
-    {status=eslEFORMAT; goto ERROR;}
+  if ((status = fm_nextArray(meta, compressed_bytes, &view)) != eslOK) goto ERROR;
+  if (view) fm->BWT = (uint8_t *) view;   // FM_ALIGN-aligned, for vector access
+  else {
+    ESL_ALLOC (fm->BWT_mem,  sizeof(uint8_t) * (compressed_bytes + 31) ); // +31 for manual 16-byte alignment  ( typically only need +15, but this allows offset in memory, plus offset in case of <16 bytes of characters at the end)
+       fm->BWT =   (uint8_t *) (((unsigned long int)fm->BWT_mem + 15) & (~0xf));   // align vector memory on 16-byte boundaries
+    if (fread(fm->BWT, sizeof(uint8_t), compressed_bytes, meta->fp) != compressed_bytes) {status=eslEFORMAT; goto ERROR;}
+  }
+
+  if (getAll) {
+    if ((status = fm_nextArray(meta, num_SA_samples * SA_sample_size, &view)) != eslOK) goto ERROR;
+    if (view) {
+      if (fm->N > UINT32_MAX) fm->SA64 = (uint64_t *) view;
+      else                    fm->SA   = (uint32_t *) view;
+    } else if (fm->N > UINT32_MAX) {
+      ESL_ALLOC (fm->SA64, num_SA_samples * sizeof(uint64_t));
+      if (fread(fm->SA64, sizeof(uint64_t), (size_t)num_SA_samples, meta->fp) != (size_t)num_SA_samples) {status=eslEFORMAT; goto ERROR;}
+    } else {
+      ESL_ALLOC (fm->SA,   num_SA_samples * sizeof(uint32_t));
+      if (fread(fm->SA,   sizeof(uint32_t), (size_t)num_SA_samples, meta->fp) != (size_t)num_SA_samples) {status=eslEFORMAT; goto ERROR;}
+    }
+  }
+
+  if ((status = fm_nextArray(meta, num_freq_cnts_b * meta->alph_size * sizeof(uint16_t), &view)) != eslOK) goto ERROR;
+  if (view) fm->occCnts_b = (uint16_t *) view;
+  else {
+    ESL_ALLOC (fm->occCnts_b,  num_freq_cnts_b *  (meta->alph_size ) * sizeof(uint16_t)); // every freq_cnt positions, store an array of ints
+    if (fread(fm->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, meta->fp) != (size_t)num_freq_cnts_b) {status=eslEFORMAT; goto ERROR;}
+  }
+
+  if ((status = fm_nextArray(meta, num_freq_cnts_sb * meta->alph_size * sizeof(uint64_t), &view)) != eslOK) goto ERROR;
+  if (view) fm->occCnts_sb = (uint64_t *) view;
+  else {
+    ESL_ALLOC (fm->occCnts_sb,  num_freq_cnts_sb *  (meta->alph_size ) * sizeof(uint64_t)); // every freq_cnt positions, store an array of ints
+
+    if (meta->version >= fm_VERSION_2) {
+      if (fread(fm->occCnts_sb, sizeof(uint64_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, meta->fp) != (size_t)num_freq_cnts_sb)
+        {status=eslEFORMAT; goto ERROR;}
+    } else {
+      /* version 1 counts are 32-bit: read them into the front of the
+       * array, then widen in place, back to front */
+      occCnts_sb32 = (uint32_t *) fm->occCnts_sb;
+      if (fread(occCnts_sb32, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, meta->fp) != (size_t)num_freq_cnts_sb)
+        {status=eslEFORMAT; goto ERROR;}
+      for (i = num_freq_cnts_sb * meta->alph_size - 1; i >= 0; i--)
+        fm->occCnts_sb[i] = occCnts_sb32[i];
+    }
+  }
 
   //shortcut variables
   C          = fm->C;
@@ -552,7 +809,7 @@ fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll )
   * used to establish the end of the prior range*/
   C[0] = 0;
   for (i=0; i<meta->alph_size; i++) {
-    prevC = abs((int)(C[i]));
+    prevC = llabs(C[i]);
 
     cnt = FM_OCC_CNT( sb, num_freq_cnts_sb-1, i);
 
@@ -574,6 +831,81 @@ ERROR:
 }
 
 
+/* Function:  fm_FM_readBlocks()
+ * Synopsis:  Read every block of an FM index, forward and backward.
+ *
+ * Purpose:   Read all <meta->block_count> blocks of the index open as
+ *            <meta->fp>, positioned at its first block, with
+ *            <fm_FM_read()>: the forward indexes (with the text and
+ *            suffix array samples) in <*ret_fwd>, and the backward
+ *            ones, which share those with their forward twins, in
+ *            <*ret_bwd>. If the file is mapped (<fm_FM_mmap()>), this
+ *            only points into the mapping, so the blocks can be kept
+ *            for a whole run of queries at no cost.
+ *
+ * Returns:   <eslOK> on success. Caller frees with <fm_FM_destroyBlocks()>.
+ *
+ *            <eslEFORMAT> if a block can't be read. <*ret_fwd> and
+ *            <*ret_bwd> are NULL.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+fm_FM_readBlocks( FM_METADATA *meta, FM_DATA **ret_fwd, FM_DATA **ret_bwd )
+{
+  FM_DATA *fwd   = NULL;
+  FM_DATA *bwd   = NULL;
+  int      nread = 0;
+  int      status;
+
+  ESL_ALLOC(fwd, sizeof(FM_DATA) * ESL_MAX(1, meta->block_count));
+  ESL_ALLOC(bwd, sizeof(FM_DATA) * ESL_MAX(1, meta->block_count));
+
+  for (nread = 0; nread < meta->block_count; nread++) {
+    if ((status = fm_FM_read(fwd + nread, meta, TRUE))  != eslOK) goto ERROR;
+    if ((status = fm_FM_read(bwd + nread, meta, FALSE)) != eslOK) { fm_FM_destroy(fwd + nread, TRUE); goto ERROR; }
+
+    bwd[nread].SA   = fwd[nread].SA;
+    bwd[nread].SA64 = fwd[nread].SA64;
+    bwd[nread].T    = fwd[nread].T;
+  }
+
+  *ret_fwd = fwd;
+  *ret_bwd = bwd;
+  return eslOK;
+
+ ERROR:
+  if (fwd && bwd) fm_FM_destroyBlocks(meta, fwd, bwd, nread);
+  else {
+    if (fwd) free(fwd);
+    if (bwd) free(bwd);
+  }
+  *ret_fwd = NULL;
+  *ret_bwd = NULL;
+  return status;
+}
+
+/* Function:  fm_FM_destroyBlocks()
+ * Synopsis:  Free the blocks read by <fm_FM_readBlocks()>.
+ *
+ * Purpose:   Free the first <nblocks> blocks of <fwd> and <bwd> (all of
+ *            them, <meta->block_count>, unless cleaning up after a
+ *            failed read), and the arrays.
+ */
+void
+fm_FM_destroyBlocks( FM_METADATA *meta, FM_DATA *fwd, FM_DATA *bwd, int nblocks )
+{
+  int b;
+
+  for (b = 0; b < nblocks; b++) {
+    fm_FM_destroy(fwd + b, TRUE);
+    fm_FM_destroy(bwd + b, FALSE);
+  }
+  free(fwd);
+  free(bwd);
+}
+
+
 /* Function:  readFMmeta()
  * Synopsis:  Read metadata from disk for the set of FM-indexes stored in a HMMER binary file
  *
@@ -585,12 +917,33 @@ fm_readFMmeta( FM_METADATA *meta)
 {
   int status;
   int i;
+  char     magic[FM_MAGIC_LEN];
+  uint32_t fm_start32;
+  int32_t  lower32, upper32;
 
 
   fm_initAmbiguityList(meta->ambig_list);
 
-  if( fread(&(meta->fwd_only),     sizeof(meta->fwd_only),     1, meta->fp) != 1 ||
-      fread(&(meta->alph_type),    sizeof(meta->alph_type),    1, meta->fp) != 1 ||
+  /* A version 1 file has no magic; its first byte is fwd_only (0 or 1) */
+  if (fread(magic, sizeof(char), 1, meta->fp) != 1)
+    {status=eslEFORMAT; goto ERROR;}
+
+  if (magic[0] == 0 || magic[0] == 1) {
+    meta->version  = fm_VERSION_1;
+    meta->fwd_only = magic[0];
+  } else {
+    if( fread(magic+1,            sizeof(char),               FM_MAGIC_LEN-1, meta->fp) != FM_MAGIC_LEN-1 ||
+        memcmp(magic, FM_MAGIC, FM_MAGIC_LEN) != 0                                                          ||
+        fread(&(meta->version),   sizeof(meta->version),      1, meta->fp) != 1                            ||
+        fread(&(meta->fwd_only),  sizeof(meta->fwd_only),     1, meta->fp) != 1
+    )
+    {status=eslEFORMAT; goto ERROR;}
+
+    if (meta->version < fm_VERSION_2 || meta->version > fm_VERSION_CURRENT)
+      {status=eslEINCOMPAT; return status;}
+  }
+
+  if( fread(&(meta->alph_type),    sizeof(meta->alph_type),    1, meta->fp) != 1 ||
       fread(&(meta->alph_size),    sizeof(meta->alph_size),    1, meta->fp) != 1 ||
       fread(&(meta->charBits),     sizeof(meta->charBits),     1, meta->fp) != 1 ||
       fread(&(meta->freq_SA),      sizeof(meta->freq_SA),      1, meta->fp) != 1 ||
@@ -604,9 +957,9 @@ fm_readFMmeta( FM_METADATA *meta)
   {status=eslEFORMAT; goto ERROR;}
 
   /* sanity check - are these metadata for a real FM index?
-   * TODO: in an upcoming renovation of FM, capture FM validation & version as part of metadata header
+   * (version 1 files have no magic, so this is all we have to go on for those)
    */
-  if (  meta->alph_type != fm_DNA ||  /* this is the only legal value for nhmmer */
+  if (  (meta->alph_type != fm_DNA && meta->alph_type != fm_AMINO) ||  /* nhmmer reads DNA, hmmsearch and phmmer amino */
         meta->fwd_only > 1        ||  /* must be 0 (false) or 1 (true) */
         meta->charBits > 8        ||  /* should really be 2 ... but allowing for future growth */
         meta->freq_SA > 10000         /* a suffix array sampling of this scale is insane */
@@ -620,7 +973,8 @@ fm_readFMmeta( FM_METADATA *meta)
   for (i=0; i<meta->seq_count; i++) {
     if( fread(&(meta->seq_data[i].target_id),    sizeof(meta->seq_data[i].target_id),    1, meta->fp) != 1 ||
         fread(&(meta->seq_data[i].target_start), sizeof(meta->seq_data[i].target_start), 1, meta->fp) != 1 ||
-        fread(&(meta->seq_data[i].fm_start),     sizeof(meta->seq_data[i].fm_start),     1, meta->fp) != 1 ||
+        (meta->version >= fm_VERSION_2 && fread(&(meta->seq_data[i].fm_start), sizeof(meta->seq_data[i].fm_start), 1, meta->fp) != 1) ||
+        (meta->version <  fm_VERSION_2 && fread(&fm_start32,                   sizeof(fm_start32),                 1, meta->fp) != 1) ||
         fread(&(meta->seq_data[i].length),       sizeof(meta->seq_data[i].length),       1, meta->fp) != 1 ||
         fread(&(meta->seq_data[i].name_length),  sizeof(meta->seq_data[i].name_length),  1, meta->fp) != 1 ||
         fread(&(meta->seq_data[i].acc_length),   sizeof(meta->seq_data[i].acc_length),   1, meta->fp) != 1 ||
@@ -629,6 +983,8 @@ fm_readFMmeta( FM_METADATA *meta)
         )
         {status=eslEFORMAT; goto ERROR;}
 
+    if (meta->version < fm_VERSION_2) meta->seq_data[i].fm_start = fm_start32;
+
     ESL_ALLOC (meta->seq_data[i].name,  (1+meta->seq_data[i].name_length)   * sizeof(char));
     ESL_ALLOC (meta->seq_data[i].acc,   (1+meta->seq_data[i].acc_length)    * sizeof(char));
     ESL_ALLOC (meta->seq_data[i].source,(1+meta->seq_data[i].source_length) * sizeof(char));
@@ -649,10 +1005,19 @@ fm_readFMmeta( FM_METADATA *meta)
   }
 
   for (i=0; i<meta->ambig_list->count; i++) {
-    if( fread(&(meta->ambig_list->ranges[i].lower),   sizeof(meta->ambig_list->ranges[i].lower),       1, meta->fp) != 1 ||
-        fread(&(meta->ambig_list->ranges[i].upper),   sizeof(meta->ambig_list->ranges[i].upper),       1, meta->fp) != 1
-    )
-    {status=eslEAMBIGUOUS; goto ERROR;}
+    if (meta->version >= fm_VERSION_2) {
+      if( fread(&(meta->ambig_list->ranges[i].lower),   sizeof(meta->ambig_list->ranges[i].lower),       1, meta->fp) != 1 ||
+          fread(&(meta->ambig_list->ranges[i].upper),   sizeof(meta->ambig_list->ranges[i].upper),       1, meta->fp) != 1
+      )
+      {status=eslEAMBIGUOUS; goto ERROR;}
+    } else {
+      if( fread(&lower32,   sizeof(lower32),       1, meta->fp) != 1 ||
+          fread(&upper32,   sizeof(upper32),       1, meta->fp) != 1
+      )
+      {status=eslEAMBIGUOUS; goto ERROR;}
+      meta->ambig_list->ranges[i].lower = lower32;
+      meta->ambig_list->ranges[i].upper = upper32;
+    }
   }
 
   return eslOK;
@@ -683,6 +1048,8 @@ fm_configAlloc(FM_CFG **cfg)
 
   ESL_ALLOC(*cfg, sizeof(FM_CFG) );
   ESL_ALLOC((*cfg)->meta, sizeof(FM_METADATA));
+  (*cfg)->meta->map  = NULL;
+  (*cfg)->meta->nmap = 0;
   ESL_ALLOC ((*cfg)->meta->ambig_list, sizeof(FM_AMBIGLIST));
 
   return eslOK;
@@ -739,6 +1106,9 @@ fm_metaDestroy(FM_METADATA *meta ) {
     }
 
     fm_alphabetDestroy(meta);
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+    if (meta->map) munmap(meta->map, meta->nmap);
+#endif
     free (meta);
   }
 
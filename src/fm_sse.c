@@ -187,27 +187,27 @@ ERROR:
  *            a reasonable expectation, as spacings of 256 or more seem to give the best speed,
  *            and certainly better space-utilization.
  */
-int
-fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
+int64_t
+fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int64_t pos, uint8_t c)
 {
   FM_METADATA *meta = cfg->meta;
-  int cnt = 0;
-  const int b_pos          = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
+  int64_t cnt = 0;
+  const int64_t b_pos      = (pos+1) / meta->freq_cnt_b ; //floor(pos/b_size)   : the b count element preceding pos
   const int cnt_mod_mask_b = meta->freq_cnt_b - 1; //used to compute the mod function
   const int b_rel_pos      = (pos+1) & cnt_mod_mask_b; // pos % b_size      : how close is pos to the boundary corresponding to b_pos
   int up_b           = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
-  int landmark       = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
+  int64_t landmark   = ((b_pos+up_b)*meta->freq_cnt_b) - 1 ;
 
-  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+  if (landmark >= (int64_t)fm->N) { // special case: for a count in the final block, just count from the bottom
     up_b      = 0;
     landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
   }
 
 #if defined (eslENABLE_SSE)
-  int i;
+  int64_t i;
   const uint16_t * occCnts_b  = fm->occCnts_b;
-  const uint32_t * occCnts_sb = fm->occCnts_sb;
-  const int sb_pos = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const uint64_t * occCnts_sb = fm->occCnts_sb;
+  const int64_t sb_pos = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
 
 
   // get the cnt stored at the nearest checkpoint
@@ -218,7 +218,7 @@ fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
   else if ( b_pos !=  sb_pos * (meta->freq_cnt_sb / meta->freq_cnt_b) )
     cnt += FM_OCC_CNT(b, b_pos, c )  ;// b_pos has cumulative counts since the prior sb_pos - if sb_pos references the same count as b_pos, it'll doublecount
 
-  if ( landmark < fm->N || landmark == -1 ) {
+  if ( landmark < (int64_t)fm->N || landmark == -1 ) {
 
     const uint8_t * BWT = fm->BWT;
 
@@ -339,7 +339,7 @@ fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
     cnt  +=   ( up_b == 1 ?  -1 : 1) * ( _mm_extract_epi16(counts_v, 0) );
   }
 
-  if (c==0 && pos >= fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
+  if (c==0 && pos >= (int64_t)fm->term_loc) { // I overcounted 'A' by one, because '$' was replaced with an 'A'
     cnt--;
   }
 
@@ -372,21 +372,21 @@ fm_getOccCount (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c)
  *
  */
 int
-fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt)
+fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int64_t pos, uint8_t c, uint64_t *cnteq, uint64_t *cntlt)
 {
   FM_METADATA *meta = cfg->meta;
-  int i;
+  int64_t i;
   const uint16_t * occCnts_b  = fm->occCnts_b;
-  const uint32_t * occCnts_sb = fm->occCnts_sb;
-  const int b_pos          = (pos+1) / meta->freq_cnt_b; //floor(pos/b_size)   : the b count element preceding pos
-  const int sb_pos         = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
+  const uint64_t * occCnts_sb = fm->occCnts_sb;
+  const int64_t b_pos      = (pos+1) / meta->freq_cnt_b; //floor(pos/b_size)   : the b count element preceding pos
+  const int64_t sb_pos     = (pos+1) / meta->freq_cnt_sb; //floor(pos/sb_size) : the sb count element preceding pos
 
   const int b_rel_pos      = (pos+1) % meta->freq_cnt_b; //  how close is pos to the boundary corresponding to b_pos
   int up_b                 = 2*b_rel_pos/meta->freq_cnt_b; //1 if pos is expected to be closer to the boundary of b_pos+1, 0 otherwise
-  int landmark             = ((b_pos+up_b)*(meta->freq_cnt_b)) - 1 ;
+  int64_t landmark         = ((b_pos+up_b)*(meta->freq_cnt_b)) - 1 ;
 
 
-  if (landmark >= fm->N) { // special case: for a count in the final block, just count from the bottom
+  if (landmark >= (int64_t)fm->N) { // special case: for a count in the final block, just count from the bottom
     up_b      = 0;
     landmark  = (b_pos*(meta->freq_cnt_b)) - 1 ;
   }
@@ -410,7 +410,7 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
 #if   defined (eslENABLE_SSE)
   int j;
 
-  if ( landmark < fm->N - 1 || landmark == -1 ) {
+  if ( landmark < (int64_t)fm->N - 1 || landmark == -1 ) {
 
     const uint8_t * BWT = fm->BWT;
 
@@ -550,6 +550,8 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
       }
 */
     } else { //amino
+      c_v = *(cfg->fm_chars_v + c);
+
       if (!up_b) { // count forward, adding
         for (i=1+landmark ; i+15<(pos+1);  i+=16) { // keep running until i begins a run that shouldn't all be counted
           BWT_v       = *(__m128i*)(BWT+i);
@@ -562,11 +564,11 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
         if (remaining_cnt > 0) {
           BWT_v       = *(__m128i*)(BWT+i);
           tmp_v       = _mm_cmplt_epi8(BWT_v, c_v);  // each byte is all 1s if leq, all zeros otherwise
-          tmp_v       = _mm_and_si128(tmp_v, *(cfg->fm_masks_v + remaining_cnt/4));
+          tmp_v       = _mm_and_si128(tmp_v, *(cfg->fm_masks_v + remaining_cnt));
           counts_v_lt = _mm_subs_epi8(counts_v_lt, tmp_v); // adds 1 for each matching byte  (subtracting negative 1)
 
           BWT_v       = _mm_cmpeq_epi8(BWT_v, c_v);
-          BWT_v       = _mm_and_si128(BWT_v, *(cfg->fm_masks_v + remaining_cnt/4));// mask characters we don't want to count
+          BWT_v       = _mm_and_si128(BWT_v, *(cfg->fm_masks_v + remaining_cnt));// mask characters we don't want to count
           counts_v_eq = _mm_subs_epi8(counts_v_eq, BWT_v);
         }
 
@@ -583,11 +585,11 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
         if (remaining_cnt > 0) {
           BWT_v = *(__m128i*)(BWT+i);
           tmp_v       = _mm_cmplt_epi8(BWT_v, c_v);  // each byte is all 1s if leq, all zeros otherwise
-          tmp_v       = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt/4));
+          tmp_v       = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt));
           counts_v_lt = _mm_subs_epi8(counts_v_lt, tmp_v); // adds 1 for each matching byte  (subtracting negative 1)
 
           BWT_v       = _mm_cmpeq_epi8(BWT_v, c_v);
-          BWT_v       = _mm_and_si128(tmp_v, *(cfg->fm_reverse_masks_v + remaining_cnt/4));// mask characters we don't want to count
+          BWT_v       = _mm_and_si128(BWT_v, *(cfg->fm_reverse_masks_v + remaining_cnt));// mask characters we don't want to count
           //tmp2_v    = _mm_and_si128(tmp2_v, *(cfg->fm_reverse_masks_v + (remaining_cnt+1)/2));
           counts_v_eq = _mm_subs_epi8(counts_v_eq, BWT_v);
         }
@@ -607,7 +609,7 @@ fm_getOccCountLT (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint
   }
 
 
-  if ( pos >= fm->term_loc) {
+  if ( pos >= (int64_t)fm->term_loc) {
     if (c == 0) { // deal with the fact that '$' was replaced with an 'A'
       (*cnteq)--; // I overcounted 'A' by one
       (*cntlt) = 1; // '$' is lexicographically lower than 'A', but I didn't count it in the method above
@@ -1,5 +1,6 @@
 #include <p7_config.h>
 
+#include <math.h>
 #include <string.h>
 
 #include "easel.h"
@@ -125,20 +126,20 @@ FM_mergeSeeds(FM_DIAGLIST *seeds, int N, int ssv_length) {
   *
   * Returns:   <eslOK> on success.
   */
-static uint32_t
-FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int i) {
-  int j = i;
+static uint64_t
+FM_backtrackSeed(const FM_DATA *fmf, const FM_CFG *fm_cfg, int64_t i) {
+  int64_t j = i;
   int len = 0;
   int c;
 
   while ( j != fmf->term_loc && (j % fm_cfg->meta->freq_SA)) { //go until we hit a position in the full SA that was sampled during FM index construction
     c = fm_getChar( fm_cfg->meta->alph_type, j, fmf->BWT);
     j = fm_getOccCount (fmf, fm_cfg, j-1, c);
-    j += abs((int)(fmf->C[c]));
+    j += llabs(fmf->C[c]);
     len++;
   }
 
-  return len + (j==fmf->term_loc ? 0 : fmf->SA[ j / fm_cfg->meta->freq_SA ]) ; // len is how many backward steps we had to take to find a sampled SA position
+  return len + (j==fmf->term_loc ? 0 : FM_SA(fmf, j / fm_cfg->meta->freq_SA)) ; // len is how many backward steps we had to take to find a sampled SA position
 }
 
 /* Function:  FM_getPassingDiags()
@@ -170,7 +171,7 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
             FM_DIAGLIST *seeds
             )
 {
-  int i;
+  int64_t i;
   FM_DIAG *seed;
 
   //iterate over the forward interval, for each entry backtrack until hitting a sampled suffix array entry
@@ -196,8 +197,8 @@ FM_getPassingDiags(const FM_DATA *fmf, const FM_CFG *fm_cfg,
       seed->k -= (depth - 1) ;
 
 
-    seed->sortkey =  (int)( complementarity == p7_COMPLEMENT ? fmf->N + 1 : 0)   // makes complement seeds cover a different score range than non-complements
-                    +  ((int)(seed->n) - (int)(seed->k) )                        // unique diagonal within the complement/non-complement score range
+    seed->sortkey =  (double)( complementarity == p7_COMPLEMENT ? fmf->N + 1 : 0)   // makes complement seeds cover a different score range than non-complements
+                    +  ((double)(seed->n) - (double)(seed->k) )                     // unique diagonal within the complement/non-complement score range
                     + ((double)(seed->k)/(double)(M+1))  ;                       // fractional part, used to sort seeds sharing a diagonal
 
 
@@ -273,7 +274,7 @@ FM_Recurse( int depth, int Kp, int fm_direction,
           next_score = ssvdata->ssv_scores_f[k*Kp + fm_cfg->meta->compl_alph[c]];
           cons_c = fm_cfg->meta->compl_alph[consensus[k]];
         } else {
-          next_score = ssvdata->ssv_scores_f[k*Kp + c];
+          next_score = ssvdata->ssv_scores_f[k*Kp + FM_DSQ(fm_cfg->meta, c)];
           cons_c = consensus[k];
         }
 
@@ -436,6 +437,8 @@ FM_Recurse( int depth, int Kp, int fm_direction,
  *            Kp          - Alphabet size (including ambiguity chars)
  *            sc_threshFM - Score that a short diagonal must pass to warrant extension to a full diagonal
  *            strands     - p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH
+ *            dp_pairs_fwd - space for ssvdata->M * fm_cfg->max_depth diagonals, for the forward direction
+ *            dp_pairs_rev - same, for the reverse direction
  *            seeds       - RETURN: collection of threshold-passing windows
  *
  * Returns:   <eslOK> on success.
@@ -443,28 +446,22 @@ FM_Recurse( int depth, int Kp, int fm_direction,
 static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
                          const FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
                          uint8_t  *consensus, int Kp, float sc_threshFM,
-                         int strands, FM_DIAGLIST *seeds
+                         int strands, FM_DP_PAIR *dp_pairs_fwd, FM_DP_PAIR *dp_pairs_rev,
+                         FM_DIAGLIST *seeds
                  )
 {
   FM_INTERVAL interval_f1, interval_f2, interval_bk;
   int i, k;
-  int status;
   float sc;
   //char         *seq;
 
-  FM_DP_PAIR *dp_pairs_fwd;
-  FM_DP_PAIR *dp_pairs_rev;
-
-  ESL_ALLOC(dp_pairs_fwd, ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR)); // guaranteed to be enough to hold all diagonals
-  ESL_ALLOC(dp_pairs_rev, ssvdata->M * fm_cfg->max_depth * sizeof(FM_DP_PAIR));
-
   //ESL_ALLOC(seq, 50*sizeof(char));
 
   for (i=0; i<fm_cfg->meta->alph_size; i++) {
     int fwd_cnt=0;
     int rev_cnt=0;
     interval_f1.lower = interval_f2.lower = interval_bk.lower = fmf->C[i];
-    interval_f1.upper = interval_f2.upper = interval_bk.upper = abs((int)(fmf->C[i+1]))-1;
+    interval_f1.upper = interval_f2.upper = interval_bk.upper = llabs(fmf->C[i+1])-1;
 
     if (interval_f1.lower<0 ) //none of that character found
       continue;
@@ -479,7 +476,7 @@ static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
     {
 
       if (strands != p7_STRAND_BOTTOMONLY) {
-        sc = ssvdata->ssv_scores_f[k*Kp + i];
+        sc = ssvdata->ssv_scores_f[k*Kp + FM_DSQ(fm_cfg->meta, i)];
         if (sc>0) { // we'll extend any positive-scoring diagonal
           /* fwd on model, fwd on FM (really, reverse on FM, but the FM is on a reversed string, so its fwd*/
           if (k < ssvdata->M-3) { // don't bother starting a forward diagonal so close to the end of the model
@@ -571,13 +568,8 @@ static int FM_getSeeds ( const FM_DATA *fmf, const FM_DATA *fmb,
   //merge duplicates
   FM_mergeSeeds(seeds, fmf->N, fm_cfg->ssv_length);
 
-  free (dp_pairs_fwd);
-  free (dp_pairs_rev);
   //if (seq) free(seq);
   return eslOK;
-
-ERROR:
-  return eslEMEM;
 }
 
 
@@ -700,6 +692,79 @@ FM_extendSeed(FM_DIAG *diag, const FM_DATA *fm, const P7_SCOREDATA *ssvdata, FM_
 }
 
 
+/* Function:  fm_ssvWorkspaceInit()
+ * Synopsis:  Initialize an empty <FM_SSV_WORKSPACE>.
+ *
+ * Purpose:   Nothing is allocated until <p7_SSVFM_longlarget()> first
+ *            needs it.
+ */
+void
+fm_ssvWorkspaceInit(FM_SSV_WORKSPACE *ws)
+{
+  ws->dp_pairs_fwd    = NULL;
+  ws->dp_pairs_rev    = NULL;
+  ws->dp_pairs_alloc  = 0;
+  ws->consensus       = NULL;
+  ws->consensus_alloc = 0;
+  ws->tmp_sq          = NULL;
+  ws->seeds.diags     = NULL;
+  ws->seeds.count     = 0;
+  ws->seeds.size      = 0;
+}
+
+/* Function:  fm_ssvWorkspaceDestroy()
+ * Synopsis:  Free what an <FM_SSV_WORKSPACE> has allocated.
+ *
+ * Purpose:   Free the contents of <ws>, leaving it empty, as if just
+ *            initialized.
+ */
+void
+fm_ssvWorkspaceDestroy(FM_SSV_WORKSPACE *ws)
+{
+  if (ws->dp_pairs_fwd) free(ws->dp_pairs_fwd);
+  if (ws->dp_pairs_rev) free(ws->dp_pairs_rev);
+  if (ws->consensus)    free(ws->consensus);
+  if (ws->tmp_sq)       esl_sq_Destroy(ws->tmp_sq);
+  if (ws->seeds.diags)  free(ws->seeds.diags);
+  fm_ssvWorkspaceInit(ws);
+}
+
+
+/* Function:  fm_setThreshRatio()
+ * Synopsis:  Scale the FM seed score threshold to the query.
+ *
+ * Purpose:   Set <fm_cfg->sc_thresh_ratio> for the query profile <gm>,
+ *            which must be configured. Call for each query, before
+ *            <p7_SSVFM_longlarget()>.
+ *
+ *            Capture a measure of score density multiplied by something
+ *            I conjecture to be related to the expected longest common
+ *            subsequence (sqrt(M)). If less than a default target (7 bits
+ *            of expected LCS), then the requested score threshold will be
+ *            shifted down according to this ratio.
+ *            Xref: ~wheelert/notebook/2014/03-04-FM-time-v-len/00NOTES -- Thu Mar  6 14:40:48 EST 2014
+ */
+void
+fm_setThreshRatio(FM_CFG *fm_cfg, const P7_PROFILE *gm)
+{
+  float best_sc_avg = 0;
+  float max_score;
+  int   i, j;
+
+  for (i = 1; i <= gm->M; i++) {
+    max_score = 0;
+    for (j=0; j<gm->abc->K; j++) {
+      if ( esl_abc_XIsResidue(gm->abc,j) &&  gm->rsc[j][(i) * p7P_NR     + p7P_MSC]   > max_score)   max_score   = gm->rsc[j][(i) * p7P_NR     + p7P_MSC];
+    }
+    best_sc_avg += max_score;
+  }
+  best_sc_avg /= sqrt((double) gm->M);   //that's dividing by M to get score density, then multiplying by sqrt(M) as a proxy for expected LCS
+  best_sc_avg = ESL_MAX(5.0,best_sc_avg); // don't let it get too low, or run time will dramatically suffer
+
+  fm_cfg->sc_thresh_ratio = ESL_MIN(best_sc_avg/7.0, 1.0);
+}
+
+
 /* Function:  p7_SSVFM_longlarget()
  * Synopsis:  Finds windows with SSV scores above given threshold, using FM-index
  *
@@ -717,6 +782,8 @@ FM_extendSeed(FM_DIAG *diag, const FM_DATA *fm, const P7_SCOREDATA *ssvdata, FM_
  *            fm_cfg  - FM-index meta data
  *            ssvdata - compact data required for computing SSV scores
  *            strands     - p7_STRAND_TOPONLY  | p7_STRAND_BOTTOMONLY |  p7_STRAND_BOTH
+ *            r       - random number generator, to pick residues for degenerate consensus positions
+ *            ws      - scratch space, grown here as needed, and kept by the caller for the next call
  *            windowlist - RETURN: collection of SSV-passing windows, with meta data required for downstream stages.
  *
  * Returns:   <eslOK> on success.
@@ -726,7 +793,7 @@ FM_extendSeed(FM_DIAG *diag, const FM_DATA *fm, const P7_SCOREDATA *ssvdata, FM_
 int
 p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
          const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
-         int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist)
+         int strands, ESL_RANDOMNESS *r, FM_SSV_WORKSPACE *ws, P7_HMM_WINDOWLIST *windowlist)
 {
   float sc_thresh, sc_threshFM;
   float invP;
@@ -744,16 +811,44 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
 
   ESL_SQ   *tmp_sq;
   uint8_t  *consensus;
+  int64_t   ndp = (int64_t) ssvdata->M * fm_cfg->max_depth;  // guaranteed to be enough to hold all diagonals
+
 
+  FM_DIAGLIST *seeds;
+  int          status;
 
-  FM_DIAGLIST seeds;
-  int         status;
-  status = fm_initSeeds(&seeds);
-  if (status != eslOK)
-    ESL_EXCEPTION(eslEMEM, "Error allocating memory for seed list\n");
+  /* an amino index has no complement, so only its top strand can be searched */
+  if (fm_cfg->meta->compl_alph == NULL)
+    strands = p7_STRAND_TOPONLY;
+
+  /* grow the workspace, if this model or alphabet needs more than the last one */
+  if (ws->seeds.diags == NULL) {
+    status = fm_initSeeds(&(ws->seeds));
+    if (status != eslOK)
+      ESL_EXCEPTION(eslEMEM, "Error allocating memory for seed list\n");
+  }
+  seeds = &(ws->seeds);
+  seeds->count = 0;
+
+  if (ndp > ws->dp_pairs_alloc) {
+    ESL_REALLOC(ws->dp_pairs_fwd, ndp * sizeof(FM_DP_PAIR));
+    ESL_REALLOC(ws->dp_pairs_rev, ndp * sizeof(FM_DP_PAIR));
+    ws->dp_pairs_alloc = ndp;
+  }
+  if (om->M+1 > ws->consensus_alloc) {
+    ESL_REALLOC(ws->consensus, (om->M+1)*sizeof(uint8_t) );
+    ws->consensus_alloc = om->M+1;
+  }
+  if (ws->tmp_sq != NULL && ws->tmp_sq->abc != om->abc) {
+    esl_sq_Destroy(ws->tmp_sq);
+    ws->tmp_sq = NULL;
+  }
+  if (ws->tmp_sq == NULL && (ws->tmp_sq = esl_sq_CreateDigital(om->abc)) == NULL) goto ERROR;
+
+  consensus = ws->consensus;
+  tmp_sq    = ws->tmp_sq;
 
   /* convert the consensus to a collection of ints, so I can test for runs of identity to the consensus */
-  ESL_ALLOC(consensus, (om->M+1)*sizeof(uint8_t) );
   for (i=1; i<=om->M; i++) {
     consensus[i] = om->abc->inmap[(int)(om->consensus[i])];
     if (consensus[i] > om->abc->K)
@@ -768,8 +863,6 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
   p7_bg_SetLength(bg, om->max_length);
   p7_bg_NullOne  (bg, NULL, om->max_length, &nullsc);
 
-  tmp_sq   =  esl_sq_CreateDigital(om->abc);
-
   /*
    * Computing the score required to let P meet the F1 prob threshold
    * In original code, converting from an SSV score S (the score getting
@@ -799,26 +892,20 @@ p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
   sc_threshFM = fm_cfg->scthreshFM * fm_cfg->sc_thresh_ratio;
 
   //get diagonals that score above sc_threshFM
-  status = FM_getSeeds(fmf, fmb, fm_cfg, ssvdata, consensus, om->abc->Kp, sc_threshFM, strands, &seeds );
-  if (status != eslOK)
-    ESL_EXCEPTION(eslEMEM, "Error allocating memory for seed computation\n");
+  FM_getSeeds(fmf, fmb, fm_cfg, ssvdata, consensus, om->abc->Kp, sc_threshFM, strands, ws->dp_pairs_fwd, ws->dp_pairs_rev, seeds );
 
   //now extend those diagonals to find ones scoring above sc_thresh
-  for(i=0; i<seeds.count; i++) {
-    FM_extendSeed( seeds.diags+i, fmf, ssvdata, fm_cfg, tmp_sq);
+  for(i=0; i<seeds->count; i++) {
+    FM_extendSeed( seeds->diags+i, fmf, ssvdata, fm_cfg, tmp_sq);
   }
 
-  for(i=0; i<seeds.count; i++) {
-    diag = seeds.diags+i;
+  for(i=0; i<seeds->count; i++) {
+    diag = seeds->diags+i;
     if (diag->score >= sc_thresh)
       FM_window_from_diag(diag, fmf, fm_cfg->meta, windowlist );
 
   }
 
-  esl_sq_Destroy(tmp_sq);
-
-  free(seeds.diags);
-  free(consensus);
   return eslEOF;
 
 ERROR:
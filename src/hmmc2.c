@@ -80,6 +80,7 @@ static ESL_OPTIONS searchOpts[] = {
   /* Other options */
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",               12 },
+  { "--bands",      eslARG_NONE,        NULL,  NULL, NULL,    NULL,  NULL, "--max",          "decode domains inside their posterior bands",                 12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--hmmdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
@@ -143,6 +144,7 @@ output_header(FILE *ofp, const ESL_GETOPTS *sopt, char *seqfile, char *banner)
   if (esl_opt_IsUsed(sopt, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(sopt, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(sopt, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(sopt, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(sopt, "--bands")     && fprintf(ofp, "# banded domain decoding:          on\n")                                                   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(sopt, "--EmL")       && fprintf(ofp, "# seq length, MSV Gumbel mu fit:   %d\n",            esl_opt_GetInteger(sopt, "--EmL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(sopt, "--EmN")       && fprintf(ofp, "# seq number, MSV Gumbel mu fit:   %d\n",            esl_opt_GetInteger(sopt, "--EmN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(sopt, "--EvL")       && fprintf(ofp, "# seq length, Vit Gumbel mu fit:   %d\n",            esl_opt_GetInteger(sopt, "--EvL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -330,8 +332,14 @@ int main(int argc, char *argv[])
         exit(1);
       }
 
-      n = sizeof(sstatus);
-      if ((size = readn(sock, &sstatus, n)) == -1) {
+      buf = malloc(HMMD_SEARCH_STATUS_SERIAL_SIZE);
+      buf_offset = 0;
+      n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
+      if (buf == NULL) {
+        fprintf(stderr, "[%s:%d] malloc error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
+        exit(1);
+      }
+      if ((size = readn(sock, buf, n)) == -1) {
         //printf("MY ERRNO IS %d\n", errno);
         if(errno == ECONNRESET || errno == ESRCH || errno == EPERM || errno == 0) {
           // when daemon is shut down normally, the readn() is expected to fail - but w/ various errors, depending on OS, etc. 
@@ -343,17 +351,24 @@ int main(int argc, char *argv[])
         fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
         exit(1);
       }
+      if (hmmd_search_status_Deserialize(buf, &buf_offset, &sstatus) != eslOK) {
+        fprintf(stderr, "[%s:%d] Couldn't deserialize sstatus\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      free(buf);
 
-      if (sstatus.status != eslOK) {
-        char *ebuf;
+      /* !shutdown answers with a bare status; !stats with the metrics as its message */
+      if (sstatus.msg_size > 0) {
+        char *mbuf;
         n = sstatus.msg_size;
-        ebuf = malloc(n);
-        if ((size = readn(sock, ebuf, n)) == -1) {
+        mbuf = malloc(n);
+        if ((size = readn(sock, mbuf, n)) == -1) {
           fprintf(stderr, "[%s:%d] read error %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
           exit(1);
         }
-        fprintf(stderr, "ERROR (%d): %s\n", sstatus.status, ebuf);
-        free(ebuf);
+        if (sstatus.status != eslOK) fprintf(stderr, "ERROR (%d): %s\n", sstatus.status, mbuf);
+        else                         fputs(mbuf, stdout);
+        free(mbuf);
       }
 
       continue;
@@ -442,6 +457,7 @@ int main(int argc, char *argv[])
             exit(1);
           }
           fprintf(stderr, "ERROR (%d): %s\n", sstatus.status, ebuf);
+          if (sstatus.retry_after > 0) fprintf(stderr, "The server is busy; try again in %" PRIu32 " seconds\n", sstatus.retry_after);
           free(ebuf);
           goto COMPLETE;
         }
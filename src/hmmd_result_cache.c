@@ -0,0 +1,893 @@
+/* HMMD_RESULT_CACHE: the hmmpgmd master's cache of search results.
+ *
+ * Web clients often send the same search again (a page reloaded, the
+ * same sequence pasted by several users). The master keeps the bytes
+ * it sent back for recent searches -- the serialized
+ * HMMD_SEARCH_STATUS, HMMD_SEARCH_STATS and hits, exactly as they
+ * went down the socket -- and sends them again when the same query,
+ * with the same options, comes in for the same database, without
+ * handing anything to the workers.
+ *
+ * A search is known by its database id, its options that differ from
+ * their defaults, and the query itself, and found by a 64-bit hash
+ * of them; see hmmd_result_cache_Key(). The cache keeps the least recently
+ * used results in memory up to a limit; past it, the oldest are
+ * written to files in a spill directory, if there is one, up to a
+ * second limit, or dropped. Results read back from a file move back
+ * into memory. hmmd_result_cache_Clear() forgets everything, for
+ * when the databases are reloaded.
+ *
+ * Contents:
+ *    1. The HMMD_RESULT_CACHE object.
+ *    2. Lookup keys.
+ *    3. Internal functions.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "hmmpgmd.h"
+
+#define CACHE_NBUCKETS 4096	/* hash buckets; a power of 2 */
+#define FNV_OFFSET     UINT64_C(0xcbf29ce484222325)
+#define FNV_PRIME      UINT64_C(0x100000001b3)
+
+/* One cached result: in memory if <data> is set, else in its spill file.
+ * Its key stays in memory either way.
+ */
+typedef struct cache_entry_s {
+  uint64_t              id;	/* serial number, naming its spill file          */
+  uint64_t              hash;	/* hash of its key, picking its bucket           */
+  uint8_t              *kmem;	/* the key, compared in full on lookup           */
+  uint64_t              nkey;
+  uint64_t              size;	/* bytes of serialized result                   */
+  uint8_t              *data;	/* the bytes, or NULL if spilled to disk         */
+  struct cache_entry_s *prev;	/* LRU list of its tier, most recent at the head */
+  struct cache_entry_s *next;
+  struct cache_entry_s *chain;	/* next entry in the same hash bucket            */
+} CACHE_ENTRY;
+
+typedef struct {
+  CACHE_ENTRY *head;
+  CACHE_ENTRY *tail;
+  uint64_t     size;		/* total bytes of the results and keys on the list */
+  uint64_t     max;
+} CACHE_LRU;
+
+struct hmmd_result_cache_s {
+  pthread_mutex_t  mutex;
+  CACHE_ENTRY    **bucket;	/* [0..CACHE_NBUCKETS-1] hash chains */
+  CACHE_LRU        mem;
+  CACHE_LRU        disk;
+  char            *spill_dir;	/* NULL if results are never spilled */
+  uint64_t         nextid;	/* serial number of the next entry   */
+
+  uint64_t         nhits;
+  uint64_t         nmisses;
+  uint64_t         nspilled;
+};
+
+static CACHE_ENTRY *find_entry   (HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key);
+static void         remove_entry (HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e);
+static void         lru_push     (CACHE_LRU *lru, CACHE_ENTRY *e);
+static void         lru_unlink   (CACHE_LRU *lru, CACHE_ENTRY *e);
+static void         evict_mem    (HMMD_RESULT_CACHE *cache);
+static void         evict_disk   (HMMD_RESULT_CACHE *cache);
+static int          spill_path   (HMMD_RESULT_CACHE *cache, uint64_t id, char *path, size_t n);
+static int          spill_write  (HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e);
+static int          spill_read   (HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e);
+
+
+/*****************************************************************
+ * 1. The HMMD_RESULT_CACHE object.
+ *****************************************************************/
+
+/* Function:  hmmd_result_cache_Create()
+ * Synopsis:  Create an empty result cache.
+ *
+ * Purpose:   Create a cache that keeps up to <max_mem> bytes of results
+ *            in memory. If <spill_dir> is non-NULL, results pushed out
+ *            of memory are written to files in that directory, up to
+ *            <max_disk> bytes, instead of being dropped. The directory
+ *            must exist and be writable. The keys of the results are
+ *            kept in memory, and count against the limit of the tier
+ *            their result is in.
+ *
+ * Returns:   a pointer to the new cache.
+ *
+ * Throws:    <NULL> on allocation or pthreads failure.
+ */
+HMMD_RESULT_CACHE *
+hmmd_result_cache_Create(uint64_t max_mem, const char *spill_dir, uint64_t max_disk)
+{
+  HMMD_RESULT_CACHE *cache = NULL;
+  int                status;
+
+  ESL_ALLOC(cache, sizeof(HMMD_RESULT_CACHE));
+  cache->bucket    = NULL;
+  cache->spill_dir = NULL;
+  cache->mem.head  = cache->mem.tail  = NULL;
+  cache->disk.head = cache->disk.tail = NULL;
+  cache->mem.size  = cache->disk.size = 0;
+  cache->mem.max   = max_mem;
+  cache->disk.max  = (spill_dir != NULL) ? max_disk : 0;
+  cache->nhits     = 0;
+  cache->nmisses   = 0;
+  cache->nspilled  = 0;
+  cache->nextid    = 0;
+
+  ESL_ALLOC(cache->bucket, sizeof(CACHE_ENTRY *) * CACHE_NBUCKETS);
+  memset(cache->bucket, 0, sizeof(CACHE_ENTRY *) * CACHE_NBUCKETS);
+  if (spill_dir != NULL && (status = esl_strdup(spill_dir, -1, &cache->spill_dir)) != eslOK) goto ERROR;
+
+  if (pthread_mutex_init(&cache->mutex, NULL) != 0) goto ERROR;
+  return cache;
+
+ ERROR:
+  if (cache != NULL) {
+    if (cache->bucket)    free(cache->bucket);
+    if (cache->spill_dir) free(cache->spill_dir);
+    free(cache);
+  }
+  return NULL;
+}
+
+/* Function:  hmmd_result_cache_Destroy()
+ * Synopsis:  Free a result cache, and remove its spill files.
+ */
+void
+hmmd_result_cache_Destroy(HMMD_RESULT_CACHE *cache)
+{
+  if (cache == NULL) return;
+
+  hmmd_result_cache_Clear(cache);
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache->bucket);
+  if (cache->spill_dir) free(cache->spill_dir);
+  free(cache);
+}
+
+/* Function:  hmmd_result_cache_Get()
+ * Synopsis:  Look up the result of a search.
+ *
+ * Purpose:   Look for the result stored under <key>: one with the
+ *            same hash and the same key material. If it's there,
+ *            return a copy of its bytes in <*ret_data>, which the
+ *            caller frees, and their number in <*ret_size>. A result
+ *            read back from the spill directory moves back into
+ *            memory.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENOTFOUND> if there is no result for <key>, or it
+ *            could not be read back from its spill file; <*ret_data>
+ *            is NULL and <*ret_size> 0.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+hmmd_result_cache_Get(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key, uint8_t **ret_data, uint64_t *ret_size)
+{
+  CACHE_ENTRY *e;
+  uint8_t     *data = NULL;
+  int          status;
+
+  *ret_data = NULL;
+  *ret_size = 0;
+
+  if (pthread_mutex_lock(&cache->mutex) != 0) ESL_EXCEPTION(eslESYS, "mutex lock failed");
+
+  if ((e = find_entry(cache, key)) != NULL && e->data == NULL) {
+    /* spilled: bring it back into memory, or forget it if the file is gone */
+    lru_unlink(&cache->disk, e);
+    if (spill_read(cache, e) != eslOK) {
+      remove_entry(cache, e);
+      e = NULL;
+    } else {
+      lru_push(&cache->mem, e);
+      evict_mem(cache);
+      if (e->data == NULL) e = NULL; /* pushed straight back out: bigger than memory */
+    }
+  } else if (e != NULL) {
+    lru_unlink(&cache->mem, e);
+    lru_push(&cache->mem, e);
+  }
+
+  if (e == NULL) {
+    cache->nmisses++;
+    pthread_mutex_unlock(&cache->mutex);
+    return eslENOTFOUND;
+  }
+
+  if ((data = malloc(e->size)) == NULL) { status = eslEMEM; goto ERROR; }
+  memcpy(data, e->data, e->size);
+  *ret_data = data;
+  *ret_size = e->size;
+  cache->nhits++;
+
+  pthread_mutex_unlock(&cache->mutex);
+  return eslOK;
+
+ ERROR:
+  pthread_mutex_unlock(&cache->mutex);
+  return status;
+}
+
+/* Function:  hmmd_result_cache_Put()
+ * Synopsis:  Store the result of a search.
+ *
+ * Purpose:   Store a copy of the <size> bytes of <data> under <key>,
+ *            pushing the least recently used results out to the spill
+ *            directory, or out of the cache, to make room. A result
+ *            that, with its key, is larger than the memory limit isn't
+ *            stored; nor is one that's already there.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; the cache is unchanged.
+ */
+int
+hmmd_result_cache_Put(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key, const uint8_t *data, uint64_t size)
+{
+  CACHE_ENTRY *e = NULL;
+  int          status;
+
+  if (size == 0 || size + key->n > cache->mem.max) return eslOK;
+
+  ESL_ALLOC(e, sizeof(CACHE_ENTRY));
+  e->data = NULL;
+  e->kmem = NULL;
+  ESL_ALLOC(e->data, size);
+  ESL_ALLOC(e->kmem, key->n);
+  memcpy(e->data, data, size);
+  memcpy(e->kmem, key->mem, key->n);
+  e->hash = key->hash;
+  e->nkey = key->n;
+  e->size = size;
+
+  if (pthread_mutex_lock(&cache->mutex) != 0) { status = eslESYS; goto ERROR; }
+  if (find_entry(cache, key) != NULL) {
+    /* a client sent the same search again before the first one finished */
+    pthread_mutex_unlock(&cache->mutex);
+    free(e->data);
+    free(e->kmem);
+    free(e);
+    return eslOK;
+  }
+
+  e->id    = cache->nextid++;
+  e->chain = cache->bucket[e->hash & (CACHE_NBUCKETS-1)];
+  cache->bucket[e->hash & (CACHE_NBUCKETS-1)] = e;
+  lru_push(&cache->mem, e);
+  evict_mem(cache);
+
+  pthread_mutex_unlock(&cache->mutex);
+  return eslOK;
+
+ ERROR:
+  if (e != NULL) {
+    if (e->data) free(e->data);
+    if (e->kmem) free(e->kmem);
+    free(e);
+  }
+  return status;
+}
+
+/* Function:  hmmd_result_cache_Clear()
+ * Synopsis:  Forget all the results in a cache.
+ *
+ * Purpose:   Drop every result in <cache> and remove its spill files;
+ *            called when the master reloads its databases, since the
+ *            results of searches of the old ones are no longer right.
+ *            The hit and miss counts are kept.
+ */
+void
+hmmd_result_cache_Clear(HMMD_RESULT_CACHE *cache)
+{
+  CACHE_ENTRY *e;
+  int          b;
+
+  pthread_mutex_lock(&cache->mutex);
+  for (b = 0; b < CACHE_NBUCKETS; b++)
+    while ((e = cache->bucket[b]) != NULL) {
+      if (e->data == NULL) lru_unlink(&cache->disk, e);
+      else                 lru_unlink(&cache->mem,  e);
+      remove_entry(cache, e);
+    }
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+/* Function:  hmmd_result_cache_GetCounts()
+ * Synopsis:  Get a cache's usage counts.
+ *
+ * Purpose:   Return the number of lookups that found a result in
+ *            <*opt_nhits>, the number that didn't in <*opt_nmisses>,
+ *            and the bytes of results now held in memory and on disk
+ *            in <*opt_memsize> and <*opt_disksize>. Any of them may be
+ *            NULL.
+ */
+void
+hmmd_result_cache_GetCounts(HMMD_RESULT_CACHE *cache, uint64_t *opt_nhits, uint64_t *opt_nmisses, uint64_t *opt_memsize, uint64_t *opt_disksize)
+{
+  pthread_mutex_lock(&cache->mutex);
+  if (opt_nhits)    *opt_nhits    = cache->nhits;
+  if (opt_nmisses)  *opt_nmisses  = cache->nmisses;
+  if (opt_memsize)  *opt_memsize  = cache->mem.size;
+  if (opt_disksize) *opt_disksize = cache->disk.size;
+  pthread_mutex_unlock(&cache->mutex);
+}
+/*--------------- end, HMMD_RESULT_CACHE object -----------------*/
+
+
+
+/*****************************************************************
+ * 2. Lookup keys.
+ *****************************************************************/
+
+/* Append <n> bytes at <p> to the key material */
+static int
+key_bytes(HMMD_CACHE_KEY *key, const void *p, size_t n)
+{
+  int status;
+
+  if (key->n + n > key->nalloc) {
+    key->nalloc = ESL_MAX(2 * key->nalloc, key->n + n);
+    ESL_REALLOC(key->mem, key->nalloc);
+  }
+  memcpy(key->mem + key->n, p, n);
+  key->n += n;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+/* a string and its terminator, so that "ab","c" and "a","bc" differ */
+static int
+key_string(HMMD_CACHE_KEY *key, const char *s)
+{
+  return (s == NULL) ? key_bytes(key, "", 1) : key_bytes(key, s, strlen(s)+1);
+}
+
+static int
+key_options(HMMD_CACHE_KEY *key, const ESL_GETOPTS *go)
+{
+  const char *val;
+  const char *def;
+  double      x;
+  long        i;
+  int         o;
+  int         status;
+
+  /* Options equal to their defaults are left out, whether the client
+   * gave them or not, and numbers are kept by value, so "-E 10.0"
+   * is the same search as no -E at all. The table order makes the
+   * order the client gave them in irrelevant.
+   */
+  for (o = 0; o < go->nopts; o++) {
+    val = go->val[o];
+    def = go->opt[o].defval;
+    if (esl_strcmp(val, def) == 0) continue;
+    if (strcmp(go->opt[o].name, "--batch") == 0) continue; /* queueing, not searching */
+
+    switch (go->opt[o].type) {
+    case eslARG_INT:
+      i = (val != NULL) ? strtol(val, NULL, 10) : 0;
+      if (def != NULL && i == strtol(def, NULL, 10)) continue;
+      if ((status = key_string(key, go->opt[o].name)) != eslOK) return status;
+      if ((status = key_bytes (key, &i, sizeof(i)))   != eslOK) return status;
+      break;
+    case eslARG_REAL:
+      x = (val != NULL) ? strtod(val, NULL) : 0.0;
+      if (def != NULL && x == strtod(def, NULL)) continue;
+      if ((status = key_string(key, go->opt[o].name)) != eslOK) return status;
+      if ((status = key_bytes (key, &x, sizeof(x)))   != eslOK) return status;
+      break;
+    default:
+      if ((status = key_string(key, go->opt[o].name)) != eslOK) return status;
+      if ((status = key_string(key, val))             != eslOK) return status;
+      break;
+    }
+  }
+  return eslOK;
+}
+
+static int
+key_hmm(HMMD_CACHE_KEY *key, const P7_HMM *hmm)
+{
+  int K = hmm->abc->K;
+  int status;
+
+  if ((status = key_bytes (key, &hmm->abc->type,  sizeof(hmm->abc->type)))                       != eslOK) return status;
+  if ((status = key_bytes (key, &hmm->M,          sizeof(hmm->M)))                               != eslOK) return status;
+  if ((status = key_bytes (key, &hmm->flags,      sizeof(hmm->flags)))                           != eslOK) return status;
+  if ((status = key_bytes (key, hmm->t[0],        sizeof(float) * (hmm->M+1) * p7H_NTRANSITIONS)) != eslOK) return status;
+  if ((status = key_bytes (key, hmm->mat[0],      sizeof(float) * (hmm->M+1) * K))               != eslOK) return status;
+  if ((status = key_bytes (key, hmm->ins[0],      sizeof(float) * (hmm->M+1) * K))               != eslOK) return status;
+  if ((status = key_string(key, hmm->name))                                                      != eslOK) return status;
+  if ((status = key_string(key, hmm->acc))                                                       != eslOK) return status;
+  if ((status = key_string(key, hmm->desc))                                                      != eslOK) return status;
+  if ((status = key_string(key, (hmm->flags & p7H_RF)    ? hmm->rf        : NULL))                != eslOK) return status;
+  if ((status = key_string(key, (hmm->flags & p7H_MMASK) ? hmm->mm        : NULL))                != eslOK) return status;
+  if ((status = key_string(key, (hmm->flags & p7H_CONS)  ? hmm->consensus : NULL))                != eslOK) return status;
+  if ((status = key_string(key, (hmm->flags & p7H_CS)    ? hmm->cs        : NULL))                != eslOK) return status;
+  if ((status = key_string(key, (hmm->flags & p7H_CA)    ? hmm->ca        : NULL))                != eslOK) return status;
+  if ((status = key_bytes (key, &hmm->nseq,       sizeof(hmm->nseq)))                            != eslOK) return status;
+  if ((status = key_bytes (key, &hmm->eff_nseq,   sizeof(hmm->eff_nseq)))                        != eslOK) return status;
+  if ((status = key_bytes (key, &hmm->max_length, sizeof(hmm->max_length)))                      != eslOK) return status;
+  if ((status = key_bytes (key, hmm->evparam,     sizeof(float) * p7_NEVPARAM))                  != eslOK) return status;
+  if ((status = key_bytes (key, hmm->cutoff,      sizeof(float) * p7_NCUTOFFS))                  != eslOK) return status;
+  if ((status = key_bytes (key, hmm->compo,       sizeof(float) * p7_MAXABET))                   != eslOK) return status;
+  return eslOK;
+}
+
+static int
+key_seq(HMMD_CACHE_KEY *key, const ESL_SQ *sq)
+{
+  int status;
+
+  if ((status = key_bytes (key, &sq->abc->type, sizeof(sq->abc->type))) != eslOK) return status;
+  if ((status = key_bytes (key, &sq->n,         sizeof(sq->n)))         != eslOK) return status;
+  if ((status = key_string(key, sq->name))                              != eslOK) return status;
+  if ((status = key_string(key, sq->desc))                              != eslOK) return status;
+  if ((status = key_bytes (key, sq->dsq,        sq->n + 2))             != eslOK) return status;
+  return eslOK;
+}
+
+/* 64-bit FNV-1a */
+static uint64_t
+hash_bytes(const uint8_t *s, uint64_t n)
+{
+  uint64_t h = FNV_OFFSET;
+
+  while (n--) {
+    h ^= *s++;
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+/* Function:  hmmd_result_cache_Key()
+ * Synopsis:  Make the result cache key of a search.
+ *
+ * Purpose:   Return the key of the search <query> of the database
+ *            known as <dbid>: <dbid>, the type of search, the options
+ *            in <query->opts> that differ from their defaults, and the
+ *            query sequence or profile, written out one after another
+ *            in a normal form, and a 64-bit hash of them. The caller
+ *            makes <dbid> unique to the database's contents, e.g. by
+ *            adding the master's database version to it, so that no
+ *            result of a search of an old database is found for a
+ *            search of a new one.
+ *
+ *            The profile is written field by field, not as the bytes
+ *            it was sent in, which include pointers that differ from
+ *            one client command to the next.
+ *
+ *            The hash only picks a bucket and narrows the search;
+ *            <hmmd_result_cache_Get()> returns a result only if the
+ *            whole key is the same, so two searches whose hashes
+ *            collide can't get each other's results.
+ *
+ * Returns:   a pointer to the new key. Caller frees it with
+ *            <hmmd_cache_key_Destroy()>.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+HMMD_CACHE_KEY *
+hmmd_result_cache_Key(const QUEUE_DATA *query, const char *dbid)
+{
+  HMMD_CACHE_KEY *key = NULL;
+  int             status;
+
+  ESL_ALLOC(key, sizeof(HMMD_CACHE_KEY));
+  key->hash   = 0;
+  key->n      = 0;
+  key->nalloc = 1024;
+  key->mem    = NULL;
+  ESL_ALLOC(key->mem, key->nalloc);
+
+  if ((status = key_string (key, dbid))                                         != eslOK) goto ERROR;
+  if ((status = key_bytes  (key, &query->cmd_type, sizeof(query->cmd_type)))    != eslOK) goto ERROR;
+  if ((status = key_bytes  (key, &query->dbx,      sizeof(query->dbx)))         != eslOK) goto ERROR;
+  if ((status = key_options(key, query->opts))                                  != eslOK) goto ERROR;
+  if (query->query_type == HMMD_SEQUENCE) status = key_seq(key, query->seq);
+  else                                    status = key_hmm(key, query->hmm);
+  if (status != eslOK) goto ERROR;
+
+  key->hash = hash_bytes(key->mem, key->n);
+  return key;
+
+ ERROR:
+  hmmd_cache_key_Destroy(key);
+  return NULL;
+}
+
+/* Function:  hmmd_cache_key_Destroy()
+ * Synopsis:  Free a result cache key.
+ */
+void
+hmmd_cache_key_Destroy(HMMD_CACHE_KEY *key)
+{
+  if (key == NULL) return;
+  if (key->mem) free(key->mem);
+  free(key);
+}
+/*------------------- end, lookup keys --------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Internal functions.
+ *****************************************************************/
+
+static CACHE_ENTRY *
+find_entry(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key)
+{
+  CACHE_ENTRY *e;
+
+  for (e = cache->bucket[key->hash & (CACHE_NBUCKETS-1)]; e != NULL; e = e->chain)
+    if (e->hash == key->hash && e->nkey == key->n && memcmp(e->kmem, key->mem, key->n) == 0) return e;
+  return NULL;
+}
+
+/* Take <e>, already off its LRU list, out of the hash table, remove
+ * its spill file if it has one, and free it.
+ */
+static void
+remove_entry(HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e)
+{
+  CACHE_ENTRY **pp;
+  char          path[1024];
+
+  for (pp = &cache->bucket[e->hash & (CACHE_NBUCKETS-1)]; *pp != e; pp = &(*pp)->chain) ;
+  *pp = e->chain;
+
+  if (e->data != NULL) free(e->data);
+  else if (spill_path(cache, e->id, path, sizeof(path)) == eslOK) unlink(path);
+  free(e->kmem);
+  free(e);
+}
+
+static void
+lru_push(CACHE_LRU *lru, CACHE_ENTRY *e)
+{
+  e->prev = NULL;
+  e->next = lru->head;
+  if (lru->head != NULL) lru->head->prev = e;
+  else                   lru->tail       = e;
+  lru->head  = e;
+  lru->size += e->size + e->nkey;
+}
+
+static void
+lru_unlink(CACHE_LRU *lru, CACHE_ENTRY *e)
+{
+  if (e->prev != NULL) e->prev->next = e->next;
+  else                 lru->head     = e->next;
+  if (e->next != NULL) e->next->prev = e->prev;
+  else                 lru->tail     = e->prev;
+  e->prev = e->next = NULL;
+  lru->size -= e->size + e->nkey;
+}
+
+/* Push the least recently used results out of memory until the rest
+ * fit: to the spill directory if there's room there, else away.
+ */
+static void
+evict_mem(HMMD_RESULT_CACHE *cache)
+{
+  CACHE_ENTRY *e;
+
+  while (cache->mem.size > cache->mem.max && (e = cache->mem.tail) != NULL) {
+    lru_unlink(&cache->mem, e);
+    if (cache->spill_dir != NULL && e->size + e->nkey <= cache->disk.max && spill_write(cache, e) == eslOK) {
+      free(e->data);
+      e->data = NULL;
+      lru_push(&cache->disk, e);
+      cache->nspilled++;
+      evict_disk(cache);
+    } else {
+      remove_entry(cache, e);
+    }
+  }
+}
+
+static void
+evict_disk(HMMD_RESULT_CACHE *cache)
+{
+  CACHE_ENTRY *e;
+
+  while (cache->disk.size > cache->disk.max && (e = cache->disk.tail) != NULL) {
+    lru_unlink(&cache->disk, e);
+    remove_entry(cache, e);
+  }
+}
+
+/* Spill files are named for the process as well as the entry's
+ * serial number (not its hash, which another entry may share), so
+ * that two daemons can share a directory, and one doesn't pick up
+ * files a dead one left behind.
+ */
+static int
+spill_path(HMMD_RESULT_CACHE *cache, uint64_t id, char *path, size_t n)
+{
+  int len;
+
+  if (cache->spill_dir == NULL) return eslEINVAL;
+  len = snprintf(path, n, "%s/hmmpgmd-%ld-%016" PRIx64 ".res", cache->spill_dir, (long) getpid(), id);
+  return (len > 0 && (size_t) len < n) ? eslOK : eslEINVAL;
+}
+
+static int
+spill_write(HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e)
+{
+  char  path[1024];
+  FILE *fp;
+
+  if (spill_path(cache, e->id, path, sizeof(path)) != eslOK) return eslEINVAL;
+  if ((fp = fopen(path, "wb")) == NULL) {
+    p7_syslog(LOG_ERR,"[%s:%d] - opening %s error %d - %s\n", __FILE__, __LINE__, path, errno, strerror(errno));
+    return eslEWRITE;
+  }
+  if (fwrite(e->data, 1, e->size, fp) != e->size) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, path, errno, strerror(errno));
+    fclose(fp);
+    unlink(path);
+    return eslEWRITE;
+  }
+  if (fclose(fp) != 0) {
+    unlink(path);
+    return eslEWRITE;
+  }
+  return eslOK;
+}
+
+/* Read <e>'s bytes back from its spill file, and remove the file */
+static int
+spill_read(HMMD_RESULT_CACHE *cache, CACHE_ENTRY *e)
+{
+  char     path[1024];
+  FILE    *fp;
+  uint8_t *data = NULL;
+
+  if (spill_path(cache, e->id, path, sizeof(path)) != eslOK) return eslEINVAL;
+  if ((fp = fopen(path, "rb")) == NULL) return eslENOTFOUND;
+  if ((data = malloc(e->size)) == NULL) { fclose(fp); return eslEMEM; }
+  if (fread(data, 1, e->size, fp) != e->size) {
+    p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, path, errno, strerror(errno));
+    fclose(fp);
+    free(data);
+    return eslEFORMAT;
+  }
+  fclose(fp);
+  unlink(path);
+  e->data = data;
+  return eslOK;
+}
+/*------------------ end, internal functions --------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef p7HMMD_RESULT_CACHE_TESTDRIVE
+#include "esl_random.h"
+
+static void
+fill(uint8_t *buf, uint64_t size, uint64_t key)
+{
+  uint64_t i;
+  for (i = 0; i < size; i++) buf[i] = (uint8_t) ((key * 31 + i) & 0xff);
+}
+
+/* The test key for number <key>: its bytes, with a hash that one
+ * key in three shares, so that lookups have to compare keys in full.
+ */
+static HMMD_CACHE_KEY *
+make_key(uint64_t key)
+{
+  HMMD_CACHE_KEY *k;
+
+  if ((k = malloc(sizeof(HMMD_CACHE_KEY))) == NULL)   esl_fatal("malloc failed");
+  if ((k->mem = malloc(sizeof(uint64_t)))  == NULL)   esl_fatal("malloc failed");
+  memcpy(k->mem, &key, sizeof(uint64_t));
+  k->n      = k->nalloc = sizeof(uint64_t);
+  k->hash   = key % 3;
+  return k;
+}
+
+static int
+put(HMMD_RESULT_CACHE *cache, uint64_t key, const uint8_t *data, uint64_t size)
+{
+  HMMD_CACHE_KEY *k = make_key(key);
+  int             status;
+
+  status = hmmd_result_cache_Put(cache, k, data, size);
+  hmmd_cache_key_Destroy(k);
+  return status;
+}
+
+static int
+check(HMMD_RESULT_CACHE *cache, uint64_t key, uint64_t size)
+{
+  HMMD_CACHE_KEY *k    = make_key(key);
+  uint8_t        *data = NULL;
+  uint8_t        *want = NULL;
+  uint64_t        n;
+  int             ok;
+
+  if (hmmd_result_cache_Get(cache, k, &data, &n) != eslOK) { hmmd_cache_key_Destroy(k); return FALSE; }
+  if ((want = malloc(size)) == NULL) esl_fatal("malloc failed");
+  fill(want, size, key);
+  ok = (n == size && memcmp(data, want, size) == 0);
+  free(want);
+  free(data);
+  hmmd_cache_key_Destroy(k);
+  return ok;
+}
+
+/* With room for <nfit> results in memory and none on disk, the least
+ * recently used ones are dropped, and a lookup makes a result recent.
+ */
+static void
+utest_lru(void)
+{
+  char               msg[]  = "result cache LRU unit test failed";
+  uint64_t           size   = 1000;
+  int                nfit   = 10;
+  uint64_t           esize  = size + sizeof(uint64_t); /* result and its key */
+  HMMD_RESULT_CACHE *cache  = hmmd_result_cache_Create(esize * nfit, NULL, 0);
+  uint8_t           *buf    = malloc(size);
+  uint64_t           nhits, nmisses, memsize, disksize;
+  uint64_t           key;
+
+  if (cache == NULL || buf == NULL) esl_fatal(msg);
+
+  for (key = 1; key <= nfit; key++) {
+    fill(buf, size, key);
+    if (put(cache, key, buf, size) != eslOK) esl_fatal(msg);
+  }
+  if (! check(cache, 1, size)) esl_fatal(msg);  /* 1 is now the most recent */
+
+  fill(buf, size, nfit+1);
+  if (put(cache, nfit+1, buf, size) != eslOK) esl_fatal(msg);
+  if (! check(cache, 1, size))      esl_fatal(msg);
+  if (  check(cache, 2, size))      esl_fatal(msg);  /* 2 was the least recent */
+  if (! check(cache, nfit+1, size)) esl_fatal(msg);
+
+  hmmd_result_cache_GetCounts(cache, &nhits, &nmisses, &memsize, &disksize);
+  if (nhits != 3 || nmisses != 1)         esl_fatal(msg);
+  if (memsize != esize * nfit || disksize) esl_fatal(msg);
+
+  /* same hash as results that are there, different key */
+  if (check(cache, 3 * nfit, size)) esl_fatal(msg);
+
+  /* too big to keep */
+  if (put(cache, 999, buf, esize * nfit) != eslOK) esl_fatal(msg);
+  if (check(cache, 999, esize * nfit)) esl_fatal(msg);
+
+  hmmd_result_cache_Clear(cache);
+  if (check(cache, 1, size)) esl_fatal(msg);
+  hmmd_result_cache_GetCounts(cache, NULL, NULL, &memsize, NULL);
+  if (memsize != 0) esl_fatal(msg);
+
+  free(buf);
+  hmmd_result_cache_Destroy(cache);
+}
+
+/* Results pushed out of memory go to the spill directory, come back
+ * intact, and are removed from it when the cache is cleared.
+ */
+static void
+utest_spill(ESL_RANDOMNESS *rng, const char *dir)
+{
+  char               msg[]  = "result cache spill unit test failed";
+  int                nkeys  = 50;
+  uint64_t           maxsz  = 5000;
+  uint64_t          *size   = malloc(sizeof(uint64_t) * nkeys);
+  uint8_t           *buf    = malloc(maxsz);
+  HMMD_RESULT_CACHE *cache  = hmmd_result_cache_Create(4 * maxsz, dir, 1000 * maxsz);
+  uint64_t           memsize, disksize;
+  int                i, j;
+
+  if (cache == NULL || buf == NULL || size == NULL) esl_fatal(msg);
+
+  for (i = 0; i < nkeys; i++) {
+    size[i] = 1 + esl_rnd_Roll(rng, maxsz);
+    fill(buf, size[i], 1000 + i);
+    if (put(cache, 1000 + i, buf, size[i]) != eslOK) esl_fatal(msg);
+  }
+  hmmd_result_cache_GetCounts(cache, NULL, NULL, &memsize, &disksize);
+  if (memsize > 4 * maxsz || disksize == 0) esl_fatal(msg);
+
+  for (j = 0; j < 3 * nkeys; j++) {
+    i = esl_rnd_Roll(rng, nkeys);
+    if (! check(cache, 1000 + i, size[i])) esl_fatal(msg);
+  }
+
+  hmmd_result_cache_Clear(cache);
+  hmmd_result_cache_GetCounts(cache, NULL, NULL, &memsize, &disksize);
+  if (memsize != 0 || disksize != 0) esl_fatal(msg);
+  for (i = 0; i < nkeys; i++)
+    if (check(cache, 1000 + i, size[i])) esl_fatal(msg);
+
+  free(size);
+  free(buf);
+  hmmd_result_cache_Destroy(cache);
+}
+#endif /*p7HMMD_RESULT_CACHE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+#endif /*HMMER_THREADS*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7HMMD_RESULT_CACHE_TESTDRIVE
+/*
+  gcc -o hmmd_result_cache_utest -g -Wall -pthread -I. -L. -I../easel -L../easel -Dp7HMMD_RESULT_CACHE_TESTDRIVE hmmd_result_cache.c -lhmmer -leasel -lm
+  ./hmmd_result_cache_utest
+ */
+#include <p7_config.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                            docgrp */
+  { "-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                0 },
+  { "-s",  eslARG_INT,      "0",  NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",      0 },
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for hmmpgmd result cache";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  char            dir[] = "esltmpXXXXXX";
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  if (mkdtemp(dir) == NULL) esl_fatal("failed to create a spill directory");
+
+  utest_lru();
+  utest_spill(rng, dir);
+
+  if (rmdir(dir) != 0) esl_fatal("spill directory not empty");  /* Clear() removed every file */
+
+  fprintf(stderr, "#  status = ok\n");
+  esl_randomness_Destroy(rng);
+#endif /*HMMER_THREADS*/
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7HMMD_RESULT_CACHE_TESTDRIVE*/
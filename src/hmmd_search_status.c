@@ -84,6 +84,11 @@ extern int hmmd_search_status_Serialize(const HMMD_SEARCH_STATUS *obj, uint8_t *
   memcpy(ptr, &network_64bit, sizeof(int64_t));
   ptr += sizeof(int64_t);
 
+  // Field 3: retry_after
+  network_32bit = esl_hton32(obj->retry_after);
+  memcpy(ptr, &network_32bit, sizeof(int32_t));
+  ptr += sizeof(int32_t);
+
  *n = ptr - *buf;  // update n to point to end of serialized region
  return eslOK;
 
@@ -128,6 +133,11 @@ extern int hmmd_search_status_Deserialize(const uint8_t *buf, uint32_t *n, HMMD_
   ret_obj->msg_size = esl_ntoh64(network_64bit);
   ptr += sizeof(uint64_t);
 
+  //Field 3: retry_after
+  memcpy(&network_32bit, ptr, sizeof(uint32_t)); // Grab the bytes out of the buffer
+  ret_obj->retry_after = esl_ntoh32(network_32bit);
+  ptr += sizeof(uint32_t);
+
   *n = ptr - buf;
   return eslOK;
 }
@@ -164,6 +174,7 @@ extern int hmmd_search_status_TestSample(ESL_RAND64 *rng, HMMD_SEARCH_STATUS **r
 
   (*ret_obj)->status = (uint32_t) esl_rand64(rng);
   (*ret_obj)->msg_size = esl_rand64(rng);
+  (*ret_obj)->retry_after = (uint32_t) esl_rand64(rng);
   return eslOK;
 
 ERROR:
@@ -185,7 +196,7 @@ ERROR:
  */ 
 extern int hmmd_search_status_Compare(HMMD_SEARCH_STATUS *first, HMMD_SEARCH_STATUS *second){
 
-  if((first->status == second->status) && (first->msg_size == second->msg_size)){
+  if((first->status == second->status) && (first->msg_size == second->msg_size) && (first->retry_after == second->retry_after)){
     return eslOK;
   }
   else{
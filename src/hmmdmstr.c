@@ -21,6 +21,8 @@
 #include <syslog.h>
 #include <assert.h>
 #include <time.h>
+#include <math.h>
+#include <sys/time.h>
 
 #ifndef HMMER_THREADS
 #error "Program requires pthreads be enabled."
@@ -31,7 +33,6 @@
 #include "esl_getopts.h"
 #include "esl_sq.h"
 #include "esl_sqio.h"
-#include "esl_stack.h"
 #include "esl_stopwatch.h"
 #include "esl_threads.h"
 
@@ -43,35 +44,148 @@
 #define MAX_WORKERS  64
 #define MAX_BUFFER   4096
 
+#define UNITS_PER_WORKER 4	/* split each query into at least 4 work units per worker */
+#define SEQ_CHUNK   100000	/* sequences per work unit of a large sequence database   */
+#define HMM_CHUNK     1000	/* models per work unit of a large hmm database            */
+#define MAX_TRIES        3	/* times a unit is handed out, retries included, before   */
+				/*   the query fails                                       */
+#define SPEC_FACTOR    2.0	/* a unit running this many times longer than the query's */
+#define SPEC_SLACK       5	/*   average unit, plus this many seconds, is given to an  */
+				/*   idle worker as well; the first copy to finish wins    */
+
+#define QUERY_SEARCHED   0	/* how a query was answered, for finish_query()            */
+#define QUERY_CACHED     1
+#define QUERY_FAILED     2
+
+#define STATS_INTERVAL  10	/* seconds between rewrites of the --statsfile             */
+#define RELOAD_PROBE   1.0	/* seconds between asking a worker how its reload is going */
+#define HIST_NBINS      12	/* bins of the latency histograms, plus one for the rest  */
+
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
+/* TRUE if a worker has loaded the version of the databases a query searches */
+#define HAS_VERSION(w, job) ((job)->db->version == (w)->db_version || (job)->db->version == (w)->old_version)
+
+/* upper bounds of the latency histogram bins, in seconds */
+static const double hist_le[HIST_NBINS] = { 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0, 300.0, 600.0 };
+
+typedef struct {
+  uint64_t  count[HIST_NBINS+1];  /* [i]: observations in (hist_le[i-1], hist_le[i]]; [HIST_NBINS]: longer */
+  uint64_t  n;
+  double    sum;
+} HISTOGRAM;
+
+/* What the master has done since it started, for the !stats command and
+ * the --statsfile dump. Protected by the work mutex.
+ */
+typedef struct {
+  double          started;
+  uint64_t        nsearched;	/* queries answered by searching            */
+  uint64_t        ncached;	/* queries answered from the result cache   */
+  uint64_t        nfailed;	/* queries answered with an error           */
+  uint64_t        ntargets;	/* comparisons of a query to a target       */
+  uint64_t        n_past_msv;
+  uint64_t        n_past_bias;
+  uint64_t        n_past_vit;
+  uint64_t        n_past_fwd;
+  HISTOGRAM       wait;		/* seconds from queued to taken by the master */
+  HISTOGRAM       latency;	/* seconds from queued to answered            */
+} SERVER_METRICS;
+
 typedef struct {
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
   P7_HIT              **hits; 
   int                 nhits;
-  int                 db_inx;
-  int                 db_cnt;
-  int                 errors;
+  int                 *runs;	/* runs[r]: end of the r'th worker's sorted run in <hits> */
+  int                 nruns;
 } SEARCH_RESULTS;
 
+/* One client's queries waiting in the master's queue, oldest first in
+ * each priority class. Clients are told apart by their address, so a
+ * user with many connections is still one client.
+ */
+typedef struct client_queue_s {
+  char            ip_addr[64];
+  QUEUE_DATA     *head[HMMD_NPRIORITY];
+  QUEUE_DATA     *tail[HMMD_NPRIORITY];
+  int             nqueued;	/* queries waiting, in all classes               */
+  int             nrunning;	/* queries taken by the master and not answered  */
+  uint64_t        served;	/* when it last had a query taken; 0 if never    */
+  struct client_queue_s *next;
+} CLIENT_QUEUE;
+
+/* The queue of commands that clients want done. Server commands go
+ * first. Of the queries, the master takes one from the highest
+ * priority class that has any; within a class, from the client it
+ * served least recently, skipping clients that already have their
+ * limit of queries in flight. So one client's thousand queued batch
+ * searches are interleaved with, not ahead of, everyone else's.
+ */
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;		/* signalled when a command is queued or a query finishes */
+
+  QUEUE_DATA     *cmd_head;	/* server commands, e.g. shutdown */
+  QUEUE_DATA     *cmd_tail;
+  CLIENT_QUEUE   *clients;	/* clients with queries waiting or in flight */
+  QUEUE_DATA     *running;	/* queries taken and not yet answered, linked by <next> */
+
+  int             nqueued;	/* queries waiting, all clients  */
+  uint64_t        nserved;	/* queries taken so far          */
+  int             max_queued;	/* turn queries away past this many waiting (--qsize)     */
+  int             max_client_queued; /* ... or this many from one client (--cqsize)   */
+  int             max_client_running; /* queries of one client in flight (--cmaxq)    */
+  int             nslots;	/* queries the master searches at the same time (--maxq) */
+  double          avg_secs;	/* running average of a query's time, for retry hints     */
+  uint64_t        nrejected;	/* queries turned away                                     */
+} CMD_QUEUE;
+
 typedef struct {
   int             sock_fd;
   char            ip_addr[64];
 
-  ESL_STACK      *cmdstack;	/* stack of commands that clients want done */
+  CMD_QUEUE      *cmdqueue;	/* queue of commands that clients want done */
+  struct workerside_args_s *workers;	/* for the !stats command           */
 } CLIENTSIDE_ARGS;
 
+/* One version of the cached databases. A reload (the !reload command)
+ * loads the next version while the current one goes on being searched;
+ * once every worker has loaded it too, new queries search it, and the
+ * old version is freed when the last query pinned to it is done.
+ */
+typedef struct {
+  int              version;
+  P7_SEQCACHE     *seq_db;
+  P7_HMMCACHE     *hmm_db;
+  double           seq_mean_len;	/* mean length of a target: estimates residues   */
+  double           hmm_mean_len;	/*   searched by each worker                      */
+  int              njobs;		/* queries in flight that search this version    */
+} DB_GEN;
+
+/* A piece of a query's database, targets inx..inx+cnt-1, pulled by a worker */
 typedef struct {
+  uint32_t        inx;
+  uint32_t        cnt;
+  int             tries;	/* number of times it has been handed to a worker */
+  int             nrun;		/* number of workers searching it now             */
+  int             done;		/* TRUE once one of them has returned results     */
+  time_t          started;	/* when it was last handed out                    */
+} WORK_UNIT;
+
+typedef struct workerside_args_s {
   int              sock_fd;
 
   pthread_mutex_t  work_mutex;
   pthread_cond_t   start_cond;
   pthread_cond_t   complete_cond;
 
-  int              db_version;
-  P7_SEQCACHE     *seq_db;
-  P7_HMMCACHE     *hmm_db;
+  DB_GEN          *db;		/* version new queries search                      */
+  DB_GEN          *old;		/* previous version, until its queries are done    */
+  DB_GEN          *next;	/* loaded version waiting for the workers to load  */
+  int              reloading;	/* TRUE from !reload until <next> is switched to   */
+  char            *seqdb_file;	/* what a reload loads (--seqdb, --hmmdb)          */
+  char            *hmmdb_file;
 
   int              ready;
   int              failed;
@@ -84,19 +198,62 @@ typedef struct {
   int              idle_cnt;
   struct worker_s *idling;
 
-  RANGE_LIST       *range_list;  /* (optional) list of ranges searched within the seqdb */
+  int              nlive;	/* number of verified workers that can take work   */
+
+  pthread_cond_t   job_cond;	/* signalled when a query finishes or is forwarded */
+  struct search_job_s *jobs;	/* queries in flight, oldest first                 */
+  int              njobs;
+  int              max_jobs;	/* maximum number of queries in flight (--maxq)    */
+  int              nheld;	/* forwarded queries with straggler copies running */
+
+  HMMD_RESULT_CACHE *cache;	/* results of recent queries (--cache), or NULL    */
+  CMD_QUEUE       *cmdqueue;	/* where the queries came from                     */
+  SERVER_METRICS   metrics;
+  char            *statsfile;	/* where to dump the metrics (--statsfile), or NULL */
 
   int              completed;
 } WORKERSIDE_ARGS;
 
+/* A query in flight. Its units are pulled by the worker threads, and
+ * each unit's results are merged into <results> as it finishes.
+ */
+typedef struct search_job_s {
+  QUEUE_DATA     *query;
+  ESL_STOPWATCH  *w;
+  SEARCH_RESULTS  results;
+  WORKERSIDE_ARGS *parent;
+  DB_GEN         *db;		/* version of the databases it searches          */
+
+  WORK_UNIT      *unit;		/* [0..nunits-1]                                 */
+  int             nunits;
+  int            *todo;		/* stack of units waiting for a worker           */
+  int             ntodo;
+  int             nrunning;	/* number of unit copies being searched          */
+  int             ndone;	/* number of units finished, or given up on      */
+  int             failed;	/* TRUE if a unit failed for good                */
+  int             forwarded;	/* TRUE once off the list; freed when nrunning 0 */
+  int             held;		/* TRUE if counted in the parent's <nheld>       */
+
+  double          secs;		/* total seconds of the units finished so far    */
+  int             ntimed;
+
+  HMMD_CACHE_KEY *cache_key;	/* key of its results in the parent's cache      */
+
+  struct search_job_s *next;
+} SEARCH_JOB;
+
 typedef struct worker_s {
   int                   sock_fd;
   char                  ip_addr[64];
   
   int                   completed;
   int                   terminated;
+  int                   idle;		/* TRUE if the worker failed to verify its database */
   HMMD_COMMAND         *cmd;
 
+  SEARCH_JOB           *job[HMMD_MAX_BATCH];	/* queries and units being searched, NULL once done */
+  int                   unit[HMMD_MAX_BATCH];
+  int                   nbatch;
   uint32_t              srch_inx;
   uint32_t              srch_cnt;
 
@@ -107,6 +264,14 @@ typedef struct worker_s {
   uint32_t             allocated_hits;
   int                   total;
 
+  int                   db_version;	/* newest version of the databases loaded      */
+  int                   old_version;	/* older version still loaded, or 0            */
+  double                probed;		/* when it was last asked about a reload       */
+
+  uint64_t              nunits;		/* units searched                              */
+  double                nres;		/* residues (or model nodes) searched, estimated */
+  double                busy;		/* seconds spent searching                     */
+
   WORKERSIDE_ARGS      *parent;
 
   struct worker_s      *next;
@@ -120,12 +285,17 @@ static void setup_workerside_comm(ESL_GETOPTS *opts, WORKERSIDE_ARGS  *args);
 static void destroy_worker(WORKER_DATA *worker);
 
 static void init_results(SEARCH_RESULTS *results);
-static void clear_results(WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results);
+static void clear_results(SEARCH_RESULTS *results);
+static void gather_results(SEARCH_RESULTS *results, WORKER_DATA *worker);
+static void forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results, HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *cache_key);
+
+static int  next_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker);
+static void finish_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker, int b);
+static void abandon_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker);
+static void *forward_thread(void *arg);
 
 static void
-print_client_msg(int fd, int status, char *format, va_list ap)
+print_client_msg(int fd, int status, uint32_t retry_after, char *format, va_list ap)
 {
   uint32_t nalloc =0;
   uint32_t buf_offset = 0;
@@ -136,8 +306,9 @@ print_client_msg(int fd, int status, char *format, va_list ap)
 
   memset(&s, 0, sizeof(HMMD_SEARCH_STATUS));
 
-  s.status   = status;
-  s.msg_size = vsnprintf(ebuf, sizeof(ebuf), format, ap) +1; /* +1 because we send the \0 */
+  s.status      = status;
+  s.msg_size    = vsnprintf(ebuf, sizeof(ebuf), format, ap) +1; /* +1 because we send the \0 */
+  s.retry_after = retry_after;
 
   p7_syslog(LOG_ERR, ebuf);
 
@@ -164,7 +335,21 @@ client_msg(int fd, int status, char *format, ...)
   va_list ap;
 
   va_start(ap, format);
-  print_client_msg(fd, status, format, ap);
+  print_client_msg(fd, status, 0, format, ap);
+  va_end(ap);
+}
+
+/* client_busy_msg()
+ * Turn a query away because the server is too busy, telling the client
+ * how many seconds to wait before sending it again.
+ */
+static void
+client_busy_msg(int fd, uint32_t retry_after, char *format, ...)
+{
+  va_list ap;
+
+  va_start(ap, format);
+  print_client_msg(fd, eslFAIL, retry_after, format, ap);
   va_end(ap);
 }
 
@@ -174,12 +359,319 @@ client_msg_longjmp(int fd, int status, jmp_buf *env, char *format, ...)
   va_list ap;
 
   va_start(ap, format);
-  print_client_msg(fd, status, format, ap);
+  print_client_msg(fd, status, 0, format, ap);
   va_end(ap);
 
   longjmp(*env, 1);
 }
 
+/* wallclock()
+ * Seconds since the epoch, to the microsecond.
+ */
+static double
+wallclock(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double) tv.tv_sec + (double) tv.tv_usec * 1e-6;
+}
+
+static void
+hist_add(HISTOGRAM *h, double secs)
+{
+  int i;
+
+  for (i = 0; i < HIST_NBINS && secs > hist_le[i]; ++i) ;
+  ++h->count[i];
+  ++h->n;
+  h->sum += secs;
+}
+
+/* find_client()
+ * Return the queue of the client at <ip_addr>, creating it if it has
+ * none and <create> is TRUE, else NULL. Caller holds the queue's lock.
+ */
+static CLIENT_QUEUE *
+find_client(CMD_QUEUE *cq, const char *ip_addr, int create)
+{
+  CLIENT_QUEUE *c;
+  int           p;
+
+  for (c = cq->clients; c != NULL; c = c->next)
+    if (strcmp(c->ip_addr, ip_addr) == 0) return c;
+  if (!create) return NULL;
+
+  if ((c = malloc(sizeof(CLIENT_QUEUE))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  strcpy(c->ip_addr, ip_addr);
+  for (p = 0; p < HMMD_NPRIORITY; ++p) c->head[p] = c->tail[p] = NULL;
+  c->nqueued  = 0;
+  c->nrunning = 0;
+  c->served   = 0;
+  c->next     = cq->clients;
+  cq->clients = c;
+  return c;
+}
+
+/* forget a client with nothing waiting or in flight */
+static void
+drop_client_if_idle(CMD_QUEUE *cq, CLIENT_QUEUE *c)
+{
+  CLIENT_QUEUE **pp;
+
+  if (c->nqueued > 0 || c->nrunning > 0) return;
+  for (pp = &cq->clients; *pp != c; pp = &(*pp)->next) ;
+  *pp = c->next;
+  free(c);
+}
+
+/* seconds a client turned away should wait: long enough for the
+ * master to get through <nahead> queries, at the recent pace */
+static uint32_t
+retry_hint(CMD_QUEUE *cq, int nahead)
+{
+  double secs = cq->avg_secs * nahead / cq->nslots;
+
+  return (secs < 1.0) ? 1 : (uint32_t) ceil(secs);
+}
+
+static void
+init_cmdqueue(CMD_QUEUE *cq, ESL_GETOPTS *go)
+{
+  int n;
+
+  if ((n = pthread_mutex_init(&cq->mutex, NULL)) != 0) LOG_FATAL_MSG("mutex init", n);
+  if ((n = pthread_cond_init(&cq->cond, NULL)) != 0)   LOG_FATAL_MSG("cond init", n);
+
+  cq->cmd_head           = NULL;
+  cq->cmd_tail           = NULL;
+  cq->clients            = NULL;
+  cq->running            = NULL;
+  cq->nqueued            = 0;
+  cq->nserved            = 0;
+  cq->max_queued         = esl_opt_GetInteger(go, "--qsize");
+  cq->max_client_queued  = esl_opt_GetInteger(go, "--cqsize");
+  cq->max_client_running = esl_opt_GetInteger(go, "--cmaxq");
+  cq->nslots             = esl_opt_GetInteger(go, "--maxq");
+  cq->avg_secs           = 0.0;
+  cq->nrejected          = 0;
+}
+
+/* enqueue_query()
+ * Queue a client's query behind the others of its client and priority
+ * class. If the queue, or the client's share of it, is full, leave the
+ * query alone and return eslFAIL, with the number of seconds the client
+ * should wait before trying again in <*ret_retry>.
+ */
+static int
+enqueue_query(CMD_QUEUE *cq, QUEUE_DATA *query, uint32_t *ret_retry)
+{
+  CLIENT_QUEUE *c;
+  int           p      = query->priority;
+  int           status = eslOK;
+  int           n;
+
+  *ret_retry = 0;
+  query->next = NULL;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  c = find_client(cq, query->ip_addr, TRUE);
+
+  if (cq->nqueued >= cq->max_queued) {
+    *ret_retry = retry_hint(cq, cq->nqueued);
+    status     = eslFAIL;
+  } else if (c->nqueued >= cq->max_client_queued) {
+    *ret_retry = retry_hint(cq, c->nqueued);
+    status     = eslFAIL;
+  } else {
+    query->queued = wallclock();
+    if (c->tail[p] == NULL) c->head[p]       = query;
+    else                    c->tail[p]->next = query;
+    c->tail[p] = query;
+    ++c->nqueued;
+    ++cq->nqueued;
+    if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  }
+
+  if (status != eslOK) {
+    ++cq->nrejected;
+    drop_client_if_idle(cq, c);
+  }
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return status;
+}
+
+/* enqueue_command()
+ * Queue a server command, such as shutdown, ahead of all queries.
+ */
+static void
+enqueue_command(CMD_QUEUE *cq, QUEUE_DATA *cmd)
+{
+  int n;
+
+  cmd->next = NULL;
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (cq->cmd_tail == NULL) cq->cmd_head       = cmd;
+  else                      cq->cmd_tail->next = cmd;
+  cq->cmd_tail = cmd;
+  if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* next_query()
+ * Take the next query to search out of the queue, or return NULL if
+ * none can go now. Caller holds the queue's lock.
+ */
+static QUEUE_DATA *
+next_query(CMD_QUEUE *cq)
+{
+  CLIENT_QUEUE *c;
+  CLIENT_QUEUE *best;
+  QUEUE_DATA   *query;
+  int           p;
+
+  for (p = 0; p < HMMD_NPRIORITY; ++p) {
+    best = NULL;
+    for (c = cq->clients; c != NULL; c = c->next) {
+      if (c->head[p] == NULL) continue;
+      if (cq->max_client_running > 0 && c->nrunning >= cq->max_client_running) continue;
+      if (best == NULL || c->served < best->served) best = c;
+    }
+    if (best == NULL) continue;
+
+    query = best->head[p];
+    best->head[p] = query->next;
+    if (best->head[p] == NULL) best->tail[p] = NULL;
+    query->next = cq->running;
+    cq->running = query;
+
+    --best->nqueued;
+    ++best->nrunning;
+    best->served = ++cq->nserved;
+    --cq->nqueued;
+    return query;
+  }
+  return NULL;
+}
+
+/* dequeue()
+ * Wait for the next command or query the master should handle.
+ */
+static QUEUE_DATA *
+dequeue(CMD_QUEUE *cq)
+{
+  QUEUE_DATA *query = NULL;
+  int         n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for ( ;; ) {
+    if ((query = cq->cmd_head) != NULL) {
+      cq->cmd_head = query->next;
+      if (cq->cmd_head == NULL) cq->cmd_tail = NULL;
+      query->next = NULL;
+      break;
+    }
+    if ((query = next_query(cq)) != NULL) break;
+    if ((n = pthread_cond_wait (&cq->cond, &cq->mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  return query;
+}
+
+/* query_finished()
+ * A query taken from the queue has been answered, after <secs> seconds
+ * of searching (0 if it wasn't searched), letting its client have
+ * another one in flight. Call before the query is freed.
+ */
+static void
+query_finished(CMD_QUEUE *cq, QUEUE_DATA *query, double secs)
+{
+  CLIENT_QUEUE  *c;
+  QUEUE_DATA   **pp;
+  int            n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (pp = &cq->running; *pp != NULL; pp = &(*pp)->next)
+    if (*pp == query) { *pp = query->next; query->next = NULL; break; }
+  if ((c = find_client(cq, query->ip_addr, FALSE)) != NULL) {
+    --c->nrunning;
+    drop_client_if_idle(cq, c);
+  }
+  if (secs > 0.0) cq->avg_secs = (cq->avg_secs == 0.0) ? secs : 0.9 * cq->avg_secs + 0.1 * secs;
+  if ((n = pthread_cond_broadcast(&cq->cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* has_running()
+ * TRUE if a query from socket <fd> is in flight. Caller holds the
+ * queue's lock.
+ */
+static int
+has_running(CMD_QUEUE *cq, int fd)
+{
+  QUEUE_DATA *q;
+
+  for (q = cq->running; q != NULL; q = q->next)
+    if (q->sock == fd) return TRUE;
+  return FALSE;
+}
+
+/* discard_queued()
+ * Remove all the commands queued from socket <fd>, because we're
+ * closing that client down, and wait until its queries in flight are
+ * answered. Their forward_thread()s still write to <fd>; if it were
+ * closed under them, the descriptor could be reused by a new client
+ * that would get someone else's results.
+ */
+static void
+discard_queued(CMD_QUEUE *cq, int fd)
+{
+  CLIENT_QUEUE  *c;
+  CLIENT_QUEUE  *next;
+  QUEUE_DATA   **pp;
+  QUEUE_DATA    *q;
+  int            p;
+  int            n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (pp = &cq->cmd_head, cq->cmd_tail = NULL; (q = *pp) != NULL; ) {
+    if (q->sock == fd) { *pp = q->next; free_QueueData(q); }
+    else               { cq->cmd_tail = q; pp = &q->next; }
+  }
+  for (c = cq->clients; c != NULL; c = next) {
+    next = c->next;
+    for (p = 0; p < HMMD_NPRIORITY; ++p) {
+      for (pp = &c->head[p], c->tail[p] = NULL; (q = *pp) != NULL; ) {
+        if (q->sock == fd) { *pp = q->next; free_QueueData(q); --c->nqueued; --cq->nqueued; }
+        else               { c->tail[p] = q; pp = &q->next; }
+      }
+    }
+    drop_client_if_idle(cq, c);
+  }
+  while (has_running(cq, fd)) {
+    if ((n = pthread_cond_wait (&cq->cond, &cq->mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+static void
+destroy_cmdqueue(CMD_QUEUE *cq)
+{
+  CLIENT_QUEUE *c;
+  QUEUE_DATA   *q;
+  int           p;
+
+  while ((q = cq->cmd_head) != NULL) { cq->cmd_head = q->next; free_QueueData(q); }
+  while ((c = cq->clients) != NULL) {
+    for (p = 0; p < HMMD_NPRIORITY; ++p)
+      while ((q = c->head[p]) != NULL) { c->head[p] = q->next; free_QueueData(q); }
+    cq->clients = c->next;
+    free(c);
+  }
+  pthread_mutex_destroy(&cq->mutex);
+  pthread_cond_destroy(&cq->cond);
+}
+
 static int
 validate_workers(WORKERSIDE_ARGS *args)
 {
@@ -290,155 +782,744 @@ update_workers(WORKERSIDE_ARGS *args)
   assert(validate_workers(args));
 }
 
+/* load_gen()
+ * Load a version of the databases from <seqdb_file> and/or
+ * <hmmdb_file> (either may be NULL). Returns eslOK and the new version,
+ * not yet numbered, in <ret_db>; or an error code with a message in
+ * <errbuf>.
+ */
+static int
+load_gen(char *seqdb_file, char *hmmdb_file, DB_GEN **ret_db, char *errbuf)
+{
+  DB_GEN  *db     = NULL;
+  char     msg[eslERRBUFSIZE];
+  uint32_t i;
+  int      status = eslOK;
+
+  if ((db = malloc(sizeof(DB_GEN))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(db, 0, sizeof(DB_GEN));
+
+  if (seqdb_file != NULL) {
+    if ((status = p7_seqcache_Open(seqdb_file, &db->seq_db, msg)) != eslOK) {
+      snprintf(errbuf, eslERRBUFSIZE, "Failed to cache %s (%d)", seqdb_file, status);
+      goto ERROR;
+    }
+    if (db->seq_db->count > 0) db->seq_mean_len = (double) db->seq_db->res_size / db->seq_db->count;
+  }
+
+  if (hmmdb_file != NULL) {
+    status = p7_hmmcache_Open(hmmdb_file, &db->hmm_db, msg);
+    if      (status == eslENOTFOUND) { snprintf(errbuf, eslERRBUFSIZE, "Failed to open profile database %s\n  %s\n",    hmmdb_file, msg); goto ERROR; }
+    else if (status == eslEFORMAT)   { snprintf(errbuf, eslERRBUFSIZE, "Failed to parse profile database %s\n  %s\n",   hmmdb_file, msg); goto ERROR; }
+    else if (status == eslEINCOMPAT) { snprintf(errbuf, eslERRBUFSIZE, "Mismatched alphabets in profile db %s\n  %s\n", hmmdb_file, msg); goto ERROR; }
+    else if (status != eslOK)        { snprintf(errbuf, eslERRBUFSIZE, "Failed to load profile db %s : code %d\n",      hmmdb_file, status); goto ERROR; }
+
+    p7_hmmcache_SetNumericNames(db->hmm_db);
+
+    printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n", 
+	   hmmdb_file, db->hmm_db->n, (uint64_t) p7_hmmcache_Sizeof(db->hmm_db));
+
+    if (db->hmm_db->n > 0) {
+      for (i = 0; i < db->hmm_db->n; ++i) db->hmm_mean_len += db->hmm_db->list[i]->M;
+      db->hmm_mean_len /= db->hmm_db->n;
+    }
+  }
+
+  *ret_db = db;
+  return eslOK;
+
+ ERROR:
+  if (db->hmm_db) p7_hmmcache_Close(db->hmm_db);
+  if (db->seq_db) p7_seqcache_Close(db->seq_db);
+  free(db);
+  *ret_db = NULL;
+  return status;
+}
+
 static void
-process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+free_gen(DB_GEN *db)
+{
+  if (db == NULL) return;
+  if (db->hmm_db) p7_hmmcache_Close(db->hmm_db);
+  if (db->seq_db) p7_seqcache_Close(db->seq_db);
+  free(db);
+}
+
+/* release_gen()
+ * Called holding the work mutex when a query pinned to version <db> of
+ * the databases is done with it. The last query of a replaced version
+ * frees it, and wakes the worker threads to have the workers free
+ * their copies.
+ */
+static void
+release_gen(WORKERSIDE_ARGS *args, DB_GEN *db)
 {
-  ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
-  WORKER_DATA    *worker     = NULL;
-  SEARCH_RESULTS  results;
   int n;
-  int cnt;
-  int inx;
-  int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
-  int tries;
-  int i;
 
+  if (--db->njobs > 0 || db != args->old) return;
+
+  printf("Database version %d freed\n", db->version);
+  fflush(stdout);
 
-  memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+  args->old = NULL;
+  free_gen(db);
+  if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+}
+
+/* switch_gen()
+ * Called holding the work mutex. Once every live worker has loaded the
+ * next version of the databases, make it the one new queries search.
+ * Queries already in flight finish on the version they started on.
+ */
+static void
+switch_gen(WORKERSIDE_ARGS *args)
+{
+  WORKER_DATA *worker;
+  DB_GEN      *old;
+  int          n;
+
+  if (args->next == NULL) return;
+
+  for (worker = args->head; worker != NULL; worker = worker->next)
+    if (!worker->terminated && worker->db_version != args->next->version) return;
+  for (worker = args->pending; worker != NULL; worker = worker->next)
+    if (worker->db_version != args->next->version) return;
+
+  old            = args->db;
+  args->db       = args->next;
+  args->next     = NULL;
+  args->reloading = FALSE;
+
+  /* the old results are keyed by the old version; drop them */
+  if (args->cache != NULL) hmmd_result_cache_Clear(args->cache);
+
+  printf("Switched to database version %d\n", args->db->version);
+  fflush(stdout);
+
+  if (old->njobs > 0) {
+    args->old = old;
+  } else {
+    printf("Database version %d freed\n", old->version);
+    fflush(stdout);
+    free_gen(old);
+  }
+  if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+}
+
+/* split_units()
+ * Divide the targets of a query, 0..cnt-1 of its database, into
+ * contiguous units of about SEQ_CHUNK sequences or HMM_CHUNK models,
+ * but no fewer than <nunits>, so that a small database still keeps
+ * every worker busy. Workers pull units as they finish the last, so
+ * fast nodes simply search more of them. If the client restricted
+ * the search to ranges of the database, the units are balanced by
+ * the number of sequences within the ranges rather than by position.
+ */
+static void
+split_units(WORKERSIDE_ARGS *args, SEARCH_JOB *job, int cnt, RANGE_LIST *range_list)
+{
+  HMMER_SEQ **list   = NULL;
+  int         remain = cnt;	/* number of targets left to hand out */
+  int         inx    = 0;
+  int         chunk  = (job->query->cmd_type == HMMD_CMD_SEARCH) ? SEQ_CHUNK : HMM_CHUNK;
+  int         u;
+
+  if (range_list != NULL) {
+    list   = job->db->seq_db->db[job->query->dbx].list;
+    remain = 0;
+    for (inx = 0; inx < cnt; ++inx)
+      if (hmmpgmd_IsWithinRanges(list[inx]->idx, range_list)) ++remain;
+    inx = 0;
+  }
+
+  job->nunits = ESL_MAX(job->nunits, (remain + chunk - 1) / chunk);
+  job->nunits = ESL_MAX(1, ESL_MIN(job->nunits, remain));
+  if ((job->unit = malloc(sizeof(WORK_UNIT) * job->nunits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((job->todo = malloc(sizeof(int)       * job->nunits)) == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  for (u = 0; u < job->nunits; ++u) {
+    int goal = remain / (job->nunits - u);
+
+    job->unit[u].inx     = inx;
+    job->unit[u].tries   = 0;
+    job->unit[u].nrun    = 0;
+    job->unit[u].done    = FALSE;
+    job->unit[u].started = 0;
+    if (u == job->nunits - 1) {
+      job->unit[u].cnt = cnt - inx;
+    } else if (range_list != NULL) {
+      int curr = 0;
+      while (curr < goal) {
+        if (hmmpgmd_IsWithinRanges(list[inx]->idx, range_list)) ++curr;
+        ++inx;
+      }
+      job->unit[u].cnt = inx - job->unit[u].inx;
+    } else {
+      job->unit[u].cnt = goal;
+      inx += goal;
+    }
+    remain -= goal;
+
+    /* the todo list is popped from the top, so hand out unit 0 first */
+    job->todo[job->nunits - u - 1] = u;
+  }
+  job->ntodo = job->nunits;
+}
+
+/* finish_query()
+ * Count a query taken from the queue as answered -- by searching, from
+ * the cache, or with an error, as <outcome> says -- after <secs> seconds
+ * of searching, and let its client have another query searched. Call
+ * before the query is freed.
+ */
+static void
+finish_query(WORKERSIDE_ARGS *args, QUEUE_DATA *query, double secs, int outcome)
+{
+  SERVER_METRICS *m = &args->metrics;
+  int             n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if      (outcome == QUERY_SEARCHED) ++m->nsearched;
+  else if (outcome == QUERY_CACHED)   ++m->ncached;
+  else                                ++m->nfailed;
+  hist_add(&m->latency, wallclock() - query->queued);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  query_finished(args->cmdqueue, query, secs);
+}
+
+/* cache_key()
+ * The key of <query>'s results in the result cache. The database is
+ * known by the id the workers are initialized with, and the master's
+ * database version, so nothing found for an old database is returned
+ * for a search of a new one. Returns NULL if it can't be allocated;
+ * the query is then searched and its results aren't cached.
+ */
+static HMMD_CACHE_KEY *
+cache_key(DB_GEN *db, QUEUE_DATA *query)
+{
+  char dbid[256];
+
+  if (query->cmd_type == HMMD_CMD_SEARCH) snprintf(dbid, sizeof(dbid), "seq:%s:%d", db->seq_db->id,   db->version);
+  else                                    snprintf(dbid, sizeof(dbid), "hmm:%s:%d", db->hmm_db->name, db->version);
+  return hmmd_result_cache_Key(query, dbid);
+}
+
+/* answer_from_cache()
+ * If the results of <query> are in the cache, send them to the client
+ * and return TRUE. The client's earlier queries still in flight are
+ * answered first, by their forward_thread()s, so if it has any, the
+ * query is searched as usual.
+ */
+static int
+answer_from_cache(WORKERSIDE_ARGS *args, QUEUE_DATA *query, const HMMD_CACHE_KEY *key)
+{
+  SEARCH_JOB *job;
+  uint8_t    *data = NULL;
+  uint64_t    size;
+  int         n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for (job = args->jobs; job != NULL; job = job->next)
+    if (job->query->sock == query->sock) break;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  if (job != NULL || key == NULL) return FALSE;
+
+  if (hmmd_result_cache_Get(args->cache, key, &data, &size) != eslOK) return FALSE;
+
+  if (writen(query->sock, data, size) != size) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, query->ip_addr, errno, strerror(errno));
+  } else {
+    printf("Cached results for %s (%d) sent %" PRIu64 " bytes\n", query->ip_addr, query->sock, size);
+    fflush(stdout);
+  }
+  free(data);
+  return TRUE;
+}
+
+/* process_search()
+ * Queue a search or scan for the workers and return without waiting
+ * for it. The query is split into units that the worker threads pull
+ * (next_unit()); a forward_thread() sends the results back to the
+ * client when the last unit is done. At most <max_jobs> queries are
+ * in flight; beyond that the master blocks here until one finishes.
+ * Takes ownership of <query>.
+ */
+static void
+process_search(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
+{
+  SEARCH_JOB     *job        = NULL;
+  SEARCH_JOB     *tail       = NULL;
+  RANGE_LIST     *range_list = NULL;  /* (optional) list of ranges searched within the seqdb */
+  pthread_t       thread_id;
+  int             n;
+  int             cnt;
+  int             nlive;
+  HMMD_CACHE_KEY *key        = NULL;
+  DB_GEN         *db;
+
+  /* pin the current version of the databases, so a reload does not
+   * free it under the query
+   */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  db = args->db;
+  ++db->njobs;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
   /* figure out the size of the database we are searching */
   if (query->cmd_type == HMMD_CMD_SEARCH) {
-    if((args->seq_db == NULL)||(args->seq_db->db == NULL)|| (query->dbx >= args->seq_db->db_cnt) || (query->dbx < 0)){
+    if((db->seq_db == NULL)||(db->seq_db->db == NULL)|| (query->dbx >= db->seq_db->db_cnt) || (query->dbx < 0)){
       // Client is attempting to search a database that does not exist, complain and abort search
       client_msg(query->sock, eslFAIL, "Specified sequence database has not been loaded into the daemon. \n");
-      return;
+      goto UNPIN;
     }
     else{ 
-      cnt = args->seq_db->db[query->dbx].count;
+      cnt = db->seq_db->db[query->dbx].count;
     }
   } else {
-    if(args->hmm_db == NULL){
+    if(db->hmm_db == NULL){
       // Client is attempting to search a database that does not exist, complain and abort search
       client_msg(query->sock, eslFAIL, "No HMM database has been loaded into the daemon. \n");
-      return;
+      goto UNPIN;
     }
     else{ 
-     cnt = args->hmm_db->n;
+     cnt = db->hmm_db->n;
     }
   }
-  
+
+  if (args->cache != NULL) {
+    key = cache_key(db, query);
+    if (answer_from_cache(args, query, key)) {
+      finish_query(args, query, 0.0, QUERY_CACHED);
+      free_QueueData(query);
+      query = NULL;
+      goto UNPIN;
+    }
+  }
+
+  /* wait for room in the list of queries in flight */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (args->njobs >= args->max_jobs) {
+    if ((n = pthread_cond_wait (&args->job_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+  update_workers(args);
+  nlive = args->nlive;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (nlive == 0) {
+    client_msg(query->sock, eslFAIL, "No compute nodes available\n");
+    goto UNPIN;
+  }
+
+  if ((job = malloc(sizeof(SEARCH_JOB))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(job, 0, sizeof(SEARCH_JOB)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
+
   // start timer after we make sure the relevant database exists to make cleanup easier on error
-  w = esl_stopwatch_Create();
-  esl_stopwatch_Start(w);
-  init_results(&results);
-
-  //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
-  if (args->range_list) { // can only happen in HMMD_CMD_SEARCH case
-    int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
-    for (i=0; i<cnt; i++) {
-      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, args->range_list ) )
-        range_cnt++;
+  job->w = esl_stopwatch_Create();
+  esl_stopwatch_Start(job->w);
+  init_results(&job->results);
+
+  job->query     = query;
+  job->parent    = args;
+  job->db        = db;
+  job->nunits    = nlive * UNITS_PER_WORKER;
+  job->cache_key = key;
+  key            = NULL;
+
+  query->cmd->srch.db_version = db->version;
+
+  if (query->cmd_type == HMMD_CMD_SEARCH && esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
+    if ((range_list = malloc(sizeof(RANGE_LIST))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    hmmpgmd_GetRanges(range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
+  }
+  split_units(args, job, cnt, range_list);
+
+  /* add the query to the end of the list and let the workers at it */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (args->jobs == NULL) {
+    args->jobs = job;
+  } else {
+    for (tail = args->jobs; tail->next != NULL; tail = tail->next) ;
+    tail->next = job;
+  }
+  ++args->njobs;
+  if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((n = pthread_create(&thread_id, NULL, forward_thread, job)) != 0) LOG_FATAL_MSG("thread create", n);
+
+  if (range_list) {
+    if (range_list->starts)  free(range_list->starts);
+    if (range_list->ends)    free(range_list->ends);
+    free(range_list);
+  }
+  return;
+
+ UNPIN:
+  if (query != NULL) {
+    finish_query(args, query, 0.0, QUERY_FAILED);
+    free_QueueData(query);
+  }
+  hmmd_cache_key_Destroy(key);
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  release_gen(args, db);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+}
+
+/* take_unit()
+ * Hand unit <u> of a query to the worker, adding it to the worker's
+ * batch.
+ */
+static void
+take_unit(WORKER_DATA *worker, SEARCH_JOB *job, int u)
+{
+  ++job->unit[u].tries;
+  ++job->unit[u].nrun;
+  job->unit[u].started = time(NULL);
+  ++job->nrunning;
+
+  worker->job[worker->nbatch]  = job;
+  worker->unit[worker->nbatch] = u;
+  ++worker->nbatch;
+}
+
+/* pop_unit()
+ * Remove the unit at position <t> of a query's todo list and return it.
+ */
+static int
+pop_unit(SEARCH_JOB *job, int t)
+{
+  int u = job->todo[t];
+
+  memmove(job->todo + t, job->todo + t + 1, sizeof(int) * (job->ntodo - t - 1));
+  --job->ntodo;
+  return u;
+}
+
+/* straggler()
+ * Find the unit that has been running longest past SPEC_FACTOR times
+ * its query's average unit time plus SPEC_SLACK seconds, and is not
+ * already being searched twice, of a query <worker> can search.
+ * Returns FALSE if there is none.
+ */
+static int
+straggler(WORKERSIDE_ARGS *args, WORKER_DATA *worker, SEARCH_JOB **ret_job, int *ret_u)
+{
+  SEARCH_JOB *job;
+  WORK_UNIT  *unit;
+  time_t      now  = time(NULL);
+  double      over;
+  double      most = 0.0;
+  int         u;
+
+  *ret_job = NULL;
+  for (job = args->jobs; job != NULL; job = job->next) {
+    if (job->ntimed == 0 || !HAS_VERSION(worker, job)) continue;
+    for (u = 0; u < job->nunits; ++u) {
+      unit = job->unit + u;
+      if (unit->done || unit->nrun != 1) continue;
+      over = difftime(now, unit->started) - (SPEC_FACTOR * job->secs / job->ntimed + SPEC_SLACK);
+      if (over > most) { most = over; *ret_job = job; *ret_u = u; }
     }
-    cnt = range_cnt;
   }
+  return (*ret_job != NULL);
+}
 
+/* next_unit()
+ * Called by a worker thread holding the work mutex. Hands the worker
+ * a unit of the query with the fewest units being searched, oldest
+ * first on ties, so one long query cannot starve the queries behind
+ * it. Other searches of the same piece of the same sequence database
+ * are batched with it, up to HMMD_MAX_BATCH, so the worker streams
+ * those targets from memory once for all of them.
+ *
+ * When no unit is waiting, an idle worker instead gets a copy of a
+ * straggling unit (see straggler()), so a slow or hung node does not
+ * hold up the whole query. A worker is only given units of queries
+ * on a version of the databases it has loaded. Returns TRUE if the
+ * worker was given work.
+ */
+static int
+next_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker)
+{
+  SEARCH_JOB *job  = NULL;
+  SEARCH_JOB *best = NULL;
+  WORK_UNIT  *unit = NULL;
+  WORK_UNIT  *other;
+  int         t;
+  int         u;
+
+  worker->nbatch = 0;
+
+  for (job = args->jobs; job != NULL; job = job->next) {
+    if (!HAS_VERSION(worker, job)) continue;
+    if (job->ntodo > 0 && (best == NULL || job->nrunning < best->nrunning)) best = job;
+  }
 
-  inx = 0;
-  tries = 0;
-  do {
-    /* process any changes to the available workers */
-    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (best != NULL) {
+    take_unit(worker, best, pop_unit(best, best->ntodo - 1));
+    unit = best->unit + worker->unit[0];
 
-    /* build a list of the currently available workers */
-    update_workers(args);
-
-    /* if there are no workers, report an error */
-    if (args->ready > 0) {
-      ready_workers = args->ready;
-
-      /* update the workers search information */
-      worker = args->head;
-
-      while (worker != NULL) {
-        worker->cmd        = query->cmd;
-        worker->completed  = 0;
-        worker->total      = 0;
-
-        /* assign each worker a portion of the database */
-        worker->srch_inx = inx;
-        if (args->range_list) {
-          // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
-          int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
-          int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
-          worker->srch_cnt = 0;
-          while (curr < goal) {
-            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, args->range_list ) )
-                curr++;
-            worker->srch_cnt++;
-            inx++;
-          }
-          cnt -= curr;
-        } else {
-          // default - split evenly among workers
-          worker->srch_cnt = cnt / ready_workers;
-          inx += worker->srch_cnt;
-          cnt -= worker->srch_cnt;
+    if (best->query->cmd_type == HMMD_CMD_SEARCH) {
+      for (job = args->jobs; job != NULL && worker->nbatch < HMMD_MAX_BATCH; job = job->next) {
+        if (job == best || job->query->cmd_type != HMMD_CMD_SEARCH || job->query->dbx != best->query->dbx || job->db != best->db) continue;
+        for (t = job->ntodo - 1; t >= 0; --t) {
+          other = job->unit + job->todo[t];
+          if (other->inx == unit->inx && other->cnt == unit->cnt) break;
         }
-
-        --ready_workers;
-        worker            = worker->next;
+        if (t >= 0) take_unit(worker, job, pop_unit(job, t));
       }
+    }
+  } else if (straggler(args, worker, &best, &u)) {
+    p7_syslog(LOG_ERR,"[%s:%d] - reissuing unit %d [%u - %u] to %s\n", __FILE__, __LINE__, u, best->unit[u].inx, best->unit[u].inx + best->unit[u].cnt - 1, worker->ip_addr);
+    take_unit(worker, best, u);
+    unit = best->unit + u;
+  } else {
+    return FALSE;
+  }
+
+  worker->cmd       = best->query->cmd;
+  worker->srch_inx  = unit->inx;
+  worker->srch_cnt  = unit->cnt;
+  worker->completed = 0;
+  worker->total     = 0;
+
+  return TRUE;
+}
+
+/* release_job()
+ * Free a query once it has been forwarded and no worker is searching
+ * any copy of its units. Called holding the work mutex.
+ */
+static void
+release_job(WORKERSIDE_ARGS *args, SEARCH_JOB *job)
+{
+  int n;
 
-      args->completed = 0;
+  if (!job->forwarded || job->nrunning > 0) return;
 
-      /* notify all the worker threads of the new query */
-      if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if (job->held) {
+    --args->nheld;
+    if ((n = pthread_cond_broadcast(&args->job_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  }
+
+  release_gen(args, job->db);
+
+  esl_stopwatch_Destroy(job->w);
+  free_QueueData(job->query);
+  hmmd_cache_key_Destroy(job->cache_key);
+  free(job->unit);
+  free(job->todo);
+  free(job);
+}
+
+/* discard_results()
+ * Drop the results a worker has read for a unit that is already done.
+ */
+static void
+discard_results(WORKER_DATA *worker)
+{
+  int i;
+
+  if (worker->err_buf != NULL) free(worker->err_buf);
+  if (worker->hits != NULL) {
+    for (i = 0; i < worker->allocated_hits; i++) p7_hit_Destroy(worker->hits[i]);
+    free(worker->hits);
+  }
+  worker->err_buf        = NULL;
+  worker->hits           = NULL;
+  worker->allocated_hits = 0;
+}
+
+/* finish_unit()
+ * Called by a worker thread holding the work mutex once the results
+ * of the <b>'th search of its batch have been read. Merges them into
+ * that query's results, unless another copy of the unit got there
+ * first.
+ */
+static void
+finish_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker, int b)
+{
+  SEARCH_JOB *job  = worker->job[b];
+  WORK_UNIT  *unit = job->unit + worker->unit[b];
+  int         n;
+
+  --unit->nrun;
+  --job->nrunning;
+
+  if (unit->done) {
+    discard_results(worker);
+  } else {
+    if (worker->status.status == eslOK) {
+      gather_results(&job->results, worker);
+    } else {
+      p7_syslog(LOG_ERR,"[%s:%d] - search failed on %s: %s\n", __FILE__, __LINE__, worker->ip_addr, worker->err_buf);
+      job->failed = TRUE;
+      discard_results(worker);
     }
 
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+    unit->done = TRUE;
+    ++job->ndone;
+    job->secs += difftime(time(NULL), unit->started);
+    ++job->ntimed;
+
+    if (job->ndone == job->nunits) {
+      if ((n = pthread_cond_broadcast(&args->job_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+    }
+  }
 
-    if (args->ready > 0) {
-      /* Wait for all the workers to complete */
-      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  worker->job[b] = NULL;
+  if (b == worker->nbatch - 1) {
+    worker->nbatch = 0;
+    worker->cmd    = NULL;
+  }
 
-      while (args->completed < args->ready) {
-        if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
-      }
+  release_job(args, job);
+}
 
-      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+/* abandon_unit()
+ * Called holding the work mutex when a worker's connection fails.
+ * We can recover from a worker crashing: the units of its batch that
+ * were not finished, and are not being searched by another worker,
+ * go back on their queries' todo lists, unless they have already been
+ * handed out MAX_TRIES times. If no live workers are left, all the
+ * units still waiting are given up on.
+ */
+static void
+abandon_unit(WORKERSIDE_ARGS *args, WORKER_DATA *worker)
+{
+  SEARCH_JOB *job;
+  WORK_UNIT  *unit;
+  int         b;
+  int         n;
+
+  discard_results(worker);
+
+  for (b = 0; b < worker->nbatch; ++b) {
+    if ((job = worker->job[b]) == NULL) continue;
+    unit = job->unit + worker->unit[b];
+
+    --unit->nrun;
+    --job->nrunning;
+    if (!unit->done && unit->nrun == 0) {
+      if (unit->tries < MAX_TRIES) {
+        job->todo[job->ntodo++] = worker->unit[b];
+      } else {
+        job->failed = TRUE;
+        unit->done  = TRUE;
+        ++job->ndone;
+      }
+    }
+    worker->job[b] = NULL;
+    release_job(args, job);
+  }
+  worker->nbatch = 0;
+  worker->cmd    = NULL;
+
+  if (args->nlive == 0) {
+    for (job = args->jobs; job != NULL; job = job->next) {
+      while (job->ntodo > 0) {
+        job->unit[job->todo[--job->ntodo]].done = TRUE;
+        job->failed = TRUE;
+        ++job->ndone;
+      }
     }
+  }
 
-    /* gather up the results from all the workers */
-    gather_results(query, args, &results);
+  if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_cond_broadcast(&args->job_cond))   != 0) LOG_FATAL_MSG("cond broadcast", n);
+}
 
-    /* we can recover from one worker crashing.  get the block that worker ran on
-     * and redistribute its load to all the remaining workers.
-     */
-    inx = results.db_inx;
-    cnt = results.db_cnt;
-    ++tries;
+/* forward_thread()
+ * Waits for a query to finish, then sends its results to the client.
+ * Results go back to each client in the order it sent its queries,
+ * so a query also waits for any older query from the same socket.
+ */
+static void *
+forward_thread(void *arg)
+{
+  SEARCH_JOB      *job   = (SEARCH_JOB *) arg;
+  WORKERSIDE_ARGS *args  = job->parent;
+  QUEUE_DATA      *query = job->query;
+  SEARCH_JOB      *prev  = NULL;
+  int              nlive;
+  int              n;
 
-  } while (args->ready > 0 && results.errors == 1 && tries < 2);
+  /* Guarantees that thread resources are deallocated upon return */
+  pthread_detach(pthread_self()); 
 
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  for ( ;; ) {
+    for (prev = args->jobs; prev != job; prev = prev->next)
+      if (prev->query->sock == query->sock) break;
+    if (prev == job && job->ndone == job->nunits) break;
+    if ((n = pthread_cond_wait (&args->job_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
+  nlive = args->nlive;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-  esl_stopwatch_Stop(w);
+  esl_stopwatch_Stop(job->w);
 
   /* copy the search stats */
-  results.stats.elapsed = w->elapsed;
-  results.stats.user    = w->user;
-  results.stats.sys     = w->sys;
-  results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
-  /* TODO: check for errors */
-  if (args->ready == 0) {
+  job->results.stats.elapsed = job->w->elapsed;
+  job->results.stats.user    = job->w->user;
+  job->results.stats.sys     = job->w->sys;
+  job->results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
+
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    job->results.stats.nmodels = 1;
+    job->results.stats.nseqs   = job->db->seq_db->db[query->dbx].K;
+  } else {
+    job->results.stats.nseqs   = 1;
+    job->results.stats.nmodels = job->db->hmm_db->n;
+  }
+  if (job->results.stats.Z_setby == p7_ZSETBY_NTARGETS) {
+    job->results.stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? job->results.stats.nseqs : job->results.stats.nmodels;
+  }
+
+  if (job->failed && nlive == 0) {
     client_msg(query->sock, eslFAIL, "No compute nodes available\n");
-  } else if (args->failed > 0) {
+    clear_results(&job->results);
+    finish_query(args, query, job->w->elapsed, QUERY_FAILED);
+  } else if (job->failed) {
     client_msg(query->sock, eslFAIL, "Errors running search\n");
-    clear_results(args, &results);
+    clear_results(&job->results);
+    finish_query(args, query, job->w->elapsed, QUERY_FAILED);
   } else {
-    forward_results(query, &results);  
+    if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+    args->metrics.ntargets    += job->results.stats.nseqs * job->results.stats.nmodels;
+    args->metrics.n_past_msv  += job->results.stats.n_past_msv;
+    args->metrics.n_past_bias += job->results.stats.n_past_bias;
+    args->metrics.n_past_vit  += job->results.stats.n_past_vit;
+    args->metrics.n_past_fwd  += job->results.stats.n_past_fwd;
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+    forward_results(query, &job->results, args->cache, job->cache_key);
+    finish_query(args, query, job->w->elapsed, QUERY_SEARCHED);
   }
 
-  esl_stopwatch_Destroy(w);
+  /* take the query off the list, letting the master queue another.
+   * Workers may still be searching copies of straggling units; the
+   * last of them frees the query.
+   */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (args->jobs == job) {
+    args->jobs = job->next;
+  } else {
+    for (prev = args->jobs; prev->next != job; prev = prev->next) ;
+    prev->next = job->next;
+  }
+  --args->njobs;
+  job->forwarded = TRUE;
+  if (job->nrunning > 0) {
+    job->held = TRUE;
+    ++args->nheld;
+  }
+  release_job(args, job);
+  if ((n = pthread_cond_broadcast(&args->job_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  pthread_exit(NULL);
 }
 
 static void
@@ -451,8 +1532,11 @@ process_shutdown(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
 
   WORKER_DATA *worker  = NULL;
 
-  /* process any changes to the available workers */
+  /* let the queries in flight, and any straggling copies of their units, finish */
   if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  while (args->njobs > 0 || args->nheld > 0) {
+    if ((n = pthread_cond_wait (&args->job_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+  }
 
   /* build a list of the currently available workers */
   update_workers(args);
@@ -509,12 +1593,258 @@ process_shutdown(WORKERSIDE_ARGS *args, QUEUE_DATA *query)
 }
 
 
+static void
+print_metric(FILE *fp, const char *name, const char *type, const char *help)
+{
+  fprintf(fp, "# HELP %s %s\n", name, help);
+  fprintf(fp, "# TYPE %s %s\n", name, type);
+}
+
+static void
+print_histogram(FILE *fp, const char *name, const char *help, const HISTOGRAM *h)
+{
+  uint64_t cum = 0;
+  int      i;
+
+  print_metric(fp, name, "histogram", help);
+  for (i = 0; i < HIST_NBINS; ++i) {
+    cum += h->count[i];
+    fprintf(fp, "%s_bucket{le=\"%g\"} %" PRIu64 "\n", name, hist_le[i], cum);
+  }
+  fprintf(fp, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", name, h->n);
+  fprintf(fp, "%s_sum %.6f\n",           name, h->sum);
+  fprintf(fp, "%s_count %" PRIu64 "\n",  name, h->n);
+}
+
+static void
+print_worker(FILE *fp, WORKER_DATA *worker, const char *state)
+{
+  fprintf(fp, "hmmpgmd_worker_units_total{worker=\"%s\",fd=\"%d\",state=\"%s\"} %" PRIu64 "\n",
+          worker->ip_addr, worker->sock_fd, state, worker->nunits);
+  fprintf(fp, "hmmpgmd_worker_busy_seconds_total{worker=\"%s\",fd=\"%d\",state=\"%s\"} %.3f\n",
+          worker->ip_addr, worker->sock_fd, state, worker->busy);
+  fprintf(fp, "hmmpgmd_worker_residues_per_second{worker=\"%s\",fd=\"%d\",state=\"%s\"} %.0f\n",
+          worker->ip_addr, worker->sock_fd, state, (worker->busy > 0.0) ? worker->nres / worker->busy : 0.0);
+}
+
+/* print_stats()
+ * Write what the master has done since it started, and what it is doing
+ * now, to <fp>, in the Prometheus text exposition format.
+ */
+static void
+print_stats(FILE *fp, WORKERSIDE_ARGS *args)
+{
+  CMD_QUEUE      *cq       = args->cmdqueue;
+  SERVER_METRICS *m        = &args->metrics;
+  WORKER_DATA    *worker;
+  uint64_t        nhits    = 0;
+  uint64_t        nmisses  = 0;
+  uint64_t        memsize  = 0;
+  uint64_t        disksize = 0;
+  uint64_t        nrejected;
+  int             nqueued;
+  double          secs;
+  int             n;
+
+  if ((n = pthread_mutex_lock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  nqueued   = cq->nqueued;
+  nrejected = cq->nrejected;
+  if ((n = pthread_mutex_unlock (&cq->mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (args->cache != NULL) hmmd_result_cache_GetCounts(args->cache, &nhits, &nmisses, &memsize, &disksize);
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+
+  print_metric(fp, "hmmpgmd_uptime_seconds", "gauge", "seconds since the master started");
+  fprintf(fp, "hmmpgmd_uptime_seconds %.0f\n", wallclock() - m->started);
+
+  print_metric(fp, "hmmpgmd_queries_queued", "gauge", "queries waiting to be searched");
+  fprintf(fp, "hmmpgmd_queries_queued %d\n", nqueued);
+  print_metric(fp, "hmmpgmd_queries_in_flight", "gauge", "queries being searched");
+  fprintf(fp, "hmmpgmd_queries_in_flight %d\n", args->njobs);
+
+  print_metric(fp, "hmmpgmd_queries_total", "counter", "queries answered, by how");
+  fprintf(fp, "hmmpgmd_queries_total{result=\"searched\"} %" PRIu64 "\n", m->nsearched);
+  fprintf(fp, "hmmpgmd_queries_total{result=\"cached\"} %"   PRIu64 "\n", m->ncached);
+  fprintf(fp, "hmmpgmd_queries_total{result=\"failed\"} %"   PRIu64 "\n", m->nfailed);
+  fprintf(fp, "hmmpgmd_queries_total{result=\"rejected\"} %" PRIu64 "\n", nrejected);
+
+  print_histogram(fp, "hmmpgmd_queue_wait_seconds", "seconds from queued to taken by the master", &m->wait);
+  print_histogram(fp, "hmmpgmd_query_seconds",      "seconds from queued to answered",             &m->latency);
+
+  print_metric(fp, "hmmpgmd_comparisons_total", "counter", "query-target comparisons");
+  fprintf(fp, "hmmpgmd_comparisons_total %" PRIu64 "\n", m->ntargets);
+  print_metric(fp, "hmmpgmd_filter_passed_total", "counter", "comparisons that passed each filter stage");
+  fprintf(fp, "hmmpgmd_filter_passed_total{stage=\"msv\"} %"  PRIu64 "\n", m->n_past_msv);
+  fprintf(fp, "hmmpgmd_filter_passed_total{stage=\"bias\"} %" PRIu64 "\n", m->n_past_bias);
+  fprintf(fp, "hmmpgmd_filter_passed_total{stage=\"vit\"} %"  PRIu64 "\n", m->n_past_vit);
+  fprintf(fp, "hmmpgmd_filter_passed_total{stage=\"fwd\"} %"  PRIu64 "\n", m->n_past_fwd);
+
+  secs = wallclock() - m->started;
+  print_metric(fp, "hmmpgmd_comparisons_per_second", "gauge", "mean comparisons per second since the master started");
+  fprintf(fp, "hmmpgmd_comparisons_per_second %.1f\n", (secs > 0.0) ? m->ntargets / secs : 0.0);
+
+  print_metric(fp, "hmmpgmd_db_version", "gauge", "version of the databases new queries search");
+  fprintf(fp, "hmmpgmd_db_version %d\n", args->db->version);
+  print_metric(fp, "hmmpgmd_db_reloading", "gauge", "1 while a !reload is loading the next version");
+  fprintf(fp, "hmmpgmd_db_reloading %d\n", args->reloading ? 1 : 0);
+
+  print_metric(fp, "hmmpgmd_workers", "gauge", "connected workers, by state");
+  fprintf(fp, "hmmpgmd_workers{state=\"ready\"} %d\n",   args->nlive);
+  fprintf(fp, "hmmpgmd_workers{state=\"pending\"} %d\n", args->pend_cnt);
+  fprintf(fp, "hmmpgmd_workers{state=\"idle\"} %d\n",    args->idle_cnt);
+
+  /* residues are estimated from the database's mean target length */
+  print_metric(fp, "hmmpgmd_worker_units_total",         "counter", "work units searched by each worker");
+  print_metric(fp, "hmmpgmd_worker_busy_seconds_total",  "counter", "seconds each worker spent searching");
+  print_metric(fp, "hmmpgmd_worker_residues_per_second", "gauge",   "residues (or model nodes) searched per busy second");
+  for (worker = args->head;    worker != NULL; worker = worker->next) print_worker(fp, worker, worker->terminated ? "down" : "ready");
+  for (worker = args->pending; worker != NULL; worker = worker->next) print_worker(fp, worker, "pending");
+  for (worker = args->idling;  worker != NULL; worker = worker->next) print_worker(fp, worker, "idle");
+
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (args->cache != NULL) {
+    print_metric(fp, "hmmpgmd_cache_lookups_total", "counter", "result cache lookups, by outcome");
+    fprintf(fp, "hmmpgmd_cache_lookups_total{result=\"hit\"} %"  PRIu64 "\n", nhits);
+    fprintf(fp, "hmmpgmd_cache_lookups_total{result=\"miss\"} %" PRIu64 "\n", nmisses);
+    print_metric(fp, "hmmpgmd_cache_bytes", "gauge", "bytes of cached results");
+    fprintf(fp, "hmmpgmd_cache_bytes{tier=\"memory\"} %" PRIu64 "\n", memsize);
+    fprintf(fp, "hmmpgmd_cache_bytes{tier=\"disk\"} %"   PRIu64 "\n", disksize);
+  }
+}
+
+/* send_stats()
+ * Answer a !stats command: an eslOK status, then the text of
+ * print_stats(), \0-terminated, as its message.
+ */
+static void
+send_stats(int fd, WORKERSIDE_ARGS *args)
+{
+  HMMD_SEARCH_STATUS s;
+  FILE     *fp;
+  char     *text       = NULL;
+  size_t    len        = 0;
+  uint8_t  *buf        = NULL;
+  uint32_t  nalloc     = 0;
+  uint32_t  buf_offset = 0;
+
+  if ((fp = open_memstream(&text, &len)) == NULL) LOG_FATAL_MSG("open_memstream", errno);
+  print_stats(fp, args);
+  if (fclose(fp) != 0) LOG_FATAL_MSG("fclose", errno);
+
+  memset(&s, 0, sizeof(HMMD_SEARCH_STATUS));
+  s.status   = eslOK;
+  s.msg_size = len + 1;
+  if (hmmd_search_status_Serialize(&s, &buf, &buf_offset, &nalloc) != eslOK) LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
+
+  if (writen(fd, buf, buf_offset) != buf_offset || writen(fd, text, s.msg_size) != s.msg_size)
+    p7_syslog(LOG_ERR,"[%s:%d] - writing (%d) error %d - %s\n", __FILE__, __LINE__, fd, errno, strerror(errno));
+
+  free(buf);
+  free(text);
+}
+
+/* stats_thread()
+ * Rewrite the --statsfile every STATS_INTERVAL seconds, for a
+ * Prometheus node exporter's textfile collector or the like. The file
+ * is replaced with rename(), so readers never see half of it.
+ */
+static void *
+stats_thread(void *arg)
+{
+  WORKERSIDE_ARGS *args    = (WORKERSIDE_ARGS *) arg;
+  char            *tmpfile = NULL;
+  FILE            *fp;
+
+  pthread_detach(pthread_self());
+
+  if (esl_sprintf(&tmpfile, "%s.tmp", args->statsfile) != eslOK) LOG_FATAL_MSG("esl_sprintf", errno);
+
+  for ( ;; ) {
+    if ((fp = fopen(tmpfile, "w")) == NULL) {
+      p7_syslog(LOG_ERR,"[%s:%d] - opening %s error %d - %s\n", __FILE__, __LINE__, tmpfile, errno, strerror(errno));
+    } else {
+      print_stats(fp, args);
+      if (fclose(fp) != 0 || rename(tmpfile, args->statsfile) != 0)
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, args->statsfile, errno, strerror(errno));
+    }
+    sleep(STATS_INTERVAL);
+  }
+
+  pthread_exit(NULL);
+}
+
+/* reload_thread()
+ * Load the next version of the databases from the same files, while
+ * the current one goes on being searched. The worker threads then
+ * have their workers load it too (see gen_task()), and the last of
+ * them to finish switches the master over.
+ */
+static void *
+reload_thread(void *arg)
+{
+  WORKERSIDE_ARGS *args = (WORKERSIDE_ARGS *) arg;
+  DB_GEN          *db   = NULL;
+  char             errbuf[eslERRBUFSIZE];
+  int              status;
+  int              n;
+
+  pthread_detach(pthread_self());
+
+  status = load_gen(args->seqdb_file, args->hmmdb_file, &db, errbuf);
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (status != eslOK) {
+    p7_syslog(LOG_ERR,"[%s:%d] - reload failed: %s\n", __FILE__, __LINE__, errbuf);
+    args->reloading = FALSE;
+  } else {
+    db->version = args->db->version + 1;
+    args->next  = db;
+    printf("Database version %d loaded by the master\n", db->version);
+    fflush(stdout);
+
+    switch_gen(args);
+    if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+  }
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  pthread_exit(NULL);
+}
+
+/* start_reload()
+ * Answer a !reload command: start loading the next version of the
+ * databases in the background. Only one reload runs at a time, and not
+ * before the queries on the version before the current one are done.
+ */
+static void
+start_reload(int fd, WORKERSIDE_ARGS *args)
+{
+  pthread_t thread_id;
+  int       busy;
+  int       version;
+  int       n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  busy    = (args->reloading || args->old != NULL);
+  version = args->db->version + 1;
+  if (!busy) args->reloading = TRUE;
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  if (busy) {
+    client_msg(fd, eslFAIL, "A reload is already in progress\n");
+    return;
+  }
+
+  if ((n = pthread_create(&thread_id, NULL, reload_thread, args)) != 0) LOG_FATAL_MSG("thread create", n);
+  client_msg(fd, eslOK, "Reloading the databases as version %d\n", version);
+}
+
 void
 master_process(ESL_GETOPTS *go)
 {
-  P7_SEQCACHE        *seq_db     = NULL;
-  P7_HMMCACHE        *hmm_db     = NULL;
-  ESL_STACK          *cmdstack   = NULL; /* stack of commands that clients want done */
+  DB_GEN             *db         = NULL;
+  CMD_QUEUE           cmdqueue;          /* queue of commands that clients want done */
   QUEUE_DATA         *query      = NULL;
   CLIENTSIDE_ARGS     client_comm;
   WORKERSIDE_ARGS     worker_comm;
@@ -526,27 +1856,9 @@ master_process(ESL_GETOPTS *go)
   impl_Init();
   p7_FLogsumInit();     /* we're going to use table-driven Logsum() approximations at times */
 
-  if (esl_opt_IsUsed(go, "--seqdb")) {
-    char *name = esl_opt_GetString(go, "--seqdb");
-    if ((status = p7_seqcache_Open(name, &seq_db, errbuf)) != eslOK) 
-      p7_Fail("Failed to cache %s (%d)", name, status);
-
-  }
-
-  if (esl_opt_IsUsed(go, "--hmmdb")) {
-    char *name = esl_opt_GetString(go, "--hmmdb");
-
-    status = p7_hmmcache_Open(name, &hmm_db, errbuf);
-    if      (status == eslENOTFOUND) p7_Fail("Failed to open profile database %s\n  %s\n",    name, errbuf);
-    else if (status == eslEFORMAT)   p7_Fail("Failed to parse profile database %s\n  %s\n",   name, errbuf); 
-    else if (status == eslEINCOMPAT) p7_Fail("Mismatched alphabets in profile db %s\n  %s\n", name, errbuf);
-    else if (status != eslOK)        p7_Fail("Failed to load profile db %s : code %d\n",      name, status);
-
-    p7_hmmcache_SetNumericNames(hmm_db);
-
-    printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n", 
-	   name, hmm_db->n, (uint64_t) p7_hmmcache_Sizeof(hmm_db));
-  }
+  status = load_gen(esl_opt_GetString(go, "--seqdb"), esl_opt_GetString(go, "--hmmdb"), &db, errbuf);
+  if (status != eslOK) p7_Fail("%s", errbuf);
+  db->version = 1;
 
   /* if stdout is redirected at the commandline, it causes printf's to be buffered,
    * which means status logging isn't printed. This line strongly requests unbuffering,
@@ -556,55 +1868,82 @@ master_process(ESL_GETOPTS *go)
   printf("Data loaded into memory. Master is ready.\n");
   setvbuf (stdout, NULL, _IOFBF, BUFSIZ);
 
-  /* initialize the search stack, set it up for interthread communication  */
-  cmdstack = esl_stack_PCreate();
-  esl_stack_UseMutex(cmdstack);
-  esl_stack_UseCond(cmdstack);
-
-  /* start the communications with the web clients */
-  client_comm.cmdstack = cmdstack;
-  setup_clientside_comm(go, &client_comm);
+  /* initialize the queue of client commands */
+  init_cmdqueue(&cmdqueue, go);
 
   /* initialize the worker structure */
   if ((n = pthread_mutex_init(&worker_comm.work_mutex, NULL)) != 0)   LOG_FATAL_MSG("mutex init", n);
   if ((n = pthread_cond_init(&worker_comm.start_cond, NULL)) != 0)    LOG_FATAL_MSG("cond init", n);
   if ((n = pthread_cond_init(&worker_comm.complete_cond, NULL)) != 0) LOG_FATAL_MSG("cond init", n);
+  if ((n = pthread_cond_init(&worker_comm.job_cond, NULL)) != 0)      LOG_FATAL_MSG("cond init", n);
 
   worker_comm.sock_fd    = -1;
   worker_comm.head       = NULL;
   worker_comm.tail       = NULL;
   worker_comm.pending    = NULL;
   worker_comm.idling     = NULL;
-  worker_comm.seq_db     = seq_db;
-  worker_comm.hmm_db     = hmm_db;
-  worker_comm.db_version = 1;
+  worker_comm.db         = db;
+  worker_comm.old        = NULL;
+  worker_comm.next       = NULL;
+  worker_comm.reloading  = FALSE;
+  worker_comm.seqdb_file = esl_opt_GetString(go, "--seqdb");
+  worker_comm.hmmdb_file = esl_opt_GetString(go, "--hmmdb");
 
   worker_comm.ready      = 0;
   worker_comm.failed     = 0;
   worker_comm.pend_cnt   = 0;
   worker_comm.idle_cnt   = 0;
+  worker_comm.nlive      = 0;
+
+  worker_comm.jobs       = NULL;
+  worker_comm.njobs      = 0;
+  worker_comm.max_jobs   = esl_opt_GetInteger(go, "--maxq");
+  worker_comm.nheld      = 0;
+
+  worker_comm.cmdqueue   = &cmdqueue;
+  worker_comm.cache      = NULL;
+  if (esl_opt_GetInteger(go, "--cache") > 0) {
+    uint64_t max_mem  = (uint64_t) esl_opt_GetInteger(go, "--cache")     * 1024 * 1024;
+    uint64_t max_disk = (uint64_t) esl_opt_GetInteger(go, "--cachedisk") * 1024 * 1024;
+
+    if ((worker_comm.cache = hmmd_result_cache_Create(max_mem, esl_opt_GetString(go, "--cachedir"), max_disk)) == NULL)
+      p7_Fail("Failed to create the result cache\n");
+  }
+
+  memset(&worker_comm.metrics, 0, sizeof(SERVER_METRICS));
+  worker_comm.metrics.started = wallclock();
+  worker_comm.statsfile       = esl_opt_GetString(go, "--statsfile");
 
   setup_workerside_comm(go, &worker_comm);
 
+  /* start the communications with the web clients */
+  client_comm.cmdqueue = &cmdqueue;
+  client_comm.workers  = &worker_comm;
+  setup_clientside_comm(go, &client_comm);
+
+  if (worker_comm.statsfile != NULL) {
+    pthread_t thread_id;
+    if ((n = pthread_create(&thread_id, NULL, stats_thread, &worker_comm)) != 0) LOG_FATAL_MSG("thread create", n);
+  }
+
   /* read query hmm/sequence 
-   * the PPop() will wait until a client pushes a command to the queue
+   * dequeue() will wait until a client queues a command
    */
   shutdown = 0;
-  while (!shutdown &&  esl_stack_PPop(cmdstack, (void **) &query) == eslOK) {
+  while (!shutdown && (query = dequeue(&cmdqueue)) != NULL) {
     printf("Processing command %d from %s\n", query->cmd_type, query->ip_addr);
     fflush(stdout);
 
-    worker_comm.range_list = NULL;
-
     switch(query->cmd_type) {
     case HMMD_CMD_SEARCH:      
-      if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
-        ESL_ALLOC(worker_comm.range_list, sizeof(RANGE_LIST));
-        hmmpgmd_GetRanges(worker_comm.range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
-      }
-      process_search(&worker_comm, query); 
+    case HMMD_CMD_SCAN:        
+      if ((n = pthread_mutex_lock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+      hist_add(&worker_comm.metrics.wait, wallclock() - query->queued);
+      if ((n = pthread_mutex_unlock (&worker_comm.work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+      process_search(&worker_comm, query);   /* the query now belongs to the search */
+      query = NULL;
       break;
-    case HMMD_CMD_SCAN:        process_search(&worker_comm, query); break;
     case HMMD_CMD_SHUTDOWN:    
       process_shutdown(&worker_comm, query);
       p7_syslog(LOG_ERR,"[%s:%d] - shutting down...\n", __FILE__, __LINE__);
@@ -615,33 +1954,22 @@ master_process(ESL_GETOPTS *go)
       break;
     }
 
-    free_QueueData(query);
+    if (query != NULL) free_QueueData(query);
   }
 
-  esl_stack_ReleaseCond(cmdstack);
-
-  if (hmm_db) p7_hmmcache_Close(hmm_db);
-  if (seq_db) p7_seqcache_Close(seq_db);
+  free_gen(worker_comm.db);
+  free_gen(worker_comm.old);
+  free_gen(worker_comm.next);
+  if (worker_comm.cache) hmmd_result_cache_Destroy(worker_comm.cache);
 
-  esl_stack_Destroy(cmdstack);
+  destroy_cmdqueue(&cmdqueue);
 
   pthread_mutex_destroy(&worker_comm.work_mutex);
   pthread_cond_destroy(&worker_comm.start_cond);
   pthread_cond_destroy(&worker_comm.complete_cond);
-
-
-  if (worker_comm.range_list) {
-    if (worker_comm.range_list->starts)  free(worker_comm.range_list->starts);
-    if (worker_comm.range_list->ends)    free(worker_comm.range_list->ends);
-    free (worker_comm.range_list);
-  }
+  pthread_cond_destroy(&worker_comm.job_cond);
 
   return;
-
-
-ERROR:
-  p7_Fail("Memory allocation error. Code: %d\n",    status);
-
 }
 
 
@@ -665,6 +1993,7 @@ init_results(SEARCH_RESULTS *results)
 {
   results->status.status     = eslOK;
   results->status.msg_size   = 0;
+  results->status.retry_after = 0;
 
   results->stats.nhits       = 0;
   results->stats.nreported   = 0;
@@ -681,96 +2010,162 @@ init_results(SEARCH_RESULTS *results)
   results->hits              = NULL;
   results->stats.hit_offsets = NULL;
   results->nhits             = 0;
-  results->db_inx            = 0;
-  results->db_cnt            = 0;
-  results->errors            = 0;
+  results->runs              = NULL;
+  results->nruns             = 0;
 }
 
+/* gather_results()
+ * Add the results of one worker's unit to the query's results.  The
+ * worker sends its hits best first; they are kept as a separate run
+ * and merged with the others by merge_runs() once the query is done,
+ * so nothing is sorted while holding the work mutex.
+ * Called holding the work mutex.
+ */
 static void
-gather_results(QUEUE_DATA *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+gather_results(SEARCH_RESULTS *results, WORKER_DATA *worker)
 {
-  int cnt;
-  int n;
-  int i0, i1;
-  WORKER_DATA *worker;
+  uint32_t previous_hits = results->stats.nhits;
+  int      i0, i1;
 
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  results->stats.nhits        += worker->stats.nhits;
+  results->stats.nreported    += worker->stats.nreported;
+  results->stats.nincluded    += worker->stats.nincluded;
 
-  /* lock the workers until we have merged the results */
-  if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  results->stats.n_past_msv   += worker->stats.n_past_msv;
+  results->stats.n_past_bias  += worker->stats.n_past_bias;
+  results->stats.n_past_vit   += worker->stats.n_past_vit;
+  results->stats.n_past_fwd   += worker->stats.n_past_fwd;
 
-  /* count the number of hits */
-  cnt = results->nhits;
-  worker = comm->head;
-  while (worker != NULL) {
-    if (worker->completed) {
-      uint32_t previous_hits = results->stats.nhits;
-
-      results->stats.nhits        += worker->stats.nhits;
-      results->stats.nreported    += worker->stats.nreported;
-      results->stats.nincluded    += worker->stats.nincluded;
-
-      results->stats.n_past_msv   += worker->stats.n_past_msv;
-      results->stats.n_past_bias  += worker->stats.n_past_bias;
-      results->stats.n_past_vit   += worker->stats.n_past_vit;
-      results->stats.n_past_fwd   += worker->stats.n_past_fwd;
-
-      results->stats.Z_setby       = worker->stats.Z_setby;
-      results->stats.domZ_setby    = worker->stats.domZ_setby;
-      results->stats.domZ          = worker->stats.domZ;
-      results->stats.Z             = worker->stats.Z;
-
-      results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
-
-      if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-        results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-          LOG_FATAL_MSG("malloc", n);
-        }
+  results->stats.Z_setby       = worker->stats.Z_setby;
+  results->stats.domZ_setby    = worker->stats.domZ_setby;
+  results->stats.domZ          = worker->stats.domZ;
+  results->stats.Z             = worker->stats.Z;
 
-        // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-        }
+  results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
 
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-        // will be freed by forward_results()
+  if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
+    // Add enough space to the list of hits for all the hits from this worker
+    results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
+    if(results->hits == NULL){
+      LOG_FATAL_MSG("malloc", errno);
+    }
 
-        worker->hits = NULL;  
-      }
-      worker->completed   = 0;
-      ++cnt;
-    } else {
-      results->errors++;
-      results->db_inx            = worker->srch_inx;
-      results->db_cnt            = worker->srch_cnt;
+    // copy this worker's hits into the global list
+    for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
+      results->hits[i1] = worker->hits[i0];
     }
 
-    worker = worker->next;
+    if ((results->runs = realloc(results->runs, (results->nruns + 1) * sizeof(int))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    results->runs[results->nruns++] = results->stats.nhits;
+
+    free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
+    // will be freed by forward_results()
+
+    worker->hits = NULL;  
+    worker->allocated_hits = 0;
   }
+  worker->completed = 0;
 
-  if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+  results->nhits = results->stats.nhits;
+}
 
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    results->stats.nmodels = 1;
-    results->stats.nseqs   = comm->seq_db->db[query->dbx].K;
-  } else {
-    results->stats.nseqs   = 1;
-    results->stats.nmodels = comm->hmm_db->n;
+/* run_before()
+ * TRUE if the next hit of run <r1> ranks ahead of the next hit of run
+ * <r2>. Ties go to the earlier run.
+ */
+static int
+run_before(P7_HIT **hits, int *next, int r1, int r2)
+{
+  int cmp = hit_sorter2(&hits[next[r1]], &hits[next[r2]]);
+
+  return (cmp < 0 || (cmp == 0 && r1 < r2));
+}
+
+static void
+sift_down(P7_HIT **hits, int *next, int *heap, int nheap, int i)
+{
+  int r = heap[i];
+  int c;
+
+  while ((c = 2 * i + 1) < nheap) {
+    if (c + 1 < nheap && run_before(hits, next, heap[c+1], heap[c])) c++;
+    if (!run_before(hits, next, heap[c], r)) break;
+    heap[i] = heap[c];
+    i = c;
   }
-    
-  if (results->stats.Z_setby == p7_ZSETBY_NTARGETS) {
-    results->stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results->stats.nseqs : results->stats.nmodels;
+  heap[i] = r;
+}
+
+/* merge_runs()
+ * Merge the workers' sorted runs of hits into one list, best first,
+ * with a heap of the runs ordered by their next hit.  Keeps at most
+ * <maxhits> hits (all of them if <maxhits> is negative) and frees the
+ * rest.
+ */
+static void
+merge_runs(SEARCH_RESULTS *results, int maxhits)
+{
+  P7_HIT **merged = NULL;
+  int     *next   = NULL;	/* next[r]: position in <hits> of run r's next hit */
+  int     *heap   = NULL;	/* runs with hits left                            */
+  int      nheap  = 0;
+  int      nout;
+  int      i, r;
+
+  if (maxhits < 0 || maxhits > results->stats.nhits) maxhits = results->stats.nhits;
+
+  if ((merged = malloc(results->stats.nhits * sizeof(P7_HIT *))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((next   = malloc(results->nruns * sizeof(int)))             == NULL) LOG_FATAL_MSG("malloc", errno);
+  if ((heap   = malloc(results->nruns * sizeof(int)))             == NULL) LOG_FATAL_MSG("malloc", errno);
+
+  for (r = 0; r < results->nruns; r++) {
+    next[r] = (r == 0) ? 0 : results->runs[r-1];
+    if (next[r] < results->runs[r]) heap[nheap++] = r;
+  }
+  for (i = nheap / 2 - 1; i >= 0; i--) sift_down(results->hits, next, heap, nheap, i);
+
+  for (nout = 0; nout < maxhits; nout++) {
+    r = heap[0];
+    merged[nout] = results->hits[next[r]++];
+    if (next[r] == results->runs[r]) heap[0] = heap[--nheap];
+    if (nheap > 0) sift_down(results->hits, next, heap, nheap, 0);
   }
 
-  results->nhits = cnt;
+  /* whatever is left is past the client's limit */
+  for (i = 0; i < nheap; i++) {
+    for (r = next[heap[i]]; r < results->runs[heap[i]]; r++) p7_hit_Destroy(results->hits[r]);
+  }
+
+  free(results->hits);
+  results->hits        = merged;
+  results->stats.nhits = results->nhits = nout;
+
+  free(next);
+  free(heap);
+}
+
+/* cache_results()
+ * Store the reply to a query -- its serialized status, stats and hits,
+ * in the order they're sent -- in the result cache under <key>.
+ */
+static void
+cache_results(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key, uint8_t *status, uint32_t nstatus, uint8_t *stats, uint32_t nstats, uint8_t *hits, uint32_t nhits)
+{
+  uint64_t  size = (uint64_t) nstatus + nstats + nhits;
+  uint8_t  *data;
+
+  if ((data = malloc(size)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memcpy(data, status, nstatus);
+  memcpy(data + nstatus, stats, nstats);
+  if (nhits > 0) memcpy(data + nstatus + nstats, hits, nhits);
+
+  if (hmmd_result_cache_Put(cache, key, data, size) != eslOK)
+    p7_syslog(LOG_ERR,"[%s:%d] - failed to cache results\n", __FILE__, __LINE__);
+  free(data);
 }
 
 static void
-forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
+forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results, HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *cache_key)
 {
   P7_TOPHITS         th;
   P7_PIPELINE        *pli   = NULL;
@@ -780,6 +2175,8 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
   uint8_t **buf, **buf2, **buf3, *buf_ptr, *buf2_ptr, *buf3_ptr;
   uint32_t nalloc, nalloc2, nalloc3, buf_offset, buf_offset2, buf_offset3;
   enum p7_pipemodes_e mode;
+  int maxhits, maxaln;
+  int limited;
   int i;
   // Initialize these pointers-to-pointers that we'll use for sending data
   buf_ptr = NULL;
@@ -791,6 +2188,8 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 
   fd    = query->sock;
 
+  limited = hmmpgmd_GetHitLimits(query->opts, &maxhits, &maxaln);
+
   if (query->cmd_type == HMMD_CMD_SEARCH) mode = p7_SEARCH_SEQS;
   else                                    mode = p7_SCAN_MODELS;
     
@@ -803,8 +2202,13 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
       if ((results->stats.hit_offsets = malloc(results->stats.nhits * sizeof(uint64_t))) == NULL) LOG_FATAL_MSG("malloc", errno);
     }
 
-    // sort the hits 
-    qsort(results->hits, results->stats.nhits, sizeof(P7_HIT *), hit_sorter2);
+    /* each worker sent its hits sorted, and only its best ones if the
+     * client set limits; keep the best of those */
+    merge_runs(results, limited ? maxhits : -1);
+    if (limited) {
+      for (i = (maxaln >= 0) ? maxaln : results->stats.nhits; i < results->stats.nhits; i++)
+        hmmpgmd_DropAlignments(results->hits[i]);
+    }
 
     th.unsrt     = NULL;
     th.N         = results->stats.nhits;
@@ -829,7 +2233,15 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 
     th.hit = results->hits;
 
+    /* the workers counted the reportable targets before dropping any
+     * hits, so their sum is the domZ of the whole search */
+    if (limited && pli->domZ_setby == p7_ZSETBY_NTARGETS) {
+      pli->domZ       = (double) results->stats.nreported;
+      pli->domZ_setby = p7_ZSETBY_OPTION;
+    }
+
     p7_tophits_Threshold(&th, pli);
+    pli->domZ_setby = results->stats.domZ_setby;
 
     /* after the top hits thresholds are checked, the number of sequences
      * and domains to be reported can change. */
@@ -878,6 +2290,9 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
     LOG_FATAL_MSG("Serializing HMMD_SEARCH_STATUS failed", errno);
   }
 
+  // Keep the reply, as sent, for the next client who asks the same question
+  if (cache != NULL && cache_key != NULL) cache_results(cache, cache_key, buf3_ptr, buf_offset3, buf2_ptr, buf_offset2, buf_ptr, buf_offset);
+
   // Now, send the buffers in the reverse of the order they were built
   /* send back a successful status message */
   n = buf_offset3;
@@ -914,6 +2329,7 @@ forward_results(QUEUE_DATA *query, SEARCH_RESULTS *results)
 
   free(results->hits);
   results->hits = NULL;
+  if (results->runs) free(results->runs);
 
   if (pli)  p7_pipeline_Destroy(pli);
   if (hits) free(hits);
@@ -953,35 +2369,9 @@ destroy_worker(WORKER_DATA *worker)
 }
 
 static void
-clear_results(WORKERSIDE_ARGS *args, SEARCH_RESULTS *results)
+clear_results(SEARCH_RESULTS *results)
 {
   int i;
-  int n;
-  WORKER_DATA *worker;
-
-  /* lock the workers until we have freed the results */
-  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-  assert(validate_workers(args));
-
-  /* free all the results */
-  worker = args->head;
-  while (worker != NULL) {
-    if (worker->err_buf  != NULL) free(worker->err_buf);
-    if(worker->hits != NULL){
-      for(i =0; i < worker->allocated_hits; i++){
-        p7_hit_Destroy(worker->hits[i]);
-      }
-      free(worker->hits);
-      worker->hits = NULL;
-    }
-    worker->err_buf  = NULL;
-      
-    worker->completed = 0;
-    worker = worker->next;
-  }
-
-  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
 
   for (i = 0; i < results->nhits; ++i) {
     if (results->hits[i]  != NULL) p7_hit_Destroy(results->hits[i]);
@@ -989,6 +2379,7 @@ clear_results(WORKERSIDE_ARGS *args, SEARCH_RESULTS *results)
   }
 
   if (results->hits != NULL) free(results->hits);
+  if (results->runs != NULL) free(results->runs);
   init_results(results);
 }
 
@@ -998,7 +2389,6 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   QUEUE_DATA    *parms    = NULL;     /* cmd to queue           */
   HMMD_COMMAND  *cmd      = NULL;     /* parsed cmd to process  */
   int            fd       = data->sock_fd;
-  ESL_STACK     *cmdstack = data->cmdstack;
   char          *s;
   time_t         date;
   char           timestamp[32];
@@ -1021,6 +2411,16 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
       cmd->hdr.length  = 0;
       cmd->hdr.command = HMMD_CMD_SHUTDOWN;
     } 
+  else if (strcmp(s, "stats") == 0)
+    {
+      send_stats(fd, data->workers);
+      return;
+    }
+  else if (strcmp(s, "reload") == 0)
+    {
+      start_reload(fd, data->workers);
+      return;
+    }
   else 
     {
       client_msg(fd, eslEINVAL, "Unknown command %s\n", s);
@@ -1048,7 +2448,7 @@ process_ServerCmd(char *ptr, CLIENTSIDE_ARGS *data)
   printf("Queuing command %d from %s (%d)\n", cmd->hdr.command, parms->ip_addr, parms->sock);
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  enqueue_command(data->cmdqueue, parms);
 }
 
 static int
@@ -1075,8 +2475,8 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   ESL_GETOPTS       *opts    = NULL;     /* search specific options        */
   HMMD_COMMAND      *cmd     = NULL;     /* search cmd to send to workers  */
 
-  ESL_STACK         *cmdstack = data->cmdstack;
   QUEUE_DATA        *parms;
+  uint32_t           retry;
   jmp_buf            jmp_env;
   time_t             date;
   char               timestamp[32];
@@ -1326,6 +2726,7 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   parms->sock       = data->sock_fd;
   parms->cmd_type   = cmd->hdr.command;
   parms->query_type = (seq != NULL) ? HMMD_SEQUENCE : HMMD_HMM;
+  parms->priority   = esl_opt_GetBoolean(opts, "--batch") ? HMMD_PRIORITY_BATCH : HMMD_PRIORITY_INTERACTIVE;
 
   date = time(NULL);
   ctime_r(&date, timestamp);
@@ -1339,34 +2740,16 @@ clientside_loop(CLIENTSIDE_ARGS *data)
   printf("%s", opt_str);	/* note opt_str already has trailing \n */
   fflush(stdout);
 
-  esl_stack_PPush(cmdstack, parms);
+  if (enqueue_query(data->cmdqueue, parms, &retry) != eslOK) {
+    client_busy_msg(data->sock_fd, retry, "Too many queries waiting; try again in %u seconds\n", (unsigned int) retry);
+    free_QueueData(parms);
+  }
 
   free(buffer);
   return 0;
 }
 
 
-/* discard_function()
- * function handed to esl_stack_DiscardSelected() to remove
- * all commands in the stack that are associated with a
- * particular client socket, because we're closing that
- * client down. Prototype to this is dictate by the generalized
- * interface to esl_stack_DiscardSelected().
- */
-static int
-discard_function(void *elemp, void *args)
-{
-  QUEUE_DATA  *elem = (QUEUE_DATA *) elemp;
-  int          fd   = * (int *) args;
-
-  if (elem->sock == fd) 
-    {
-      free_QueueData(elem);
-      return TRUE;
-    }
-  return FALSE;
-}
-
 static void *
 clientside_thread(void *arg)
 {
@@ -1381,8 +2764,8 @@ clientside_thread(void *arg)
     eof = clientside_loop(data);
   }
 
-  /* remove any commands in stack associated with this client's socket */
-  esl_stack_DiscardSelected(data->cmdstack, discard_function, &(data->sock_fd));
+  /* remove any commands in the queue associated with this client's socket */
+  discard_queued(data->cmdqueue, data->sock_fd);
 
   printf("Closing %s (%d)\n", data->ip_addr, data->sock_fd);
   fflush(stdout);
@@ -1413,7 +2796,8 @@ client_comm_thread(void *arg)
     if ((fd = accept(data->sock_fd, (struct sockaddr *)&addr, (unsigned int *)&n)) < 0) LOG_FATAL_MSG("accept", errno);
 
     if ((targs = malloc(sizeof(CLIENTSIDE_ARGS))) == NULL) LOG_FATAL_MSG("malloc", errno);
-    targs->cmdstack   = data->cmdstack;
+    targs->cmdqueue   = data->cmdqueue;
+    targs->workers    = data->workers;
     targs->sock_fd    = fd;
 
     addrlen = sizeof(targs->ip_addr);
@@ -1469,18 +2853,284 @@ setup_clientside_comm(ESL_GETOPTS *opts, CLIENTSIDE_ARGS *args)
   if ((n = pthread_create(&thread_id, NULL, client_comm_thread, (void *)args)) != 0) LOG_FATAL_MSG("socket", n);
 }
 
+/* read_results()
+ * Read one set of search results from a worker into <worker>.
+ * Returns the number of bytes read, or -1 if the connection failed.
+ */
+static int
+read_results(WORKER_DATA *worker)
+{
+  HMMD_SEARCH_STATS  *stats = NULL;
+  int    n, i;
+  int    size;
+  int    total;
+  uint8_t *buf; // Buffer to receive bytes into over sockets
+  uint32_t buf_position; //Index into buffer for deserialize
+
+  total = 0;
+
+  n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
+  buf = malloc(n);
+  if (buf == NULL){
+    LOG_FATAL_MSG("malloc", errno);
+  }
+
+  total += n;
+  if ((size = readn(worker->sock_fd, buf, n)) == -1) {
+    p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    free(buf);
+    return -1;
+  }
+
+  buf_position = 0;
+  if(hmmd_search_status_Deserialize(buf, &buf_position, &(worker->status)) != eslOK){
+     LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
+  }
+
+  if (worker->status.status != eslOK) {
+    n = worker->status.msg_size;
+    total += n; 
+    if ((worker->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+    worker->err_buf[0] = 0;
+    if ((size = readn(worker->sock_fd, worker->err_buf, n)) == -1) {
+      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      free(buf);
+      return -1;
+    }
+  } else {
+
+    // receive the results from the worker
+    buf = realloc(buf, worker->status.msg_size);
+    if(buf == NULL){
+      LOG_FATAL_MSG("malloc", errno);
+    }
+
+    total += worker->status.msg_size;
+    if ((size = readn(worker->sock_fd, buf, worker->status.msg_size)) == -1) {
+      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+      free(buf);
+      return -1;
+    }
+
+    buf_position = 0; // start at beginning of new buffer of data
+    // Now, serialize the data structures out of it
+    if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
+      LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
+    }
+    stats = &worker->stats;
+    if(stats->nhits > 0){
+      worker->hits = malloc(stats->nhits * sizeof(P7_HIT *));
+      if(worker->hits == NULL){
+        LOG_FATAL_MSG("malloc", errno);
+      }
+      worker->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
+      /* read in the hits */
+      for(i = 0; i < stats->nhits; i++){
+        worker->hits[i] = p7_hit_Create_empty();
+        if(worker->hits[i] == NULL){
+          LOG_FATAL_MSG("malloc", errno);
+        }
+        if(p7_hit_Deserialize(buf, &buf_position, worker->hits[i]) != eslOK){
+          LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
+        } 
+      }
+    }
+  }
+  free(buf);
+
+  /* We've just allocated an array of pointers to P7_HIT objects and a bunch of P7_HIT 
+    objects that we don't free in this function.  Here's what happens to them.  gather_results() appends
+    the P7_HIT objects of each unit to its query's list, which forward_thread() passes to forward_results().  
+    gather_results() frees each worker's array of pointers to P7_HIT objects, and forward_results is responsible for 
+    freeing all of the P7_HIT objects when it's done with them */
+
+  return total;
+}
+
+/* write_batch()
+ * Send the worker's batch of searches as one HMMD_CMD_BATCH message.
+ * Returns eslOK, or eslFAIL if the connection failed.
+ */
+static int
+write_batch(WORKER_DATA *worker)
+{
+  HMMD_COMMAND *cmd;
+  HMMD_COMMAND *sub;
+  char         *ptr;
+  size_t        n;
+  int           b;
+
+  n = sizeof(HMMD_HEADER);
+  for (b = 0; b < worker->nbatch; ++b) n += HMMD_BATCH_ALIGN(MSG_SIZE(worker->job[b]->query->cmd));
+
+  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, n);		/* silence valgrind bitching about uninit bytes; remove if we ever serialize structs properly */
+  cmd->hdr.length  = n - sizeof(HMMD_HEADER);
+  cmd->hdr.command = HMMD_CMD_BATCH;
+
+  ptr = (char *) cmd + sizeof(HMMD_HEADER);
+  for (b = 0; b < worker->nbatch; ++b) {
+    sub = (HMMD_COMMAND *) ptr;
+    memcpy(sub, worker->job[b]->query->cmd, MSG_SIZE(worker->job[b]->query->cmd));
+    sub->srch.inx = worker->srch_inx;
+    sub->srch.cnt = worker->srch_cnt;
+    ptr += HMMD_BATCH_ALIGN(MSG_SIZE(sub));
+  }
+
+  if (writen(worker->sock_fd, cmd, n) != n) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    free(cmd);
+    return eslFAIL;
+  }
+
+  free(cmd);
+  return eslOK;
+}
+
+/* init_command()
+ * Build the HMMD_CMD_INIT or HMMD_CMD_RELOAD command that has a worker
+ * load version <db> of the databases. Called holding the work mutex.
+ */
+static HMMD_COMMAND *
+init_command(DB_GEN *db, int command)
+{
+  HMMD_COMMAND *cmd;
+  char         *p;
+  int           n;
+
+  n = sizeof(HMMD_COMMAND);
+  if (db->seq_db != NULL) n += strlen(db->seq_db->name) + 1;
+  if (db->hmm_db != NULL) n += strlen(db->hmm_db->name) + 1;
+
+  if ((cmd = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
+  memset(cmd, 0, n);
+
+  cmd->hdr.length      = n - sizeof(HMMD_HEADER);
+  cmd->hdr.command     = command;
+  cmd->init.db_version = db->version;
+
+  p = cmd->init.data;
+
+  if (db->seq_db != NULL) {
+    cmd->init.db_cnt      = db->seq_db->db_cnt;
+    cmd->init.seq_cnt     = db->seq_db->count;
+    cmd->init.seqdb_off   = p - cmd->init.data;
+
+    strncpy(cmd->init.sid, db->seq_db->id, sizeof(cmd->init.sid));
+    cmd->init.sid[sizeof(cmd->init.sid)-1] = 0;
+
+    strcpy(p, db->seq_db->name);
+    p += strlen(db->seq_db->name) + 1;
+  }
+
+  if (db->hmm_db != NULL) {
+    cmd->init.hmm_cnt     = 1;
+    cmd->init.model_cnt   = db->hmm_db->n;
+    cmd->init.hmmdb_off   = p - cmd->init.data;
+
+    //strncpy(cmd->init.hid, db->hmm_db->id, sizeof(cmd->init.hid));
+    //cmd->init.hid[sizeof(cmd->init.hid)-1] = 0;
+
+    strcpy(p, db->hmm_db->name);
+    p += strlen(db->hmm_db->name) + 1;
+  }
+
+  return cmd;
+}
+
+/* gen_task()
+ * Called by a worker thread holding the work mutex. Returns the
+ * command to send its worker about the versions of the databases, or
+ * 0 if there is none: HMMD_CMD_RETIRE once the master has freed the
+ * worker's older version, HMMD_CMD_RELOAD while a next version waits
+ * for the worker to load it (at most every RELOAD_PROBE seconds).
+ */
+static int
+gen_task(WORKERSIDE_ARGS *args, WORKER_DATA *worker)
+{
+  if (worker->idle) return 0;
+
+  if (worker->old_version != 0 && worker->old_version != args->db->version && (args->old == NULL || worker->old_version != args->old->version))
+    return HMMD_CMD_RETIRE;
+
+  if (args->next != NULL && worker->db_version != args->next->version && wallclock() - worker->probed >= RELOAD_PROBE)
+    return HMMD_CMD_RELOAD;
+
+  return 0;
+}
+
+/* send_gen_task()
+ * Send the worker the command gen_task() chose, and read its answer.
+ * A worker that has loaded the next version can search it as well as
+ * the version it had; the master switches when all of them can.
+ * Returns eslOK, or eslFAIL if the connection failed or the worker
+ * could not load the next version.
+ */
+static int
+send_gen_task(WORKERSIDE_ARGS *args, WORKER_DATA *worker, int command)
+{
+  HMMD_COMMAND *cmd;
+  HMMD_HEADER   hdr;
+  int           version;
+  int           n;
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (command == HMMD_CMD_RELOAD) {
+    cmd     = init_command(args->next, HMMD_CMD_RELOAD);
+    version = args->next->version;
+    worker->probed = wallclock();
+  } else {
+    if ((cmd = malloc(sizeof(HMMD_COMMAND))) == NULL) LOG_FATAL_MSG("malloc", errno);
+    memset(cmd, 0, sizeof(HMMD_COMMAND));
+    cmd->hdr.length      = sizeof(HMMD_INIT_CMD);
+    cmd->hdr.command     = HMMD_CMD_RETIRE;
+    cmd->init.db_version = version = worker->old_version;
+  }
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  n = MSG_SIZE(cmd);
+  if (writen(worker->sock_fd, cmd, n) != n) {
+    p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    free(cmd);
+    return eslFAIL;
+  }
+  free(cmd);
+
+  if (readn(worker->sock_fd, &hdr, sizeof(HMMD_HEADER)) == -1) {
+    p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+    return eslFAIL;
+  }
+  if (hdr.command != command || (hdr.status != eslOK && hdr.status != eslEINCOMPLETE)) {
+    p7_syslog(LOG_ERR,"[%s:%d] - %s failed to load database version %d: status %d\n", __FILE__, __LINE__, worker->ip_addr, version, hdr.status);
+    return eslFAIL;
+  }
+
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  if (command == HMMD_CMD_RETIRE) {
+    worker->old_version = 0;
+  } else if (hdr.status == eslOK && worker->db_version != version) {
+    printf("Worker %s loaded database version %d\n", worker->ip_addr, version);
+    fflush(stdout);
+    worker->old_version = worker->db_version;
+    worker->db_version  = version;
+    switch_gen(args);
+  }
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+  return eslOK;
+}
+
 static void
 workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
 {
   ESL_STOPWATCH      *w     = NULL;
-  HMMD_SEARCH_STATS  *stats = NULL;
   HMMD_COMMAND        cmd;
-  int    n, i;
+  int    n, b;
   int    size;
   int    total;
+  int    task;
+  double nres;
   char  *ptr;
-  uint8_t *buf; // Buffer to receive bytes into over sockets
-  uint32_t buf_position; //Index into buffer for deserialize
   memset(&cmd, 0, sizeof(HMMD_COMMAND)); /* silence valgrind. if we ever serialize structs properly, remove */
   w = esl_stopwatch_Create();
 
@@ -1489,13 +3139,31 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
     /* wait for the next search object */
     if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
-    /* wait for the master's signal to start the calculations */
-    while (worker->cmd == NULL) {
-      if ((n = pthread_cond_wait(&data->start_cond, &data->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+    /* wait for a command from the master, a reload, or a unit of a query
+     * in flight. While queries are in flight or a reload is waiting,
+     * wake up every second to look for straggling units and to ask
+     * the worker how its reload is going.
+     */
+    task = 0;
+    while (worker->cmd == NULL && (task = gen_task(data, worker)) == 0 && (worker->idle || !next_unit(data, worker))) {
+      if (data->njobs > 0 || data->next != NULL) {
+        struct timespec ts;
+        ts.tv_sec  = time(NULL) + 1;
+        ts.tv_nsec = 0;
+        n = pthread_cond_timedwait(&data->start_cond, &data->work_mutex, &ts);
+        if (n != 0 && n != ETIMEDOUT) LOG_FATAL_MSG("cond timedwait", n);
+      } else {
+        if ((n = pthread_cond_wait(&data->start_cond, &data->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
+      }
     }
 
     if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
+    if (task != 0) {
+      if (send_gen_task(data, worker, task) != eslOK) break;
+      continue;
+    }
+
     if (worker->cmd->hdr.command == HMMD_CMD_SHUTDOWN) {
       fd_set rset;
       struct timeval tv;
@@ -1534,117 +3202,60 @@ workerside_loop(WORKERSIDE_ARGS *data, WORKER_DATA *worker)
 
     //printf ("Writing %d bytes to %s [MSG = %d/%d]\n", (int)MSG_SIZE(worker->cmd), worker->ip_addr, worker->cmd->hdr.command, worker->cmd->hdr.length);
 
+    /* the batch searches one range, so count its targets once */
+    nres = worker->srch_cnt * ((worker->cmd->hdr.command == HMMD_CMD_SEARCH) ? worker->job[0]->db->seq_mean_len : worker->job[0]->db->hmm_mean_len);
+
     esl_stopwatch_Start(w);
 
-    /* write search message in two parts */
-    n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
-    memcpy(&cmd, worker->cmd, n);
-    cmd.srch.inx = worker->srch_inx;
-    cmd.srch.cnt = worker->srch_cnt;
-    if (writen(worker->sock_fd, &cmd, n) != n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
-    }
+    if (worker->nbatch > 1) {
+      if (write_batch(worker) != eslOK) break;
+    } else {
+      /* write search message in two parts */
+      n = sizeof(HMMD_HEADER) + sizeof(HMMD_SEARCH_CMD);
+      memcpy(&cmd, worker->cmd, n);
+      cmd.srch.inx = worker->srch_inx;
+      cmd.srch.cnt = worker->srch_cnt;
+      if (writen(worker->sock_fd, &cmd, n) != n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+        break;
+      }
 
-    /* write remaining data, i.e. sequence, options etc. */
-    ptr = (char *)worker->cmd;
-    ptr += n;
-    n = MSG_SIZE(worker->cmd) - n;
-    if (writen(worker->sock_fd, ptr, n) != n) {
-      p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
+      /* write remaining data, i.e. sequence, options etc. */
+      ptr = (char *)worker->cmd;
+      ptr += n;
+      n = MSG_SIZE(worker->cmd) - n;
+      if (writen(worker->sock_fd, ptr, n) != n) {
+        p7_syslog(LOG_ERR,"[%s:%d] - writing %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
+        break;
+      }
     }
     
     total = 0;
     worker->total = 0;
 
-    n = HMMD_SEARCH_STATUS_SERIAL_SIZE;
-    buf = malloc(n);
-    if (buf == NULL){
-      LOG_FATAL_MSG("malloc", errno);
-    }
-
-    total += n;
-    if ((size = readn(worker->sock_fd, buf, n)) == -1) {
-      p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-      break;
-    }
-
-    buf_position = 0;
-    if(hmmd_search_status_Deserialize(buf, &buf_position, &(worker->status)) != eslOK){
-       LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATUS", errno);
-    }
-
-    if (worker->status.status != eslOK) {
-      n = worker->status.msg_size;
-      total += n; 
-      if ((worker->err_buf = malloc(n)) == NULL) LOG_FATAL_MSG("malloc", errno);
-      worker->err_buf[0] = 0;
-      if ((size = readn(worker->sock_fd, worker->err_buf, n)) == -1) {
-        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
-    } else {
-
-      // receive the results from the worker
-      buf = realloc(buf, worker->status.msg_size);
-      if(buf == NULL){
-        LOG_FATAL_MSG("malloc", errno);
-      }
-
-      total += worker->status.msg_size;
-      if ((size = readn(worker->sock_fd, buf, worker->status.msg_size)) == -1) {
-        p7_syslog(LOG_ERR,"[%s:%d] - reading %s error %d - %s\n", __FILE__, __LINE__, worker->ip_addr, errno, strerror(errno));
-        break;
-      }
+    /* one set of results per search of the batch, in order */
+    size = worker->nbatch;
+    for (b = 0; b < size; ++b) {
+      if ((n = read_results(worker)) < 0) break;
+      total += n;
 
-      buf_position = 0; // start at beginning of new buffer of data
-      // Now, serialize the data structures out of it
-      if(p7_hmmd_search_stats_Deserialize(buf, &buf_position, &(worker->stats)) != eslOK){
-        LOG_FATAL_MSG("Couldn't deserialize HMMD_SEARCH_STATS", errno);
-      }
-      stats = &worker->stats;
-      if(stats->nhits > 0){
-        worker->hits = malloc(stats->nhits * sizeof(P7_HIT *));
-        if(worker->hits == NULL){
-          LOG_FATAL_MSG("malloc", errno);
-        }
-        worker->allocated_hits = stats->nhits;  // Need this if we have to destroy the worker because of an error
-        /* read in the hits */
-        for(i = 0; i < stats->nhits; i++){
-          worker->hits[i] = p7_hit_Create_empty();
-          if(worker->hits[i] == NULL){
-            LOG_FATAL_MSG("malloc", errno);
-          }
-          if(p7_hit_Deserialize(buf, &buf_position, worker->hits[i]) != eslOK){
-            LOG_FATAL_MSG("Couldn't deserialize P7_HIT", errno);
-          } 
-        }
-      }
-      free(buf);
+      if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+      finish_unit(data, worker, b);
+      if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
     }
-
-    /* We've just allocated an array of pointers to P7_HIT objects and a bunch of P7_HIT 
-      objects that we don't free in this function.  Here's what happens to them.  gather_results() assembles
-      all of the P7_HIT objects from the different workers into one big list, which it passes to forward_results().  
-      gather_results() frees each worker's array of pointers to P7_HIT objects, and forward_results is responsible for 
-      freeing all of the P7_HIT objects when it's done with them */
+    if (b < size) break;
 
     esl_stopwatch_Stop(w);
 
     if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-    /* set the state of the worker to completed */
-    worker->cmd       = NULL;
     worker->completed = 1;
     worker->total     = total;
-    ++data->completed;
-
-    /* notify the master that a worker has completed */
-    if ((n = pthread_cond_broadcast(&data->complete_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
+    worker->nunits   += size;
+    worker->nres     += nres;
+    worker->busy     += w->elapsed;
     if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
 
-    printf ("WORKER %s COMPLETED: %.2f sec received %d bytes\n", worker->ip_addr, w->elapsed, total);
+    printf ("WORKER %s COMPLETED: %.2f sec received %d bytes for %d queries\n", worker->ip_addr, w->elapsed, total, size);
     fflush(stdout);
   }
 
@@ -1665,7 +3276,6 @@ workerside_thread(void *arg)
   int               version;
   int               updated;
   int               status = eslOK;
-  char             *p;
 
   memset(&hdr, 0, sizeof(HMMD_HEADER)); /* silence valgrind; remove if/when we serialize structs properly */
 
@@ -1679,48 +3289,11 @@ workerside_thread(void *arg)
   while (!updated) {
     /* get the database version to load */
     if ((n = pthread_mutex_lock (&parent->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-    version = parent->db_version;
+    version = parent->db->version;
+    if (cmd != NULL) free(cmd);
+    cmd = init_command(parent->db, HMMD_CMD_INIT);
     if ((n = pthread_mutex_unlock (&parent->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
-
-    n = sizeof(HMMD_COMMAND);
-    if (parent->seq_db != NULL) n += strlen(parent->seq_db->name) + 1;
-    if (parent->hmm_db != NULL) n += strlen(parent->hmm_db->name) + 1;
-
-    cmd = malloc(n);
-    if (cmd == NULL) {
-      p7_syslog(LOG_ERR,"[%s:%d] - malloc %d - %s\n", __FILE__, __LINE__, errno, strerror(errno));
-      goto EXIT;
-    }
-    memset(cmd, 0, n);
-
-    cmd->hdr.length  = n - sizeof(HMMD_HEADER);
-    cmd->hdr.command = HMMD_CMD_INIT;
-
-    p = cmd->init.data;
-
-    if (parent->seq_db != NULL) {
-      cmd->init.db_cnt      = parent->seq_db->db_cnt;
-      cmd->init.seq_cnt     = parent->seq_db->count;
-      cmd->init.seqdb_off   = p - cmd->init.data;
-
-      strncpy(cmd->init.sid, parent->seq_db->id, sizeof(cmd->init.sid));
-      cmd->init.sid[sizeof(cmd->init.sid)-1] = 0;
-
-      strcpy(p, parent->seq_db->name);
-      p += strlen(parent->seq_db->name) + 1;
-    }
-
-    if (parent->hmm_db != NULL) {
-      cmd->init.hmm_cnt     = 1;
-      cmd->init.model_cnt   = parent->hmm_db->n;
-      cmd->init.hmmdb_off   = p - cmd->init.data;
-
-      //strncpy(cmd->init.hid, parent->hmm_db->id, sizeof(cmd->init.hid));
-      //cmd->init.hid[sizeof(cmd->init.hid)-1] = 0;
-
-      strcpy(p, parent->hmm_db->name);
-      p += strlen(parent->hmm_db->name) + 1;
-    }
+    n = MSG_SIZE(cmd);
 
     if (writen(worker->sock_fd, cmd, n) != n) {
       p7_syslog(LOG_ERR,"[%s:%d] - writing (%d) error %d - %s\n", __FILE__, __LINE__, worker->sock_fd, errno, strerror(errno));
@@ -1771,15 +3344,19 @@ workerside_thread(void *arg)
      * for the worker to load and verify the database we started out this.  If
      * the version has changed, force the worker to reload and verify.
      */
-    if (version == parent->db_version) {
+    if (version == parent->db->version) {
+      worker->db_version  = version;
+      worker->old_version = 0;
       if (status == eslOK) {
         worker->next    = parent->pending;
         parent->pending = worker;
         ++parent->pend_cnt;
+        ++parent->nlive;
       } else {
         worker->next   = parent->idling;
         parent->idling = worker;
         ++parent->idle_cnt;
+        worker->idle   = TRUE;
       }
       updated = 1;
     }
@@ -1805,6 +3382,13 @@ workerside_thread(void *arg)
   worker->total      = 0;
   worker->sock_fd    = -1;
 
+  /* hand the worker's unit, if any, to someone else */
+  if (!worker->idle) --parent->nlive;
+  abandon_unit(parent, worker);
+
+  /* a reload may have been waiting for this worker only */
+  switch_gen(parent);
+
   assert(validate_workers(parent));
 
   /* notify the master that a worker has completed */
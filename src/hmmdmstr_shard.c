@@ -45,19 +45,28 @@
 #define MAX_BUFFER   4096
 
 #define CONF_FILE "/etc/hmmpgmd.conf"
-#define INVALID_IP 0xfefefefe // 254.254.254.254 is supposed to be in the "reserved for future use" range of IPs, so we
-  // should never see one
+#define MAX_TRIES   3	/* times a part of a search is given to a worker before giving up */
 
 typedef struct {
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
   P7_HIT           **hits;
   int                 nhits;
-  int                 db_inx;
-  int                 db_cnt;
-  int                 errors;
 } SEARCH_RESULTS;
 
+/* A part of a query: one shard of a sequence database, searched by any
+ * of the workers holding that shard, or a slice of the hmm database,
+ * which isn't sharded and can be searched by any worker.
+ */
+typedef struct {
+  int              shard;	/* shard to search, or -1 for any worker */
+  uint32_t         inx;
+  uint32_t         cnt;
+  int              tries;	/* number of workers it has been given to */
+  int              done;
+  struct worker_s *worker;	/* worker searching it now, or NULL       */
+} SHARD_TASK;
+
 typedef struct {
   int             sock_fd;
   char            ip_addr[64];
@@ -91,7 +100,7 @@ typedef struct {
 
   int              completed;
   uint32_t         num_shards;  // new for sharding
-  uint32_t         *worker_ips;  // IP addresses of the workers we've connected to
+  int              *replicas;   // replicas[s]: number of live workers holding shard s
 
 } WORKERSIDE_ARGS;
 
@@ -119,6 +128,8 @@ typedef struct worker_s {
   struct worker_s      *prev;
   uint32_t             num_shards;  // New for sharding
   uint32_t             my_shard;    // New for sharding
+  int                  nsearches;   // searches given to this worker, to spread them over a shard's replicas
+  int                  counted;     // TRUE while it is counted in parent->replicas[my_shard]
 } WORKER_DATA;
 
 static void
@@ -142,7 +153,7 @@ static void destroy_worker(WORKER_DATA *worker);
 
 static void init_results(SEARCH_RESULTS *results);
 static void clear_results(WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
-static void gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results);
+static void gather_results(SEARCH_RESULTS *results, WORKER_DATA *worker);
 static void forward_results(QUEUE_DATA_SHARD *query, SEARCH_RESULTS *results);
 
 static void print_client_msg(int fd, int status, char *format, va_list ap)
@@ -289,7 +300,6 @@ update_workers(WORKERSIDE_ARGS *args)
     if (worker->terminated) {
       --args->failed;
       --args->ready;
-      args->worker_ips[worker->my_shard] = INVALID_IP; // This worker is no longer responsible for a shard
       if (args->head == worker && args->tail == worker) {
         args->head = NULL;
         args->tail = NULL;
@@ -311,17 +321,79 @@ update_workers(WORKERSIDE_ARGS *args)
   assert(validate_workers(args));
 }
 
+/* pick_worker()
+ * Return the least loaded live worker holding <shard> (any worker, if
+ * <shard> is -1) that has not been given a part of the query yet, or
+ * NULL if there is none.  A worker's load is the number of searches it
+ * has been given, so the replicas of a shard take turns.
+ * Called holding the work mutex.
+ */
+static WORKER_DATA *
+pick_worker(WORKERSIDE_ARGS *args, int shard)
+{
+  WORKER_DATA *worker;
+  WORKER_DATA *best = NULL;
+
+  for (worker = args->head; worker != NULL; worker = worker->next) {
+    if (worker->terminated || worker->cmd != NULL)         continue;
+    if (shard >= 0 && worker->my_shard != (uint32_t) shard) continue;
+    if (best == NULL || worker->nsearches < best->nsearches) best = worker;
+  }
+
+  return best;
+}
+
+/* discard_results()
+ * Free any hits or error message a worker still has from an earlier
+ * round, e.g. one whose part of the search failed, so they can't be
+ * gathered into the next query's results.
+ * Called holding the work mutex.
+ */
+static void
+discard_results(WORKER_DATA *worker)
+{
+  int i;
+
+  if (worker->hits != NULL) {
+    for (i = 0; i < worker->allocated_hits; i++) p7_hit_Destroy(worker->hits[i]);
+    free(worker->hits);
+  }
+  if (worker->err_buf != NULL) free(worker->err_buf);
+  worker->hits           = NULL;
+  worker->allocated_hits = 0;
+  worker->err_buf        = NULL;
+  worker->stats.nhits    = 0;
+}
+
+/* drop_replica()
+ * Stop counting <worker> as a live replica of its shard, once: a worker
+ * that fails to load the database is put on the idle list, and dies
+ * later.
+ * Called holding the work mutex.
+ */
+static void
+drop_replica(WORKERSIDE_ARGS *parent, WORKER_DATA *worker)
+{
+  if (!worker->counted) return;
+  --parent->replicas[worker->my_shard];
+  worker->counted = FALSE;
+}
+
 static void
 process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
 {
   ESL_STOPWATCH  *w          = NULL;      /* timer used for profiling statistics             */
   WORKER_DATA    *worker     = NULL;
+  SHARD_TASK     *task       = NULL;      /* parts of the search, one per shard or slice     */
   SEARCH_RESULTS  results;
-  int n;
+  int n, i;
   int cnt;
   int inx;
-  int ready_workers;    /* counter variable used to track the number of workers currently available to receive work; short for "remaining", I imagine */
-  int tries;
+  int ntasks;
+  int ntodo;
+  int nassigned;
+  int errors;
+  int missing;          /* TRUE if no live worker can search a part of the query */
 
   memset(&results, 0, sizeof(SEARCH_RESULTS)); /* avoid valgrind bitching about uninit bytes; remove, if we ever serialize structs properly */
 
@@ -352,106 +424,106 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
 
   init_results(&results);
 
-  //if range(s) are given, count how many of the seqdb's sequences are within supplied range(s)
- /* if (args->range_list) { // can only happen in HMMD_CMD_SEARCH case
-   int range_cnt = 0; // this will now count how many of the seqs in the db are within the range
-    for (i=0; i<cnt; i++) {
-      if ( hmmpgmd_IsWithinRanges(args->seq_db->list[i].idx, args->range_list ) )
-        range_cnt++;
+  /* A sequence database search needs each shard searched once, by any
+   * of the workers holding it.  Each of them is told to search the
+   * whole range, which covers its whole shard.  The hmm database isn't
+   * sharded, so a scan is split between all of the live workers.
+   */
+  if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+  update_workers(args);
+  ntasks = (query->cmd_type == HMMD_CMD_SEARCH) ? args->num_shards : ESL_MAX(args->ready, 1);
+  if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+
+  if ((task = malloc(ntasks * sizeof(SHARD_TASK))) == NULL) LOG_FATAL_MSG("malloc", errno);
+  inx = 0;
+  for (i = 0; i < ntasks; ++i) {
+    task[i].tries  = 0;
+    task[i].done   = FALSE;
+    task[i].worker = NULL;
+    if (query->cmd_type == HMMD_CMD_SEARCH) {
+      task[i].shard = i;
+      task[i].inx   = 0;
+      task[i].cnt   = cnt;
+    } else {
+      task[i].shard = -1;
+      task[i].inx   = inx;
+      task[i].cnt   = (cnt - inx) / (ntasks - i);
+      inx          += task[i].cnt;
     }
-    cnt = range_cnt;
   }
-  */
-
 
-  inx = 0;
-  tries = 0;
-  do {
-    /* process any changes to the available workers */
+  errors  = 0;
+  missing = FALSE;
+  ntodo   = ntasks;
+  while (ntodo > 0 && errors == 0 && !missing) {
     if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
 
     /* build a list of the currently available workers */
     update_workers(args);
 
-    /* if there aren't enough workers ready, report an error */
-    if (args->ready == args->num_shards) {
-      ready_workers = args->ready;
-
-      /* update the workers search information */
-      worker = args->head;
-
-      while (worker != NULL) {
-        worker->cmd        = query->cmd;
-        worker->completed  = 0;
-        worker->total      = 0;
-
-        /* assign each worker a portion of the database */
-        worker->srch_inx = inx;
-        if (args->range_list) {
-      /*  old code for non-sharded database.  For sharded database, each worker should be told to search the entire range of the 
-          search, because a worker only has 1/nth of the database 
-          // if ranges are given, need to split the db list based on which elements in the list are within the given range(s)
-          int goal = cnt / ready_workers; //how many within-range sequences do I want to ask this worker to handle
-          int curr = 0;                   //how many within-range sequences have I seen since the start of this full-db range
-          worker->srch_cnt = 0;
-          while (curr < goal) {
-            if ( hmmpgmd_IsWithinRanges (args->seq_db->list[inx].idx, args->range_list ) )
-                curr++;
-            worker->srch_cnt++;
-            inx++;
-          }
-          cnt -= curr;
-          */ 
-          worker->srch_cnt = cnt;
-        } else {
-          if(query->cmd_type == HMMD_CMD_SEARCH){
-            // This is a sharded hmmsearch, so each worker should be told to search the entire db range, which
-            // will cause them to search their entire shard
-            worker->srch_cnt = cnt;
-          }
-          else{
-            // This is a hmmscan, so the database is not sharded and each worker should be told to search a fraction of it     
-            worker->srch_cnt = cnt / ready_workers;
-            inx += worker->srch_cnt;
-            cnt -= worker->srch_cnt;
-          }
-        }
+    /* a shard with no live worker holding it can't be searched */
+    for (i = 0; i < ntasks; ++i) {
+      if (!task[i].done && task[i].shard >= 0 && pick_worker(args, task[i].shard) == NULL) missing = TRUE;
+    }
 
-        --ready_workers;
-        worker            = worker->next;
-      }
+    /* give each part still to do to the least loaded worker that can take it */
+    nassigned = 0;
+    for (i = 0; i < ntasks && !missing; ++i) {
+      if (task[i].done) continue;
+      if ((worker = pick_worker(args, task[i].shard)) == NULL) continue;
+
+      discard_results(worker);
+      worker->cmd        = query->cmd;
+      worker->completed  = 0;
+      worker->total      = 0;
+      worker->srch_inx   = task[i].inx;
+      worker->srch_cnt   = task[i].cnt;
+      ++worker->nsearches;
+
+      task[i].worker = worker;
+      ++task[i].tries;
+      ++nassigned;
+    }
+    if (nassigned == 0) missing = TRUE;
 
+    if (!missing) {
       args->completed = 0;
 
       /* notify all the worker threads of the new query */
       if ((n = pthread_cond_broadcast(&args->start_cond)) != 0) LOG_FATAL_MSG("cond broadcast", n);
-    }
-
-    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
 
-    if (args->ready > 0) {
-      /* Wait for all the workers to complete */
-      if ((n = pthread_mutex_lock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-      while (args->completed < args->ready) {
+      /* Wait for the workers to complete, or die */
+      while (args->completed < nassigned) {
         if ((n = pthread_cond_wait (&args->complete_cond, &args->work_mutex)) != 0) LOG_FATAL_MSG("cond wait", n);
       }
 
-      if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
-    }
-
-    /* gather up the results from all the workers */
-    gather_results(query, args, &results);
+      /* gather up the results.  The part of a worker that died goes to
+       * another worker holding the same shard in the next round.
+       */
+      for (i = 0; i < ntasks; ++i) {
+        if ((worker = task[i].worker) == NULL) continue;
+        task[i].worker = NULL;
 
-    /* we can recover from one worker crashing.  get the block that worker ran on
-     * and redistribute its load to all the remaining workers.
-     */
-    inx = results.db_inx;
-    cnt = results.db_cnt;
-    ++tries;
-
-  } while (args->ready > 0 && results.errors == 1 && tries < 2);
+        if (worker->completed) {
+          if (worker->status.status == eslOK) {
+            gather_results(&results, worker);
+          } else {
+            p7_syslog(LOG_ERR,"[%s:%d] - search failed on %s: %s\n", __FILE__, __LINE__, worker->ip_addr, worker->err_buf);
+            ++errors;
+          }
+          worker->completed = 0;
+          task[i].done = TRUE;
+          --ntodo;
+        } else if (task[i].tries >= MAX_TRIES) {
+          ++errors;
+        } else {
+          p7_syslog(LOG_ERR,"[%s:%d] - worker %s died, retrying its part of the search\n", __FILE__, __LINE__, worker->ip_addr);
+        }
+      }
+    }
 
+    if ((n = pthread_mutex_unlock (&args->work_mutex)) != 0)  LOG_FATAL_MSG("mutex unlock", n);
+  }
 
   esl_stopwatch_Stop(w);
 
@@ -460,16 +532,29 @@ process_search(WORKERSIDE_ARGS *args, QUEUE_DATA_SHARD *query)
   results.stats.user    = w->user;
   results.stats.sys     = w->sys;
   results.stats.hit_offsets = NULL; // set this to make sure we allocate memory later
-  /* TODO: check for errors */
-  if (args->ready != args->num_shards) {
-    client_msg(query->sock, eslFAIL, "Not enough compute nodes available for the number of shards specified.  %d nodes available, %d required\n", args->ready, args->num_shards);
-  } else if (args->failed > 0) {
+
+  if (query->cmd_type == HMMD_CMD_SEARCH) {
+    results.stats.nmodels = 1;
+    results.stats.nseqs   = args->seq_db->db[query->dbx].K;
+  } else {
+    results.stats.nseqs   = 1;
+    results.stats.nmodels = args->hmm_db->n;
+  }
+  if (results.stats.Z_setby == p7_ZSETBY_NTARGETS) {
+    results.stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results.stats.nseqs : results.stats.nmodels;
+  }
+
+  if (missing) {
+    client_msg(query->sock, eslFAIL, "Not enough compute nodes available: no live node holds part of the database\n");
+    clear_results(args, &results);
+  } else if (errors > 0) {
     client_msg(query->sock, eslFAIL, "Errors running search\n");
     clear_results(args, &results);
   } else {
     forward_results(query, &results);  
   }
 
+  free(task);
   esl_stopwatch_Destroy(w);
 }
 
@@ -612,9 +697,9 @@ master_process_shard(ESL_GETOPTS *go)
   worker_comm.hmm_db     = hmm_db;
   worker_comm.db_version = 1;
   worker_comm.num_shards = esl_opt_GetInteger(go, "--num_shards");
-  ESL_ALLOC(worker_comm.worker_ips, worker_comm.num_shards * sizeof(uint32_t));
+  ESL_ALLOC(worker_comm.replicas, worker_comm.num_shards * sizeof(int));
   for(i = 0; i < worker_comm.num_shards; i++){
-    worker_comm.worker_ips[i] = INVALID_IP;
+    worker_comm.replicas[i] = 0;
   }
 
   worker_comm.ready      = 0;
@@ -676,7 +761,7 @@ master_process_shard(ESL_GETOPTS *go)
     if (worker_comm.range_list->ends)    free(worker_comm.range_list->ends);
     free (worker_comm.range_list);
   }
-  free(worker_comm.worker_ips);
+  free(worker_comm.replicas);
   return;
 
 
@@ -706,6 +791,7 @@ init_results(SEARCH_RESULTS *results)
 {
   results->status.status     = eslOK;
   results->status.msg_size   = 0;
+  results->status.retry_after = 0;
 
   results->stats.nhits       = 0;
   results->stats.nreported   = 0;
@@ -721,93 +807,54 @@ init_results(SEARCH_RESULTS *results)
 
   results->hits              = NULL;
   results->nhits             = 0;
-  results->db_inx            = 0;
-  results->db_cnt            = 0;
-  results->errors            = 0;
 }
 
 
+/* gather_results()
+ * Merge the results of one worker into the query's results.
+ * Called holding the work mutex.
+ */
 static void
-gather_results(QUEUE_DATA_SHARD *query, WORKERSIDE_ARGS *comm, SEARCH_RESULTS *results)
+gather_results(SEARCH_RESULTS *results, WORKER_DATA *worker)
 {
-  int cnt;
-  int n;
-  int i0, i1;
-  WORKER_DATA *worker;
-
-  /* allocate spaces to hold all the hits */
-  cnt = results->nhits + MAX_WORKERS;
-  if ((results->hits = realloc(results->hits, sizeof(P7_HIT *) * cnt)) == NULL) LOG_FATAL_MSG("malloc", errno);
-
-  /* lock the workers until we have merged the results */
-  if ((n = pthread_mutex_lock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
-
-  /* count the number of hits */
-  cnt = results->nhits;
-  worker = comm->head;
-  while (worker != NULL) {
-    if (worker->completed) {
-      uint32_t previous_hits = results->stats.nhits;
-
-      results->stats.nhits        += worker->stats.nhits;
-      results->stats.nreported    += worker->stats.nreported;
-      results->stats.nincluded    += worker->stats.nincluded;
-
-      results->stats.n_past_msv   += worker->stats.n_past_msv;
-      results->stats.n_past_bias  += worker->stats.n_past_bias;
-      results->stats.n_past_vit   += worker->stats.n_past_vit;
-      results->stats.n_past_fwd   += worker->stats.n_past_fwd;
-
-      results->stats.Z_setby       = worker->stats.Z_setby;
-      results->stats.domZ_setby    = worker->stats.domZ_setby;
-      results->stats.domZ          = worker->stats.domZ;
-      results->stats.Z             = worker->stats.Z;
-
-      results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
-      if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
-        // Add enough space to the list of hits for all the hits from this worker
-       results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
-        if(results->hits == NULL){
-         LOG_FATAL_MSG("malloc", n);
-       }
-
-       // copy this worker's hits into the global list
-        for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
-          results->hits[i1] = worker->hits[i0];
-       }
-
-        free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
-       // will be freed by forward_results()
-
-       worker->hits = NULL;  
-      }
-      worker->completed   = 0;
-      ++cnt;
-    } else {
-      results->errors++;
-      results->db_inx            = worker->srch_inx;
-      results->db_cnt            = worker->srch_cnt;
+  uint32_t previous_hits = results->stats.nhits;
+  int      i0, i1;
+
+  results->stats.nhits        += worker->stats.nhits;
+  results->stats.nreported    += worker->stats.nreported;
+  results->stats.nincluded    += worker->stats.nincluded;
+
+  results->stats.n_past_msv   += worker->stats.n_past_msv;
+  results->stats.n_past_bias  += worker->stats.n_past_bias;
+  results->stats.n_past_vit   += worker->stats.n_past_vit;
+  results->stats.n_past_fwd   += worker->stats.n_past_fwd;
+
+  results->stats.Z_setby       = worker->stats.Z_setby;
+  results->stats.domZ_setby    = worker->stats.domZ_setby;
+  results->stats.domZ          = worker->stats.domZ;
+  results->stats.Z             = worker->stats.Z;
+
+  results->status.msg_size    += worker->status.msg_size - sizeof(HMMD_SEARCH_STATS);
+  if((results->stats.nhits- previous_hits) >0){ // There are new hits to deal with
+    // Add enough space to the list of hits for all the hits from this worker
+    results->hits = realloc(results->hits, results->stats.nhits * sizeof (P7_HIT *));
+    if(results->hits == NULL){
+      LOG_FATAL_MSG("malloc", errno);
     }
 
-    worker = worker->next;
-  }
+    // copy this worker's hits into the global list
+    for(i0 = 0, i1 = previous_hits; i1 < results->stats.nhits; i0++, i1++){
+      results->hits[i1] = worker->hits[i0];
+    }
 
-  if ((n = pthread_mutex_unlock (&comm->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+    free(worker->hits); //  Free the worker's array of pointers to hits.  The hits themselves
+    // will be freed by forward_results()
 
-  if (query->cmd_type == HMMD_CMD_SEARCH) {
-    results->stats.nmodels = 1;
-    results->stats.nseqs   = comm->seq_db->db[query->dbx].K;
-  } else {
-    results->stats.nseqs   = 1;
-    results->stats.nmodels = comm->hmm_db->n;
-  }
-    
-  if (results->stats.Z_setby == p7_ZSETBY_NTARGETS) {
-    results->stats.Z = (query->cmd_type == HMMD_CMD_SEARCH) ? results->stats.nseqs : results->stats.nmodels;
+    worker->hits = NULL;  
+    worker->allocated_hits = 0;
   }
 
-  results->nhits = cnt;
-
+  results->nhits = results->stats.nhits;
 }
 
 static void
@@ -1825,6 +1872,7 @@ workerside_thread(void *arg)
         worker->next   = parent->idling;
         parent->idling = worker;
         ++parent->idle_cnt;
+        drop_replica(parent, worker);
       }
       updated = 1;
     }
@@ -1843,9 +1891,14 @@ workerside_thread(void *arg)
 
   fd = worker->sock_fd;
 
+  /* only a worker that was given a part of the master's current
+   * command counts as completing it; the master is waiting for those
+   */
   ++parent->failed;
-  ++parent->completed;
+  if (worker->cmd != NULL) ++parent->completed;
+  drop_replica(parent, worker);
 
+  worker->cmd        = NULL;
   worker->terminated = 1;
   worker->total      = 0;
   worker->sock_fd    = -1;
@@ -1892,30 +1945,25 @@ worker_comm_thread(void *arg)
     addrlen = sizeof(worker->ip_addr);
     strncpy(worker->ip_addr, inet_ntoa(addr.sin_addr), addrlen);
     worker->ip_addr[addrlen-1] = 0;
-    new_worker_shard = -1;
-    update_workers(data);  // Check the status of the existing workers to remove any that have died
-    // Figure out which shard to assign to the new worker
-    for(i = 0; i < data->num_shards; i++){
-      if (data->worker_ips[i] == addr.sin_addr.s_addr){ // This IP has connected to this server in the past,
-                                                                  // so re-use its old shard
-        printf("Found a shard assigned to the same worker as one that just tried to join.  This shouldn't happen\n");
-      }
-      if(data->worker_ips[i] == INVALID_IP){
-        // There is no worker node assigned to this shard, so assign it to the new worker
-        new_worker_shard = i;
-        break;
-      }
-    }
 
-    if(new_worker_shard == -1){  // We're unable to find a shard for this worker because all of the shards are taken
-      LOG_FATAL_MSG("Attempt to add a new worker node when there were already as many workers as shards", 1);
-    }
-    else{
-      worker->num_shards = data->num_shards;
-      worker->my_shard = new_worker_shard;
-      data->worker_ips[new_worker_shard] = addr.sin_addr.s_addr;  // record the IP of the new warker
-      if ((n = pthread_create(&thread_id, NULL, workerside_thread, worker)) != 0) LOG_FATAL_MSG("thread create", n);
+    /* give the new worker the shard with the fewest live workers holding
+     * it; once every shard has one, further workers become replicas
+     */
+    if ((n = pthread_mutex_lock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex lock", n);
+    new_worker_shard = 0;
+    for(i = 1; i < data->num_shards; i++){
+      if (data->replicas[i] < data->replicas[new_worker_shard]) new_worker_shard = i;
     }
+    ++data->replicas[new_worker_shard];
+    worker->counted = TRUE;
+    if ((n = pthread_mutex_unlock (&data->work_mutex)) != 0) LOG_FATAL_MSG("mutex unlock", n);
+
+    printf("Worker %s assigned shard %d of %d\n", worker->ip_addr, new_worker_shard, (int) data->num_shards);
+    fflush(stdout);
+
+    worker->num_shards = data->num_shards;
+    worker->my_shard = new_worker_shard;
+    if ((n = pthread_create(&thread_id, NULL, workerside_thread, worker)) != 0) LOG_FATAL_MSG("thread create", n);
   }
   
   pthread_exit(NULL);
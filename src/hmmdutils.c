@@ -52,6 +52,8 @@ static ESL_OPTIONS searchOpts[] = {
   /* Control of output */
   { "--acc",        eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, NULL,        "prefer accessions over names in output",                       2 },
   { "--noali",      eslARG_NONE,        FALSE, NULL, NULL,      NULL,  NULL, NULL,        "don't output alignments, so output is smaller",                2 },
+  { "--maxhits",    eslARG_INT,          NULL, NULL, "n>0",     NULL,  NULL, NULL,        "return only the <n> top-ranked hits",                          2 },
+  { "--maxaln",     eslARG_INT,          NULL, NULL, "n>=0",    NULL,  NULL, NULL,        "return alignments for only the <n> top-ranked hits",           2 },
   /* Control of scoring system */
   { "--popen",      eslARG_REAL,       "0.02", NULL, "0<=x<0.5",NULL,  NULL, NULL,        "gap open probability",                                         3 },
   { "--pextend",    eslARG_REAL,        "0.4", NULL, "0<=x<1",  NULL,  NULL, NULL,        "gap extend probability",                                       3 },
@@ -88,11 +90,13 @@ static ESL_OPTIONS searchOpts[] = {
   /* Other options */
   { "--seed",       eslARG_INT,        "42", NULL, "n>=0",    NULL,  NULL, NULL,        "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
   { "--nonull2",    eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, NULL,        "turn off biased composition score corrections",               12 },
+  { "--bands",      eslARG_NONE,       NULL, NULL, NULL,      NULL,  NULL, "--max",     "decode domains inside their posterior bands",                 12 },
   { "-Z",           eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,      FALSE, NULL, "x>0",     NULL,  NULL, NULL,        "set # of significant seqs, for domain E-value calculation",   12 },
   { "--hmmdb",      eslARG_INT,       NULL,  NULL, "n>0",   NULL,  NULL,  "--seqdb",       "hmm database to search",                                      12 },
   { "--seqdb",      eslARG_INT,         NULL,  NULL, "n>0",   NULL,  NULL,  "--hmmdb",       "protein database to search",                                  12 },
   { "--seqdb_ranges",eslARG_STRING,     NULL,  NULL,  NULL,   NULL, "--seqdb", NULL,         "range(s) of sequences within --seqdb that will be searched",  12 },
+  { "--batch",      eslARG_NONE,      FALSE, NULL, NULL,      NULL,  NULL, NULL,        "queue as a batch query, behind interactive ones",             12 },
   
 
   /* name           type        default  env  range toggles reqs incomp  help                                          docgroup*/
@@ -289,6 +293,65 @@ ERROR:
   return eslEMEM;
 }
 
+/* Function:  hmmpgmd_GetHitLimits()
+ * Synopsis:  Get the client's limits on the hits returned
+ *
+ * Purpose:   Sets <*ret_maxhits> to the number of top-ranked hits the
+ *            client asked for with --maxhits, and <*ret_maxaln> to the
+ *            number of them that keep their alignments (--maxaln).
+ *            Either is -1 if the client set no limit.
+ *
+ * Returns:   <TRUE> if either limit is set, <FALSE> if not.
+ */
+int
+hmmpgmd_GetHitLimits(ESL_GETOPTS *opts, int *ret_maxhits, int *ret_maxaln)
+{
+  *ret_maxhits = esl_opt_IsOn(opts, "--maxhits") ? esl_opt_GetInteger(opts, "--maxhits") : -1;
+  *ret_maxaln  = esl_opt_IsOn(opts, "--maxaln")  ? esl_opt_GetInteger(opts, "--maxaln")  : -1;
+
+  return (*ret_maxhits >= 0 || *ret_maxaln >= 0);
+}
+
+/* Function:  hmmpgmd_DropAlignments()
+ * Synopsis:  Strip the alignment displays from a hit
+ *
+ * Purpose:   Empty the alignment display of each domain of <hit>,
+ *            keeping its names and coordinates, so the hit costs
+ *            little to serialize.  The domains still serialize and
+ *            deserialize as usual, with alignments of length 0.
+ *
+ * Returns:   void
+ */
+void
+hmmpgmd_DropAlignments(P7_HIT *hit)
+{
+  P7_ALIDISPLAY *ad;
+  int            d;
+
+  for (d = 0; d < hit->ndom; d++) {
+    if (hit->dcl[d].scores_per_pos != NULL) free(hit->dcl[d].scores_per_pos);
+    hit->dcl[d].scores_per_pos = NULL;
+
+    if ((ad = hit->dcl[d].ad) == NULL) continue;
+
+    /* in serialized form the strings all live in ad->mem */
+    if (ad->mem == NULL) {
+      if (ad->rfline) free(ad->rfline);
+      if (ad->mmline) free(ad->mmline);
+      if (ad->csline) free(ad->csline);
+      if (ad->ntseq)  free(ad->ntseq);
+      if (ad->ppline) free(ad->ppline);
+    }
+    ad->rfline = ad->mmline = ad->csline = NULL;
+    ad->ntseq  = ad->ppline = NULL;
+
+    ad->model[0] = '\0';
+    ad->mline[0] = '\0';
+    if (ad->aseq) ad->aseq[0] = '\0';
+    ad->N        = 0;
+  }
+}
+
 /* Function:  hmmpgmd_WriteReady()
  * Synopsis:  Write ready status to file
  *
@@ -43,6 +43,10 @@
 #define CONF_FILE "/etc/hmmpgmd.conf"
 
 typedef struct {
+  int               nq;          /* number of queries searched together; a
+                                  * thread's infos are this one and the
+                                  * nq-1 after it, one per query      */
+
   HMMER_SEQ       **sq_list;     /* list of sequences to process     */
   int               sq_cnt;      /* number of sequences              */
   int               db_Z;        /* true number of sequences         */
@@ -71,28 +75,61 @@ typedef struct {
   P7_TOPHITS       *th;          /* top hit results                  */
 } WORKER_INFO;
 
+/* One version of the cached databases. While the master reloads its
+ * databases, the worker keeps the old version searchable next to the
+ * new one, and each search says which one it is for.
+ */
+typedef struct {
+  uint32_t     version;          /* master's version, 0 if unused    */
+  P7_SEQCACHE *seq_db;
+  P7_HMMCACHE *hmm_db;
+} WORKER_DB;
+
 typedef struct {
   int fd;                        /* socket connection to server      */
   int ncpus;                     /* number of cpus to use            */
 
-  P7_SEQCACHE *seq_db;           /* cached sequence database         */
-  P7_HMMCACHE *hmm_db;           /* cached hmm database              */
+  P7_SEQCACHE *seq_db;           /* databases of the current search  */
+  P7_HMMCACHE *hmm_db;           /*   (one of <db>)                  */
+
+  WORKER_DB    db[2];            /* versions the master may search   */
+
+  pthread_mutex_t load_mutex;    /* protects the reload below        */
+  pthread_t    load_id;
+  HMMD_COMMAND *load_cmd;        /* reload being done, or NULL       */
+  int          load_status;      /* eslEINCOMPLETE while loading     */
+  WORKER_DB    loaded;           /* what the reload loaded           */
 } WORKER_ENV;
 
 static void process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
-static void process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query);
+static void process_ReloadCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static void process_RetireCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
+static void select_db(WORKER_ENV *env, HMMD_COMMAND *cmd);
+static void process_SearchCmd(WORKER_ENV *env, QUEUE_DATA **queries, int nq);
+static void process_BatchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
 static void process_Shutdown(HMMD_COMMAND *cmd, WORKER_ENV *env);
 
 static QUEUE_DATA *process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env);
 
 static int  setup_masterside_comm(ESL_GETOPTS *opts);
 
-static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli);
+static int  limit_hits(WORKER_ENV *env, QUEUE_DATA *query, P7_TOPHITS *th, P7_PIPELINE *pli);
+static void send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli, int nsend);
 
 #define BLOCK_SIZE 1000
 static void search_thread(void *arg);
 static void scan_thread(void *arg);
 
+static void
+close_db(WORKER_DB *db)
+{
+  if (db->hmm_db != NULL) p7_hmmcache_Close(db->hmm_db);
+  if (db->seq_db != NULL) p7_seqcache_Close(db->seq_db);
+  db->version = 0;
+  db->seq_db  = NULL;
+  db->hmm_db  = NULL;
+}
+
 static void
 print_timings(int i, double elapsed, P7_PIPELINE *pli)
 {
@@ -155,9 +192,12 @@ worker_process(ESL_GETOPTS *go)
 
   env.ncpus = ESL_MIN(esl_opt_GetInteger(go, "--cpu"),  esl_threads_GetCPUCount());
 
-  env.hmm_db = NULL;
-  env.seq_db = NULL;
-  env.fd     = setup_masterside_comm(go);
+  env.hmm_db   = NULL;
+  env.seq_db   = NULL;
+  memset(env.db, 0, sizeof(env.db));
+  env.load_cmd = NULL;
+  if (pthread_mutex_init(&env.load_mutex, NULL) != 0) p7_Fail("mutex init failed");
+  env.fd       = setup_masterside_comm(go);
 
   while (!shutdown) 
     {
@@ -165,18 +205,24 @@ worker_process(ESL_GETOPTS *go)
 
       switch (cmd->hdr.command) {
       case HMMD_CMD_INIT:      process_InitCmd  (cmd, &env);                break;
+      case HMMD_CMD_RELOAD:    process_ReloadCmd(cmd, &env);                break;
+      case HMMD_CMD_RETIRE:    process_RetireCmd(cmd, &env);                break;
       case HMMD_CMD_SCAN: 
 	  {	  
+		   select_db(&env, cmd);
  		   query = process_QueryCmd(cmd, &env);
- 		   process_SearchCmd(cmd, &env, query);
+ 		   process_SearchCmd(&env, &query, 1);
  		   free_QueueData(query);
 	  }
 		 break;
       case HMMD_CMD_SEARCH:
+		   select_db(&env, cmd);
 		   query = process_QueryCmd(cmd, &env);
-	     process_SearchCmd(cmd, &env, query);
+	     process_SearchCmd(&env, &query, 1);
        free_QueueData(query);
          break;
+      case HMMD_CMD_BATCH:     select_db(&env, (HMMD_COMMAND *) ((char *) cmd + sizeof(HMMD_HEADER)));
+                               process_BatchCmd (cmd, &env);                break;
       case HMMD_CMD_SHUTDOWN:  process_Shutdown (cmd, &env);  shutdown = 1; break;
       default: p7_syslog(LOG_ERR,"[%s:%d] - unknown command %d (%d)\n", __FILE__, __LINE__, cmd->hdr.command, cmd->hdr.length);
       }
@@ -185,18 +231,26 @@ worker_process(ESL_GETOPTS *go)
       cmd = NULL;
     }
 
-  if (env.hmm_db) p7_hmmcache_Close(env.hmm_db);
-  if (env.seq_db) p7_seqcache_Close(env.seq_db);
+  if (env.load_cmd != NULL) {
+    pthread_join(env.load_id, NULL);
+    close_db(&env.loaded);
+    free(env.load_cmd);
+  }
+  close_db(&env.db[0]);
+  close_db(&env.db[1]);
+  pthread_mutex_destroy(&env.load_mutex);
   if (env.fd != -1) close(env.fd);
   return;
 }
 
 
 static void 
-process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
+process_SearchCmd(WORKER_ENV *env, QUEUE_DATA **queries, int nq)
 { 
-  int              i;
+  QUEUE_DATA      *query      = queries[0];
+  int              i, q;
   int              cnt;
+  int              nsend;
   int              limit;
   int              status;
   int              blk_size;
@@ -213,7 +267,9 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   abc = esl_alphabet_Create(eslAMINO);
 
   if (pthread_mutex_init(&inx_mutex, NULL) != 0) p7_Fail("mutex init failed");
-  ESL_ALLOC(info, sizeof(*info) * env->ncpus);
+
+  /* each thread gets <nq> consecutive WORKER_INFOs, one per query */
+  ESL_ALLOC(info, sizeof(*info) * env->ncpus * nq);
 
   /* Log the current time (at search start) */
   date = time(NULL);
@@ -223,38 +279,44 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   /* initialize thread data */
   esl_stopwatch_Start(w);
 
-  info->range_list = NULL;
-  if (esl_opt_IsUsed(query->opts, "--seqdb_ranges")) {
-    ESL_ALLOC(info->range_list, sizeof(RANGE_LIST));
-    hmmpgmd_GetRanges(info->range_list, esl_opt_GetString(query->opts, "--seqdb_ranges"));
+  for (q = 0; q < nq; ++q) {
+    info[q].range_list = NULL;
+    if (esl_opt_IsUsed(queries[q]->opts, "--seqdb_ranges")) {
+      ESL_ALLOC(info[q].range_list, sizeof(RANGE_LIST));
+      hmmpgmd_GetRanges(info[q].range_list, esl_opt_GetString(queries[q]->opts, "--seqdb_ranges"));
+    }
   }
 
-
   if (query->cmd_type == HMMD_CMD_SEARCH) threadObj = esl_threads_Create(&search_thread);
   else                                    threadObj = esl_threads_Create(&scan_thread);
 
-  if (query->query_type == HMMD_SEQUENCE) {
-    fprintf(stdout, "Search seq %s  [L=%ld]", query->seq->name, (long) query->seq->n);
-  } else {
-    fprintf(stdout, "Search hmm %s  [M=%d]", query->hmm->name, query->hmm->M);
-  }
-  fprintf(stdout, " vs %s DB %d [%d - %d]",
-          (query->cmd_type == HMMD_CMD_SEARCH) ? "SEQ" : "HMM", 
-          query->dbx, query->inx, query->inx + query->cnt - 1);
+  for (q = 0; q < nq; ++q) {
+    if (queries[q]->query_type == HMMD_SEQUENCE) {
+      fprintf(stdout, "Search seq %s  [L=%ld]", queries[q]->seq->name, (long) queries[q]->seq->n);
+    } else {
+      fprintf(stdout, "Search hmm %s  [M=%d]", queries[q]->hmm->name, queries[q]->hmm->M);
+    }
+    fprintf(stdout, " vs %s DB %d [%d - %d]",
+            (query->cmd_type == HMMD_CMD_SEARCH) ? "SEQ" : "HMM", 
+            query->dbx, query->inx, query->inx + query->cnt - 1);
 
-  if (info->range_list)
-    fprintf(stdout, " in range(s) %s", esl_opt_GetString(query->opts, "--seqdb_ranges"));
+    if (info[q].range_list)
+      fprintf(stdout, " in range(s) %s", esl_opt_GetString(queries[q]->opts, "--seqdb_ranges"));
 
-  fprintf(stdout, "\n");
+    fprintf(stdout, "\n");
+  }
 
   /* Create processing pipeline and hit list */
-  for (i = 0; i < env->ncpus; ++i) {
-    info[i].abc   = query->abc;
-    info[i].hmm   = query->hmm;
-    info[i].seq   = query->seq;
-    info[i].opts  = query->opts;
+  for (i = 0; i < env->ncpus * nq; ++i) {
+    q = i % nq;
+
+    info[i].nq    = nq;
+    info[i].abc   = queries[q]->abc;
+    info[i].hmm   = queries[q]->hmm;
+    info[i].seq   = queries[q]->seq;
+    info[i].opts  = queries[q]->opts;
 
-    info[i].range_list  = info[0].range_list;
+    info[i].range_list  = info[q].range_list;
 
     info[i].th    = NULL;
     info[i].pli   = NULL;
@@ -279,7 +341,7 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
       info[i].om_cnt    = query->cnt;
     }
 
-    esl_threads_AddThread(threadObj, &info[i]);
+    if (q == 0) esl_threads_AddThread(threadObj, &info[i]);
   }
 
   /* try block size of 5000.  we will need enough sequences for four
@@ -306,35 +368,39 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   esl_stopwatch_Stop(w);
 #if 1
   fprintf (stdout, "   Sequences  Residues                              Elapsed\n");
-  for (i = 0; i < env->ncpus; ++i) {
-    print_timings(i, info[i].elapsed, info[i].pli);
+  for (i = 0; i < env->ncpus * nq; ++i) {
+    print_timings(i / nq, info[i].elapsed, info[i].pli);
   }
 #endif
   /* merge the results of the search results */
-  for (i = 1; i < env->ncpus; ++i) {
-    p7_tophits_Merge(info[0].th, info[i].th);
-    p7_pipeline_Merge(info[0].pli, info[i].pli);
+  for (i = nq; i < env->ncpus * nq; ++i) {
+    q = i % nq;
+    p7_tophits_Merge(info[q].th, info[i].th);
+    p7_pipeline_Merge(info[q].pli, info[i].pli);
     p7_pipeline_Destroy(info[i].pli);
     p7_tophits_Destroy(info[i].th);
   }
 
-  print_timings(99, w->elapsed, info[0].pli);
-  send_results(env->fd, w, info[0].th, info[0].pli);
+  for (q = 0; q < nq; ++q) {
+    print_timings(99, w->elapsed, info[q].pli);
+    nsend = limit_hits(env, queries[q], info[q].th, info[q].pli);
+    send_results(env->fd, w, info[q].th, info[q].pli, nsend);
+
+    /* free the last of the pipeline data */
+    p7_pipeline_Destroy(info[q].pli);
+    p7_tophits_Destroy(info[q].th);
 
-  /* free the last of the pipeline data */
-  p7_pipeline_Destroy(info->pli);
-  p7_tophits_Destroy(info->th);
+    if (info[q].range_list) {
+      if (info[q].range_list->starts)  free(info[q].range_list->starts);
+      if (info[q].range_list->ends)    free(info[q].range_list->ends);
+      free (info[q].range_list);
+    }
+  }
 
   esl_threads_Destroy(threadObj);
 
   pthread_mutex_destroy(&inx_mutex);
 
-  if (info->range_list) {
-    if (info->range_list->starts)  free(info->range_list->starts);
-    if (info->range_list->ends)    free(info->range_list->ends);
-    free (info->range_list);
-  }
-
   free(info);
 
   esl_stopwatch_Destroy(w);
@@ -346,6 +412,31 @@ process_SearchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env, QUEUE_DATA *query)
   LOG_FATAL_MSG("malloc", errno);
 }
 
+/* process_BatchCmd()
+ * Unpack the searches of a HMMD_CMD_BATCH message and run them
+ * together in one pass over their database range.
+ */
+static void
+process_BatchCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  QUEUE_DATA   *queries[HMMD_MAX_BATCH];
+  HMMD_COMMAND *sub;
+  char         *p   = (char *) cmd + sizeof(HMMD_HEADER);
+  char         *end = (char *) cmd + MSG_SIZE(cmd);
+  int           nq  = 0;
+  int           q;
+
+  while (p < end && nq < HMMD_MAX_BATCH) {
+    sub = (HMMD_COMMAND *) p;
+    queries[nq++] = process_QueryCmd(sub, env);
+    p += HMMD_BATCH_ALIGN(MSG_SIZE(sub));
+  }
+
+  process_SearchCmd(env, queries, nq);
+
+  for (q = 0; q < nq; ++q) free_QueueData(queries[q]);
+}
+
 static QUEUE_DATA *
 process_QueryCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
 {
@@ -455,18 +546,20 @@ process_Shutdown(HMMD_COMMAND *cmd, WORKER_ENV  *env)
   }
 }
 
-static void
-process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
+/* load_db()
+ * Load and verify the databases named by the HMMD_CMD_INIT or
+ * HMMD_CMD_RELOAD <cmd> into <db>. Returns eslOK, or an error code
+ * (logged) with <db> empty.
+ */
+static int
+load_db(HMMD_COMMAND *cmd, WORKER_DB *db)
 {
   char *p;
-  int   n;
   int   status;
 
-  if (env->hmm_db != NULL) p7_hmmcache_Close(env->hmm_db);
-  if (env->seq_db != NULL) p7_seqcache_Close(env->seq_db);
-
-  env->hmm_db = NULL;
-  env->seq_db = NULL;
+  db->version = cmd->init.db_version;
+  db->seq_db  = NULL;
+  db->hmm_db  = NULL;
 
   /* load the sequence database */
   if (cmd->init.db_cnt != 0) {
@@ -476,17 +569,17 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
     status = p7_seqcache_Open(p, &sdb, NULL);
     if (status != eslOK) {
       p7_syslog(LOG_ERR,"[%s:%d] - p7_seqcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache seqdb error", status);
+      goto ERROR;
     }
+    db->seq_db = sdb;
 
     /* validate the sequence database */
     cmd->init.sid[MAX_INIT_DESC-1] = 0;
     if (strcmp (cmd->init.sid, sdb->id) != 0 || cmd->init.db_cnt != sdb->db_cnt || cmd->init.seq_cnt != sdb->count) {
       p7_syslog(LOG_ERR,"[%s:%d] - seq db %s: integrity error %s - %s\n", __FILE__, __LINE__, p, cmd->init.sid, sdb->id);
-      LOG_FATAL_MSG("database integrity error", 0);
+      status = eslEINCONCEIVABLE;
+      goto ERROR;
     }
-
-    env->seq_db = sdb;
   }
 
   /* load the hmm database */
@@ -498,12 +591,13 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
     status = p7_hmmcache_Open(p, &hcache, NULL);
     if (status != eslOK) {
       p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_Open %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
+      goto ERROR;
     }
+    db->hmm_db = hcache;
 
     if ( (status = p7_hmmcache_SetNumericNames(hcache)) != eslOK){
       p7_syslog(LOG_ERR,"[%s:%d] - p7_hmmcache_SetNumericNames %s error %d\n", __FILE__, __LINE__, p, status);
-      LOG_FATAL_MSG("cache hmmdb error", status);
+      goto ERROR;
     }
 
     /* validate the hmm database */
@@ -511,16 +605,34 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
     /* TODO: come up with a new pressed format with an id to compare - strcmp (cmd->init.hid, hdb->id) != 0 */
     if (cmd->init.hmm_cnt != 1 || cmd->init.model_cnt != hcache->n) {
       p7_syslog(LOG_ERR,"[%s:%d] - hmm db %s: integrity error\n", __FILE__, __LINE__, p);
-      LOG_FATAL_MSG("database integrity error", 0);
+      status = eslEINCONCEIVABLE;
+      goto ERROR;
     }
 
-    env->hmm_db = hcache;
-
     printf("Loaded profile db %s;  models: %d  memory: %" PRId64 "\n",
          p, hcache->n, (uint64_t) p7_hmmcache_Sizeof(hcache));
-
   }
 
+  return eslOK;
+
+ ERROR:
+  close_db(db);
+  return status;
+}
+
+static void
+process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
+{
+  int   n;
+  int   status;
+
+  close_db(&env->db[0]);
+  close_db(&env->db[1]);
+
+  if ((status = load_db(cmd, &env->db[0])) != eslOK) LOG_FATAL_MSG("database load error", status);
+  env->seq_db = env->db[0].seq_db;
+  env->hmm_db = env->db[0].hmm_db;
+
   /* if stdout is redirected at the commandline, it causes printf's to be buffered,
    * which means status logging isn't printed. This line strongly requests unbuffering,
    * which should be ok, given the low stdout load of hmmpgmd
@@ -539,10 +651,134 @@ process_InitCmd(HMMD_COMMAND *cmd, WORKER_ENV  *env)
 }
 
 
+/* load_thread()
+ * Load the databases of a HMMD_CMD_RELOAD while the worker goes on
+ * searching the ones it has.
+ */
+static void *
+load_thread(void *arg)
+{
+  WORKER_ENV *env = (WORKER_ENV *) arg;
+  WORKER_DB   db;
+  int         status;
+
+  status = load_db(env->load_cmd, &db);
+
+  if (pthread_mutex_lock(&env->load_mutex) != 0) p7_Fail("mutex lock failed");
+  env->loaded      = db;
+  env->load_status = status;
+  if (pthread_mutex_unlock(&env->load_mutex) != 0) p7_Fail("mutex unlock failed");
+
+  pthread_exit(NULL);
+}
+
+/* process_ReloadCmd()
+ * The first HMMD_CMD_RELOAD of a version starts loading it in the
+ * background; the ones after it ask how it is going. Once it is loaded
+ * it joins the versions the master may search, and the answer is eslOK.
+ */
+static void
+process_ReloadCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  HMMD_HEADER hdr;
+  int         status;
+  int         i;
+
+  if (env->load_cmd != NULL && env->load_cmd->init.db_version != cmd->init.db_version) {
+    /* the master gave up on that version; finish with it first */
+    pthread_join(env->load_id, NULL);
+    close_db(&env->loaded);
+    free(env->load_cmd);
+    env->load_cmd = NULL;
+  }
+
+  if (env->load_cmd == NULL) {
+    if (env->db[0].version == cmd->init.db_version || env->db[1].version == cmd->init.db_version) {
+      status = eslOK;
+    } else {
+      if ((env->load_cmd = malloc(MSG_SIZE(cmd))) == NULL) LOG_FATAL_MSG("malloc", errno);
+      memcpy(env->load_cmd, cmd, MSG_SIZE(cmd));
+      env->load_status = eslEINCOMPLETE;
+      if ((i = pthread_create(&env->load_id, NULL, load_thread, env)) != 0) LOG_FATAL_MSG("thread create", i);
+      printf("Loading database version %u\n", cmd->init.db_version);
+      status = eslEINCOMPLETE;
+    }
+  } else {
+    if (pthread_mutex_lock(&env->load_mutex) != 0) p7_Fail("mutex lock failed");
+    status = env->load_status;
+    if (pthread_mutex_unlock(&env->load_mutex) != 0) p7_Fail("mutex unlock failed");
+
+    if (status != eslEINCOMPLETE) {
+      pthread_join(env->load_id, NULL);
+      free(env->load_cmd);
+      env->load_cmd = NULL;
+    }
+    if (status == eslOK) {
+      /* keep the newest version the master searches; free the older */
+      i = (env->db[0].version == 0 || env->db[0].version < env->db[1].version) ? 0 : 1;
+      close_db(&env->db[i]);
+      env->db[i] = env->loaded;
+      printf("Database version %u loaded\n", env->db[i].version);
+    }
+  }
+
+  memset(&hdr, 0, sizeof(HMMD_HEADER));
+  hdr.command = HMMD_CMD_RELOAD;
+  hdr.status  = status;
+  if (writen(env->fd, &hdr, sizeof(HMMD_HEADER)) != sizeof(HMMD_HEADER)) {
+    LOG_FATAL_MSG("write error", errno);
+  }
+}
+
+/* process_RetireCmd()
+ * Free a version of the databases the master no longer searches.
+ */
+static void
+process_RetireCmd(HMMD_COMMAND *cmd, WORKER_ENV *env)
+{
+  HMMD_HEADER hdr;
+  int         i;
+
+  for (i = 0; i < 2; ++i) {
+    if (env->db[i].version == cmd->init.db_version && env->db[1-i].version != 0) {
+      close_db(&env->db[i]);
+      printf("Database version %u freed\n", cmd->init.db_version);
+    }
+  }
+
+  memset(&hdr, 0, sizeof(HMMD_HEADER));
+  hdr.command = HMMD_CMD_RETIRE;
+  hdr.status  = eslOK;
+  if (writen(env->fd, &hdr, sizeof(HMMD_HEADER)) != sizeof(HMMD_HEADER)) {
+    LOG_FATAL_MSG("write error", errno);
+  }
+}
+
+/* select_db()
+ * Point the worker at the version of the databases that the search
+ * command <cmd> is for.
+ */
+static void
+select_db(WORKER_ENV *env, HMMD_COMMAND *cmd)
+{
+  int i;
+
+  for (i = 0; i < 2; ++i) {
+    if (env->db[i].version == cmd->srch.db_version) {
+      env->seq_db = env->db[i].seq_db;
+      env->hmm_db = env->db[i].hmm_db;
+      return;
+    }
+  }
+  p7_syslog(LOG_ERR,"[%s:%d] - database version %u is not loaded\n", __FILE__, __LINE__, cmd->srch.db_version);
+  LOG_FATAL_MSG("database version error", 0);
+}
+
 static void 
 search_thread(void *arg)
 {
-  int               i;
+  int               i, q;
+  int               nq;
   int               count;
   int               seed;
   int               status;
@@ -552,62 +788,66 @@ search_thread(void *arg)
   ESL_SQ            dbsq;
   ESL_STOPWATCH    *w        = NULL;         /* timing stopwatch               */
   P7_BUILDER       *bld      = NULL;         /* HMM construction configuration */
-  P7_BG            *bg       = NULL;         /* null model                     */
-  P7_PIPELINE      *pli      = NULL;         /* work pipeline                  */
-  P7_TOPHITS       *th       = NULL;         /* top hit results                */
-  P7_PROFILE       *gm       = NULL;         /* generic model                  */
-  P7_OPROFILE      *om       = NULL;         /* optimized query profile        */
+  P7_BG            *bg[HMMD_MAX_BATCH];      /* null model, one per query      */
+  P7_PROFILE       *gm[HMMD_MAX_BATCH];      /* generic model                  */
+  P7_OPROFILE      *om[HMMD_MAX_BATCH];      /* optimized query profile        */
 
   obj = (ESL_THREADS *) arg;
   esl_threads_Started(obj, &workeridx);
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
+  nq   = info->nq;
   w    = esl_stopwatch_Create();
-  bg   = p7_bg_Create(info->abc);
   esl_stopwatch_Start(w);
 
   /* set up the dummy description and accession fields */
   dbsq.desc = "";
   dbsq.acc  = "";
 
-  /* process a query sequence or hmm */
-  if (info->seq != NULL) {
-    bld = p7_builder_Create(NULL, info->abc);
-    if ((seed = esl_opt_GetInteger(info->opts, "--seed")) > 0) {
-      esl_randomness_Init(bld->r, seed);
-      bld->do_reseeding = TRUE;
-    }
-    bld->EmL = esl_opt_GetInteger(info->opts, "--EmL");
-    bld->EmN = esl_opt_GetInteger(info->opts, "--EmN");
-    bld->EvL = esl_opt_GetInteger(info->opts, "--EvL");
-    bld->EvN = esl_opt_GetInteger(info->opts, "--EvN");
-    bld->EfL = esl_opt_GetInteger(info->opts, "--EfL");
-    bld->EfN = esl_opt_GetInteger(info->opts, "--EfN");
-    bld->Eft = esl_opt_GetReal   (info->opts, "--Eft");
-
-    if (esl_opt_IsOn(info->opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info->opts, "--mxfile"), NULL, esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg);
-    else                                      status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info->opts, "--mx"),           esl_opt_GetReal(info->opts, "--popen"), esl_opt_GetReal(info->opts, "--pextend"), bg); 
-    if (status != eslOK) {
-      //client_error(info->sock, status, "hmmgpmd: failed to set single query sequence score system: %s", bld->errbuf);
-      fprintf(stderr, "hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
-      pthread_exit(NULL);
-      return;
+  for (q = 0; q < nq; ++q) {
+    bg[q] = p7_bg_Create(info[q].abc);
+    gm[q] = NULL;
+    om[q] = NULL;
+
+    /* process a query sequence or hmm */
+    if (info[q].seq != NULL) {
+      bld = p7_builder_Create(NULL, info[q].abc);
+      if ((seed = esl_opt_GetInteger(info[q].opts, "--seed")) > 0) {
+        esl_randomness_Init(bld->r, seed);
+        bld->do_reseeding = TRUE;
+      }
+      bld->EmL = esl_opt_GetInteger(info[q].opts, "--EmL");
+      bld->EmN = esl_opt_GetInteger(info[q].opts, "--EmN");
+      bld->EvL = esl_opt_GetInteger(info[q].opts, "--EvL");
+      bld->EvN = esl_opt_GetInteger(info[q].opts, "--EvN");
+      bld->EfL = esl_opt_GetInteger(info[q].opts, "--EfL");
+      bld->EfN = esl_opt_GetInteger(info[q].opts, "--EfN");
+      bld->Eft = esl_opt_GetReal   (info[q].opts, "--Eft");
+
+      if (esl_opt_IsOn(info[q].opts, "--mxfile")) status = p7_builder_SetScoreSystem (bld, esl_opt_GetString(info[q].opts, "--mxfile"), NULL, esl_opt_GetReal(info[q].opts, "--popen"), esl_opt_GetReal(info[q].opts, "--pextend"), bg[q]);
+      else                                        status = p7_builder_LoadScoreSystem(bld, esl_opt_GetString(info[q].opts, "--mx"),           esl_opt_GetReal(info[q].opts, "--popen"), esl_opt_GetReal(info[q].opts, "--pextend"), bg[q]); 
+      if (status != eslOK) {
+        //client_error(info->sock, status, "hmmgpmd: failed to set single query sequence score system: %s", bld->errbuf);
+        fprintf(stderr, "hmmpgmd: failed to set single query sequence score system: %s", bld->errbuf);
+        pthread_exit(NULL);
+        return;
+      }
+      p7_SingleBuilder(bld, info[q].seq, bg[q], NULL, NULL, NULL, &om[q]); /* bypass HMM - only need model */
+      p7_builder_Destroy(bld);
+    } else {
+      gm[q] = p7_profile_Create (info[q].hmm->M, info[q].abc);
+      om[q] = p7_oprofile_Create(info[q].hmm->M, info[q].abc);
+      p7_ProfileConfig(info[q].hmm, bg[q], gm[q], 100, p7_LOCAL);
+      p7_oprofile_Convert(gm[q], om[q]);
     }
-    p7_SingleBuilder(bld, info->seq, bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
-    p7_builder_Destroy(bld);
-  } else {
-    gm = p7_profile_Create (info->hmm->M, info->abc);
-    om = p7_oprofile_Create(info->hmm->M, info->abc);
-    p7_ProfileConfig(info->hmm, bg, gm, 100, p7_LOCAL);
-    p7_oprofile_Convert(gm, om);
-  }
 
-  /* Create processing pipeline and hit list */
-  th  = p7_tophits_Create(); 
-  pli = p7_pipeline_Create(info->opts, om->M, 100, FALSE, p7_SEARCH_SEQS);
-  p7_pli_NewModel(pli, om, bg);
+    /* Create processing pipeline and hit list */
+    info[q].th  = p7_tophits_Create(); 
+    info[q].pli = p7_pipeline_Create(info[q].opts, om[q]->M, 100, FALSE, p7_SEARCH_SEQS);
+    p7_pli_NewModel(info[q].pli, om[q], bg[q]);
 
-  if (pli->Z_setby == p7_ZSETBY_NTARGETS) pli->Z = info->db_Z;
+    if (info[q].pli->Z_setby == p7_ZSETBY_NTARGETS) info[q].pli->Z = info[q].db_Z;
+  }
 
   /* loop until all sequences have been processed */
   count = 1;
@@ -637,37 +877,38 @@ search_thread(void *arg)
     count = info->sq_cnt - inx;
     if (count > blksz) count = blksz;
 
-    /* Main loop: */
+    /* Main loop: each target is compared to all the queries of a
+     * batch while its residues are still in cache.
+     */
     for (i = 0; i < count; ++i, ++sq) {
-      if ( !(info->range_list) || hmmpgmd_IsWithinRanges ((*sq)->idx, info->range_list)) {
-        dbsq.name  = (*sq)->name;
-        dbsq.dsq   = (*sq)->dsq;
-        dbsq.n     = (*sq)->n;
-        dbsq.idx   = (*sq)->idx;
-        if((*sq)->desc != NULL) dbsq.desc  = (*sq)->desc;
+      dbsq.name  = (*sq)->name;
+      dbsq.dsq   = (*sq)->dsq;
+      dbsq.n     = (*sq)->n;
+      dbsq.idx   = (*sq)->idx;
+      if((*sq)->desc != NULL) dbsq.desc  = (*sq)->desc;
 
-        p7_bg_SetLength(bg, dbsq.n);
-        p7_oprofile_ReconfigLength(om, dbsq.n);
+      for (q = 0; q < nq; ++q) {
+        if ( !(info[q].range_list) || hmmpgmd_IsWithinRanges ((*sq)->idx, info[q].range_list)) {
+          p7_bg_SetLength(bg[q], dbsq.n);
+          p7_oprofile_ReconfigLength(om[q], dbsq.n);
 
-        p7_Pipeline(pli, om, bg, &dbsq, NULL, th);
+          p7_Pipeline(info[q].pli, om[q], bg[q], &dbsq, NULL, info[q].th);
 
-        p7_pipeline_Reuse(pli);
+          p7_pipeline_Reuse(info[q].pli);
+        }
       }
     }
   }
 
-  /* make available the pipeline objects to the main thread */
-  info->th = th;
-  info->pli = pli;
-
   /* clean up */
-  p7_bg_Destroy(bg);
-  p7_oprofile_Destroy(om);
-
-  if (gm != NULL)  p7_profile_Destroy(gm);
+  for (q = 0; q < nq; ++q) {
+    p7_bg_Destroy(bg[q]);
+    p7_oprofile_Destroy(om[q]);
+    if (gm[q] != NULL)  p7_profile_Destroy(gm[q]);
+  }
 
   esl_stopwatch_Stop(w);
-  info->elapsed = w->elapsed;
+  for (q = 0; q < nq; ++q) info[q].elapsed = w->elapsed;
 
   esl_stopwatch_Destroy(w);
 
@@ -766,8 +1007,57 @@ scan_thread(void *arg)
 }
 
 
+/* limit_hits()
+ * Sort one query's hits best first, as the master merges the sorted
+ * lists of its workers, then apply the client's --maxhits and --maxaln
+ * limits and return how many hits to send.  Any hit in the top <n> of
+ * the whole database is in the top <n> of its unit, so the master
+ * still sees every hit it returns.  The counts of reportable and
+ * includable targets are taken over all of the unit's hits against the
+ * size of the whole database, letting the master set domZ as if it had
+ * seen every hit.
+ */
+static int
+limit_hits(WORKER_ENV *env, QUEUE_DATA *query, P7_TOPHITS *th, P7_PIPELINE *pli)
+{
+  P7_HIT *hit;
+  int     maxhits;
+  int     maxaln;
+  int     nsend;
+  int     h;
+
+  p7_tophits_SortBySortkey(th);
+
+  if (!hmmpgmd_GetHitLimits(query->opts, &maxhits, &maxaln)) return th->N;
+
+  if (pli->Z_setby == p7_ZSETBY_NTARGETS) {
+    if (query->cmd_type == HMMD_CMD_SEARCH) pli->Z = env->seq_db->db[query->dbx].K;
+    else                                    pli->Z = env->hmm_db->n;
+  }
+
+  th->nreported = 0;
+  th->nincluded = 0;
+  for (h = 0; h < th->N; h++) {
+    hit = &(th->unsrt[h]);
+    if (pli->use_bit_cutoffs) {
+      /* the pipeline already flagged these against the model's cutoffs */
+      if (hit->flags & p7_IS_REPORTED) th->nreported++;
+      if (hit->flags & p7_IS_INCLUDED) th->nincluded++;
+    } else if (!(hit->flags & p7_IS_DUPLICATE) && p7_pli_TargetReportable(pli, hit->score, hit->lnP)) {
+      th->nreported++;
+      if (p7_pli_TargetIncludable(pli, hit->score, hit->lnP)) th->nincluded++;
+    }
+  }
+
+  nsend = (maxhits >= 0 && maxhits < th->N) ? maxhits : th->N;
+  for (h = (maxaln >= 0) ? maxaln : nsend; h < nsend; h++)
+    hmmpgmd_DropAlignments(th->hit[h]);
+
+  return nsend;
+}
+
 static void
-send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
+send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli, int nsend){
   HMMD_SEARCH_STATS   stats;
   HMMD_SEARCH_STATUS  status;
   uint8_t **buf = NULL; // Buffer for the main results message
@@ -804,7 +1094,7 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
   stats.Z_setby     = pli->Z_setby;
   stats.domZ_setby  = pli->domZ_setby;
 
-  stats.nhits       = th->N;
+  stats.nhits       = nsend;
   stats.nreported   = th->nreported;
   stats.nincluded   = th->nincluded;
   stats.hit_offsets = NULL; // This field is only used when sending results back to the client
@@ -814,7 +1104,7 @@ send_results(int fd, ESL_STOPWATCH *w, P7_TOPHITS *th, P7_PIPELINE *pli){
 
   // and then the hits
   for(i =0; i< stats.nhits; i++){
-    if(p7_hit_Serialize(&(th->unsrt[i]), buf, &n, &nalloc) != eslOK){
+    if(p7_hit_Serialize(th->hit[i], buf, &n, &nalloc) != eslOK){
       LOG_FATAL_MSG("Serializing P7_HIT failed", errno);
     }
   }
@@ -427,6 +427,12 @@ typedef struct p7_hmmfile_s {
   FILE         *ffp;		/* MSV part of the optimized profile */
   FILE         *pfp;		/* rest of the optimized profile     */
 
+  /* ... or, after p7_hmmfile_Mmap(), view them in place:           */
+  char         *fmap;		/* <ffp>'s file, mapped; or NULL     */
+  char         *pmap;		/* <pfp>'s file, mapped; or NULL     */
+  off_t         nfmap;		/* size of <fmap>, in bytes          */
+  off_t         npmap;		/* size of <pmap>, in bytes          */
+
 #ifdef HMMER_THREADS
   int              syncRead;
   pthread_mutex_t  readMutex;
@@ -683,7 +689,12 @@ typedef struct p7_domaindef_s {
   int    nclustered;	/* number of regions evaluated by clustering ensemble of tracebacks */
   int    noverlaps;	/* number of envelopes defined in ensemble clustering that overlap w/ prev envelope */
   int    nenvelopes;	/* number of envelopes handed over for domain definition, null2, alignment, and scoring. */
+  int    nbanded;	/* number of those decoded and aligned on a sliced profile, inside their posterior bands */
 
+  /* banded decoding of envelopes (SSE only; see rescore_isolated_domain()) */
+  int                    do_bands;  /* TRUE to decode envelopes inside their posterior bands        */
+  struct p7_gbands_s    *bnd;	    /* reusable space for an envelope's posterior bands             */
+  struct p7_oprofile_s  *bom;	    /* reusable profile, sliced to an envelope's band window        */
 } P7_DOMAINDEF;
 
 
@@ -845,6 +856,29 @@ typedef struct p7_hmm_window_list_s {
  */
 #define FM_OCC_CNT( type, i, c)  ( occCnts_##type[(meta->alph_size)*(i) + (c)])
 
+/* Entry i of the sampled suffix array. Blocks too long for 32-bit positions
+ * (N > UINT32_MAX) keep their samples in SA64; all others use SA. Either
+ * way, the sample for the position of the '$' is stored as all-ones and
+ * comes back as -1.
+ */
+#define FM_SA(fm, i)  ( (fm)->SA64 != NULL ? (int64_t)(fm)->SA64[(i)] : \
+                        ((fm)->SA[(i)] == UINT32_MAX ? -1 : (int64_t)(fm)->SA[(i)]) )
+
+/* An FM index file written by current makehmmerdb starts with FM_MAGIC
+ * and a version byte. Version 1 files (no magic; the first byte is
+ * fwd_only) store term_loc, fm_start, ambiguity ranges and the
+ * superblock counts in 32 bits, which caps a block near 4 Gbases;
+ * version 2 stores them in 64 bits. Both are read into the same
+ * in-memory structures. Version 3 is version 2 with each of a block's
+ * arrays (T, BWT, SA, and the two count arrays) zero-padded to start on
+ * an FM_ALIGN byte boundary of the file, so that a mapped file can be
+ * searched in place; see fm_FM_mmap().
+ */
+#define FM_MAGIC      "HFM"
+#define FM_MAGIC_LEN  3
+#define FM_ALIGN      64
+#define FM_ALIGNED(n) ( ((n) + FM_ALIGN - 1) & ~((uint64_t) FM_ALIGN - 1) )
+
 enum fm_alphabettypes_e {
   fm_DNA        = 0,  //acgt,  2 bit
   //fm_DNA_full   = 1,  //includes ambiguity codes, 4 bit.
@@ -855,6 +889,19 @@ enum fm_alphabettypes_e {
  * See wheelert/notebook/2013/12-11-FM-alphabet-speed notes on 12/12.
  */
 
+/* FM alphabet code -> Easel digital code. The DNA codes are the same;
+ * the amino codes skip Easel's gap, which sits after the 20 canonical
+ * residues and before the degeneracies (BJZOUX).
+ */
+#define FM_DSQ(meta, c) ( (meta)->alph_type == fm_AMINO && (c) >= 20 ? (c) + 1 : (c) )
+
+enum fm_version_e {
+  fm_VERSION_1  = 1,
+  fm_VERSION_2  = 2,
+  fm_VERSION_3  = 3,
+};
+#define fm_VERSION_CURRENT fm_VERSION_3
+
 enum fm_direction_e {
   fm_forward    = 0,
   fm_backward   = 1,
@@ -862,8 +909,8 @@ enum fm_direction_e {
 
 
 typedef struct fm_interval_s {
-  int   lower;
-  int   upper;
+  int64_t  lower;
+  int64_t  upper;
 } FM_INTERVAL;
 
 typedef struct fm_hit_s {
@@ -887,7 +934,7 @@ typedef struct fm_seqdata_s {
 
   uint32_t target_id;      // Which sequence in the target database did this segment come from (can be multiple segment per sequence, if a sequence has Ns)
   uint64_t target_start;   // The position in sequence {id} in the target database at which this sequence-block starts (usually 1, unless its a long sequence split out over multiple FMs)
-  uint32_t fm_start;       // The position in the FM block at which this sequence begins
+  uint64_t fm_start;       // The position in the FM block at which this sequence begins
   uint32_t length;         // Length of this sequence segment  (usually the length of the target sequence, unless its a long sequence split out over multiple FMs)
 
 
@@ -904,6 +951,7 @@ typedef struct fm_seqdata_s {
 
 
 typedef struct fm_metadata_s {
+  uint8_t  version; //file format version, fm_VERSION_*
   uint8_t  fwd_only;
   uint8_t  alph_type;
   uint8_t  alph_size;
@@ -918,6 +966,8 @@ typedef struct fm_metadata_s {
   char     *inv_alph;
   int      *compl_alph;
   FILE         *fp;
+  char         *map;  //after fm_FM_mmap(), <fp>'s file, mapped; or NULL
+  off_t        nmap;  //size of <map>, in bytes
   FM_SEQDATA   *seq_data;
   FM_AMBIGLIST *ambig_list;
 } FM_METADATA;
@@ -925,7 +975,7 @@ typedef struct fm_metadata_s {
 
 typedef struct fm_data_s {
   uint64_t N; //length of text
-  uint32_t term_loc; // location in the BWT at which the '$' char is found (replaced in the sequence with 'a')
+  uint64_t term_loc; // location in the BWT at which the '$' char is found (replaced in the sequence with 'a')
   uint32_t seq_offset;
   uint32_t ambig_offset;
   uint32_t seq_cnt;
@@ -935,9 +985,11 @@ typedef struct fm_data_s {
   uint8_t  *BWT_mem;
   uint8_t  *BWT;
   uint32_t *SA; // sampled suffix array
+  uint64_t *SA64; // sampled suffix array, for blocks with N > UINT32_MAX (then SA is NULL); see FM_SA()
   int64_t  *C; //the first position of each letter of the alphabet if all of T is sorted.  (signed, as I use that to keep tract of presence/absence)
-  uint32_t *occCnts_sb;
+  uint64_t *occCnts_sb;
   uint16_t *occCnts_b;
+  int      is_view; //TRUE if T, BWT, SA and the counts point into meta->map, and aren't ours to free
 } FM_DATA;
 
 typedef struct fm_dp_pair_s {
@@ -970,6 +1022,20 @@ typedef struct fm_diaglist_s {
   int       size;
 } FM_DIAGLIST;
 
+/* Scratch space for p7_SSVFM_longlarget(). The caller keeps one per
+ * thread (in its P7_PIPELINE) and passes it in for every block, so it
+ * is grown as needed instead of allocated and freed for each block.
+ */
+typedef struct fm_ssv_workspace_s {
+  FM_DP_PAIR  *dp_pairs_fwd;     // M*max_depth diagonals, enough for any search
+  FM_DP_PAIR  *dp_pairs_rev;
+  int64_t      dp_pairs_alloc;   // # of FM_DP_PAIRs allocated in each of the above
+  uint8_t     *consensus;        // 1..M: model consensus, as digital residues
+  int          consensus_alloc;  // # of bytes allocated for consensus
+  ESL_SQ      *tmp_sq;           // target range, for extending seeds
+  FM_DIAGLIST  seeds;            // seeds.diags is NULL until first use
+} FM_SSV_WORKSPACE;
+
 /* Effectively global variables, to be initialized once in fm_initConfig(),
  * then passed around among threads to avoid recomputing them
  *
@@ -1177,6 +1243,9 @@ enum p7_pipemodes_e { p7_SEARCH_SEQS = 0, p7_SCAN_MODELS = 1 };
 enum p7_zsetby_e    { p7_ZSETBY_NTARGETS = 0, p7_ZSETBY_OPTION = 1, p7_ZSETBY_FILEINFO = 2 };
 enum p7_complementarity_e { p7_NOCOMPLEMENT    = 0, p7_COMPLEMENT   = 1 };
 
+/* Longer targets are compared in overlapping windows of this length; see p7_Pipeline() */
+#define p7_PIPELINE_MAXL 100000
+
 typedef struct p7_pipeline_s {
   /* Dynamic programming matrices                                           */
   P7_OMX     *oxf;		/* one-row Forward matrix, accel pipe       */
@@ -1250,7 +1319,21 @@ typedef struct p7_pipeline_s {
   int           show_alignments;/* TRUE to output alignments (default)      */
 
   P7_HMMFILE   *hfp;		/* COPY of open HMM database (if scan mode) */
+  int           rest_read;	/* TRUE once the rest of the current scan model is read */
   char          errbuf[eslERRBUFSIZE];
+
+  /* Workspace for p7_Pipeline_LongTarget(), allocated on first use and
+   * grown as needed; kept until p7_pipeline_Destroy()                      */
+  ESL_SQ       *lt_tmpseq;        /* holds each window passed downstream      */
+  P7_BG        *lt_bg;            /* scratch null model (its f[] only)        */
+  float        *lt_scores;        /* Kp*4 emission scores, for reparam'ing    */
+  float        *lt_fwd_emissions; /* Kp*(M+1) Forward emission probabilities  */
+  int           lt_allocM;        /* lt_fwd_emissions is big enough for this M */
+  FM_SSV_WORKSPACE fm_ws;         /* FM-index seeding (nhmmer on an FM db)    */
+
+  /* Workspace for p7_Pipeline_Block(): MSV scores for a range of targets */
+  float        *blk_usc;          /* [0..blk_nusc-1]                          */
+  int           blk_nusc;         /* allocated size of blk_usc                */
 } P7_PIPELINE;
 
 
@@ -1599,6 +1682,7 @@ extern int  p7_hmmfile_Open      (const char *filename, char *env, P7_HMMFILE **
 extern int  p7_hmmfile_OpenNoDB  (const char *filename, char *env, P7_HMMFILE **ret_hfp, char *errbuf);
 extern int  p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp);
 extern void p7_hmmfile_Close(P7_HMMFILE *hfp);
+extern int  p7_hmmfile_Mmap (P7_HMMFILE *hfp);
 #ifdef HMMER_THREADS
 extern int  p7_hmmfile_CreateLock(P7_HMMFILE *hfp);
 #endif
@@ -1646,11 +1730,15 @@ extern int p7_pli_NewModel          (P7_PIPELINE *pli, const P7_OPROFILE *om, P7
 extern int p7_pli_NewModelThresholds(P7_PIPELINE *pli, const P7_OPROFILE *om);
 extern int p7_pli_NewSeq            (P7_PIPELINE *pli, const ESL_SQ *sq);
 extern int p7_Pipeline              (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *th);
+extern int p7_Pipeline_FromMSV      (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float usc, P7_TOPHITS *th);
+extern int p7_Pipeline_Block        (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, ESL_SQ_BLOCK *block, int start, int end, P7_TOPHITS *th);
 extern int p7_Pipeline_LongTarget   (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
                                      P7_BG *bg, P7_TOPHITS *hitlist, int64_t seqidx,
                                      const ESL_SQ *sq, int complementarity,
                                      const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg
                                      );
+extern int p7_Pipeline_FMSeed       (P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data, P7_BG *bg,
+                                     const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, uint8_t *seeded);
 
 
 
@@ -1786,9 +1874,12 @@ extern uint64_t fm_computeSequenceOffset (const FM_DATA *fms, const FM_METADATA
 extern int fm_getOriginalPosition (const FM_DATA *fms, const FM_METADATA *meta, int fm_id, int length, int direction, uint64_t fm_pos,
                                     uint32_t *segment_id, uint64_t *seg_pos);
 extern int fm_readFMmeta( FM_METADATA *meta);
+extern int fm_FM_mmap( FM_METADATA *meta );
 extern int fm_FM_read( FM_DATA *fm, FM_METADATA *meta, int getAll );
 extern void fm_FM_destroy ( FM_DATA *fm, int isMainFM);
-extern uint8_t fm_getChar(uint8_t alph_type, int j, const uint8_t *B );
+extern int fm_FM_readBlocks( FM_METADATA *meta, FM_DATA **ret_fwd, FM_DATA **ret_bwd );
+extern void fm_FM_destroyBlocks( FM_METADATA *meta, FM_DATA *fwd, FM_DATA *bwd, int nblocks );
+extern uint8_t fm_getChar(uint8_t alph_type, uint64_t j, const uint8_t *B );
 extern int fm_getSARangeReverse( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alph, FM_INTERVAL *interval);
 extern int fm_getSARangeForward( const FM_DATA *fm, FM_CFG *cfg, char *query, char *inv_alph, FM_INTERVAL *interval);
 extern int fm_configAlloc(FM_CFG **cfg);
@@ -1799,20 +1890,24 @@ extern int fm_updateIntervalReverse( const FM_DATA *fm, const FM_CFG *cfg, char
 extern int fm_initSeeds (FM_DIAGLIST *list) ;
 extern FM_DIAG * fm_newSeed (FM_DIAGLIST *list);
 extern int fm_initAmbiguityList (FM_AMBIGLIST *list);
-extern int fm_addAmbiguityRange (FM_AMBIGLIST *list, uint32_t start, uint32_t stop);
+extern int fm_addAmbiguityRange (FM_AMBIGLIST *list, uint64_t start, uint64_t stop);
 extern int fm_convertRange2DSQ(const FM_DATA *fm, const FM_METADATA *meta, uint64_t first, int length, int complementarity, ESL_SQ *sq, int fix_ambiguities );
+extern int fm_readSeeded( const FM_DATA *fms, const FM_METADATA *meta, const uint8_t *seeded, uint32_t *idx, ESL_SQ_BLOCK *block );
 extern int fm_initConfigGeneric( FM_CFG *cfg, ESL_GETOPTS *go);
 
 /* fm_ssv.c */
+extern void fm_ssvWorkspaceInit   (FM_SSV_WORKSPACE *ws);
+extern void fm_ssvWorkspaceDestroy(FM_SSV_WORKSPACE *ws);
+extern void fm_setThreshRatio     (FM_CFG *fm_cfg, const P7_PROFILE *gm);
 extern int p7_SSVFM_longlarget( P7_OPROFILE *om, float nu, P7_BG *bg, double F1,
                       const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, const P7_SCOREDATA *ssvdata,
-                      int strands, ESL_RANDOMNESS *r, P7_HMM_WINDOWLIST *windowlist);
+                      int strands, ESL_RANDOMNESS *r, FM_SSV_WORKSPACE *ws, P7_HMM_WINDOWLIST *windowlist);
 
 
 /* fm_sse.c */
 extern int fm_configInit      (FM_CFG *cfg, ESL_GETOPTS *go);
-extern int fm_getOccCount     (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c);
-extern int fm_getOccCountLT   (const FM_DATA *fm, const FM_CFG *cfg, int pos, uint8_t c, uint32_t *cnteq, uint32_t *cntlt);
+extern int64_t fm_getOccCount   (const FM_DATA *fm, const FM_CFG *cfg, int64_t pos, uint8_t c);
+extern int fm_getOccCountLT   (const FM_DATA *fm, const FM_CFG *cfg, int64_t pos, uint8_t c, uint64_t *cnteq, uint64_t *cntlt);
 
 #endif /*P7_HMMERH_INCLUDED*/
 
@@ -147,8 +147,9 @@ return status;
 int
 getFMHits( FM_DATA *fm, FM_CFG *cfg, FM_INTERVAL *interval, int block_id, int hit_offset, int hit_length, FM_HIT *hits_ptr, int fm_direction) {
 
-  int i, j, len = 0;
-  int dist_from_end;
+  int64_t i, j;
+  int len = 0;
+  int64_t dist_from_end;
 
   for (i = interval->lower;  i<= interval->upper; i++) {
     j = i;
@@ -157,7 +158,7 @@ getFMHits( FM_DATA *fm, FM_CFG *cfg, FM_INTERVAL *interval, int block_id, int hi
     while ( j != fm->term_loc && (j % cfg->meta->freq_SA)) { //go until we hit a position in the full SA that was sampled during FM index construction
       uint8_t c = fm_getChar( cfg->meta->alph_type, j, fm->BWT);
       j = fm_getOccCount (fm, cfg, j-1, c);
-      j += abs((int)(fm->C[c]));
+      j += llabs(fm->C[c]);
       len++;
     }
 
@@ -166,7 +167,7 @@ getFMHits( FM_DATA *fm, FM_CFG *cfg, FM_INTERVAL *interval, int block_id, int hi
     hits_ptr[hit_offset + i - interval->lower].direction = fm_direction;
     hits_ptr[hit_offset + i - interval->lower].length    = hit_length;
 
-    dist_from_end = 1 + len + (j==fm->term_loc ? 0 : fm->SA[ j / cfg->meta->freq_SA ]) ; // len is how many backward steps we had to take to find a sampled SA position
+    dist_from_end = 1 + len + (j==fm->term_loc ? 0 : FM_SA(fm, j / cfg->meta->freq_SA)) ; // len is how many backward steps we had to take to find a sampled SA position
 
     if (fm_direction == fm_forward)
       dist_from_end += hit_length;
@@ -277,6 +278,7 @@ main(int argc,  char *argv[])
 
 
   fm_readFMmeta( meta);
+  fm_FM_mmap( meta);  // if we can, view the blocks in place
 
   if      (meta->alph_type == fm_DNA)   abc     = esl_alphabet_Create(eslDNA);
   else if (meta->alph_type == fm_AMINO) abc     = esl_alphabet_Create(eslAMINO);
@@ -294,7 +296,8 @@ main(int argc,  char *argv[])
 
     if (!meta->fwd_only) {  // whether or not we're going to search forward, need to read it in
       fm_FM_read(fmsb+i, meta, FALSE );
-      fmsb[i].SA = fmsf[i].SA;
+      fmsb[i].SA   = fmsf[i].SA;
+      fmsb[i].SA64 = fmsf[i].SA64;
       fmsb[i].T = fmsf[i].T;
     }
   }
@@ -30,6 +30,14 @@ static ESL_OPTIONS cmdlineOpts[] = {
   { "--wport",      eslARG_INT,     "51372",  NULL, "49151<n<65536",NULL,  NULL,  NULL,            "port to use for server/worker communication",                 12 },
   { "--ccncts",     eslARG_INT,     "16",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of client side connections to accept",         12 },
   { "--wcncts",     eslARG_INT,     "32",     NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of worker side connections to accept",         12 },
+  { "--maxq",       eslARG_INT,     "4",      NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of queries searched at the same time",         12 },
+  { "--qsize",      eslARG_INT,     "1000",   NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of queries waiting; more are turned away",     12 },
+  { "--cqsize",     eslARG_INT,     "100",    NULL, "n>0",          NULL,  NULL,  "--worker",      "maximum number of one client's queries waiting",              12 },
+  { "--cmaxq",      eslARG_INT,     "0",      NULL, "n>=0",         NULL,  NULL,  "--worker",      "maximum number of one client's queries searched (0: unlimited)", 12 },
+  { "--cache",      eslARG_INT,     "0",      NULL, "n>=0",         NULL,  NULL,  "--worker",      "MB of results kept to answer repeated queries (0: none)",     12 },
+  { "--cachedir",   eslARG_STRING,  NULL,     NULL, NULL,           NULL, "--cache","--worker",    "spill cached results to files in directory <s>",              12 },
+  { "--cachedisk",  eslARG_INT,     "1024",   NULL, "n>0",          NULL, "--cachedir",NULL,       "MB of cached results kept in the spill directory",            12 },
+  { "--statsfile",  eslARG_OUTFILE, NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "rewrite server metrics to file <f> every 10 seconds",         12 },
   { "--pid",        eslARG_OUTFILE, NULL,     NULL, NULL,           NULL,  NULL,  NULL,            "file to write process id to",                                 12 },
   { "--seqdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "protein database to cache for searches",                      12 },
   { "--hmmdb",      eslARG_INFILE,  NULL,     NULL, NULL,           NULL,  NULL,  "--worker",      "hmm database to cache for searches",                          12 },
@@ -8,6 +8,9 @@ typedef struct {
                                 /* zero, the length is for the error string */
                                 /* otherwise it is the length of the data   */
                                 /* to follow.                               */
+  uint32_t   retry_after;       /* if the server turned the query away      */
+                                /* because it is busy, seconds to wait      */
+                                /* before sending it again; otherwise 0     */
 } HMMD_SEARCH_STATUS;
 
 typedef struct {
@@ -44,6 +47,29 @@ typedef struct {
 #define HMMD_CMD_SCAN       10002
 #define HMMD_CMD_INIT       10003
 #define HMMD_CMD_SHUTDOWN   10004
+#define HMMD_CMD_BATCH      10005
+#define HMMD_CMD_RELOAD     10006
+#define HMMD_CMD_RETIRE     10007
+
+/* A reload has the master send each worker a HMMD_CMD_RELOAD, with the
+ * same data as a HMMD_CMD_INIT, every second or so until the worker has
+ * loaded the new databases in the background. The reply is a bare
+ * HMMD_HEADER whose status is eslEINCOMPLETE while the worker is still
+ * loading, eslOK once it can search the new version. HMMD_CMD_RETIRE
+ * tells the worker to free version <db_version>.
+ */
+
+/* A HMMD_CMD_BATCH message carries several HMMD_CMD_SEARCH commands of the
+ * same database range, back to back, each starting on an 8 byte boundary.
+ * The worker answers with one set of results per search, in order.
+ */
+#define HMMD_BATCH_ALIGN(n) (((n) + 7) & ~((size_t) 7))
+#define HMMD_MAX_BATCH      8
+
+/* priority classes of client queries in the master's queue */
+#define HMMD_PRIORITY_INTERACTIVE 0
+#define HMMD_PRIORITY_BATCH       1
+#define HMMD_NPRIORITY            2
 
 #define MAX_INIT_DESC 32
 
@@ -51,6 +77,7 @@ typedef struct {
 typedef struct {
   uint32_t    db_inx;               /* database index to search                 */
   uint32_t    db_type;              /* database type to search                  */
+  uint32_t    db_version;           /* version of the databases to search       */
   uint32_t    inx;                  /* index to begin search                    */
   uint32_t    cnt;                  /* number of sequences to search            */
   uint32_t    query_type;           /* sequence / hmm                           */
@@ -69,6 +96,7 @@ typedef struct {
   uint32_t    seq_cnt;              /* sequences in database                    */
   uint32_t    hmm_cnt;              /* total number hmm databases               */
   uint32_t    model_cnt;            /* models in hmm database                   */
+  uint32_t    db_version;           /* master's version of the databases        */
   char        data[];              /* string data                              */
 } HMMD_INIT_CMD;
 
@@ -94,7 +122,7 @@ typedef struct {
   };
 } HMMD_COMMAND;
 
-#define HMMD_SEARCH_STATUS_SERIAL_SIZE sizeof(uint32_t) + sizeof(uint64_t)
+#define HMMD_SEARCH_STATUS_SERIAL_SIZE (2 * sizeof(uint32_t) + sizeof(uint64_t))
 #define HMMD_SEARCH_STATS_SERIAL_BASE (5 * sizeof(double)) + (9 * sizeof(uint64_t)) + 2
 // The 2 is two enums at one byte/enum as we serialize them
 #define MSG_SIZE(x) (sizeof(HMMD_HEADER) + ((HMMD_HEADER *)(x))->length)
@@ -118,6 +146,9 @@ typedef struct queue_data_s {
   int            inx;         /* sequence index to start search */
   int            cnt;         /* number of sequences to search  */
 
+  int            priority;    /* HMMD_PRIORITY_* class (master) */
+  double         queued;      /* when it was queued (master)    */
+  struct queue_data_s *next;  /* next in its client's queue     */
 } QUEUE_DATA;
 
 
@@ -131,6 +162,9 @@ extern void free_QueueData(QUEUE_DATA *data);
 extern int  hmmpgmd_IsWithinRanges (int64_t sq_idx, RANGE_LIST *list );
 extern int  hmmpgmd_GetRanges (RANGE_LIST *list, char *rangestr);
 
+extern int  hmmpgmd_GetHitLimits(ESL_GETOPTS *opts, int *ret_maxhits, int *ret_maxaln);
+extern void hmmpgmd_DropAlignments(P7_HIT *hit);
+
 extern int  process_searchopts(int fd, char *cmdstr, ESL_GETOPTS **ret_opts);
 
 extern void worker_process(ESL_GETOPTS *go);
@@ -150,6 +184,28 @@ extern int hmmd_search_status_Deserialize(const uint8_t *buf, uint32_t *n, HMMD_
 extern int hmmd_search_status_TestSample(ESL_RAND64 *rng, HMMD_SEARCH_STATUS **ret_obj);
 extern int hmmd_search_status_Compare(HMMD_SEARCH_STATUS *first, HMMD_SEARCH_STATUS *second);
 
+/* hmmd_result_cache.c */
+typedef struct hmmd_result_cache_s HMMD_RESULT_CACHE;
+
+/* The key of a search's results: the search written out in a normal
+ * form, compared in full on lookup, and a hash of it.
+ */
+typedef struct {
+  uint64_t  hash;
+  uint8_t  *mem;		/* [0..n-1] key material */
+  uint64_t  n;
+  uint64_t  nalloc;
+} HMMD_CACHE_KEY;
+
+extern HMMD_RESULT_CACHE *hmmd_result_cache_Create(uint64_t max_mem, const char *spill_dir, uint64_t max_disk);
+extern void     hmmd_result_cache_Destroy(HMMD_RESULT_CACHE *cache);
+extern int      hmmd_result_cache_Get(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key, uint8_t **ret_data, uint64_t *ret_size);
+extern int      hmmd_result_cache_Put(HMMD_RESULT_CACHE *cache, const HMMD_CACHE_KEY *key, const uint8_t *data, uint64_t size);
+extern void     hmmd_result_cache_Clear(HMMD_RESULT_CACHE *cache);
+extern void     hmmd_result_cache_GetCounts(HMMD_RESULT_CACHE *cache, uint64_t *opt_nhits, uint64_t *opt_nmisses, uint64_t *opt_memsize, uint64_t *opt_disksize);
+extern HMMD_CACHE_KEY *hmmd_result_cache_Key(const QUEUE_DATA *query, const char *dbid);
+extern void     hmmd_cache_key_Destroy(HMMD_CACHE_KEY *key);
+
 /* hmmdutils.c */
 extern void hmmpgmd_WriteReady(ESL_GETOPTS *go);
 extern void hmmpgmd_RemoveReady(ESL_GETOPTS *go);
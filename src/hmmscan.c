@@ -26,14 +26,16 @@
 #ifdef HMMER_THREADS
 #include <unistd.h>
 #include "esl_threads.h"
-#include "esl_workqueue.h"
 #endif
 
 #include "hmmer.h"
+#ifdef HMMER_THREADS
+#include "p7_workpool.h"
+#endif
 
 typedef struct {
 #ifdef HMMER_THREADS
-  ESL_WORK_QUEUE   *queue;
+  P7_WORKPOOL      *pool;
 #endif
   ESL_SQ           *qsq;
   P7_BG            *bg;	         /* null model                              */
@@ -89,6 +91,7 @@ static ESL_OPTIONS options[] = {
   { "--nobias",     eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "turn off composition bias filter",                              7 },
   /* Other options */
   { "--nonull2",    eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL,  NULL,            "turn off biased composition score corrections",                12 },
+  { "--bands",      eslARG_NONE,    NULL, NULL, NULL,    NULL,  NULL, "--max",          "decode domains inside their posterior bands",                  12 },
   { "-Z",           eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of comparisons done, for E-value calculation",           12 },
   { "--domZ",       eslARG_REAL,   FALSE, NULL, "x>0",   NULL,  NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",    12 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",  NULL,  NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",          12 },
@@ -127,7 +130,7 @@ static int  serial_loop  (WORKER_INFO *info, P7_HMMFILE *hfp);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp);
+static int  thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_HMMFILE *hfp);
 static void pipeline_thread(void *arg);
 #endif
 
@@ -237,6 +240,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *hmmfile, char *seqfile)
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",            esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--bands")     && fprintf(ofp, "# banded domain decoding:          on\n")                                                 < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")          && fprintf(ofp, "# sequence search space set to:    %.0f\n",          esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")      && fprintf(ofp, "# domain search space set to:      %.0f\n",          esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))  {
@@ -346,7 +350,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   P7_OM_BLOCK     *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
-  ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WORKPOOL     *pool     = NULL;
 #endif
   char             errbuf[eslERRBUFSIZE];
 
@@ -398,7 +402,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
-      queue = esl_workqueue_Create(ncpus * 2);
+      pool      = p7_workpool_Create(ncpus, p7_workpool_ModelWeight);
+      if (pool == NULL) esl_fatal("Failed to create work pool");
     }
 #endif
 
@@ -409,7 +414,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     {
       info[i].bg    = p7_bg_Create(abc);
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].pool  = pool;
 #endif
     }
 
@@ -419,8 +424,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       block = p7_oprofile_CreateBlock(BLOCK_SIZE);
       if (block == NULL)    esl_fatal("Failed to allocate sequence block");
 
-      status = esl_workqueue_Init(queue, block);
-      if (status != eslOK)  esl_fatal("Failed to add block to work queue");
+      status = p7_workpool_Init(pool, block);
+      if (status != eslOK)  esl_fatal("Failed to add block to work pool");
     }
 #endif
 
@@ -433,6 +438,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       /* Open the target profile database */
       status = p7_hmmfile_Open(cfg->hmmfile, p7_HMMDBENV, &hfp, NULL);
       if (status != eslOK)        p7_Fail("Unexpected error %d in opening hmm file %s.\n",           status, cfg->hmmfile);  
+
+      /* Map the pressed profiles, so they're viewed in place instead of read */
+      status = p7_hmmfile_Mmap(hfp);
+      if (status != eslOK && status != eslENORESULT) p7_Fail("Unexpected error %d in mapping hmm file %s.\n", status, cfg->hmmfile);
   
 #ifdef HMMER_THREADS
       /* if we are threaded, create a lock to prevent multiple readers */
@@ -463,7 +472,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	}
 
 #ifdef HMMER_THREADS
-      if (ncpus > 0)  hstatus = thread_loop(threadObj, queue, hfp);
+      if (ncpus > 0)  hstatus = thread_loop(threadObj, pool, hfp);
       else	      hstatus = serial_loop(info, hfp);
 #else
       hstatus = serial_loop(info, hfp);
@@ -527,10 +536,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   if (ncpus > 0)
     {
-      esl_workqueue_Reset(queue);
-      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+      p7_workpool_Reset(pool);
+      while (p7_workpool_Remove(pool, (void **) &block) == eslOK)
 	p7_oprofile_DestroyBlock(block);
-      esl_workqueue_Destroy(queue);
+      p7_workpool_Destroy(pool);
       esl_threads_Destroy(threadObj);
     }
 #endif
@@ -1184,48 +1193,34 @@ serial_loop(WORKER_INFO *info, P7_HMMFILE *hfp)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, P7_HMMFILE *hfp)
+thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_HMMFILE *hfp)
 {
   int  status   = eslOK;
   int  sstatus  = eslOK;
-  int  eofCount = 0;
   P7_OM_BLOCK   *block;
   ESL_ALPHABET  *abc = NULL;
   void          *newBlock;
 
-  esl_workqueue_Reset(queue);
+  p7_workpool_Reset(pool);
   esl_threads_WaitForStart(obj);
 
-  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
-  if (status != eslOK) esl_fatal("Work queue reader failed");
-      
   /* Main loop: */
   while (sstatus == eslOK)
     {
+      status = p7_workpool_ReaderGet(pool, &newBlock);
+      if (status != eslOK) esl_fatal("Work pool reader failed");
       block = (P7_OM_BLOCK *) newBlock;
-      sstatus = p7_oprofile_ReadBlockMSV(hfp, &abc, block);
-      if (sstatus == eslEOF)
-	{
-	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
-	  ++eofCount;
-	}
-	  
-      if (sstatus == eslOK)
-	{
-	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
-	  if (status != eslOK) esl_fatal("Work queue reader failed");
-	}
-    }
 
-  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
-  if (status != eslOK) esl_fatal("Work queue reader failed");
+      sstatus = p7_oprofile_ReadBlockMSV(hfp, &abc, block);
 
-  if (sstatus == eslEOF)
-    {
-      /* wait for all the threads to complete */
-      esl_threads_WaitForFinish(obj);
-      esl_workqueue_Complete(queue);  
+      status = p7_workpool_ReaderPut(pool, block, (sstatus == eslOK ? block->count : 0));
+      if (status != eslOK) esl_fatal("Work pool reader failed");
     }
+
+  /* wait for the workers to finish the blocks, then for the threads to exit */
+  status = p7_workpool_ReaderDone(pool);
+  if (status != eslOK) esl_fatal("Work pool reader failed");
+  esl_threads_WaitForFinish(obj);
   
   esl_alphabet_Destroy(abc);
   return sstatus;
@@ -1240,7 +1235,7 @@ pipeline_thread(void *arg)
   WORKER_INFO   *info;
   ESL_THREADS   *obj;
   P7_OM_BLOCK   *block;
-  void          *newBlock;
+  P7_WORKRANGE   rng;
   
   impl_Init();
 
@@ -1249,15 +1244,13 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
-  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
-  if (status != eslOK) esl_fatal("Work queue worker failed");
-
-  /* loop until all blocks have been processed */
-  block = (P7_OM_BLOCK *) newBlock;
-  while (block->count > 0)
+  /* loop over ranges of models, taken from our deque or stolen, until all blocks have been processed */
+  while ((status = p7_workpool_WorkerNext(info->pool, workeridx, &rng)) == eslOK)
   {
+    block = (P7_OM_BLOCK *) rng.blk;
+
       /* Main loop: */
-    for (i = 0; i < block->count; ++i)
+    for (i = rng.start; i < rng.end; ++i)
     {
       P7_OPROFILE *om = block->list[i];
 
@@ -1274,14 +1267,10 @@ pipeline_thread(void *arg)
       block->list[i] = NULL;
     }
 
-    status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
-    if (status != eslOK) esl_fatal("Work queue worker failed");
-
-    block = (P7_OM_BLOCK *) newBlock;
+    status = p7_workpool_WorkerDone(info->pool, &rng);
+    if (status != eslOK) esl_fatal("Work pool worker failed");
   }
-
-  status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
-  if (status != eslOK) esl_fatal("Work queue worker failed");
+  if (status != eslEOD) esl_fatal("Work pool worker failed");
 
   esl_threads_Finished(obj, workeridx);
   return;
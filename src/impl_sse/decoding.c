@@ -189,6 +189,189 @@ p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P
   if (isinf(scaleproduct)) return eslERANGE;
   else                     return eslOK;
 }
+
+
+/* Function:  p7_DecodingBands()
+ * Synopsis:  Posterior-decoded bands, from full Forward/Backward matrices.
+ *
+ * Purpose:   Given filled Forward and Backward matrices <oxf>, <oxb>
+ *            for profile <om>, find the bands where the posterior
+ *            probability is, by the criteria of
+ *            <p7_BackwardCheckpointed()>: rows where the N, J, C states
+ *            have posterior probability $\geq 0.9$ are left out, and
+ *            for the others the band <ka..kb> is the range of k where
+ *            $P(M_k) + P(I_k) \geq 0.02$. Append the bands to <bnd>,
+ *            which the caller has created or reused, in order of i.
+ *
+ *            Each row is decoded as in <p7_Decoding()>, but only
+ *            tested, not stored, so this is a fraction of the cost of
+ *            a full decoding.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslERANGE> on numeric overflow. See commentary in
+ *            <p7_Decoding()>.
+ *
+ * Throws:    <eslEMEM> on allocation failure in <bnd>.
+ */
+int
+p7_DecodingBands(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_GBANDS *bnd)
+{
+  const __m128 *fv;
+  const __m128 *bv;
+  __m128  totrv;
+  __m128  pv;
+  __m128  minv = _mm_set1_ps(0.02);
+  int     L    = oxf->L;
+  int     M    = om->M;
+  int     Q    = p7O_NQF(M);
+  float   scaleproduct = 1.0 / oxb->xmx[p7X_N];
+  float   njc;
+  int     i, q, z, k, ka, kb, mask;
+  int     status;
+
+  for (i = 1; i <= L; i++)
+    {
+      njc  = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+      njc += oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+      njc += oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+
+      if (njc < 0.9)
+	{
+	  fv    = oxf->dpf[i];
+	  bv    = oxb->dpf[i];
+	  totrv = _mm_set1_ps(scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  ka    = M+1;
+	  kb    = 0;
+	  for (q = 0; q < Q; q++)
+	    {
+	      pv = _mm_add_ps(_mm_mul_ps(MMO(fv,q), MMO(bv,q)), _mm_mul_ps(IMO(fv,q), IMO(bv,q)));
+	      pv = _mm_mul_ps(pv, totrv);
+	      if (! (mask = _mm_movemask_ps(_mm_cmpge_ps(pv, minv)))) continue;
+	      for (z = 0; z < 4; z++)	/* striped: vector q, element z is k = zQ+q+1 */
+		if (mask & (1<<z))
+		  {
+		    k = z*Q+q+1;
+		    if (k > M) break;
+		    ka = ESL_MIN(ka, k);
+		    kb = ESL_MAX(kb, k);
+		  }
+	    }
+	  if (kb && (status = p7_gbands_Append(bnd, i, ka, kb)) != eslOK) return status;
+	}
+
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+  bnd->L = L;
+  bnd->M = M;
+
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+}
+
+
+/* Function:  p7_DecodingBanded()
+ * Synopsis:  Posterior decoding of residue assignment, in a column window.
+ *
+ * Purpose:   Same as <p7_Decoding()>, but decode only nodes <ka..kb> of
+ *            <om>, and lay <pp> out as the posterior decoding matrix of
+ *            the <W = kb-ka+1> node profile that <p7_oprofile_Slice()>
+ *            makes of them: node <k'> of <pp> is node <ka+k'-1> of
+ *            <om>. <pp> can then go to <p7_OptimalAccuracy()>,
+ *            <p7_OATrace()> and <p7_Null2_ByExpectation()> with the
+ *            sliced profile. The posteriors are those of the full
+ *            model; what falls outside the window is dropped.
+ *
+ *            As with <p7_Decoding()>, <pp> may be the same matrix as
+ *            <oxb>.
+ *
+ * Args:      om   - profile (must be the same that was used to fill <oxf>, <oxb>).
+ *            oxf  - filled Forward matrix 
+ *            oxb  - filled Backward matrix
+ *            ka   - first node of the window, 1..M
+ *            kb   - last node of the window, ka..M
+ *            pp   - RESULT: posterior decoding matrix, for a <W> node profile.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslERANGE> on numeric overflow; see <p7_Decoding()>.
+ *
+ * Throws:    <eslEINVAL> if <ka..kb> isn't a window of <om>.
+ *            <eslEMEM> on allocation failure.
+ */
+int
+p7_DecodingBanded(const P7_OPROFILE *om, const P7_OMX *oxf, P7_OMX *oxb, int ka, int kb, P7_OMX *pp)
+{
+  float       *mpp = NULL;	/* M posteriors of the current row, nodes ka..kb */
+  float       *ipp = NULL;	/* I posteriors of the current row               */
+  const float *fp;
+  const float *bp;
+  float       *dst;
+  float        totr;
+  int          L   = oxf->L;
+  int          Q   = p7O_NQF(om->M);
+  int          W   = kb-ka+1;
+  int          nq  = p7O_NQF(W);
+  float        scaleproduct = 1.0 / oxb->xmx[p7X_N];
+  int          i, q, k, kp, c;
+  int          status;
+
+  if (ka < 1 || kb > om->M || W < 1) ESL_EXCEPTION(eslEINVAL, "bad column window");
+  ESL_ALLOC(mpp, sizeof(float) * W);
+  ESL_ALLOC(ipp, sizeof(float) * W);
+
+  for (q = 0; q < nq*p7X_NSCELLS; q++) pp->dpf[0][q] = _mm_setzero_ps();
+  pp->xmx[p7X_E] = 0.0;
+  pp->xmx[p7X_N] = 0.0;
+  pp->xmx[p7X_J] = 0.0;
+  pp->xmx[p7X_C] = 0.0;
+  pp->xmx[p7X_B] = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      /* Gather first: <pp> may be <oxb>, striped differently. 
+       * Striped element k (0-based here) is vector k%Q, element k/Q.
+       */
+      fp   = (const float *) oxf->dpf[i];
+      bp   = (const float *) oxb->dpf[i];
+      totr = scaleproduct * oxf->xmx[i*p7X_NXCELLS+p7X_SCALE];
+      for (kp = 0, k = ka-1; kp < W; kp++, k++)
+	{
+	  c       = (k%Q)*p7X_NSCELLS*4 + k/Q;
+	  mpp[kp] = fp[c+p7X_M*4] * bp[c+p7X_M*4] * totr;
+	  ipp[kp] = fp[c+p7X_I*4] * bp[c+p7X_I*4] * totr;
+	}
+
+      dst = (float *) pp->dpf[i];
+      for (q = 0; q < nq*p7X_NSCELLS; q++) pp->dpf[i][q] = _mm_setzero_ps();
+      for (kp = 0; kp < W; kp++)
+	{
+	  c              = (kp%nq)*p7X_NSCELLS*4 + kp/nq;
+	  dst[c+p7X_M*4] = mpp[kp];
+	  dst[c+p7X_I*4] = ipp[kp];
+	}
+
+      pp->xmx[i*p7X_NXCELLS+p7X_E] = 0.0;
+      pp->xmx[i*p7X_NXCELLS+p7X_N] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_N] * oxb->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_J] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_J] * oxb->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_C] = oxf->xmx[(i-1)*p7X_NXCELLS+p7X_C] * oxb->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+      pp->xmx[i*p7X_NXCELLS+p7X_B] = 0.0;
+
+      if (oxb->has_own_scales) scaleproduct *= oxf->xmx[i*p7X_NXCELLS+p7X_SCALE] /  oxb->xmx[i*p7X_NXCELLS+p7X_SCALE];
+    }
+  pp->M = W;
+  pp->L = L;
+
+  free(mpp);
+  free(ipp);
+  if (isinf(scaleproduct)) return eslERANGE;
+  else                     return eslOK;
+
+ ERROR:
+  if (mpp) free(mpp);
+  if (ipp) free(ipp);
+  return status;
+}
 /*------------------ end, posterior decoding --------------------*/
 
 /*****************************************************************
@@ -356,6 +539,86 @@ utest_decoding(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, in
   p7_profile_Destroy(gm);
   p7_hmm_Destroy(hmm);
 }
+
+/* Decoding a column window gives the same posteriors as full
+ * decoding, in those columns; decoding the whole model with a
+ * slice of the whole model gives the same OA alignment; and the
+ * bands are sorted and in range.
+ */
+static void
+utest_decoding_banded(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, float tolerance)
+{
+  char        *msg  = "banded decoding unit test failed";
+  P7_HMM      *hmm  = NULL;
+  P7_PROFILE  *gm   = NULL;
+  P7_OPROFILE *om   = NULL;
+  P7_OPROFILE *sub  = p7_oprofile_Create(M, abc);
+  ESL_DSQ     *dsq  = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd  = p7_omx_Create(M, L, L);
+  P7_OMX      *bck  = p7_omx_Create(M, L, L);
+  P7_OMX      *pp1  = p7_omx_Create(M, L, L);
+  P7_OMX      *pp2  = p7_omx_Create(M, L, L);
+  P7_OMX      *oa   = p7_omx_Create(M, L, L);
+  P7_GMX      *gxp1 = p7_gmx_Create(M, L);
+  P7_GMX      *gxp2 = p7_gmx_Create(M, L);
+  P7_GBANDS   *bnd  = p7_gbands_Create();
+  float        fsc, bsc, oasc1, oasc2;
+  int          ka, kb, i, k, n;
+
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      if (esl_rsq_xfIID(r, bg->f, abc->K, L, dsq) != eslOK) esl_fatal(msg);
+      if (p7_Forward (dsq, L, om, fwd,      &fsc) != eslOK) esl_fatal(msg);
+      if (p7_Backward(dsq, L, om, fwd, bck, &bsc) != eslOK) esl_fatal(msg);
+      if (p7_Decoding(om, fwd, bck, pp1)          != eslOK) esl_fatal(msg);
+      if (p7_omx_FDeconvert(pp1, gxp1)            != eslOK) esl_fatal(msg);
+
+      ka = 1 + esl_rnd_Roll(r, M);
+      kb = ka + esl_rnd_Roll(r, M-ka+1);
+      if (p7_DecodingBanded(om, fwd, bck, ka, kb, pp2) != eslOK) esl_fatal(msg);
+      if (pp2->M != kb-ka+1)                           esl_fatal(msg);
+      if (p7_omx_FDeconvert(pp2, gxp2)                 != eslOK) esl_fatal(msg);
+      for (i = 1; i <= L; i++)
+	{
+	  for (k = ka; k <= kb; k++)
+	    {
+	      if (esl_FCompare(gxp1->dp[i][k*p7G_NSCELLS+p7G_M], gxp2->dp[i][(k-ka+1)*p7G_NSCELLS+p7G_M], 0.0, tolerance) != eslOK) esl_fatal(msg);
+	      if (esl_FCompare(gxp1->dp[i][k*p7G_NSCELLS+p7G_I], gxp2->dp[i][(k-ka+1)*p7G_NSCELLS+p7G_I], 0.0, tolerance) != eslOK) esl_fatal(msg);
+	    }
+	  if (esl_FCompare(gxp1->xmx[i*p7G_NXCELLS+p7G_C], gxp2->xmx[i*p7G_NXCELLS+p7G_C], 0.0, tolerance) != eslOK) esl_fatal(msg);
+	}
+
+      if (p7_DecodingBanded(om, fwd, bck, 1, M, pp2)   != eslOK) esl_fatal(msg);
+      if (p7_oprofile_Slice(om, 1, M, sub)             != eslOK) esl_fatal(msg);
+      if (p7_OptimalAccuracy(om,  pp1, oa, &oasc1)     != eslOK) esl_fatal(msg);
+      if (p7_OptimalAccuracy(sub, pp2, oa, &oasc2)     != eslOK) esl_fatal(msg);
+      if (esl_FCompare(oasc1, oasc2, tolerance, tolerance) != eslOK) esl_fatal(msg);
+
+      if (p7_gbands_Reuse(bnd)                         != eslOK) esl_fatal(msg);
+      if (p7_DecodingBands(om, fwd, bck, bnd)          != eslOK) esl_fatal(msg);
+      if (bnd->L != L || bnd->M != M)                  esl_fatal(msg);
+      for (n = 0; n < bnd->nrow; n++)
+	if (bnd->kmem[n*p7_GBANDS_NK] < 1 || bnd->kmem[n*p7_GBANDS_NK+1] > M ||
+	    bnd->kmem[n*p7_GBANDS_NK] > bnd->kmem[n*p7_GBANDS_NK+1]) esl_fatal(msg);
+      for (n = 1; n < bnd->nseg; n++)
+	if (bnd->imem[n*2] <= bnd->imem[n*2-1]+1)      esl_fatal(msg);
+    }
+
+  p7_gbands_Destroy(bnd);
+  p7_gmx_Destroy(gxp1);
+  p7_gmx_Destroy(gxp2);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(pp1);
+  p7_omx_Destroy(pp2);
+  p7_omx_Destroy(oa);
+  free(dsq);
+  p7_oprofile_Destroy(sub);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
 #endif /*p7DECODING_TESTDRIVE*/
 /*--------------------- end, unit tests -------------------------*/
 
@@ -411,7 +674,8 @@ main(int argc, char **argv)
   
   p7_FLogsumInit();
 
-  utest_decoding(r, abc, bg, M, L, N, tol);
+  utest_decoding       (r, abc, bg, M, L, N, tol);
+  utest_decoding_banded(r, abc, bg, M, L, N, tol);
   
   esl_getopts_Destroy(go);
   esl_randomness_Destroy(r);
@@ -138,6 +138,28 @@ p7_ForwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   if (! p7_oprofile_IsLocal(om)) ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
+  switch (om->simd) {
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return p7_ForwardParser_avx512(dsq, L, om, ox, opt_sc);
+#endif
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return p7_ForwardParser_avx(dsq, L, om, ox, opt_sc);
+#endif
+  default:             return forward_engine(FALSE, dsq, L, om, ox, opt_sc);
+  }
+}
+
+/* Function:  p7_ForwardParser_sse()
+ * Synopsis:  SSE implementation of <p7_ForwardParser()>.
+ *
+ * Purpose:   The 128-bit implementation, which <p7_ForwardParser()>
+ *            calls for profiles built for SSE (<om->simd>;
+ *            see simd.c). Unit tests and benchmarks of the wider
+ *            implementations compare against it.
+ */
+int
+p7_ForwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
   return forward_engine(FALSE, dsq, L, om, ox, opt_sc);
 }
 
@@ -243,6 +265,23 @@ p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX
   if (! p7_oprofile_IsLocal(om))  ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
 #endif
 
+  switch (om->simd) {
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return p7_BackwardParser_avx512(dsq, L, om, fwd, bck, opt_sc);
+#endif
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return p7_BackwardParser_avx(dsq, L, om, fwd, bck, opt_sc);
+#endif
+  default:             return backward_engine(FALSE, dsq, L, om, fwd, bck, opt_sc);
+  }
+}
+
+/* Function:  p7_BackwardParser_sse()
+ * Synopsis:  SSE implementation of <p7_BackwardParser()>.
+ */
+int
+p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
   return backward_engine(FALSE, dsq, L, om, fwd, bck, opt_sc);
 }
 
@@ -0,0 +1,1314 @@
+/* Forward/Backward, checkpointed: SSE version.
+ *
+ * The striped, scaled-probability Forward and Backward of fwdback.c,
+ * in O(M sqrt(L)) memory instead of O(ML). Forward saves only some
+ * of its rows (checkpoints); Backward runs in two rows, recomputing
+ * each segment of Forward rows from the checkpoint before it as it
+ * needs them (Grice, Hughey and Speck 1997), and posterior-decodes
+ * each row as it goes, so that no full matrix ever exists. What
+ * comes out is the Forward score and a set of posterior-decoded
+ * bands (<P7_GBANDS>): for each row where the homology states have
+ * appreciable posterior probability, the range of k where they do.
+ *
+ * Domain definition uses these for each domain envelope (see
+ * banded_decoding() in p7_domaindef.c), so that scoring an envelope
+ * doesn't need a full matrix.
+ *
+ * This is the SSE counterpart of generic_fwdback_chk.c, and uses the
+ * same row layout (see p7_gmxchk.h). As much of the matrix is kept
+ * as fits in the caller's memory limit; at worst, every row is
+ * checkpointed, and Forward rows are computed about twice.
+ *
+ * Contents:
+ *    1. The P7_OMXCHK object.
+ *    2. Forward: checkpointed fill, Forward score.
+ *    3. Backward: linear-memory back pass, recovering posterior-decoded bands.
+ *    4. Internal (static) routines.
+ *    5. Benchmark driver.
+ *    6. Unit tests.
+ *    7. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+#include "p7_gbands.h"
+
+static float forward_row     (const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, __m128 *dpc, int i, float xB);
+static void  rescale_row     (__m128 *dpc, int Q, float scale);
+static void  recompute_row   (const ESL_DSQ *dsq, const P7_OPROFILE *om, const P7_OMXCHK *oxc, const __m128 *dpp, __m128 *dpc, int i);
+static void  backward_row_L  (const P7_OPROFILE *om, __m128 *dpc, float *xs);
+static void  backward_row    (const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, __m128 *dpc, int i, float *xs);
+static float backward_xB     (const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, int i);
+static int   backward_rescale(const P7_OPROFILE *om, const P7_OMXCHK *oxc, __m128 *dpc, int i, float *xs, float *totscale);
+static int   decode_row      (const P7_OPROFILE *om, const P7_OMXCHK *oxc, const __m128 *fwd, const __m128 *bck, int i,
+			      const float *xs, float scaleproduct, P7_GBANDS *bnd);
+
+static int    set_row_layout  (P7_OMXCHK *oxc, int allocL, int maxR);
+static void   set_full        (P7_OMXCHK *oxc, int L);
+static void   set_checkpointed(P7_OMXCHK *oxc, int L, int R);
+static void   set_redlined    (P7_OMXCHK *oxc, int L, double minR);
+static double minimum_rows     (int L);
+static double checkpointed_rows(int L, int R);
+
+
+/*****************************************************************
+ * 1. The P7_OMXCHK object.
+ *****************************************************************/
+
+/* Function:  p7_omxchk_Create()
+ * Synopsis:  Allocate a new <P7_OMXCHK> matrix.
+ *
+ * Purpose:   Allocate a new checkpointed matrix sufficient for
+ *            <p7_ForwardCheckpointed()> and <p7_BackwardCheckpointed()>
+ *            on a comparison of a query model of length <M> and a
+ *            target sequence of length <L>, trying to keep the
+ *            allocation within <ramlimit> bytes (<ESL_MBYTES(128)>,
+ *            for example). As for <p7_gmxchk_Create()>: if even a
+ *            fully checkpointed matrix doesn't fit, it's allocated
+ *            anyway ("redlined"), and a later <p7_omxchk_GrowTo()>
+ *            shrinks it back when it can.
+ *
+ *            <ramlimit> is per matrix, so take the number of threads
+ *            into account. Choosing it to fit in cache keeps the
+ *            recomputation cheap.
+ *
+ * Returns:   ptr to new <P7_OMXCHK> object on success.
+ *
+ * Throws:    <NULL> on allocation failure.
+ */
+P7_OMXCHK *
+p7_omxchk_Create(int M, int L, int64_t ramlimit)
+{
+  P7_OMXCHK *oxc = NULL;
+  int        maxR;
+  int        r;
+  int        status;
+
+  ESL_ALLOC(oxc, sizeof(P7_OMXCHK));
+  oxc->dp     = NULL;
+  oxc->dp_mem = NULL;
+  oxc->x_mem  = NULL;
+
+  oxc->R0          = 3;	/* bck[prv,cur], fwd[0] */
+  oxc->allocW      = p7O_NQF(M) * p7X_NSCELLS;
+  oxc->ncell_limit = ramlimit / sizeof(__m128);
+  maxR             = (int) (oxc->ncell_limit / (int64_t) oxc->allocW);
+  set_row_layout(oxc, L, maxR);
+  oxc->allocR      = oxc->R0 + oxc->Ra + oxc->Rb + oxc->Rc;
+  oxc->validR      = oxc->allocR;
+  oxc->ncells      = (int64_t) oxc->allocR * (int64_t) oxc->allocW;
+
+  ESL_ALLOC(oxc->dp_mem, sizeof(__m128)   * oxc->ncells + 15);
+  ESL_ALLOC(oxc->dp,     sizeof(__m128 *) * oxc->allocR);
+  oxc->dp[0] = (__m128 *) ( ( (unsigned long int) ((char *) oxc->dp_mem + 15) & (~0xf)));
+  for (r = 1; r < oxc->allocR; r++)
+    oxc->dp[r] = oxc->dp[0] + (int64_t) r * (int64_t) oxc->allocW;
+
+  oxc->allocXR = L+1;
+  ESL_ALLOC(oxc->x_mem, sizeof(float) * oxc->allocXR * p7X_NXCELLS + 15);
+  oxc->xmx = (float *) ( ( (unsigned long int) ((char *) oxc->x_mem + 15) & (~0xf)));
+
+  oxc->M        = 0;
+  oxc->L        = 0;
+  oxc->R        = 0;
+  oxc->totscale = 0.0;
+  return oxc;
+
+ ERROR:
+  p7_omxchk_Destroy(oxc);
+  return NULL;
+}
+
+
+/* Function:  p7_omxchk_GrowTo()
+ * Synopsis:  Resize a checkpointed matrix for a new comparison.
+ *
+ * Purpose:   Reallocate and lay out <oxc> for a comparison of
+ *            dimensions <M> by <L>, avoiding reallocation where the
+ *            current allocation will do. Same policy as
+ *            <p7_gmxchk_GrowTo()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure; <oxc> must not be used
+ *            further, except to destroy it.
+ */
+int
+p7_omxchk_GrowTo(P7_OMXCHK *oxc, int M, int L)
+{
+  void *p;
+  int   W             = p7O_NQF(M) * p7X_NSCELLS;
+  int   minR_chk      = (int) ceil(minimum_rows(L)) + oxc->R0;
+  int   reset_dp_ptrs = FALSE;
+  int   maxR;
+  int   r;
+  int   status;
+
+  if (L+1 > oxc->allocXR)
+    {
+      ESL_RALLOC(oxc->x_mem, p, sizeof(float) * (L+1) * p7X_NXCELLS + 15);
+      oxc->allocXR = L+1;
+      oxc->xmx     = (float *) ( ( (unsigned long int) ((char *) oxc->x_mem + 15) & (~0xf)));
+    }
+
+  oxc->M = 0;
+  oxc->L = 0;
+  oxc->R = 0;
+
+  /* Are the current allocations satisfactory? */
+  if (W <= oxc->allocW && oxc->ncells <= oxc->ncell_limit)
+    {
+      if      (L + oxc->R0 <= oxc->validR) { set_full        (oxc, L);              return eslOK; }
+      else if (minR_chk    <= oxc->validR) { set_checkpointed(oxc, L, oxc->validR); return eslOK; }
+    }
+
+  /* Do rows need to widen? */
+  if (W > oxc->allocW)
+    {
+      oxc->allocW   = W;
+      oxc->validR   = (int) (oxc->ncells / (int64_t) oxc->allocW);
+      reset_dp_ptrs = TRUE;
+    }
+
+  /* Does <dp_mem> need reallocation, up or down? */
+  maxR = (int) (oxc->ncell_limit / (int64_t) oxc->allocW);
+  if ( (oxc->ncells > oxc->ncell_limit && minR_chk <= maxR) || minR_chk > oxc->validR)
+    {
+      set_row_layout(oxc, L, maxR);
+      oxc->validR = oxc->R0 + oxc->Ra + oxc->Rb + oxc->Rc;
+      oxc->ncells = (int64_t) oxc->validR * (int64_t) oxc->allocW;
+      ESL_RALLOC(oxc->dp_mem, p, sizeof(__m128) * oxc->ncells + 15);
+      reset_dp_ptrs = TRUE;
+    }
+  else
+    {
+      if   (L + oxc->R0 <= oxc->validR) set_full(oxc, L);
+      else                              set_checkpointed(oxc, L, oxc->validR);
+    }
+
+  if (oxc->validR > oxc->allocR)
+    {
+      ESL_RALLOC(oxc->dp, p, sizeof(__m128 *) * oxc->validR);
+      oxc->allocR   = oxc->validR;
+      reset_dp_ptrs = TRUE;
+    }
+
+  if (reset_dp_ptrs)
+    {
+      oxc->dp[0] = (__m128 *) ( ( (unsigned long int) ((char *) oxc->dp_mem + 15) & (~0xf)));
+      for (r = 1; r < oxc->validR; r++)
+	oxc->dp[r] = oxc->dp[0] + (int64_t) r * (int64_t) oxc->allocW;
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_omxchk_Sizeof()
+ * Synopsis:  Returns the size of a checkpointed matrix, in bytes.
+ */
+size_t
+p7_omxchk_Sizeof(const P7_OMXCHK *oxc)
+{
+  size_t n = sizeof(P7_OMXCHK);
+
+  n += oxc->ncells  * sizeof(__m128) + 15;
+  n += oxc->allocR  * sizeof(__m128 *);
+  n += oxc->allocXR * sizeof(float) * p7X_NXCELLS + 15;
+  return n;
+}
+
+
+/* Function:  p7_omxchk_Reuse()
+ * Synopsis:  Recycle a checkpointed matrix.
+ *
+ * Purpose:   Reset <oxc> for a new comparison, keeping its
+ *            allocations. The caller still calls <p7_omxchk_GrowTo()>
+ *            before the next Forward, to lay out the rows.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_omxchk_Reuse(P7_OMXCHK *oxc)
+{
+  oxc->M  = 0;
+  oxc->L  = 0;
+  oxc->R  = 0;
+  oxc->Ra = oxc->Rb = oxc->Rc = 0;
+  oxc->La = oxc->Lb = oxc->Lc = 0;
+  oxc->totscale = 0.0;
+  return eslOK;
+}
+
+
+/* Function:  p7_omxchk_Destroy()
+ * Synopsis:  Frees a checkpointed matrix.
+ *
+ * Purpose:   Free <oxc>, which may be <NULL> or incompletely allocated.
+ */
+void
+p7_omxchk_Destroy(P7_OMXCHK *oxc)
+{
+  if (oxc)
+    {
+      if (oxc->dp_mem) free(oxc->dp_mem);
+      if (oxc->dp)     free(oxc->dp);
+      if (oxc->x_mem)  free(oxc->x_mem);
+      free(oxc);
+    }
+}
+/*------------------ end, P7_OMXCHK object ----------------------*/
+
+
+
+
+/*****************************************************************
+ * 2. Forward: checkpointed fill, Forward score.
+ *****************************************************************/
+
+/* Function:  p7_ForwardCheckpointed()
+ * Synopsis:  Forward pass in a checkpointed SSE matrix.
+ *
+ * Purpose:   Compute the Forward pass of profile <om> against digital
+ *            sequence <dsq> of length <L>, leaving the checkpointed
+ *            matrix in <oxc> ready for <p7_BackwardCheckpointed()>,
+ *            and (optionally) the Forward score in <*opt_sc>, in
+ *            nats. The score is the same as <p7_Forward()>'s.
+ *
+ *            The caller has laid out <oxc> for the <om->M> by <L>
+ *            comparison, with <p7_omxchk_Create()> or
+ *            <p7_omxchk_GrowTo()>, and has configured the length
+ *            model of <om> for <L>. As for <p7_Forward()>, <om> must
+ *            be in a local mode.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslERANGE> if the score exceeds the range of a
+ *            probability-space odds ratio; <*opt_sc> is undefined.
+ */
+int
+p7_ForwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *oxc, float *opt_sc)
+{
+  int     Q   = p7O_NQF(om->M);
+  float  *xmx = oxc->xmx;
+  __m128 *dpc;			/* current row  */
+  __m128 *dpp;			/* previous row */
+  float   xE, xN, xJ, xB, xC;
+  int     i, q;
+  int     b, w;		        /* b counts down the checkpointed segments; w counts down rows in the current one */
+
+  /* Initialization of row 0 */
+  oxc->M        = om->M;
+  oxc->L        = L;
+  oxc->R        = 0;
+  oxc->totscale = 0.0;
+  dpc = oxc->dp[oxc->R0-1];
+  for (q = 0; q < Q; q++)
+    MMO(dpc,q) = IMO(dpc,q) = DMO(dpc,q) = _mm_setzero_ps();
+  xE = xmx[p7X_E] = 0.;
+  xN = xmx[p7X_N] = 1.;
+  xJ = xmx[p7X_J] = 0.;
+  xB = xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  xC = xmx[p7X_C] = 0.;
+  xmx[p7X_SCALE]  = 1.0;
+
+  /* Region a: every row saved. Then regions b, c: rows go in the two
+   * temporary rows, except the last row of each segment, which is
+   * saved. Same traversal as p7_GForwardCheckpointed().
+   */
+  b = oxc->Rb + oxc->Rc;
+  w = (oxc->Rb ? oxc->Lb : oxc->Rc+1);
+  for (i = 1; i <= L; i++)
+    {
+      dpp = dpc;
+      if (i <= oxc->La)  { dpc = oxc->dp[oxc->R0+oxc->R]; oxc->R++; }
+      else if (! (--w))  { dpc = oxc->dp[oxc->R0+oxc->R]; oxc->R++; w = b; b--; }
+      else                 dpc = oxc->dp[i%2];
+
+      xE = forward_row(dsq, om, dpp, dpc, i, xB);
+
+      xN =  xN * om->xf[p7O_N][p7O_LOOP];
+      xC = (xC * om->xf[p7O_C][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_MOVE]);
+      xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
+      xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+
+      /* Sparse rescaling, as in p7_Forward(). Backward recomputes rows
+       * in the checkpointed regions with the scale factors kept here.
+       */
+      if (xE > 1.0e4)
+	{
+	  xN  = xN / xE;
+	  xC  = xC / xE;
+	  xJ  = xJ / xE;
+	  xB  = xB / xE;
+	  rescale_row(dpc, Q, xE);
+	  xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
+	  oxc->totscale += log(xE);
+	  xE = 1.0;
+	}
+      else xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
+
+      xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    }
+
+  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
+  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");
+  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = oxc->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+/*--------------------- end, forward ----------------------------*/
+
+
+
+/*****************************************************************
+ * 3. Backward: linear-memory back pass, recovering posterior-decoded bands.
+ *****************************************************************/
+
+/* Function:  p7_BackwardCheckpointed()
+ * Synopsis:  Backward pass and posterior decoding, in linear memory.
+ *
+ * Purpose:   Given a checkpointed Forward matrix <oxc> that
+ *            <p7_ForwardCheckpointed()> has just filled for <om>
+ *            against <dsq>, run Backward in two rows, recomputing
+ *            Forward rows from the checkpoints as needed, and
+ *            posterior-decode each row. Rows where the nonhomologous
+ *            states N, J, C have posterior probability $\geq 0.9$
+ *            are left out; for the others, the band <ka..kb> is the
+ *            range of k where $P(M_k) + P(I_k) \geq 0.02$. These are
+ *            the criteria of <p7_GBackwardCheckpointed()>. The bands
+ *            are added to <bnd>, which the caller has created or
+ *            reused, in order of i.
+ *
+ *            Optionally return the Backward score in <*opt_sc>, in
+ *            nats.
+ *
+ *            The pass uses up <oxc>: the saved Forward rows are
+ *            overwritten, so one Backward follows each Forward.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslERANGE> if Backward overflows Forward's scale
+ *            factors. <p7_Backward()> copes with this rare case
+ *            [J3/119] by switching to scale factors of its own, which
+ *            requires the whole matrix to decode; here, the caller
+ *            falls back to the full-matrix routines. <bnd> is
+ *            incomplete.
+ *
+ * Throws:    <eslEMEM> on allocation failure in <bnd>.
+ */
+int
+p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *oxc, P7_GBANDS *bnd, float *opt_sc)
+{
+  float  *xmx          = oxc->xmx;
+  float   scaleproduct = 1.0 / (xmx[L*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_MOVE]);
+  float   xs[p7X_NXCELLS];	/* Backward specials for the current row */
+  float   totscale     = 0.0;
+  __m128 *fwd;
+  __m128 *bck;
+  __m128 *dpp;			/* Backward row i+1 */
+  int     i, i2, b, w;
+  int     status;
+
+  if (L == 0)
+    {
+      bnd->L = 0;
+      bnd->M = om->M;
+      if (opt_sc != NULL) *opt_sc = -eslINFINITY; /* as p7_ForwardCheckpointed(): no L=0 path [J5/118] */
+      return eslOK;
+    }
+
+  /* Row L */
+  i   = L;
+  oxc->R--;
+  fwd = oxc->dp[oxc->R0+oxc->R];
+  bck = oxc->dp[L%2];
+  backward_row_L(om, bck, xs);
+  if ((status = backward_rescale(om, oxc, bck, i, xs, &totscale)) != eslOK) return status;
+  if ((status = decode_row(om, oxc, fwd, bck, i, xs, scaleproduct, bnd)) != eslOK) return status;
+  dpp = bck;
+
+  /* Checkpointed regions (c, then b), last segment first. Segment b
+   * (counting from the end) has w rows, i-w+1..i, and row i was saved;
+   * the rest are recomputed from the saved row before them.
+   */
+  for (b = 1; b <= oxc->Rb + oxc->Rc; b++)
+    {
+      w = (b <= oxc->Rc ? b+1 : oxc->Lb);
+
+      if (b > 1)		/* for b=1, the saved row is L, done above */
+	{
+	  oxc->R--;
+	  fwd = oxc->dp[oxc->R0+oxc->R];
+	  bck = oxc->dp[i%2];
+	  backward_row(dsq, om, dpp, bck, i, xs);
+	  if ((status = backward_rescale(om, oxc, bck, i, xs, &totscale)) != eslOK) return status;
+	  if ((status = decode_row(om, oxc, fwd, bck, i, xs, scaleproduct, bnd)) != eslOK) return status;
+	  dpp = bck;
+	}
+
+      /* Forward rows i-w+1..i-1, from the checkpoint at i-w */
+      fwd = oxc->dp[oxc->R0+oxc->R-1];
+      for (i2 = i-w+1; i2 <= i-1; i2++)
+	{
+	  recompute_row(dsq, om, oxc, fwd, oxc->dp[oxc->R0+oxc->R], i2);
+	  fwd = oxc->dp[oxc->R0+oxc->R];
+	  oxc->R++;
+	}
+
+      /* Backward across them */
+      for (i2 = i-1; i2 >= i-w+1; i2--)
+	{
+	  oxc->R--;
+	  fwd = oxc->dp[oxc->R0+oxc->R];
+	  bck = oxc->dp[i2%2];
+	  backward_row(dsq, om, dpp, bck, i2, xs);
+	  if ((status = backward_rescale(om, oxc, bck, i2, xs, &totscale)) != eslOK) return status;
+	  if ((status = decode_row(om, oxc, fwd, bck, i2, xs, scaleproduct, bnd)) != eslOK) return status;
+	  dpp = bck;
+	}
+      i -= w;
+    }
+  if (oxc->Rb + oxc->Rc == 0) i--; /* row L was in region a; else i=La now */
+
+  /* Region a: every row saved */
+  for (; i >= 1; i--)
+    {
+      oxc->R--;
+      fwd = oxc->dp[oxc->R0+oxc->R];
+      bck = oxc->dp[i%2];
+      backward_row(dsq, om, dpp, bck, i, xs);
+      if ((status = backward_rescale(om, oxc, bck, i, xs, &totscale)) != eslOK) return status;
+      if ((status = decode_row(om, oxc, fwd, bck, i, xs, scaleproduct, bnd)) != eslOK) return status;
+      dpp = bck;
+    }
+
+  /* i=0: only N,B are reachable */
+  xs[p7X_B] = backward_xB(dsq, om, dpp, 0);
+  xs[p7X_N] = (xs[p7X_B] * om->xf[p7O_N][p7O_MOVE]) + (xs[p7X_N] * om->xf[p7O_N][p7O_LOOP]);
+
+  if       (isnan(xs[p7X_N]))  ESL_EXCEPTION(eslERANGE, "backward score is NaN");
+  else if  (xs[p7X_N] == 0.0)  ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");
+  else if  (isinf(xs[p7X_N]))  ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+
+  bnd->L = L;
+  bnd->M = om->M;
+  p7_gbands_Reverse(bnd);
+  if (opt_sc != NULL) *opt_sc = totscale + log(xs[p7X_N]);
+  return eslOK;
+}
+/*--------------------- end, backward ---------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Internal (static) routines.
+ *****************************************************************/
+
+/* forward_row()
+ *
+ * Compute Forward row <i> in <dpc> from row i-1 in <dpp>, given
+ * B(i-1) in <xB>; return E(i), before any rescaling. This is the
+ * row calculation of p7_Forward(), operation for operation, so a
+ * recomputed row is identical to the first one.
+ */
+static float
+forward_row(const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, __m128 *dpc, int i, float xB)
+{
+  register __m128 mpv, dpv, ipv;   /* previous row values                                       */
+  register __m128 sv;		   /* temp storage of 1 curr row value in progress              */
+  register __m128 dcv;		   /* delayed storage of D(i,q+1)                               */
+  register __m128 xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register __m128 xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  __m128   zerov = _mm_setzero_ps();
+  __m128  *rp    = om->rfv[dsq[i]];
+  __m128  *tp    = om->tfv;
+  float    xE;
+  int      Q     = p7O_NQF(om->M);
+  int      q, j;
+
+  dcv   = _mm_setzero_ps();
+  xEv   = _mm_setzero_ps();
+  xBv   = _mm_set1_ps(xB);
+
+  /* Right shifts by 4 bytes. 4,8,12,x becomes x,4,8,12.  Shift zeros on. */
+  mpv   = esl_sse_rightshiftz_float(MMO(dpp,Q-1));
+  dpv   = esl_sse_rightshiftz_float(DMO(dpp,Q-1));
+  ipv   = esl_sse_rightshiftz_float(IMO(dpp,Q-1));
+
+  for (q = 0; q < Q; q++)
+    {
+      sv   =                _mm_mul_ps(xBv, *tp);  tp++;
+      sv   = _mm_add_ps(sv, _mm_mul_ps(mpv, *tp)); tp++;
+      sv   = _mm_add_ps(sv, _mm_mul_ps(ipv, *tp)); tp++;
+      sv   = _mm_add_ps(sv, _mm_mul_ps(dpv, *tp)); tp++;
+      sv   = _mm_mul_ps(sv, *rp);                  rp++;
+      xEv  = _mm_add_ps(xEv, sv);
+
+      mpv = MMO(dpp,q);
+      dpv = DMO(dpp,q);
+      ipv = IMO(dpp,q);
+
+      MMO(dpc,q) = sv;
+      DMO(dpc,q) = dcv;
+
+      dcv   = _mm_mul_ps(sv, *tp); tp++;
+
+      sv         =                _mm_mul_ps(mpv, *tp);  tp++;
+      IMO(dpc,q) = _mm_add_ps(sv, _mm_mul_ps(ipv, *tp)); tp++;
+    }
+
+  /* DD paths: one complete pass, then serialized (small models) or
+   * until no D changes (large models), as in p7_Forward().
+   */
+  dcv        = esl_sse_rightshiftz_float(dcv);
+  DMO(dpc,0) = zerov;
+  tp         = om->tfv + 7*Q;
+  for (q = 0; q < Q; q++)
+    {
+      DMO(dpc,q) = _mm_add_ps(dcv, DMO(dpc,q));
+      dcv        = _mm_mul_ps(DMO(dpc,q), *tp); tp++;
+    }
+
+  if (om->M < 100)
+    {
+      for (j = 1; j < 4; j++)
+	{
+	  dcv = esl_sse_rightshiftz_float(dcv);
+	  tp  = om->tfv + 7*Q;
+	  for (q = 0; q < Q; q++)
+	    {
+	      DMO(dpc,q) = _mm_add_ps(dcv, DMO(dpc,q));
+	      dcv        = _mm_mul_ps(dcv, *tp);   tp++;
+	    }
+	}
+    }
+  else
+    {
+      for (j = 1; j < 4; j++)
+	{
+	  register __m128 cv;
+
+	  dcv = esl_sse_rightshiftz_float(dcv);
+	  tp  = om->tfv + 7*Q;
+	  cv  = zerov;
+	  for (q = 0; q < Q; q++)
+	    {
+	      sv         = _mm_add_ps(dcv, DMO(dpc,q));
+	      cv         = _mm_or_ps(cv, _mm_cmpgt_ps(sv, DMO(dpc,q)));
+	      DMO(dpc,q) = sv;
+	      dcv        = _mm_mul_ps(dcv, *tp);   tp++;
+	    }
+	  if (! _mm_movemask_ps(cv)) break;
+	}
+    }
+
+  for (q = 0; q < Q; q++) xEv = _mm_add_ps(DMO(dpc,q), xEv);
+  xEv = _mm_add_ps(xEv, _mm_shuffle_ps(xEv, xEv, _MM_SHUFFLE(0, 3, 2, 1)));
+  xEv = _mm_add_ps(xEv, _mm_shuffle_ps(xEv, xEv, _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_store_ss(&xE, xEv);
+  return xE;
+}
+
+
+/* rescale_row()
+ *
+ * Multiply the MDI cells of row <dpc> by 1/<scale>.
+ */
+static void
+rescale_row(__m128 *dpc, int Q, float scale)
+{
+  __m128 sv = _mm_set1_ps(1.0 / scale);
+  int    q;
+
+  for (q = 0; q < Q; q++)
+    {
+      MMO(dpc,q) = _mm_mul_ps(MMO(dpc,q), sv);
+      DMO(dpc,q) = _mm_mul_ps(DMO(dpc,q), sv);
+      IMO(dpc,q) = _mm_mul_ps(IMO(dpc,q), sv);
+    }
+}
+
+
+/* recompute_row()
+ *
+ * Recompute Forward row <i> of a checkpointed segment into <dpc>,
+ * from row i-1 in <dpp>, using the B(i-1) and scale factor that
+ * p7_ForwardCheckpointed() kept.
+ */
+static void
+recompute_row(const ESL_DSQ *dsq, const P7_OPROFILE *om, const P7_OMXCHK *oxc, const __m128 *dpp, __m128 *dpc, int i)
+{
+  forward_row(dsq, om, dpp, dpc, i, oxc->xmx[(i-1)*p7X_NXCELLS+p7X_B]);
+  if (oxc->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
+    rescale_row(dpc, p7O_NQF(om->M), oxc->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+}
+
+
+/* backward_row_L()
+ *
+ * Initialize Backward row L in <dpc>, and the specials in <xs>.
+ */
+static void
+backward_row_L(const P7_OPROFILE *om, __m128 *dpc, float *xs)
+{
+  register __m128 dpv, dcv, xEv;
+  __m128  zerov = _mm_setzero_ps();
+  __m128 *tp;
+  int     Q     = p7O_NQF(om->M);
+  int     q, j;
+
+  xs[p7X_J] = 0.0;
+  xs[p7X_B] = 0.0;
+  xs[p7X_N] = 0.0;
+  xs[p7X_C] = om->xf[p7O_C][p7O_MOVE];               /* C<-T */
+  xs[p7X_E] = xs[p7X_C] * om->xf[p7O_E][p7O_MOVE];   /* E<-C, no tail */
+  xEv       = _mm_set1_ps(xs[p7X_E]);
+  dcv       = zerov;
+  for (q = 0; q < Q; q++) MMO(dpc,q) = DMO(dpc,q) = xEv;
+  for (q = 0; q < Q; q++) IMO(dpc,q) = zerov;
+
+  /* DD paths: first segment includes xE, from DMO(q); then three more passes */
+  tp  = om->tfv + 8*Q - 1;
+  dpv = _mm_move_ss(DMO(dpc,Q-1), zerov);
+  dpv = _mm_shuffle_ps(dpv, dpv, _MM_SHUFFLE(0,3,2,1));
+  for (q = Q-1; q >= 0; q--)
+    {
+      dcv        = _mm_mul_ps(dpv, *tp);      tp--;
+      DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+      dpv        = DMO(dpc,q);
+    }
+  for (j = 1; j < 4; j++)
+    {
+      tp  = om->tfv + 8*Q - 1;
+      dcv = _mm_move_ss(dcv, zerov);
+      dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1));
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv        = _mm_mul_ps(dcv, *tp); tp--;
+	  DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	}
+    }
+
+  /* M->D */
+  tp  = om->tfv + 7*Q - 3;
+  dcv = _mm_move_ss(DMO(dpc,0), zerov);
+  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1));
+  for (q = Q-1; q >= 0; q--)
+    {
+      MMO(dpc,q) = _mm_add_ps(MMO(dpc,q), _mm_mul_ps(dcv, *tp)); tp -= 7;
+      dcv        = DMO(dpc,q);
+    }
+}
+
+
+/* backward_xB()
+ *
+ * Return B(i), collected from the M(i+1,k) cells of Backward row i+1
+ * in <dpp>. Used for the i=0 termination.
+ */
+static float
+backward_xB(const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, int i)
+{
+  register __m128 mpv, xBv;
+  __m128 *tp = om->tfv;
+  __m128 *rp = om->rfv[dsq[i+1]];
+  float   xB;
+  int     Q  = p7O_NQF(om->M);
+  int     q;
+
+  xBv = _mm_setzero_ps();
+  for (q = 0; q < Q; q++)
+    {
+      mpv = _mm_mul_ps(MMO(dpp,q), *rp);  rp++;
+      mpv = _mm_mul_ps(mpv,        *tp);  tp += 7;
+      xBv = _mm_add_ps(xBv,        mpv);
+    }
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(0, 3, 2, 1)));
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_store_ss(&xB, xBv);
+  return xB;
+}
+
+
+/* backward_row()
+ *
+ * Compute Backward row <i> in <dpc> from row i+1 in <dpp>, updating
+ * the specials <xs> from row i+1's to row i's. Phases 1-5 of
+ * p7_Backward()'s row calculation; rescaling is left to the caller.
+ */
+static void
+backward_row(const ESL_DSQ *dsq, const P7_OPROFILE *om, const __m128 *dpp, __m128 *dpc, int i, float *xs)
+{
+  register __m128 mpv, ipv, dpv;
+  register __m128 mcv, dcv;
+  register __m128 tmmv, timv, tdmv;
+  register __m128 xBv, xEv;
+  __m128  zerov = _mm_setzero_ps();
+  __m128 *rp;
+  __m128 *tp;
+  int     Q     = p7O_NQF(om->M);
+  int     q, j;
+
+  /* phase 1. B(i) collected; complete I(i,k), partial {MD}(i,k) */
+  rp  = om->rfv[dsq[i+1]] + Q-1;
+  tp  = om->tfv + 7*Q - 1;
+
+  tmmv = _mm_move_ss(om->tfv[1], zerov); tmmv = _mm_shuffle_ps(tmmv, tmmv, _MM_SHUFFLE(0,3,2,1));
+  timv = _mm_move_ss(om->tfv[2], zerov); timv = _mm_shuffle_ps(timv, timv, _MM_SHUFFLE(0,3,2,1));
+  tdmv = _mm_move_ss(om->tfv[3], zerov); tdmv = _mm_shuffle_ps(tdmv, tdmv, _MM_SHUFFLE(0,3,2,1));
+
+  mpv = _mm_mul_ps(MMO(dpp,0), om->rfv[dsq[i+1]][0]);
+  mpv = _mm_move_ss(mpv, zerov);
+  mpv = _mm_shuffle_ps(mpv, mpv, _MM_SHUFFLE(0,3,2,1));
+
+  xBv = zerov;
+  for (q = Q-1; q >= 0; q--)
+    {
+      ipv = IMO(dpp,q);
+      IMO(dpc,q) = _mm_add_ps(_mm_mul_ps(ipv, *tp), _mm_mul_ps(mpv, timv));   tp--;
+      DMO(dpc,q) =                                  _mm_mul_ps(mpv, tdmv);
+      mcv        = _mm_add_ps(_mm_mul_ps(ipv, *tp), _mm_mul_ps(mpv, tmmv));   tp-= 2;
+
+      mpv        = _mm_mul_ps(MMO(dpp,q), *rp);  rp--;
+      MMO(dpc,q) = mcv;
+
+      tdmv = *tp;   tp--;
+      timv = *tp;   tp--;
+      tmmv = *tp;   tp--;
+
+      xBv = _mm_add_ps(xBv, _mm_mul_ps(mpv, *tp)); tp--;
+    }
+
+  /* phase 2: the specials */
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(0, 3, 2, 1)));
+  xBv = _mm_add_ps(xBv, _mm_shuffle_ps(xBv, xBv, _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_store_ss(&(xs[p7X_B]), xBv);
+
+  xs[p7X_C] =  xs[p7X_C] * om->xf[p7O_C][p7O_LOOP];
+  xs[p7X_J] = (xs[p7X_B] * om->xf[p7O_J][p7O_MOVE]) + (xs[p7X_J] * om->xf[p7O_J][p7O_LOOP]);
+  xs[p7X_N] = (xs[p7X_B] * om->xf[p7O_N][p7O_MOVE]) + (xs[p7X_N] * om->xf[p7O_N][p7O_LOOP]);
+  xs[p7X_E] = (xs[p7X_C] * om->xf[p7O_E][p7O_MOVE]) + (xs[p7X_J] * om->xf[p7O_E][p7O_LOOP]);
+  xEv = _mm_set1_ps(xs[p7X_E]);
+
+  /* phase 3: {MD}->E paths and one step of the D->D paths */
+  tp  = om->tfv + 8*Q - 1;
+  dpv = _mm_add_ps(DMO(dpc,0), xEv);
+  dpv = _mm_move_ss(dpv, zerov);
+  dpv = _mm_shuffle_ps(dpv, dpv, _MM_SHUFFLE(0,3,2,1));
+  for (q = Q-1; q >= 0; q--)
+    {
+      dcv        = _mm_mul_ps(dpv, *tp); tp--;
+      DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), _mm_add_ps(dcv, xEv));
+      dpv        = DMO(dpc,q);
+      MMO(dpc,q) = _mm_add_ps(MMO(dpc,q), xEv);
+    }
+
+  /* phase 4: finish extending the DD paths */
+  for (j = 1; j < 4; j++)
+    {
+      dcv = _mm_move_ss(dcv, zerov);
+      dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1));
+      tp  = om->tfv + 8*Q - 1;
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv        = _mm_mul_ps(dcv, *tp); tp--;
+	  DMO(dpc,q) = _mm_add_ps(DMO(dpc,q), dcv);
+	}
+    }
+
+  /* phase 5: add M->D paths */
+  dcv = _mm_move_ss(DMO(dpc,0), zerov);
+  dcv = _mm_shuffle_ps(dcv, dcv, _MM_SHUFFLE(0,3,2,1));
+  tp  = om->tfv + 7*Q - 3;
+  for (q = Q-1; q >= 0; q--)
+    {
+      MMO(dpc,q) = _mm_add_ps(MMO(dpc,q), _mm_mul_ps(dcv, *tp)); tp -= 7;
+      dcv        = DMO(dpc,q);
+    }
+}
+
+
+/* backward_rescale()
+ *
+ * Rescale Backward row <i> (in <dpc>, specials in <xs>) by Forward's
+ * scale factor for row i, accumulating its log in <*totscale>. Return
+ * <eslERANGE> if Backward has overflowed Forward's scale factors; the
+ * same test p7_Backward() uses to switch to its own.
+ */
+static int
+backward_rescale(const P7_OPROFILE *om, const P7_OMXCHK *oxc, __m128 *dpc, int i, float *xs, float *totscale)
+{
+  float scale = oxc->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+  if (xs[p7X_B] > 1.0e16) return eslERANGE;
+  if (scale > 1.0)
+    {
+      xs[p7X_E] /= scale;
+      xs[p7X_N] /= scale;
+      xs[p7X_J] /= scale;
+      xs[p7X_B] /= scale;
+      xs[p7X_C] /= scale;
+      rescale_row(dpc, p7O_NQF(om->M), scale);
+      *totscale += log(scale);
+    }
+  return eslOK;
+}
+
+
+/* decode_row()
+ *
+ * Posterior-decode row <i>, given Forward row <fwd> and Backward row
+ * <bck> and specials <xs>, and add its band to <bnd> if it has one;
+ * see p7_Decoding() for the scaling arithmetic. <scaleproduct> is 1
+ * over the scaled Forward total. Rows go in backwards, with
+ * p7_gbands_Prepend().
+ */
+static int
+decode_row(const P7_OPROFILE *om, const P7_OMXCHK *oxc, const __m128 *fwd, const __m128 *bck, int i,
+	   const float *xs, float scaleproduct, P7_GBANDS *bnd)
+{
+  const float *xf    = oxc->xmx + (i-1)*p7X_NXCELLS;
+  __m128       totrv = _mm_set1_ps(scaleproduct * oxc->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+  __m128       minv  = _mm_set1_ps(0.02);
+  __m128       pv;
+  float        njc;
+  int          Q     = p7O_NQF(om->M);
+  int          ka    = om->M+1;
+  int          kb    = 0;
+  int          q, z, k, mask;
+
+  njc  = xf[p7X_N] * xs[p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+  njc += xf[p7X_J] * xs[p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+  njc += xf[p7X_C] * xs[p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+  if (njc >= 0.9) return eslOK;
+
+  for (q = 0; q < Q; q++)
+    {
+      pv   = _mm_add_ps(_mm_mul_ps(MMO(fwd,q), MMO(bck,q)), _mm_mul_ps(IMO(fwd,q), IMO(bck,q)));
+      pv   = _mm_mul_ps(pv, totrv);
+      if (! (mask = _mm_movemask_ps(_mm_cmpge_ps(pv, minv)))) continue;
+      for (z = 0; z < 4; z++)	/* striped: vector q, element z is k = zQ+q+1 */
+	if (mask & (1<<z))
+	  {
+	    k = z*Q+q+1;
+	    if (k > om->M) break;
+	    ka = ESL_MIN(ka, k);
+	    kb = ESL_MAX(kb, k);
+	  }
+    }
+  if (kb == 0) return eslOK;
+
+  return p7_gbands_Prepend(bnd, i, ka, kb);
+}
+
+
+/* The row layout, as in p7_gmxchk.c: see there for the derivations. */
+static int
+set_row_layout(P7_OMXCHK *oxc, int allocL, int maxR)
+{
+  double Rbc      = minimum_rows(allocL);
+  int    minR_chk = oxc->R0 + (int) ceil(Rbc);
+  int    minR_all = oxc->R0 + allocL;
+
+  if      (minR_all <= maxR) set_full        (oxc, allocL);
+  else if (minR_chk <= maxR) set_checkpointed(oxc, allocL, maxR);
+  else                       set_redlined    (oxc, allocL, Rbc);
+  return eslOK;
+}
+
+static void
+set_full(P7_OMXCHK *oxc, int L)
+{
+  oxc->Ra     = L;
+  oxc->Rb     = 0;
+  oxc->Rc     = 0;
+  oxc->La     = L;
+  oxc->Lb     = 0;
+  oxc->Lc     = 0;
+}
+
+static void
+set_checkpointed(P7_OMXCHK *oxc, int L, int R)
+{
+  double Rbc = checkpointed_rows(L, R-oxc->R0);
+  double Rc  = floor(Rbc);
+
+  oxc->Rc     = (int) Rc;
+  oxc->Rb     = (Rbc > Rc ? 1 : 0);
+  oxc->Ra     = R - oxc->Rb - oxc->Rc - oxc->R0;
+  oxc->Lc     = ((oxc->Rc + 2) * (oxc->Rc + 1)) / 2 - 1;
+  oxc->La     = oxc->Ra;
+  oxc->Lb     = L - oxc->La - oxc->Lc;
+}
+
+static void
+set_redlined(P7_OMXCHK *oxc, int L, double minR)
+{
+  double Rc = floor(minR);
+
+  oxc->Rc     = (int) Rc;
+  oxc->Rb     = (minR > Rc ? 1 : 0);
+  oxc->Ra     = 0;
+  oxc->Lc     = ((oxc->Rc + 2) * (oxc->Rc + 1)) / 2 - 1;
+  oxc->La     = 0;
+  oxc->Lb     = L - oxc->La - oxc->Lc;
+}
+
+static double
+minimum_rows(int L)
+{
+  return (sqrt(9. + 8. * (double) L) - 3.) / 2.;
+}
+
+static double
+checkpointed_rows(int L, int R)
+{
+  return (sqrt(1. + 8. * (double) (L - R)) - 1.) / 2.;
+}
+/*----------------- end, internals ------------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Benchmark driver.
+ *****************************************************************/
+#ifdef p7FWDBACK_CHK_BENCHMARK
+/*
+   gcc -O3 -msse2 -std=gnu99 -o fwdback_chk_benchmark -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_CHK_BENCHMARK fwdback_chk.c -lhmmer -leasel -lm
+   ./fwdback_chk_benchmark <hmmfile>          checkpointed Forward/Backward, with bands
+   ./fwdback_chk_benchmark -f <hmmfile>       full-matrix Forward/Backward/Decoding, for comparison
+   ./fwdback_chk_benchmark -R 1 <hmmfile>     force full checkpointing with a small memory limit
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+#include "p7_gbands.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-f",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "benchmark full-matrix p7_Forward/Backward/Decoding", 0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,   "2000", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,   "2000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  { "-R",        eslARG_INT,    "128", NULL, "n>0", NULL,  NULL, "-f", "memory limit for checkpointed matrix, in MB",      0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for checkpointed SSE Forward/Backward";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *fwd     = NULL;
+  P7_OMX         *bck     = NULL;
+  P7_OMXCHK      *oxc     = NULL;
+  P7_GBANDS      *bnd     = p7_gbands_Create();
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           fsc, bsc;
+  double          base_time, bench_time, Mcs;
+  size_t          nbytes;
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  if (esl_opt_GetBoolean(go, "-f"))
+    {
+      fwd    = p7_omx_Create(gm->M, L, L);
+      bck    = p7_omx_Create(gm->M, L, L);
+      nbytes = 2 * (size_t) (L+1) * p7O_NQF(gm->M) * p7X_NSCELLS * sizeof(__m128);
+    }
+  else
+    {
+      oxc    = p7_omxchk_Create(gm->M, L, ESL_MBYTES(esl_opt_GetInteger(go, "-R")));
+      nbytes = p7_omxchk_Sizeof(oxc);
+    }
+
+  /* Baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++) esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      if (esl_opt_GetBoolean(go, "-f"))
+	{
+	  p7_Forward (dsq, L, om,      fwd, &fsc);
+	  p7_Backward(dsq, L, om, fwd, bck, &bsc);
+	  p7_Decoding(om, fwd, bck, bck);
+	}
+      else
+	{
+	  p7_omxchk_GrowTo(oxc, om->M, L);
+	  p7_gbands_Reuse(bnd);
+	  p7_ForwardCheckpointed (dsq, L, om, oxc,      &fsc);
+	  p7_BackwardCheckpointed(dsq, L, om, oxc, bnd, &bsc);
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+  printf("# DP memory: %.2f MB\n", (double) nbytes / 1048576.);
+  if (oxc) printf("# rows: Ra=%d Rb=%d Rc=%d\n", oxc->Ra, oxc->Rb, oxc->Rc);
+
+  free(dsq);
+  p7_gbands_Destroy(bnd);
+  p7_omxchk_Destroy(oxc);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7FWDBACK_CHK_BENCHMARK*/
+/*------------------- end, benchmark driver ---------------------*/
+
+
+
+
+/*****************************************************************
+ * 6. Unit tests.
+ *****************************************************************/
+#ifdef p7FWDBACK_CHK_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* Bands, the slow way: decode the full matrices <fwd>, <bck> from
+ * p7_Forward(), p7_Backward() with the same arithmetic and thresholds
+ * as decode_row().
+ */
+static void
+full_bands(const P7_OPROFILE *om, const P7_OMX *fwd, const P7_OMX *bck, int L, P7_GBANDS *bnd)
+{
+  float scaleproduct = 1.0 / (fwd->xmx[L*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_MOVE]);
+  float totr, njc, pp;
+  int   i, k, ka, kb;
+
+  p7_gbands_Reuse(bnd);
+  for (i = L; i >= 1; i--)
+    {
+      njc  = fwd->xmx[(i-1)*p7X_NXCELLS+p7X_N] * bck->xmx[i*p7X_NXCELLS+p7X_N] * om->xf[p7O_N][p7O_LOOP] * scaleproduct;
+      njc += fwd->xmx[(i-1)*p7X_NXCELLS+p7X_J] * bck->xmx[i*p7X_NXCELLS+p7X_J] * om->xf[p7O_J][p7O_LOOP] * scaleproduct;
+      njc += fwd->xmx[(i-1)*p7X_NXCELLS+p7X_C] * bck->xmx[i*p7X_NXCELLS+p7X_C] * om->xf[p7O_C][p7O_LOOP] * scaleproduct;
+      if (njc >= 0.9) continue;
+
+      totr = scaleproduct * fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+      ka   = om->M+1;
+      kb   = 0;
+      for (k = 1; k <= om->M; k++)
+	{
+	  pp = (p7_omx_FGetMDI(fwd, p7X_M, i, k) * p7_omx_FGetMDI(bck, p7X_M, i, k) +
+		p7_omx_FGetMDI(fwd, p7X_I, i, k) * p7_omx_FGetMDI(bck, p7X_I, i, k)) * totr;
+	  if (pp >= 0.02) { ka = ESL_MIN(ka, k); kb = k; }
+	}
+      if (kb) p7_gbands_Prepend(bnd, i, ka, kb);
+    }
+  bnd->L = L;
+  bnd->M = om->M;
+  p7_gbands_Reverse(bnd);
+}
+
+/* Compare the checkpointed Forward/Backward to the full-matrix
+ * p7_Forward()/p7_Backward(): scores must agree, and the bands must be
+ * identical to those decoded from the full matrices. <ramlimit>
+ * chooses the layout: a small one forces checkpointing (or redlining),
+ * a large one a full matrix. The same <oxc> is reused across targets
+ * of varying length, to exercise p7_omxchk_GrowTo().
+ */
+static void
+utest_fwdback_chk(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, int64_t ramlimit)
+{
+  char        *msg = "checkpointed forward/backward unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd = p7_omx_Create(M, L, L);
+  P7_OMX      *bck = p7_omx_Create(M, L, L);
+  P7_OMXCHK   *oxc = p7_omxchk_Create(M, L/2, ramlimit);
+  P7_GBANDS   *bnd = p7_gbands_Create();
+  P7_GBANDS   *ref = p7_gbands_Create();
+  float        fsc1, fsc2;
+  float        bsc1, bsc2;
+  int          tL;
+  int          g, n;
+
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  while (N--)
+    {
+      tL = 1 + esl_rnd_Roll(r, L);
+      esl_rsq_xfIID(r, bg->f, abc->K, tL, dsq);
+      p7_oprofile_ReconfigLength(om, tL);
+
+      if (p7_Forward (dsq, tL, om,      fwd, &fsc1) != eslOK) esl_fatal(msg);
+      if (p7_Backward(dsq, tL, om, fwd, bck, &bsc1) != eslOK) esl_fatal(msg);
+      full_bands(om, fwd, bck, tL, ref);
+
+      if (p7_omxchk_GrowTo(oxc, M, tL)                         != eslOK) esl_fatal(msg);
+      if (oxc->La + oxc->Lb + oxc->Lc != tL)                             esl_fatal(msg);
+      if (p7_ForwardCheckpointed (dsq, tL, om, oxc,      &fsc2) != eslOK) esl_fatal(msg);
+      if (p7_gbands_Reuse(bnd)                                  != eslOK) esl_fatal(msg);
+      if (p7_BackwardCheckpointed(dsq, tL, om, oxc, bnd, &bsc2) != eslOK) esl_fatal(msg);
+
+      if (fabs(fsc1-fsc2) > 0.0001)  esl_fatal(msg);
+      if (fabs(bsc1-bsc2) > 0.0001)  esl_fatal(msg);
+      if (fabs(fsc2-bsc2) > 0.0001)  esl_fatal(msg);
+      if (oxc->R != 0)               esl_fatal(msg); /* every saved row popped */
+
+      if (bnd->L != ref->L || bnd->M != ref->M)           esl_fatal(msg);
+      if (bnd->nseg != ref->nseg || bnd->nrow != ref->nrow) esl_fatal(msg);
+      for (g = 0; g < bnd->nseg*2; g++)
+	if (bnd->imem[g] != ref->imem[g]) esl_fatal(msg);
+      for (n = 0; n < bnd->nrow*p7_GBANDS_NK; n++)
+	if (bnd->kmem[n] != ref->kmem[n]) esl_fatal(msg);
+    }
+
+  free(dsq);
+  p7_gbands_Destroy(ref);
+  p7_gbands_Destroy(bnd);
+  p7_omxchk_Destroy(oxc);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_hmm_Destroy(hmm);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7FWDBACK_CHK_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 7. Test driver.
+ *****************************************************************/
+#ifdef p7FWDBACK_CHK_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -std=gnu99 -o fwdback_chk_utest -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_CHK_TESTDRIVE fwdback_chk.c -lhmmer -leasel -lm
+   ./fwdback_chk_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "maximum length of random sequences to sample",   0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for checkpointed SSE Forward/Backward";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* The comparison is to p7_Forward()/p7_Backward()'s SSE engines,
+   * operation for operation, so don't let them dispatch to wider ones.
+   */
+  p7_simd_Set(p7_SIMD_SSE);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  utest_fwdback_chk(r, abc, bg, M, L, N, ESL_MBYTES(128)); /* full matrix                    */
+  utest_fwdback_chk(r, abc, bg, M, L, N, 16 * 1024);       /* checkpointed                   */
+  utest_fwdback_chk(r, abc, bg, M, L, N, 0);               /* redlined: all checkpointed     */
+  utest_fwdback_chk(r, abc, bg, 1, L, 10, 0);              /* size 1 models                  */
+  utest_fwdback_chk(r, abc, bg, M, 1, 10, 0);              /* size 1 sequences               */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  utest_fwdback_chk(r, abc, bg, M, L, N, 16 * 1024);
+  utest_fwdback_chk(r, abc, bg, M, L, N, 0);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7FWDBACK_CHK_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
@@ -0,0 +1,762 @@
+/* Forward/Backward parsers; AVX2 and AVX-512 versions.
+ * 
+ * The linear-memory ForwardParser/BackwardParser of fwdback.c,
+ * striped across p7W_NF (8 or 16) float lanes instead of 4, and
+ * compiled once per instruction set, into p7_ForwardParser_avx() and
+ * p7_ForwardParser_avx512() and so on; see impl_avx.h. These are the
+ * versions the acceleration pipeline runs on every sequence that
+ * passes the Viterbi filter; the full-matrix p7_Forward() and
+ * p7_Backward() used for domain postprocessing stay SSE only.
+ *
+ * Scores are read from om->rfv_avx[] and om->tfv_avx (or their _avx512
+ * versions), which p7_oprofile_RestripeRest() keeps in sync with the
+ * SSE om->rfv[] and om->tfv. The one DP row lives in the wide row <ox->wrow>; the
+ * special states and scale factors are stored in <ox->xmx> exactly as
+ * the SSE parsers store them, so posterior decoding of the specials
+ * can't tell the difference.
+ * 
+ * Contents:
+ *   1. Forward/Backward parser implementations.
+ *   2. Benchmark driver.
+ *   3. Unit tests.
+ *   4. Test driver.
+ */
+#include <p7_config.h>
+#include "impl_avx.h"
+#ifdef p7_WIDE_ENABLED
+
+#include <stdio.h>
+#include <math.h>
+
+#include <immintrin.h>
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+/*****************************************************************
+ * 1. Forward/Backward parser implementations.
+ *****************************************************************/
+
+/* Function:  p7_ForwardParser_avx(), p7_ForwardParser_avx512()
+ * Synopsis:  The Forward algorithm, linear memory parsing version; wide vectors.
+ *
+ * Purpose:   Same as <p7_ForwardParser()>, using AVX2 or AVX-512 vectors. The
+ *            caller provides a "parsing" <fwd> matrix, as from
+ *            <p7_omx_Create(M, 0, L)>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            fwd     - RETURN: filled special-state rows of the Forward matrix
+ *            opt_sc  - optRETURN: Forward score (in nats)          
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <fwd> allocation is too small.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int
+p7W_NAME(p7_ForwardParser)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *opt_sc)
+{
+  register p7W_vecf mpv, dpv, ipv;   /* previous row values                                       */
+  register p7W_vecf sv;		   /* temp storage of 1 curr row value in progress              */
+  register p7W_vecf dcv;		   /* delayed storage of D(i,q+1)                               */
+  register p7W_vecf xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register p7W_vecf xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  p7W_vecf   zerov;		   /* splatted 0.0's in a vector                                */
+  float    xN, xE, xB, xC, xJ;	   /* special states' scores                                    */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int j;			   /* counter over DD iterations (p7W_NF is full serialization) */
+  int Q       = p7W_NQF(om->M);   /* segment length: # of vectors                              */
+  p7W_vecf *dp    = (p7W_vecf *) ox->wrow; /* the one row, updated in place, for {MDI}MO(dp,q) macros */
+  p7W_vecf *rp;			   /* will point at om->p7W_NAME(rfv)[x] for residue x[i]          */
+  p7W_vecf *tp;			   /* will point into (and step thru) om->p7W_NAME(tfv)            */
+
+  if (om->M > ox->allocWM)         ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+  if (L     >= ox->allocXR)        ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+#if eslDEBUGLEVEL > 0		
+  if (! p7_oprofile_IsLocal(om))   ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  /* Initialization. */
+  ox->M  = om->M;
+  ox->L  = L;
+  ox->has_own_scales = TRUE; 	/* all forward matrices control their own scalefactors */
+  zerov  = p7W(setzero_ps)();
+  for (q = 0; q < Q; q++)
+    MMO(dp,q) = IMO(dp,q) = DMO(dp,q) = zerov;
+  xE    = ox->xmx[p7X_E] = 0.;
+  xN    = ox->xmx[p7X_N] = 1.;
+  xJ    = ox->xmx[p7X_J] = 0.;
+  xB    = ox->xmx[p7X_B] = om->xf[p7O_N][p7O_MOVE];
+  xC    = ox->xmx[p7X_C] = 0.;
+
+  ox->xmx[p7X_SCALE] = 1.0;
+  ox->totscale       = 0.0;
+
+  for (i = 1; i <= L; i++)
+    {
+      rp    = om->p7W_NAME(rfv)[dsq[i]];
+      tp    = om->p7W_NAME(tfv);
+      dcv   = p7W(setzero_ps)();
+      xEv   = p7W(setzero_ps)();
+      xBv   = p7W(set1_ps)(xB);
+
+      /* Right shifts by one element, across lanes. Shift zeros on. */
+      mpv   = p7W_rightshiftz_ps(MMO(dp,Q-1));
+      dpv   = p7W_rightshiftz_ps(DMO(dp,Q-1));
+      ipv   = p7W_rightshiftz_ps(IMO(dp,Q-1));
+      
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMO(i,q); don't store it yet, hold it in sv. */
+	  sv   =                   p7W(mul_ps)(xBv, *tp);  tp++;
+	  sv   = p7W(add_ps)(sv, p7W(mul_ps)(mpv, *tp)); tp++;
+	  sv   = p7W(add_ps)(sv, p7W(mul_ps)(ipv, *tp)); tp++;
+	  sv   = p7W(add_ps)(sv, p7W(mul_ps)(dpv, *tp)); tp++;
+	  sv   = p7W(mul_ps)(sv, *rp);                     rp++;
+	  xEv  = p7W(add_ps)(xEv, sv);
+	  
+	  /* Load {MDI}(i-1,q) into mpv, dpv, ipv;
+	   * {MDI}MX(q) is then the current, not the prev row
+	   */
+	  mpv = MMO(dp,q);
+	  dpv = DMO(dp,q);
+	  ipv = IMO(dp,q);
+
+	  /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+	  MMO(dp,q) = sv;
+	  DMO(dp,q) = dcv;
+
+	  /* Calculate the next D(i,q+1) partially: M->D only;
+	   * delay storage, holding it in dcv
+	   */
+	  dcv   = p7W(mul_ps)(sv, *tp); tp++;
+
+	  /* Calculate and store I(i,q); assumes odds ratio for emission is 1.0 */
+	  sv        =                   p7W(mul_ps)(mpv, *tp);  tp++;
+	  IMO(dp,q) = p7W(add_ps)(sv, p7W(mul_ps)(ipv, *tp)); tp++;
+	}	  
+
+      /* Now the DD paths; first pass adds M->D and D->D paths into DMO. */
+      dcv       = p7W_rightshiftz_ps(dcv);
+      DMO(dp,0) = zerov;
+      tp        = om->p7W_NAME(tfv) + 7*Q;	/* set tp to start of the DD's */
+      for (q = 0; q < Q; q++) 
+	{
+	  DMO(dp,q) = p7W(add_ps)(dcv, DMO(dp,q));	
+	  dcv       = p7W(mul_ps)(DMO(dp,q), *tp); tp++; /* extend DMO(q), so we include M->D and D->D paths */
+	}
+
+      /* As in fwdback.c: serialize fully on small models, otherwise
+       * stop as soon as a pass leaves every DMO(q) unchanged. With
+       * p7W_NF lanes a full serialization is p7W_NF-1 more passes, not 3,
+       * so the early exit pays off more often here.
+       */
+      if (om->M < 100)
+	{			/* Fully serialized version */
+	  for (j = 1; j < p7W_NF; j++)
+	    {
+	      dcv = p7W_rightshiftz_ps(dcv);
+	      tp  = om->p7W_NAME(tfv) + 7*Q;	/* set tp to start of the DD's */
+	      for (q = 0; q < Q; q++) 
+		{ /* note, extend dcv, not DMO(q); only adding DD paths now */
+		  DMO(dp,q) = p7W(add_ps)(dcv, DMO(dp,q));	
+		  dcv       = p7W(mul_ps)(dcv, *tp);   tp++; 
+		}	    
+	    }
+	} 
+      else
+	{			/* Slightly parallelized version, but which incurs some overhead */
+	  for (j = 1; j < p7W_NF; j++)
+	    {
+	      int changed = FALSE;	/* keeps track of whether any DD's change DMO(q) */
+
+	      dcv = p7W_rightshiftz_ps(dcv);
+	      tp  = om->p7W_NAME(tfv) + 7*Q;	/* set tp to start of the DD's */
+	      for (q = 0; q < Q; q++) 
+		{ 
+		  sv         = p7W(add_ps)(dcv, DMO(dp,q));	
+		  changed   |= p7W_any_gt_ps(sv, DMO(dp,q)); 
+		  DMO(dp,q)  = sv;	                               /* store new DMO(q) */
+		  dcv        = p7W(mul_ps)(dcv, *tp);   tp++;       /* note, extend dcv, not DMO(q) */
+		}	    
+	      if (! changed) break; /* DD's didn't change any DMO(q)? Then done, break out. */
+	    }
+	}
+
+      /* Add D's to xEv */
+      for (q = 0; q < Q; q++) xEv = p7W(add_ps)(DMO(dp,q), xEv);
+
+      /* Finally the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = p7W_hsum_ps(xEv);
+
+      xN =  xN * om->xf[p7O_N][p7O_LOOP];
+      xC = (xC * om->xf[p7O_C][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_MOVE]);
+      xJ = (xJ * om->xf[p7O_J][p7O_LOOP]) +  (xE * om->xf[p7O_E][p7O_LOOP]);
+      xB = (xJ * om->xf[p7O_J][p7O_MOVE]) +  (xN * om->xf[p7O_N][p7O_MOVE]);
+      /* and now xB will carry over into next i, and xC carries over after i=L */
+
+      /* Sparse rescaling. xE above threshold? trigger a rescaling event.            */
+      if (xE > 1.0e4)	/* that's a little less than e^10, ~10% of our dynamic range */
+	{
+	  xN  = xN / xE;
+	  xC  = xC / xE;
+	  xJ  = xJ / xE;
+	  xB  = xB / xE;
+	  xEv = p7W(set1_ps)(1.0 / xE);
+	  for (q = 0; q < Q; q++)
+	    {
+	      MMO(dp,q) = p7W(mul_ps)(MMO(dp,q), xEv);
+	      DMO(dp,q) = p7W(mul_ps)(DMO(dp,q), xEv);
+	      IMO(dp,q) = p7W(mul_ps)(IMO(dp,q), xEv);
+	    }
+	  ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = xE;
+	  ox->totscale += log(xE);
+	  xE = 1.0;		
+	}
+      else ox->xmx[i*p7X_NXCELLS+p7X_SCALE] = 1.0;
+
+      ox->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      ox->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      ox->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      ox->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      ox->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T, and flip total score back to log space (nats) */
+  if       (isnan(xC))        ESL_EXCEPTION(eslERANGE, "forward score is NaN");
+  else if  (L>0 && xC == 0.0) ESL_EXCEPTION(eslERANGE, "forward score underflow (is 0.0)");     /* if L==0, xC *should* be 0.0; J5/118 */
+  else if  (isinf(xC) == 1)   ESL_EXCEPTION(eslERANGE, "forward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = ox->totscale + log(xC * om->xf[p7O_C][p7O_MOVE]);
+  return eslOK;
+}
+
+
+
+/* Function:  p7_BackwardParser_avx(), p7_BackwardParser_avx512()
+ * Synopsis:  The Backward algorithm, linear memory parsing version; wide vectors.
+ *
+ * Purpose:   Same as <p7_BackwardParser()>, using AVX2 or AVX-512
+ *            vectors. A filled Forward matrix <fwd> supplies the
+ *            sparse scaling factors; it may come from the SSE or any
+ *            wide Forward parser.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            fwd     - filled Forward DP matrix, for scale factors
+ *            bck     - RETURN: filled special-state rows of the Backward matrix
+ *            opt_sc  - optRETURN: Backward score (in nats)          
+ *
+ * Returns:   <eslOK> on success. 
+ *
+ * Throws:    <eslEINVAL> if <bck> allocation is too small.
+ *            <eslERANGE> if the score exceeds the limited range of
+ *            a probability-space odds ratio.
+ *            In either case, <*opt_sc> is undefined.
+ */
+int 
+p7W_NAME(p7_BackwardParser)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc)
+{
+  register p7W_vecf mpv, ipv, dpv;      /* previous row values                                       */
+  register p7W_vecf mcv, dcv;           /* current row values                                        */
+  register p7W_vecf tmmv, timv, tdmv;   /* tmp vars for accessing rotated transition scores          */
+  register p7W_vecf xBv;		      /* collects B->Mk components of B(i)                         */
+  register p7W_vecf xEv;	              /* splatted E(i)                                             */
+  p7W_vecf   zerov;		      /* splatted 0.0's in a vector                                */
+  float    xN, xE, xB, xC, xJ;	      /* special states' scores                                    */
+  int      i;			      /* counter over sequence positions 0,1..L                    */
+  int      q;			      /* counter over vectors 0..Q-1                               */
+  int      Q       = p7W_NQF(om->M);  /* segment length: # of vectors                          */
+  int      j;			      /* DD segment iteration counter (p7W_NF = full serialization) */
+  p7W_vecf  *dp      = (p7W_vecf *) bck->wrow; /* the one DP row, updated in place                   */
+  p7W_vecf  *rp;			      /* will point into om->p7W_NAME(rfv)[x] for residue x[i+1]      */
+  p7W_vecf  *tp;		              /* will point into (and step thru) om->p7W_NAME(tfv)            */
+
+  if (om->M > bck->allocWM)        ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few columns)");
+  if (L     >= bck->allocXR)       ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small (too few X rows)");
+  if (L     != fwd->L)             ESL_EXCEPTION(eslEINVAL, "fwd matrix size doesn't agree with length L");
+#if eslDEBUGLEVEL > 0		
+  if (! p7_oprofile_IsLocal(om))   ESL_EXCEPTION(eslEINVAL, "Forward implementation makes assumptions that only work for local alignment");
+#endif
+
+  /* initialize the L row. */
+  bck->M = om->M;
+  bck->L = L;
+  bck->has_own_scales = FALSE;	/* backwards scale factors are *usually* given by <fwd> */
+  xJ     = 0.0;
+  xB     = 0.0;
+  xN     = 0.0;
+  xC     = om->xf[p7O_C][p7O_MOVE];      /* C<-T */
+  xE     = xC * om->xf[p7O_E][p7O_MOVE]; /* E<-C, no tail */
+  xEv    = p7W(set1_ps)(xE); 
+  zerov  = p7W(setzero_ps)();  
+  dcv    = zerov;		/* solely to silence a compiler warning */
+  for (q = 0; q < Q; q++) MMO(dp,q) = DMO(dp,q) = xEv;
+  for (q = 0; q < Q; q++) IMO(dp,q) = zerov;
+
+  /* init row L's DD paths, 1) first segment includes xE, from DMO(q) */
+  tp  = om->p7W_NAME(tfv) + 8*Q - 1;	           /* <*tp> now the last TDD vector              */
+  dpv = p7W_leftshiftz_ps(DMO(dp,Q-1));       /* leftshift: [1 5 9 13] -> [5 9 13 x]        */
+  for (q = Q-1; q >= 0; q--)
+    {
+      dcv       = p7W(mul_ps)(dpv, *tp);      tp--;
+      DMO(dp,q) = p7W(add_ps)(DMO(dp,q), dcv);
+      dpv       = DMO(dp,q);
+    }
+  /* 2) p7W_NF-1 more passes, only extending DD component (dcv only; no xE contrib from DMO(q)) */
+  for (j = 1; j < p7W_NF; j++)
+    {
+      tp  = om->p7W_NAME(tfv) + 8*Q - 1;
+      dcv = p7W_leftshiftz_ps(dcv);
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv       = p7W(mul_ps)(dcv, *tp); tp--;
+	  DMO(dp,q) = p7W(add_ps)(DMO(dp,q), dcv);
+	}
+    }
+  /* now MD init */
+  tp  = om->p7W_NAME(tfv) + 7*Q - 3;	           /* <*tp> now the last Mk->Dk+1 vector         */
+  dcv = p7W_leftshiftz_ps(DMO(dp,0));
+  for (q = Q-1; q >= 0; q--)
+    {
+      MMO(dp,q) = p7W(add_ps)(MMO(dp,q), p7W(mul_ps)(dcv, *tp)); tp -= 7;
+      dcv       = DMO(dp,q);
+    }
+
+  /* Sparse rescaling: same scale factors as fwd matrix */
+  if (fwd->xmx[L*p7X_NXCELLS+p7X_SCALE] > 1.0)
+    {
+      xE  = xE / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xN  = xN / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xC  = xC / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xJ  = xJ / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xB  = xB / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+      xEv = p7W(set1_ps)(1.0 / fwd->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+      for (q = 0; q < Q; q++) {
+	MMO(dp,q) = p7W(mul_ps)(MMO(dp,q), xEv);
+	DMO(dp,q) = p7W(mul_ps)(DMO(dp,q), xEv);
+	IMO(dp,q) = p7W(mul_ps)(IMO(dp,q), xEv);
+      }
+    }
+  bck->xmx[L*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[L*p7X_NXCELLS+p7X_SCALE];
+  bck->totscale                     = log(bck->xmx[L*p7X_NXCELLS+p7X_SCALE]);
+
+  bck->xmx[L*p7X_NXCELLS+p7X_E] = xE;
+  bck->xmx[L*p7X_NXCELLS+p7X_N] = xN;
+  bck->xmx[L*p7X_NXCELLS+p7X_J] = xJ;
+  bck->xmx[L*p7X_NXCELLS+p7X_B] = xB;
+  bck->xmx[L*p7X_NXCELLS+p7X_C] = xC;
+
+  /* main recursion */
+  for (i = L-1; i >= 1; i--)	/* backwards stride */
+    {
+      /* phase 1. B(i) collected. Old row destroyed, new row contains
+       *    complete I(i,k), partial {MD}(i,k) w/ no {MD}->{DE} paths yet.
+       */
+      rp  = om->p7W_NAME(rfv)[dsq[i+1]] + Q-1; /* <*rp> is now the last match emission vector */
+      tp  = om->p7W_NAME(tfv) + 7*Q - 1;	     /* <*tp> is now the last TII transition vector   */
+
+      /* leftshift the first transition vectors */
+      tmmv = p7W_leftshiftz_ps(om->p7W_NAME(tfv)[1]);
+      timv = p7W_leftshiftz_ps(om->p7W_NAME(tfv)[2]);
+      tdmv = p7W_leftshiftz_ps(om->p7W_NAME(tfv)[3]);
+
+      mpv = p7W(mul_ps)(MMO(dp,0), om->p7W_NAME(rfv)[dsq[i+1]][0]); /* precalc M(i+1,k+1) * e(M_k+1, x_{i+1}) */
+      mpv = p7W_leftshiftz_ps(mpv);
+
+      xBv = zerov;
+      for (q = Q-1; q >= 0; q--)     /* backwards stride */
+	{
+	  ipv = IMO(dp,q); /* assumes emission odds ratio of 1.0; i+1's IMO(q) now free */
+	  IMO(dp,q) = p7W(add_ps)(p7W(mul_ps)(ipv, *tp), p7W(mul_ps)(mpv, timv));   tp--;
+	  DMO(dp,q) =                                     p7W(mul_ps)(mpv, tdmv); 
+	  mcv       = p7W(add_ps)(p7W(mul_ps)(ipv, *tp), p7W(mul_ps)(mpv, tmmv));   tp-= 2;
+	  
+	  mpv       = p7W(mul_ps)(MMO(dp,q), *rp);  rp--;  /* obtain mpv for next q. i+1's MMO(q) is freed  */
+	  MMO(dp,q) = mcv;
+
+	  tdmv = *tp;   tp--;
+	  timv = *tp;   tp--;
+	  tmmv = *tp;   tp--;
+
+	  xBv = p7W(add_ps)(xBv, p7W(mul_ps)(mpv, *tp)); tp--;
+	}
+
+      /* phase 2: now that we have accumulated the B->Mk transitions in xBv, we can do the specials */
+      xB = p7W_hsum_ps(xBv);
+
+      xC =  xC * om->xf[p7O_C][p7O_LOOP];
+      xJ = (xB * om->xf[p7O_J][p7O_MOVE]) + (xJ * om->xf[p7O_J][p7O_LOOP]); /* must come after xB */
+      xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]); /* must come after xB */
+      xE = (xC * om->xf[p7O_E][p7O_MOVE]) + (xJ * om->xf[p7O_E][p7O_LOOP]); /* must come after xJ, xC */
+      xEv = p7W(set1_ps)(xE);	/* splat */
+
+      /* phase 3: {MD}->E paths and one step of the D->D paths */
+      tp  = om->p7W_NAME(tfv) + 8*Q - 1;	/* <*tp> now the last TDD vector */
+      dpv = p7W_leftshiftz_ps(p7W(add_ps)(DMO(dp,0), xEv));
+      for (q = Q-1; q >= 0; q--)
+	{
+	  dcv       = p7W(mul_ps)(dpv, *tp); tp--;
+	  DMO(dp,q) = p7W(add_ps)(DMO(dp,q), p7W(add_ps)(dcv, xEv));
+	  dpv       = DMO(dp,q);
+	  MMO(dp,q) = p7W(add_ps)(MMO(dp,q), xEv);
+	}
+      
+      /* phase 4: finish extending the DD paths; fully serialized */
+      for (j = 1; j < p7W_NF; j++)
+	{
+	  dcv = p7W_leftshiftz_ps(dcv);
+	  tp  = om->p7W_NAME(tfv) + 8*Q - 1;	/* <*tp> now the last TDD vector */
+	  for (q = Q-1; q >= 0; q--)
+	    {
+	      dcv       = p7W(mul_ps)(dcv, *tp); tp--;
+	      DMO(dp,q) = p7W(add_ps)(DMO(dp,q), dcv);
+	    }
+	}
+
+      /* phase 5: add M->D paths */
+      dcv = p7W_leftshiftz_ps(DMO(dp,0));
+      tp  = om->p7W_NAME(tfv) + 7*Q - 3;	/* <*tp> is now the last Mk->Dk+1 vector */
+      for (q = Q-1; q >= 0; q--)
+	{
+	  MMO(dp,q) = p7W(add_ps)(MMO(dp,q), p7W(mul_ps)(dcv, *tp)); tp -= 7;
+	  dcv       = DMO(dp,q);
+	}
+
+      /* Sparse rescaling; see fwdback.c for when we switch to our own scale factors */
+      if (xB > 1.0e16) bck->has_own_scales = TRUE;
+
+      if      (bck->has_own_scales)  bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = (xB > 1.0e4) ? xB : 1.0;
+      else                           bck->xmx[i*p7X_NXCELLS+p7X_SCALE] = fwd->xmx[i*p7X_NXCELLS+p7X_SCALE];
+
+      if (bck->xmx[i*p7X_NXCELLS+p7X_SCALE] > 1.0)
+	{
+	  xE /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xN /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xJ /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xB /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xC /= bck->xmx[i*p7X_NXCELLS+p7X_SCALE];
+	  xBv = p7W(set1_ps)(1.0 / bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	  for (q = 0; q < Q; q++) {
+	    MMO(dp,q) = p7W(mul_ps)(MMO(dp,q), xBv);
+	    DMO(dp,q) = p7W(mul_ps)(DMO(dp,q), xBv);
+	    IMO(dp,q) = p7W(mul_ps)(IMO(dp,q), xBv);
+	  }
+	  bck->totscale += log(bck->xmx[i*p7X_NXCELLS+p7X_SCALE]);
+	}
+
+      bck->xmx[i*p7X_NXCELLS+p7X_E] = xE;
+      bck->xmx[i*p7X_NXCELLS+p7X_N] = xN;
+      bck->xmx[i*p7X_NXCELLS+p7X_J] = xJ;
+      bck->xmx[i*p7X_NXCELLS+p7X_B] = xB;
+      bck->xmx[i*p7X_NXCELLS+p7X_C] = xC;
+    } /* thus ends the loop over sequence positions i */
+
+  /* Termination at i=0, where we can only reach N,B states. */
+  tp  = om->p7W_NAME(tfv);          /* <*tp> is now the first TBMk transition vector  */
+  rp  = om->p7W_NAME(rfv)[dsq[1]];  /* <*rp> is now the first match emission vector   */
+  xBv = zerov;
+  for (q = 0; q < Q; q++)
+    {
+      mpv = p7W(mul_ps)(MMO(dp,q), *rp);  rp++;
+      mpv = p7W(mul_ps)(mpv,       *tp);  tp += 7;
+      xBv = p7W(add_ps)(xBv,       mpv);
+    }
+  xB = p7W_hsum_ps(xBv);
+ 
+  xN = (xB * om->xf[p7O_N][p7O_MOVE]) + (xN * om->xf[p7O_N][p7O_LOOP]);  
+
+  bck->xmx[p7X_B]     = xB;
+  bck->xmx[p7X_C]     = 0.0;
+  bck->xmx[p7X_J]     = 0.0;
+  bck->xmx[p7X_N]     = xN;
+  bck->xmx[p7X_E]     = 0.0;
+  bck->xmx[p7X_SCALE] = 1.0;
+
+  if       (isnan(xN))        ESL_EXCEPTION(eslERANGE, "backward score is NaN");
+  else if  (L>0 && xN == 0.0) ESL_EXCEPTION(eslERANGE, "backward score underflow (is 0.0)");    /* if L==0, xN *should* be 0.0 [J5/118]*/
+  else if  (isinf(xN) == 1)   ESL_EXCEPTION(eslERANGE, "backward score overflow (is infinity)");
+
+  if (opt_sc != NULL) *opt_sc = bck->totscale + log(xN);
+  return eslOK;
+}
+/*-------------- end, forward/backward parsers  -----------------*/
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7FWDBACK_WIDE_BENCHMARK
+/* 
+   gcc -o fwdback_avx_benchmark    -std=gnu99 -g -O3 -Wall -mavx2                 -Dp7_WIDE_AVX    -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_WIDE_BENCHMARK fwdback_wide.c -lhmmer -leasel -lm 
+   gcc -o fwdback_avx512_benchmark -std=gnu99 -g -O3 -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_WIDE_BENCHMARK fwdback_wide.c -lhmmer -leasel -lm 
+
+   ./fwdback_avx_benchmark <hmmfile>           runs benchmark on both Forward and Backward parser
+   ./fwdback_avx_benchmark -s -N100 <hmmfile>  compare scores to SSE parsers
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "compare scores to SSE implementation (debug)",     0 }, 
+  { "-S",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  { "-F",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-B", "only benchmark Forward",                           0 },
+  { "-B",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-F", "only benchmark Backward",                          0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for " p7W_ISA " Forward, Backward parsers";
+
+int 
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-S"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *fwd     = NULL;
+  P7_OMX         *bck     = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           fsc, bsc;
+  float           fsc2, bsc2;
+  double          base_time, bench_time, Mcs;
+
+  if (p7_simd_Set(p7W_SIMD) != eslOK) p7_Fail(p7W_ISA " isn't supported here");
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  fwd = p7_omx_Create(gm->M, 0, L);
+  bck = p7_omx_Create(gm->M, 0, L);
+
+  /* Get a baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++) esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      if (! esl_opt_GetBoolean(go, "-B"))  p7W_NAME(p7_ForwardParser) (dsq, L, om,      fwd, &fsc);
+      if (! esl_opt_GetBoolean(go, "-F"))  p7W_NAME(p7_BackwardParser)(dsq, L, om, fwd, bck, &bsc);
+
+      if (esl_opt_GetBoolean(go, "-s"))
+	{
+	  p7_ForwardParser_sse (dsq, L, om,      fwd, &fsc2); 
+	  p7_BackwardParser_sse(dsq, L, om, fwd, bck, &bsc2); 
+	  printf("%.4f %.4f %.4f %.4f\n", fsc, bsc, fsc2, bsc2);  
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7FWDBACK_WIDE_BENCHMARK*/
+/*------------------- end, benchmark driver ---------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7FWDBACK_WIDE_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* 
+ * Compare to the SSE full Forward/Backward, which the SSE parsers
+ * already agree with. The summation order differs across vector
+ * widths, so scores agree to float roundoff, not exactly.
+ */
+static void
+utest_fwdback(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char        *msg = p7W_ISA " forward/backward unit test failed";
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *fwd = p7_omx_Create(M, 0, L);
+  P7_OMX      *bck = p7_omx_Create(M, 0, L);
+  P7_OMX      *oxf = p7_omx_Create(M, L, L);
+  P7_OMX      *oxb = p7_omx_Create(M, L, L);
+  float fsc1, fsc2;
+  float bsc1, bsc2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      p7_Forward             (dsq, L, om, oxf,      &fsc1);
+      p7_Backward            (dsq, L, om, oxf, oxb, &bsc1);
+      p7W_NAME(p7_ForwardParser) (dsq, L, om, fwd,      &fsc2);
+      p7W_NAME(p7_BackwardParser)(dsq, L, om, fwd, bck, &bsc2);
+
+      if (fabs(fsc2-bsc2) > 0.0001) esl_fatal(msg);
+      if (fabs(fsc1-fsc2) > 0.001)  esl_fatal(msg);
+      if (fabs(bsc1-bsc2) > 0.001)  esl_fatal(msg);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(oxb);
+  p7_omx_Destroy(oxf);
+  p7_omx_Destroy(bck);
+  p7_omx_Destroy(fwd);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7FWDBACK_WIDE_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7FWDBACK_WIDE_TESTDRIVE
+/* 
+   gcc -g -Wall -mavx2                 -Dp7_WIDE_AVX    -std=gnu99 -o fwdback_avx_utest    -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_WIDE_TESTDRIVE fwdback_wide.c -lhmmer -leasel -lm
+   gcc -g -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -std=gnu99 -o fwdback_avx512_utest -I.. -L.. -I../../easel -L../../easel -Dp7FWDBACK_WIDE_TESTDRIVE fwdback_wide.c -lhmmer -leasel -lm
+   ./fwdback_avx_utest; ./fwdback_avx512_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for " p7W_ISA " Forward, Backward parsers";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* nothing to test on a processor without the instruction set */
+  if (p7_simd_Set(p7W_SIMD) != eslOK) { esl_randomness_Destroy(r); esl_getopts_Destroy(go); return 0; }
+
+  /* First round of tests for DNA alphabets.  */
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  utest_fwdback(r, abc, bg, M, L, N);   /* normal sized models */
+  utest_fwdback(r, abc, bg, 1, L, 10);  /* size 1 models       */
+  utest_fwdback(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+  utest_fwdback(r, abc, bg, 50, L, 10); /* M < 100: fully serialized DD path */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  /* Second round of tests for amino alphabets.  */
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  utest_fwdback(r, abc, bg, M, L, N);   
+  utest_fwdback(r, abc, bg, 1, L, 10);  
+  utest_fwdback(r, abc, bg, M, 1, 10);  
+  utest_fwdback(r, abc, bg, 50, L, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7FWDBACK_WIDE_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
+
+
+
+#else /* ! p7_WIDE_ENABLED */
+/* Provide a dummy symbol, so the object file isn't empty; and if the
+ * test driver is compiled anyway, let it pass trivially.
+ */
+void p7W_NAME(p7_fwdback_silence_hack)(void) { return; }
+#if defined p7FWDBACK_WIDE_TESTDRIVE || defined p7FWDBACK_WIDE_BENCHMARK
+int main(void) { return 0; }
+#endif
+#endif /* p7_WIDE_ENABLED */
@@ -0,0 +1,262 @@
+/* AVX2 and AVX-512 vector helpers for the wide filter kernels.
+ *
+ * The *_wide.c kernels are striped exactly like the SSE
+ * ones, so they need the same handful of whole-vector shifts and
+ * horizontal reductions. In the wider instruction sets, byte shifts
+ * only work within each 128-bit lane; these inlines carry elements
+ * across lane boundaries with a permute first.
+ *
+ * Only included by files compiled with the corresponding instruction
+ * set flags (AVX_CFLAGS, AVX512_CFLAGS), so it's guarded on the
+ * compiler's own __AVX2__ and __AVX512BW__ macros. The last section
+ * picks the vector width that the *_wide.c kernels are compiled for.
+ *
+ * "Right" and "left" follow the SSE code's convention of naming
+ * shifts by where the striped elements go, not by bit direction:
+ * a rightshift turns [1 5 9 13] into [x 1 5 9].
+ */
+#ifndef P7_IMPL_AVX_INCLUDED
+#define P7_IMPL_AVX_INCLUDED
+
+#include <p7_config.h>
+
+#include <immintrin.h>
+#include "esl_sse.h"
+
+#ifdef __AVX2__
+/* Function:  p7_avx_rightshift_epi8(), p7_avx_rightshift_epi16()
+ * Synopsis:  Shift a vector by one element, shifting zeros on.
+ *
+ * Purpose:   AVX2 equivalents of <_mm_slli_si128(v, 1)> and
+ *            <_mm_slli_si128(v, 2)>: element 0 becomes 0, element
+ *            i becomes old element i-1.
+ */
+static inline __m256i
+p7_avx_rightshift_epi8(__m256i v)
+{
+  return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 15);
+}
+
+static inline __m256i
+p7_avx_rightshift_epi16(__m256i v)
+{
+  return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(v, v, 0x08), 14);
+}
+
+/* Function:  p7_avx_rightshiftz_ps(), p7_avx_leftshiftz_ps()
+ * Synopsis:  Shift a float vector by one element, shifting zeros on.
+ *
+ * Purpose:   AVX2 equivalents of <esl_sse_rightshiftz_float()> ([1 5 9 13]
+ *            becomes [0 1 5 9]) and of the <_mm_move_ss()>/<_mm_shuffle_ps()>
+ *            leftshift used in Backward ([1 5 9 13] becomes [5 9 13 0]).
+ */
+static inline __m256
+p7_avx_rightshiftz_ps(__m256 v)
+{
+  __m256i vi = _mm256_castps_si256(v);
+  return _mm256_castsi256_ps(_mm256_alignr_epi8(vi, _mm256_permute2x128_si256(vi, vi, 0x08), 12));
+}
+
+static inline __m256
+p7_avx_leftshiftz_ps(__m256 v)
+{
+  __m256i vi = _mm256_castps_si256(v);
+  return _mm256_castsi256_ps(_mm256_alignr_epi8(_mm256_permute2x128_si256(vi, vi, 0x81), vi, 4));
+}
+
+/* Function:  p7_avx_hmax_epu8(), p7_avx_hmax_epi16(), p7_avx_hsum_ps()
+ * Synopsis:  Horizontal max or sum of a vector's elements.
+ */
+static inline uint8_t
+p7_avx_hmax_epu8(__m256i v)
+{
+  return esl_sse_hmax_epu8(_mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+static inline int16_t
+p7_avx_hmax_epi16(__m256i v)
+{
+  return esl_sse_hmax_epi16(_mm_max_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+static inline float
+p7_avx_hsum_ps(__m256 v)
+{
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  float  r;
+
+  s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 3, 2, 1)));
+  s = _mm_add_ps(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 0, 3, 2)));
+  _mm_store_ss(&r, s);
+  return r;
+}
+
+/* Function:  p7_avx_any_gt_epi16(), p7_avx_any_gt_ps()
+ * Synopsis:  Returns TRUE if any a[z] > b[z].
+ */
+static inline int
+p7_avx_any_gt_epi16(__m256i a, __m256i b)
+{
+  return (_mm256_movemask_epi8(_mm256_cmpgt_epi16(a, b)) != 0);
+}
+
+static inline int
+p7_avx_any_gt_ps(__m256 a, __m256 b)
+{
+  return (_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)) != 0);
+}
+#endif /*__AVX2__*/
+
+
+#ifdef __AVX512BW__
+/* The AVX-512 versions. Here the 128-bit lanes are moved up or down
+ * one with a masked _mm512_shuffle_i32x4(), zeroing the lane that
+ * comes in at the end, then _mm512_alignr_epi8() does the per-lane
+ * shift as in AVX2.
+ */
+static inline __m512i
+p7_avx512_rightshift_epi8(__m512i v)
+{
+  return _mm512_alignr_epi8(v, _mm512_maskz_shuffle_i32x4(0xfff0, v, v, 0x90), 15);
+}
+
+static inline __m512i
+p7_avx512_rightshift_epi16(__m512i v)
+{
+  return _mm512_alignr_epi8(v, _mm512_maskz_shuffle_i32x4(0xfff0, v, v, 0x90), 14);
+}
+
+static inline __m512
+p7_avx512_rightshiftz_ps(__m512 v)
+{
+  __m512i vi = _mm512_castps_si512(v);
+  return _mm512_castsi512_ps(_mm512_alignr_epi8(vi, _mm512_maskz_shuffle_i32x4(0xfff0, vi, vi, 0x90), 12));
+}
+
+static inline __m512
+p7_avx512_leftshiftz_ps(__m512 v)
+{
+  __m512i vi = _mm512_castps_si512(v);
+  return _mm512_castsi512_ps(_mm512_alignr_epi8(_mm512_maskz_shuffle_i32x4(0x0fff, vi, vi, 0x39), vi, 4));
+}
+
+static inline uint8_t
+p7_avx512_hmax_epu8(__m512i v)
+{
+  return p7_avx_hmax_epu8(_mm256_max_epu8(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1)));
+}
+
+static inline int16_t
+p7_avx512_hmax_epi16(__m512i v)
+{
+  return p7_avx_hmax_epi16(_mm256_max_epi16(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1)));
+}
+
+static inline float
+p7_avx512_hsum_ps(__m512 v)
+{
+  return p7_avx_hsum_ps(_mm256_add_ps(_mm512_castps512_ps256(v), _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))));
+}
+
+static inline int
+p7_avx512_any_gt_epi16(__m512i a, __m512i b)
+{
+  return (_mm512_cmpgt_epi16_mask(a, b) != 0);
+}
+
+static inline int
+p7_avx512_any_gt_ps(__m512 a, __m512 b)
+{
+  return (_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ) != 0);
+}
+#endif /*__AVX512BW__*/
+
+
+/* The wide kernels (*_wide.c) are written once, for a vector width
+ * chosen here, and compiled once per instruction set: with
+ * AVX_CFLAGS and -Dp7_WIDE_AVX into the *_avx.o objects, and with
+ * AVX512_CFLAGS and -Dp7_WIDE_AVX512 into the *_avx512.o objects
+ * (see Makefile.in). p7_WIDE_ENABLED is defined when configure also
+ * found compiler support for that instruction set; otherwise the
+ * kernel compiles to a stub.
+ *
+ *   p7W_NAME(f)   f with the instruction set's suffix: p7W_NAME(p7_MSVFilter)
+ *                 is p7_MSVFilter_avx or p7_MSVFilter_avx512, and
+ *                 om->p7W_NAME(rbv) is om->rbv_avx or om->rbv_avx512.
+ *   p7W(op)       the intrinsic: p7W(add_ps) is _mm256_add_ps or _mm512_add_ps.
+ *   p7W_vec, p7W_vecf   integer and float vector types
+ *   p7W_NB, p7W_NW, p7W_NF   uint8_t, int16_t and float lanes per vector
+ */
+#define p7W_PASTE_(a, b) a ## b
+#define p7W_PASTE(a, b)  p7W_PASTE_(a, b)
+
+#if defined(p7_WIDE_AVX512)
+#define p7W_NAME(f)      p7W_PASTE(f, _avx512)
+#define p7W(op)          p7W_PASTE(_mm512_, op)
+#define p7W_ISA          "AVX-512"
+#define p7W_SIMD         p7_SIMD_AVX512
+#ifdef eslENABLE_AVX512
+#define p7_WIDE_ENABLED
+#endif
+
+#elif defined(p7_WIDE_AVX)
+#define p7W_NAME(f)      p7W_PASTE(f, _avx)
+#define p7W(op)          p7W_PASTE(_mm256_, op)
+#define p7W_ISA          "AVX2"
+#define p7W_SIMD         p7_SIMD_AVX
+#ifdef eslENABLE_AVX
+#define p7_WIDE_ENABLED
+#endif
+
+#else
+#error "compile the wide kernels with -Dp7_WIDE_AVX or -Dp7_WIDE_AVX512"
+#endif
+
+#if defined(p7_WIDE_ENABLED) && defined(p7_WIDE_AVX512)
+#define p7W_vec                 __m512i
+#define p7W_vecf                __m512
+#define p7W_NB                  64
+#define p7W_NW                  32
+#define p7W_NF                  16
+#define p7W_NQB(M)              p7O_NQB_AVX512(M)
+#define p7W_NQW(M)              p7O_NQW_AVX512(M)
+#define p7W_NQF(M)              p7O_NQF_AVX512(M)
+#define p7W_setzero_si()        _mm512_setzero_si512()
+#define p7W_or_si(a, b)         _mm512_or_si512((a), (b))
+#define p7W_cast_si128(v)       _mm512_castsi512_si128(v)
+#define p7W_neginf0_epi16()     _mm512_maskz_set1_epi16(0x1, -32768)
+#define p7W_rightshift_epi8     p7_avx512_rightshift_epi8
+#define p7W_rightshift_epi16    p7_avx512_rightshift_epi16
+#define p7W_rightshiftz_ps      p7_avx512_rightshiftz_ps
+#define p7W_leftshiftz_ps       p7_avx512_leftshiftz_ps
+#define p7W_hmax_epu8           p7_avx512_hmax_epu8
+#define p7W_hmax_epi16          p7_avx512_hmax_epi16
+#define p7W_hsum_ps             p7_avx512_hsum_ps
+#define p7W_any_gt_epi16        p7_avx512_any_gt_epi16
+#define p7W_any_gt_ps           p7_avx512_any_gt_ps
+
+#elif defined(p7_WIDE_ENABLED) && defined(p7_WIDE_AVX)
+#define p7W_vec                 __m256i
+#define p7W_vecf                __m256
+#define p7W_NB                  32
+#define p7W_NW                  16
+#define p7W_NF                  8
+#define p7W_NQB(M)              p7O_NQB_AVX(M)
+#define p7W_NQW(M)              p7O_NQW_AVX(M)
+#define p7W_NQF(M)              p7O_NQF_AVX(M)
+#define p7W_setzero_si()        _mm256_setzero_si256()
+#define p7W_or_si(a, b)         _mm256_or_si256((a), (b))
+#define p7W_cast_si128(v)       _mm256_castsi256_si128(v)
+#define p7W_neginf0_epi16()     _mm256_inserti128_si256(_mm256_setzero_si256(), _mm_cvtsi32_si128(0x8000), 0)
+#define p7W_rightshift_epi8     p7_avx_rightshift_epi8
+#define p7W_rightshift_epi16    p7_avx_rightshift_epi16
+#define p7W_rightshiftz_ps      p7_avx_rightshiftz_ps
+#define p7W_leftshiftz_ps       p7_avx_leftshiftz_ps
+#define p7W_hmax_epu8           p7_avx_hmax_epu8
+#define p7W_hmax_epi16          p7_avx_hmax_epi16
+#define p7W_hsum_ps             p7_avx_hsum_ps
+#define p7W_any_gt_epi16        p7_avx_any_gt_epi16
+#define p7W_any_gt_ps           p7_avx_any_gt_ps
+#endif
+
+#endif /*P7_IMPL_AVX_INCLUDED*/
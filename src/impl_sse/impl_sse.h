@@ -16,7 +16,11 @@
 #ifdef __SSE3__
 #include <pmmintrin.h>   /* DENORMAL_MODE */
 #endif
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+#include <immintrin.h>   /* __m256, __m512 types; only the *_avx*.c files use the instructions */
+#endif
 #include "hmmer.h"
+#include "p7_gbands.h"
 
 /* In calculating Q, the number of vectors we need in a row, we have
  * to make sure there's at least 2, or a striped implementation fails.
@@ -27,6 +31,16 @@
 
 #define p7O_EXTRA_SB 17    /* see ssvfilter.c for explanation */
 
+/* The optional AVX2 (256-bit) and AVX-512 (512-bit) filter kernels use
+ * the same striping, just with 2x or 4x as many elements per vector.
+ */
+#define p7O_NQB_AVX(M)     ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 uchars  */
+#define p7O_NQW_AVX(M)     ( ESL_MAX(2, ((((M)-1) / 16) + 1)))   /* 16 words   */
+#define p7O_NQF_AVX(M)     ( ESL_MAX(2, ((((M)-1) / 8)  + 1)))   /*  8 floats  */
+#define p7O_NQB_AVX512(M)  ( ESL_MAX(2, ((((M)-1) / 64) + 1)))   /* 64 uchars  */
+#define p7O_NQW_AVX512(M)  ( ESL_MAX(2, ((((M)-1) / 32) + 1)))   /* 32 words   */
+#define p7O_NQF_AVX512(M)  ( ESL_MAX(2, ((((M)-1) / 16) + 1)))   /* 16 floats  */
+
 
 /*****************************************************************
  * 1. P7_OPROFILE: an optimized score profile
@@ -65,6 +79,11 @@
  *        
  */
 
+/* Vector implementations a P7_OPROFILE can be built for; see simd.c.
+ * Ordered by width, so comparisons like (level >= p7_SIMD_AVX) work.
+ */
+enum p7_simd_e { p7_SIMD_SSE = 0, p7_SIMD_AVX = 1, p7_SIMD_AVX512 = 2 };
+
 #define p7O_NXSTATES  4    /* special states stored: ENJC                       */
 #define p7O_NXTRANS   2         /* special states all have 2 transitions: move, loop */
 #define p7O_NTRANS    8    /* 7 core transitions + BMk entry                    */
@@ -104,7 +123,29 @@ typedef struct p7_oprofile_s {
   __m128i  *twv_mem;
   __m128   *tfv_mem;
   __m128   *rfv_mem;
-  
+
+#ifdef eslENABLE_AVX
+  /* The same MSV, SSV, Viterbi and Forward scores restriped 32 bytes wide for the
+   * AVX2 kernels; built from the SSE vectors by p7_oprofile_Restripe{MSV,Rest}()  */
+  __m256i **rbv_avx;    /* [x][q] MSV match costs        [Kp][p7O_NQB_AVX(M)]            */
+  __m256i **sbv_avx;    /* [x][q] SSV match scores       [Kp][p7O_NQB_AVX(M)+EXTRA_SB]   */
+  __m256i **rwv_avx;    /* [x][q] Viterbi match scores   [Kp][p7O_NQW_AVX(M)]            */
+  __m256i  *twv_avx;    /* Viterbi transition blocks     [8*p7O_NQW_AVX(M)]              */
+  __m256  **rfv_avx;    /* [x][q] Forward match odds     [Kp][p7O_NQF_AVX(M)]            */
+  __m256   *tfv_avx;    /* Forward transition blocks     [8*p7O_NQF_AVX(M)]              */
+  void     *avx_mem;    /* one allocation for all the AVX2 vectors, before alignment     */
+#endif
+#ifdef eslENABLE_AVX512
+  /* ... and 64 bytes wide for the AVX-512 kernels.                                   */
+  __m512i **rbv_avx512; /* [x][q] MSV match costs        [Kp][p7O_NQB_AVX512(M)]          */
+  __m512i **sbv_avx512; /* [x][q] SSV match scores       [Kp][p7O_NQB_AVX512(M)+EXTRA_SB] */
+  __m512i **rwv_avx512; /* [x][q] Viterbi match scores   [Kp][p7O_NQW_AVX512(M)]          */
+  __m512i  *twv_avx512; /* Viterbi transition blocks     [8*p7O_NQW_AVX512(M)]            */
+  __m512  **rfv_avx512; /* [x][q] Forward match odds     [Kp][p7O_NQF_AVX512(M)]          */
+  __m512   *tfv_avx512; /* Forward transition blocks     [8*p7O_NQF_AVX512(M)]            */
+  void     *avx512_mem; /* one allocation for all the AVX-512 vectors, before alignment  */
+#endif
+
   /* Disk offset information for hmmpfam's fast model retrieval                      */
   off_t  offs[p7_NOFFSETS];     /* p7_{MFP}OFFSET, or -1                             */
 
@@ -135,10 +176,13 @@ typedef struct p7_oprofile_s {
   int    allocQ16;    /* p7_NQB(allocM): alloc size for rb                 */
   int    mode;      /* currently must be p7_LOCAL                        */
   float  nj;      /* expected # of J's: 0 or 1, uni vs. multihit       */
+  int    simd;                  /* p7_SIMD_*: which kernels, and wide copies, to use */
 
   int    clone;                 /* this optimized profile structure is just a copy   */
                                 /* of another profile structre.  all pointers of     */
                                 /* this structure should not be freed.               */
+  int    view;                  /* TRUE if vectors, annotation point into a mapped   */
+                                /* .h3f/.h3p file: see p7_oprofile_CreateView()      */
 } P7_OPROFILE;
 
 typedef struct {
@@ -203,6 +247,17 @@ typedef struct p7_omx_s {
   float     totscale;    /* log of the product of all scale factors (0.0 if unscaled)   */
   int       has_own_scales;  /* TRUE to use own scale factors; FALSE if scales provided     */
 
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  /* The AVX2/AVX-512 filters and parsers only ever need one row, of wider vectors     */
+  void     *wrow;         /* one row of [0..Q-1][MDI] 256- or 512-bit vectors, 64-aligned */
+  void     *wrow_mem;     /* <wrow> before alignment                                     */
+  int       allocWM;      /* <wrow> is wide enough for models up to this length          */
+#endif
+
+  /* p7_MSVFilter_Block() scores 16 sequences at once, one k per vector; its scratch  */
+  void     *bmem;         /* profile costs, DP row, sort order; grown on demand          */
+  int64_t   nbmem;        /* allocated size of <bmem>, in bytes                          */
+
   /* Parsers,scorers only hold a row at a time, so to get them to dump full matrix, it
    * must be done during a DP calculation, after each row is calculated 
    */
@@ -246,7 +301,54 @@ p7_omx_FSetMDI(const P7_OMX *ox, int s, int i, int k, float val)
   u.p[r]        = val;
   ox->dpf[i][q] = u.v;
 }
-  
+
+
+/* P7_OMXCHK: a checkpointed Forward matrix (fwdback_chk.c).
+ *
+ * The striped, scaled-probability counterpart of P7_GMXCHK; see
+ * p7_gmxchk.h for the row layout (regions a, b, c) and how the
+ * Backward pass recomputes the Forward rows it needs from the
+ * checkpoints. MDI rows are [0..Q-1][MDI] float vectors, as in
+ * P7_OMX. Rows dp[0,1] hold Backward's current and previous rows,
+ * dp[2] is Forward row 0, and dp[R0..R0+R-1] are the saved Forward
+ * rows. The special states and scale factors are kept for every row
+ * 0..L in <xmx>, as in a parsing P7_OMX, so memory is
+ * O(M sqrt(L) + L) when fully checkpointed.
+ */
+typedef struct p7_omxchk_s {
+  int       M;		/* actual query model dimension of current comparison            */
+  int       L;		/* actual target sequence dimension of current comparison        */
+  int       R;		/* actual # of saved Forward rows, excluding R0                  */
+
+  int       R0;		/* # of extra rows: bck[prv,cur] and fwd[0]                      */
+  int       Ra;		/* # of rows in "all" region (uncheckpointed)                    */
+  int       Rb;		/* # of rows in "between" region (one incomplete segment)        */
+  int       Rc;		/* # of rows in "checkpointed" region                            */
+  int       La;		/* residues 1..La are in "all" region                            */
+  int       Lb;		/* residues La+1..La+Lb are in "between" region                  */
+  int       Lc;		/* residues La+Lb+1..L are in "checkpointed" region              */
+
+  __m128  **dp;		/* row pointers dp[0..validR-1], into aligned <dp_mem>           */
+  void     *dp_mem;	/* DP memory, before 16-byte alignment                           */
+  int       allocW;	/* allocated row width, in vectors: >= p7O_NQF(M)*p7X_NSCELLS    */
+  int64_t   ncells;	/* total # of allocated vectors in <dp_mem>                      */
+  int64_t   ncell_limit;/* recommended limit on <ncells>; may be exceeded ("redlined")   */
+  int       allocR;	/* allocated size of <dp[]>                                      */
+  int       validR;	/* # of rows pointing at DP memory, <= allocR                    */
+
+  float    *xmx;	/* [0..L][ENJBCS] specials of Forward, indexed [i*p7X_NXCELLS+s] */
+  void     *x_mem;	/* <xmx> before 16-byte alignment                                */
+  int       allocXR;	/* # of rows allocated in <xmx>; >= L+1                          */
+  float     totscale;	/* log of the product of Forward's scale factors                 */
+} P7_OMXCHK;
+
+
+/* Banded decoding of domain envelopes (decoding.c, p7_domaindef.c).
+ * When the union of an envelope's posterior bands spans no more than
+ * p7_BANDS_MAXFRAC of the model, decoding, optimal accuracy and null2
+ * run on a profile sliced to those columns (p7_oprofile_Slice()).
+ */
+#define p7_BANDS_MAXFRAC  0.5
 
 
 
@@ -270,6 +372,7 @@ extern int          p7_omx_DumpFBRow(P7_OMX *ox, int logify, int rowi, int width
 
 /* p7_oprofile.c */
 extern P7_OPROFILE *p7_oprofile_Create(int M, const ESL_ALPHABET *abc);
+extern P7_OPROFILE *p7_oprofile_CreateView(int M, const ESL_ALPHABET *abc);
 extern int          p7_oprofile_IsLocal(const P7_OPROFILE *om);
 extern void         p7_oprofile_Destroy(P7_OPROFILE *om);
 extern size_t       p7_oprofile_Sizeof(P7_OPROFILE *om);
@@ -281,6 +384,9 @@ extern int          p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *
 
 
 extern int          p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om);
+extern int          p7_oprofile_Slice(const P7_OPROFILE *om, int ka, int kb, P7_OPROFILE *sub);
+extern int          p7_oprofile_RestripeMSV (P7_OPROFILE *om);
+extern int          p7_oprofile_RestripeRest(P7_OPROFILE *om);
 extern int          p7_oprofile_ReconfigLength    (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigMSVLength (P7_OPROFILE *om, int L);
 extern int          p7_oprofile_ReconfigRestLength(P7_OPROFILE *om, int L);
@@ -302,12 +408,25 @@ extern int          p7_oprofile_GetFwdEmissionArray(const P7_OPROFILE *om, P7_BG
 /* decoding.c */
 extern int p7_Decoding      (const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, P7_OMX *pp);
 extern int p7_DomainDecoding(const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_DOMAINDEF *ddef);
+extern int p7_DecodingBands (const P7_OPROFILE *om, const P7_OMX *oxf, const P7_OMX *oxb, P7_GBANDS *bnd);
+extern int p7_DecodingBanded(const P7_OPROFILE *om, const P7_OMX *oxf,       P7_OMX *oxb, int ka, int kb, P7_OMX *pp);
 
 /* fwdback.c */
 extern int p7_Forward       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_ForwardParser (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
 extern int p7_Backward      (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
 extern int p7_BackwardParser(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+extern int p7_ForwardParser_sse (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+
+/* fwdback_chk.c */
+extern P7_OMXCHK *p7_omxchk_Create (int M, int L, int64_t ramlimit);
+extern int        p7_omxchk_GrowTo (P7_OMXCHK *oxc, int M, int L);
+extern size_t     p7_omxchk_Sizeof (const P7_OMXCHK *oxc);
+extern int        p7_omxchk_Reuse  (P7_OMXCHK *oxc);
+extern void       p7_omxchk_Destroy(P7_OMXCHK *oxc);
+extern int        p7_ForwardCheckpointed (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *oxc, float *opt_sc);
+extern int        p7_BackwardCheckpointed(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMXCHK *oxc, P7_GBANDS *bnd, float *opt_sc);
 
 /* io.c */
 extern int p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om);
@@ -322,11 +441,17 @@ extern void p7_oprofile_DestroyBlock(P7_OM_BLOCK *block);
 
 /* ssvfilter.c */
 extern int p7_SSVFilter    (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_SSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
 
 /* msvfilter.c */
 extern int p7_MSVFilter           (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_MSVFilter_sse       (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_SSVFilter_longtarget(const ESL_DSQ *dsq, int L, P7_OPROFILE *om, P7_OMX *ox, const P7_SCOREDATA *msvdata, P7_BG *bg, double P, P7_HMM_WINDOWLIST *windowlist);
 
+/* msvfilter_block.c */
+#define p7_MSVBLOCK_MAXM 100	/* p7_MSVFilter_Block() interleaves targets for models shorter than this */
+extern int p7_MSVFilter_Block(const ESL_SQ_BLOCK *block, P7_OPROFILE *om, P7_OMX *ox, float *usc);
+
 
 /* null2.c */
 extern int p7_Null2_ByExpectation(const P7_OPROFILE *om, const P7_OMX *pp, float *null2);
@@ -341,13 +466,38 @@ extern int p7_StochasticTrace(ESL_RANDOMNESS *rng, const ESL_DSQ *dsq, int L, co
 
 /* vitfilter.c */
 extern int p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 extern int p7_ViterbiFilter_longtarget(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox,
                                         float filtersc, double P, P7_HMM_WINDOWLIST *windowlist);
 
 
+/* simd.c */
+extern int         p7_simd_Select(void);
+extern int         p7_simd_Set(int level);
+extern int         p7_simd_Supported(int level);
+extern const char *p7_simd_Name(int level);
+
 /* vitscore.c */
 extern int p7_ViterbiScore (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
 
+/* {ssv,msv,vit}filter_wide.c, fwdback_wide.c, built as *_avx.o: AVX2 kernels */
+#ifdef eslENABLE_AVX
+extern int p7_SSVFilter_avx     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_MSVFilter_avx     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_avx (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ForwardParser_avx (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_avx(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+#endif
+
+/* {ssv,msv,vit}filter_wide.c, fwdback_wide.c, built as *_avx512.o: AVX-512 kernels */
+#ifdef eslENABLE_AVX512
+extern int p7_SSVFilter_avx512     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc);
+extern int p7_MSVFilter_avx512     (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ViterbiFilter_avx512 (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc);
+extern int p7_ForwardParser_avx512 (const ESL_DSQ *dsq, int L, const P7_OPROFILE *om,                    P7_OMX *fwd, float *opt_sc);
+extern int p7_BackwardParser_avx512(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, const P7_OMX *fwd, P7_OMX *bck, float *opt_sc);
+#endif
+
 
 /*****************************************************************
  * 4. Implementation specific initialization
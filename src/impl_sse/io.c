@@ -10,6 +10,12 @@
  * <hmmfile>.h3p, which nominally stand for "H3 filter" and "H3
  * profile".
  * 
+ * Each block of score vectors starts on a 16-byte file offset
+ * (zero-padded), so the files can also be mapped into memory with
+ * <p7_hmmfile_Mmap()>. Then the readers don't copy anything: they
+ * return "view" profiles whose vectors and annotation point straight
+ * into the mapping (see <p7_oprofile_CreateView()>).
+ * 
  * Contents:
  *    1. Writing optimized profiles to two files.
  *    2. Reading optimized profiles in two stages.
@@ -29,6 +35,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #ifdef HMMER_THREADS
@@ -43,6 +50,9 @@
 #include "hmmer.h"
 #include "impl_sse.h"
 
+static uint32_t  v3g_fmagic = 0xb3e7e6f3; /* 3/g binary MSV file, SSE:     "3gfs" = 0x 33 67 66 73  + 0x80808080 */
+static uint32_t  v3g_pmagic = 0xb3e7f0f3; /* 3/g binary profile file, SSE: "3gps" = 0x 33 67 70 73  + 0x80808080 */
+
 static uint32_t  v3f_fmagic = 0xb3e6e6f3; /* 3/f binary MSV file, SSE:     "3ffs" = 0x 33 66 66 73  + 0x80808080 */
 static uint32_t  v3f_pmagic = 0xb3e6f0f3; /* 3/f binary profile file, SSE: "3fps" = 0x 33 66 70 73  + 0x80808080 */
 
@@ -61,6 +71,14 @@ static uint32_t  v3b_pmagic = 0xb3e2f0f3; /* 3/b binary profile file, SSE: "3bps
 static uint32_t  v3a_fmagic = 0xe8b3e6f3; /* 3/a binary MSV file, SSE:     "h3fs" = 0x 68 33 66 73  + 0x80808080 */
 static uint32_t  v3a_pmagic = 0xe8b3f0f3; /* 3/a binary profile file, SSE: "h3ps" = 0x 68 33 70 73  + 0x80808080 */
 
+#define p7O_FILEALIGN 16	/* vector blocks in .h3f/.h3p start on a multiple of this file offset */
+
+static int   check_magic(uint32_t magic, int is_msv, char *errbuf);
+static int   write_pad(FILE *fp);
+static int   read_pad(FILE *fp);
+static int   read_msv_view (P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_om);
+static int   read_rest_view(P7_HMMFILE *hfp, P7_OPROFILE *om);
+
 
 /*****************************************************************
  *# 1. Writing optimized profiles to two files.
@@ -92,9 +110,10 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   int Q16x = p7O_NQB(om->M) + p7O_EXTRA_SB;
   int n    = strlen(om->name);
   int x;
+  int status;
 
   /* <ffp> is the part of the oprofile that MSVFilter() needs */
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -106,6 +125,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->scale_b),   sizeof(float),    1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
   if (fwrite((char *) &(om->base_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
   if (fwrite((char *) &(om->bias_b),    sizeof(uint8_t),  1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");  
+  if ((status = write_pad(ffp)) != eslOK) return status;
 
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->sbv[x],    sizeof(__m128i),  Q16x,        ffp) != Q16x)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -116,10 +136,10 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) om->evparam,      sizeof(float),    p7_NEVPARAM, ffp) != p7_NEVPARAM) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->offs,         sizeof(off_t),    p7_NOFFSETS, ffp) != p7_NOFFSETS) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) om->compo,        sizeof(float),    p7_MAXABET,  ffp) != p7_MAXABET)  ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_fmagic),    sizeof(uint32_t), 1,           ffp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
 
   /* <pfp> gets the rest of the oprofile */
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->M),         sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->abc->type), sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &n,               sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -149,6 +169,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) om->consensus,    sizeof(char),     om->M+2,     pfp) != om->M+2)     ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* ViterbiFilter part */
+  if ((status = write_pad(pfp)) != eslOK) return status;
   if (fwrite((char *) om->twv,             sizeof(__m128i),  8*Q8,        pfp) != 8*Q8)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          pfp) != Q8)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -160,6 +181,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->ncj_roundoff), sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
 
   /* Forward/Backward part */
+  if ((status = write_pad(pfp)) != eslOK) return status;
   if (fwrite((char *) om->tfv,          sizeof(__m128),   8*Q4,        pfp) != 8*Q4)        ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   for (x = 0; x < om->abc->Kp; x++)
     if (fwrite( (char *) om->rfv[x],    sizeof(__m128),   Q4,          pfp) != Q4)          ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
@@ -170,7 +192,7 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
   if (fwrite((char *) &(om->nj),        sizeof(float),    1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->mode),      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
   if (fwrite((char *) &(om->L)   ,      sizeof(int),      1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
-  if (fwrite((char *) &(v3f_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
+  if (fwrite((char *) &(v3g_pmagic),    sizeof(uint32_t), 1,           pfp) != 1)           ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed"); /* sentinel */
   return eslOK;
 }
 /*---------------- end, writing oprofile ------------------------*/
@@ -201,6 +223,9 @@ p7_oprofile_Write(FILE *ffp, FILE *pfp, P7_OPROFILE *om)
  *            
  *            The <.h3f> file was opened automatically, if it existed,
  *            when the HMM file was opened with <p7_hmmfile_Open()>.
+ *            If it has also been mapped with <p7_hmmfile_Mmap()>, 
+ *            <*ret_om> is a view: its vectors point into the mapping,
+ *            and it must be destroyed before <hfp> is closed.
  *            
  *            When no more HMMs remain in the file, return <eslEOF>.
  *
@@ -241,18 +266,14 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
 
   hfp->errbuf[0] = '\0';  // do NOT touch rr_errbuf[]. In thread parallelization, master is exclusively using ReadMSV, workers are using ReadRest
   if (hfp->ffp == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no MSV profile file; hmmpress probably wasn't run");
+  if (hfp->fmap != NULL) return read_msv_view(hfp, byp_abc, ret_om);
   if (feof(hfp->ffp))   { status = eslEOF; goto ERROR; }	/* normal EOF: no more profiles */
   
   /* keep track of the starting offset of the MSV model */
   roff = ftello(hfp->ffp);
 
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp)) { status = eslEOF; goto ERROR; }
-  if (magic == v3a_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
-  if (magic == v3b_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
-  if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
-  if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
-  if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if ((status = check_magic(magic, TRUE, hfp->errbuf)) != eslOK) goto ERROR;
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -284,6 +305,7 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
   if (! fread((char *) &(om->scale_b),   sizeof(float),   1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
   if (! fread((char *) &(om->base_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
   if (! fread((char *) &(om->bias_b),    sizeof(uint8_t), 1,           hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+  if (read_pad(hfp->ffp) != eslOK)                                                 ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read padding");
   for (x = 0; x < abc->Kp; x++)
     if (! fread((char *) om->sbv[x],     sizeof(__m128i), Q16x,        hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores at %d [residue %c]", x, abc->sym[x]); 
   for (x = 0; x < abc->Kp; x++)
@@ -294,11 +316,14 @@ p7_oprofile_ReadMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_o
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp))  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
-  if (magic != v3f_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+  if (magic != v3g_fmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
 
   /* keep track of the ending offset of the MSV model */
   om->eoff = ftello(hfp->ffp) - 1;
 
+  /* wide copies of the MSV/SSV vectors, for AVX2/AVX-512 kernels */
+  p7_oprofile_RestripeMSV(om);
+
   if (byp_abc != NULL) *byp_abc = abc;  /* pass alphabet (whether new or not) back to caller, if caller wanted it */
   *ret_om = om;
   return eslOK;
@@ -368,12 +393,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   roff = ftello(hfp->ffp);
 
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->ffp)) { status = eslEOF; goto ERROR; }
-  if (magic == v3a_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
-  if (magic == v3b_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
-  if (magic == v3c_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
-  if (magic == v3d_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
-  if (magic == v3e_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_fmagic)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad magic; not an HMM database?");
+  if ((status = check_magic(magic, TRUE, hfp->errbuf)) != eslOK) goto ERROR;
 
   if (! fread( (char *) &M,         sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype, sizeof(int),      1, hfp->ffp)) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");  
@@ -400,6 +420,7 @@ p7_oprofile_ReadInfoMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **r
   roff += (sizeof(int) * 5);                      /* magic, model size, alphabet type, max length, name length */
   roff += (sizeof(char) * (n + 1));               /* name string and terminator '\0'                           */
   roff += (sizeof(float) + sizeof(uint8_t) * 5);  /* transition  costs, bias, scale and base                   */
+  roff += (p7O_FILEALIGN - roff % p7O_FILEALIGN) % p7O_FILEALIGN; /* padding to align the vectors             */
   roff += (sizeof(__m128i) * abc->Kp * Q16x);     /* ssv scores                                                */
   roff += (sizeof(__m128i) * abc->Kp * Q16);      /* msv scores                                                */
   roff += (sizeof(float) * p7_NEVPARAM);          /* stat params                                               */
@@ -475,6 +496,11 @@ p7_oprofile_ReadBlockMSV(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OM_BLOCK *h
  *            data. ReadMSV only touches ffp (the MSV input data
  *            stream) and errbuf. We can't use the same errbuf
  *            in ReadRest; we work around by using hfp->rr_errbuf.
+ *            
+ *            If <om> is a view (the files were mapped with
+ *            <p7_hmmfile_Mmap()>), the rest of it is pointed into the
+ *            mapped <.h3p> file instead. That doesn't touch the
+ *            stream, so it doesn't take the lock.
  
  *
  * Args:      hfp - open HMM file, from which we've previously
@@ -504,6 +530,8 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   int           alphatype;
   int           status;
 
+  if (om->view) return read_rest_view(hfp, om); /* no stream to share; no lock */
+
 #ifdef HMMER_THREADS
   /* lock the mutex to prevent other threads from reading from the optimized
    * profile at the same time.
@@ -521,12 +549,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (fseeko(hfp->pfp, om->offs[p7_POFFSET], SEEK_SET) != 0)                       ESL_EXCEPTION(eslESYS, "fseeko() failed");
    
   if (! fread( (char *) &magic,          sizeof(uint32_t), 1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read magic");
-  if (magic == v3a_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/a); please hmmpress your HMM file again");
-  if (magic == v3b_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/b); please hmmpress your HMM file again");
-  if (magic == v3c_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/c); please hmmpress your HMM file again");
-  if (magic == v3d_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/d); please hmmpress your HMM file again");
-  if (magic == v3e_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "binary auxfiles are in an outdated HMMER format (3/e); please hmmpress your HMM file again");
-  if (magic != v3f_pmagic) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad magic; not an HMM database file?");
+  if ((status = check_magic(magic, FALSE, hfp->rr_errbuf)) != eslOK) goto ERROR;
 
   if (! fread( (char *) &M,              sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
   if (! fread( (char *) &alphatype,      sizeof(int),      1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");  
@@ -557,6 +580,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   Q4  = p7O_NQF(om->M);
   Q8  = p7O_NQW(om->M);
 
+  if (read_pad(hfp->pfp) != eslOK)                                                    ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding");
   if (! fread((char *) om->twv,             sizeof(__m128i),  8*Q8,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rwv[x],       sizeof(__m128i),  Q8,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>[%d], vitfilter emissions for sym %c", x, om->abc->sym[x]);
@@ -567,6 +591,7 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (! fread((char *) &(om->ddbound_w),    sizeof(int16_t),  1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
   if (! fread((char *) &(om->ncj_roundoff), sizeof(float),    1,           hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
 
+  if (read_pad(hfp->pfp) != eslOK)                                                 ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read padding");
   if (! fread((char *) om->tfv,          sizeof(__m128),   8*Q4,        hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
   for (x = 0; x < om->abc->Kp; x++)
     if (! fread( (char *) om->rfv[x],    sizeof(__m128),   Q4,          hfp->pfp)) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf>[%d] emissions for sym %c", x, om->abc->sym[x]);
@@ -580,7 +605,9 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
 
   /* record ends with magic sentinel, for detecting binary file corruption */
   if (! fread( (char *) &magic,     sizeof(uint32_t), 1, hfp->pfp))  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
-  if (magic != v3f_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+  if (magic != v3g_pmagic)                                           ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+
+  p7_oprofile_RestripeRest(om);
 
 #ifdef HMMER_THREADS
   if (hfp->syncRead)
@@ -604,6 +631,197 @@ p7_oprofile_ReadRest(P7_HMMFILE *hfp, P7_OPROFILE *om)
   if (name != NULL) free(name);
   return status;
 }
+
+/* read_msv_view(), read_rest_view()
+ * 
+ * What p7_oprofile_ReadMSV() and p7_oprofile_ReadRest() do instead
+ * when p7_hmmfile_Mmap() has mapped the .h3f and .h3p files: parse
+ * the same records, but in memory, making the profile's vectors and
+ * annotation point into the mapping rather than reading them. Only
+ * the name is copied. The .h3f stream isn't read, but its position
+ * is kept up to date, so p7_oprofile_Position() and
+ * p7_oprofile_ReadInfoMSV() still work.
+ * 
+ * view_get() copies <n> bytes at <*p> to <dst>; view_str() returns
+ * a '\0'-terminated string of length <n> at <*p>; view_vec() skips
+ * padding to the next vector boundary and returns <n> bytes of
+ * vectors there. Each advances <*p> past what it read, or fails
+ * (eslEFORMAT or NULL) if that would run past <end>.
+ */
+static int
+view_get(const char **p, const char *end, void *dst, size_t n)
+{
+  if ((size_t) (end - *p) < n) return eslEFORMAT;
+  memcpy(dst, *p, n);
+  *p += n;
+  return eslOK;
+}
+
+static char *
+view_str(const char **p, const char *end, int n)
+{
+  const char *s = *p;
+
+  if (n < 0 || (size_t) (end - s) < (size_t) n + 1 || s[n] != '\0') return NULL;
+  *p += n + 1;
+  return (char *) s;
+}
+
+static void *
+view_vec(const char **p, const char *end, size_t n)
+{
+  const char *v = (const char *) (((uintptr_t) *p + p7O_FILEALIGN - 1) & ~((uintptr_t) p7O_FILEALIGN - 1));
+
+  if (v > end || (size_t) (end - v) < n) return NULL;
+  *p = v + n;
+  return (void *) v;
+}
+
+static int
+read_msv_view(P7_HMMFILE *hfp, ESL_ALPHABET **byp_abc, P7_OPROFILE **ret_om)
+{
+  P7_OPROFILE  *om  = NULL;
+  ESL_ALPHABET *abc = NULL;
+  const char   *end = hfp->fmap + hfp->nfmap;
+  const char   *p;
+  char         *name;
+  uint32_t      magic;
+  off_t         roff;
+  int           M, Q16, Q16x;
+  int           x,n;
+  int           alphatype;
+  int           status;
+
+  if ((roff = ftello(hfp->ffp)) >= hfp->nfmap) { status = eslEOF; goto ERROR; } /* normal EOF: no more profiles */
+  p = hfp->fmap + roff;
+
+  if (view_get(&p, end, &magic, sizeof(uint32_t)) != eslOK) { status = eslEOF; goto ERROR; }
+  if ((status = check_magic(magic, TRUE, hfp->errbuf)) != eslOK) goto ERROR;
+  if (view_get(&p, end, &M,         sizeof(int)) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model size M");
+  if (view_get(&p, end, &alphatype, sizeof(int)) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read alphabet type");
+  Q16  = p7O_NQB(M);
+  Q16x = p7O_NQB(M) + p7O_EXTRA_SB;
+
+  if (byp_abc == NULL || *byp_abc == NULL)	{	
+    if ((abc = esl_alphabet_Create(alphatype)) == NULL)  ESL_XFAIL(eslEMEM, hfp->errbuf, "allocation failed: alphabet");
+  } else {		
+    abc = *byp_abc;
+    if (abc->type != alphatype) 
+      ESL_XFAIL(eslEINCOMPAT, hfp->errbuf, "Alphabet type mismatch: was %s, but current profile says %s", 
+		esl_abc_DecodeType(abc->type), esl_abc_DecodeType(alphatype));
+  }
+  if ((om = p7_oprofile_CreateView(M, abc)) == NULL)     ESL_XFAIL(eslEMEM, hfp->errbuf, "allocation failed: oprofile");
+  om->M    = M;
+  om->roff = roff;
+
+  if (view_get(&p, end, &n, sizeof(int))                      != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name length");
+  if ((name = view_str(&p, end, n))                           == NULL)  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read name");
+  if ((status = esl_strdup(name, n, &(om->name)))             != eslOK) goto ERROR;
+  if (view_get(&p, end, &(om->max_length), sizeof(int))       != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read max_length");
+  if (view_get(&p, end, &(om->tbm_b),      sizeof(uint8_t))   != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tbm");
+  if (view_get(&p, end, &(om->tec_b),      sizeof(uint8_t))   != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tec");
+  if (view_get(&p, end, &(om->tjb_b),      sizeof(uint8_t))   != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read tjb");
+  if (view_get(&p, end, &(om->scale_b),    sizeof(float))     != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read scale");
+  if (view_get(&p, end, &(om->base_b),     sizeof(uint8_t))   != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read base");
+  if (view_get(&p, end, &(om->bias_b),     sizeof(uint8_t))   != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read bias");
+
+  if ((om->sbv[0] = view_vec(&p, end, sizeof(__m128i) * Q16x * abc->Kp)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read ssv scores");
+  if ((om->rbv[0] = view_vec(&p, end, sizeof(__m128i) * Q16  * abc->Kp)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read msv scores");
+  for (x = 1; x < abc->Kp; x++) {
+    om->sbv[x] = om->sbv[0] + (x * Q16x);
+    om->rbv[x] = om->rbv[0] + (x * Q16);
+  }
+
+  if (view_get(&p, end, om->evparam, sizeof(float) * p7_NEVPARAM) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read stat params");
+  if (view_get(&p, end, om->offs,    sizeof(off_t) * p7_NOFFSETS) != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read hmmpfam offsets");
+  if (view_get(&p, end, om->compo,   sizeof(float) * p7_MAXABET)  != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "failed to read model composition");
+  if (view_get(&p, end, &magic,      sizeof(uint32_t))            != eslOK) ESL_XFAIL(eslEFORMAT, hfp->errbuf, "no sentinel magic: .h3f file corrupted?");
+  if (magic != v3g_fmagic)                                                  ESL_XFAIL(eslEFORMAT, hfp->errbuf, "bad sentinel magic; .h3f file corrupted?");
+
+  om->eoff = (p - hfp->fmap) - 1;
+  if (fseeko(hfp->ffp, p - hfp->fmap, SEEK_SET) != 0) ESL_XEXCEPTION(eslESYS, "fseeko() failed");
+
+  p7_oprofile_RestripeMSV(om);
+
+  if (byp_abc != NULL) *byp_abc = abc; 
+  *ret_om = om;
+  return eslOK;
+
+ ERROR:
+  if (abc && (byp_abc == NULL || *byp_abc == NULL)) esl_alphabet_Destroy(abc);
+  p7_oprofile_Destroy(om);
+  *ret_om = NULL;
+  return status;
+}
+
+static int
+read_rest_view(P7_HMMFILE *hfp, P7_OPROFILE *om)
+{
+  const char   *end = hfp->pmap + hfp->npmap;
+  const char   *p;
+  const char   *name;
+  uint32_t      magic;
+  int           M, Q4, Q8;
+  int           x,n;
+  int           alphatype;
+  int           status;
+
+  hfp->rr_errbuf[0] = '\0';
+  if (hfp->pmap == NULL)                                         ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "profile is a view, but no mapped .h3p file");
+  if (om->offs[p7_POFFSET] < 0 || om->offs[p7_POFFSET] >= hfp->npmap) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad .h3p offset");
+  p = hfp->pmap + om->offs[p7_POFFSET];
+
+  if (view_get(&p, end, &magic,     sizeof(uint32_t)) != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read magic");
+  if ((status = check_magic(magic, FALSE, hfp->rr_errbuf)) != eslOK) goto ERROR;
+  if (view_get(&p, end, &M,         sizeof(int))      != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read model size M");
+  if (view_get(&p, end, &alphatype, sizeof(int))      != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read alphabet type");
+  if (view_get(&p, end, &n,         sizeof(int))      != eslOK)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name length");
+  if (M         != om->M)                                        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f model length mismatch");
+  if (alphatype != om->abc->type)                                ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f alphabet type mismatch");
+  if ((name = view_str(&p, end, n))                   == NULL)   ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read name");
+  if (strcmp(name, om->name) != 0)                               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "p/f name mismatch");
+
+  if (view_get(&p, end, &n, sizeof(int)) != eslOK)               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession length");
+  if (n > 0 && (om->acc  = view_str(&p, end, n)) == NULL)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read accession");
+  if (view_get(&p, end, &n, sizeof(int)) != eslOK)               ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description length");
+  if (n > 0 && (om->desc = view_str(&p, end, n)) == NULL)        ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read description");
+
+  if ((size_t) (end - p) < 4 * (size_t) (M+2))                   ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read annotation");
+  om->rf        = (char *) p;  p += M+2;
+  om->mm        = (char *) p;  p += M+2;
+  om->cs        = (char *) p;  p += M+2;
+  om->consensus = (char *) p;  p += M+2;
+
+  Q4  = p7O_NQF(om->M);
+  Q8  = p7O_NQW(om->M);
+
+  if ((om->twv    = view_vec(&p, end, sizeof(__m128i) * 8 * Q8))       == NULL)  ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tu>, vitfilter transitions");
+  if ((om->rwv[0] = view_vec(&p, end, sizeof(__m128i) * om->abc->Kp * Q8)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <ru>, vitfilter emissions");
+  for (x = 1; x < om->abc->Kp; x++) om->rwv[x] = om->rwv[0] + (x * Q8);
+  if (view_get(&p, end, om->xw,              sizeof(om->xw))   != eslOK)          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xu>, vitfilter special transitions");
+  if (view_get(&p, end, &(om->scale_w),      sizeof(float))    != eslOK)          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read scale_w");
+  if (view_get(&p, end, &(om->base_w),       sizeof(int16_t))  != eslOK)          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read base_w");
+  if (view_get(&p, end, &(om->ddbound_w),    sizeof(int16_t))  != eslOK)          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ddbound_w");
+  if (view_get(&p, end, &(om->ncj_roundoff), sizeof(float))    != eslOK)          ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read ncj_roundoff");
+
+  if ((om->tfv    = view_vec(&p, end, sizeof(__m128) * 8 * Q4))           == NULL) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <tf> transitions");
+  if ((om->rfv[0] = view_vec(&p, end, sizeof(__m128) * om->abc->Kp * Q4)) == NULL) ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <rf> emissions");
+  for (x = 1; x < om->abc->Kp; x++) om->rfv[x] = om->rfv[0] + (x * Q4);
+  if (view_get(&p, end, om->xf,         sizeof(om->xf))              != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read <xf> special transitions");
+
+  if (view_get(&p, end, om->cutoff,     sizeof(float) * p7_NCUTOFFS) != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read Pfam score cutoffs");
+  if (view_get(&p, end, &(om->nj),      sizeof(float))               != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read nj");
+  if (view_get(&p, end, &(om->mode),    sizeof(int))                 != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read mode");
+  if (view_get(&p, end, &(om->L),       sizeof(int))                 != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "failed to read L");
+  if (view_get(&p, end, &magic,         sizeof(uint32_t))            != eslOK)     ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "no sentinel magic: .h3p file corrupted?");
+  if (magic != v3g_pmagic)                                                         ESL_XFAIL(eslEFORMAT, hfp->rr_errbuf, "bad sentinel magic; .h3p file corrupted?");
+
+  p7_oprofile_RestripeRest(om);
+  return eslOK;
+
+ ERROR:
+  return status;
+}
 /*----------- end, reading optimized profiles -------------------*/
 
 
@@ -706,6 +924,61 @@ p7_oprofile_Position(P7_HMMFILE *hfp, off_t offset)
   return eslOK;
 }
 
+
+/* check_magic()
+ * Return <eslOK> if <magic> is the current .h3f magic (<is_msv> TRUE)
+ * or .h3p magic (FALSE). Otherwise return <eslEFORMAT>, with a message
+ * in <errbuf> saying whether it's an outdated format or not one at all.
+ */
+static int
+check_magic(uint32_t magic, int is_msv, char *errbuf)
+{
+  char v = '\0';
+
+  if (magic == (is_msv ? v3g_fmagic : v3g_pmagic)) return eslOK;
+
+  if      (magic == (is_msv ? v3f_fmagic : v3f_pmagic)) v = 'f';
+  else if (magic == (is_msv ? v3e_fmagic : v3e_pmagic)) v = 'e';
+  else if (magic == (is_msv ? v3d_fmagic : v3d_pmagic)) v = 'd';
+  else if (magic == (is_msv ? v3c_fmagic : v3c_pmagic)) v = 'c';
+  else if (magic == (is_msv ? v3b_fmagic : v3b_pmagic)) v = 'b';
+  else if (magic == (is_msv ? v3a_fmagic : v3a_pmagic)) v = 'a';
+
+  if (v) ESL_FAIL(eslEFORMAT, errbuf, "binary auxfiles are in an outdated HMMER format (3/%c); please hmmpress your HMM file again", v);
+  if (is_msv) ESL_FAIL(eslEFORMAT, errbuf, "bad magic; not an HMM database?");
+  else        ESL_FAIL(eslEFORMAT, errbuf, "bad magic; not an HMM database file?");
+}
+
+
+/* write_pad(), read_pad()
+ * Write zeros, or read past them, up to the next file offset that's
+ * a multiple of p7O_FILEALIGN, where a block of vectors starts.
+ */
+static int
+write_pad(FILE *fp)
+{
+  static const char zeros[p7O_FILEALIGN] = { 0 };
+  off_t             offset;
+  size_t            n;
+
+  if ((offset = ftello(fp)) == -1) ESL_EXCEPTION_SYS(eslEWRITE, "ftello() failed");
+  n = (p7O_FILEALIGN - offset % p7O_FILEALIGN) % p7O_FILEALIGN;
+  if (n > 0 && fwrite(zeros, sizeof(char), n, fp) != n) ESL_EXCEPTION_SYS(eslEWRITE, "oprofile write failed");
+  return eslOK;
+}
+
+static int
+read_pad(FILE *fp)
+{
+  char   buf[p7O_FILEALIGN];
+  off_t  offset;
+  size_t n;
+
+  if ((offset = ftello(fp)) == -1) return eslEFORMAT;
+  n = (p7O_FILEALIGN - offset % p7O_FILEALIGN) % p7O_FILEALIGN;
+  if (n > 0 && fread(buf, sizeof(char), n, fp) != n) return eslEFORMAT;
+  return eslOK;
+}
 /*-------------------- end, utility routines ---------------------*/
 
 
@@ -853,6 +1126,19 @@ utest_ReadWrite(P7_HMM *hmm, P7_OPROFILE *om)
        
   p7_oprofile_Destroy(om2);
   p7_hmmfile_Close(hfp);
+
+  /* 4. again, mapped: now it's a view into the .h3f/.h3p files, and
+   *    can still be destroyed after they're closed.
+   */
+  if ( p7_hmmfile_Open(tmpfile, NULL, &hfp, NULL)  != eslOK) esl_fatal(msg);
+  if ( p7_hmmfile_Mmap(hfp)                        != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_ReadMSV(hfp, &abc, &om2)        != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_ReadRest(hfp, om2)              != eslOK) esl_fatal(msg);
+  if ( ! om2->view)                                          esl_fatal(msg);
+  if ( p7_oprofile_Compare(om, om2, tolerance, errbuf) != eslOK) esl_fatal("%s\n%s", msg, errbuf);
+  p7_hmmfile_Close(hfp);
+  p7_oprofile_Destroy(om2);
+
   esl_alphabet_Destroy(abc);
   remove(ssifile);
   remove(ffile);
@@ -450,6 +450,10 @@ p7_oprofile_MPIUnpack(char *buf, int n, int *pos, MPI_Comm comm, ESL_ALPHABET **
   if (MPI_Unpack(buf, n, pos,  om->cutoff,       p7_NCUTOFFS,          MPI_FLOAT, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi unpack failed");
   if (MPI_Unpack(buf, n, pos,  om->compo,        p7_MAXABET,           MPI_FLOAT, comm) != 0) ESL_EXCEPTION(eslESYS, "mpi unpack failed");
 
+  /* wide copies of the vector scores, for AVX2/AVX-512 kernels */
+  p7_oprofile_RestripeMSV(om);
+  p7_oprofile_RestripeRest(om);
+
   *ret_om = om;
   return eslOK;
 
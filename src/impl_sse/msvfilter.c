@@ -72,6 +72,29 @@
  */
 int
 p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  switch (om->simd) {
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return p7_MSVFilter_avx512(dsq, L, om, ox, ret_sc);
+#endif
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return p7_MSVFilter_avx(dsq, L, om, ox, ret_sc);
+#endif
+  default:             return p7_MSVFilter_sse(dsq, L, om, ox, ret_sc);
+  }
+}
+
+
+/* Function:  p7_MSVFilter_sse()
+ * Synopsis:  SSE implementation of <p7_MSVFilter()>.
+ *
+ * Purpose:   The 128-bit implementation, which <p7_MSVFilter()> calls
+ *            for profiles built for SSE (<om->simd>; see simd.c).
+ *            Unit tests and benchmarks of the wider implementations
+ *            compare against it.
+ */
+int
+p7_MSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv;            /* previous row values                                       */
   register __m128i xEv;		   /* E state: keeps max for Mk->E as we go                     */
@@ -100,7 +123,7 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
   ox->M   = om->M;
 
   /* Try highly optimized ssv filter first */
-  status = p7_SSVFilter(dsq, L, om, ret_sc);
+  status = p7_SSVFilter_sse(dsq, L, om, ret_sc);
   if (status != eslENORESULT) return status;
 
   /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
@@ -206,7 +229,7 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
 
   return eslOK;
 }
-/*------------------ end, p7_MSVFilter() ------------------------*/
+/*------------------ end, p7_MSVFilter_sse() --------------------*/
 
 
 
@@ -0,0 +1,561 @@
+/* The MSV filter, run across a block of target sequences at once.
+ *
+ * p7_MSVFilter() stripes the model across vector lanes, which wastes
+ * most of each vector when the query is short: a model of M=40 needs
+ * Q=3 vectors, 48 lanes, per row, and for short targets the per-call
+ * overhead (setup, the SSV try, the horizontal max on every row)
+ * dominates. Here, instead, each of 16 vector lanes carries a
+ * different target sequence, and there's one vector per model
+ * position k. The DP is the same uint8_t MSV calculation as
+ * p7_MSVFilter(), lane by lane, so scores are identical.
+ *
+ * The catch is that each lane needs the match cost for its own
+ * residue. The costs are unstriped into a residue-major table once
+ * per block; each row then loads 16 consecutive k for each lane's
+ * residue and transposes the 16x16 bytes, which only takes SSE2.
+ *
+ * Sequences are taken in order of length, so that lanes in the same
+ * group finish at about the same row. Models of p7_MSVBLOCK_MAXM
+ * nodes or more gain nothing from this; they go through p7_MSVFilter()
+ * one sequence at a time, so the pipeline can call
+ * p7_MSVFilter_Block() for any query.
+ *
+ * Contents:
+ *   1. p7_MSVFilter_Block() implementation
+ *   2. Benchmark driver
+ *   3. Unit tests
+ *   4. Test driver
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <xmmintrin.h>		/* SSE  */
+#include <emmintrin.h>		/* SSE2 */
+
+#include "easel.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static int  msv_striped(const ESL_SQ_BLOCK *block, P7_OPROFILE *om, P7_OMX *ox, float *usc);
+static int  order_sorter(const void *vh1, const void *vh2);
+static void msv_lanes(P7_OPROFILE *om, const ESL_SQ_BLOCK *block, const int64_t *order, int n,
+		      const uint8_t *cost, int Mp, __m128i *dp, float *usc);
+
+/*****************************************************************
+ * 1. p7_MSVFilter_Block() implementation
+ *****************************************************************/
+
+/* Function:  p7_MSVFilter_Block()
+ * Synopsis:  MSV scores for a block of sequences, 16 at a time.
+ *
+ * Purpose:   Calculate the MSV filter score of each sequence in
+ *            <block> against <om>, setting <usc[i]> to the score (in
+ *            nats) of <block->list[i]>. Each score is exactly what
+ *            <p7_MSVFilter()> would return with <om> configured for
+ *            that sequence's length; a sequence that overflows gets
+ *            <eslINFINITY>, as <p7_MSVFilter()> does when it returns
+ *            <eslERANGE>.
+ *
+ *            Sequences are interleaved, one per vector lane, for
+ *            models with <M < p7_MSVBLOCK_MAXM>, where that is faster
+ *            than the striped <p7_MSVFilter()>. Bigger models are
+ *            scored by <p7_MSVFilter()> itself, one sequence at a
+ *            time, so this can be called for any model; that is what
+ *            <p7_Pipeline_Block()> does.
+ *
+ *            <om> only has to be configured (<p7_oprofile_Convert()>).
+ *            Its MSV length configuration is changed for each
+ *            sequence, and restored on return. <ox> provides scratch
+ *            space, which is reallocated as needed; its DP matrix is
+ *            not used, and it can be of any size.
+ *
+ * Args:      block - target sequences, digital
+ *            om    - optimized profile
+ *            ox    - DP matrix, for its scratch space
+ *            usc   - RETURN: MSV scores, [0..block->count-1]; caller allocated
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_MSVFilter_Block(const ESL_SQ_BLOCK *block, P7_OPROFILE *om, P7_OMX *ox, float *usc)
+{
+  int      M        = om->M;
+  int      Q        = p7O_NQB(M);
+  int      Mp       = ((M + 15) / 16) * 16; /* k padded out to whole 16x16 transposes      */
+  int      Kp       = om->abc->Kp;
+  uint8_t  tjb_save = om->tjb_b;
+  int64_t  need;
+  __m128i *dp;			/* [0..Mp-1]: M(i-1,k) for 16 sequences, one k per vector */
+  uint8_t *cost;		/* [x*Mp+k-1]: MSV match costs, unstriped                 */
+  uint8_t *rb;
+  int64_t *order;		/* [0..count-1]: length<<32 | index into block, sorted    */
+  int      b, x, k;
+  int      status;
+
+  if (M >= p7_MSVBLOCK_MAXM) return msv_striped(block, om, ox, usc);
+
+  need = sizeof(__m128i) * Mp + (int64_t) Kp * Mp + sizeof(int64_t) * block->count + 15;
+  if (need > ox->nbmem) {
+    ESL_REALLOC(ox->bmem, need);
+    ox->nbmem = need;
+  }
+  dp    = (__m128i *) (((unsigned long int) ox->bmem + 15) & (~0xf));
+  cost  = (uint8_t *) (dp + Mp);
+  order = (int64_t *) (cost + Kp * Mp);
+
+  /* The striped costs, residue x at position k, into cost[x][k]; padding is impossible (255) */
+  for (x = 0; x < Kp; x++)
+    {
+      rb = (uint8_t *) om->rbv[x];
+      for (k = 0; k < M;  k++) cost[x*Mp + k] = rb[(k % Q) * 16 + k / Q];
+      for (     ; k < Mp; k++) cost[x*Mp + k] = 255;
+    }
+
+  for (b = 0; b < block->count; b++) order[b] = (block->list[b].n << 32) | b;
+  qsort(order, block->count, sizeof(int64_t), order_sorter);
+
+  for (b = 0; b < block->count; b += 16)
+    msv_lanes(om, block, order + b, ESL_MIN(16, block->count - b), cost, Mp, dp, usc);
+
+  om->tjb_b = tjb_save;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* msv_striped()
+ * p7_MSVFilter_Block() for a model too big to gain from interleaving
+ * sequences: p7_MSVFilter() on each sequence in turn, with <om>
+ * configured for its length.
+ */
+static int
+msv_striped(const ESL_SQ_BLOCK *block, P7_OPROFILE *om, P7_OMX *ox, float *usc)
+{
+  uint8_t tjb_save = om->tjb_b;
+  ESL_SQ *sq;
+  int     b;
+  int     status;
+
+  for (b = 0; b < block->count; b++)
+    {
+      sq = block->list + b;
+      if (sq->n == 0) { usc[b] = -eslINFINITY; continue; } /* the pipeline skips these anyway */
+
+      if ((status = p7_omx_GrowTo(ox, om->M, 0, sq->n)) != eslOK) goto ERROR;
+      p7_oprofile_ReconfigMSVLength(om, sq->n);
+      p7_MSVFilter(sq->dsq, sq->n, om, ox, &(usc[b])); /* eslERANGE leaves usc[b] = eslINFINITY */
+    }
+
+  om->tjb_b = tjb_save;
+  return eslOK;
+
+ ERROR:
+  om->tjb_b = tjb_save;
+  return status;
+}
+
+
+/* order_sorter(): qsort's pawn, below; shortest sequences first */
+static int
+order_sorter(const void *vh1, const void *vh2)
+{
+  int64_t o1 = *((const int64_t *) vh1);
+  int64_t o2 = *((const int64_t *) vh2);
+
+  if      (o1 < o2) return -1;
+  else if (o1 > o2) return  1;
+  else              return  0;
+}
+
+
+/* transpose16()
+ * Transpose a 16x16 byte matrix held in r[0..15], in place: afterwards
+ * byte z of r[j] is what was byte j of r[z]. Four rounds of the same
+ * interleave of r[j] with r[j+8] does it.
+ */
+static inline void
+transpose16(__m128i *r)
+{
+  __m128i t[16];
+  int     round, j;
+
+  for (round = 0; round < 4; round++)
+    {
+      for (j = 0; j < 8; j++)
+	{
+	  t[2*j]   = _mm_unpacklo_epi8(r[j], r[j+8]);
+	  t[2*j+1] = _mm_unpackhi_epi8(r[j], r[j+8]);
+	}
+      for (j = 0; j < 16; j++) r[j] = t[j];
+    }
+}
+
+
+/* msv_lanes()
+ * The MSV filter for up to 16 sequences, <order[0..n-1]>, one per
+ * lane. Same arithmetic as p7_MSVFilter_sse(), except that each lane
+ * has its own length-dependent tjb cost, and lanes stop updating
+ * their J state once their sequence ends.
+ */
+static void
+msv_lanes(P7_OPROFILE *om, const ESL_SQ_BLOCK *block, const int64_t *order, int n,
+	  const uint8_t *cost, int Mp, __m128i *dp, float *usc)
+{
+  const ESL_DSQ *dsq[16];
+  const uint8_t *row[16];	/* cost[] row for each lane's current residue      */
+  int64_t  L[16];
+  uint8_t  tjb[16], tjbm[16];	/* per-lane N/J->B cost, and that + B->M cost       */
+  uint8_t  act[16];		/* 0xff for lanes still in their sequence, else 0   */
+  uint8_t  xJ[16], ovf[16];
+  __m128i  r[16];		/* 16 lanes' costs for 16 consecutive k; transposed */
+  __m128i  biasv    = _mm_set1_epi8((int8_t) om->bias_b);
+  __m128i  basev    = _mm_set1_epi8((int8_t) om->base_b);
+  __m128i  tecv     = _mm_set1_epi8((int8_t) om->tec_b);
+  __m128i  ceilingv = _mm_cmpeq_epi8(biasv, biasv);
+  __m128i  tjbmv, xJv, xBv, xEv, mpv, sv, activev, ovfv;
+  int64_t  Lmax = 0;
+  int64_t  i;
+  int      z, k, j;
+
+  for (z = 0; z < 16; z++)
+    {
+      if (z < n) {
+	dsq[z] = block->list[order[z] & 0xffffffff].dsq;
+	L[z]   = block->list[order[z] & 0xffffffff].n;
+	p7_oprofile_ReconfigMSVLength(om, L[z]);
+	tjb[z] = om->tjb_b;
+      } else {
+	dsq[z] = NULL;
+	L[z]   = 0;
+	tjb[z] = 0;
+      }
+      tjbm[z] = tjb[z] + om->tbm_b;
+      Lmax    = ESL_MAX(Lmax, L[z]);
+    }
+
+  tjbmv = _mm_loadu_si128((__m128i *) tjbm);
+  xJv   = _mm_setzero_si128();
+  xBv   = _mm_subs_epu8(basev, tjbmv);
+  ovfv  = _mm_setzero_si128();
+  for (k = 0; k < Mp; k++) dp[k] = _mm_setzero_si128();
+
+  for (i = 1; i <= Lmax; i++)
+    {
+      for (z = 0; z < 16; z++)
+	{
+	  act[z] = (i <= L[z]) ? 0xff : 0;
+	  row[z] = cost + (act[z] ? dsq[z][i] : 0) * Mp;
+	}
+      activev = _mm_loadu_si128((__m128i *) act);
+      xEv     = _mm_setzero_si128();
+      mpv     = _mm_setzero_si128(); /* M(i-1,0) is -infinity */
+
+      for (k = 0; k < Mp; k += 16)
+	{
+	  for (z = 0; z < 16; z++) r[z] = _mm_load_si128((__m128i *) (row[z] + k));
+	  transpose16(r);
+
+	  for (j = 0; j < 16; j++)
+	    {
+	      sv      = _mm_max_epu8(mpv, xBv);
+	      sv      = _mm_adds_epu8(sv, biasv);
+	      sv      = _mm_subs_epu8(sv, r[j]);
+	      xEv     = _mm_max_epu8(xEv, sv);
+	      mpv     = dp[k+j];
+	      dp[k+j] = sv;
+	    }
+	}
+
+      /* a lane that overflows is a high scoring hit; flag it, and let it run on */
+      ovfv = _mm_or_si128(ovfv, _mm_and_si128(activev, _mm_cmpeq_epi8(_mm_adds_epu8(xEv, biasv), ceilingv)));
+
+      xEv = _mm_subs_epu8(xEv, tecv);
+      xJv = _mm_max_epu8(xJv, _mm_and_si128(xEv, activev));
+      xBv = _mm_max_epu8(basev, xJv);
+      xBv = _mm_subs_epu8(xBv, tjbmv);
+    }
+
+  _mm_storeu_si128((__m128i *) xJ,  xJv);
+  _mm_storeu_si128((__m128i *) ovf, ovfv);
+  for (z = 0; z < n; z++)
+    {
+      if (ovf[z]) usc[order[z] & 0xffffffff] = eslINFINITY;
+      else        usc[order[z] & 0xffffffff] = ((float) (xJ[z] - tjb[z]) - (float) om->base_b) / om->scale_b - 3.0;
+    }
+}
+/*------------- end, p7_MSVFilter_Block() -----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7MSVFILTER_BLOCK_BENCHMARK
+/*
+   gcc -o msvfilter_block_benchmark -std=gnu99 -g -O3 -Wall -msse2 -I.. -L.. -I../../easel -L../../easel -Dp7MSVFILTER_BLOCK_BENCHMARK msvfilter_block.c -lhmmer -leasel -lm
+
+   ./msvfilter_block_benchmark <hmmfile>          runs benchmark, blocks of 1000 seqs
+   ./msvfilter_block_benchmark -b <hmmfile>       same seqs, one p7_MSVFilter() at a time, for comparison
+   ./msvfilter_block_benchmark -N1000 -c <hmmfile> compare scores to p7_MSVFilter()
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-b",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-c", "baseline: time p7_MSVFilter() on the same seqs",  0 },
+  { "-c",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, "-b", "compare scores to p7_MSVFilter() (debug)",         0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-B",        eslARG_INT,   "1000", NULL, "n>0", NULL,  NULL, NULL, "number of seqs per block",                         0 },
+  { "-L",        eslARG_INT,    "150", NULL, "n>0", NULL,  NULL, NULL, "mean length of random target seqs",                0 },
+  { "-N",        eslARG_INT, "200000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for p7_MSVFilter_Block()";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  ESL_SQ_BLOCK   *block   = NULL;
+  int             B       = esl_opt_GetInteger(go, "-B");
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  float          *usc     = malloc(sizeof(float) * B);
+  float           sc;
+  int64_t         nres    = 0;
+  int             i, n;
+  double          Mcs;
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  ox = p7_omx_Create(gm->M, 0, 0);
+
+  /* One block of random seqs of lengths L/2..3L/2, reused; we're timing the filter, not the generator */
+  block = esl_sq_CreateDigitalBlock(B, abc);
+  for (i = 0; i < B; i++)
+    {
+      n = L/2 + esl_rnd_Roll(r, L+1);
+      esl_sq_GrowTo(block->list + i, n);
+      esl_rsq_xfIID(r, bg->f, abc->K, n, block->list[i].dsq);
+      block->list[i].n = n;
+      nres += n;
+    }
+  block->count = B;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i += B)
+    {
+      if (esl_opt_GetBoolean(go, "-b"))
+	{
+	  for (n = 0; n < B; n++)
+	    {
+	      p7_oprofile_ReconfigMSVLength(om, block->list[n].n);
+	      p7_MSVFilter(block->list[n].dsq, block->list[n].n, om, ox, &usc[n]);
+	    }
+	}
+      else p7_MSVFilter_Block(block, om, ox, usc);
+
+      if (esl_opt_GetBoolean(go, "-c"))
+	for (n = 0; n < B; n++)
+	  {
+	    p7_oprofile_ReconfigMSVLength(om, block->list[n].n);
+	    p7_MSVFilter(block->list[n].dsq, block->list[n].n, om, ox, &sc);
+	    printf("%.4f %.4f\n", usc[n], sc);
+	  }
+    }
+  esl_stopwatch_Stop(w);
+  Mcs = (double) (N / B) * (double) nres * (double) gm->M * 1e-6 / w->user;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(usc);
+  esl_sq_DestroyBlock(block);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7MSVFILTER_BLOCK_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7MSVFILTER_BLOCK_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_block()
+ * Scores for a block of <N> sequences of random lengths 0..L must be
+ * identical to p7_MSVFilter()'s, one at a time. Some of the sequences
+ * are emitted from the model, to get high scores and some overflows.
+ */
+static void
+utest_block(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  char          msg[] = "msvfilter_block unit test failed";
+  P7_HMM       *hmm   = NULL;
+  P7_PROFILE   *gm    = NULL;
+  P7_OPROFILE  *om    = NULL;
+  P7_OMX       *ox    = p7_omx_Create(M, 0, 0);
+  ESL_SQ_BLOCK *block = esl_sq_CreateDigitalBlock(N, abc);
+  float        *usc   = malloc(sizeof(float) * N);
+  float         sc;
+  int           status;
+  int           i, n;
+
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  om->tjb_b = 42;		/* a sentinel: p7_MSVFilter_Block() must restore it */
+
+  for (i = 0; i < N; i++)
+    {
+      if (i % 4 == 0)
+	{
+	  do {
+	    esl_sq_Reuse(block->list + i);
+	    p7_ProfileEmit(r, hmm, gm, bg, block->list + i, NULL);
+	  } while (block->list[i].n > 10*L);
+	}
+      else
+	{
+	  n = esl_rnd_Roll(r, L+1);
+	  esl_sq_GrowTo(block->list + i, n);
+	  esl_rsq_xfIID(r, bg->f, abc->K, n, block->list[i].dsq);
+	  block->list[i].n = n;
+	}
+    }
+  block->count = N;
+
+  if (p7_MSVFilter_Block(block, om, ox, usc) != eslOK) esl_fatal(msg);
+  if (om->tjb_b != 42)                                 esl_fatal(msg);
+
+  for (i = 0; i < N; i++)
+    {
+      if (block->list[i].n == 0) continue; /* p7_MSVFilter() isn't defined for L=0 */
+      p7_oprofile_ReconfigMSVLength(om, block->list[i].n);
+      status = p7_MSVFilter(block->list[i].dsq, block->list[i].n, om, ox, &sc);
+      if (status != eslOK && status != eslERANGE) esl_fatal(msg);
+      if (sc != usc[i]) esl_fatal("%s: seq %d (L=%d) scores differ (%.4f, %.4f)", msg, i, (int) block->list[i].n, usc[i], sc);
+    }
+
+  free(usc);
+  esl_sq_DestroyBlock(block);
+  p7_omx_Destroy(ox);
+  p7_hmm_Destroy(hmm);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7MSVFILTER_BLOCK_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7MSVFILTER_BLOCK_TESTDRIVE
+/*
+   gcc -g -Wall -msse2 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o msvfilter_block_utest -Dp7MSVFILTER_BLOCK_TESTDRIVE msvfilter_block.c -lhmmer -leasel -lm
+   ./msvfilter_block_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "maximum length of random sequences",             0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences in the block",        0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for p7_MSVFilter_Block()";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+  utest_block(r, abc, bg,  40, L, N);
+  utest_block(r, abc, bg,  10, L, 10);  /* small models                     */
+  utest_block(r, abc, bg, 145, L, 17);  /* past p7_MSVBLOCK_MAXM, so the striped fallback; and a partial group */
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+  utest_block(r, abc, bg,  40, L, N);
+  utest_block(r, abc, bg,  10, L, 10);
+  utest_block(r, abc, bg, 145, L, 17);
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7MSVFILTER_BLOCK_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
@@ -0,0 +1,405 @@
+/* The MSV filter implementation; AVX2 and AVX-512 versions.
+ * 
+ * Same algorithm as the SSE p7_MSVFilter() in msvfilter.c, striped
+ * across p7W_NB (32 or 64) uint8_t lanes instead of 16. Compiled
+ * once per instruction set, into p7_MSVFilter_avx() and
+ * p7_MSVFilter_avx512(); see impl_avx.h. The striped match scores
+ * are read from om->rbv_avx[] or om->rbv_avx512[], which
+ * p7_oprofile_RestripeMSV() keeps in sync with the SSE om->rbv[],
+ * and the one DP row lives in the wide row <ox->wrow>.
+ * 
+ * Contents:
+ *   1. p7_MSVFilter_avx(), p7_MSVFilter_avx512() implementation
+ *   2. Benchmark driver
+ *   3. Unit tests
+ *   4. Test driver
+ */
+#include <p7_config.h>
+#include "impl_avx.h"
+#ifdef p7_WIDE_ENABLED
+
+#include <stdio.h>
+#include <math.h>
+
+#include <immintrin.h>
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+/*****************************************************************
+ * 1. The p7_MSVFilter_avx(), p7_MSVFilter_avx512() DP implementation.
+ *****************************************************************/
+
+/* Function:  p7_MSVFilter_avx(), p7_MSVFilter_avx512()
+ * Synopsis:  Calculates MSV score with AVX2 or AVX-512 vectors.
+ *
+ * Purpose:   Same as <p7_MSVFilter()>: calculates an approximation of
+ *            the MSV score for sequence <dsq> of length <L> residues,
+ *            using optimized profile <om> and a preallocated one-row
+ *            DP matrix <ox>, and returns the estimated MSV score (in
+ *            nats) in <ret_sc>. Scores are identical to the SSE
+ *            version's.
+ *
+ *            The SSV filter is tried first, exactly as in
+ *            <p7_MSVFilter()>.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            ox      - DP matrix
+ *            ret_sc  - RETURN: MSV score (in nats)          
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslERANGE> if the score overflows the limited range; in
+ *            this case, this is a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small.
+ */
+int
+p7W_NAME(p7_MSVFilter)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  register p7W_vec mpv;            /* previous row values                                       */
+  register p7W_vec xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register p7W_vec xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register p7W_vec sv;		   /* temp storage of 1 curr row value in progress              */
+  register p7W_vec biasv;	   /* emission bias in a vector                                 */
+  p7W_vec xJv;                     /* vector for states score                                   */
+  p7W_vec tjbmv;                   /* vector for cost of moving from either J or N through B to an M state */
+  p7W_vec tecv;                    /* vector for E->C  cost                                     */
+  p7W_vec basev;                   /* offset for scores                                         */
+  uint8_t  xE, xJ;                 /* special states' scores                                    */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7W_NQB(om->M); /* segment length: # of vectors                           */
+  p7W_vec *dp  = (p7W_vec *) ox->wrow; /* one row, dp[0..Q-1]                                  */
+  p7W_vec *rsc;			   /* will point at om->rbv_avx[x] (or _avx512) for residue x[i] */
+  int status;
+
+  /* Check that the DP matrix is ok for us. */
+  if (om->M > ox->allocWM)  ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  ox->M   = om->M;
+
+  /* Try highly optimized ssv filter first */
+  status = p7W_NAME(p7_SSVFilter)(dsq, L, om, ret_sc);
+  if (status != eslENORESULT) return status;
+
+  /* Initialization. In offset unsigned arithmetic, -infinity is 0, and 0 is om->base.
+   */
+  biasv = p7W(set1_epi8)((int8_t) om->bias_b);
+  for (q = 0; q < Q; q++) dp[q] = p7W_setzero_si();
+
+  basev = p7W(set1_epi8)((int8_t) om->base_b);
+  tjbmv = p7W(set1_epi8)((int8_t) om->tjb_b + (int8_t) om->tbm_b);
+  tecv  = p7W(set1_epi8)((int8_t) om->tec_b);
+
+  xJv = p7W_setzero_si();
+  xBv = p7W(subs_epu8)(basev, tjbmv);
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc = om->p7W_NAME(rbv)[dsq[i]];
+      xEv = p7W_setzero_si();
+
+      /* Right shift by one byte, across lanes; zeros (-infinity) shift on. */
+      mpv = p7W_rightshift_epi8(dp[Q-1]);
+      for (q = 0; q < Q; q++)
+	{
+	  sv   = p7W(max_epu8)(mpv, xBv);
+	  sv   = p7W(adds_epu8)(sv, biasv);
+	  sv   = p7W(subs_epu8)(sv, *rsc);   rsc++;
+	  xEv  = p7W(max_epu8)(xEv, sv);
+
+	  mpv   = dp[q];   	  /* Load {MDI}(i-1,q) into mpv */
+	  dp[q] = sv;       	  /* Do delayed store of M(i,q) now that memory is usable */
+	}
+
+      /* Overflow test. The SSE code compares xEv+bias against a
+       * saturated vector before reducing; testing the reduced max is
+       * equivalent, and one horizontal max is all we need here.
+       */
+      xE = p7W_hmax_epu8(xEv);
+      if (xE >= 255 - om->bias_b) { *ret_sc = eslINFINITY; return eslERANGE; }
+
+      xEv = p7W(set1_epi8)((int8_t) xE);
+      xEv = p7W(subs_epu8)(xEv, tecv);
+      xJv = p7W(max_epu8)(xJv, xEv);
+      xBv = p7W(max_epu8)(basev, xJv);
+      xBv = p7W(subs_epu8)(xBv, tjbmv);
+    } /* end loop over sequence residues 1..L */
+
+  xJ = (uint8_t) _mm_cvtsi128_si32(p7W_cast_si128(xJv));
+
+  /* finally C->T, and add our missing precision on the NN,CC,JJ back */
+  *ret_sc = ((float) (xJ - om->tjb_b) - (float) om->base_b);
+  *ret_sc /= om->scale_b;
+  *ret_sc -= 3.0; /* that's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ */
+  return eslOK;
+}
+/*------------------ end, p7_MSVFilter_avx*() ---------------------*/
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+/* Same as the msvfilter.c benchmark; -s compares to the SSE
+ * p7_MSVFilter_sse(), which must give exactly the same scores.
+ */
+#ifdef p7MSVFILTER_WIDE_BENCHMARK
+/* 
+   gcc -o msvfilter_avx_benchmark    -std=gnu99 -g -O3 -Wall -mavx2                 -Dp7_WIDE_AVX    -I.. -L.. -I../../easel -L../../easel -Dp7MSVFILTER_WIDE_BENCHMARK msvfilter_wide.c -lhmmer -leasel -lm 
+   gcc -o msvfilter_avx512_benchmark -std=gnu99 -g -O3 -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -I.. -L.. -I../../easel -L../../easel -Dp7MSVFILTER_WIDE_BENCHMARK msvfilter_wide.c -lhmmer -leasel -lm 
+
+   ./msvfilter_avx_benchmark <hmmfile>            runs benchmark 
+   ./msvfilter_avx_benchmark -N100 -s <hmmfile>   compare scores to SSE impl
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "compare scores to SSE implementation (debug)",     0 }, 
+  { "-S",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for " p7W_ISA " MSVFilter() implementation";
+
+int 
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-S"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           sc1, sc2;
+  double          base_time, bench_time, Mcs;
+
+  if (p7_simd_Set(p7W_SIMD) != eslOK) p7_Fail(p7W_ISA " isn't supported here");
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  ox = p7_omx_Create(gm->M, 0, 0);
+
+  /* Get a baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      p7W_NAME(p7_MSVFilter)(dsq, L, om, ox, &sc1);   
+
+      if (esl_opt_GetBoolean(go, "-s")) 
+	{
+	  p7_MSVFilter_sse(dsq, L, om, ox, &sc2); 
+	  printf("%.4f %.4f\n", sc1, sc2);  
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7MSVFILTER_WIDE_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7MSVFILTER_WIDE_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* 
+ * As in msvfilter.c, scores must be identical (within machine
+ * error) to generic Viterbi with scores rounded the same way. We
+ * also check that the SSE filter returns the same status and score,
+ * since the wide filter is a drop-in replacement for it.
+ */
+static void
+utest_msv_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(M, 0, 0);
+  P7_GMX      *gx  = p7_gmx_Create(M, L);
+  float sc1, sc2, sc3;
+  int   status1, status2;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  p7_profile_SameAsMF(om, gm);
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      status1 = p7W_NAME(p7_MSVFilter)(dsq, L, om, ox, &sc1);
+      status2 = p7_MSVFilter_sse  (dsq, L, om, ox, &sc2);
+      p7_GViterbi (dsq, L, gm, gx, &sc3);
+
+      sc3 = sc3 / om->scale_b - 3.0f;
+      if (status1 != status2)     esl_fatal(p7W_ISA " msv filter unit test failed: status differs from SSE (%d, %d)", status1, status2);
+      if (sc1 != sc2)             esl_fatal(p7W_ISA " msv filter unit test failed: score differs from SSE (%.2f, %.2f)", sc1, sc2);
+      if (fabs(sc1-sc3) > 0.001)  esl_fatal(p7W_ISA " msv filter unit test failed: scores differ (%.2f, %.2f)", sc1, sc3);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7MSVFILTER_WIDE_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7MSVFILTER_WIDE_TESTDRIVE
+/* 
+   gcc -g -Wall -mavx2                 -Dp7_WIDE_AVX    -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o msvfilter_avx_utest    -Dp7MSVFILTER_WIDE_TESTDRIVE msvfilter_wide.c -lhmmer -leasel -lm
+   gcc -g -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o msvfilter_avx512_utest -Dp7MSVFILTER_WIDE_TESTDRIVE msvfilter_wide.c -lhmmer -leasel -lm
+   ./msvfilter_avx_utest; ./msvfilter_avx512_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the " p7W_ISA " MSVFilter() implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* nothing to test on a processor without the instruction set */
+  if (p7_simd_Set(p7W_SIMD) != eslOK) { esl_randomness_Destroy(r); esl_getopts_Destroy(go); return 0; }
+
+  /* First round of tests for DNA alphabets.  */
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf(p7W_ISA " MSVFilter() tests, DNA\n");
+  utest_msv_filter(r, abc, bg, M, L, N);   /* normal sized models */
+  utest_msv_filter(r, abc, bg, 1, L, 10);  /* size 1 models       */
+  utest_msv_filter(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+  utest_msv_filter(r, abc, bg, p7W_NB*3+1, L, 10); /* model spans a partial last vector */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf(p7W_ISA " MSVFilter() tests, protein\n");
+  utest_msv_filter(r, abc, bg, M, L, N);   
+  utest_msv_filter(r, abc, bg, 1, L, 10);  
+  utest_msv_filter(r, abc, bg, M, 1, 10);  
+  utest_msv_filter(r, abc, bg, p7W_NB*3+1, L, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7MSVFILTER_WIDE_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
+
+
+
+#else /* ! p7_WIDE_ENABLED */
+/* Provide a dummy symbol, so the object file isn't empty; and if the
+ * test driver is compiled anyway, let it pass trivially.
+ */
+void p7W_NAME(p7_msvfilter_silence_hack)(void) { return; }
+#if defined p7MSVFILTER_WIDE_TESTDRIVE || defined p7MSVFILTER_WIDE_BENCHMARK
+int main(void) { return 0; }
+#endif
+#endif /* p7_WIDE_ENABLED */
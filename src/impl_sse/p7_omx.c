@@ -30,6 +30,27 @@
  * 1. The P7_OMX structure: a dynamic programming matrix
  *****************************************************************/
 
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+/* wrow_size()
+ * Size in bytes of the one wide DP row used by the AVX2/AVX-512
+ * filters and parsers, for models up to length <M>: three float
+ * vectors per segment of whichever enabled width is largest. (Float
+ * rows are always at least as big as the word and byte ones.)
+ */
+static size_t
+wrow_size(int M)
+{
+  size_t n = 0;
+#ifdef eslENABLE_AVX
+  n = ESL_MAX(n, sizeof(__m256) * p7O_NQF_AVX(M)    * p7X_NSCELLS);
+#endif
+#ifdef eslENABLE_AVX512
+  n = ESL_MAX(n, sizeof(__m512) * p7O_NQF_AVX512(M) * p7X_NSCELLS);
+#endif
+  return n;
+}
+#endif
+
 /* Function:  p7_omx_Create()
  * Synopsis:  Create an optimized dynamic programming matrix.
  * Incept:    SRE, Tue Nov 27 08:48:20 2007 [Janelia]
@@ -72,6 +93,12 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ox->dpf    = NULL;
   ox->xmx    = NULL;
   ox->x_mem  = NULL;
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  ox->wrow     = NULL;
+  ox->wrow_mem = NULL;
+#endif
+  ox->bmem     = NULL;
+  ox->nbmem    = 0;
 
   /* DP matrix will be allocated for allocL+1 rows 0,1..L; allocQ4*p7X_NSCELLS columns */
   ox->allocR   = allocL+1;
@@ -100,6 +127,12 @@ p7_omx_Create(int allocM, int allocL, int allocXL)
   ESL_ALLOC(ox->x_mem,  sizeof(float) * ox->allocXR * p7X_NXCELLS + 15); 
   ox->xmx = (float *) ( ( (unsigned long int) ((char *) ox->x_mem  + 15) & (~0xf)));
 
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  ox->allocWM = ox->allocQ4 * 4;
+  ESL_ALLOC(ox->wrow_mem, wrow_size(ox->allocWM) + 63);
+  ox->wrow = (void *) ( ( (unsigned long int) ((char *) ox->wrow_mem + 63) & (~0x3f)));
+#endif
+
   ox->M              = 0;
   ox->L              = 0;
   ox->totscale       = 0.0;
@@ -206,6 +239,15 @@ p7_omx_GrowTo(P7_OMX *ox, int allocM, int allocL, int allocXL)
       ox->allocQ8  = nqw;
       ox->allocQ16 = nqb;
     }
+
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  if (ox->allocQ4*4 > ox->allocWM)
+    {
+      ESL_RALLOC(ox->wrow_mem, p, wrow_size(ox->allocQ4*4) + 63);
+      ox->allocWM = ox->allocQ4*4;
+      ox->wrow    = (void *) ( ( (unsigned long int) ((char *) ox->wrow_mem + 63) & (~0x3f)));
+    }
+#endif
   
   ox->M = 0;
   ox->L = 0;
@@ -299,6 +341,10 @@ p7_omx_Destroy(P7_OMX *ox)
   if (ox->dpf     != NULL) free(ox->dpf);
   if (ox->dpw     != NULL) free(ox->dpw);
   if (ox->dpb     != NULL) free(ox->dpb);
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  if (ox->wrow_mem != NULL) free(ox->wrow_mem);
+#endif
+  if (ox->bmem    != NULL) free(ox->bmem);
   free(ox);
   return;
 }
@@ -32,6 +32,14 @@ static uint8_t unbiased_byteify(P7_OPROFILE *om, float sc);
 static uint8_t biased_byteify(P7_OPROFILE *om, float sc);
 static int16_t wordify(P7_OPROFILE *om, float sc);
 static int     sf_conversion(P7_OPROFILE *om);
+#ifdef eslENABLE_AVX
+static int     avx_create(P7_OPROFILE *om);
+static size_t  avx_sizeof(const P7_OPROFILE *om);
+#endif
+#ifdef eslENABLE_AVX512
+static int     avx512_create(P7_OPROFILE *om);
+static size_t  avx512_sizeof(const P7_OPROFILE *om);
+#endif
 
 /*****************************************************************
  * 1. The P7_OPROFILE structure: a score profile.
@@ -71,6 +79,17 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->rfv     = NULL;
   om->tfv     = NULL;
   om->clone   = 0;
+  om->view    = FALSE;
+#ifdef eslENABLE_AVX
+  om->avx_mem    = NULL;
+  om->rbv_avx    = om->sbv_avx    = om->rwv_avx    = NULL;
+  om->rfv_avx    = NULL;
+#endif
+#ifdef eslENABLE_AVX512
+  om->avx512_mem = NULL;
+  om->rbv_avx512 = om->sbv_avx512 = om->rwv_avx512 = NULL;
+  om->rfv_avx512 = NULL;
+#endif
 
   /* level 1 */
   ESL_ALLOC(om->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp          +15); /* +15 is for manual 16-byte alignment */
@@ -103,6 +122,17 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   om->allocQ16  = nqb;
   om->allocQ8   = nqw;
   om->allocQ4   = nqf;
+  om->allocM    = allocM;
+  om->abc       = abc;
+
+  /* wider copies of the filter scores, if this machine runs the AVX2/AVX-512 kernels */
+  om->simd      = p7_simd_Select();
+#ifdef eslENABLE_AVX
+  if (om->simd == p7_SIMD_AVX    && (status = avx_create(om))    != eslOK) goto ERROR;
+#endif
+#ifdef eslENABLE_AVX512
+  if (om->simd == p7_SIMD_AVX512 && (status = avx512_create(om)) != eslOK) goto ERROR;
+#endif
 
   /* Remaining initializations */
   om->tbm_b     = 0;
@@ -154,6 +184,101 @@ p7_oprofile_Create(int allocM, const ESL_ALPHABET *abc)
   return NULL;
 }
 
+/* Function:  p7_oprofile_CreateView()
+ * Synopsis:  Allocate an optimized profile that views vectors stored elsewhere.
+ *
+ * Purpose:   Allocate an optimized profile of exactly <M> nodes for
+ *            digital alphabet <abc>, without any memory for its score
+ *            vectors or its rf, mm, cs and consensus annotation: the
+ *            caller points <rbv>, <sbv>, <rwv>, <twv>, <rfv>, <tfv> and
+ *            the annotation at data that outlives the profile. The
+ *            readers in io.c do this with pressed databases mapped by
+ *            <p7_hmmfile_Mmap()>. Only the structure, its row pointer
+ *            arrays, its name, and the AVX2/AVX-512 copies of its
+ *            scores (if <om->simd> needs them) belong to the profile.
+ *            <p7_oprofile_Destroy()> frees those, and never touches
+ *            what the profile views.
+ *
+ * Throws:    <NULL> on allocation error.
+ */
+P7_OPROFILE *
+p7_oprofile_CreateView(int M, const ESL_ALPHABET *abc)
+{
+  P7_OPROFILE *om  = NULL;
+  int          x;
+  int          status;
+
+  ESL_ALLOC(om, sizeof(P7_OPROFILE));
+  om->rbv_mem = om->sbv_mem = om->rwv_mem = om->twv_mem = NULL;
+  om->rfv_mem = om->tfv_mem = NULL;
+  om->rbv     = om->sbv     = om->rwv     = NULL;
+  om->twv     = NULL;
+  om->rfv     = NULL;
+  om->tfv     = NULL;
+  om->clone   = 0;
+  om->view    = TRUE;
+#ifdef eslENABLE_AVX
+  om->avx_mem    = NULL;
+  om->rbv_avx    = om->sbv_avx    = om->rwv_avx    = NULL;
+  om->rfv_avx    = NULL;
+#endif
+#ifdef eslENABLE_AVX512
+  om->avx512_mem = NULL;
+  om->rbv_avx512 = om->sbv_avx512 = om->rwv_avx512 = NULL;
+  om->rfv_avx512 = NULL;
+#endif
+  om->name = om->acc = om->desc = NULL;
+  om->rf   = om->mm  = om->cs   = om->consensus = NULL;
+
+  ESL_ALLOC(om->rbv, sizeof(__m128i *) * abc->Kp); 
+  ESL_ALLOC(om->sbv, sizeof(__m128i *) * abc->Kp); 
+  ESL_ALLOC(om->rwv, sizeof(__m128i *) * abc->Kp); 
+  ESL_ALLOC(om->rfv, sizeof(__m128  *) * abc->Kp); 
+  for (x = 0; x < abc->Kp; x++) {
+    om->rbv[x] = om->sbv[x] = om->rwv[x] = NULL;
+    om->rfv[x] = NULL;
+  }
+
+  om->allocQ16  = p7O_NQB(M);
+  om->allocQ8   = p7O_NQW(M);
+  om->allocQ4   = p7O_NQF(M);
+  om->allocM    = M;
+  om->abc       = abc;
+
+  om->simd      = p7_simd_Select();
+#ifdef eslENABLE_AVX
+  if (om->simd == p7_SIMD_AVX    && (status = avx_create(om))    != eslOK) goto ERROR;
+#endif
+#ifdef eslENABLE_AVX512
+  if (om->simd == p7_SIMD_AVX512 && (status = avx512_create(om)) != eslOK) goto ERROR;
+#endif
+
+  om->tbm_b     = om->tec_b   = om->tjb_b  = 0;
+  om->scale_b   = 0.0f;
+  om->base_b    = om->bias_b  = 0;
+  om->scale_w      = 0.0f;
+  om->base_w       = 0;
+  om->ddbound_w    = 0;
+  om->ncj_roundoff = 0.0f;	
+
+  for (x = 0; x < p7_NOFFSETS; x++) om->offs[x]    = -1;
+  for (x = 0; x < p7_NEVPARAM; x++) om->evparam[x] = p7_EVPARAM_UNSET;
+  for (x = 0; x < p7_NCUTOFFS; x++) om->cutoff[x]  = p7_CUTOFF_UNSET;
+  for (x = 0; x < p7_MAXABET;  x++) om->compo[x]   = p7_COMPO_UNSET;
+
+  om->L          = 0;
+  om->M          = 0;
+  om->max_length = -1;
+  om->mode       = p7_NO_MODE;
+  om->nj         = 0.0f;
+  return om;
+
+ ERROR:
+  p7_oprofile_Destroy(om);
+  return NULL;
+}
+
+
 /* Function:  p7_oprofile_IsLocal()
  * Synopsis:  Returns TRUE if profile is in local alignment mode.
  * Incept:    SRE, Sat Aug 16 08:46:00 2008 [Janelia]
@@ -189,12 +314,29 @@ p7_oprofile_Destroy(P7_OPROFILE *om)
       if (om->rwv       != NULL) free(om->rwv);
       if (om->rfv       != NULL) free(om->rfv);
       if (om->name      != NULL) free(om->name);
-      if (om->acc       != NULL) free(om->acc);
-      if (om->desc      != NULL) free(om->desc);
-      if (om->rf        != NULL) free(om->rf);
-      if (om->mm        != NULL) free(om->mm);
-      if (om->cs        != NULL) free(om->cs);
-      if (om->consensus != NULL) free(om->consensus);
+      if (! om->view)		/* a view doesn't own its annotation */
+	{
+	  if (om->acc       != NULL) free(om->acc);
+	  if (om->desc      != NULL) free(om->desc);
+	  if (om->rf        != NULL) free(om->rf);
+	  if (om->mm        != NULL) free(om->mm);
+	  if (om->cs        != NULL) free(om->cs);
+	  if (om->consensus != NULL) free(om->consensus);
+	}
+#ifdef eslENABLE_AVX
+      if (om->avx_mem    != NULL) free(om->avx_mem);
+      if (om->rbv_avx    != NULL) free(om->rbv_avx);
+      if (om->sbv_avx    != NULL) free(om->sbv_avx);
+      if (om->rwv_avx    != NULL) free(om->rwv_avx);
+      if (om->rfv_avx    != NULL) free(om->rfv_avx);
+#endif
+#ifdef eslENABLE_AVX512
+      if (om->avx512_mem != NULL) free(om->avx512_mem);
+      if (om->rbv_avx512 != NULL) free(om->rbv_avx512);
+      if (om->sbv_avx512 != NULL) free(om->sbv_avx512);
+      if (om->rwv_avx512 != NULL) free(om->rwv_avx512);
+      if (om->rfv_avx512 != NULL) free(om->rfv_avx512);
+#endif
     }
 
   free(om);
@@ -223,23 +365,33 @@ p7_oprofile_Sizeof(P7_OPROFILE *om)
    * maintainability and clarity.
    */
   n  += sizeof(P7_OPROFILE);
-  n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
-  n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
-  n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
-  n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
-  n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
-  n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
+  if (! om->view) {		/* a view's vectors and annotation aren't its own */
+    n  += sizeof(__m128i) * nqb  * om->abc->Kp +15; /* om->rbv_mem   */
+    n  += sizeof(__m128i) * nqs  * om->abc->Kp +15; /* om->sbv_mem   */
+    n  += sizeof(__m128i) * nqw  * om->abc->Kp +15; /* om->rwv_mem   */
+    n  += sizeof(__m128i) * nqw  * p7O_NTRANS  +15; /* om->twv_mem   */
+    n  += sizeof(__m128)  * nqf  * om->abc->Kp +15; /* om->rfv_mem   */
+    n  += sizeof(__m128)  * nqf  * p7O_NTRANS  +15; /* om->tfv_mem   */
+  }
   
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->sbv       */
   n  += sizeof(__m128i *) * om->abc->Kp;          /* om->rwv       */
   n  += sizeof(__m128  *) * om->abc->Kp;          /* om->rfv       */
   
-  n  += sizeof(char) * (om->allocM+2);            /* om->rf        */
-  n  += sizeof(char) * (om->allocM+2);            /* om->mm        */
-  n  += sizeof(char) * (om->allocM+2);            /* om->cs        */
-  n  += sizeof(char) * (om->allocM+2);            /* om->consensus */
+  if (! om->view) {
+    n  += sizeof(char) * (om->allocM+2);            /* om->rf        */
+    n  += sizeof(char) * (om->allocM+2);            /* om->mm        */
+    n  += sizeof(char) * (om->allocM+2);            /* om->cs        */
+    n  += sizeof(char) * (om->allocM+2);            /* om->consensus */
+  }
 
+#ifdef eslENABLE_AVX
+  if (om->simd == p7_SIMD_AVX)    n += avx_sizeof(om);    /* om->*_avx     */
+#endif
+#ifdef eslENABLE_AVX512
+  if (om->simd == p7_SIMD_AVX512) n += avx512_sizeof(om); /* om->*_avx512  */
+#endif
   return n;
 }
 
@@ -285,6 +437,17 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->twv     = NULL;
   om2->rfv     = NULL;
   om2->tfv     = NULL;
+  om2->view    = FALSE;
+#ifdef eslENABLE_AVX
+  om2->avx_mem    = NULL;
+  om2->rbv_avx    = om2->sbv_avx    = om2->rwv_avx    = NULL;
+  om2->rfv_avx    = NULL;
+#endif
+#ifdef eslENABLE_AVX512
+  om2->avx512_mem = NULL;
+  om2->rbv_avx512 = om2->sbv_avx512 = om2->rwv_avx512 = NULL;
+  om2->rfv_avx512 = NULL;
+#endif
 
   /* level 1 */
   ESL_ALLOC(om2->rbv_mem, sizeof(__m128i) * nqb  * abc->Kp    +15);	/* +15 is for manual 16-byte alignment */
@@ -323,6 +486,16 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
   om2->allocQ16  = nqb;
   om2->allocQ8   = nqw;
   om2->allocQ4   = nqf;
+  om2->allocM    = om1->allocM;
+  om2->abc       = abc;
+
+  om2->simd      = om1->simd;
+#ifdef eslENABLE_AVX
+  if (om2->simd == p7_SIMD_AVX    && (status = avx_create(om2))    != eslOK) goto ERROR;
+#endif
+#ifdef eslENABLE_AVX512
+  if (om2->simd == p7_SIMD_AVX512 && (status = avx512_create(om2)) != eslOK) goto ERROR;
+#endif
 
   /* Remaining initializations */
   om2->tbm_b     = om1->tbm_b;
@@ -381,6 +554,9 @@ p7_oprofile_Copy(P7_OPROFILE *om1)
 
   om2->clone     = om1->clone;
 
+  /* the wide vectors are derived data; rebuild them rather than copy */
+  p7_oprofile_RestripeMSV(om2);
+  p7_oprofile_RestripeRest(om2);
   return om2;
 
  ERROR:
@@ -481,6 +657,7 @@ p7_oprofile_UpdateFwdEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
+  p7_oprofile_RestripeRest(om);
   return eslOK;
 }
 
@@ -550,6 +727,7 @@ p7_oprofile_UpdateVitEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
     }
   }
 
+  p7_oprofile_RestripeRest(om);
   return eslOK;
 }
 
@@ -647,6 +825,117 @@ p7_oprofile_UpdateMSVEmissionScores(P7_OPROFILE *om, P7_BG *bg, float *fwd_emiss
 }
 
 
+#ifdef eslENABLE_AVX
+/* avx_create()
+ * Allocate the AVX2 copies of the filter and parser scores in <om>,
+ * for models up to <om->allocM>. The vectors all share one block,
+ * manually aligned on a 32-byte boundary. Caller has NULL'ed the
+ * pointers, so <p7_oprofile_Destroy()> can clean up after a failure.
+ */
+static int
+avx_create(P7_OPROFILE *om)
+{
+  int      Kp  = om->abc->Kp;
+  int      nqb = p7O_NQB_AVX(om->allocM);
+  int      nqs = nqb + p7O_EXTRA_SB;
+  int      nqw = p7O_NQW_AVX(om->allocM);
+  int      nqf = p7O_NQF_AVX(om->allocM);
+  __m256i *v;
+  int      x;
+  int      status;
+
+  ESL_ALLOC(om->avx_mem, sizeof(__m256i) * (Kp * (nqb + nqs + nqw + nqf) + p7O_NTRANS * (nqw + nqf)) + 31);
+  ESL_ALLOC(om->rbv_avx, sizeof(__m256i *) * Kp);
+  ESL_ALLOC(om->sbv_avx, sizeof(__m256i *) * Kp);
+  ESL_ALLOC(om->rwv_avx, sizeof(__m256i *) * Kp);
+  ESL_ALLOC(om->rfv_avx, sizeof(__m256  *) * Kp);
+
+  v = (__m256i *) (((unsigned long int) om->avx_mem + 31) & (~0x1f));
+  for (x = 0; x < Kp; x++) { om->rbv_avx[x] = v;             v += nqb; }
+  for (x = 0; x < Kp; x++) { om->sbv_avx[x] = v;             v += nqs; }
+  for (x = 0; x < Kp; x++) { om->rwv_avx[x] = v;             v += nqw; }
+  om->twv_avx = v;                                           v += p7O_NTRANS * nqw;
+  for (x = 0; x < Kp; x++) { om->rfv_avx[x] = (__m256 *) v;  v += nqf; }
+  om->tfv_avx = (__m256 *) v;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static size_t
+avx_sizeof(const P7_OPROFILE *om)
+{
+  int    Kp  = om->abc->Kp;
+  int    nqb = p7O_NQB_AVX(om->allocM);
+  int    nqs = nqb + p7O_EXTRA_SB;
+  int    nqw = p7O_NQW_AVX(om->allocM);
+  int    nqf = p7O_NQF_AVX(om->allocM);
+  size_t n   = 0;
+
+  n += sizeof(__m256i) * (Kp * (nqb + nqs + nqw + nqf) + p7O_NTRANS * (nqw + nqf)) + 31; /* om->avx_mem */
+  n += sizeof(__m256i *) * Kp;                                                          /* om->rbv_avx */
+  n += sizeof(__m256i *) * Kp;                                                          /* om->sbv_avx */
+  n += sizeof(__m256i *) * Kp;                                                          /* om->rwv_avx */
+  n += sizeof(__m256  *) * Kp;                                                          /* om->rfv_avx */
+  return n;
+}
+#endif /*eslENABLE_AVX*/
+
+#ifdef eslENABLE_AVX512
+/* avx512_create()
+ * Same as avx_create(), for the 64-byte AVX-512 vectors.
+ */
+static int
+avx512_create(P7_OPROFILE *om)
+{
+  int      Kp  = om->abc->Kp;
+  int      nqb = p7O_NQB_AVX512(om->allocM);
+  int      nqs = nqb + p7O_EXTRA_SB;
+  int      nqw = p7O_NQW_AVX512(om->allocM);
+  int      nqf = p7O_NQF_AVX512(om->allocM);
+  __m512i *v;
+  int      x;
+  int      status;
+
+  ESL_ALLOC(om->avx512_mem, sizeof(__m512i) * (Kp * (nqb + nqs + nqw + nqf) + p7O_NTRANS * (nqw + nqf)) + 63);
+  ESL_ALLOC(om->rbv_avx512, sizeof(__m512i *) * Kp);
+  ESL_ALLOC(om->sbv_avx512, sizeof(__m512i *) * Kp);
+  ESL_ALLOC(om->rwv_avx512, sizeof(__m512i *) * Kp);
+  ESL_ALLOC(om->rfv_avx512, sizeof(__m512  *) * Kp);
+
+  v = (__m512i *) (((unsigned long int) om->avx512_mem + 63) & (~0x3f));
+  for (x = 0; x < Kp; x++) { om->rbv_avx512[x] = v;             v += nqb; }
+  for (x = 0; x < Kp; x++) { om->sbv_avx512[x] = v;             v += nqs; }
+  for (x = 0; x < Kp; x++) { om->rwv_avx512[x] = v;             v += nqw; }
+  om->twv_avx512 = v;                                           v += p7O_NTRANS * nqw;
+  for (x = 0; x < Kp; x++) { om->rfv_avx512[x] = (__m512 *) v;  v += nqf; }
+  om->tfv_avx512 = (__m512 *) v;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+static size_t
+avx512_sizeof(const P7_OPROFILE *om)
+{
+  int    Kp  = om->abc->Kp;
+  int    nqb = p7O_NQB_AVX512(om->allocM);
+  int    nqs = nqb + p7O_EXTRA_SB;
+  int    nqw = p7O_NQW_AVX512(om->allocM);
+  int    nqf = p7O_NQF_AVX512(om->allocM);
+  size_t n   = 0;
+
+  n += sizeof(__m512i) * (Kp * (nqb + nqs + nqw + nqf) + p7O_NTRANS * (nqw + nqf)) + 63; /* om->avx512_mem */
+  n += sizeof(__m512i *) * Kp;                                                          /* om->rbv_avx512 */
+  n += sizeof(__m512i *) * Kp;                                                          /* om->sbv_avx512 */
+  n += sizeof(__m512i *) * Kp;                                                          /* om->rwv_avx512 */
+  n += sizeof(__m512  *) * Kp;                                                          /* om->rfv_avx512 */
+  return n;
+}
+#endif /*eslENABLE_AVX512*/
+
 /*----------------- end, P7_OPROFILE structure ------------------*/
 
 
@@ -757,7 +1046,7 @@ sf_conversion(P7_OPROFILE *om)
       for (q = nq; q < nq + p7O_EXTRA_SB; q++) om->sbv[x][q] = om->sbv[x][q % nq];
     }
 
-  return eslOK;
+  return p7_oprofile_RestripeMSV(om);
 }
 
 /* mf_conversion(): 
@@ -1028,6 +1317,7 @@ p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om)
   if ((status =  mf_conversion(gm, om)) != eslOK) return status;   /* MSVFilter()'s information     */
   if ((status =  vf_conversion(gm, om)) != eslOK) return status;   /* ViterbiFilter()'s information */
   if ((status =  fb_conversion(gm, om)) != eslOK) return status;   /* ForwardFilter()'s information */
+  if ((status =  p7_oprofile_RestripeRest(om)) != eslOK) return status; /* AVX2/AVX-512 copies of vf, fb */
 
   if (om->name != NULL) free(om->name);
   if (om->acc  != NULL) free(om->acc);
@@ -1049,6 +1339,83 @@ p7_oprofile_Convert(const P7_PROFILE *gm, P7_OPROFILE *om)
   return status;
 }
 
+/* Function:  p7_oprofile_Slice()
+ * Synopsis:  Copy a window of columns of a profile's float parts.
+ *
+ * Purpose:   Make <sub> a profile of <W = kb-ka+1> nodes, consisting
+ *            of nodes <ka..kb> of <om>, for the float (Forward/Backward,
+ *            decoding, optimal accuracy, null2) routines: striped
+ *            match odds, transitions and special transitions. Node
+ *            <k'> of <sub> is node <ka+k'-1> of <om>; entry into it
+ *            keeps its local entry probability, and there are no
+ *            transitions out of its last node <W>. The filter parts,
+ *            name and annotation of <sub> are left alone.
+ *
+ *            This is used to run posterior decoding and optimal
+ *            accuracy only on the columns of a domain envelope where
+ *            the posterior probability is (see p7_domaindef.c).
+ *
+ * Args:      om  - profile to take columns from
+ *            ka  - first node, 1..M
+ *            kb  - last node, ka..M
+ *            sub - allocated profile for at least <kb-ka+1> nodes, same alphabet
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <ka..kb> isn't a window of <om>, or <sub>
+ *            is too small.
+ */
+int
+p7_oprofile_Slice(const P7_OPROFILE *om, int ka, int kb, P7_OPROFILE *sub)
+{
+  int          W   = kb-ka+1;
+  int          Q   = p7O_NQF(om->M);   /* segment length in <om>  */
+  int          nq  = p7O_NQF(W);       /* segment length in <sub> */
+  const float *src;
+  float       *dst;
+  int          x, t, q, k, kp;
+
+  if (ka < 1 || kb > om->M || W < 1) ESL_EXCEPTION(eslEINVAL, "bad column window");
+  if (nq > sub->allocQ4)             ESL_EXCEPTION(eslEINVAL, "optimized profile is too small to hold slice");
+
+  /* Striped element k of <om> is vector (k-1)%Q, element (k-1)/Q. 
+   * Padding beyond node W stays zero, as in fb_conversion(). 
+   */
+  for (x = 0; x < om->abc->Kp; x++)
+    {
+      src = (const float *) om->rfv[x];
+      dst = (float *)       sub->rfv[x];
+      for (q = 0; q < nq; q++) sub->rfv[x][q] = _mm_setzero_ps();
+      for (kp = 1, k = ka; kp <= W; kp++, k++)
+	dst[((kp-1)%nq)*4 + (kp-1)/nq] = src[((k-1)%Q)*4 + (k-1)/Q];
+    }
+
+  src = (const float *) om->tfv;
+  dst = (float *)       sub->tfv;
+  for (q = 0; q < 8*nq; q++) sub->tfv[q] = _mm_setzero_ps();
+  for (kp = 1, k = ka; kp <= W; kp++, k++)
+    {
+      for (t = p7O_BM; t <= p7O_DM; t++)  /* transitions into k */
+	dst[(7*((kp-1)%nq) + t)*4 + (kp-1)/nq] = src[(7*((k-1)%Q) + t)*4 + (k-1)/Q];
+      if (kp == W) break;	          /* none out of the last node */
+      for (t = p7O_MD; t <= p7O_II; t++)  /* transitions out of k */
+	dst[(7*((kp-1)%nq) + t)*4 + (kp-1)/nq] = src[(7*((k-1)%Q) + t)*4 + (k-1)/Q];
+      dst[(7*nq + (kp-1)%nq)*4 + (kp-1)/nq] = src[(7*Q + (k-1)%Q)*4 + (k-1)/Q];
+    }
+
+  for (x = 0; x < p7O_NXSTATES; x++)
+    for (t = 0; t < p7O_NXTRANS; t++)
+      sub->xf[x][t] = om->xf[x][t];
+
+  sub->mode = om->mode;
+  sub->L    = om->L;
+  sub->nj   = om->nj;
+  sub->M    = W;
+  sub->simd = p7_SIMD_SSE;	/* only the SSE float parts are set */
+  return eslOK;
+}
+
+
 /* Function:  p7_oprofile_ReconfigLength()
  * Synopsis:  Set the target sequence length of a model.
  * Incept:    SRE, Thu Dec 20 09:56:40 2007 [Janelia]
@@ -1193,6 +1560,154 @@ p7_oprofile_ReconfigUnihit(P7_OPROFILE *om, int L)
 
   return p7_oprofile_ReconfigLength(om, L);
 }
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+/* restripe()
+ * Copy <n> striped values of <esz> bytes each from <src>, an array of
+ * <sQ> vectors of <sw> elements, into <dst>, an array of <dQ> vectors
+ * of <dw> elements. Value p (0..n-1) lives in vector p%Q, element
+ * p/Q. Successive vectors are <sstride> (<dstride>) vectors apart, so
+ * the interleaved transition blocks can be done one transition at a
+ * time. Destination elements p >= n are set to <pad>.
+ */
+static void
+restripe(char *dst, int dQ, int dw, int dstride, const char *src, int sQ, int sw, int sstride, int n, int esz, const void *pad)
+{
+  int p;
+
+  for (p = 0; p < dQ*dw; p++)
+    memcpy(dst + ((int64_t) (p%dQ) * dstride * dw + p/dQ) * esz, 
+	   (p < n) ? src + ((int64_t) (p%sQ) * sstride * sw + p/sQ) * esz : pad, 
+	   esz);
+}
+
+/* wide_sf_conversion()
+ * The same transformation of MSV costs <rb> into SSV scores <sb>
+ * as sf_conversion(), done bytewise for one residue's row of <nq>
+ * vectors of <vb> bytes, including the p7O_EXTRA_SB wraparound.
+ */
+static void
+wide_sf_conversion(const P7_OPROFILE *om, const uint8_t *rb, uint8_t *sb, int nq, int vb)
+{
+  uint8_t top = om->bias_b + 127;
+  int     i;
+
+  for (i = 0;     i < nq * vb;                  i++) sb[i] = ((top > rb[i]) ? top - rb[i] : 0) ^ 127;
+  for (i = nq*vb; i < (nq + p7O_EXTRA_SB) * vb; i++) sb[i] = sb[i % (nq*vb)];
+}
+#endif /*eslENABLE_AVX || eslENABLE_AVX512*/
+
+
+/* Function:  p7_oprofile_RestripeMSV()
+ * Synopsis:  Build the AVX2/AVX-512 copies of the MSV and SSV scores.
+ *
+ * Purpose:   The AVX2 and AVX-512 filter kernels use the same striped
+ *            layout as the SSE ones, 32 or 64 elements to a vector
+ *            instead of 16, so their scores are a rearrangement of
+ *            the SSE ones. Rebuild the wide <rbv>, <sbv> copies in
+ *            <om> from the SSE <om->rbv> and <om->bias_b>.
+ *
+ *            Anything that sets <om->rbv> other than through
+ *            <p7_oprofile_Convert()> (reading an .h3f file, an MPI
+ *            unpack, an emission update) calls this afterwards.
+ *            Only the copies for <om->simd> exist; for an SSE
+ *            profile, it's a no-op.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_RestripeMSV(P7_OPROFILE *om)
+{
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  uint8_t pad = 255;		/* cost of an impossible match */
+  int     Q   = p7O_NQB(om->M);
+  int     x;
+#endif
+
+#ifdef eslENABLE_AVX
+  if (om->simd == p7_SIMD_AVX)
+    for (x = 0; x < om->abc->Kp; x++)
+      {
+	restripe((char *) om->rbv_avx[x], p7O_NQB_AVX(om->M), 32, 1, (char *) om->rbv[x], Q, 16, 1, om->M, sizeof(uint8_t), &pad);
+	wide_sf_conversion(om, (uint8_t *) om->rbv_avx[x], (uint8_t *) om->sbv_avx[x], p7O_NQB_AVX(om->M), 32);
+      }
+#endif
+#ifdef eslENABLE_AVX512
+  if (om->simd == p7_SIMD_AVX512)
+    for (x = 0; x < om->abc->Kp; x++)
+      {
+	restripe((char *) om->rbv_avx512[x], p7O_NQB_AVX512(om->M), 64, 1, (char *) om->rbv[x], Q, 16, 1, om->M, sizeof(uint8_t), &pad);
+	wide_sf_conversion(om, (uint8_t *) om->rbv_avx512[x], (uint8_t *) om->sbv_avx512[x], p7O_NQB_AVX512(om->M), 64);
+      }
+#endif
+  return eslOK;
+}
+
+/* Function:  p7_oprofile_RestripeRest()
+ * Synopsis:  Build the AVX2/AVX-512 copies of the Viterbi and Forward scores.
+ *
+ * Purpose:   Same as <p7_oprofile_RestripeMSV()>, for the ViterbiFilter
+ *            <rwv>, <twv> and Forward/Backward <rfv>, <tfv> parts of
+ *            <om>. Transitions are done one at a time: the ones into
+ *            M (BM, MM, IM, DM) are rotated, covering nodes 0..M-1,
+ *            and the rest cover 1..M-1.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_oprofile_RestripeRest(P7_OPROFILE *om)
+{
+#if defined(eslENABLE_AVX) || defined(eslENABLE_AVX512)
+  int16_t wpad = -32768;	/* ViterbiFilter -infinity */
+  float   fpad = 0.0f;		/* Forward odds ratio of an impossible path */
+  int     Q8   = p7O_NQW(om->M);
+  int     Q4   = p7O_NQF(om->M);
+  int     x, t, n;
+#endif
+
+#ifdef eslENABLE_AVX
+  if (om->simd == p7_SIMD_AVX)
+  {
+    int dQw = p7O_NQW_AVX(om->M);
+    int dQf = p7O_NQF_AVX(om->M);
+
+    for (x = 0; x < om->abc->Kp; x++)
+      {
+	restripe((char *) om->rwv_avx[x], dQw, 16, 1, (char *) om->rwv[x], Q8, 8, 1, om->M, sizeof(int16_t), &wpad);
+	restripe((char *) om->rfv_avx[x], dQf,  8, 1, (char *) om->rfv[x], Q4, 4, 1, om->M, sizeof(float),   &fpad);
+      }
+    for (t = p7O_BM; t <= p7O_II; t++)
+      {
+	n = (t <= p7O_DM) ? om->M : om->M-1;
+	restripe((char *) (om->twv_avx + t), dQw, 16, 7, (char *) (om->twv + t), Q8, 8, 7, n, sizeof(int16_t), &wpad);
+	restripe((char *) (om->tfv_avx + t), dQf,  8, 7, (char *) (om->tfv + t), Q4, 4, 7, n, sizeof(float),   &fpad);
+      }
+    restripe((char *) (om->twv_avx + 7*dQw), dQw, 16, 1, (char *) (om->twv + 7*Q8), Q8, 8, 1, om->M-1, sizeof(int16_t), &wpad);
+    restripe((char *) (om->tfv_avx + 7*dQf), dQf,  8, 1, (char *) (om->tfv + 7*Q4), Q4, 4, 1, om->M-1, sizeof(float),   &fpad);
+  }
+#endif
+#ifdef eslENABLE_AVX512
+  if (om->simd == p7_SIMD_AVX512)
+  {
+    int dQw = p7O_NQW_AVX512(om->M);
+    int dQf = p7O_NQF_AVX512(om->M);
+
+    for (x = 0; x < om->abc->Kp; x++)
+      {
+	restripe((char *) om->rwv_avx512[x], dQw, 32, 1, (char *) om->rwv[x], Q8, 8, 1, om->M, sizeof(int16_t), &wpad);
+	restripe((char *) om->rfv_avx512[x], dQf, 16, 1, (char *) om->rfv[x], Q4, 4, 1, om->M, sizeof(float),   &fpad);
+      }
+    for (t = p7O_BM; t <= p7O_II; t++)
+      {
+	n = (t <= p7O_DM) ? om->M : om->M-1;
+	restripe((char *) (om->twv_avx512 + t), dQw, 32, 7, (char *) (om->twv + t), Q8, 8, 7, n, sizeof(int16_t), &wpad);
+	restripe((char *) (om->tfv_avx512 + t), dQf, 16, 7, (char *) (om->tfv + t), Q4, 4, 7, n, sizeof(float),   &fpad);
+      }
+    restripe((char *) (om->twv_avx512 + 7*dQw), dQw, 32, 1, (char *) (om->twv + 7*Q8), Q8, 8, 1, om->M-1, sizeof(int16_t), &wpad);
+    restripe((char *) (om->tfv_avx512 + 7*dQf), dQf, 16, 1, (char *) (om->tfv + 7*Q4), Q4, 4, 1, om->M-1, sizeof(float),   &fpad);
+  }
+#endif
+  return eslOK;
+}
 /*------------ end, conversions to P7_OPROFILE ------------------*/
 
 /*******************************************************************
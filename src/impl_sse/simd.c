@@ -0,0 +1,225 @@
+/* Runtime choice among the SSE, AVX2 and AVX-512 kernels.
+ *
+ * The SSE code is always compiled; the AVX2 and AVX-512 kernels are
+ * compiled with their own flags when configure finds a compiler that
+ * supports them. Which one actually runs is decided here, once, by
+ * asking the processor (cpuid) what it supports, so one binary can be
+ * shipped to a mixed cluster.
+ *
+ * The choice is recorded in each P7_OPROFILE when it's created
+ * (<om->simd>), which determines which wide copies of the scores it
+ * carries; p7_MSVFilter() and friends dispatch on <om->simd>. Setting
+ * the environment variable HMMER_SIMD to "sse", "avx" or "avx512"
+ * forces a narrower implementation, for benchmarking. A level the
+ * processor or the build doesn't support falls back to the widest one
+ * that is.
+ *
+ * Contents:
+ *   1. Selecting an implementation.
+ *   2. Processor feature tests.
+ *   3. Test driver.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#include "easel.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static int cpu_has_avx2(void);
+static int cpu_has_avx512(void);
+
+static int simd_level = -1;	/* -1 = not chosen yet */
+
+/*****************************************************************
+ * 1. Selecting an implementation.
+ *****************************************************************/
+
+/* Function:  p7_simd_Select()
+ * Synopsis:  Return the vector implementation in use.
+ *
+ * Purpose:   Return the vector implementation (<p7_SIMD_SSE>,
+ *            <p7_SIMD_AVX>, or <p7_SIMD_AVX512>) that newly created
+ *            optimized profiles will use. On the first call, choose
+ *            the widest one that is both compiled in and supported by
+ *            the processor, optionally narrowed by the HMMER_SIMD
+ *            environment variable.
+ *
+ *            The first call is made by the first <p7_oprofile_Create()>,
+ *            normally before any worker threads exist. If two threads
+ *            do race here, they make the same choice.
+ */
+int
+p7_simd_Select(void)
+{
+  char *s;
+  int   level;
+
+  if (simd_level >= 0) return simd_level;
+
+  level = p7_SIMD_AVX512;
+  if ((s = getenv("HMMER_SIMD")) != NULL)
+    {
+      if      (strcasecmp(s, "sse")    == 0) level = p7_SIMD_SSE;
+      else if (strcasecmp(s, "avx")    == 0) level = p7_SIMD_AVX;
+      else if (strcasecmp(s, "avx2")   == 0) level = p7_SIMD_AVX;
+      else if (strcasecmp(s, "avx512") == 0) level = p7_SIMD_AVX512;
+    }
+  while (level > p7_SIMD_SSE && ! p7_simd_Supported(level)) level--;
+
+  simd_level = level;
+  return simd_level;
+}
+
+
+/* Function:  p7_simd_Set()
+ * Synopsis:  Force a vector implementation.
+ *
+ * Purpose:   Make <level> the implementation for optimized profiles
+ *            created from now on. Profiles that already exist keep
+ *            the implementation they were built for. Used by the
+ *            unit tests and benchmarks of the wide kernels.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslENORESULT> if <level> isn't compiled in or the
+ *            processor doesn't support it; the current choice is
+ *            unchanged.
+ */
+int
+p7_simd_Set(int level)
+{
+  if (! p7_simd_Supported(level)) return eslENORESULT;
+  simd_level = level;
+  return eslOK;
+}
+
+
+/* Function:  p7_simd_Supported()
+ * Synopsis:  Check whether an implementation can be used here.
+ *
+ * Purpose:   Return TRUE if vector implementation <level> was compiled
+ *            in and the processor (and operating system) support it.
+ */
+int
+p7_simd_Supported(int level)
+{
+  switch (level) {
+  case p7_SIMD_SSE:    return TRUE;
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return cpu_has_avx2();
+#endif
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return cpu_has_avx512();
+#endif
+  default:             return FALSE;
+  }
+}
+
+
+/* Function:  p7_simd_Name()
+ * Synopsis:  Return a printable name for an implementation.
+ */
+const char *
+p7_simd_Name(int level)
+{
+  switch (level) {
+  case p7_SIMD_SSE:    return "SSE";
+  case p7_SIMD_AVX:    return "AVX2";
+  case p7_SIMD_AVX512: return "AVX-512";
+  default:             return "unknown";
+  }
+}
+/*------------- end, selecting an implementation ----------------*/
+
+
+
+/*****************************************************************
+ * 2. Processor feature tests.
+ *****************************************************************/
+
+/* The processor has to have the instructions, and the operating
+ * system has to save the wider registers on a context switch; the
+ * latter is what the OSXSAVE/xgetbv check is for.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static uint64_t
+xgetbv0(void)
+{
+  uint32_t eax, edx;
+
+  __asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+  return ((uint64_t) edx << 32) | eax;
+}
+
+static int
+cpu_has_avx2(void)
+{
+  unsigned int a, b, c, d;
+
+  if (! __get_cpuid(1, &a, &b, &c, &d))       return FALSE;
+  if (! (c & (1u << 27)))                       return FALSE; /* OSXSAVE         */
+  if ((xgetbv0() & 0x6) != 0x6)                 return FALSE; /* XMM, YMM state  */
+  if (__get_cpuid_max(0, NULL) < 7)             return FALSE;
+  __cpuid_count(7, 0, a, b, c, d);
+  return ((b & (1u << 5)) ? TRUE : FALSE);                     /* AVX2            */
+}
+
+static int
+cpu_has_avx512(void)
+{
+  unsigned int a, b, c, d;
+
+  if (! cpu_has_avx2())                         return FALSE; /* also checks OSXSAVE */
+  if ((xgetbv0() & 0xe6) != 0xe6)               return FALSE; /* opmask, ZMM state   */
+  __cpuid_count(7, 0, a, b, c, d);
+  return (((b & (1u << 16)) && (b & (1u << 30))) ? TRUE : FALSE); /* AVX512F, AVX512BW */
+}
+#else
+static int cpu_has_avx2(void)   { return FALSE; }
+static int cpu_has_avx512(void) { return FALSE; }
+#endif
+/*---------------- end, processor feature tests -----------------*/
+
+
+
+/*****************************************************************
+ * 3. Test driver.
+ *****************************************************************/
+#ifdef p7SIMD_TESTDRIVE
+/* Checks that the choice is consistent; with -v, also prints what
+ * this machine supports and what was chosen. Try it with HMMER_SIMD set.
+ *   gcc -o simd_utest -std=gnu99 -g -Wall -msse2 -I.. -L.. -I../../easel -L../../easel -Dp7SIMD_TESTDRIVE simd.c -lhmmer -leasel -lm
+ */
+int
+main(int argc, char **argv)
+{
+  int be_verbose = (argc > 1 && strcmp(argv[1], "-v") == 0);
+  int chosen     = p7_simd_Select();
+  int level;
+
+  if (be_verbose)
+    {
+      for (level = p7_SIMD_SSE; level <= p7_SIMD_AVX512; level++)
+	printf("%-8s %s\n", p7_simd_Name(level), p7_simd_Supported(level) ? "yes" : "no");
+      printf("chosen:  %s\n", p7_simd_Name(chosen));
+    }
+
+  if (! p7_simd_Supported(chosen))                    esl_fatal("chose an unsupported implementation");
+  if (p7_simd_Set(p7_SIMD_SSE) != eslOK)              esl_fatal("SSE should always be supported");
+  if (p7_simd_Select() != p7_SIMD_SSE)                esl_fatal("p7_simd_Set() didn't take");
+  if (p7_simd_Set(chosen) != eslOK)                   esl_fatal("couldn't restore choice");
+  if (p7_simd_Set(p7_SIMD_AVX512+1) != eslENORESULT)  esl_fatal("accepted a bogus level");
+  if (p7_simd_Select() != chosen)                     esl_fatal("bogus level changed the choice");
+  return 0;
+}
+#endif /*p7SIMD_TESTDRIVE*/
+/*--------------------- end, test driver ------------------------*/
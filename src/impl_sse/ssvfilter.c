@@ -874,6 +874,21 @@ get_xE(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om)
 
 int
 p7_SSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
+{
+  switch (om->simd) {
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return p7_SSVFilter_avx512(dsq, L, om, ret_sc);
+#endif
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return p7_SSVFilter_avx(dsq, L, om, ret_sc);
+#endif
+  default:             return p7_SSVFilter_sse(dsq, L, om, ret_sc);
+  }
+}
+
+
+int
+p7_SSVFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, float *ret_sc)
 {
   /* Use 16 bit values to avoid overflow due to moved baseline */
   uint16_t  xE;
@@ -81,6 +81,28 @@
  */
 int
 p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  switch (om->simd) {
+#ifdef eslENABLE_AVX512
+  case p7_SIMD_AVX512: return p7_ViterbiFilter_avx512(dsq, L, om, ox, ret_sc);
+#endif
+#ifdef eslENABLE_AVX
+  case p7_SIMD_AVX:    return p7_ViterbiFilter_avx(dsq, L, om, ox, ret_sc);
+#endif
+  default:             return p7_ViterbiFilter_sse(dsq, L, om, ox, ret_sc);
+  }
+}
+
+
+/* Function:  p7_ViterbiFilter_sse()
+ * Synopsis:  SSE implementation of <p7_ViterbiFilter()>.
+ *
+ * Purpose:   The 128-bit implementation, which <p7_ViterbiFilter()>
+ *            calls for profiles built for SSE (<om->simd>;
+ *            see simd.c).
+ */
+int
+p7_ViterbiFilter_sse(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
 {
   register __m128i mpv, dpv, ipv;  /* previous row values                                       */
   register __m128i sv;		   /* temp storage of 1 curr row value in progress              */
@@ -246,7 +268,7 @@ p7_ViterbiFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, f
   else  *ret_sc = -eslINFINITY;
   return eslOK;
 }
-/*---------------- end, p7_ViterbiFilter() ----------------------*/
+/*---------------- end, p7_ViterbiFilter_sse() ------------------*/
 
 
 
@@ -0,0 +1,463 @@
+/* Viterbi filter implementation; AVX2 and AVX-512 versions.
+ * 
+ * Same algorithm as the SSE p7_ViterbiFilter() in vitfilter.c,
+ * striped across p7W_NW (16 or 32) int16_t lanes instead of 8.
+ * Compiled once per instruction set, into p7_ViterbiFilter_avx() and
+ * p7_ViterbiFilter_avx512(); see impl_avx.h. Scores are read from
+ * om->rwv_avx[] and om->twv_avx (or their _avx512 versions), which
+ * p7_oprofile_RestripeRest() keeps in sync with the SSE om->rwv[]
+ * and om->twv; the one DP row lives in the wide row <ox->wrow>.
+ * 
+ * Contents:
+ *   1. p7_ViterbiFilter_avx(), p7_ViterbiFilter_avx512() implementation
+ *   2. Benchmark driver
+ *   3. Unit tests
+ *   4. Test driver
+ */
+#include <p7_config.h>
+#include "impl_avx.h"
+#ifdef p7_WIDE_ENABLED
+
+#include <stdio.h>
+#include <math.h>
+
+#include <immintrin.h>
+
+#include "easel.h"
+#include "esl_sse.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+/*****************************************************************
+ * 1. Viterbi filter implementation.
+ *****************************************************************/
+
+/* Function:  p7_ViterbiFilter_avx(), p7_ViterbiFilter_avx512()
+ * Synopsis:  Calculates Viterbi score with AVX2 or AVX-512 vectors.
+ *
+ * Purpose:   Same as <p7_ViterbiFilter()>: calculates an approximation
+ *            of the Viterbi score for sequence <dsq> of length <L>
+ *            residues, using optimized profile <om> and a preallocated
+ *            one-row DP matrix <ox>, and returns the estimated score
+ *            (in nats) in <ret_sc>. Scores are identical to the SSE
+ *            version's.
+ *
+ * Args:      dsq     - digital target sequence, 1..L
+ *            L       - length of dsq in residues          
+ *            om      - optimized profile
+ *            ox      - DP matrix
+ *            ret_sc  - RETURN: Viterbi score (in nats)          
+ *
+ * Returns:   <eslOK> on success;
+ *            <eslERANGE> if the score overflows; in this case
+ *            <*ret_sc> is <eslINFINITY>, and the sequence can 
+ *            be treated as a high-scoring hit.
+ *
+ * Throws:    <eslEINVAL> if <ox> allocation is too small, or if
+ *            profile isn't in a local alignment mode. (Must be in local
+ *            alignment mode because that's what helps us guarantee 
+ *            limited dynamic range.)
+ */
+int
+p7W_NAME(p7_ViterbiFilter)(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float *ret_sc)
+{
+  register p7W_vec mpv, dpv, ipv;  /* previous row values                                       */
+  register p7W_vec sv;		   /* temp storage of 1 curr row value in progress              */
+  register p7W_vec dcv;		   /* delayed storage of D(i,q+1)                               */
+  register p7W_vec xEv;		   /* E state: keeps max for Mk->E as we go                     */
+  register p7W_vec xBv;		   /* B state: splatted vector of B[i-1] for B->Mk calculations */
+  register p7W_vec Dmaxv;          /* keeps track of maximum D cell on row                      */
+  int16_t  xE, xB, xC, xJ, xN;	   /* special states' scores                                    */
+  int16_t  Dmax;		   /* maximum D cell score on row                               */
+  int i;			   /* counter over sequence positions 1..L                      */
+  int q;			   /* counter over vectors 0..nq-1                              */
+  int Q        = p7W_NQW(om->M); /* segment length: # of vectors                           */
+  p7W_vec *dp  = (p7W_vec *) ox->wrow; /* using {MDI}MX(q) macro requires initialization of <dp> */
+  p7W_vec *rsc;			   /* will point at om->rwv_avx[x] (or _avx512) for residue x[i] */
+  p7W_vec *tsc;			   /* will point into (and step thru) om->twv_avx (or _avx512)   */
+  p7W_vec negInfv;                 /* -32768 in element 0, 0 elsewhere, for OR after a shift    */
+
+  /* Check that the DP matrix is ok for us. */
+  if (om->M > ox->allocWM)                             ESL_EXCEPTION(eslEINVAL, "DP matrix allocated too small");
+  if (om->mode != p7_LOCAL && om->mode != p7_UNILOCAL) ESL_EXCEPTION(eslEINVAL, "Fast filter only works for local alignment");
+  ox->M   = om->M;
+
+  negInfv = p7W_neginf0_epi16();
+
+  /* Initialization. In unsigned arithmetic, -infinity is -32768
+   */
+  for (q = 0; q < Q; q++)
+    MMXo(q) = IMXo(q) = DMXo(q) = p7W(set1_epi16)(-32768);
+  xN   = om->base_w;
+  xB   = xN + om->xw[p7O_N][p7O_MOVE];
+  xJ   = -32768;
+  xC   = -32768;
+  xE   = -32768;
+
+  for (i = 1; i <= L; i++)
+    {
+      rsc   = om->p7W_NAME(rwv)[dsq[i]];
+      tsc   = om->p7W_NAME(twv);
+      dcv   = p7W(set1_epi16)(-32768);      /* "-infinity" */
+      xEv   = p7W(set1_epi16)(-32768);     
+      Dmaxv = p7W(set1_epi16)(-32768);     
+      xBv   = p7W(set1_epi16)(xB);
+
+      /* Right shifts by 1 value, across lanes; replace the zero that
+       * shifts on with -32768.
+       */
+      mpv = p7W_rightshift_epi16(MMXo(Q-1));  mpv = p7W_or_si(mpv, negInfv);
+      dpv = p7W_rightshift_epi16(DMXo(Q-1));  dpv = p7W_or_si(dpv, negInfv);
+      ipv = p7W_rightshift_epi16(IMXo(Q-1));  ipv = p7W_or_si(ipv, negInfv);
+
+      for (q = 0; q < Q; q++)
+	{
+	  /* Calculate new MMXo(i,q); don't store it yet, hold it in sv. */
+	  sv   =                       p7W(adds_epi16)(xBv, *tsc);  tsc++;
+	  sv   = p7W(max_epi16) (sv, p7W(adds_epi16)(mpv, *tsc)); tsc++;
+	  sv   = p7W(max_epi16) (sv, p7W(adds_epi16)(ipv, *tsc)); tsc++;
+	  sv   = p7W(max_epi16) (sv, p7W(adds_epi16)(dpv, *tsc)); tsc++;
+	  sv   = p7W(adds_epi16)(sv, *rsc);                         rsc++;
+	  xEv  = p7W(max_epi16)(xEv, sv);
+
+	  /* Load {MDI}(i-1,q) into mpv, dpv, ipv;
+	   * {MDI}MX(q) is then the current, not the prev row
+	   */
+	  mpv = MMXo(q);
+	  dpv = DMXo(q);
+	  ipv = IMXo(q);
+
+	  /* Do the delayed stores of {MD}(i,q) now that memory is usable */
+	  MMXo(q) = sv;
+	  DMXo(q) = dcv;
+
+	  /* Calculate the next D(i,q+1) partially: M->D only;
+	   * delay storage, holding it in dcv
+	   */
+	  dcv   = p7W(adds_epi16)(sv, *tsc);  tsc++;
+	  Dmaxv = p7W(max_epi16)(dcv, Dmaxv);
+
+	  /* Calculate and store I(i,q) */
+	  sv     =                       p7W(adds_epi16)(mpv, *tsc);  tsc++;
+	  IMXo(q)= p7W(max_epi16) (sv, p7W(adds_epi16)(ipv, *tsc)); tsc++;
+	}
+
+      /* Now the "special" states, which start from Mk->E (->C, ->J->B) */
+      xE = p7W_hmax_epi16(xEv);
+      if (xE >= 32767) { *ret_sc = eslINFINITY; return eslERANGE; }	/* immediately detect overflow */
+      xN = xN + om->xw[p7O_N][p7O_LOOP];
+      xC = ESL_MAX(xC + om->xw[p7O_C][p7O_LOOP], xE + om->xw[p7O_E][p7O_MOVE]);
+      xJ = ESL_MAX(xJ + om->xw[p7O_J][p7O_LOOP], xE + om->xw[p7O_E][p7O_LOOP]);
+      xB = ESL_MAX(xJ + om->xw[p7O_J][p7O_MOVE], xN + om->xw[p7O_N][p7O_MOVE]);
+      /* and now xB will carry over into next i, and xC carries over after i=L */
+
+      /* The "lazy F" loop; see vitfilter.c for the reasoning. */
+      Dmax = p7W_hmax_epi16(Dmaxv);
+      if (Dmax + om->ddbound_w > xB) 
+	{
+	  /* Now we're obligated to do at least one complete DD path to be sure. */
+	  /* dcv has carried through from end of q loop above */
+	  dcv = p7W_rightshift_epi16(dcv);
+	  dcv = p7W_or_si(dcv, negInfv);
+	  tsc = om->p7W_NAME(twv) + 7*Q;	/* set tsc to start of the DD's */
+	  for (q = 0; q < Q; q++) 
+	    {
+	      DMXo(q) = p7W(max_epi16)(dcv, DMXo(q));	
+	      dcv     = p7W(adds_epi16)(DMXo(q), *tsc); tsc++;
+	    }
+
+	  /* We may have to do up to p7W_NW-1 more passes; the check
+	   * is for whether crossing a segment boundary can improve
+	   * our score. 
+	   */
+	  do {
+	    dcv = p7W_rightshift_epi16(dcv);
+	    dcv = p7W_or_si(dcv, negInfv);
+	    tsc = om->p7W_NAME(twv) + 7*Q;	/* set tsc to start of the DD's */
+	    for (q = 0; q < Q; q++) 
+	      {
+		if (! p7W_any_gt_epi16(dcv, DMXo(q))) break;
+		DMXo(q) = p7W(max_epi16)(dcv, DMXo(q));	
+		dcv     = p7W(adds_epi16)(DMXo(q), *tsc);   tsc++;
+	      }	    
+	  } while (q == Q);
+	}
+      else  /* not calculating DD? then just store the last M->D vector calc'ed.*/
+	{
+	  dcv = p7W_rightshift_epi16(dcv);
+	  DMXo(0) = p7W_or_si(dcv, negInfv);
+	}
+    } /* end loop over sequence residues 1..L */
+
+  /* finally C->T */
+  if (xC > -32768)
+    {
+      *ret_sc = (float) xC + (float) om->xw[p7O_C][p7O_MOVE] - (float) om->base_w;
+      *ret_sc /= om->scale_w;
+      *ret_sc -= 3.0; /* the NN/CC/JJ=0,-3nat approximation: see J5/36. That's ~ L \log \frac{L}{L+3}, for our NN,CC,JJ contrib */
+    }
+  else  *ret_sc = -eslINFINITY;
+  return eslOK;
+}
+/*---------------- end, p7_ViterbiFilter_avx*() ----------------------*/
+
+
+
+/*****************************************************************
+ * 2. Benchmark driver.
+ *****************************************************************/
+#ifdef p7VITFILTER_WIDE_BENCHMARK
+/* -s compares to the SSE p7_ViterbiFilter_sse(), which must give exactly the same scores.
+
+   gcc -o vitfilter_avx_benchmark    -std=gnu99 -g -O3 -Wall -mavx2                 -Dp7_WIDE_AVX    -I.. -L.. -I../../easel -L../../easel -Dp7VITFILTER_WIDE_BENCHMARK vitfilter_wide.c -lhmmer -leasel -lm 
+   gcc -o vitfilter_avx512_benchmark -std=gnu99 -g -O3 -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -I.. -L.. -I../../easel -L../../easel -Dp7VITFILTER_WIDE_BENCHMARK vitfilter_wide.c -lhmmer -leasel -lm 
+
+   ./vitfilter_avx_benchmark <hmmfile>          runs benchmark 
+   ./vitfilter_avx_benchmark -N100 -s <hmmfile> compare scores to SSE impl
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_stopwatch.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "compare scores to SSE implementation (debug)",     0 }, 
+  { "-S",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-N",        eslARG_INT,  "50000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <hmmfile>";
+static char banner[] = "benchmark driver for " p7W_ISA " Viterbi filter";
+
+int 
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+  char           *hmmfile = esl_opt_GetArg(go, 1);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-S"));
+  ESL_ALPHABET   *abc     = NULL;
+  P7_HMMFILE     *hfp     = NULL;
+  P7_HMM         *hmm     = NULL;
+  P7_BG          *bg      = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  P7_OMX         *ox      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  ESL_DSQ        *dsq     = malloc(sizeof(ESL_DSQ) * (L+2));
+  int             i;
+  float           sc1, sc2;
+  double          base_time, bench_time, Mcs;
+
+  if (p7_simd_Set(p7W_SIMD) != eslOK) p7_Fail(p7W_ISA " isn't supported here");
+
+  if (p7_hmmfile_Open(hmmfile, NULL, &hfp, NULL) != eslOK) p7_Fail("Failed to open HMM file %s", hmmfile);
+  if (p7_hmmfile_Read(hfp, &abc, &hmm)           != eslOK) p7_Fail("Failed to read HMM");
+
+  bg = p7_bg_Create(abc);
+  p7_bg_SetLength(bg, L);
+  gm = p7_profile_Create(hmm->M, abc);
+  p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL);
+  om = p7_oprofile_Create(gm->M, abc);
+  p7_oprofile_Convert(gm, om);
+  p7_oprofile_ReconfigLength(om, L);
+
+  ox = p7_omx_Create(gm->M, 0, 0);
+
+  /* Get a baseline time: how long it takes just to generate the sequences */
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++) esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+  esl_stopwatch_Stop(w);
+  base_time = w->user;
+
+  esl_stopwatch_Start(w);
+  for (i = 0; i < N; i++)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+      p7W_NAME(p7_ViterbiFilter)(dsq, L, om, ox, &sc1);   
+
+      if (esl_opt_GetBoolean(go, "-s")) 
+	{
+	  p7_ViterbiFilter_sse(dsq, L, om, ox, &sc2); 
+	  printf("%.4f %.4f\n", sc1, sc2);  
+	}
+    }
+  esl_stopwatch_Stop(w);
+  bench_time = w->user - base_time;
+  Mcs        = (double) N * (double) L * (double) gm->M * 1e-6 / (double) bench_time;
+  esl_stopwatch_Display(stdout, w, "# CPU time: ");
+  printf("# M    = %d\n",   gm->M);
+  printf("# %.1f Mc/s\n", Mcs);
+
+  free(dsq);
+  p7_omx_Destroy(ox);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+  p7_hmmfile_Close(hfp);
+  esl_alphabet_Destroy(abc);
+  esl_stopwatch_Destroy(w);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7VITFILTER_WIDE_BENCHMARK*/
+/*---------------- end, benchmark driver ------------------------*/
+
+
+
+
+/*****************************************************************
+ * 3. Unit tests.
+ *****************************************************************/
+#ifdef p7VITFILTER_WIDE_TESTDRIVE
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* wide ViterbiFilter() unit test
+ * 
+ * As in vitfilter.c, scores must be identical (within machine error)
+ * to generic Viterbi with scores rounded the same way; and they must
+ * be identical to the SSE filter's.
+ */
+static void
+utest_viterbi_filter(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N)
+{
+  P7_HMM      *hmm = NULL;
+  P7_PROFILE  *gm  = NULL;
+  P7_OPROFILE *om  = NULL;
+  ESL_DSQ     *dsq = malloc(sizeof(ESL_DSQ) * (L+2));
+  P7_OMX      *ox  = p7_omx_Create(M, 0, 0);
+  P7_GMX      *gx  = p7_gmx_Create(M, L);
+  float sc1, sc2, sc3;
+
+  p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om);
+  p7_profile_SameAsVF(om, gm);	/* round and scale the scores in <gm> the same as in <om> */
+
+  while (N--)
+    {
+      esl_rsq_xfIID(r, bg->f, abc->K, L, dsq);
+
+      p7W_NAME(p7_ViterbiFilter)(dsq, L, om, ox, &sc1);
+      p7_ViterbiFilter_sse  (dsq, L, om, ox, &sc2);
+      p7_GViterbi           (dsq, L, gm, gx, &sc3);
+
+      sc3 /= om->scale_w;
+      sc3 -= 3.0;
+
+      if (sc1 != sc2)            esl_fatal(p7W_ISA " viterbi filter unit test failed: score differs from SSE (%.2f, %.2f)", sc1, sc2);
+      if (fabs(sc1-sc3) > 0.001) esl_fatal(p7W_ISA " viterbi filter unit test failed: scores differ (%.2f, %.2f)", sc1, sc3);
+    }
+
+  free(dsq);
+  p7_hmm_Destroy(hmm);
+  p7_omx_Destroy(ox);
+  p7_gmx_Destroy(gx);
+  p7_profile_Destroy(gm);
+  p7_oprofile_Destroy(om);
+}
+#endif /*p7VITFILTER_WIDE_TESTDRIVE*/
+
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7VITFILTER_WIDE_TESTDRIVE
+/* 
+   gcc -g -Wall -mavx2                 -Dp7_WIDE_AVX    -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o vitfilter_avx_utest    -Dp7VITFILTER_WIDE_TESTDRIVE vitfilter_wide.c -lhmmer -leasel -lm
+   gcc -g -Wall -mavx512f -mavx512bw -Dp7_WIDE_AVX512 -std=gnu99 -I.. -L.. -I../../easel -L../../easel -o vitfilter_avx512_utest -Dp7VITFILTER_WIDE_TESTDRIVE vitfilter_wide.c -lhmmer -leasel -lm
+   ./vitfilter_avx_utest; ./vitfilter_avx512_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+
+#include "hmmer.h"
+#include "impl_sse.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-L",        eslARG_INT,    "200", NULL, NULL,  NULL,  NULL, NULL, "size of random sequences to sample",             0 },
+  { "-M",        eslARG_INT,    "145", NULL, NULL,  NULL,  NULL, NULL, "size of random models to sample",                0 },
+  { "-N",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "number of random sequences to sample",           0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for the " p7W_ISA " Viterbi filter implementation";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = NULL;
+  P7_BG          *bg   = NULL;
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+
+  /* nothing to test on a processor without the instruction set */
+  if (p7_simd_Set(p7W_SIMD) != eslOK) { esl_randomness_Destroy(r); esl_getopts_Destroy(go); return 0; }
+
+  /* First round of tests for DNA alphabets.  */
+  if ((abc = esl_alphabet_Create(eslDNA)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))            == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf(p7W_ISA " ViterbiFilter() tests, DNA\n");
+  utest_viterbi_filter(r, abc, bg, M, L, N);   /* normal sized models */
+  utest_viterbi_filter(r, abc, bg, 1, L, 10);  /* size 1 models       */
+  utest_viterbi_filter(r, abc, bg, M, 1, 10);  /* size 1 sequences    */
+  utest_viterbi_filter(r, abc, bg, p7W_NW*3+1, L, 10); /* model spans a partial last vector */
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  /* Second round of tests for amino alphabets.  */
+  if ((abc = esl_alphabet_Create(eslAMINO)) == NULL)  esl_fatal("failed to create alphabet");
+  if ((bg = p7_bg_Create(abc))              == NULL)  esl_fatal("failed to create null model");
+
+  if (esl_opt_GetBoolean(go, "-v")) printf(p7W_ISA " ViterbiFilter() tests, protein\n");
+  utest_viterbi_filter(r, abc, bg, M, L, N); 
+  utest_viterbi_filter(r, abc, bg, 1, L, 10);
+  utest_viterbi_filter(r, abc, bg, M, 1, 10);
+  utest_viterbi_filter(r, abc, bg, p7W_NW*3+1, L, 10);
+
+  esl_alphabet_Destroy(abc);
+  p7_bg_Destroy(bg);
+
+  esl_getopts_Destroy(go);
+  esl_randomness_Destroy(r);
+  return eslOK;
+}
+#endif /*p7VITFILTER_WIDE_TESTDRIVE*/
+
+
+
+#else /* ! p7_WIDE_ENABLED */
+/* Provide a dummy symbol, so the object file isn't empty; and if the
+ * test driver is compiled anyway, let it pass trivially.
+ */
+void p7W_NAME(p7_vitfilter_silence_hack)(void) { return; }
+#if defined p7VITFILTER_WIDE_TESTDRIVE || defined p7VITFILTER_WIDE_BENCHMARK
+int main(void) { return 0; }
+#endif
+#endif /* p7_WIDE_ENABLED */
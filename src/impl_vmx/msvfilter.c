@@ -202,6 +202,53 @@ p7_MSVFilter(const ESL_DSQ *dsq, int L, const P7_OPROFILE *om, P7_OMX *ox, float
 /*------------------ end, p7_MSVFilter() ------------------------*/
 
 
+/* Function:  p7_MSVFilter_Block()
+ * Synopsis:  MSV scores for a block of sequences.
+ *
+ * Purpose:   Calculate the MSV filter score of each sequence in
+ *            <block> against <om>, setting <usc[i]> to the score (in
+ *            nats) of <block->list[i]>: what <p7_MSVFilter()> returns
+ *            with <om> configured for that sequence's length,
+ *            <eslINFINITY> if it overflows. The pipeline calls this
+ *            through <p7_Pipeline_Block()>; here it is just
+ *            <p7_MSVFilter()> on each sequence in turn.
+ *
+ *            <om>'s MSV length configuration is changed for each
+ *            sequence, and restored on return. <ox> is reallocated
+ *            as needed.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_MSVFilter_Block(const ESL_SQ_BLOCK *block, P7_OPROFILE *om, P7_OMX *ox, float *usc)
+{
+  uint8_t tjb_save = om->tjb_b;
+  ESL_SQ *sq;
+  int     b;
+  int     status;
+
+  for (b = 0; b < block->count; b++)
+    {
+      sq = block->list + b;
+      if (sq->n == 0) { usc[b] = -eslINFINITY; continue; } /* the pipeline skips these anyway */
+
+      if ((status = p7_omx_GrowTo(ox, om->M, 0, sq->n)) != eslOK) goto ERROR;
+      p7_oprofile_ReconfigMSVLength(om, sq->n);
+      p7_MSVFilter(sq->dsq, sq->n, om, ox, &(usc[b])); /* eslERANGE leaves usc[b] = eslINFINITY */
+    }
+
+  om->tjb_b = tjb_save;
+  return eslOK;
+
+ ERROR:
+  om->tjb_b = tjb_save;
+  return status;
+}
+/*------------------ end, p7_MSVFilter_Block() ------------------*/
+
+
 /* Function:  p7_SSVFilter_longtarget()
  * Synopsis:  Finds windows with SSV scores above some threshold (vewy vewy fast, in limited precision)
  *
@@ -26,14 +26,17 @@
 #ifdef HMMER_THREADS
 #include <unistd.h>
 #include "esl_threads.h"
-#include "esl_workqueue.h"
 #endif 
 
 #include "hmmer.h"
+#ifdef HMMER_THREADS
+#include "p7_sqreader.h"
+#include "p7_workpool.h"
+#endif
 
 typedef struct {
 #ifdef HMMER_THREADS
-  ESL_WORK_QUEUE   *queue;
+  P7_WORKPOOL      *pool;
 #endif
   P7_BG            *bg;
   P7_PIPELINE      *pli;
@@ -132,6 +135,7 @@ static ESL_OPTIONS options[] = {
   { "--Eft",         eslARG_REAL,      "0.04", NULL,"0<x<1",    NULL,    NULL,  NULL,            "tail mass for Forward exponential tail tau fit",              11 },   
 /* Other options */
   { "--nonull2",    eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL,  NULL,            "turn off biased composition score corrections",               12 },
+  { "--bands",      eslARG_NONE,         NULL, NULL, NULL,      NULL,    NULL, "--max",          "decode domains inside their posterior bands",                 12 },
   { "-Z",           eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,        FALSE, NULL, "x>0",     NULL,    NULL,  NULL,            "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,          "42", NULL, "n>=0",    NULL,    NULL,  NULL,            "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
@@ -172,7 +176,7 @@ static int  serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp);
 #ifdef HMMER_THREADS
 #define BLOCK_SIZE 1000
 
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp);
+static int  thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_SQREADER *rdr, ESL_SQFILE *dbfp);
 static void pipeline_thread(void *arg);
 #endif 
 
@@ -344,6 +348,7 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--EfN")        && fprintf(ofp, "# seq number, Fwd exp tau fit:     %d\n",             esl_opt_GetInteger(go, "--EfN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--Eft")        && fprintf(ofp, "# tail mass for Fwd exp tau fit:   %f\n",             esl_opt_GetReal   (go, "--Eft"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nonull2")    && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--bands")      && fprintf(ofp, "# banded domain decoding:          on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "-Z")           && fprintf(ofp, "# sequence search space set to:    %.0f\n",           esl_opt_GetReal(go, "-Z"))            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--domZ")       && fprintf(ofp, "# domain search space set to:      %.0f\n",           esl_opt_GetReal(go, "--domZ"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--seed"))
@@ -459,7 +464,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
-  ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WORKPOOL     *pool     = NULL;
+  P7_SQREADER     *rdr      = NULL;
 #endif
 
   /* Initializations */
@@ -529,7 +535,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
-      queue = esl_workqueue_Create(ncpus * 2);
+      pool      = p7_workpool_Create(ncpus, p7_workpool_SeqWeight);
+      if (pool == NULL) p7_Fail("Failed to create work pool");
     }
 #endif
 
@@ -546,7 +553,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].pool  = pool;
 #endif
     }
 
@@ -559,12 +566,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  p7_Fail("Failed to allocate sequence block");
 	}
 
-      status = esl_workqueue_Init(queue, block);
+      status = p7_workpool_Init(pool, block);
       if (status != eslOK) 
 	{
-	  p7_Fail("Failed to add block to work queue");
+	  p7_Fail("Failed to add block to work pool");
 	}
     }
+
+  /* A plain FASTA target file is parsed and digitized by several reader threads at once */
+  if (ncpus > 0 && p7_sqreader_IsUsable(dbfp))
+    rdr = p7_sqreader_Create(dbfp->filename, abc, 1 + ncpus / p7_SQREADER_CPUS_PER_THREAD);
 #endif
 
   /* Outer loop over sequence queries, if more than one */
@@ -641,7 +652,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	    }
 
 #ifdef HMMER_THREADS
-	  if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp);
+	  if (ncpus > 0) sstatus = thread_loop(threadObj, pool, rdr, dbfp);
 	  else           sstatus = serial_loop(info, dbfp);
 #else
 	  sstatus = serial_loop(info, dbfp);
@@ -761,10 +772,11 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   if (ncpus > 0)
     {
-      esl_workqueue_Reset(queue);
-      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+      p7_workpool_Reset(pool);
+      while (p7_workpool_Remove(pool, (void **) &block) == eslOK)
 	esl_sq_DestroyBlock(block);
-      esl_workqueue_Destroy(queue);
+      p7_workpool_Destroy(pool);
+      if (rdr) p7_sqreader_Destroy(rdr);
       esl_threads_Destroy(threadObj);
     }
 #endif
@@ -1625,47 +1637,40 @@ serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp)
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp)
+thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_SQREADER *rdr, ESL_SQFILE *dbfp)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
-  int  eofCount = 0;
   ESL_SQ_BLOCK *block;
   void         *newBlock;
 
-  esl_workqueue_Reset(queue);
+  p7_workpool_Reset(pool);
   esl_threads_WaitForStart(obj);
 
-  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
-  if (status != eslOK) p7_Fail("Work queue reader failed");
-      
+  /* A plain FASTA file is read and digitized by the P7_SQREADER's own threads. */
+  if (rdr != NULL)
+    {
+      sstatus = p7_sqreader_Run(rdr, pool);
+      if (sstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", rdr->filename, rdr->errbuf);
+    }
+
   /* Main loop: */
-  while (sstatus == eslOK)
+  while (rdr == NULL && sstatus == eslOK)
     {
+      status = p7_workpool_ReaderGet(pool, &newBlock);
+      if (status != eslOK) p7_Fail("Work pool reader failed");
       block = (ESL_SQ_BLOCK *) newBlock;
+
       sstatus = esl_sqio_ReadBlock(dbfp, block, -1, -1, /*max_init_window=*/FALSE, FALSE);
-      if (sstatus == eslEOF)
-	{
-	  if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
-	  ++eofCount;
-	}
 
-      if (sstatus == eslOK)
-	{
-	  status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
-	  if (status != eslOK) p7_Fail("Work queue reader failed");
-	}
+      status = p7_workpool_ReaderPut(pool, block, (sstatus == eslOK ? block->count : 0));
+      if (status != eslOK) p7_Fail("Work pool reader failed");
     }
 
-  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
-  if (status != eslOK) p7_Fail("Work queue reader failed");
-
-  if (sstatus == eslEOF)
-    {
-      /* wait for all the threads to complete */
-      esl_threads_WaitForFinish(obj);
-      esl_workqueue_Complete(queue);  
-    }
+  /* wait for the workers to finish the blocks, then for the threads to exit */
+  status = p7_workpool_ReaderDone(pool);
+  if (status != eslOK) p7_Fail("Work pool reader failed");
+  esl_threads_WaitForFinish(obj);
 
   return sstatus;
 }
@@ -1680,7 +1685,7 @@ pipeline_thread(void *arg)
   ESL_THREADS   *obj;
 
   ESL_SQ_BLOCK  *block = NULL;
-  void          *newBlock;
+  P7_WORKRANGE   rng;
 
   impl_Init();
 
@@ -1690,15 +1695,13 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
-  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
-  if (status != eslOK) p7_Fail("Work queue worker failed");
-
-  /* loop until all blocks have been processed */
-  block = (ESL_SQ_BLOCK *) newBlock;
-  while (block->count > 0)
+  /* loop over ranges of targets, taken from our deque or stolen, until all blocks have been processed */
+  while ((status = p7_workpool_WorkerNext(info->pool, workeridx, &rng)) == eslOK)
     {
+      block = (ESL_SQ_BLOCK *) rng.blk;
+
       /* Main loop: */
-      for (i = 0; i < block->count; ++i)
+      for (i = rng.start; i < rng.end; ++i)
 	{
 	  ESL_SQ *dbsq = block->list + i;
 
@@ -1712,14 +1715,10 @@ pipeline_thread(void *arg)
 	  p7_pipeline_Reuse(info->pli);
 	}
 
-      status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
-      if (status != eslOK) p7_Fail("Work queue worker failed");
-
-      block = (ESL_SQ_BLOCK *) newBlock;
+      status = p7_workpool_WorkerDone(info->pool, &rng);
+      if (status != eslOK) p7_Fail("Work pool worker failed");
     }
-
-  status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
-  if (status != eslOK) p7_Fail("Work queue worker failed");
+  if (status != eslEOD) p7_Fail("Work pool worker failed");
 
   esl_threads_Finished(obj, workeridx);
   return;
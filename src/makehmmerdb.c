@@ -6,6 +6,12 @@
 #include "esl_mem.h"
 
 #include <string.h>
+#include <inttypes.h>
+
+#ifdef HMMER_THREADS
+#include <pthread.h>
+#include "esl_threads.h"
+#endif
 
 #include "hmmer.h"
 #include "divsufsort.h"
@@ -13,6 +19,7 @@
 
 #define FM_BLOCK_COUNT 100000 //max number of SQ objects in a block
 #define FM_BLOCK_OVERLAP 20000 //20 Kbases of overlap, at most, between adjascent FM-index blocks
+#define FM_READ_CHUNK 1000000000 //esl_sqio_ReadBlock() counts residues in an int, so larger FM-index blocks are read in pieces this size
 #define ALPHOPTS "--amino,--dna,--rna"                         /* Exclusive options for alphabet choice */
 
 
@@ -21,7 +28,6 @@ static ESL_OPTIONS options[] = {
   { "-h",           eslARG_NONE,        FALSE, NULL, NULL,    NULL,  NULL,  NULL,       "show brief help on version and usage",                      1 },
 
   /* Selecting the alphabet rather than autoguessing it */
-  //TODO: when I make the FM method work for amino acids, re-enable this selection
   { "--amino",   eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is protein sequence",                                 2 },
   { "--dna",     eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is DNA sequence",                                     2 },
   { "--rna",     eslARG_NONE,   FALSE, NULL, NULL,   ALPHOPTS,    NULL,     NULL,       "input is RNA sequence",                                     2 },
@@ -31,6 +37,10 @@ static ESL_OPTIONS options[] = {
   { "--bin_length", eslARG_INT,        "256", NULL, NULL,    NULL,  NULL,  NULL,        "bin length (power of 2;  32<=b<=4096)",                     3 },
   { "--sa_freq",    eslARG_INT,        "8",   NULL, NULL,    NULL,  NULL,  NULL,        "suffix array sample rate (power of 2)",                     3 },
   { "--block_size", eslARG_INT,        "50",  NULL, NULL,    NULL,  NULL,  NULL,        "input sequence broken into blocks this size (Mbases)",      3 },
+  { "--max_mem",    eslARG_INT,        "0",   NULL, "n>=0",  NULL,  NULL,  NULL,        "limit memory for building blocks to <n> Mbytes (0: no limit)", 3 },
+#ifdef HMMER_THREADS
+  { "--cpu",        eslARG_INT,     p7_NCPU,"HMMER_NCPU","n>=0",NULL, NULL,  NULL,        "number of blocks to build in parallel",                     3 },
+#endif
 
   /* hidden*/
   { "--fwd_only",   eslARG_NONE,       FALSE, NULL, NULL,    NULL,  NULL,  NULL,        "build FM-index only for forward search (not for HMMER)",    9 },
@@ -60,8 +70,8 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_seqf
       if (puts("\nBasic options:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 1, 2, 80); /* 1= group; 2 = indentation; 120=textwidth*/
 
-//      if (puts("\nOptions for selecting alphabet rather than guessing it:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
-//      esl_opt_DisplayHelp(stdout, go, 2, 2, 80);
+      if (puts("\nOptions for selecting alphabet rather than guessing it:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 2, 2, 80);
 
       if (puts("\nSpecial options:") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 3, 2, 80); /* 2= group; 2 = indentation; 120=textwidth*/
@@ -108,6 +118,10 @@ output_header(FILE *ofp, const ESL_GETOPTS *go, char *seqfile, char *fmfile)
   if (esl_opt_IsUsed(go, "--amino")      && fprintf(ofp, "# input is asserted to be:                 protein\n")                                        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--dna")        && fprintf(ofp, "# input is asserted to be:                 DNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--rna")        && fprintf(ofp, "# input is asserted to be:                 RNA\n")                                            < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--max_mem")    && fprintf(ofp, "# memory limit for building blocks:        %d Mbytes\n", esl_opt_GetInteger(go, "--max_mem")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#ifdef HMMER_THREADS
+  if (esl_opt_IsUsed(go, "--cpu")        && fprintf(ofp, "# number of worker threads:                %d\n", esl_opt_GetInteger(go, "--cpu"))     < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#endif
   if (fprintf(ofp, "# - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -\n\n")           < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   return eslOK;
 }
@@ -167,28 +181,31 @@ ERROR:
  */
 int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig_offset,
                         uint32_t seq_cnt, uint32_t ambig_cnt, uint32_t overlap,
-                        FM_DATA *fm_data, uint32_t *SAsamp,
-                        uint32_t *cnts_sb, uint16_t *cnts_b,
+                        FM_DATA *fm_data, uint64_t *SAsamp,
+                        uint64_t *cnts_sb, uint16_t *cnts_b,
                         uint64_t N, uint8_t **Tcompressed, FILE *fp
     ) {
 
 
   int status;
   uint64_t i,j,c,joffset;
+  int64_t  sa;
   int chars_per_byte = 8/meta->charBits;
-  uint32_t compressed_bytes =   ((chars_per_byte-1+N)/chars_per_byte);
-  uint32_t term_loc;
+  uint64_t compressed_bytes =   ((chars_per_byte-1+N)/chars_per_byte);
+  uint64_t term_loc;
 
   uint8_t *T             = fm_data->T;
   uint8_t *BWT           = fm_data->BWT;
   int *SA                = (int*) fm_data->SA; //cast this way because libdivsufsort requires an int.
-  uint32_t *occCnts_sb   = fm_data->occCnts_sb;
+  int64_t *SA64          = (int64_t*) fm_data->SA64; //set instead of SA when blocks may hold 2^31 or more characters
+  uint32_t *SAsamp32     = (uint32_t*) SAsamp;
+  uint64_t *occCnts_sb   = fm_data->occCnts_sb;
   uint16_t *occCnts_b    = fm_data->occCnts_b;
 
 
-  int num_freq_cnts_b  = 1+ceil((double)N/(meta->freq_cnt_b));
-  int num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
-  int num_SA_samples   = 1+floor((double)N/meta->freq_SA);
+  uint64_t num_freq_cnts_b  = 1+ceil((double)N/(meta->freq_cnt_b));
+  uint64_t num_freq_cnts_sb = 1+ceil((double)N/meta->freq_cnt_sb);
+  uint64_t num_SA_samples   = 1+floor((double)N/meta->freq_SA);
 
   if (SAsamp != NULL) {
     ESL_REALLOC ((*Tcompressed), compressed_bytes * sizeof(uint8_t));
@@ -198,7 +215,8 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
   }
 
   // Construct the Suffix Array on text T
-  status = divsufsort(fm_data->T, SA, N);
+  if (SA64 != NULL) status = divsufsort64(fm_data->T, SA64, N);
+  else              status = divsufsort(fm_data->T, SA, N);
   if ( status < 0 )
     esl_fatal("buildAndWriteFMIndex: Error building BWT.\n");
 
@@ -216,7 +234,8 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
   }
   T[N-1]=0;
 
-  BWT[0] =  SA[0]==0 ? 0 /* '$' */ : T[ SA[0]-1] ;
+  sa     = (SA64 != NULL ? SA64[0] : SA[0]);
+  BWT[0] =  sa==0 ? 0 /* '$' */ : T[ sa-1] ;
 
   cnts_sb[BWT[0]]++;
   cnts_b[BWT[0]]++;
@@ -228,18 +247,19 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
 
   //Scan through SA to build the BWT and FM index structures
   for(j=1; j < N; ++j) {
-    if (SA[j]==0) { //'$'
+    sa = (SA64 != NULL ? SA64[j] : SA[j]);
+    if (sa==0) { //'$'
       term_loc = j;
       BWT[j] =  0; //store 'a' in place of '$'
     } else {
-      BWT[j] =  T[ SA[j]-1] ;
+      BWT[j] =  T[ sa-1] ;
     }
 
 
     //sample the SA
     if (SAsamp != NULL) {
       if ( !(j % meta->freq_SA) )
-        SAsamp[ j/meta->freq_SA ] = ( SA[j] == N - 1 ? -1 : SA[j] ) ; // handle the wrap-around '$'
+        SAsamp[ j/meta->freq_SA ] = ( sa == N - 1 ? UINT64_MAX : sa ) ; // handle the wrap-around '$'
     }
 
     cnts_sb[BWT[j]]++;
@@ -311,10 +331,16 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
   T[N-1] = 0;
 
 
+  // Blocks that fit 32-bit positions keep 32-bit SA samples; narrow them in place
+  if (SAsamp != NULL && N <= UINT32_MAX) {
+    for (i=0; i<num_SA_samples; i++)
+      SAsamp32[i] = SAsamp[i];
+  }
+
   // Write the FM-index meta data
   if(fwrite(&N, sizeof(uint64_t), 1, fp) !=  1)
     esl_fatal( "buildAndWriteFMIndex: Error writing block_length in FM index.\n");
-  if(fwrite(&term_loc, sizeof(uint32_t), 1, fp) !=  1)
+  if(fwrite(&term_loc, sizeof(uint64_t), 1, fp) !=  1)
     esl_fatal( "buildAndWriteFMIndex: Error writing terminal location in FM index.\n");
   if(fwrite(&seq_offset, sizeof(uint32_t), 1, fp) !=  1)
     esl_fatal( "buildAndWriteFMIndex: Error writing seq_offset in FM index.\n");
@@ -332,11 +358,11 @@ int buildAndWriteFMIndex (FM_METADATA *meta, uint32_t seq_offset, uint32_t ambig
     esl_fatal( "buildAndWriteFMIndex: Error writing T in FM index.\n");
   if(fwrite(BWT, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
     esl_fatal( "buildAndWriteFMIndex: Error writing BWT in FM index.\n");
-  if(SAsamp != NULL && fwrite(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
+  if(SAsamp != NULL && fwrite(SAsamp, (N > UINT32_MAX ? sizeof(uint64_t) : sizeof(uint32_t)), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
     esl_fatal( "buildAndWriteFMIndex: Error writing SA in FM index.\n");
   if(fwrite(occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
     esl_fatal( "buildAndWriteFMIndex: Error writing occCnts_b in FM index.\n");
-  if(fwrite(occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
+  if(fwrite(occCnts_sb, sizeof(uint64_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
     esl_fatal( "buildAndWriteFMIndex: Error writing occCnts_sb in FM index.\n");
 
 
@@ -350,6 +376,237 @@ ERROR:
 
 
 
+/* Function:  writeAlignPad()
+ * Synopsis:  Zero-pad <fp> to the next FM_ALIGN boundary, where the
+ *            next array of a block starts (see fm_FM_mmap()).
+ */
+static void
+writeAlignPad (FILE *fp)
+{
+  static const char zeros[FM_ALIGN] = { 0 };
+  off_t  pos;
+  size_t n;
+
+  if ((pos = ftello(fp)) == -1)
+    esl_fatal( "writeAlignPad: Error getting position in FM index.\n");
+  n = FM_ALIGNED(pos) - pos;
+  if (n > 0 && fwrite(zeros, sizeof(char), n, fp) != n)
+    esl_fatal( "writeAlignPad: Error writing padding in FM index.\n");
+}
+
+
+/* FM_BUILD_SLOT
+ * Buffers for building the index of one block. The main thread reads
+ * a block's text into T and fills in its offsets, then hands the slot
+ * to a builder, which appends the block's FM-indexes to the slot's own
+ * temporary file. Block i always goes to slot i % nslots, so each
+ * temporary file holds every nslots'th block, in order.
+ */
+typedef struct {
+  FM_METADATA *meta;
+  FM_DATA      fm_data;
+  uint64_t    *SAsamp;
+  uint64_t    *cnts_sb;
+  uint16_t    *cnts_b;
+  uint8_t     *Tcompressed;
+
+  char         tmp_filename[16];
+  FILE        *fptmp;
+
+  uint32_t     seq_offset;
+  uint32_t     ambig_offset;
+  uint32_t     seq_cnt;
+  uint32_t     ambig_cnt;
+  uint32_t     overlap;
+  uint64_t     block_length;
+
+  int          full;   /* TRUE from when a block is handed over until it's written */
+  int          done;   /* TRUE once no more blocks are coming                       */
+#ifdef HMMER_THREADS
+  pthread_t       thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+#endif
+} FM_BUILD_SLOT;
+
+
+/* Function:  slotBytes()
+ * Synopsis:  Memory needed to build one block of up to <max_block_size>
+ *            characters.
+ */
+static uint64_t
+slotBytes (const FM_METADATA *meta, uint64_t max_block_size)
+{
+  uint64_t n = max_block_size;
+
+  return   n                                            // T
+         + n                                            // BWT
+         + n * (n > INT32_MAX ? sizeof(int64_t) : sizeof(int))   // full suffix array
+         + (1 + n / meta->freq_SA)     * sizeof(uint64_t)          // SA samples
+         + (2 + n / meta->freq_cnt_sb) * meta->alph_size * sizeof(uint64_t)
+         + (2 + n / meta->freq_cnt_b)  * meta->alph_size * sizeof(uint16_t)
+         + n / (8 / meta->charBits);                    // compressed T
+}
+
+
+/* Function:  slotCreate()
+ * Synopsis:  Allocate a block-building slot, and open its temporary file.
+ */
+static int
+slotCreate (FM_BUILD_SLOT *slot, FM_METADATA *meta, uint64_t max_block_size)
+{
+  int status;
+
+  slot->meta                = meta;
+  slot->fm_data.T           = NULL;
+  slot->fm_data.BWT_mem     = NULL;
+  slot->fm_data.BWT         = NULL;
+  slot->fm_data.SA          = NULL;
+  slot->fm_data.SA64        = NULL;
+  slot->fm_data.C           = NULL;
+  slot->fm_data.occCnts_sb  = NULL;
+  slot->fm_data.occCnts_b   = NULL;
+  slot->fm_data.is_view     = FALSE;
+  slot->SAsamp              = NULL;
+  slot->cnts_sb             = NULL;
+  slot->cnts_b              = NULL;
+  slot->Tcompressed         = NULL;
+  slot->fptmp               = NULL;
+  slot->full                = FALSE;
+  slot->done                = FALSE;
+
+  ESL_ALLOC (slot->fm_data.T, max_block_size * sizeof(uint8_t));
+  ESL_ALLOC (slot->fm_data.BWT_mem, max_block_size * sizeof(uint8_t));
+  slot->fm_data.BWT = slot->fm_data.BWT_mem;  // in SSE code, used to align memory. Here, doesn't matter
+  if (max_block_size > INT32_MAX) ESL_ALLOC (slot->fm_data.SA64, max_block_size * sizeof(int64_t)); // too big for the int version of libdivsufsort
+  else                            ESL_ALLOC (slot->fm_data.SA,   max_block_size * sizeof(int));
+  ESL_ALLOC (slot->SAsamp,     (1 + floor((double)max_block_size/meta->freq_SA) ) * sizeof(uint64_t));
+  ESL_ALLOC (slot->fm_data.occCnts_sb, (1+ceil((double)max_block_size/meta->freq_cnt_sb)) *  meta->alph_size * sizeof(uint64_t)); // every freq_cnt_sb positions, store an array of ints
+  ESL_ALLOC (slot->fm_data.occCnts_b,  ( 1+ceil((double)max_block_size/meta->freq_cnt_b)) *  meta->alph_size * sizeof(uint16_t)); // every freq_cnt_b positions, store an array of 8-byte ints
+  ESL_ALLOC (slot->cnts_sb,    meta->alph_size * sizeof(uint64_t));
+  ESL_ALLOC (slot->cnts_b,     meta->alph_size * sizeof(uint16_t));
+
+  strcpy(slot->tmp_filename, "fmtmpXXXXXX");
+  if (esl_tmpfile(slot->tmp_filename, &(slot->fptmp)) != eslOK) esl_fatal("unable to open fm-index tmpfile");
+
+#ifdef HMMER_THREADS
+  if (pthread_mutex_init(&(slot->mutex), NULL) != 0) esl_fatal("unable to create block mutex");
+  if (pthread_cond_init (&(slot->cond),  NULL) != 0) esl_fatal("unable to create block condition");
+#endif
+
+  return eslOK;
+
+ERROR:
+  return status;
+}
+
+
+/* Function:  slotDestroy()
+ */
+static void
+slotDestroy (FM_BUILD_SLOT *slot)
+{
+  fm_FM_destroy(&(slot->fm_data), TRUE);
+  free(slot->SAsamp);
+  free(slot->cnts_sb);
+  free(slot->cnts_b);
+  free(slot->Tcompressed);
+  if (slot->fptmp) fclose(slot->fptmp);
+#ifdef HMMER_THREADS
+  pthread_mutex_destroy(&(slot->mutex));
+  pthread_cond_destroy (&(slot->cond));
+#endif
+}
+
+
+/* Function:  slotBuild()
+ * Synopsis:  Build and write the FM-index(es) for the block in <slot>.
+ */
+static void
+slotBuild (FM_BUILD_SLOT *slot)
+{
+  FM_METADATA *meta = slot->meta;
+
+  //build and write FM-index for T.  This will be a BWT on the reverse of the sequence, required for reverse-traversal of the BWT
+  buildAndWriteFMIndex(meta, slot->seq_offset, slot->ambig_offset, slot->seq_cnt, slot->ambig_cnt, slot->overlap, &(slot->fm_data),
+                       slot->SAsamp, slot->cnts_sb, slot->cnts_b, slot->block_length, &(slot->Tcompressed), slot->fptmp);
+
+  if ( ! meta->fwd_only ) {
+    //build and write FM-index for un-reversed T  (used to find reverse hits using forward traversal of the BWT
+    buildAndWriteFMIndex(meta, slot->seq_offset, slot->ambig_offset, slot->seq_cnt, slot->ambig_cnt, 0, &(slot->fm_data),
+                       NULL, slot->cnts_sb, slot->cnts_b, slot->block_length, &(slot->Tcompressed), slot->fptmp);
+  }
+}
+
+
+#ifdef HMMER_THREADS
+/* Function:  slotThread()
+ * Synopsis:  Builder thread: build each block handed to this slot, until
+ *            told there are no more.
+ */
+static void *
+slotThread (void *arg)
+{
+  FM_BUILD_SLOT *slot = (FM_BUILD_SLOT *) arg;
+
+  pthread_mutex_lock(&(slot->mutex));
+  while (1) {
+    while (!slot->full && !slot->done)
+      pthread_cond_wait(&(slot->cond), &(slot->mutex));
+    if (!slot->full) break;
+
+    pthread_mutex_unlock(&(slot->mutex));
+    slotBuild(slot);
+    pthread_mutex_lock(&(slot->mutex));
+
+    slot->full = FALSE;
+    pthread_cond_broadcast(&(slot->cond));
+  }
+  pthread_mutex_unlock(&(slot->mutex));
+
+  return NULL;
+}
+#endif /*HMMER_THREADS*/
+
+
+/* Function:  slotAcquire()
+ * Synopsis:  Wait until <slot>'s builder has finished with its last block,
+ *            so the reader can fill it with the next one.
+ */
+static void
+slotAcquire (FM_BUILD_SLOT *slot, int threaded)
+{
+#ifdef HMMER_THREADS
+  if (threaded) {
+    pthread_mutex_lock(&(slot->mutex));
+    while (slot->full)
+      pthread_cond_wait(&(slot->cond), &(slot->mutex));
+    pthread_mutex_unlock(&(slot->mutex));
+  }
+#endif
+}
+
+
+/* Function:  slotSubmit()
+ * Synopsis:  Hand a filled <slot> to its builder; without threads, build
+ *            it here.
+ */
+static void
+slotSubmit (FM_BUILD_SLOT *slot, int threaded)
+{
+#ifdef HMMER_THREADS
+  if (threaded) {
+    pthread_mutex_lock(&(slot->mutex));
+    slot->full = TRUE;
+    pthread_cond_broadcast(&(slot->cond));
+    pthread_mutex_unlock(&(slot->mutex));
+    return;
+  }
+#endif
+  slotBuild(slot);
+}
+
+
 /* Function:  main()
  * Synopsis:  break input sequence set into chunks, for each one building the
  *            Burrows-Wheeler transform and corresponding FM-index. Maintain requisite
@@ -361,7 +618,6 @@ int
 main(int argc, char **argv) 
 {
   int status           = eslOK;
-  char tmp_filename[16] = "fmtmpXXXXXX";
   FILE *fptmp          = NULL;
   FILE *fp             = NULL;
 
@@ -369,10 +625,14 @@ main(int argc, char **argv)
   // these will be allocated once, and reused for each built block
   FM_METADATA *meta    = NULL;
   FM_DATA *fm_data     = NULL;
-  uint32_t *SAsamp     = NULL;
-  uint32_t *cnts_sb    = NULL;
-  uint16_t *cnts_b     = NULL;
-  uint8_t *Tcompressed = NULL;
+  uint64_t *SAsamp     = NULL;
+  FM_BUILD_SLOT *slots = NULL;
+  FM_BUILD_SLOT *slot  = NULL;
+  int nslots           = 0;
+  int ncpus            = 0;
+  int threaded         = FALSE;
+  uint64_t max_mem     = 0;
+  uint64_t slot_bytes;
 
 
 
@@ -382,9 +642,10 @@ main(int argc, char **argv)
   long i,j,c;
 
   int chars_per_byte;
-  int num_freq_cnts_sb ;
-  int num_freq_cnts_b ;
-  int num_SA_samples ;
+  uint64_t num_freq_cnts_sb ;
+  uint64_t num_freq_cnts_b ;
+  uint64_t num_SA_samples ;
+  size_t   SA_sample_size;
 
   int             infmt     = eslSQFILE_UNKNOWN;
   int             alphatype = eslUNKNOWN;
@@ -397,13 +658,16 @@ main(int argc, char **argv)
 
   char *fname_in = NULL;
   char *fname_out= NULL;
-  uint32_t block_size = 50000000;
+  uint64_t block_size = 50000000;
+  uint64_t chunk_size;
   int sq_cnt = 0;
   int use_tmpsq = 0;
+  int continuing;
+  int first_chunk;
   uint64_t block_length;
   uint64_t total_char_count = 0;
 
-  uint32_t max_block_size;
+  uint64_t max_block_size;
 
   int numblocks = 0;
   uint32_t numseqs = 0;
@@ -415,8 +679,8 @@ main(int argc, char **argv)
   uint32_t overlap = 0;
   uint32_t seq_cnt;
   uint32_t ambig_cnt;
-  int compressed_bytes;
-  uint32_t term_loc;
+  uint64_t compressed_bytes;
+  uint64_t term_loc;
   int alphaguess;
 
   ESL_GETOPTS     *go  = NULL;    /* command line processing                 */
@@ -434,6 +698,8 @@ main(int argc, char **argv)
   if (meta == NULL)
     esl_fatal("unable to allocate memory to store FM meta data\n");
   meta->alph = NULL;
+  meta->map  = NULL;
+  meta->nmap = 0;
 
 
   ESL_ALLOC (meta->ambig_list, sizeof(FM_AMBIGLIST));
@@ -442,6 +708,7 @@ main(int argc, char **argv)
   fm_initAmbiguityList(meta->ambig_list);
 
 
+  meta->version     = fm_VERSION_CURRENT;
   meta->alph_type   = fm_DNA;
   meta->freq_SA     = 8;
   meta->freq_cnt_b  = 256;
@@ -463,12 +730,16 @@ main(int argc, char **argv)
     esl_fatal ("SA_freq must be a power of 2\n");
 
 
-  if (esl_opt_IsOn(go, "--block_size")) block_size = 1000000 * esl_opt_GetInteger(go, "--block_size");
-  if ( block_size <= 0  )
-    esl_fatal ("block_size must be a positive number\n");
+  if (esl_opt_IsOn(go, "--block_size")) {
+    if ( esl_opt_GetInteger(go, "--block_size") <= 0  )
+      esl_fatal ("block_size must be a positive number\n");
+    block_size = (uint64_t) 1000000 * esl_opt_GetInteger(go, "--block_size");
+  }
 
-  if ( block_size > 3500000000  )
-    esl_fatal ("block_size must less than 3500M\n");
+  max_mem = (uint64_t) 1000000 * esl_opt_GetInteger(go, "--max_mem");
+#ifdef HMMER_THREADS
+  ncpus   = ESL_MIN(esl_opt_GetInteger(go, "--cpu"), esl_threads_GetCPUCount());
+#endif
 
 
   //start timer
@@ -492,7 +763,6 @@ main(int argc, char **argv)
   if ( esl_opt_IsUsed(go, "--amino")  ) {
     meta->alph_type = fm_AMINO;
     alphatype = eslAMINO;
-    meta->fwd_only = 1;
   } else if (esl_opt_IsUsed(go, "--dna") || esl_opt_IsUsed(go, "--rna") ){
 
     //meta->alph = "dna"; //esl_opt_IsUsed(go, "--dna") ? "dna" || "rna";
@@ -508,7 +778,6 @@ main(int argc, char **argv)
     } else if (alphaguess == eslAMINO) {
       meta->alph_type = fm_AMINO;
       alphatype = eslAMINO;
-      meta->fwd_only = 1;
     } else {
       esl_fatal("Unable to guess alphabet. Try '--dna' or '--amino'\n%s", ""); //'dna_full'
     }
@@ -537,172 +806,211 @@ main(int argc, char **argv)
   block->complete = FALSE;
   max_block_size = FM_BLOCK_OVERLAP+block_size+1  + ceil(block_size*.05); // first +1 for the '$',  +5% of block size because that's the slop allowed by readwindow
 
-  /* Allocate BWT, Text, SA, and FM-index data structures, allowing storage of maximally large sequence*/
-  ESL_ALLOC(fm_data, sizeof(FM_DATA) );
-  fm_data->T          = NULL;
-  fm_data->BWT_mem    = NULL;
-  fm_data->BWT        = NULL;
-  fm_data->SA         = NULL;
-  fm_data->C          = NULL;
-  fm_data->occCnts_sb = NULL;
-  fm_data->occCnts_b  = NULL;
-
-  ESL_ALLOC (fm_data->T, max_block_size * sizeof(uint8_t));
-  ESL_ALLOC (fm_data->BWT_mem, max_block_size * sizeof(uint8_t));
-  fm_data->BWT = fm_data->BWT_mem;  // in SSE code, used to align memory. Here, doesn't matter
-  ESL_ALLOC (fm_data->SA, max_block_size * sizeof(int));
-  ESL_ALLOC (SAsamp,     (1 + floor((double)max_block_size/meta->freq_SA) ) * sizeof(uint32_t));
-  ESL_ALLOC (fm_data->occCnts_sb, (1+ceil((double)max_block_size/meta->freq_cnt_sb)) *  meta->alph_size * sizeof(uint32_t)); // every freq_cnt_sb positions, store an array of ints
-  ESL_ALLOC (fm_data->occCnts_b,  ( 1+ceil((double)max_block_size/meta->freq_cnt_b)) *  meta->alph_size * sizeof(uint16_t)); // every freq_cnt_b positions, store an array of 8-byte ints
-  ESL_ALLOC (cnts_sb,    meta->alph_size * sizeof(uint32_t));
-  ESL_ALLOC (cnts_b,     meta->alph_size * sizeof(uint16_t));
-
-  // Open a temporary file, to which FM-index data will be written
-  if (esl_tmpfile(tmp_filename, &fptmp) != eslOK) esl_fatal("unable to open fm-index tmpfile");
+  /* One slot of BWT, Text, SA, and FM-index data structures, allowing storage of maximally large
+   * sequence, per block being built at once: one per worker thread, as many as fit in --max_mem.
+   */
+  slot_bytes = slotBytes(meta, max_block_size);
+  nslots     = ESL_MAX(1, ncpus);
+  if (max_mem > 0) {
+    if (slot_bytes > max_mem)
+      esl_fatal("--max_mem %d is too small: building a block of --block_size %d takes about %" PRIu64 " Mbytes\n",
+                esl_opt_GetInteger(go, "--max_mem"), esl_opt_GetInteger(go, "--block_size"), (slot_bytes + 999999) / 1000000);
+    nslots = ESL_MIN(nslots, max_mem / slot_bytes);
+  }
+  threaded = (ncpus > 0);
+
+  ESL_ALLOC (slots, nslots * sizeof(FM_BUILD_SLOT));
+  memset(slots, 0, nslots * sizeof(FM_BUILD_SLOT));
+  for (i=0; i<nslots; i++)
+    if (slotCreate(slots+i, meta, max_block_size) != eslOK) goto ERROR;
+
+#ifdef HMMER_THREADS
+  for (i=0; threaded && i<nslots; i++)
+    if (pthread_create(&(slots[i].thread), NULL, slotThread, slots+i) != 0) esl_fatal("unable to create builder thread");
+#endif
 
   /* Main loop: */
   while (status == eslOK ) {
-    //reset block as an empty vessel
-    for (i=0; i<block->count; i++){
-      esl_sq_Reuse(block->list + i);  
-    }
-    // Check how much space the block structure is using and re-allocate if it has grown to more than 20*block_size bytes
-    // this loop iterates from 0 to block->listsize rather than block->count because we want to count all of the
-    // block's sub-structures, not just the ones that contained sequence data after the last call to ReadBlock()    
-    // This doesn't check some of the less-common sub-structures in a sequence, but it should be good enough for
-    // our goal of keeping block size under control
-    uint64_t block_space = 0;
-    for(i=0; i<block->listSize; i++){
-      block_space += block->list[i].nalloc;
-      block_space += block->list[i].aalloc;   
-      block_space += block->list[i].dalloc;
-      block_space += block->list[i].srcalloc; 
-      block_space += block->list[i].salloc;
-      if (block->list[i].ss != NULL){ 
-        block_space += block->list[i].salloc; // ss field is not always presesnt, but takes salloc bytes if it is
-      }
-    }
 
-    if(block_space > 20*block_size){
-      ESL_SQ_BLOCK *new_block = esl_sq_CreateDigitalBlock(FM_BLOCK_COUNT, abc);
-      new_block->count = block->count; // copying this field shouldn't be necessary, but I can't guarantee that it isn't.
-      new_block->listSize = block->listSize;  
-      new_block->complete = block->complete;  
-      new_block->first_seqidx = block->first_seqidx;
-      esl_sq_DestroyBlock(block);   
-      block = new_block; 
-    }
-    if (use_tmpsq) {
-        esl_sq_Copy(tmpsq , block->list);
-        block->complete = FALSE;  //this lets ReadBlock know that it needs to append to a small bit of previously-read seqeunce
-        block->list->C = FM_BLOCK_OVERLAP; // overload the ->C value, which ReadBlock uses to determine how much
-                                               // overlap should be retained in the ReadWindow step
-    } else {
-        block->complete = TRUE;
-    }
-
-    
-    status = esl_sqio_ReadBlock(sqfp, block, block_size, -1, /*max_init_window=*/FALSE, alphatype != eslAMINO);
-    if (status == eslEOF) continue;
-    if (status != eslOK)  esl_fatal("Parse failed (sequence file %s): status:%d\n%s\n",
-                                                  sqfp->filename, status, esl_sqfile_GetErrorBuf(sqfp));
+    slot = slots + (numblocks % nslots);
+    slotAcquire(slot, threaded);
 
-    seq_offset = numseqs;
+    seq_offset   = numseqs;
     ambig_offset = meta->ambig_list->count;
+    block_length = 0;
+    overlap      = 0;
+    first_chunk  = TRUE;
 
-    if (block->complete || block->count == 0) {
-        use_tmpsq = FALSE;
-    } else {
-        /* The final sequence on the block was a probably-incomplete window of the active sequence.
-         * Grab a copy of the end for use in the next pass, to ensure we don't miss hits crossing
-         * the boundary between two blocks.
-         */
-        esl_sq_Copy(block->list + (block->count - 1) , tmpsq);
-        use_tmpsq = TRUE;
-    }
+    /* Fill one FM-index block. esl_sqio_ReadBlock() takes an int residue
+     * count, so a block larger than FM_READ_CHUNK takes several reads; a
+     * sequence split between two of them is stitched back into a single
+     * segment, dropping the overlap the second read repeats.
+     */
+    while (block_length < block_size) {
+      chunk_size = ESL_MIN(block_size - block_length, FM_READ_CHUNK);
+
+      //reset block as an empty vessel
+      for (i=0; i<block->count; i++){
+        esl_sq_Reuse(block->list + i);
+      }
+      // Check how much space the block structure is using and re-allocate if it has grown to more than 20*chunk_size bytes
+      // this loop iterates from 0 to block->listsize rather than block->count because we want to count all of the
+      // block's sub-structures, not just the ones that contained sequence data after the last call to ReadBlock()
+      // This doesn't check some of the less-common sub-structures in a sequence, but it should be good enough for
+      // our goal of keeping block size under control
+      uint64_t block_space = 0;
+      for(i=0; i<block->listSize; i++){
+        block_space += block->list[i].nalloc;
+        block_space += block->list[i].aalloc;
+        block_space += block->list[i].dalloc;
+        block_space += block->list[i].srcalloc;
+        block_space += block->list[i].salloc;
+        if (block->list[i].ss != NULL){
+          block_space += block->list[i].salloc; // ss field is not always presesnt, but takes salloc bytes if it is
+        }
+      }
 
-    block->first_seqidx = sq_cnt;
-    sq_cnt += block->count - (use_tmpsq ? 1 : 0);// if there's an incomplete sequence read into the block wait to count it until it's complete.
+      if(block_space > 20*chunk_size){
+        ESL_SQ_BLOCK *new_block = esl_sq_CreateDigitalBlock(FM_BLOCK_COUNT, abc);
+        new_block->count = block->count; // copying this field shouldn't be necessary, but I can't guarantee that it isn't.
+        new_block->listSize = block->listSize;
+        new_block->complete = block->complete;
+        new_block->first_seqidx = block->first_seqidx;
+        esl_sq_DestroyBlock(block);
+        block = new_block;
+      }
+      continuing = use_tmpsq && !first_chunk;
+      if (use_tmpsq) {
+          esl_sq_Copy(tmpsq , block->list);
+          block->complete = FALSE;  //this lets ReadBlock know that it needs to append to a small bit of previously-read seqeunce
+          block->list->C = FM_BLOCK_OVERLAP; // overload the ->C value, which ReadBlock uses to determine how much
+                                                 // overlap should be retained in the ReadWindow step
+      } else {
+          block->complete = TRUE;
+      }
 
 
-    /* Read dseqs from block into text element T.
-    *  Convert the dsq from esl-alphabet to fm-alphabet (1..k for alphabet of size k).
-    *  (a) collapsing upper/lower case for appropriate sorting.
-    *  (b) reserving 0 for '$', which must be lexicographically smallest
-    *      (these will later be shifted to 0-based alphabet, once SA has been built)
-    *
-    */
-    block_length = 0;
-    for (i=0; i<block->count; i++) {
-
-      //start a new block, with space for the name
-      allocateSeqdata(meta, block->list+i, numseqs, &allocedseqs);
-
-      //meta data
-      meta->seq_data[numseqs].target_id       = block->first_seqidx + i ;
-      meta->seq_data[numseqs].target_start    = block->list[i].start;
-      meta->seq_data[numseqs].fm_start        = block_length;
-
-      if (block->list[i].name == NULL) meta->seq_data[numseqs].name[0] = '\0';
-          else  strcpy(meta->seq_data[numseqs].name, block->list[i].name );
-      if (block->list[i].acc == NULL) meta->seq_data[numseqs].acc[0] = '\0';
-          else  strcpy(meta->seq_data[numseqs].acc, block->list[i].acc );
-      if (block->list[i].source == NULL) meta->seq_data[numseqs].source[0] = '\0';
-          else  strcpy(meta->seq_data[numseqs].source, block->list[i].source );
-      if (block->list[i].desc == NULL) meta->seq_data[numseqs].desc[0] = '\0';
-          else  strcpy(meta->seq_data[numseqs].desc, block->list[i].desc );
-
-      meta->seq_data[numseqs].length = 0;
-      for (j=1; j<=block->list[i].n; j++) {
-        c = abc->sym[block->list[i].dsq[j]];
-        if ( meta->alph_type == fm_DNA) {
-          if (meta->inv_alph[c] == -1) {
-            // replace ambiguity characters by random choice of A,C,G, and T.
-            c = meta->alph[(int)(esl_random(r)*4)];
-
-            if (!in_ambig_run) {
-              fm_addAmbiguityRange(meta->ambig_list, block_length, block_length);
-              in_ambig_run=1;
+      status = esl_sqio_ReadBlock(sqfp, block, (int)chunk_size, -1, /*max_init_window=*/FALSE, alphatype != eslAMINO);
+      if (status == eslEOF) break;
+      if (status != eslOK)  esl_fatal("Parse failed (sequence file %s): status:%d\n%s\n",
+                                                    sqfp->filename, status, esl_sqfile_GetErrorBuf(sqfp));
+
+      if (block->complete || block->count == 0) {
+          use_tmpsq = FALSE;
+      } else {
+          /* The final sequence on the block was a probably-incomplete window of the active sequence.
+           * Grab a copy of the end for use in the next pass, to ensure we don't miss hits crossing
+           * the boundary between two blocks.
+           */
+          esl_sq_Copy(block->list + (block->count - 1) , tmpsq);
+          use_tmpsq = TRUE;
+      }
+
+      block->first_seqidx = sq_cnt;
+      sq_cnt += block->count - (use_tmpsq ? 1 : 0);// if there's an incomplete sequence read into the block wait to count it until it's complete.
+
+      if (first_chunk && block->count > 0) overlap = block->list[0].C;
+
+      // a segment's length is 32 bits; start a new one rather than overflow it
+      if (continuing && block->count > 0 && (uint64_t)meta->seq_data[numseqs-1].length + block->list[0].n - block->list[0].C > UINT32_MAX)
+        continuing = FALSE;
+
+
+      /* Read dseqs from block into text element T.
+      *  Convert the dsq from esl-alphabet to fm-alphabet (1..k for alphabet of size k).
+      *  (a) collapsing upper/lower case for appropriate sorting.
+      *  (b) reserving 0 for '$', which must be lexicographically smallest
+      *      (these will later be shifted to 0-based alphabet, once SA has been built)
+      *
+      */
+      for (i=0; i<block->count; i++) {
+
+        if (i == 0 && continuing) {
+          // the rest of the sequence that ended the previous read; it's already started in T
+          numseqs--;
+          j = block->list[i].C + 1;
+        } else {
+          //start a new block, with space for the name
+          allocateSeqdata(meta, block->list+i, numseqs, &allocedseqs);
+
+          //meta data
+          meta->seq_data[numseqs].target_id       = block->first_seqidx + i ;
+          meta->seq_data[numseqs].target_start    = block->list[i].start;
+          meta->seq_data[numseqs].fm_start        = block_length;
+
+          if (block->list[i].name == NULL) meta->seq_data[numseqs].name[0] = '\0';
+              else  strcpy(meta->seq_data[numseqs].name, block->list[i].name );
+          if (block->list[i].acc == NULL) meta->seq_data[numseqs].acc[0] = '\0';
+              else  strcpy(meta->seq_data[numseqs].acc, block->list[i].acc );
+          if (block->list[i].source == NULL) meta->seq_data[numseqs].source[0] = '\0';
+              else  strcpy(meta->seq_data[numseqs].source, block->list[i].source );
+          if (block->list[i].desc == NULL) meta->seq_data[numseqs].desc[0] = '\0';
+              else  strcpy(meta->seq_data[numseqs].desc, block->list[i].desc );
+
+          meta->seq_data[numseqs].length = 0;
+          j = 1;
+        }
+
+        for ( ; j<=block->list[i].n; j++) {
+          c = abc->sym[block->list[i].dsq[j]];
+          if ( meta->alph_type == fm_DNA) {
+            if (meta->inv_alph[c] == -1) {
+              // replace ambiguity characters by random choice of A,C,G, and T.
+              c = meta->alph[(int)(esl_random(r)*4)];
+
+              if (!in_ambig_run) {
+                fm_addAmbiguityRange(meta->ambig_list, block_length, block_length);
+                in_ambig_run=1;
+              } else {
+                meta->ambig_list->ranges[meta->ambig_list->count - 1].upper = block_length;
+              }
             } else {
-              meta->ambig_list->ranges[meta->ambig_list->count - 1].upper = block_length;
+              in_ambig_run=0;
             }
-          } else {
-            in_ambig_run=0;
+          } else if (meta->inv_alph[c] == -1) {
+            esl_fatal("requested alphabet doesn't match input text\n");
           }
-        } else if (meta->inv_alph[c] == -1) {
-          esl_fatal("requested alphabet doesn't match input text\n");
-        }
 
-        fm_data->T[block_length] = meta->inv_alph[c];
+          slot->fm_data.T[block_length] = meta->inv_alph[c];
 
-        block_length++;
-        if (j>block->list[i].C) total_char_count++; // add to total count, only if it's not redundant with earlier read
-        meta->seq_data[numseqs].length++;
+          block_length++;
+          if (j>block->list[i].C) total_char_count++; // add to total count, only if it's not redundant with earlier read
+          meta->seq_data[numseqs].length++;
+        }
+        numseqs++;
+        in_ambig_run = 0;
       }
-      numseqs++;
-      in_ambig_run = 0;
-    }
 
-    fm_data->T[block_length] = 0; // last character 0 is effectively '$' for suffix array
-    block_length++;
-
-    seq_cnt = numseqs-seq_offset;
-    ambig_cnt = meta->ambig_list->count - ambig_offset;
+      first_chunk = FALSE;
+    }
 
+    if (block_length == 0) continue; // nothing left to read
 
-    //build and write FM-index for T.  This will be a BWT on the reverse of the sequence, required for reverse-traversal of the BWT
-    buildAndWriteFMIndex(meta, seq_offset, ambig_offset, seq_cnt, ambig_cnt, (uint32_t)block->list[0].C, fm_data,
-                         SAsamp, cnts_sb, cnts_b, block_length, &Tcompressed, fptmp);
+    slot->fm_data.T[block_length] = 0; // last character 0 is effectively '$' for suffix array
+    block_length++;
 
+    slot->seq_offset   = seq_offset;
+    slot->ambig_offset = ambig_offset;
+    slot->seq_cnt      = numseqs-seq_offset;
+    slot->ambig_cnt    = meta->ambig_list->count - ambig_offset;
+    slot->overlap      = overlap;
+    slot->block_length = block_length;
+    slotSubmit(slot, threaded);
 
-    if ( ! meta->fwd_only ) {
-      //build and write FM-index for un-reversed T  (used to find reverse hits using forward traversal of the BWT
-      buildAndWriteFMIndex(meta, seq_offset, ambig_offset, seq_cnt, ambig_cnt, 0, fm_data,
-                         NULL, cnts_sb, cnts_b, block_length, &Tcompressed, fptmp);
-    }
     numblocks++;
   }
 
+  // wait for the builders to finish
+#ifdef HMMER_THREADS
+  for (i=0; threaded && i<nslots; i++) {
+    pthread_mutex_lock(&(slots[i].mutex));
+    slots[i].done = TRUE;
+    pthread_cond_broadcast(&(slots[i].cond));
+    pthread_mutex_unlock(&(slots[i].mutex));
+    pthread_join(slots[i].thread, NULL);
+  }
+#endif
+
 
   esl_sqfile_Close(sqfp);
   esl_alphabet_Destroy(abc);
@@ -723,7 +1031,9 @@ main(int argc, char **argv)
 
 
     //write out meta data
-  if( fwrite(&(meta->fwd_only),     sizeof(meta->fwd_only),     1, fp) != 1 ||
+  if( fwrite(FM_MAGIC,              sizeof(char),               FM_MAGIC_LEN, fp) != FM_MAGIC_LEN ||
+      fwrite(&(meta->version),      sizeof(meta->version),      1, fp) != 1 ||
+      fwrite(&(meta->fwd_only),     sizeof(meta->fwd_only),     1, fp) != 1 ||
       fwrite(&(meta->alph_type),    sizeof(meta->alph_type),    1, fp) != 1 ||
       fwrite(&(meta->alph_size),    sizeof(meta->alph_size),    1, fp) != 1 ||
       fwrite(&(meta->charBits),     sizeof(meta->charBits),     1, fp) != 1 ||
@@ -763,9 +1073,15 @@ main(int argc, char **argv)
   }
 
 
-  /* now append the FM-index data in fptmp to the desired output file, fp */
-  rewind(fptmp);
+  /* now append the FM-index data in the slots' temporary files to the desired output file, fp,
+   * taking block i from slot i % nslots; slot 0's buffers are reused for the copy */
+  fm_data = &(slots[0].fm_data);
+  SAsamp  = slots[0].SAsamp;
+  for (i=0; i<nslots; i++)
+    rewind(slots[i].fptmp);
+
   for (i=0; i<numblocks; i++) {
+    fptmp = slots[i % nslots].fptmp;
 
     for(j=0; j< (meta->fwd_only?1:2); j++ ) { //do this once or twice, once for forward-T index, and possibly once for reversed
     //first, read
@@ -789,6 +1105,7 @@ main(int argc, char **argv)
     num_freq_cnts_b  = 1+ceil((double)block_length/meta->freq_cnt_b);
     num_freq_cnts_sb = 1+ceil((double)block_length/meta->freq_cnt_sb);
     num_SA_samples   = 1+floor((double)block_length/meta->freq_SA);
+    SA_sample_size   = (block_length > UINT32_MAX ? sizeof(uint64_t) : sizeof(uint32_t));
 
 
     //j==0 test cause T and SA to be written only for forward sequence
@@ -796,11 +1113,11 @@ main(int argc, char **argv)
       esl_fatal( "%s: Error reading T in FM index.\n", argv[0]);
     if(fread(fm_data->BWT, sizeof(uint8_t), compressed_bytes, fptmp) != compressed_bytes)
       esl_fatal( "%s: Error reading BWT in FM index.\n", argv[0]);
-    if(j==0 && fread(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fptmp) != (size_t)num_SA_samples)
+    if(j==0 && fread(SAsamp, SA_sample_size, (size_t)num_SA_samples, fptmp) != (size_t)num_SA_samples)
       esl_fatal( "%s: Error reading SA in FM index.\n", argv[0]);
     if(fread(fm_data->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fptmp) != (size_t)num_freq_cnts_b)
       esl_fatal( "%s: Error reading occCnts_b in FM index.\n", argv[0]);
-    if(fread(fm_data->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fptmp) != (size_t)num_freq_cnts_sb)
+    if(fread(fm_data->occCnts_sb, sizeof(uint64_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fptmp) != (size_t)num_freq_cnts_sb)
       esl_fatal( "%s: Error reading occCnts_sb in FM index.\n", argv[0]);
 
 
@@ -822,33 +1139,31 @@ main(int argc, char **argv)
       esl_fatal( "%s: Error writing ambig_cnt in FM index.\n", argv[0]);
 
 
+    // each array starts on an FM_ALIGN boundary, so the file can be searched in place once mapped
+    if (j==0) writeAlignPad(fp);
     if(j==0 && fwrite(fm_data->T, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
       esl_fatal( "%s: Error writing T in FM index.\n", argv[0]);
+    writeAlignPad(fp);
     if(fwrite(fm_data->BWT, sizeof(uint8_t), compressed_bytes, fp) != compressed_bytes)
       esl_fatal( "%s: Error writing BWT in FM index.\n", argv[0]);
-    if(j==0 && fwrite(SAsamp, sizeof(uint32_t), (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
+    if (j==0) writeAlignPad(fp);
+    if(j==0 && fwrite(SAsamp, SA_sample_size, (size_t)num_SA_samples, fp) != (size_t)num_SA_samples)
       esl_fatal( "%s: Error writing SA in FM index.\n", argv[0]);
+    writeAlignPad(fp);
     if(fwrite(fm_data->occCnts_b, sizeof(uint16_t)*(meta->alph_size), (size_t)num_freq_cnts_b, fp) != (size_t)num_freq_cnts_b)
       esl_fatal( "%s: Error writing occCnts_b in FM index.\n", argv[0]);
-    if(fwrite(fm_data->occCnts_sb, sizeof(uint32_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
+    writeAlignPad(fp);
+    if(fwrite(fm_data->occCnts_sb, sizeof(uint64_t)*(meta->alph_size), (size_t)num_freq_cnts_sb, fp) != (size_t)num_freq_cnts_sb)
       esl_fatal( "%s: Error writing occCnts_sb in FM index.\n", argv[0]);
 
     }
   }
 
   fclose(fp);
-  fclose(fptmp);
-
-
-  if (fm_data != NULL)
-    fm_FM_destroy(fm_data, TRUE);
-  free(fm_data);
-  free(SAsamp);
 
-  free(cnts_b);
-  free(cnts_sb);
-
-  free(Tcompressed);
+  for (i=0; i<nslots; i++)
+    slotDestroy(slots+i);
+  free(slots);
 
   fm_metaDestroy(meta);
   esl_getopts_Destroy(go);
@@ -870,12 +1185,11 @@ main(int argc, char **argv)
 ERROR:
   /* Deallocate memory. */
   if (fp)         fclose(fp);
-  if (fm_data)    fm_FM_destroy(fm_data, TRUE);
-  free(fm_data);
-
-  free(SAsamp);
-  free(cnts_b);
-  free(cnts_sb);
+  if (slots) {
+    for (i=0; i<nslots; i++)
+      slotDestroy(slots+i);
+    free(slots);
+  }
 
   fm_metaDestroy(meta);
   esl_getopts_Destroy(go);
@@ -776,6 +776,10 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
     if ( (status = fm_alphabetCreate(fm_meta, NULL)) != eslOK)
       p7_Fail("Failed to create FM alphabet for target sequence database %s\n",      cfg->dbfile);
 
+    /* Map the index, so its blocks are searched in place instead of read for each query */
+    status = fm_FM_mmap(fm_meta);
+    if (status != eslOK && status != eslENORESULT) p7_Fail("Unexpected error %d in mapping target sequence database %s\n", status, cfg->dbfile);
+
     fgetpos( fm_meta->fp, &fm_basepos);
 
     dbformat = eslSQFILE_FMINDEX;
@@ -987,24 +991,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 #if defined (eslENABLE_SSE)
       if (dbformat == eslSQFILE_FMINDEX) {
-        //capture a measure of score density multiplied by something I conjecture to be related to
-        //the expected longest common subsequence (sqrt(M)).  If less than a default target
-        //(7 bits of expected LCS), then the requested score threshold will be shifted down
-        // according to this ratio.
-        // Xref: ~wheelert/notebook/2014/03-04-FM-time-v-len/00NOTES -- Thu Mar  6 14:40:48 EST 2014
-        float best_sc_avg = 0;
-        int j;
-        for (i = 1; i <= om->M; i++) {
-          float max_score = 0;
-          for (j=0; j<hmm->abc->K; j++) {
-            if ( esl_abc_XIsResidue(om->abc,j) &&  gm->rsc[j][(i) * p7P_NR     + p7P_MSC]   > max_score)   max_score   = gm->rsc[j][(i) * p7P_NR     + p7P_MSC];
-          }
-          best_sc_avg += max_score;
-        }
-        best_sc_avg /= sqrt((double) hmm->M);   //that's dividing by M to get score density, then multiplying by sqrt(M) as a proxy for expected LCS
-        best_sc_avg = ESL_MAX(5.0,best_sc_avg); // don't let it get too low, or run time will dramatically suffer
-
-        fm_cfg->sc_thresh_ratio = ESL_MIN(best_sc_avg/7.0, 1.0);
+        fm_setThreshRatio(fm_cfg, gm);
         scoredata = p7_hmm_ScoreDataCreate(om, gm);
       }
       else
@@ -1408,7 +1395,8 @@ serial_loop_FM(WORKER_INFO *info, ESL_SQFILE *dbfp)
     wstatus = fm_FM_read( &fmb, meta, FALSE );
     if (wstatus != eslOK) return wstatus;
 
-    fmb.SA = fmf.SA;
+    fmb.SA   = fmf.SA;
+    fmb.SA64 = fmf.SA64;
     fmb.T  = fmf.T;
 
     wstatus = p7_Pipeline_LongTarget(info->pli, info->om, info->scoredata, info->bg,
@@ -1660,7 +1648,8 @@ thread_loop_FM(WORKER_INFO *info, ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_S
     status = fm_FM_read( fminfo->fmb, meta, FALSE );
     if (status != eslOK) return status;
 
-    fminfo->fmb->SA = fminfo->fmf->SA;
+    fminfo->fmb->SA   = fminfo->fmf->SA;
+    fminfo->fmb->SA64 = fminfo->fmf->SA64;
     fminfo->fmb->T  = fminfo->fmf->T;
     fminfo->active  = TRUE;
 
@@ -5,6 +5,9 @@
  *    1. The P7_DOMAINDEF object: allocation, reuse, destruction
  *    2. Routines inferring domain structure of a target sequence
  *    3. Internal routines 
+ *    4. Unit tests
+ *    5. Test driver
+ *    6. Example drivers
  *    
  * Exegesis:
  * 
@@ -43,11 +46,17 @@
 #include "esl_vectorops.h"
 
 #include "hmmer.h"
+#include "p7_gbands.h"
 
 static int is_multidomain_region  (P7_DOMAINDEF *ddef, int i, int j);
 static int region_trace_ensemble  (P7_DOMAINDEF *ddef, const P7_OPROFILE *om, const ESL_DSQ *dsq, int ireg, int jreg, const P7_OMX *fwd, P7_OMX *wrk, int *ret_nc);
 static int rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OMX *ox1, P7_OMX *ox2,
 				   int i, int j, int null2_is_done, P7_BG *bg, int long_target, P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr);
+static int decode_envelope        (P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, float *ret_envsc);
+#ifdef p7_BANDS_MAXFRAC
+static int banded_decoding        (P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2,
+				   float *ret_envsc, P7_OPROFILE **ret_om, int *ret_koff);
+#endif
 
 
 /*****************************************************************
@@ -81,6 +90,8 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->sp   = NULL;
   ddef->tr   = NULL;
   ddef->dcl  = NULL;
+  ddef->bnd  = NULL;
+  ddef->bom  = NULL;
 
   /* level 2 alloc: posterior prob arrays */
   ESL_ALLOC(ddef->mocc, sizeof(float) * (Lalloc+1));
@@ -102,6 +113,7 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->nclustered = 0;
   ddef->noverlaps  = 0;
   ddef->nenvelopes = 0;
+  ddef->nbanded    = 0;
 
   /* default thresholds */
   ddef->rt1           = 0.25;
@@ -118,6 +130,8 @@ p7_domaindef_Create(ESL_RANDOMNESS *r)
   ddef->sp  = p7_spensemble_Create(1024, 64, 32); /* init allocs = # sampled pairs; max endpoint range; # of domains */
   ddef->tr  = p7_trace_CreateWithPP();
   ddef->gtr = p7_trace_Create();
+  ddef->bnd = p7_gbands_Create();
+  ddef->do_bands = FALSE;	/* the pipeline turns this on with --bands      */
 
   /* keep a copy of ptr to the RNG */
   ddef->r            = r;  
@@ -209,6 +223,7 @@ p7_domaindef_Reuse(P7_DOMAINDEF *ddef)
   ddef->nclustered = 0;
   ddef->noverlaps  = 0;
   ddef->nenvelopes = 0;
+  ddef->nbanded    = 0;
 
   p7_spensemble_Reuse(ddef->sp);
   p7_trace_Reuse(ddef->tr);	/* probable overkill; should already have been called */
@@ -301,6 +316,8 @@ p7_domaindef_Destroy(P7_DOMAINDEF *ddef)
   p7_spensemble_Destroy(ddef->sp);
   p7_trace_Destroy(ddef->tr);
   p7_trace_Destroy(ddef->gtr);
+  if (ddef->bnd) p7_gbands_Destroy(ddef->bnd);
+  if (ddef->bom) p7_oprofile_Destroy(ddef->bom);
   free(ddef);
   return;
 }
@@ -418,8 +435,6 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
     else if (ddef->mocc[j] - (ddef->etot[j] - ddef->etot[j-1])  <  ddef->rt2)
     {
         /* We have a region i..j to evaluate. */
-        p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
-        p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
         ddef->nregions++;
         if (is_multidomain_region(ddef, i, j))
         {
@@ -429,6 +444,10 @@ p7_domaindef_ByPosteriorHeuristics(const ESL_SQ *sq, const ESL_SQ *ntsq, P7_OPRO
              */
             ddef->nclustered++;
 
+            /* Stochastic traceback needs the region's whole Forward matrix */
+            p7_omx_GrowTo(fwd, om->M, j-i+1, j-i+1);
+            p7_omx_GrowTo(bck, om->M, j-i+1, j-i+1);
+
             /* Resolve the region into domains by stochastic trace
              * clustering; assign position-specific null2 model by
              * stochastic trace clustering; there is redundancy
@@ -816,6 +835,8 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
 			P7_BG *bg_tmp, float *scores_arr, float *fwd_emissions_arr)
 {
   P7_DOMAIN     *dom           = NULL;
+  P7_OPROFILE   *dom_om        = om;   /* profile that <ox2>'s posteriors go with: <om>, or <om> sliced to nodes koff+1.. */
+  int            koff          = 0;
   int            Ld            = j-i+1;
   float          domcorrection = 0.0;
   float          envsc, oasc;
@@ -840,24 +861,33 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
     reparameterize_model (bg, om, sq, i, j-i+1, fwd_emissions_arr, bg_tmp->f, scores_arr);
   }
 
-  p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-  p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-  status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+#ifdef p7_BANDS_MAXFRAC
+  if (! long_target && ddef->do_bands)
+    status = banded_decoding(ddef, om, sq->dsq + i-1, Ld, ox1, ox2, &envsc, &dom_om, &koff); /* <ox2> is now post probabilities for <dom_om> */
+  else
+#endif
+  status = decode_envelope(om, sq->dsq + i-1, Ld, ox1, ox2, &envsc);   /* <ox2> is now overwritten with post probabilities     */
   if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
     if (long_target && scores_arr) 
       reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
     status = eslFAIL;
     goto ERROR;
   }
+  else if (status != eslOK) goto ERROR;
 
   /* Find an optimal accuracy alignment */
-  p7_OptimalAccuracy(om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
-  p7_OATrace        (om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
+  p7_OptimalAccuracy(dom_om, ox2, ox1, &oasc);      /* <ox1> is now overwritten with OA scores              */
+  p7_OATrace        (dom_om, ox2, ox1, ddef->tr);   /* <tr>'s seq coords are offset by i-1, rel to orig dsq */
 
-  /* hack the trace's sq coords to be correct w.r.t. original dsq */
+  /* hack the trace's sq coords to be correct w.r.t. original dsq;
+   * and its model coords w.r.t. <om>, if it was aligned to a slice */
   for (z = 0; z < ddef->tr->N; z++)
     if (ddef->tr->i[z] > 0) ddef->tr->i[z] += i-1;
+  if (koff) {
+    for (z = 0; z < ddef->tr->N; z++)
+      if (ddef->tr->k[z] > 0) ddef->tr->k[z] += koff;
+    ddef->tr->M = om->M;
+  }
 
   /* get ptr to next empty domain structure in domaindef's results */
   if (ddef->ndom == ddef->nalloc) {
@@ -895,10 +925,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
         reparameterize_model (bg, om, sq, i, Ld, fwd_emissions_arr, bg_tmp->f, scores_arr);
       }
 
-      p7_Forward (sq->dsq + i-1, Ld, om,      ox1, &envsc);
-      p7_Backward(sq->dsq + i-1, Ld, om, ox1, ox2, NULL);
-
-      status = p7_Decoding(om, ox1, ox2, ox2);      /* <ox2> is now overwritten with post probabilities     */
+      status = decode_envelope(om, sq->dsq + i-1, Ld, ox1, ox2, &envsc); /* <ox2> is now overwritten with post probabilities     */
       if (status == eslERANGE) { /* rare: numeric overflow; domain is assumed to be repetitive garbage [J3/119-121] */
           reparameterize_model(bg, om, NULL, 0, 0, fwd_emissions_arr, bg_tmp->f, scores_arr); /* revert to original bg model */
           status = eslFAIL;
@@ -946,7 +973,7 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
      * do it now, by the expectation (posterior decoding) method.
      */
       if (!null2_is_done) {
-        p7_Null2_ByExpectation(om, ox2, null2);
+        p7_Null2_ByExpectation(dom_om, ox2, null2);
         for (pos = i; pos <= j; pos++)
           ddef->n2sc[pos]  = logf(null2[sq->dsq[pos]]);
       }
@@ -980,10 +1007,265 @@ rescore_isolated_domain(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_SQ *sq, c
   p7_trace_Reuse(ddef->tr);
   return status;
 }
+
+
+/* decode_envelope()
+ *
+ * Forward, Backward and posterior decoding of envelope <dsq> (a
+ * pointer to its first residue, less one) of length <Ld>, with full
+ * matrices: <ox1> and <ox2> are grown to <om->M> by <Ld>. Returns the
+ * envelope score in <*ret_envsc>, and leaves the posterior
+ * probabilities in <ox2> and the Forward matrix in <ox1>.
+ *
+ * Returns <eslOK> on success, or <eslERANGE> on numeric overflow,
+ * as p7_Decoding() does. Throws <eslEMEM> on allocation failure.
+ */
+static int
+decode_envelope(P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2, float *ret_envsc)
+{
+  int status;
+
+  if ((status = p7_omx_GrowTo(ox1, om->M, Ld, Ld)) != eslOK) return status;
+  if ((status = p7_omx_GrowTo(ox2, om->M, Ld, Ld)) != eslOK) return status;
+
+  p7_Forward (dsq, Ld, om,      ox1, ret_envsc);
+  p7_Backward(dsq, Ld, om, ox1, ox2, NULL);
+  return p7_Decoding(om, ox1, ox2, ox2);
+}
+
+
+#ifdef p7_BANDS_MAXFRAC
+/* banded_decoding()
+ *
+ * The Forward/Backward and posterior decoding step of
+ * rescore_isolated_domain(), for envelope <dsq> of length <Ld>.
+ * Forward and Backward run in full, as in decode_envelope(), and give
+ * the envelope score and the posterior bands (in <ddef->bnd>). If the
+ * union of the bands spans no more than p7_BANDS_MAXFRAC of the model,
+ * slice <om> to that window of nodes (in <ddef->bom>) and decode only
+ * those columns, so that optimal accuracy and null2 run on the
+ * aligned region, not all of M. The posteriors are those of the full
+ * model; the little mass outside the window (less than 0.02 per cell,
+ * by the band criterion) is left out. Otherwise decode in full, as
+ * usual.
+ *
+ * Either way, <ox2> ends up holding the posterior probabilities for
+ * profile <*ret_om>, whose node 1 is node <*ret_koff>+1 of <om>.
+ *
+ * Returns <eslOK> on success, or <eslERANGE> on numeric overflow,
+ * as p7_Decoding() does. Throws <eslEMEM> on allocation failure.
+ */
+static int
+banded_decoding(P7_DOMAINDEF *ddef, P7_OPROFILE *om, const ESL_DSQ *dsq, int Ld, P7_OMX *ox1, P7_OMX *ox2,
+		float *ret_envsc, P7_OPROFILE **ret_om, int *ret_koff)
+{
+  P7_GBANDS *bnd = ddef->bnd;
+  int        ka  = om->M+1;
+  int        kb  = 0;
+  int        n;
+  int        status;
+
+  *ret_om   = om;
+  *ret_koff = 0;
+
+  if ((status = p7_omx_GrowTo(ox1, om->M, Ld, Ld)) != eslOK) return status;
+  if ((status = p7_omx_GrowTo(ox2, om->M, Ld, Ld)) != eslOK) return status;
+  p7_Forward (dsq, Ld, om,      ox1, ret_envsc);
+  p7_Backward(dsq, Ld, om, ox1, ox2, NULL);
+
+  p7_gbands_Reuse(bnd);
+  if ((status = p7_DecodingBands(om, ox1, ox2, bnd)) != eslOK) return status;
+  for (n = 0; n < bnd->nrow; n++)
+    {
+      ka = ESL_MIN(ka, bnd->kmem[n*p7_GBANDS_NK]);
+      kb = ESL_MAX(kb, bnd->kmem[n*p7_GBANDS_NK+1]);
+    }
+  if (kb == 0 || kb-ka+1 > om->M * p7_BANDS_MAXFRAC) 
+    return p7_Decoding(om, ox1, ox2, ox2);
+
+  /* sized for all of <om>, so it's reallocated only for a bigger model */
+  if (ddef->bom == NULL || ddef->bom->allocM < om->M || ddef->bom->abc != om->abc)
+    {
+      p7_oprofile_Destroy(ddef->bom);
+      if ((ddef->bom = p7_oprofile_Create(om->M, om->abc)) == NULL) return eslEMEM;
+    }
+  if ((status = p7_oprofile_Slice(om, ka, kb, ddef->bom))         != eslOK) return status;
+  if ((status = p7_DecodingBanded(om, ox1, ox2, ka, kb, ox2))     != eslOK) return status;
+
+  ddef->nbanded++;
+  *ret_om   = ddef->bom;
+  *ret_koff = ka-1;
+  return eslOK;
+}
+#endif /*p7_BANDS_MAXFRAC*/
   
+
+
+/*****************************************************************
+ * 4. Unit tests
+ *****************************************************************/
+#ifdef p7DOMAINDEF_TESTDRIVE
+#include <stdlib.h>
+
+#include "esl_randomseq.h"
+
+#ifdef p7_BANDS_MAXFRAC
+/* utest_banded()
+ * Define domains with envelopes decoded inside their posterior bands
+ * (<do_bands>) and with full matrices, and compare. The envelopes
+ * and their scores (from the same full Forward) must be identical.
+ * Alignments, OA scores and null2 corrections may differ a little,
+ * because the banded path leaves out posterior mass outside the
+ * bands. Each target is a random
+ * sequence with a consensus fragment a quarter of the model long,
+ * which aligns inside narrow bands, and a full-length consensus,
+ * which doesn't.
+ */
+static void
+utest_banded(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, P7_BG *bg, int M, int L, int N, float tol)
+{
+  char            msg[]   = "domaindef banded unit test failed";
+  P7_HMM         *hmm     = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  ESL_SQ         *cq      = esl_sq_CreateDigital(abc);
+  ESL_SQ         *sq      = esl_sq_CreateDigital(abc);
+  ESL_RANDOMNESS *r1      = esl_randomness_CreateFast(42);
+  ESL_RANDOMNESS *r2      = esl_randomness_CreateFast(42);
+  P7_DOMAINDEF   *ddef1   = p7_domaindef_Create(r1); /* full matrices */
+  P7_DOMAINDEF   *ddef2   = p7_domaindef_Create(r2); /* banded        */
+  P7_OMX         *oxf     = p7_omx_Create(M, 0, L);
+  P7_OMX         *oxb     = p7_omx_Create(M, 0, L);
+  P7_OMX         *fwd     = p7_omx_Create(M, 100, 100);
+  P7_OMX         *bck     = p7_omx_Create(M, 100, 100);
+  P7_DOMAIN      *d1, *d2;
+  int             frag    = M / 4;
+  int             nbanded = 0;
+  int             ka, d;
+
+  if (L < L/2 + M)                                         esl_fatal(msg);
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) esl_fatal(msg);
+  if (p7_emit_SimpleConsensus(hmm, cq)                     != eslOK) esl_fatal(msg);
+  if (esl_sq_GrowTo(sq, L)                                 != eslOK) esl_fatal(msg);
+  esl_sq_SetName(sq, "target");
+  ddef2->do_bands = TRUE;
+
+  while (N--)
+    {
+      if (esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq) != eslOK) esl_fatal(msg);
+      ka = 1 + esl_rnd_Roll(r, M - frag + 1);
+      memcpy(sq->dsq + L/8, cq->dsq + ka, sizeof(ESL_DSQ) * frag);
+      memcpy(sq->dsq + L/2, cq->dsq + 1,  sizeof(ESL_DSQ) * M);
+      sq->n = L;
+
+      if (p7_ForwardParser (sq->dsq, L, om, oxf,      NULL) != eslOK) esl_fatal(msg);
+      if (p7_BackwardParser(sq->dsq, L, om, oxf, oxb, NULL) != eslOK) esl_fatal(msg);
+
+      p7_domaindef_Reuse(ddef1);
+      p7_domaindef_Reuse(ddef2);
+      if (p7_domaindef_ByPosteriorHeuristics(sq, NULL, om, oxf, oxb, fwd, bck, ddef1, bg, FALSE, NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+      if (p7_domaindef_ByPosteriorHeuristics(sq, NULL, om, oxf, oxb, fwd, bck, ddef2, bg, FALSE, NULL, NULL, NULL) != eslOK) esl_fatal(msg);
+
+      if (ddef1->nbanded != 0)          esl_fatal(msg);
+      if (ddef1->ndom    != ddef2->ndom) esl_fatal(msg);
+      for (d = 0; d < ddef1->ndom; d++)
+	{
+	  d1 = &(ddef1->dcl[d]);
+	  d2 = &(ddef2->dcl[d]);
+	  if (d1->ienv != d2->ienv || d1->jenv != d2->jenv)                        esl_fatal(msg);
+	  if (d1->envsc != d2->envsc)                                                esl_fatal(msg);
+	  if (esl_FCompare(d1->domcorrection, d2->domcorrection, tol, tol) != eslOK) esl_fatal(msg);
+	  if (esl_FCompare(d1->oasc,          d2->oasc,          tol, tol) != eslOK) esl_fatal(msg);
+	  if (abs(d1->iali - d2->iali) > 2 || abs(d1->jali - d2->jali) > 2)          esl_fatal(msg);
+	  if (d2->ad->hmmfrom < 1 || d2->ad->hmmto > M)                              esl_fatal(msg);
+	}
+      nbanded += ddef2->nbanded;
+    }
+  if (nbanded == 0) esl_fatal(msg); /* the fragments must have taken the banded path */
+
+  p7_omx_Destroy(oxf);
+  p7_omx_Destroy(oxb);
+  p7_omx_Destroy(fwd);
+  p7_omx_Destroy(bck);
+  p7_domaindef_Destroy(ddef1);
+  p7_domaindef_Destroy(ddef2);
+  esl_randomness_Destroy(r1);
+  esl_randomness_Destroy(r2);
+  esl_sq_Destroy(cq);
+  esl_sq_Destroy(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7_BANDS_MAXFRAC*/
+#endif /*p7DOMAINDEF_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+/*****************************************************************
+ * 5. Test driver
+ *****************************************************************/
+#ifdef p7DOMAINDEF_TESTDRIVE
+/* gcc -o p7_domaindef_utest -msse2 -g -Wall -I../easel -L../easel -I. -L. -Dp7DOMAINDEF_TESTDRIVE p7_domaindef.c -lhmmer -leasel -lm
+ * ./p7_domaindef_utest
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-t",        eslARG_REAL,   "0.1", NULL, NULL,  NULL,  NULL, NULL, "score tolerance, banded vs. full decoding",        0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                       0 },
+  { "-L",        eslARG_INT,    "400", NULL, NULL,  NULL,  NULL, NULL, "length of sampled target sequences",               0 },
+  { "-M",        eslARG_INT,    "100", NULL, NULL,  NULL,  NULL, NULL, "length of sampled test model",                     0 },
+  { "-N",        eslARG_INT,     "10", NULL, NULL,  NULL,  NULL, NULL, "number of sampled target sequences",               0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for domain definition";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = esl_alphabet_Create(eslAMINO);
+  P7_BG          *bg   = p7_bg_Create(abc);
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             L    = esl_opt_GetInteger(go, "-L");
+  int             N    = esl_opt_GetInteger(go, "-N");
+  float           tol  = esl_opt_GetReal   (go, "-t");
+
+  p7_FLogsumInit();
+  if (esl_opt_GetBoolean(go, "-v")) printf("p7_domaindef unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(r));
+
+#ifdef p7_BANDS_MAXFRAC
+  utest_banded(r, abc, bg, M, L, N, tol);
+#endif
+
+  p7_bg_Destroy(bg);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7DOMAINDEF_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
     
 /*****************************************************************
- * Example driver.
+ * 6. Example drivers.
  *****************************************************************/
 
 #ifdef p7DOMAINDEF_EXAMPLE
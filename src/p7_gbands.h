@@ -1,7 +1,7 @@
 #ifndef P7_GBANDS_INCLUDED
 #define P7_GBANDS_INCLUDED
 
-typedef struct {
+typedef struct p7_gbands_s {
   int     nseg;
   int     nrow;
   int     L;
@@ -26,6 +26,11 @@
  *            a cached profile database in memory. Return a ptr to the 
  *            cached profile database in <*ret_cache>. 
  *            
+ *            A pressed database is mapped (<p7_hmmfile_Mmap()>) and
+ *            its profiles are views into the mapping, so caching even
+ *            a large one takes little time or memory of its own. The
+ *            file stays open until <p7_hmmcache_Close()>.
+ *            
  *            Caller may optionally provide an <errbuf> ptr to
  *            at least <eslERRBUFSIZE> bytes, to capture an 
  *            informative error message on failure. 
@@ -58,6 +63,7 @@ p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
   ESL_ALLOC(cache, sizeof(P7_HMMCACHE));
   cache->name      = NULL;
   cache->abc       = NULL;
+  cache->hfp       = NULL;
   cache->list      = NULL;
   cache->lalloc    = 4096;	/* allocation chunk size for <list> of ptrs  */
   cache->n         = 0;
@@ -66,6 +72,8 @@ p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
   ESL_ALLOC(cache->list, sizeof(P7_OPROFILE *) * cache->lalloc);
 
   if ( (status = p7_hmmfile_Open(hmmfile, NULL, &hfp, errbuf)) != eslOK) goto ERROR;  // eslENOTFOUND | eslEFORMAT 
+  status = p7_hmmfile_Mmap(hfp);
+  if (status != eslOK && status != eslENORESULT) { if (errbuf) esl_fail(errbuf, "failed to map %s", hmmfile); goto ERROR; }
 
   while ((status = p7_oprofile_ReadMSV(hfp, &(cache->abc), &om)) == eslOK) /* eslEFORMAT | eslEINCOMPAT */
     {
@@ -83,7 +91,7 @@ p7_hmmcache_Open(char *hmmfile, P7_HMMCACHE **ret_cache, char *errbuf)
   if (status != eslEOF)  { strncpy(errbuf, hfp->errbuf, eslERRBUFSIZE); goto ERROR; }
 
   //printf("\nfinal:: %d  memory %" PRId64 "\n", inx, total_mem);
-  p7_hmmfile_Close(hfp);
+  cache->hfp = hfp;		/* profiles may point into its mapped files; close it last */
   *ret_cache = cache;
   return eslOK;
 
@@ -163,6 +171,7 @@ p7_hmmcache_Close(P7_HMMCACHE *cache)
 	p7_oprofile_Destroy(cache->list[i]);
       free(cache->list);
     }
+  if (cache->hfp)  p7_hmmfile_Close(cache->hfp);
   free(cache);
 }
 
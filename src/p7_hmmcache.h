@@ -9,6 +9,7 @@
 typedef struct {
   char               *name;        /* name of the hmm database              */
   ESL_ALPHABET       *abc;         /* alphabet for database                 */
+  P7_HMMFILE         *hfp;         /* kept open: profiles view its mapping  */
 
   P7_OPROFILE       **list;        /* list of profiles [0 .. n-1]           */
   uint32_t            lalloc;	   /* allocated length of <list>            */
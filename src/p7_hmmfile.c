@@ -20,6 +20,10 @@
 #ifdef HMMER_THREADS
 #include <pthread.h>
 #endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "easel.h"
 #include "esl_alphabet.h"
@@ -179,6 +183,10 @@ p7_hmmfile_OpenBuffer(const char *buffer, int size, P7_HMMFILE **ret_hfp)
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->fmap         = NULL;
+  hfp->pmap         = NULL;
+  hfp->nfmap        = 0;
+  hfp->npmap        = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -249,6 +257,10 @@ open_engine(const char *filename, char *env, P7_HMMFILE **ret_hfp, int do_ascii_
   hfp->efp          = NULL;
   hfp->ffp          = NULL;
   hfp->pfp          = NULL;
+  hfp->fmap         = NULL;
+  hfp->pmap         = NULL;
+  hfp->nfmap        = 0;
+  hfp->npmap        = 0;
   hfp->ssi          = NULL;
   hfp->errbuf[0]    = '\0';
   hfp->rr_errbuf[0] = '\0';
@@ -436,6 +448,10 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   if (hfp->do_gzip && hfp->f != NULL)    pclose(hfp->f);
 #endif
   if (!hfp->do_gzip && !hfp->do_stdin && hfp->f != NULL) fclose(hfp->f);
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if (hfp->fmap  != NULL) munmap(hfp->fmap, hfp->nfmap);
+  if (hfp->pmap  != NULL) munmap(hfp->pmap, hfp->npmap);
+#endif
   if (hfp->ffp   != NULL) fclose(hfp->ffp);
   if (hfp->pfp   != NULL) fclose(hfp->pfp);
   if (hfp->fname != NULL) free(hfp->fname);
@@ -447,6 +463,73 @@ p7_hmmfile_Close(P7_HMMFILE *hfp)
   free(hfp);
 }
 
+/* Function:  p7_hmmfile_Mmap()
+ * Synopsis:  Map a pressed database's optimized profiles into memory.
+ *
+ * Purpose:   If <hfp> is a pressed database, map its <.h3f> and
+ *            <.h3p> files into memory. From then on,
+ *            <p7_oprofile_ReadMSV()> and <p7_oprofile_ReadRest()>
+ *            don't read or allocate the profiles' score vectors: they
+ *            return views that point straight into the mapping. That
+ *            makes opening a large database nearly free, and
+ *            processes that map the same database share its pages.
+ *
+ *            The files stay mapped until <p7_hmmfile_Close()>, so the
+ *            views can only be used until then. (They can be
+ *            destroyed afterwards; <p7_oprofile_Destroy()> doesn't
+ *            look at what a view points to.) The mapping is private,
+ *            copy-on-write: a caller that changes a view's scores in
+ *            place gets its own copy of the pages it changes, and
+ *            the files are untouched.
+ *
+ *            Only the SSE implementation makes views. Elsewhere the
+ *            mapping is harmless but unused.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ *            <eslENORESULT> if <hfp> isn't a pressed database or
+ *            this system can't map files. Nothing has changed, and
+ *            profiles are read as usual.
+ *
+ * Throws:    <eslESYS> if a system call fails. Nothing has changed.
+ */
+int
+p7_hmmfile_Mmap(P7_HMMFILE *hfp)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct stat  st;
+  void        *fmap = MAP_FAILED;
+  void        *pmap = MAP_FAILED;
+  off_t        nf, np;
+  int          status;
+
+  if (! hfp->is_pressed || hfp->ffp == NULL || hfp->pfp == NULL) return eslENORESULT;
+  if (hfp->fmap != NULL) return eslOK;
+
+  if (fstat(fileno(hfp->ffp), &st) != 0) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on .h3f file");
+  nf = st.st_size;
+  if (fstat(fileno(hfp->pfp), &st) != 0) ESL_XEXCEPTION_SYS(eslESYS, "fstat() failed on .h3p file");
+  np = st.st_size;
+  if (nf == 0 || np == 0) return eslENORESULT; /* can't map an empty file; nothing to view anyway */
+
+  if ((fmap = mmap(NULL, nf, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(hfp->ffp), 0)) == MAP_FAILED) ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on .h3f file");
+  if ((pmap = mmap(NULL, np, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(hfp->pfp), 0)) == MAP_FAILED) ESL_XEXCEPTION_SYS(eslESYS, "mmap() failed on .h3p file");
+
+  hfp->fmap  = (char *) fmap;
+  hfp->nfmap = nf;
+  hfp->pmap  = (char *) pmap;
+  hfp->npmap = np;
+  return eslOK;
+
+ ERROR:
+  if (fmap != MAP_FAILED) munmap(fmap, nf);
+  return status;
+#else
+  return eslENORESULT;
+#endif
+}
+
+
 #ifdef HMMER_THREADS
 /* Function:  p7_hmmfile_CreateLock()
  *
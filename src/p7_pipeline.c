@@ -3,8 +3,10 @@
  * Contents:
  *   1. P7_PIPELINE: allocation, initialization, destruction
  *   2. Pipeline API
- *   3. Example 1: search mode (in a sequence db)
- *   4. Example 2: scan mode (in an HMM db)
+ *   3. Unit tests
+ *   4. Test driver
+ *   5. Example 1: search mode (in a sequence db)
+ *   6. Example 2: scan mode (in an HMM db)
  */
 #include <p7_config.h>
 
@@ -23,16 +25,21 @@
 #include "esl_sqio.h" //!!!!DEBUG
 
 /* Struct used to pass a collection of useful temporary objects around
- * within the LongTarget functions
+ * within the LongTarget functions. They belong to the pipeline's
+ * long target workspace (see longtarget_workspace_GrowTo()).
  *  */
 typedef struct {
-  ESL_SQ           *tmpseq; // - a new or reused digital sequence object used for p7_alidisplay_Create() call
+  ESL_SQ           *tmpseq; // - a reused digital sequence object used for p7_alidisplay_Create() call
   P7_BG            *bg;
-  P7_OPROFILE      *om;
   float            *scores;
   float            *fwd_emissions_arr;
 } P7_PIPELINE_LONGTARGET_OBJS;
 
+static int pipeline_domains (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float usc, int64_t Ldom,
+			     float *ret_fwdsc, float *ret_nullsc, int *ret_passed);
+static int pipeline_hit     (P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, float fwdsc, float nullsc, P7_TOPHITS *hitlist);
+static int pipeline_windowed(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, int W, P7_TOPHITS *hitlist);
+
 
 /*****************************************************************
  * 1. The P7_PIPELINE object: allocation, initialization, destruction.
@@ -84,6 +91,7 @@ typedef struct {
  *            | --F3         |  Stage 2 (Fwd) thresh: promote hits P <= F3 |    1e-5   |
  *            | --nobias     |  turn OFF composition bias filter HMM       |   FALSE   |
  *            | --nonull2    |  turn OFF biased comp score correction      |   FALSE   |
+ *            | --bands      |  decode domains inside posterior bands      |   FALSE   |
  *            | --seed       |  RNG seed (0=use arbitrary seed)            |      42   |
  *            | --acc        |  prefer accessions over names in output     |   FALSE   |
  *
@@ -104,6 +112,18 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
 
   ESL_ALLOC(pli, sizeof(P7_PIPELINE));
 
+  pli->fwd = pli->bck = pli->oxf = pli->oxb = NULL;
+  pli->r                = NULL;
+  pli->ddef             = NULL;
+  pli->lt_tmpseq        = NULL;
+  pli->lt_bg            = NULL;
+  pli->lt_scores        = NULL;
+  pli->lt_fwd_emissions = NULL;
+  pli->lt_allocM        = 0;
+  pli->blk_usc          = NULL;
+  pli->blk_nusc         = 0;
+  fm_ssvWorkspaceInit(&(pli->fm_ws));
+
   pli->do_alignment_score_calc = 0;
   pli->long_targets = long_targets;
 
@@ -229,6 +249,7 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
     }
   if (go && esl_opt_GetBoolean(go, "--nonull2")) pli->do_null2      = FALSE;
   if (go && esl_opt_GetBoolean(go, "--nobias"))  pli->do_biasfilter = FALSE;
+  if (go && !long_targets && esl_opt_GetBoolean(go, "--bands")) pli->ddef->do_bands = TRUE;
   
 
   /* Accounting as we collect results */
@@ -248,6 +269,7 @@ p7_pipeline_Create(const ESL_GETOPTS *go, int M_hint, int L_hint, int long_targe
   pli->show_accessions = (go && esl_opt_GetBoolean(go, "--acc")   ? TRUE  : FALSE);
   pli->show_alignments = (go && esl_opt_GetBoolean(go, "--noali") ? FALSE : TRUE);
   pli->hfp             = NULL;
+  pli->rest_read       = FALSE;
   pli->errbuf[0]       = '\0';
 
   return pli;
@@ -297,6 +319,12 @@ p7_pipeline_Destroy(P7_PIPELINE *pli)
   p7_omx_Destroy(pli->bck);
   esl_randomness_Destroy(pli->r);
   p7_domaindef_Destroy(pli->ddef);
+  if (pli->lt_tmpseq)        esl_sq_Destroy(pli->lt_tmpseq);
+  if (pli->lt_bg)            p7_bg_Destroy(pli->lt_bg);
+  if (pli->lt_scores)        free(pli->lt_scores);
+  if (pli->lt_fwd_emissions) free(pli->lt_fwd_emissions);
+  if (pli->blk_usc)          free(pli->blk_usc);
+  fm_ssvWorkspaceDestroy(&(pli->fm_ws));
   free(pli);
 }
 /*---------------- end, P7_PIPELINE object ----------------------*/
@@ -502,7 +530,8 @@ p7_pli_NewModel(P7_PIPELINE *pli, const P7_OPROFILE *om, P7_BG *bg)
   if (pli->mode == p7_SEARCH_SEQS)
     status = p7_pli_NewModelThresholds(pli, om);
 
-  pli->W = om->max_length;
+  pli->W         = om->max_length;
+  pli->rest_read = FALSE;
 
   return status;
 }
@@ -678,40 +707,166 @@ p7_pipeline_Merge(P7_PIPELINE *p1, P7_PIPELINE *p2)
  *            anyway. We may emit a warning to the user, but cleanly
  *            skip the problematic sequence and continue.
  *
- * Throws:    <eslEMEM> on allocation failure.
+ *            A target longer than <p7_PIPELINE_MAXL> residues (a
+ *            titin, say) is compared in overlapping windows of that
+ *            length, so memory stays bounded however long the target
+ *            is; see <pipeline_windowed()>. It still yields at most
+ *            one hit, with domains in full-length coordinates and
+ *            scored against the full-length null model.
  *
- *            <eslETYPE> if <sq> is more than 100K long, which can
- *            happen when someone uses hmmsearch/hmmscan instead of
- *            nhmmer/nhmmscan on a genome DNA seq db.
+ * Throws:    <eslEMEM> on allocation failure.
  *
  * Xref:      J4/25.
- *
- * Note:      Error handling needs improvement. The <eslETYPE> exception
- *            was added as a late bugfix. It really should be an <eslEINVAL>
- *            normal error (because it's a user error). But then we need
- *            all our p7_Pipeline() calls to check their return status
- *            and handle normal errors appropriately, which we haven't 
- *            been careful enough about. [SRE H9/4]
  */
 int
 p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, P7_TOPHITS *hitlist)
 {
-  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
-  float            usc, vfsc, fwdsc;   /* filter scores                           */
+  float usc;			/* MSV filter score */
+
+  if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+  if (sq->n > p7_PIPELINE_MAXL) return pipeline_windowed(pli, om, bg, sq, ntsq, p7_PIPELINE_MAXL, hitlist);
+
+  p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
+
+  /* First level filter: the MSV filter, multihit with <om> */
+  p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
+
+  return p7_Pipeline_FromMSV(pli, om, bg, sq, ntsq, usc, hitlist);
+}
+
+
+/* Function:  p7_Pipeline_FromMSV()
+ * Synopsis:  The rest of the pipeline, given an MSV filter score.
+ *
+ * Purpose:   Same as <p7_Pipeline()>, except that the MSV filter
+ *            score <usc> for <sq> has already been calculated, by
+ *            <p7_MSVFilter_Block()> for a whole block of target
+ *            sequences at once (see <p7_Pipeline_Block()>). The pipeline picks up at the MSV
+ *            P-value threshold, and counts and reports exactly as
+ *            <p7_Pipeline()> does. (A target too long to take in one
+ *            piece is windowed just as <p7_Pipeline()> would, and
+ *            <usc> is ignored.)
+ *
+ * Returns:   (same as <p7_Pipeline()>)
+ *
+ * Throws:    (same as <p7_Pipeline()>)
+ */
+int
+p7_Pipeline_FromMSV(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float usc, P7_TOPHITS *hitlist)
+{
+  float  fwdsc;			/* Forward parser score      */
+  float  nullsc;		/* null model score          */
+  int    passed;		/* TRUE if domains were found */
+  int    status;
+
+  if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
+  if (sq->n > p7_PIPELINE_MAXL) return pipeline_windowed(pli, om, bg, sq, ntsq, p7_PIPELINE_MAXL, hitlist);
+
+  if ((status = pipeline_domains(pli, om, bg, sq, ntsq, usc, sq->n, &fwdsc, &nullsc, &passed)) != eslOK) return status;
+  if (! passed) return eslOK;
+
+  return pipeline_hit(pli, om, bg, sq, fwdsc, nullsc, hitlist);
+}
+
+
+/* Function:  p7_Pipeline_Block()
+ * Synopsis:  The pipeline for a range of a block of target sequences.
+ *
+ * Purpose:   Run the pipeline for <om> against targets <start..end-1>
+ *            of <block>, as <p7_Pipeline()> would against each in
+ *            turn, adding significant hits to <hitlist>. The MSV
+ *            filter scores for the whole range come from one call to
+ *            <p7_MSVFilter_Block()>, which is faster than one
+ *            <p7_MSVFilter()> per target for short queries, and falls
+ *            back to it for the rest; <p7_Pipeline_FromMSV()> then
+ *            takes each target from there.
+ *
+ *            This does everything a search loop does for each target:
+ *            <p7_pli_NewSeq()>, configuring <bg> and <om> for its
+ *            length, and afterwards <esl_sq_Reuse()> on the target and
+ *            <p7_pipeline_Reuse()>.
+ *
+ * Returns:   <eslOK> on success. A target that overflows
+ *            (<eslERANGE>) is skipped, as <p7_Pipeline()> allows; any
+ *            other normal error from the pipeline stops the range at
+ *            that target, and is returned.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_Pipeline_Block(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, ESL_SQ_BLOCK *block, int start, int end, P7_TOPHITS *hitlist)
+{
+  ESL_SQ_BLOCK view;		/* the targets <start..end-1> of <block> */
+  ESL_SQ      *sq;
+  int          i;
+  int          status;
+
+  if (end <= start) return eslOK;
+
+  view       = *block;
+  view.list  = block->list + start;
+  view.count = end - start;
+  if (view.count > pli->blk_nusc) {
+    ESL_REALLOC(pli->blk_usc, sizeof(float) * view.count);
+    pli->blk_nusc = view.count;
+  }
+  if ((status = p7_MSVFilter_Block(&view, om, pli->oxf, pli->blk_usc)) != eslOK) return status;
+
+  for (i = start; i < end; i++)
+    {
+      sq = block->list + i;
+
+      p7_pli_NewSeq(pli, sq);
+      p7_bg_SetLength(bg, sq->n);
+      p7_oprofile_ReconfigLength(om, sq->n);
+
+      status = p7_Pipeline_FromMSV(pli, om, bg, sq, NULL, pli->blk_usc[i - start], hitlist);
+      if (status != eslOK && status != eslERANGE) return status;
+
+      esl_sq_Reuse(sq);
+      p7_pipeline_Reuse(pli);
+    }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* pipeline_domains()
+ * The filters and domain definition: the part of the pipeline that
+ * <p7_Pipeline_FromMSV()> runs on a whole target, and
+ * <pipeline_windowed()> on each window of a long one. Starts from the
+ * MSV filter score <usc> of <sq>, with <om> and <bg> configured for
+ * the length of <sq>.
+ *
+ * <Ldom> is the length of the target the domains are scored for:
+ * <sq->n>, or the full length of the target that <sq> is a window
+ * of. The filters are for <sq> alone, but domain definition runs
+ * with <om> configured for <Ldom>, so that each domain's envelope
+ * score and null2 correction are what they would be in the whole
+ * target; <om> is put back for <sq->n> afterwards.
+ *
+ * If <sq> passes the filters and has at least one domain,
+ * <*ret_passed> is TRUE, the domains are in <pli->ddef>, and
+ * <*ret_fwdsc> and <*ret_nullsc> are the Forward parser and null model
+ * scores of <sq> (in nats). Otherwise <*ret_passed> is FALSE.
+ *
+ * Returns <eslOK>, or a normal error from the pipeline (see
+ * <p7_Pipeline()>).
+ */
+static int
+pipeline_domains(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, float usc, int64_t Ldom,
+		 float *ret_fwdsc, float *ret_nullsc, int *ret_passed)
+{
+  float            vfsc, fwdsc;        /* filter scores                           */
   float            filtersc;           /* HMM null filter score                   */
   float            nullsc;             /* null model score                        */
-  float            seqbias;  
   float            seq_score;          /* the corrected per-seq bit score */
-  float            sum_score;           /* the corrected reconstruction score for the seq */
-  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
   double           P;                /* P-value of a hit */
-  double           lnP;              /* log P-value of a hit */
-  int              Ld;               /* # of residues in envelopes */
-  int              d;
   int              status;
-  
-  if (sq->n == 0) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
-  if (sq->n > 100000) ESL_EXCEPTION(eslETYPE, "Target sequence length > 100K, over comparison pipeline limit.\n(Did you mean to use nhmmer/nhmmscan?)");
+
+  *ret_passed = FALSE;
 
   p7_omx_GrowTo(pli->oxf, om->M, 0, sq->n);    /* expand the one-row omx if needed */
 
@@ -719,7 +874,6 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   p7_bg_NullOne  (bg, sq->dsq, sq->n, &nullsc);
 
   /* First level filter: the MSV filter, multihit with <om> */
-  p7_MSVFilter(sq->dsq, sq->n, om, pli->oxf, &usc);
   seq_score = (usc - nullsc) / eslCONST_LOG2;
   P = esl_gumbel_surv(seq_score,  om->evparam[p7_MMU],  om->evparam[p7_MLAMBDA]);
   if (P > pli->F1) return eslOK;
@@ -739,7 +893,10 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   /* In scan mode, if it passes the MSV filter, read the rest of the profile */
   if (pli->mode == p7_SCAN_MODELS)
     {
-      if (pli->hfp) p7_oprofile_ReadRest(pli->hfp, om);
+      if (pli->hfp && ! pli->rest_read) { /* unless an earlier window of a long target did */
+	p7_oprofile_ReadRest(pli->hfp, om);
+	pli->rest_read = TRUE;
+      }
       p7_oprofile_ReconfigRestLength(om, sq->n);
       if ((status = p7_pli_NewModelThresholds(pli, om)) != eslOK) return status; /* pli->errbuf has err msg set */
     }
@@ -763,25 +920,61 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   pli->n_past_fwd++;
 
   /* ok, it's for real. Now a Backwards parser pass, and hand it to domain definition workflow */
-  p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);
+  p7_omx_GrowTo(pli->oxb, om->M, 0, sq->n);    /* one-row parser: no DP rows, just the specials for each residue */
   p7_BackwardParser(sq->dsq, sq->n, om, pli->oxf, pli->oxb, NULL);
 
+  if (Ldom != sq->n) p7_oprofile_ReconfigRestLength(om, Ldom);
   status = p7_domaindef_ByPosteriorHeuristics(sq, ntsq, om, pli->oxf, pli->oxb, pli->fwd, pli->bck, pli->ddef, bg, FALSE, NULL, NULL, NULL);
+  if (Ldom != sq->n) p7_oprofile_ReconfigRestLength(om, sq->n);
   if (status != eslOK) ESL_FAIL(status, pli->errbuf, "domain definition workflow failure"); /* eslERANGE can happen  */
   if (pli->ddef->nregions   == 0) return eslOK; /* score passed threshold but there's no discrete domains here       */
   if (pli->ddef->nenvelopes == 0) return eslOK; /* rarer: region was found, stochastic clustered, no envelopes found */
   if (pli->ddef->ndom       == 0) return eslOK; /* even rarer: envelope found, no domain identified {iss131}         */
 
+  *ret_fwdsc  = fwdsc;
+  *ret_nullsc = nullsc;
+  *ret_passed = TRUE;
+  return eslOK;
+}
+
+
+/* pipeline_hit()
+ * Score target <sq> from its domains in <pli->ddef> and, if it's
+ * reportable, add it to <hitlist>, taking over the domain list.
+ * <fwdsc> and <nullsc> are the Forward parser and null model scores
+ * of the whole of <sq>, in nats. <fwdsc> may be -eslINFINITY if
+ * there's no Forward score for the whole target (a windowed one);
+ * then the sequence score is the reconstruction from its domains.
+ *
+ * Returns <eslOK>. Throws <eslEMEM> on allocation failure.
+ */
+static int
+pipeline_hit(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, float fwdsc, float nullsc, P7_TOPHITS *hitlist)
+{
+  P7_HIT          *hit     = NULL;     /* ptr to the current hit output data      */
+  float            seqbias;  
+  float            seq_score;          /* the corrected per-seq bit score */
+  float            sum_score;           /* the corrected reconstruction score for the seq */
+  float            pre_score, pre2_score; /* uncorrected bit scores for seq */
+  double           lnP;              /* log P-value of a hit */
+  int              Ld;               /* # of residues in envelopes */
+  int              d;
+  int              status;
 
   /* Calculate the null2-corrected per-seq score */
-  if (pli->do_null2)
+  if (fwdsc == -eslINFINITY)
+    pre_score = seq_score = -eslINFINITY;
+  else
     {
-      seqbias = esl_vec_FSum(pli->ddef->n2sc, sq->n+1);
-      seqbias = p7_FLogsum(0.0, log(bg->omega) + seqbias);
+      if (pli->do_null2)
+	{
+	  seqbias = esl_vec_FSum(pli->ddef->n2sc, sq->n+1);
+	  seqbias = p7_FLogsum(0.0, log(bg->omega) + seqbias);
+	}
+      else seqbias = 0.0;
+      pre_score =  (fwdsc - nullsc) / eslCONST_LOG2; 
+      seq_score =  (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
     }
-  else seqbias = 0.0;
-  pre_score =  (fwdsc - nullsc) / eslCONST_LOG2; 
-  seq_score =  (fwdsc - (nullsc + seqbias)) / eslCONST_LOG2;
 
   
   /* Calculate the "reconstruction score": estimated
@@ -823,7 +1016,7 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
   sum_score  = (sum_score - (nullsc + seqbias)) / eslCONST_LOG2;    /* BITS */
 
   /* A special case: let sum_score override the seq_score when it's better, and it includes at least 1 domain */
-  if (Ld > 0 && sum_score > seq_score)
+  if ((Ld > 0 && sum_score > seq_score) || fwdsc == -eslINFINITY)
     {
       seq_score = sum_score;
       pre_score = pre2_score;
@@ -885,7 +1078,6 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
 
         if (hit->dcl[d].bitscore > hit->dcl[hit->best_domain].bitscore) hit->best_domain = d;
       }
-
       /* If we're using model-specific bit score thresholds (GA | TC |
        * NC) and we're in an hmmscan pipeline (mode = p7_SCAN_MODELS),
        * then we *must* apply those reporting or inclusion thresholds
@@ -937,6 +1129,226 @@ p7_Pipeline(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, cons
 
 
 
+/* qsort() comparison for pipeline_windowed(): domains in order of envelope start */
+static int
+domain_sorter_by_ienv(const void *vd1, const void *vd2)
+{
+  const P7_DOMAIN *d1 = (const P7_DOMAIN *) vd1;
+  const P7_DOMAIN *d2 = (const P7_DOMAIN *) vd2;
+
+  if      (d1->ienv > d2->ienv) return  1;
+  else if (d1->ienv < d2->ienv) return -1;
+  else                          return  0;
+}
+
+
+/* pipeline_windowed()
+ * Compare <om> to a target <sq> too long for the pipeline to take in
+ * one piece: more than <W> residues (<p7_PIPELINE_MAXL>, from
+ * <p7_Pipeline()> and <p7_Pipeline_FromMSV()>), where the filter and
+ * domain definition matrices would grow with L. Our caller has
+ * already done the per-target setup (<p7_pli_NewSeq()>, length
+ * configuration) for the whole of <sq>.
+ *
+ * This follows <p7_Pipeline_LongTarget()>: <sq> is cut into windows
+ * of <W> residues that overlap by the model's maximum expected hit
+ * length (<om->max_length>; at least 2M, at most W/2), so any domain
+ * that's short enough to find at all lies whole in some window. Each
+ * window goes through the filters with <om> and <bg> configured to
+ * the window's length, but its domains are defined and scored with
+ * <om> configured for the full length of <sq>, and are shifted to
+ * full-length coordinates.
+ *
+ * A domain found in two overlapping windows is kept once: the copy
+ * farther from its window's cut edge, which is the one least likely
+ * to have been truncated there. The surviving domains, in order of
+ * position, go to <pipeline_hit()> with the full-length null score of
+ * <sq>, so domain scores and E-values are exactly what they would be
+ * for the whole target. The sequence score is the reconstruction
+ * score summed from those domains, since there is no Forward score
+ * for the whole target. A target counts once per filter stage that
+ * any of its windows pass.
+ *
+ * Returns <eslOK> on success, or a normal error from the pipeline
+ * (see <p7_Pipeline()>). Throws <eslEMEM> on allocation failure.
+ */
+static int
+pipeline_windowed(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, const ESL_SQ *sq, const ESL_SQ *ntsq, int W, P7_TOPHITS *hitlist)
+{
+  ESL_SQ     *wsq      = NULL;	/* current window, a copy of part of <sq>         */
+  P7_DOMAIN  *dcl      = NULL;	/* domains from all windows, full-length coords    */
+  int        *dwin     = NULL;	/* dwin[d]: which window domain d came from        */
+  int        *dedge    = NULL;	/* dedge[d]: its distance from a window cut (or n) */
+  int        *isdup    = NULL;	/* isdup[d]: TRUE if another window's copy is kept */
+  uint64_t    npass[4];		/* filter pass counts before we start              */
+  float       nexpected  = 0.0;
+  int         nregions   = 0;
+  int         nclustered = 0;
+  int         noverlaps  = 0;
+  int         nenvelopes = 0;
+  int64_t     start;		/* window start in <sq>, 1..n                      */
+  int         overlap;
+  int         wn;		/* window length                                   */
+  int         nwin;		/* window index                                    */
+  int         ndom     = 0;
+  int         dalloc   = 0;
+  float       usc, fwdsc, nullsc;
+  int         passed;
+  int         ovl, shorter;
+  int         i, j, d;
+  void       *p;
+  int         status;
+
+  overlap = ESL_MAX(om->max_length, 2 * om->M);
+  overlap = ESL_MIN(overlap, W / 2);
+
+  npass[0] = pli->n_past_msv;
+  npass[1] = pli->n_past_bias;
+  npass[2] = pli->n_past_vit;
+  npass[3] = pli->n_past_fwd;
+
+  if ((wsq = esl_sq_CreateDigital(sq->abc))                     == NULL)  { status = eslEMEM; goto ERROR; }
+  if ((status = esl_sq_GrowTo(wsq, W))                          != eslOK) goto ERROR;
+  if ((status = esl_sq_SetName(wsq, sq->name))                  != eslOK) goto ERROR;
+  if ((status = esl_sq_SetAccession(wsq, sq->acc))              != eslOK) goto ERROR;
+  if ((status = esl_sq_SetDesc(wsq, sq->desc))                  != eslOK) goto ERROR;
+
+  for (start = 1, nwin = 0; ; start += W - overlap, nwin++)
+    {
+      wn = (int) ESL_MIN(W, sq->n - start + 1);
+      memcpy(wsq->dsq + 1, sq->dsq + start, sizeof(ESL_DSQ) * wn);
+      wsq->dsq[0] = wsq->dsq[wn+1] = eslDSQ_SENTINEL;
+      wsq->n      = wn;
+
+      p7_bg_SetLength(bg, wn);
+      p7_oprofile_ReconfigLength(om, wn);
+      p7_pipeline_Reuse(pli);
+
+      p7_omx_GrowTo(pli->oxf, om->M, 0, wn);
+      p7_MSVFilter(wsq->dsq, wn, om, pli->oxf, &usc);
+      if ((status = pipeline_domains(pli, om, bg, wsq, ntsq, usc, sq->n, &fwdsc, &nullsc, &passed)) != eslOK) goto ERROR;
+
+      if (passed)
+	{
+	  if (ndom + pli->ddef->ndom > dalloc)
+	    {
+	      dalloc = ndom + pli->ddef->ndom + 16;
+	      ESL_RALLOC(dcl,   p, sizeof(P7_DOMAIN) * dalloc);
+	      ESL_RALLOC(dwin,  p, sizeof(int)       * dalloc);
+	      ESL_RALLOC(dedge, p, sizeof(int)       * dalloc);
+	    }
+
+	  /* Take the window's domains over, shifted to full-length coords */
+	  for (d = 0; d < pli->ddef->ndom; d++, ndom++)
+	    {
+	      dcl[ndom]   = pli->ddef->dcl[d];
+	      dwin[ndom]  = nwin;
+	      dedge[ndom] = sq->n;
+	      if (start > 1)            dedge[ndom] = ESL_MIN(dedge[ndom], dcl[ndom].ienv - 1);
+	      if (start + wn - 1 < sq->n) dedge[ndom] = ESL_MIN(dedge[ndom], wn - dcl[ndom].jenv);
+
+	      dcl[ndom].ienv += start - 1;
+	      dcl[ndom].jenv += start - 1;
+	      dcl[ndom].iali += start - 1;
+	      dcl[ndom].jali += start - 1;
+	      dcl[ndom].ad->sqfrom += start - 1;
+	      dcl[ndom].ad->sqto   += start - 1;
+	      dcl[ndom].ad->L       = sq->n;
+
+	      pli->ddef->dcl[d].ad             = NULL;
+	      pli->ddef->dcl[d].scores_per_pos = NULL;
+	    }
+	  nexpected  += pli->ddef->nexpected;
+	  nregions   += pli->ddef->nregions;
+	  nclustered += pli->ddef->nclustered;
+	  noverlaps  += pli->ddef->noverlaps;
+	  nenvelopes += pli->ddef->nenvelopes;
+	}
+
+      if (start + wn - 1 >= sq->n) break;
+    }
+
+  /* Restore what our caller set up for the whole target */
+  p7_bg_SetLength(bg, sq->n);
+  p7_oprofile_ReconfigLength(om, sq->n);
+  p7_pipeline_Reuse(pli);
+  if (pli->n_past_msv  > npass[0]) pli->n_past_msv  = npass[0] + 1;
+  if (pli->n_past_bias > npass[1]) pli->n_past_bias = npass[1] + 1;
+  if (pli->n_past_vit  > npass[2]) pli->n_past_vit  = npass[2] + 1;
+  if (pli->n_past_fwd  > npass[3]) pli->n_past_fwd  = npass[3] + 1;
+
+  if (ndom == 0) goto DONE;
+
+  /* A domain found in two windows overlaps itself by most of its
+   * envelope, on the same stretch of the model. Keep the copy that's
+   * farther from its window's cut (the first, on a tie).
+   */
+  ESL_ALLOC(isdup, sizeof(int) * ndom);
+  esl_vec_ISet(isdup, ndom, FALSE);
+  for (i = 0; i < ndom; i++)
+    for (j = i+1; j < ndom; j++)
+      {
+	if (isdup[i] || isdup[j] || dwin[i] == dwin[j]) continue;
+	ovl     = ESL_MIN(dcl[i].jenv, dcl[j].jenv) - ESL_MAX(dcl[i].ienv, dcl[j].ienv) + 1;
+	shorter = ESL_MIN(dcl[i].jenv - dcl[i].ienv + 1, dcl[j].jenv - dcl[j].ienv + 1);
+	if (2 * ovl < shorter) continue;
+	if (dcl[i].ad->hmmto < dcl[j].ad->hmmfrom || dcl[j].ad->hmmto < dcl[i].ad->hmmfrom) continue;
+
+	if (dedge[j] > dedge[i]) isdup[i] = TRUE;
+	else                     isdup[j] = TRUE;
+      }
+
+  for (i = 0, d = 0; d < ndom; d++)
+    {
+      if (isdup[d])
+	{
+	  p7_alidisplay_Destroy(dcl[d].ad);
+	  if (dcl[d].scores_per_pos) free(dcl[d].scores_per_pos);
+	}
+      else dcl[i++] = dcl[d];
+    }
+  ndom = i;
+  qsort(dcl, ndom, sizeof(P7_DOMAIN), domain_sorter_by_ienv);
+
+  /* The merged domains become the whole target's domain list */
+  if (ndom > pli->ddef->nalloc)
+    {
+      ESL_RALLOC(pli->ddef->dcl, p, sizeof(P7_DOMAIN) * ndom);
+      pli->ddef->nalloc = ndom;
+    }
+  memcpy(pli->ddef->dcl, dcl, sizeof(P7_DOMAIN) * ndom);
+  pli->ddef->ndom       = ndom;
+  pli->ddef->nexpected  = nexpected;
+  pli->ddef->nregions   = nregions;
+  pli->ddef->nclustered = nclustered;
+  pli->ddef->noverlaps  = noverlaps;
+  pli->ddef->nenvelopes = nenvelopes;
+  ndom = 0;		/* ddef owns the alidisplays now */
+
+  p7_bg_NullOne(bg, sq->dsq, sq->n, &nullsc);
+  if ((status = pipeline_hit(pli, om, bg, sq, -eslINFINITY, nullsc, hitlist)) != eslOK) goto ERROR;
+
+ DONE:
+  esl_sq_Destroy(wsq);
+  free(dcl);
+  free(dwin);
+  free(dedge);
+  free(isdup);
+  return eslOK;
+
+ ERROR:
+  for (d = 0; d < ndom; d++) {
+    p7_alidisplay_Destroy(dcl[d].ad);
+    if (dcl[d].scores_per_pos) free(dcl[d].scores_per_pos);
+  }
+  esl_sq_Destroy(wsq);
+  free(dcl);
+  free(dwin);
+  free(dedge);
+  free(isdup);
+  return status;
+}
+
 /* Function:  p7_pli_computeAliScores()
  * Synopsis:  Compute per-position scores for the alignment for a domain
  *
@@ -1440,6 +1852,41 @@ p7_pli_postSSV_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_BG *bg, P7_TOPHI
 
 
 
+/* longtarget_workspace_GrowTo()
+ * Make sure <pli>'s long target workspace can hold what
+ * p7_Pipeline_LongTarget() needs for profile <om>, creating it on
+ * first use and growing it for larger models. The workspace is kept
+ * from call to call, so that a search of many short targets doesn't
+ * allocate and free it for each one.
+ */
+static int
+longtarget_workspace_GrowTo(P7_PIPELINE *pli, const P7_OPROFILE *om, const P7_BG *bg)
+{
+  int status;
+
+  if (pli->lt_tmpseq != NULL && pli->lt_tmpseq->abc != om->abc) { /* new alphabet: start over */
+    esl_sq_Destroy(pli->lt_tmpseq);  pli->lt_tmpseq        = NULL;
+    p7_bg_Destroy(pli->lt_bg);       pli->lt_bg            = NULL;
+    free(pli->lt_scores);            pli->lt_scores        = NULL;
+    free(pli->lt_fwd_emissions);     pli->lt_fwd_emissions = NULL;
+    pli->lt_allocM = 0;
+  }
+
+  if (pli->lt_tmpseq == NULL && (pli->lt_tmpseq = esl_sq_CreateDigital(om->abc)) == NULL) { status = eslEMEM; goto ERROR; }
+  if (pli->lt_bg     == NULL && (pli->lt_bg     = p7_bg_Clone(bg))               == NULL) { status = eslEMEM; goto ERROR; }
+  if (pli->lt_scores == NULL)
+    ESL_ALLOC(pli->lt_scores, sizeof(float) * om->abc->Kp * 4); //space to store scores that will be used in p7_oprofile_Update(Fwd|Vit|MSV)EmissionScores
+  if (om->M > pli->lt_allocM) {
+    ESL_REALLOC(pli->lt_fwd_emissions, sizeof(float) * om->abc->Kp * (om->M+1));
+    pli->lt_allocM = om->M;
+  }
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
 /* Function:  p7_Pipeline_LongTarget()
  * Synopsis:  Accelerated seq/profile comparison pipeline for long target sequences.
  *
@@ -1515,17 +1962,17 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
   P7_HMM_WINDOW    *window;
   FM_SEQDATA        seq_data;
 
-  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp;
+  P7_PIPELINE_LONGTARGET_OBJS  lt_objs;
+  P7_PIPELINE_LONGTARGET_OBJS *pli_tmp = &lt_objs;
 
   if ((sq && (sq->n == 0)) || (fmf && (fmf->N == 0))) return eslOK;    /* silently skip length 0 seqs; they'd cause us all sorts of weird problems */
 
 
-  ESL_ALLOC(pli_tmp, sizeof(P7_PIPELINE_LONGTARGET_OBJS));
-  pli_tmp->tmpseq = NULL;
-  pli_tmp->bg = p7_bg_Clone(bg);
-  pli_tmp->om = p7_oprofile_Create(om->M, om->abc);
-  ESL_ALLOC(pli_tmp->scores, sizeof(float) * om->abc->Kp * 4); //allocation of space to store scores that will be used in p7_oprofile_Update(Fwd|Vit|MSV)EmissionScores
-  ESL_ALLOC(pli_tmp->fwd_emissions_arr, sizeof(float) *  om->abc->Kp * (om->M+1));
+  if ((status = longtarget_workspace_GrowTo(pli, om, bg)) != eslOK) return status;
+  pli_tmp->tmpseq            = pli->lt_tmpseq;
+  pli_tmp->bg                = pli->lt_bg;
+  pli_tmp->scores            = pli->lt_scores;
+  pli_tmp->fwd_emissions_arr = pli->lt_fwd_emissions;
 
   msv_windowlist.windows = NULL;
   vit_windowlist.windows = NULL;
@@ -1544,7 +1991,7 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
    * short high-scoring regions.
    */
   if (fmf) // using an FM-index
-    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, pli->r, &msv_windowlist );
+    p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, pli->strands, pli->r, &(pli->fm_ws), &msv_windowlist );
   else // compare directly to sequence
     p7_SSVFilter_longtarget(sq->dsq, sq->n, om, pli->oxf, data, bg, pli->F1, &msv_windowlist);
 
@@ -1614,9 +2061,6 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
   /* Pass each remaining window on to the remaining pipeline */
     p7_hmmwindow_init(&vit_windowlist);
-    pli_tmp->tmpseq = esl_sq_CreateDigital(om->abc);
-    if (!fmf )
-      free (pli_tmp->tmpseq->dsq);  //this ESL_SQ object is just a container that'll point to a series of other DSQs, so free the one we just created inside the larger SQ object
 
 
     for (i=0; i<msv_windowlist.count; i++){
@@ -1668,44 +2112,88 @@ p7_Pipeline_LongTarget(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data,
 
     }
 
-    if (fmf)  free (pli_tmp->tmpseq->dsq);
-
-    pli_tmp->tmpseq->dsq = NULL;  //it's a pointer to a dsq object belonging to another sequence
-
-    esl_sq_Destroy(pli_tmp->tmpseq);
     free (vit_windowlist.windows);
   }
 
   if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
 
-  if (pli_tmp != NULL) {
-    if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
-    if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
-    if (pli_tmp->scores != NULL)        free (pli_tmp->scores);
-    if (pli_tmp->fwd_emissions_arr != NULL) free (pli_tmp->fwd_emissions_arr);
-    free(pli_tmp);
-  }
-
   return eslOK;
 
 ERROR:
   if (msv_windowlist.windows != NULL) free (msv_windowlist.windows);
   if (vit_windowlist.windows != NULL) free (vit_windowlist.windows);
 
-  if (pli_tmp != NULL) {
-    if (pli_tmp->tmpseq != NULL) esl_sq_Destroy(pli_tmp->tmpseq);
-    if (pli_tmp->bg != NULL)     p7_bg_Destroy(pli_tmp->bg);
-    if (pli_tmp->om != NULL)     p7_oprofile_Destroy(pli_tmp->om);
-    if (pli_tmp->scores != NULL)        free (pli_tmp->scores);
-    if (pli_tmp->fwd_emissions_arr != NULL) free (pli_tmp->fwd_emissions_arr);
-    free(pli_tmp);
-  }
-
   return status;
 
 }
 
 
+/* Function:  p7_Pipeline_FMSeed()
+ * Synopsis:  Find the targets in one block of a protein FM-index worth scoring.
+ *
+ * Purpose:   For hmmsearch and phmmer against a <makehmmerdb --amino>
+ *            database. Seeds for <om> are found in the block <fmf>/<fmb>
+ *            with the FM-index SSV filter used by nhmmer
+ *            (<p7_SSVFM_longlarget()>), on the top strand only, and the
+ *            segment (<seq_data[]> entry) holding each seed that passes
+ *            the SSV threshold is flagged in <seeded>, an array of
+ *            <meta->seq_count> flags cleared by the caller for each
+ *            query.
+ *
+ *            Once every block has been seeded, <fm_readSeeded()> reads
+ *            the targets with a flagged segment, whole, into sequence
+ *            blocks, to be scored with <p7_Pipeline_Block()> exactly as
+ *            if they had been read from a sequence file; targets
+ *            without a seed are never scored. A target split over two
+ *            blocks is scored once, with its own coordinates. Only the
+ *            targets that are scored are counted in <pli->nseqs> and
+ *            <pli->nres>; the caller sets those (and <pli->Z>) from the
+ *            index metadata once the search is done.
+ *
+ *            Uses <pli->r>, <pli->fm_ws> and <pli->F1>, and sets the
+ *            length model of <bg>, so seed one block at a time with one
+ *            pipeline.
+ *
+ * Args:      pli      - the main pipeline object
+ *            om       - optimized profile (query)
+ *            data     - SSV scores of <om>, for seeding
+ *            bg       - background model
+ *            fmf      - the FM_DATA for the block, forward traversal
+ *            fmb      - the FM_DATA for the block, backward traversal
+ *            fm_cfg   - general FM configuration
+ *            seeded   - flags of segments seeded for this query
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_Pipeline_FMSeed(P7_PIPELINE *pli, P7_OPROFILE *om, P7_SCOREDATA *data, P7_BG *bg,
+                   const FM_DATA *fmf, const FM_DATA *fmb, FM_CFG *fm_cfg, uint8_t *seeded)
+{
+  P7_HMM_WINDOWLIST windowlist;
+  int               i;
+  int               status;
+
+  if (fmf->N == 0) return eslOK;
+
+  windowlist.windows = NULL;
+  p7_hmmwindow_init(&windowlist);
+
+  status = p7_SSVFM_longlarget(om, 2.0, bg, pli->F1, fmf, fmb, fm_cfg, data, p7_STRAND_TOPONLY, pli->r, &(pli->fm_ws), &windowlist);
+  if (status != eslEOF) goto ERROR;
+
+  for (i = 0; i < windowlist.count; i++)
+    seeded[windowlist.windows[i].id] = TRUE;
+
+  status = eslOK;
+
+ ERROR:
+  if (windowlist.windows) free(windowlist.windows);
+  return status;
+}
+
+
 /* Function:  p7_pli_Statistics()
  * Synopsis:  Final statistics output from a processing pipeline.
  *
@@ -1802,7 +2290,155 @@ p7_pli_Statistics(FILE *ofp, P7_PIPELINE *pli, ESL_STOPWATCH *w)
 
 
 /*****************************************************************
- * 3. Example 1: "search mode" in a sequence db
+ * 3. Unit tests
+ *****************************************************************/
+#ifdef p7PIPELINE_TESTDRIVE
+#include <math.h>
+
+#include "esl_random.h"
+#include "esl_randomseq.h"
+
+/* utest_windowed()
+ * A target that <pipeline_windowed()> has to cut into windows of <W>
+ * residues must score as it does in one piece. Plant three copies of
+ * a model's consensus in a random sequence of 3W residues: one inside
+ * the first window, one straddling its cut, and one whole in two
+ * overlapping windows. Run it through the pipeline unwindowed, and
+ * windowed, and compare the domains and the sequence (reconstruction)
+ * score.
+ */
+static void
+utest_windowed(ESL_RANDOMNESS *r, ESL_ALPHABET *abc, int M, int W, float tol)
+{
+  char         msg[] = "pipeline windowed unit test failed";
+  P7_HMM      *hmm   = NULL;
+  P7_BG       *bg    = NULL;
+  P7_PROFILE  *gm    = NULL;
+  P7_OPROFILE *om    = NULL;
+  P7_PIPELINE *pli   = NULL;
+  P7_TOPHITS  *th1   = p7_tophits_Create();
+  P7_TOPHITS  *th2   = p7_tophits_Create();
+  ESL_SQ      *cq    = esl_sq_CreateDigital(abc);
+  ESL_SQ      *sq    = esl_sq_CreateDigital(abc);
+  P7_HIT      *h1, *h2;
+  int          L     = 3 * W;
+  int          pos[3];
+  int          overlap;
+  int          i, d;
+
+  if ( p7_hmm_Sample(r, M, abc, &hmm)                  != eslOK) esl_fatal(msg);
+  if ( p7_Calibrate(hmm, NULL, &r, &bg, NULL, NULL)    != eslOK) esl_fatal(msg);
+  if (( gm = p7_profile_Create(hmm->M, abc))           == NULL)  esl_fatal(msg);
+  if (( om = p7_oprofile_Create(hmm->M, abc))          == NULL)  esl_fatal(msg);
+  if ( p7_ProfileConfig(hmm, bg, gm, L, p7_LOCAL)      != eslOK) esl_fatal(msg);
+  if ( p7_oprofile_Convert(gm, om)                     != eslOK) esl_fatal(msg);
+  if ( p7_emit_SimpleConsensus(hmm, cq)                != eslOK) esl_fatal(msg);
+
+  overlap = ESL_MIN(ESL_MAX(om->max_length, 2 * om->M), W / 2);
+  pos[0]  = W / 4;
+  pos[1]  = W - M / 2;
+  pos[2]  = 1 + 2 * (W - overlap) + 10;
+
+  if ( esl_sq_GrowTo(sq, L)                            != eslOK) esl_fatal(msg);
+  if ( esl_rsq_xfIID(r, bg->f, abc->K, L, sq->dsq)    != eslOK) esl_fatal(msg);
+  for (i = 0; i < 3; i++)
+    memcpy(sq->dsq + pos[i], cq->dsq + 1, sizeof(ESL_DSQ) * M);
+  sq->n = L;
+  esl_sq_SetName(sq, "target");
+
+  if (( pli = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS)) == NULL) esl_fatal(msg);
+  pli->F1 = pli->F2 = pli->F3 = 1.0;
+  if ( p7_pli_NewModel(pli, om, bg)                    != eslOK) esl_fatal(msg);
+  if ( p7_pli_NewSeq(pli, sq)                          != eslOK) esl_fatal(msg);
+  p7_bg_SetLength(bg, L);
+  p7_oprofile_ReconfigLength(om, L);
+
+  if ( p7_Pipeline(pli, om, bg, sq, NULL, th1)              != eslOK) esl_fatal(msg);
+  p7_pipeline_Reuse(pli);
+  if ( pipeline_windowed(pli, om, bg, sq, NULL, W, th2)     != eslOK) esl_fatal(msg);
+  p7_pipeline_Reuse(pli);
+
+  if (th1->N != 1 || th2->N != 1) esl_fatal(msg);
+  h1 = &(th1->unsrt[0]);
+  h2 = &(th2->unsrt[0]);
+  if (h1->ndom != h2->ndom || h1->ndom != 3) esl_fatal(msg);
+  for (d = 0; d < h1->ndom; d++)
+    {
+      if (abs(h1->dcl[d].ienv - h2->dcl[d].ienv) > 2)           esl_fatal(msg);
+      if (abs(h1->dcl[d].jenv - h2->dcl[d].jenv) > 2)           esl_fatal(msg);
+      if (fabs(h1->dcl[d].bitscore - h2->dcl[d].bitscore) > tol) esl_fatal(msg);
+    }
+  if (fabs(h1->sum_score - h2->score) > tol) esl_fatal(msg);
+
+  p7_pipeline_Destroy(pli);
+  p7_tophits_Destroy(th1);
+  p7_tophits_Destroy(th2);
+  esl_sq_Destroy(cq);
+  esl_sq_Destroy(sq);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_bg_Destroy(bg);
+  p7_hmm_Destroy(hmm);
+}
+#endif /*p7PIPELINE_TESTDRIVE*/
+/*---------------------- end, unit tests ------------------------*/
+
+
+/*****************************************************************
+ * 4. Test driver
+ *****************************************************************/
+#ifdef p7PIPELINE_TESTDRIVE
+/* gcc -o p7_pipeline_utest -g -Wall -I../easel -L../easel -I. -L. -Dp7PIPELINE_TESTDRIVE p7_pipeline.c -lhmmer -leasel -lm
+ * ./p7_pipeline_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",           0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                  0 },
+  { "-t",        eslARG_REAL,   "0.5", NULL, NULL,  NULL,  NULL, NULL, "bit score tolerance, windowed vs. whole target", 0 },
+  { "-v",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "be verbose",                                     0 },
+  { "-M",        eslARG_INT,     "50", NULL, NULL,  NULL,  NULL, NULL, "length of sampled test model",                   0 },
+  { "-W",        eslARG_INT,   "1000", NULL, NULL,  NULL,  NULL, NULL, "window length for the windowed pipeline",        0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "unit test driver for the pipeline";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go   = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+  ESL_RANDOMNESS *r    = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc  = esl_alphabet_Create(eslAMINO);
+  int             M    = esl_opt_GetInteger(go, "-M");
+  int             W    = esl_opt_GetInteger(go, "-W");
+  float           tol  = esl_opt_GetReal   (go, "-t");
+
+  p7_FLogsumInit();
+  if (esl_opt_GetBoolean(go, "-v")) printf("p7_pipeline unit test: rng seed %" PRIu32 "\n", esl_randomness_GetSeed(r));
+
+  utest_windowed(r, abc, M, W, tol);
+
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7PIPELINE_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
+
+
+/*****************************************************************
+ * 5. Example 1: "search mode" in a sequence db
  *****************************************************************/
 
 #ifdef p7PIPELINE_EXAMPLE
@@ -1836,6 +2472,7 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--bands",      eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "decode domains inside their posterior bands",                  0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -1942,7 +2579,7 @@ main(int argc, char **argv)
 
 
 /*****************************************************************
- * 4. Example 2: "scan mode" in an HMM db
+ * 6. Example 2: "scan mode" in an HMM db
  *****************************************************************/
 #ifdef p7PIPELINE_EXAMPLE2
 /* gcc -o pipeline_example2 -g -Wall -I../easel -L../easel -I. -L. -Dp7PIPELINE_EXAMPLE2 p7_pipeline.c -lhmmer -leasel -lm
@@ -1975,6 +2612,7 @@ static ESL_OPTIONS options[] = {
   { "--F3",         eslARG_REAL,  "1e-5", NULL, NULL,      NULL,  NULL, "--max",                        "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             0 },
   { "--nobias",     eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "turn off composition bias filter",                             0 },
   { "--nonull2",    eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL,  NULL,                          "turn off biased composition score corrections",                0 },
+  { "--bands",      eslARG_NONE,   NULL,  NULL, NULL,      NULL,  NULL, "--max",                        "decode domains inside their posterior bands",                  0 },
   { "--seed",       eslARG_INT,    "42",  NULL, "n>=0",    NULL,  NULL,  NULL,                          "set RNG seed to <n> (if 0: one-time arbitrary seed)",          0 },
   { "--acc",        eslARG_NONE,  FALSE,  NULL, NULL,      NULL,  NULL,  NULL,                          "output target accessions instead of names if possible",        0 },
   {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
@@ -0,0 +1,872 @@
+/* P7_SQREADER: parallel FASTA reader and digitizer for threaded searches.
+ *
+ * In a threaded search with a short query, the filters can eat
+ * sequences faster than one thread can read and digitize them with
+ * esl_sqio_ReadBlock(), and the master thread becomes the
+ * bottleneck. A P7_SQREADER splits a FASTA file into chunks of about
+ * a megabyte at record boundaries, and several reader threads parse
+ * and digitize chunks at once, each into its own free block from a
+ * P7_WORKPOOL. Only the fread() of each chunk, and the search for the
+ * last record boundary in it, happen under a lock.
+ *
+ * It only handles plain FASTA files that can be opened again by name
+ * and read from the start; see p7_sqreader_IsUsable(). Anything else
+ * (stdin, gzip'ed files, other formats, --restrictdb_* ranges) goes
+ * through esl_sqio_ReadBlock() as before. Sequences come out in no
+ * particular order, as they already did from the worker threads.
+ *
+ * Contents:
+ *    1. The P7_SQREADER object.
+ *    2. Internal functions.
+ *    3. Benchmark driver.
+ *    4. Unit tests.
+ *    5. Test driver.
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+
+#include "hmmer.h"
+#include "p7_sqreader.h"
+
+static int   next_chunk   (P7_SQREADER *rdr, char **buf, int64_t *balloc, int64_t *ret_nbuf);
+static int   parse_block  (P7_SQREADER *rdr, char **ret_p, char *end, ESL_SQ_BLOCK *block, int64_t *ret_nres, char *errbuf);
+static int   reader_loop  (P7_SQREADER *rdr);
+static void *reader_thread(void *arg);
+
+
+/*****************************************************************
+ * 1. The P7_SQREADER object.
+ *****************************************************************/
+
+/* Function:  p7_sqreader_IsUsable()
+ * Synopsis:  Can a P7_SQREADER read this sequence file?
+ *
+ * Purpose:   Return <TRUE> if the open sequence file <sqfp> is a plain
+ *            FASTA file that a <P7_SQREADER> can open again by name
+ *            and read in parallel: not stdin, not gzip'ed, and not some
+ *            other format.
+ */
+int
+p7_sqreader_IsUsable(ESL_SQFILE *sqfp)
+{
+  if (sqfp->format != eslSQFILE_FASTA)     return FALSE;
+  if (! esl_sqfile_IsRewindable(sqfp))     return FALSE;  /* stdin, gzip */
+  if (strcmp(sqfp->filename, "-") == 0)    return FALSE;
+  return TRUE;
+}
+
+
+/* Function:  p7_sqreader_Create()
+ * Synopsis:  Open a FASTA file for parallel reading.
+ *
+ * Purpose:   Open FASTA file <filename> for reading by <nthreads>
+ *            threads at once (the caller of <p7_sqreader_Run()>, and
+ *            <nthreads-1> more that it starts), digitizing in
+ *            alphabet <abc>. As in Easel's FASTA parser, whitespace and
+ *            digits in sequence lines are ignored.
+ *
+ *            Threaded programs use <1 + ncpus /
+ *            p7_SQREADER_CPUS_PER_THREAD> reader threads.
+ *
+ * Returns:   a pointer to the new reader, or <NULL> if <filename>
+ *            can't be opened; the caller reads it the usual way
+ *            instead.
+ *
+ * Throws:    <NULL> on allocation or pthreads failure.
+ */
+P7_SQREADER *
+p7_sqreader_Create(const char *filename, const ESL_ALPHABET *abc, int nthreads)
+{
+  P7_SQREADER *rdr = NULL;
+  int          x;
+  int          status;
+
+  ESL_ALLOC(rdr, sizeof(P7_SQREADER));
+  rdr->filename   = NULL;
+  rdr->fp         = NULL;
+  rdr->abc        = abc;
+  rdr->nthreads   = ESL_MAX(1, nthreads);
+  rdr->chunksize  = p7_SQREADER_CHUNKSIZE;
+  rdr->wp         = NULL;
+  rdr->carry      = NULL;
+  rdr->ncarry     = 0;
+  rdr->carryalloc = 0;
+  rdr->is_eof     = FALSE;
+  rdr->status     = eslOK;
+  rdr->nseq       = 0;
+  rdr->nres       = 0;
+  rdr->errbuf[0]  = '\0';
+  if (pthread_mutex_init(&rdr->mutex, NULL) != 0) { free(rdr); rdr = NULL; ESL_XEXCEPTION(eslESYS, "pthread_mutex_init failed"); }
+
+  if ((status = esl_strdup(filename, -1, &rdr->filename)) != eslOK) goto ERROR;
+  if ((rdr->fp = fopen(filename, "r")) == NULL) { p7_sqreader_Destroy(rdr); return NULL; }
+
+  /* FASTA input map, as esl_sqio's: the alphabet's residues, with
+   * whitespace and digits ignored, and anything else illegal.
+   */
+  for (x = 0; x < 128; x++) rdr->inmap[x] = abc->inmap[x];
+  for (x = '0'; x <= '9'; x++) rdr->inmap[x] = eslDSQ_IGNORED;
+  rdr->inmap[' ']  = eslDSQ_IGNORED;
+  rdr->inmap['\t'] = eslDSQ_IGNORED;
+  rdr->inmap['\n'] = eslDSQ_IGNORED;
+  rdr->inmap['\r'] = eslDSQ_IGNORED;
+  rdr->inmap['\v'] = eslDSQ_IGNORED;
+  rdr->inmap['\f'] = eslDSQ_IGNORED;
+  rdr->inmap[0]    = eslDSQ_ILLEGAL;
+  return rdr;
+
+ ERROR:
+  p7_sqreader_Destroy(rdr);
+  return NULL;
+}
+
+
+/* Function:  p7_sqreader_Run()
+ * Synopsis:  Read the whole file into a work pool, in parallel.
+ *
+ * Purpose:   Read FASTA file <rdr> from the start, with
+ *            <rdr->nthreads> threads including this one, parsing and
+ *            digitizing the sequences into free <ESL_SQ_BLOCK>s from
+ *            work pool <wp> and handing the filled blocks to the
+ *            pool's workers. Returns when the whole file has been
+ *            read; the caller then calls <p7_workpool_ReaderDone()>.
+ *
+ *            Takes the place of the <esl_sqio_ReadBlock()> loop in a
+ *            threaded program's <thread_loop()>, and returns what
+ *            that loop would.
+ *
+ *            <rdr->nseq> and <rdr->nres> count the sequences and
+ *            residues read.
+ *
+ * Returns:   <eslEOF> when the whole file has been read.
+ *            <eslEFORMAT> on a parse error; <rdr->errbuf> says what
+ *            it was. Blocks handed to the pool before the error are
+ *            still searched.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> on a system call failure.
+ */
+int
+p7_sqreader_Run(P7_SQREADER *rdr, P7_WORKPOOL *wp)
+{
+  pthread_t *tid      = NULL;
+  int        nstarted = 0;
+  int        t;
+  int        status;
+
+  if (fseeko(rdr->fp, 0, SEEK_SET) != 0) ESL_EXCEPTION(eslESYS, "fseeko() failed on %s", rdr->filename);
+  clearerr(rdr->fp);
+
+  rdr->wp        = wp;
+  rdr->ncarry    = 0;
+  rdr->is_eof    = FALSE;
+  rdr->status    = eslOK;
+  rdr->nseq      = 0;
+  rdr->nres      = 0;
+  rdr->errbuf[0] = '\0';
+
+  ESL_ALLOC(tid, sizeof(pthread_t) * rdr->nthreads);
+  for (t = 1; t < rdr->nthreads; t++)
+    {
+      if (pthread_create(&tid[nstarted], NULL, reader_thread, rdr) != 0) ESL_XEXCEPTION(eslESYS, "pthread_create failed");
+      nstarted++;
+    }
+
+  reader_loop(rdr);
+
+  for (t = 0; t < nstarted; t++) pthread_join(tid[t], NULL);
+  free(tid);
+  return (rdr->status == eslOK ? eslEOF : rdr->status);
+
+ ERROR:
+  /* stop the threads we did start, at their next chunk */
+  pthread_mutex_lock(&rdr->mutex);
+  if (rdr->status == eslOK) rdr->status = status;
+  pthread_mutex_unlock(&rdr->mutex);
+  for (; nstarted > 0; nstarted--) pthread_join(tid[nstarted-1], NULL);
+  if (tid) free(tid);
+  return status;
+}
+
+
+/* Function:  p7_sqreader_Destroy()
+ * Synopsis:  Close and free a P7_SQREADER.
+ */
+void
+p7_sqreader_Destroy(P7_SQREADER *rdr)
+{
+  if (rdr == NULL) return;
+
+  if (rdr->fp)       fclose(rdr->fp);
+  if (rdr->filename) free(rdr->filename);
+  if (rdr->carry)    free(rdr->carry);
+  pthread_mutex_destroy(&rdr->mutex);
+  free(rdr);
+}
+/*------------------ end, P7_SQREADER object --------------------*/
+
+
+
+/*****************************************************************
+ * 2. Internal functions.
+ *****************************************************************/
+
+/* next_chunk()
+ * Get the next chunk of the file: the start of a record left over
+ * from the last chunk, plus at least one more fread(), cut just
+ * before the start of the last record that began in what was read.
+ * If no record starts there (a sequence longer than a chunk), keep
+ * reading until one does, or to the end of the file. The chunk goes
+ * in <*buf>, which is the caller's and is reallocated as needed
+ * (<*balloc>); its length in <*ret_nbuf>. There's always at least one
+ * spare byte after it, so the parser can NUL-terminate a name or
+ * description at the end.
+ *
+ * Returns <eslOK> on success; <eslEOF> if the file is done, or
+ * another thread has hit an error.
+ */
+static int
+next_chunk(P7_SQREADER *rdr, char **buf, int64_t *balloc, int64_t *ret_nbuf)
+{
+  int64_t nbuf = 0;
+  int64_t nread;
+  int64_t i;
+  int     status;
+
+  if (pthread_mutex_lock(&rdr->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+
+  if (rdr->status != eslOK || (rdr->is_eof && rdr->ncarry == 0)) { status = eslEOF; goto ERROR; }
+
+  if (rdr->ncarry + rdr->chunksize + 1 > *balloc)
+    {
+      ESL_REALLOC(*buf, sizeof(char) * (rdr->ncarry + rdr->chunksize + 1));
+      *balloc = rdr->ncarry + rdr->chunksize + 1;
+    }
+  memcpy(*buf, rdr->carry, rdr->ncarry);
+  nbuf        = rdr->ncarry;
+  rdr->ncarry = 0;
+
+  while (! rdr->is_eof)
+    {
+      if (nbuf + rdr->chunksize + 1 > *balloc)
+	{
+	  ESL_REALLOC(*buf, sizeof(char) * (nbuf + rdr->chunksize + 1));
+	  *balloc = nbuf + rdr->chunksize + 1;
+	}
+      nread = fread(*buf + nbuf, sizeof(char), rdr->chunksize, rdr->fp);
+      if (nread < rdr->chunksize)
+	{
+	  if (ferror(rdr->fp)) ESL_XEXCEPTION(eslESYS, "fread() failed on %s", rdr->filename);
+	  rdr->is_eof = TRUE;
+	}
+
+      /* a record starts at a > at the start of a line */
+      for (i = nbuf + nread - 1; i >= ESL_MAX(1, nbuf); i--)
+	if ((*buf)[i] == '>' && (*buf)[i-1] == '\n') break;
+      nbuf += nread;
+      if (rdr->is_eof) break;
+
+      if (i >= ESL_MAX(1, nbuf - nread))
+	{
+	  if (nbuf - i > rdr->carryalloc)
+	    {
+	      ESL_REALLOC(rdr->carry, sizeof(char) * (nbuf - i));
+	      rdr->carryalloc = nbuf - i;
+	    }
+	  memcpy(rdr->carry, *buf + i, nbuf - i);
+	  rdr->ncarry = nbuf - i;
+	  nbuf        = i;
+	  break;
+	}
+    }
+
+  if (pthread_mutex_unlock(&rdr->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  *ret_nbuf = nbuf;
+  return (nbuf > 0 ? eslOK : eslEOF);
+
+ ERROR:
+  pthread_mutex_unlock(&rdr->mutex);
+  *ret_nbuf = 0;
+  return status;
+}
+
+
+/* parse_block()
+ * Parse and digitize FASTA records from <*ret_p> up to <end> into
+ * <block>, until the chunk or the block runs out, and leave <*ret_p>
+ * at the start of the next record. Number of residues in
+ * <*ret_nres>.
+ *
+ * Returns <eslOK> on success. <eslEFORMAT> on a parse error, with a
+ * message in <errbuf>.
+ */
+static int
+parse_block(P7_SQREADER *rdr, char **ret_p, char *end, ESL_SQ_BLOCK *block, int64_t *ret_nres, char *errbuf)
+{
+  ESL_SQ  *sq;
+  char    *p    = *ret_p;
+  char    *q, *r, *s, *eol, *nl;
+  char     c;
+  ESL_DSQ  x;
+  int64_t  n;
+  int64_t  nres = 0;
+  int      status;
+
+  block->count    = 0;
+  block->complete = TRUE;
+  while (block->count < block->listSize)
+    {
+      while (p < end && isspace((int) *p)) p++;
+      if (p == end) break;
+      if (*p != '>') ESL_XFAIL(eslEFORMAT, errbuf, "Expected FASTA record to start with >, saw %c", *p);
+
+      sq = block->list + block->count;
+      esl_sq_Reuse(sq);
+
+      /* Header: >name description */
+      p++;
+      if ((eol = memchr(p, '\n', end - p)) == NULL) eol = end;
+      for (q = p; q < eol && ! isspace((int) *q); q++) ;
+      if (q == p) ESL_XFAIL(eslEFORMAT, errbuf, "No name found on FASTA header line");
+      c = *q; *q = '\0';
+      status = esl_sq_SetName(sq, p);
+      *q = c;
+      if (status != eslOK) goto ERROR;
+
+      for (p = q;   p < eol && isspace((int) *p);    p++) ;
+      for (q = eol; q > p   && isspace((int) q[-1]); q--) ;
+      if (q > p)
+	{
+	  c = *q; *q = '\0';
+	  status = esl_sq_SetDesc(sq, p);
+	  *q = c;
+	  if (status != eslOK) goto ERROR;
+	}
+
+      /* Sequence: lines up to the next one that starts with > */
+      s = (eol < end ? eol+1 : end);
+      for (r = s; r < end && *r != '>'; r = (nl ? nl+1 : end))
+	nl = memchr(r, '\n', end - r);
+
+      if ((status = esl_sq_GrowTo(sq, r - s)) != eslOK) goto ERROR;
+      sq->dsq[0] = eslDSQ_SENTINEL;
+      for (n = 0, q = s; q < r; q++)
+	{
+	  x = ((unsigned char) *q < 128 ? rdr->inmap[(int) *q] : eslDSQ_ILLEGAL);
+	  if      (x <= 127)            sq->dsq[++n] = x;
+	  else if (x != eslDSQ_IGNORED) ESL_XFAIL(eslEFORMAT, errbuf, "Illegal character %c in sequence %s", *q, sq->name);
+	}
+      sq->dsq[n+1] = eslDSQ_SENTINEL;
+      sq->n        = n;
+      sq->start    = 1;
+      sq->end      = n;
+      sq->C        = 0;
+      sq->W        = n;
+      sq->L        = n;
+
+      nres += n;
+      block->count++;
+      p = r;
+    }
+
+  *ret_p    = p;
+  *ret_nres = nres;
+  return eslOK;
+
+ ERROR:
+  *ret_p    = end;
+  *ret_nres = 0;
+  return status;
+}
+
+
+/* reader_loop()
+ * One reader thread's work: take chunks, parse them into free blocks
+ * from the pool, hand the blocks to the workers. On an error, record
+ * it in <rdr> (if it's the first) so the other threads stop.
+ */
+static int
+reader_loop(P7_SQREADER *rdr)
+{
+  char          *buf    = NULL;
+  int64_t        balloc = 0;
+  int64_t        nbuf;
+  int64_t        nres;
+  char          *p, *end;
+  void          *b;
+  ESL_SQ_BLOCK  *block;
+  int            nseq;
+  char           errbuf[eslERRBUFSIZE];
+  int            status;
+
+  errbuf[0] = '\0';
+  while ((status = next_chunk(rdr, &buf, &balloc, &nbuf)) == eslOK)
+    {
+      p   = buf;
+      end = buf + nbuf;
+      while (p < end)
+	{
+	  if ((status = p7_workpool_ReaderGet(rdr->wp, &b)) != eslOK) goto ERROR;
+	  block  = (ESL_SQ_BLOCK *) b;
+	  status = parse_block(rdr, &p, end, block, &nres, errbuf);
+	  nseq   = (status == eslOK ? block->count : 0); /* once it's put, the block isn't ours to look at */
+
+	  if (p7_workpool_ReaderPut(rdr->wp, block, nseq) != eslOK) { status = eslESYS; goto ERROR; }
+	  if (status != eslOK) goto ERROR;
+
+	  if (pthread_mutex_lock(&rdr->mutex) != 0) { status = eslESYS; goto ERROR; }
+	  rdr->nseq += nseq;
+	  rdr->nres += nres;
+	  if (pthread_mutex_unlock(&rdr->mutex) != 0) { status = eslESYS; goto ERROR; }
+	}
+    }
+  if (status != eslEOF) goto ERROR;
+
+  free(buf);
+  return eslOK;
+
+ ERROR:
+  if (errbuf[0] == '\0') snprintf(errbuf, eslERRBUFSIZE, "Sequence reader thread failed (error code %d)", status);
+  pthread_mutex_lock(&rdr->mutex);
+  if (rdr->status == eslOK) { rdr->status = status; strcpy(rdr->errbuf, errbuf); }
+  pthread_mutex_unlock(&rdr->mutex);
+  if (buf) free(buf);
+  return status;
+}
+
+static void *
+reader_thread(void *arg)
+{
+  reader_loop((P7_SQREADER *) arg);
+  return NULL;
+}
+/*------------------ end, internal functions --------------------*/
+#endif /*HMMER_THREADS*/
+
+
+
+/*****************************************************************
+ * 3. Benchmark driver.
+ *****************************************************************/
+#ifdef p7SQREADER_BENCHMARK
+/*
+   ./p7_sqreader_benchmark uniprot_sprot.fasta
+   ./p7_sqreader_benchmark --max 8 uniprot_sprot.fasta
+
+   Reads <seqfile> once with esl_sqio_ReadBlock(), as the threaded
+   programs used to, then with a P7_SQREADER using 1, 2, 4... up to
+   --max reader threads. One worker thread takes the blocks and does
+   nothing with them, so this measures how fast the reader side can
+   feed a search whose filters are never the bottleneck.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_sq.h"
+#include "esl_sqio.h"
+#include "esl_stopwatch.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
+
+#include "hmmer.h"
+#include "p7_sqreader.h"
+#include "p7_workpool.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "--max",     eslARG_INT,      "8", NULL, "n>0", NULL,  NULL, NULL, "maximum number of reader threads",                 0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options] <seqfile>";
+static char banner[] = "benchmark driver for parallel FASTA reader";
+
+#ifdef HMMER_THREADS
+static void
+drain_thread(void *arg)
+{
+  ESL_THREADS  *obj = (ESL_THREADS *) arg;
+  P7_WORKPOOL  *wp;
+  P7_WORKRANGE  rng;
+  int           workeridx;
+  int           status;
+
+  esl_threads_Started(obj, &workeridx);
+  wp = (P7_WORKPOOL *) esl_threads_GetData(obj, workeridx);
+  while ((status = p7_workpool_WorkerNext(wp, workeridx, &rng)) == eslOK)
+    if (p7_workpool_WorkerDone(wp, &rng) != eslOK) p7_Fail("worker failed");
+  if (status != eslEOD) p7_Fail("worker failed");
+  esl_threads_Finished(obj, workeridx);
+}
+#endif /*HMMER_THREADS*/
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 1, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  char           *seqfile = esl_opt_GetArg(go, 1);
+  int             maxt    = esl_opt_GetInteger(go, "--max");
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  ESL_SQFILE     *sqfp    = NULL;
+  P7_SQREADER    *rdr     = NULL;
+  P7_WORKPOOL    *wp      = NULL;
+  ESL_THREADS    *obj     = NULL;
+  ESL_SQ_BLOCK   *block   = NULL;
+  void           *b;
+  int64_t         nseq    = 0;
+  int64_t         nres    = 0;
+  double          t0;
+  int             nthreads, i;
+  int             status;
+
+  if (esl_sqfile_OpenDigital(abc, seqfile, eslSQFILE_FASTA, NULL, &sqfp) != eslOK) p7_Fail("Failed to open FASTA file %s", seqfile);
+  if (! p7_sqreader_IsUsable(sqfp)) p7_Fail("%s can't be read in parallel", seqfile);
+
+  wp = p7_workpool_Create(1, p7_workpool_SeqWeight);
+  for (i = 0; i < 2 * (maxt+1); i++) p7_workpool_Init(wp, esl_sq_CreateDigitalBlock(1000, abc));
+
+  /* baseline: one thread, esl_sqio_ReadBlock() */
+  p7_workpool_Reset(wp);
+  obj = esl_threads_Create(&drain_thread);
+  esl_threads_AddThread(obj, wp);
+  esl_stopwatch_Start(w);
+  esl_threads_WaitForStart(obj);
+  do {
+    p7_workpool_ReaderGet(wp, &b);
+    block  = (ESL_SQ_BLOCK *) b;
+    status = esl_sqio_ReadBlock(sqfp, block, -1, -1, FALSE, FALSE);
+    if (status == eslOK) for (i = 0; i < block->count; i++) { nseq++; nres += block->list[i].n; }
+    p7_workpool_ReaderPut(wp, block, (status == eslOK ? block->count : 0));
+  } while (status == eslOK);
+  if (status != eslEOF) p7_Fail("Parse failed:\n%s", esl_sqfile_GetErrorBuf(sqfp));
+  p7_workpool_ReaderDone(wp);
+  esl_threads_WaitForFinish(obj);
+  esl_stopwatch_Stop(w);
+  esl_threads_Destroy(obj);
+  t0 = w->elapsed;
+
+  printf("# %s: %" PRId64 " seqs, %" PRId64 " residues\n", seqfile, nseq, nres);
+  printf("# %-14s %10s %10s %8s\n", "reader", "wall (s)", "Mres/s", "speedup");
+  printf("# %-14s %10s %10s %8s\n", "--------------", "----------", "----------", "--------");
+  printf("  %-14s %10.2f %10.1f %8.2f\n", "ReadBlock", t0, (double) nres / t0 / 1e6, 1.0);
+
+  for (nthreads = 1; nthreads <= maxt; nthreads = (nthreads < maxt && nthreads*2 > maxt) ? maxt : nthreads*2)
+    {
+      rdr = p7_sqreader_Create(seqfile, abc, nthreads);
+      p7_workpool_Reset(wp);
+      obj = esl_threads_Create(&drain_thread);
+      esl_threads_AddThread(obj, wp);
+
+      esl_stopwatch_Start(w);
+      esl_threads_WaitForStart(obj);
+      if ((status = p7_sqreader_Run(rdr, wp)) != eslEOF) p7_Fail("Parse failed:\n%s", rdr->errbuf);
+      p7_workpool_ReaderDone(wp);
+      esl_threads_WaitForFinish(obj);
+      esl_stopwatch_Stop(w);
+
+      if (rdr->nseq != nseq || rdr->nres != nres) p7_Fail("parallel reader read %" PRId64 " seqs, %" PRId64 " residues", rdr->nseq, rdr->nres);
+      printf("  %-8s %2d thr %10.2f %10.1f %8.2f\n", "sqreader", nthreads, w->elapsed, (double) nres / w->elapsed / 1e6, t0 / w->elapsed);
+
+      esl_threads_Destroy(obj);
+      p7_sqreader_Destroy(rdr);
+      if (nthreads == maxt) break;
+    }
+
+  p7_workpool_Reset(wp);
+  while (p7_workpool_Remove(wp, &b) == eslOK) esl_sq_DestroyBlock((ESL_SQ_BLOCK *) b);
+  p7_workpool_Destroy(wp);
+  esl_sqfile_Close(sqfp);
+  esl_stopwatch_Destroy(w);
+  esl_alphabet_Destroy(abc);
+#else
+  printf("# HMMER was built without threads: nothing to benchmark\n");
+#endif /*HMMER_THREADS*/
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7SQREADER_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
+
+
+
+/*****************************************************************
+ * 4. Unit tests.
+ *****************************************************************/
+#ifdef p7SQREADER_TESTDRIVE
+#ifdef HMMER_THREADS
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_threads.h"
+#include "esl_vectorops.h"
+
+/* Workers check each sequence they get against the ones that were
+ * written, by the index in its name, and count it in <seen>.
+ */
+typedef struct {
+  P7_WORKPOOL  *wp;
+  ESL_SQ      **sq;
+  int           N;
+  int          *seen;
+  int           nbad;
+} TEST_INFO;
+
+static void
+test_thread(void *arg)
+{
+  ESL_THREADS  *obj = (ESL_THREADS *) arg;
+  TEST_INFO    *info;
+  ESL_SQ_BLOCK *block;
+  ESL_SQ       *sq, *ref;
+  P7_WORKRANGE  rng;
+  int           workeridx;
+  int           i, k;
+  int           status;
+
+  esl_threads_Started(obj, &workeridx);
+  info = (TEST_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_workpool_WorkerNext(info->wp, workeridx, &rng)) == eslOK)
+    {
+      block = (ESL_SQ_BLOCK *) rng.blk;
+      for (i = rng.start; i < rng.end; i++)
+	{
+	  sq = block->list + i;
+	  if (sscanf(sq->name, "seq%d", &k) != 1 || k < 0 || k >= info->N) { info->nbad++; continue; }
+	  ref = info->sq[k];
+	  if (sq->n != ref->n)                                             info->nbad++;
+	  else if (memcmp(sq->dsq, ref->dsq, sizeof(ESL_DSQ) * (sq->n+2)) != 0) info->nbad++;
+	  if (strcmp(sq->desc, ref->desc) != 0)                             info->nbad++;
+	  __sync_fetch_and_add(&info->seen[k], 1);
+	  esl_sq_Reuse(sq);
+	}
+      if (p7_workpool_WorkerDone(info->wp, &rng) != eslOK) esl_fatal("WorkerDone failed");
+    }
+  if (status != eslEOD) esl_fatal("WorkerNext failed");
+  esl_threads_Finished(obj, workeridx);
+}
+
+/* A worker that just takes its ranges and gives them back. */
+static void
+drain_thread(void *arg)
+{
+  ESL_THREADS  *obj = (ESL_THREADS *) arg;
+  P7_WORKPOOL  *wp;
+  P7_WORKRANGE  rng;
+  int           workeridx;
+  int           status;
+
+  esl_threads_Started(obj, &workeridx);
+  wp = (P7_WORKPOOL *) esl_threads_GetData(obj, workeridx);
+  while ((status = p7_workpool_WorkerNext(wp, workeridx, &rng)) == eslOK)
+    if (p7_workpool_WorkerDone(wp, &rng) != eslOK) esl_fatal("WorkerDone failed");
+  if (status != eslEOD) esl_fatal("WorkerNext failed");
+  esl_threads_Finished(obj, workeridx);
+}
+
+/* Write <N> random sequences, some longer than a chunk, with and
+ * without descriptions, to a FASTA file with blank lines, odd line
+ * lengths and some lower case; read it back with <nthreads> reader threads and
+ * <nworkers> workers, with small chunks so there are lots of
+ * boundaries; every sequence must come back once, exactly as
+ * written.
+ */
+static void
+utest_readback(ESL_RANDOMNESS *rng, ESL_ALPHABET *abc, int N, int nthreads, int nworkers, int64_t chunksize)
+{
+  char          msg[]      = "sqreader readback unit test failed";
+  char          tmpfile[32] = "tmp-hmmerXXXXXX";
+  FILE         *fp         = NULL;
+  ESL_SQ      **sq         = malloc(sizeof(ESL_SQ *) * N);
+  int          *seen       = calloc(N, sizeof(int));
+  double        fq[20];
+  P7_SQREADER  *rdr        = NULL;
+  P7_WORKPOOL  *wp         = p7_workpool_Create(nworkers, p7_workpool_SeqWeight);
+  TEST_INFO    *info       = malloc(sizeof(TEST_INFO) * nworkers);
+  ESL_THREADS  *obj        = NULL;
+  void         *b;
+  int64_t       nres       = 0;
+  int           i, j, L, pass;
+
+  esl_vec_DSet(fq, abc->K, 1.0 / (double) abc->K);
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < N; i++)
+    {
+      L     = (esl_rnd_Roll(rng, 50) == 0 ? chunksize + esl_rnd_Roll(rng, 3 * chunksize) : esl_rnd_Roll(rng, 300));
+      sq[i] = esl_sq_CreateDigital(abc);
+      esl_sq_GrowTo(sq[i], L);
+      esl_rsq_xfIID(rng, fq, abc->K, L, sq[i]->dsq);
+      sq[i]->n = L;
+      esl_sq_FormatName(sq[i], "seq%d", i);
+      if (esl_rnd_Roll(rng, 2)) esl_sq_FormatDesc(sq[i], "description of seq %d", i);
+      nres += L;
+
+      /* header, then residues in lines of varying length, lower case sometimes */
+      fprintf(fp, ">%s%s%s\n", sq[i]->name, (sq[i]->desc[0] ? " " : ""), sq[i]->desc);
+      for (j = 1; j <= L; j++)
+	{
+	  fputc((i % 3 == 0 ? tolower(abc->sym[sq[i]->dsq[j]]) : abc->sym[sq[i]->dsq[j]]), fp);
+	  if (j % (40 + i % 30) == 0 || j == L) fputc('\n', fp);
+	}
+      if (esl_rnd_Roll(rng, 10) == 0) fputc('\n', fp);
+    }
+  fclose(fp);
+
+  for (i = 0; i < 2 * (nthreads + nworkers); i++) p7_workpool_Init(wp, esl_sq_CreateDigitalBlock(1 + esl_rnd_Roll(rng, 100), abc));
+  if ((rdr = p7_sqreader_Create(tmpfile, abc, nthreads)) == NULL) esl_fatal(msg);
+  rdr->chunksize = chunksize;
+
+  for (pass = 0; pass < 2; pass++)	/* second pass checks Run() rewinds */
+    {
+      for (i = 0; i < N; i++) seen[i] = 0;
+      p7_workpool_Reset(wp);
+      obj = esl_threads_Create(&test_thread);
+      for (i = 0; i < nworkers; i++)
+	{
+	  info[i].wp   = wp;
+	  info[i].sq   = sq;
+	  info[i].N    = N;
+	  info[i].seen = seen;
+	  info[i].nbad = 0;
+	  esl_threads_AddThread(obj, &info[i]);
+	}
+      esl_threads_WaitForStart(obj);
+      if (p7_sqreader_Run(rdr, wp) != eslEOF) esl_fatal(msg);
+      if (p7_workpool_ReaderDone(wp) != eslOK) esl_fatal(msg);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+
+      for (i = 0; i < N;        i++) if (seen[i] != 1)     esl_fatal(msg);
+      for (i = 0; i < nworkers; i++) if (info[i].nbad > 0) esl_fatal(msg);
+      if (rdr->nseq != N || rdr->nres != nres) esl_fatal(msg);
+    }
+
+  p7_sqreader_Destroy(rdr);
+  p7_workpool_Reset(wp);
+  while (p7_workpool_Remove(wp, &b) == eslOK) esl_sq_DestroyBlock((ESL_SQ_BLOCK *) b);
+  p7_workpool_Destroy(wp);
+  for (i = 0; i < N; i++) esl_sq_Destroy(sq[i]);
+  free(sq);
+  free(seen);
+  free(info);
+  remove(tmpfile);
+}
+
+/* An illegal residue is a parse error, with a message; the reader
+ * still returns, and the workers still finish.
+ */
+static void
+utest_badfile(ESL_ALPHABET *abc)
+{
+  char          msg[]       = "sqreader bad file unit test failed";
+  char          tmpfile[32] = "tmp-hmmerXXXXXX";
+  FILE         *fp          = NULL;
+  P7_SQREADER  *rdr         = NULL;
+  P7_WORKPOOL  *wp          = p7_workpool_Create(1, p7_workpool_SeqWeight);
+  ESL_THREADS  *obj         = NULL;
+  void         *b;
+  int           i;
+
+  if (esl_tmpfile_named(tmpfile, &fp) != eslOK) esl_fatal(msg);
+  for (i = 0; i < 100; i++) fprintf(fp, ">seq%d\nACDEFGHIKLMNPQRSTVWY\n", i);
+  fprintf(fp, ">bad\nACDEF!GHIK\n");
+  fclose(fp);
+
+  for (i = 0; i < 4; i++) p7_workpool_Init(wp, esl_sq_CreateDigitalBlock(10, abc));
+  if ((rdr = p7_sqreader_Create(tmpfile, abc, 2)) == NULL) esl_fatal(msg);
+  rdr->chunksize = 256;
+
+  p7_workpool_Reset(wp);
+  obj = esl_threads_Create(&drain_thread);
+  esl_threads_AddThread(obj, wp);
+  esl_threads_WaitForStart(obj);
+  if (p7_sqreader_Run(rdr, wp) != eslEFORMAT) esl_fatal(msg);
+  if (strstr(rdr->errbuf, "Illegal character") == NULL) esl_fatal(msg);
+  if (p7_workpool_ReaderDone(wp) != eslOK) esl_fatal(msg);
+  esl_threads_WaitForFinish(obj);
+  esl_threads_Destroy(obj);
+
+  p7_sqreader_Destroy(rdr);
+  p7_workpool_Reset(wp);
+  while (p7_workpool_Remove(wp, &b) == eslOK) esl_sq_DestroyBlock((ESL_SQ_BLOCK *) b);
+  p7_workpool_Destroy(wp);
+  remove(tmpfile);
+}
+#endif /*HMMER_THREADS*/
+#endif /*p7SQREADER_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 5. Test driver.
+ *****************************************************************/
+#ifdef p7SQREADER_TESTDRIVE
+/*
+  gcc -o p7_sqreader_utest -g -Wall -pthread -I. -L. -I../easel -L../easel -Dp7SQREADER_TESTDRIVE p7_sqreader.c -lhmmer -leasel -lm
+  ./p7_sqreader_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "p7_sqreader.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                            docgrp */
+  { "-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                0 },
+  { "-s",  eslARG_INT,      "0",  NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",      0 },
+  { "-N",  eslARG_INT,   "2000",  NULL, NULL, NULL, NULL, NULL, "number of sequences to read back",   0 },
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for parallel FASTA reader";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc = esl_alphabet_Create(eslAMINO);
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_readback(rng, abc, N, 1, 1,    4096);
+  utest_readback(rng, abc, N, 4, 3,    4096);
+  utest_readback(rng, abc, N, 3, 2,     100); /* chunks shorter than most records */
+  utest_readback(rng, abc, N, 2, 4,   65536);
+  utest_badfile(abc);
+
+  fprintf(stderr, "#  status = ok\n");
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(rng);
+#endif /*HMMER_THREADS*/
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7SQREADER_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
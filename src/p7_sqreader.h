@@ -0,0 +1,50 @@
+/* P7_SQREADER: parallel FASTA reader and digitizer for threaded searches.
+ * Used by hmmsearch, phmmer and jackhmmer.
+ */
+#ifndef P7_SQREADER_INCLUDED
+#define P7_SQREADER_INCLUDED
+
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_sqio.h"
+
+#include "p7_workpool.h"
+
+#define p7_SQREADER_CHUNKSIZE    (1024*1024) /* read the file in chunks of about 1MB                 */
+#define p7_SQREADER_CPUS_PER_THREAD  16	     /* one reader thread for every 16 worker threads, plus one */
+
+typedef struct p7_sqreader_s {
+  char               *filename;	/* FASTA file we're reading                          */
+  FILE               *fp;	/* our own open handle on it                         */
+  const ESL_ALPHABET *abc;	/* digital alphabet                                  */
+  ESL_DSQ             inmap[128]; /* FASTA input map: residue codes, or eslDSQ_IGNORED/ILLEGAL */
+  int                 nthreads;	/* number of reader threads, including the caller's  */
+  int64_t             chunksize;	/* bytes per fread(); a chunk grows to hold a whole record */
+
+  /* Shared by the reader threads during p7_sqreader_Run(), under <mutex>: */
+  P7_WORKPOOL        *wp;	/* pool the filled blocks go to                      */
+  char               *carry;	/* start of a record left over from the last chunk   */
+  int64_t             ncarry;
+  int64_t             carryalloc; /* allocated size of <carry>                       */
+  int                 is_eof;	/* TRUE once fread() has hit the end of the file     */
+  int                 status;	/* eslOK, or the first error a thread hit            */
+  int64_t             nseq;	/* number of sequences read in this pass             */
+  int64_t             nres;	/* number of residues read in this pass              */
+  pthread_mutex_t     mutex;
+  char                errbuf[eslERRBUFSIZE]; /* message for the first parse error    */
+} P7_SQREADER;
+
+extern int          p7_sqreader_IsUsable(ESL_SQFILE *sqfp);
+extern P7_SQREADER *p7_sqreader_Create  (const char *filename, const ESL_ALPHABET *abc, int nthreads);
+extern int          p7_sqreader_Run     (P7_SQREADER *rdr, P7_WORKPOOL *wp);
+extern void         p7_sqreader_Destroy (P7_SQREADER *rdr);
+
+#endif /*HMMER_THREADS*/
+#endif /*P7_SQREADER_INCLUDED*/
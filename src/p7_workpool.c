@@ -0,0 +1,1115 @@
+/* P7_WORKPOOL: a work-stealing pool of target blocks, for threaded searches.
+ *
+ * In a threaded search, one reader thread fills blocks of targets
+ * (sequences, in hmmsearch, phmmer and jackhmmer; profiles, in
+ * hmmscan) and hands them to the pool, and the worker threads take
+ * ranges of targets out of them. Each worker has a deque of ranges:
+ * it pops ranges from the bottom of its own deque, and when that's
+ * empty, steals from the top of someone else's. A worker that gets a
+ * range weighing more than its block's "grain" splits it in halves by
+ * weight (residues, or model nodes), keeps the first half, and pushes
+ * the rest where idle workers can steal it. So a block holding one
+ * huge target, or many that go all the way through the pipeline, is
+ * spread over the idle threads instead of serializing the tail of
+ * the search on one core, as it did when whole blocks of a fixed
+ * number of sequences went through an ESL_WORK_QUEUE.
+ *
+ * The reader's side of the API mimics ESL_WORK_QUEUE: the caller
+ * gives the pool its empty blocks once with p7_workpool_Init(); then,
+ * for each pass over the targets, calls p7_workpool_Reset(), and
+ * cycles blocks with p7_workpool_ReaderGet() and
+ * p7_workpool_ReaderPut() until p7_workpool_ReaderDone(). The pool
+ * never looks inside a block, except through the caller's <weight>
+ * function.
+ *
+ * Contents:
+ *    1. The P7_WORKPOOL object.
+ *    2. The reader's side.
+ *    3. The workers' side.
+ *    4. Internal functions.
+ *    5. Benchmark driver.
+ *    6. Unit tests.
+ *    7. Test driver.
+ */
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "easel.h"
+#include "esl_sq.h"
+
+#include "hmmer.h"
+#include "p7_workpool.h"
+
+static int  deque_push  (P7_WORKDEQUE *dq, const P7_WORKRANGE *rng);
+static int  deque_pop   (P7_WORKDEQUE *dq, P7_WORKRANGE *rng);
+static int  deque_steal (P7_WORKDEQUE *dq, P7_WORKRANGE *rng);
+static int  split_range (P7_WORKPOOL *wp, int w, P7_WORKRANGE *rng);
+static int  wake_worker (P7_WORKPOOL *wp);
+static int  any_queued  (P7_WORKPOOL *wp);
+
+
+/*****************************************************************
+ * 1. The P7_WORKPOOL object.
+ *****************************************************************/
+
+/* Function:  p7_workpool_Create()
+ * Synopsis:  Create a work-stealing pool for <nworkers> threads.
+ *
+ * Purpose:   Create a pool for <nworkers> worker threads, which will be
+ *            numbered <0..nworkers-1> in calls to
+ *            <p7_workpool_WorkerNext()> (the worker index that
+ *            <esl_threads_Started()> gives). <weight(blk, i)> returns
+ *            the cost of target <i> in block <blk>, in whatever units;
+ *            see <p7_workpool_SeqWeight()> and
+ *            <p7_workpool_ModelWeight()>.
+ *
+ *            The pool has no blocks yet; give it some with
+ *            <p7_workpool_Init()>.
+ *
+ * Returns:   a pointer to the new pool.
+ *
+ * Throws:    <NULL> on allocation or pthreads failure.
+ */
+P7_WORKPOOL *
+p7_workpool_Create(int nworkers, int64_t (*weight)(const void *blk, int i))
+{
+  P7_WORKPOOL *wp = NULL;
+  int          w;
+  int          status;
+
+  ESL_ALLOC(wp, sizeof(P7_WORKPOOL));
+  wp->nworkers = 0;
+  wp->dq       = NULL;
+  wp->bk       = NULL;
+  wp->freeq    = NULL;
+  wp->nblocks  = 0;
+  wp->balloc   = 0;
+  wp->fhead    = 0;
+  wp->nfree    = 0;
+  wp->nextw    = 0;
+  wp->nsplit   = p7_WORKPOOL_NSPLIT;
+  wp->weight   = weight;
+  wp->nidle    = 0;
+  wp->nout     = 0;
+  wp->is_done  = FALSE;
+
+  if (pthread_mutex_init(&wp->mutex,   NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init failed");
+  if (pthread_cond_init (&wp->work_cv, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init failed");
+  if (pthread_cond_init (&wp->free_cv, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_cond_init failed");
+
+  ESL_ALLOC(wp->dq, sizeof(P7_WORKDEQUE) * nworkers);
+  for (w = 0; w < nworkers; w++)
+    {
+      wp->dq[w].r      = NULL;
+      wp->dq[w].top    = 0;
+      wp->dq[w].n      = 0;
+      wp->dq[w].nalloc = 0;
+      wp->dq[w].ntaken = wp->dq[w].nstolen = wp->dq[w].nsplit = 0;
+      if (pthread_mutex_init(&wp->dq[w].mutex, NULL) != 0) ESL_XEXCEPTION(eslESYS, "pthread_mutex_init failed");
+      wp->nworkers++;		/* from here, Destroy() cleans it up */
+
+      ESL_ALLOC(wp->dq[w].r, sizeof(P7_WORKRANGE) * 16);
+      wp->dq[w].nalloc = 16;
+    }
+
+  wp->balloc = nworkers * 2;
+  ESL_ALLOC(wp->bk,    sizeof(P7_WORKBLOCK) * wp->balloc);
+  ESL_ALLOC(wp->freeq, sizeof(int)          * wp->balloc);
+  return wp;
+
+ ERROR:
+  p7_workpool_Destroy(wp);
+  return NULL;
+}
+
+
+/* Function:  p7_workpool_Init()
+ * Synopsis:  Give the pool an empty block.
+ *
+ * Purpose:   Add block <blk> to pool <wp>, as a free block for the
+ *            reader. The pool doesn't take ownership: the caller
+ *            frees its blocks after taking them back out with
+ *            <p7_workpool_Remove()>. Call this before any pass over
+ *            the targets starts. Two blocks per worker is usual.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ */
+int
+p7_workpool_Init(P7_WORKPOOL *wp, void *blk)
+{
+  int *newq = NULL;
+  int  i;
+  int  status;
+
+  if (wp->nblocks == wp->balloc)
+    {
+      /* linearize the circular free queue while we grow it */
+      ESL_ALLOC(newq, sizeof(int) * wp->balloc * 2);
+      for (i = 0; i < wp->nfree; i++) newq[i] = wp->freeq[(wp->fhead + i) % wp->balloc];
+      free(wp->freeq);
+      wp->freeq = newq;
+      wp->fhead = 0;
+      ESL_REALLOC(wp->bk, sizeof(P7_WORKBLOCK) * wp->balloc * 2);
+      wp->balloc *= 2;
+    }
+
+  wp->bk[wp->nblocks].blk       = blk;
+  wp->bk[wp->nblocks].n         = 0;
+  wp->bk[wp->nblocks].remaining = 0;
+  wp->bk[wp->nblocks].grain     = 0;
+  wp->freeq[(wp->fhead + wp->nfree) % wp->balloc] = wp->nblocks;
+  wp->nfree++;
+  wp->nblocks++;
+  return eslOK;
+
+ ERROR:
+  return status;
+}
+
+
+/* Function:  p7_workpool_Reset()
+ * Synopsis:  Prepare the pool for a new pass over the targets.
+ *
+ * Purpose:   Return all of <wp>'s blocks to its free queue, in the
+ *            order they were given with <p7_workpool_Init()>; empty
+ *            the deques; and clear the statistics. Call it when no
+ *            workers are running: at the start of each pass, and
+ *            before taking the blocks out with <p7_workpool_Remove()>.
+ *
+ * Returns:   <eslOK> on success.
+ */
+int
+p7_workpool_Reset(P7_WORKPOOL *wp)
+{
+  int b, w;
+
+  wp->fhead = 0;
+  wp->nfree = 0;
+  for (b = 0; b < wp->nblocks; b++)
+    if (wp->bk[b].blk != NULL) wp->freeq[wp->nfree++] = b;
+
+  for (w = 0; w < wp->nworkers; w++)
+    {
+      wp->dq[w].top     = 0;
+      wp->dq[w].n       = 0;
+      wp->dq[w].ntaken  = 0;
+      wp->dq[w].nstolen = 0;
+      wp->dq[w].nsplit  = 0;
+    }
+
+  wp->nextw   = 0;
+  wp->nidle   = 0;
+  wp->nout    = 0;
+  wp->is_done = FALSE;
+  return eslOK;
+}
+
+
+/* Function:  p7_workpool_Remove()
+ * Synopsis:  Take a block back out of the pool.
+ *
+ * Purpose:   Take the next free block out of <wp>, and return it in
+ *            <*ret_blk>, for the caller to free. Used at cleanup,
+ *            after <p7_workpool_Reset()>:
+ *            <while (p7_workpool_Remove(wp, &blk) == eslOK) free it>.
+ *
+ * Returns:   <eslOK> on success. <eslEOD> if there are no free
+ *            blocks left; <*ret_blk> is <NULL>.
+ */
+int
+p7_workpool_Remove(P7_WORKPOOL *wp, void **ret_blk)
+{
+  int b;
+
+  if (wp->nfree == 0) { *ret_blk = NULL; return eslEOD; }
+
+  b = wp->freeq[wp->fhead];
+  wp->fhead = (wp->fhead + 1) % wp->balloc;
+  wp->nfree--;
+
+  *ret_blk = wp->bk[b].blk;
+  wp->bk[b].blk = NULL;
+  return eslOK;
+}
+
+
+/* Function:  p7_workpool_Destroy()
+ * Synopsis:  Free a pool.
+ *
+ * Purpose:   Free pool <wp>. Its blocks belong to the caller, and
+ *            are not freed.
+ */
+void
+p7_workpool_Destroy(P7_WORKPOOL *wp)
+{
+  int w;
+
+  if (wp == NULL) return;
+
+  if (wp->dq)
+    {
+      for (w = 0; w < wp->nworkers; w++)
+	{
+	  pthread_mutex_destroy(&wp->dq[w].mutex);
+	  if (wp->dq[w].r) free(wp->dq[w].r);
+	}
+      free(wp->dq);
+    }
+  if (wp->bk)    free(wp->bk);
+  if (wp->freeq) free(wp->freeq);
+
+  pthread_cond_destroy (&wp->free_cv);
+  pthread_cond_destroy (&wp->work_cv);
+  pthread_mutex_destroy(&wp->mutex);
+  free(wp);
+}
+/*------------------- end, P7_WORKPOOL object -------------------*/
+
+
+
+/*****************************************************************
+ * 2. The reader's side.
+ *****************************************************************/
+
+/* Function:  p7_workpool_ReaderGet()
+ * Synopsis:  Get a free block to fill.
+ *
+ * Purpose:   Wait until <wp> has a free block, and return it in
+ *            <*ret_blk>. Free blocks come back in the order they were
+ *            freed: first those given by <p7_workpool_Init()>, then
+ *            blocks as the workers finish them.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> on pthreads failure.
+ */
+int
+p7_workpool_ReaderGet(P7_WORKPOOL *wp, void **ret_blk)
+{
+  int b;
+
+  if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+
+  while (wp->nfree == 0)
+    if (pthread_cond_wait(&wp->free_cv, &wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_wait failed");
+
+  b = wp->freeq[wp->fhead];
+  wp->fhead = (wp->fhead + 1) % wp->balloc;
+  wp->nfree--;
+
+  if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+
+  *ret_blk = wp->bk[b].blk;
+  return eslOK;
+}
+
+
+/* Function:  p7_workpool_ReaderPut()
+ * Synopsis:  Hand a filled block to the workers.
+ *
+ * Purpose:   Submit block <blk>, which the reader got from
+ *            <p7_workpool_ReaderGet()> and filled with <n> targets,
+ *            to the workers. The whole block goes on one worker's
+ *            deque, round robin; it is split up as workers take and
+ *            steal from it. Its grain is set so that, unless
+ *            <wp->nsplit> is 0, it can end up in about
+ *            <nworkers * nsplit> ranges of equal weight. If <n> is 0
+ *            (end of data, or a read error), the block goes straight
+ *            back to the free queue.
+ *
+ *            Several reader threads may share a pool (see
+ *            <P7_SQREADER>), each cycling its own blocks through
+ *            <p7_workpool_ReaderGet()> and <p7_workpool_ReaderPut()>;
+ *            the last of them to finish calls
+ *            <p7_workpool_ReaderDone()>.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslEINVAL> if <blk> isn't one of <wp>'s blocks.
+ *            <eslEMEM> on allocation failure.
+ *            <eslESYS> on pthreads failure.
+ */
+int
+p7_workpool_ReaderPut(P7_WORKPOOL *wp, void *blk, int n)
+{
+  P7_WORKRANGE rng;
+  int64_t      tot = 0;
+  int          b, i, w;
+  int          status;
+
+  for (b = 0; b < wp->nblocks; b++)
+    if (wp->bk[b].blk == blk) break;
+  if (b == wp->nblocks) ESL_EXCEPTION(eslEINVAL, "not a block of this pool");
+
+  if (n == 0)
+    {
+      if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      wp->freeq[(wp->fhead + wp->nfree) % wp->balloc] = b;
+      wp->nfree++;
+      if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+      return eslOK;
+    }
+
+  for (i = 0; i < n; i++) tot += (*wp->weight)(blk, i);
+  wp->bk[b].n         = n;
+  wp->bk[b].remaining = n;
+  wp->bk[b].grain     = (wp->nsplit ? ESL_MAX(1, tot / (wp->nworkers * wp->nsplit)) : INT64_MAX);
+
+  if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+  wp->nout++;
+  w         = wp->nextw;
+  wp->nextw = (wp->nextw + 1) % wp->nworkers;
+  if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+
+  rng.blk   = blk;
+  rng.slot  = b;
+  rng.start = 0;
+  rng.end   = n;
+  if ((status = deque_push(&wp->dq[w], &rng)) != eslOK) return status;
+
+  return wake_worker(wp);
+}
+
+
+/* Function:  p7_workpool_ReaderDone()
+ * Synopsis:  Tell the workers there are no more blocks; wait for them.
+ *
+ * Purpose:   The reader has submitted its last block. Wait until the
+ *            workers have finished all the submitted blocks. Workers
+ *            then get <eslEOD> from <p7_workpool_WorkerNext()>, and
+ *            the caller can wait for the threads to finish.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> on pthreads failure.
+ */
+int
+p7_workpool_ReaderDone(P7_WORKPOOL *wp)
+{
+  if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+
+  wp->is_done = TRUE;
+  if (pthread_cond_broadcast(&wp->work_cv) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_broadcast failed");
+  while (wp->nout > 0)
+    if (pthread_cond_wait(&wp->free_cv, &wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_wait failed");
+
+  if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return eslOK;
+}
+/*----------------- end, the reader's side ----------------------*/
+
+
+
+/*****************************************************************
+ * 3. The workers' side.
+ *****************************************************************/
+
+/* Function:  p7_workpool_WorkerNext()
+ * Synopsis:  Get the next range of targets for worker <w>.
+ *
+ * Purpose:   Get worker <w> its next range of targets, in <rng>: the
+ *            targets <rng->start..rng->end-1> of block <rng->blk>.
+ *            Take it from the bottom of <w>'s own deque if there's
+ *            anything there, else steal from the top of another
+ *            worker's; if the range weighs more than its block's
+ *            grain, split off all but about the grain's worth and
+ *            push the rest onto <w>'s deque. If there's nothing to
+ *            take anywhere, wait for the reader or the other workers
+ *            to make some.
+ *
+ *            When done with the range, the worker calls
+ *            <p7_workpool_WorkerDone()>.
+ *
+ * Returns:   <eslOK> on success.
+ *            <eslEOD> when the reader is done and all its blocks are
+ *            finished; the worker should exit.
+ *
+ * Throws:    <eslEMEM> on allocation failure.
+ *            <eslESYS> on pthreads failure.
+ */
+int
+p7_workpool_WorkerNext(P7_WORKPOOL *wp, int w, P7_WORKRANGE *rng)
+{
+  int v;
+  int status;
+
+  while (1)
+    {
+      if ((status = deque_pop(&wp->dq[w], rng)) == eslOK) break;
+      if (status != eslEOD) return status;
+
+      for (v = (w+1) % wp->nworkers; v != w; v = (v+1) % wp->nworkers)
+	if ((status = deque_steal(&wp->dq[v], rng)) != eslEOD) break;
+      if (status == eslOK) break;
+      if (status != eslEOD) return status;
+
+      /* Nothing anywhere: wait for more work, or the end. */
+      if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      while ((status = any_queued(wp)) == eslEOD)
+	{
+	  if (wp->is_done && wp->nout == 0)
+	    {
+	      if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+	      return eslEOD;
+	    }
+	  wp->nidle++;
+	  if (pthread_cond_wait(&wp->work_cv, &wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_wait failed");
+	  wp->nidle--;
+	}
+      if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+      if (status != eslOK) return status;
+    }
+
+  return split_range(wp, w, rng);
+}
+
+
+/* Function:  p7_workpool_WorkerDone()
+ * Synopsis:  Worker is finished with a range of targets.
+ *
+ * Purpose:   Tell <wp> that the targets in <rng> are done. When all of
+ *            a block's targets are done, the block goes back to the
+ *            reader's free queue.
+ *
+ * Returns:   <eslOK> on success.
+ *
+ * Throws:    <eslESYS> on pthreads failure.
+ */
+int
+p7_workpool_WorkerDone(P7_WORKPOOL *wp, const P7_WORKRANGE *rng)
+{
+  P7_WORKBLOCK *bk = &wp->bk[rng->slot];
+
+  if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+
+  bk->remaining -= rng->end - rng->start;
+  if (bk->remaining == 0)
+    {
+      wp->freeq[(wp->fhead + wp->nfree) % wp->balloc] = rng->slot;
+      wp->nfree++;
+      wp->nout--;
+      if (pthread_cond_signal(&wp->free_cv) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_signal failed");
+      if (wp->is_done && wp->nout == 0 && wp->nidle > 0)
+	if (pthread_cond_broadcast(&wp->work_cv) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_broadcast failed");
+    }
+
+  if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return eslOK;
+}
+
+
+/* Function:  p7_workpool_SeqWeight()
+ * Synopsis:  Weight of a target sequence: its length.
+ *
+ * Purpose:   <weight> function for pools of <ESL_SQ_BLOCK>s: the
+ *            weight of sequence <i> in <blk> is its length in
+ *            residues, or 1 if it's empty.
+ */
+int64_t
+p7_workpool_SeqWeight(const void *blk, int i)
+{
+  return ESL_MAX(1, ((const ESL_SQ_BLOCK *) blk)->list[i].n);
+}
+
+
+/* Function:  p7_workpool_ModelWeight()
+ * Synopsis:  Weight of a target profile: its length.
+ *
+ * Purpose:   <weight> function for pools of <P7_OM_BLOCK>s: the
+ *            weight of profile <i> in <blk> is its number of nodes.
+ */
+int64_t
+p7_workpool_ModelWeight(const void *blk, int i)
+{
+  return ESL_MAX(1, ((const P7_OM_BLOCK *) blk)->list[i]->M);
+}
+/*----------------- end, the workers' side ----------------------*/
+
+
+
+/*****************************************************************
+ * 4. Internal functions.
+ *****************************************************************/
+
+/* deque_push()
+ * Push range <rng> onto the bottom of deque <dq>, growing it if
+ * needed.
+ */
+static int
+deque_push(P7_WORKDEQUE *dq, const P7_WORKRANGE *rng)
+{
+  P7_WORKRANGE *newr = NULL;
+  int           i;
+  int           status;
+
+  if (pthread_mutex_lock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+
+  if (dq->n == dq->nalloc)
+    {
+      ESL_ALLOC(newr, sizeof(P7_WORKRANGE) * dq->nalloc * 2);
+      for (i = 0; i < dq->n; i++) newr[i] = dq->r[(dq->top + i) % dq->nalloc];
+      free(dq->r);
+      dq->r       = newr;
+      dq->top     = 0;
+      dq->nalloc *= 2;
+    }
+  dq->r[(dq->top + dq->n) % dq->nalloc] = *rng;
+  dq->n++;
+
+  if (pthread_mutex_unlock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return eslOK;
+
+ ERROR:
+  pthread_mutex_unlock(&dq->mutex);
+  return status;
+}
+
+
+/* deque_pop()
+ * Owner pops the bottom (newest) range of its deque <dq> into <rng>.
+ * Returns <eslEOD> if the deque is empty.
+ */
+static int
+deque_pop(P7_WORKDEQUE *dq, P7_WORKRANGE *rng)
+{
+  int status = eslEOD;
+
+  if (pthread_mutex_lock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+  if (dq->n > 0)
+    {
+      *rng = dq->r[(dq->top + dq->n - 1) % dq->nalloc];
+      dq->n--;
+      dq->ntaken++;
+      status = eslOK;
+    }
+  if (pthread_mutex_unlock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return status;
+}
+
+
+/* deque_steal()
+ * A thief takes the top (oldest, and usually biggest) range of
+ * someone else's deque <dq> into <rng>. Returns <eslEOD> if the deque
+ * is empty.
+ */
+static int
+deque_steal(P7_WORKDEQUE *dq, P7_WORKRANGE *rng)
+{
+  int status = eslEOD;
+
+  if (pthread_mutex_lock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+  if (dq->n > 0)
+    {
+      *rng    = dq->r[dq->top];
+      dq->top = (dq->top + 1) % dq->nalloc;
+      dq->n--;
+      dq->nstolen++;
+      status = eslOK;
+    }
+  if (pthread_mutex_unlock(&dq->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return status;
+}
+
+
+/* split_range()
+ * Worker <w> has range <rng>. While it has more than one target and
+ * weighs more than its block's grain, cut it in two halves of about
+ * equal weight, push the second half onto <w>'s deque, and keep the
+ * first. The pushed halves get smaller as we go, so thieves, taking
+ * from the top, get the biggest first.
+ */
+static int
+split_range(P7_WORKPOOL *wp, int w, P7_WORKRANGE *rng)
+{
+  P7_WORKBLOCK *bk  = &wp->bk[rng->slot];
+  P7_WORKRANGE  rest;
+  int64_t       tot = 0;
+  int64_t       acc;
+  int           i, m;
+  int           status;
+
+  if (rng->end - rng->start < 2) return eslOK;
+
+  for (i = rng->start; i < rng->end; i++) tot += (*wp->weight)(rng->blk, i);
+  while (rng->end - rng->start > 1 && tot > bk->grain)
+    {
+      acc = 0;
+      m   = rng->start;
+      do { acc += (*wp->weight)(rng->blk, m); m++; } while (m < rng->end-1 && acc < tot/2);
+
+      rest       = *rng;
+      rest.start = m;
+      if ((status = deque_push(&wp->dq[w], &rest)) != eslOK) return status;
+      wp->dq[w].nsplit++;	/* only the owner writes this */
+      if ((status = wake_worker(wp))              != eslOK) return status;
+
+      rng->end = m;
+      tot      = acc;
+    }
+  return eslOK;
+}
+
+
+/* wake_worker()
+ * Something was just pushed; if any worker is idle, wake one.
+ */
+static int
+wake_worker(P7_WORKPOOL *wp)
+{
+  if (pthread_mutex_lock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+  if (wp->nidle > 0 && pthread_cond_signal(&wp->work_cv) != 0) ESL_EXCEPTION(eslESYS, "pthread_cond_signal failed");
+  if (pthread_mutex_unlock(&wp->mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+  return eslOK;
+}
+
+
+/* any_queued()
+ * Returns <eslOK> if any deque has a range in it, <eslEOD> if not.
+ * Caller holds <wp->mutex>, so that a push, which signals under
+ * that mutex after it's done, can't slip in between this check and
+ * the caller's wait.
+ */
+static int
+any_queued(P7_WORKPOOL *wp)
+{
+  int w, n;
+
+  for (w = 0; w < wp->nworkers; w++)
+    {
+      if (pthread_mutex_lock(&wp->dq[w].mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_lock failed");
+      n = wp->dq[w].n;
+      if (pthread_mutex_unlock(&wp->dq[w].mutex) != 0) ESL_EXCEPTION(eslESYS, "pthread_mutex_unlock failed");
+      if (n > 0) return eslOK;
+    }
+  return eslEOD;
+}
+/*------------------ end, internal functions --------------------*/
+#endif /*HMMER_THREADS*/
+
+
+
+/*****************************************************************
+ * 5. Benchmark driver.
+ *****************************************************************/
+#ifdef p7WORKPOOL_BENCHMARK
+/*
+   ./p7_workpool_benchmark --cpu 64
+   ./p7_workpool_benchmark --cpu 64 --nosplit      (whole blocks only, like the old work queue)
+
+   Searches a sampled profile against a synthetic database of random
+   sequences, with the hard part at the end: --nhom sequences emitted
+   from the profile, which go all the way through the pipeline, and
+   one long random sequence of length --big. Runs the same search
+   with 1, 2, 4... up to --cpu worker threads, and reports wall clock
+   time, speedup and efficiency relative to one thread.
+ */
+#include <p7_config.h>
+
+#include <stdio.h>
+
+#include "easel.h"
+#include "esl_alphabet.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+#include "esl_randomseq.h"
+#include "esl_sq.h"
+#include "esl_stopwatch.h"
+#ifdef HMMER_THREADS
+#include "esl_threads.h"
+#endif
+
+#include "hmmer.h"
+#include "p7_workpool.h"
+
+static ESL_OPTIONS options[] = {
+  /* name           type      default  env  range toggles reqs incomp  help                                       docgroup*/
+  { "-h",        eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "show brief help on version and usage",             0 },
+  { "-s",        eslARG_INT,     "42", NULL, NULL,  NULL,  NULL, NULL, "set random number seed to <n>",                    0 },
+  { "-L",        eslARG_INT,    "400", NULL, "n>0", NULL,  NULL, NULL, "length of random target seqs",                     0 },
+  { "-M",        eslARG_INT,    "200", NULL, "n>0", NULL,  NULL, NULL, "length of sampled query profile",                  0 },
+  { "-N",        eslARG_INT, "100000", NULL, "n>0", NULL,  NULL, NULL, "number of random target seqs",                     0 },
+  { "--big",     eslARG_INT, "200000", NULL,"n>=0", NULL,  NULL, NULL, "length of one long random seq at the end; 0=none", 0 },
+  { "--nhom",    eslARG_INT,   "2000", NULL,"n>=0", NULL,  NULL, NULL, "number of homologous seqs at the end",             0 },
+  { "--cpu",     eslARG_INT,     NULL, NULL, "n>0", NULL,  NULL, NULL, "maximum number of threads [default: all cores]",  0 },
+  { "--nosplit", eslARG_NONE,   FALSE, NULL, NULL,  NULL,  NULL, NULL, "don't split blocks; only steal whole blocks",      0 },
+  {  0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+};
+static char usage[]  = "[-options]";
+static char banner[] = "benchmark driver for work-stealing thread pool: --cpu scaling";
+
+#ifdef HMMER_THREADS
+typedef struct {
+  P7_WORKPOOL *wp;
+  P7_OPROFILE *om;
+  P7_BG       *bg;
+  P7_PIPELINE *pli;
+  P7_TOPHITS  *th;
+} BENCH_INFO;
+
+static void
+bench_thread(void *arg)
+{
+  ESL_THREADS  *obj = (ESL_THREADS *) arg;
+  BENCH_INFO   *info;
+  ESL_SQ_BLOCK *block;
+  P7_WORKRANGE  rng;
+  int           workeridx;
+  int           i;
+  int           status;
+
+  impl_Init();
+  esl_threads_Started(obj, &workeridx);
+  info = (BENCH_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_workpool_WorkerNext(info->wp, workeridx, &rng)) == eslOK)
+    {
+      block = (ESL_SQ_BLOCK *) rng.blk;
+      for (i = rng.start; i < rng.end; i++)
+	{
+	  p7_pli_NewSeq(info->pli, block->list + i);
+	  p7_bg_SetLength(info->bg, block->list[i].n);
+	  p7_oprofile_ReconfigLength(info->om, block->list[i].n);
+	  p7_Pipeline(info->pli, info->om, info->bg, block->list + i, NULL, info->th);
+	  p7_pipeline_Reuse(info->pli);
+	}
+      if (p7_workpool_WorkerDone(info->wp, &rng) != eslOK) p7_Fail("work pool worker failed");
+    }
+  if (status != eslEOD) p7_Fail("work pool worker failed");
+
+  esl_threads_Finished(obj, workeridx);
+}
+#endif /*HMMER_THREADS*/
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go      = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  ESL_RANDOMNESS *r       = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  ESL_ALPHABET   *abc     = esl_alphabet_Create(eslAMINO);
+  ESL_STOPWATCH  *w       = esl_stopwatch_Create();
+  P7_BG          *bg      = p7_bg_Create(abc);
+  P7_HMM         *hmm     = NULL;
+  P7_PROFILE     *gm      = NULL;
+  P7_OPROFILE    *om      = NULL;
+  int             L       = esl_opt_GetInteger(go, "-L");
+  int             M       = esl_opt_GetInteger(go, "-M");
+  int             N       = esl_opt_GetInteger(go, "-N");
+  int             nhom    = esl_opt_GetInteger(go, "--nhom");
+  int             biglen  = esl_opt_GetInteger(go, "--big");
+  int             maxcpu  = (esl_opt_IsOn(go, "--cpu") ? esl_opt_GetInteger(go, "--cpu") : esl_threads_GetCPUCount());
+  int             nseq    = N + nhom + (biglen > 0 ? 1 : 0);
+  int             bsize   = 1000;
+  int             nblk    = (nseq + bsize - 1) / bsize;
+  ESL_SQ_BLOCK  **blk     = malloc(sizeof(ESL_SQ_BLOCK *) * nblk);
+  BENCH_INFO     *info    = malloc(sizeof(BENCH_INFO) * maxcpu);
+  ESL_THREADS    *obj     = NULL;
+  P7_WORKPOOL    *wp      = NULL;
+  ESL_SQ         *sq;
+  void           *b;
+  double          t1      = 0.;
+  int64_t         nsteals, nsplits;
+  int             ncpu, i, n;
+
+  impl_Init();
+  p7_FLogsumInit();
+  if (p7_oprofile_Sample(r, abc, bg, M, L, &hmm, &gm, &om) != eslOK) p7_Fail("failed to sample a profile");
+
+  /* the database: N random seqs, then the homologs, then the long one */
+  for (i = 0; i < nblk; i++) blk[i] = esl_sq_CreateDigitalBlock(bsize, abc);
+  for (n = 0; n < nseq; n++)
+    {
+      sq = blk[n/bsize]->list + (n % bsize);
+      if (n < N || n == N + nhom)
+	{
+	  i = (n < N ? L : biglen);
+	  esl_sq_GrowTo(sq, i);
+	  esl_rsq_xfIID(r, bg->f, abc->K, i, sq->dsq);
+	  sq->n = i;
+	}
+      else p7_ProfileEmit(r, hmm, gm, bg, sq, NULL);
+      esl_sq_FormatName(sq, "seq%d", n);
+      blk[n/bsize]->count++;
+    }
+
+  printf("# %d random seqs of length %d, then %d homologs, then one of length %d; M = %d\n", N, L, nhom, biglen, M);
+  printf("# %4s %10s %8s %8s %10s %10s\n", "ncpu", "wall (s)", "speedup", "effic", "steals", "splits");
+  printf("# %4s %10s %8s %8s %10s %10s\n", "----", "----------", "--------", "--------", "----------", "----------");
+
+  for (ncpu = 1; ncpu <= maxcpu; ncpu = (ncpu < maxcpu && ncpu*2 > maxcpu) ? maxcpu : ncpu*2)
+    {
+      wp = p7_workpool_Create(ncpu, p7_workpool_SeqWeight);
+      if (esl_opt_GetBoolean(go, "--nosplit")) wp->nsplit = 0;
+      for (i = 0; i < nblk; i++) p7_workpool_Init(wp, blk[i]);
+      p7_workpool_Reset(wp);
+
+      obj = esl_threads_Create(&bench_thread);
+      for (i = 0; i < ncpu; i++)
+	{
+	  info[i].wp  = wp;
+	  info[i].om  = p7_oprofile_Clone(om);
+	  info[i].bg  = p7_bg_Create(abc);
+	  info[i].th  = p7_tophits_Create();
+	  info[i].pli = p7_pipeline_Create(NULL, M, L, FALSE, p7_SEARCH_SEQS);
+	  p7_pli_NewModel(info[i].pli, info[i].om, info[i].bg);
+	}
+
+      esl_stopwatch_Start(w);
+      for (i = 0; i < ncpu; i++) esl_threads_AddThread(obj, &info[i]);
+      esl_threads_WaitForStart(obj);
+      for (i = 0; i < nblk; i++)
+	{
+	  if (p7_workpool_ReaderGet(wp, &b)                                   != eslOK) p7_Fail("reader failed");
+	  if (p7_workpool_ReaderPut(wp, b, ((ESL_SQ_BLOCK *) b)->count)      != eslOK) p7_Fail("reader failed");
+	}
+      if (p7_workpool_ReaderDone(wp) != eslOK) p7_Fail("reader failed");
+      esl_threads_WaitForFinish(obj);
+      esl_stopwatch_Stop(w);
+
+      if (ncpu == 1) t1 = w->elapsed;
+      for (nsteals = nsplits = 0, i = 0; i < ncpu; i++) { nsteals += wp->dq[i].nstolen; nsplits += wp->dq[i].nsplit; }
+      printf("  %4d %10.2f %8.2f %8.2f %10" PRId64 " %10" PRId64 "\n",
+	     ncpu, w->elapsed, t1 / w->elapsed, t1 / w->elapsed / ncpu, nsteals, nsplits);
+
+      for (i = 0; i < ncpu; i++)
+	{
+	  p7_pipeline_Destroy(info[i].pli);
+	  p7_tophits_Destroy(info[i].th);
+	  p7_bg_Destroy(info[i].bg);
+	  p7_oprofile_Destroy(info[i].om);
+	}
+      esl_threads_Destroy(obj);
+      p7_workpool_Reset(wp);
+      while (p7_workpool_Remove(wp, &b) == eslOK) ;
+      p7_workpool_Destroy(wp);
+      if (ncpu == maxcpu) break;
+    }
+
+  for (i = 0; i < nblk; i++) esl_sq_DestroyBlock(blk[i]);
+  free(blk);
+  free(info);
+  p7_oprofile_Destroy(om);
+  p7_profile_Destroy(gm);
+  p7_hmm_Destroy(hmm);
+  p7_bg_Destroy(bg);
+  esl_stopwatch_Destroy(w);
+  esl_alphabet_Destroy(abc);
+  esl_randomness_Destroy(r);
+#else
+  printf("# HMMER was built without threads: nothing to benchmark\n");
+#endif /*HMMER_THREADS*/
+  esl_getopts_Destroy(go);
+  return 0;
+}
+#endif /*p7WORKPOOL_BENCHMARK*/
+/*------------------ end, benchmark driver ----------------------*/
+
+
+
+/*****************************************************************
+ * 6. Unit tests.
+ *****************************************************************/
+#ifdef p7WORKPOOL_TESTDRIVE
+#ifdef HMMER_THREADS
+#include "esl_random.h"
+#include "esl_threads.h"
+
+/* A test block: <n> targets with weights <len[i]>; workers count
+ * how many times each is processed in <seen[i]>.
+ */
+typedef struct {
+  int  n;
+  int *len;
+  int *seen;
+} TEST_BLOCK;
+
+typedef struct {
+  P7_WORKPOOL *wp;
+  int64_t      nproc;		/* targets processed by this worker */
+} TEST_INFO;
+
+static int64_t
+test_weight(const void *blk, int i)
+{
+  return ((const TEST_BLOCK *) blk)->len[i];
+}
+
+static void
+test_thread(void *arg)
+{
+  ESL_THREADS  *obj = (ESL_THREADS *) arg;
+  TEST_INFO    *info;
+  TEST_BLOCK   *tb;
+  P7_WORKRANGE  rng;
+  volatile int  x = 0;
+  int           workeridx;
+  int           i, j;
+  int           status;
+
+  esl_threads_Started(obj, &workeridx);
+  info = (TEST_INFO *) esl_threads_GetData(obj, workeridx);
+
+  while ((status = p7_workpool_WorkerNext(info->wp, workeridx, &rng)) == eslOK)
+    {
+      tb = (TEST_BLOCK *) rng.blk;
+      if (rng.start < 0 || rng.end > tb->n || rng.start >= rng.end) esl_fatal("bad range");
+      for (i = rng.start; i < rng.end; i++)
+	{
+	  for (j = 0; j < tb->len[i]; j++) x++; /* busy work, in proportion to weight */
+	  tb->seen[i]++;
+	  info->nproc++;
+	}
+      if (p7_workpool_WorkerDone(info->wp, &rng) != eslOK) esl_fatal("WorkerDone failed");
+    }
+  if (status != eslEOD) esl_fatal("WorkerNext failed");
+  esl_threads_Finished(obj, workeridx);
+}
+
+/* Run <npass> passes over <ntot> skewed targets in blocks of up to
+ * <bsize>, with <nworkers> threads and <nblocks> blocks cycling
+ * through the pool; every target must be processed exactly once per
+ * pass, and the reader must get all its blocks back.
+ */
+static void
+utest_exactly_once(ESL_RANDOMNESS *rng, int nworkers, int nblocks, int nsplit, int bsize, int ntot, int npass)
+{
+  char         msg[] = "work pool exactly-once unit test failed";
+  P7_WORKPOOL *wp    = p7_workpool_Create(nworkers, test_weight);
+  TEST_BLOCK  *tb    = malloc(sizeof(TEST_BLOCK) * nblocks);
+  TEST_INFO   *info  = malloc(sizeof(TEST_INFO)  * nworkers);
+  int         *len   = malloc(sizeof(int) * ntot);
+  int         *seen  = malloc(sizeof(int) * ntot);
+  ESL_THREADS *obj   = NULL;
+  TEST_BLOCK  *blk;
+  void        *b;
+  int64_t      nproc;
+  int          next, pass, i, n;
+
+  if (wp == NULL) esl_fatal(msg);
+  wp->nsplit = nsplit;
+
+  /* mostly small, some huge: the tail case */
+  for (i = 0; i < ntot; i++)
+    len[i] = (esl_rnd_Roll(rng, 100) == 0 ? 1000 + esl_rnd_Roll(rng, 100000) : 1 + esl_rnd_Roll(rng, 100));
+
+  for (i = 0; i < nblocks; i++)
+    {
+      tb[i].n = 0;
+      if (p7_workpool_Init(wp, &tb[i]) != eslOK) esl_fatal(msg);
+    }
+
+  for (pass = 0; pass < npass; pass++)
+    {
+      for (i = 0; i < ntot; i++) seen[i] = 0;
+      p7_workpool_Reset(wp);
+
+      obj = esl_threads_Create(&test_thread);
+      for (i = 0; i < nworkers; i++)
+	{
+	  info[i].wp    = wp;
+	  info[i].nproc = 0;
+	  esl_threads_AddThread(obj, &info[i]);
+	}
+      esl_threads_WaitForStart(obj);
+
+      for (next = 0; next <= ntot; next += n)
+	{
+	  if (p7_workpool_ReaderGet(wp, &b) != eslOK) esl_fatal(msg);
+	  blk       = (TEST_BLOCK *) b;
+	  n         = 1 + esl_rnd_Roll(rng, bsize);
+	  n         = ESL_MIN(n, ntot - next);
+	  blk->n    = n;
+	  blk->len  = len  + next;
+	  blk->seen = seen + next;
+	  if (p7_workpool_ReaderPut(wp, blk, n) != eslOK) esl_fatal(msg);
+	  if (n == 0) break;
+	}
+      if (p7_workpool_ReaderDone(wp) != eslOK) esl_fatal(msg);
+      esl_threads_WaitForFinish(obj);
+      esl_threads_Destroy(obj);
+
+      for (i = 0; i < ntot; i++)
+	if (seen[i] != 1) esl_fatal(msg);
+      for (nproc = 0, i = 0; i < nworkers; i++) nproc += info[i].nproc;
+      if (nproc != ntot)       esl_fatal(msg);
+      if (wp->nfree != nblocks) esl_fatal(msg);
+      if (wp->nout  != 0)       esl_fatal(msg);
+      if (nsplit == 0)
+	for (i = 0; i < nworkers; i++)
+	  if (wp->dq[i].nsplit != 0) esl_fatal(msg);
+    }
+
+  p7_workpool_Reset(wp);
+  for (n = 0; p7_workpool_Remove(wp, &b) == eslOK; n++) ;
+  if (n != nblocks) esl_fatal(msg);
+
+  p7_workpool_Destroy(wp);
+  free(tb);
+  free(info);
+  free(len);
+  free(seen);
+}
+#endif /*HMMER_THREADS*/
+#endif /*p7WORKPOOL_TESTDRIVE*/
+/*-------------------- end, unit tests --------------------------*/
+
+
+
+/*****************************************************************
+ * 7. Test driver.
+ *****************************************************************/
+#ifdef p7WORKPOOL_TESTDRIVE
+/*
+  gcc -o p7_workpool_utest -g -Wall -pthread -I. -L. -I../easel -L../easel -Dp7WORKPOOL_TESTDRIVE p7_workpool.c -lhmmer -leasel -lm
+  ./p7_workpool_utest
+ */
+#include <p7_config.h>
+
+#include "easel.h"
+#include "esl_getopts.h"
+#include "esl_random.h"
+
+#include "hmmer.h"
+#include "p7_workpool.h"
+
+static ESL_OPTIONS options[] = {
+  /* name  type         default  env   range togs  reqs  incomp  help                            docgrp */
+  { "-h",  eslARG_NONE,    FALSE, NULL, NULL, NULL, NULL, NULL, "show help and usage",                0 },
+  { "-s",  eslARG_INT,      "0",  NULL, NULL, NULL, NULL, NULL, "set random number seed to <n>",      0 },
+  { "-N",  eslARG_INT,  "20000",  NULL, NULL, NULL, NULL, NULL, "number of targets per pass",         0 },
+  { 0,0,0,0,0,0,0,0,0,0},
+};
+static char usage[]  = "[-options]";
+static char banner[] = "test driver for work-stealing thread pool";
+
+int
+main(int argc, char **argv)
+{
+  ESL_GETOPTS    *go  = p7_CreateDefaultApp(options, 0, argc, argv, banner, usage);
+#ifdef HMMER_THREADS
+  ESL_RANDOMNESS *rng = esl_randomness_CreateFast(esl_opt_GetInteger(go, "-s"));
+  int             N   = esl_opt_GetInteger(go, "-N");
+
+  fprintf(stderr, "## %s\n", argv[0]);
+  fprintf(stderr, "#  rng seed = %" PRIu32 "\n", esl_randomness_GetSeed(rng));
+
+  utest_exactly_once(rng, 1, 2,  p7_WORKPOOL_NSPLIT, 1000, N, 2);
+  utest_exactly_once(rng, 4, 8,  p7_WORKPOOL_NSPLIT, 1000, N, 3);
+  utest_exactly_once(rng, 4, 8,  0,                  1000, N, 2);
+  utest_exactly_once(rng, 8, 2,  p7_WORKPOOL_NSPLIT,   50, N, 2);  /* fewer blocks than workers */
+  utest_exactly_once(rng, 3, 6,  p7_WORKPOOL_NSPLIT,    1, 500, 2); /* one target per block      */
+
+  fprintf(stderr, "#  status = ok\n");
+  esl_randomness_Destroy(rng);
+#endif /*HMMER_THREADS*/
+  esl_getopts_Destroy(go);
+  return eslOK;
+}
+#endif /*p7WORKPOOL_TESTDRIVE*/
+/*-------------------- end, test driver -------------------------*/
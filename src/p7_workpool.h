@@ -0,0 +1,86 @@
+/* P7_WORKPOOL: a work-stealing pool of target blocks, for threaded searches.
+ * Used by hmmsearch, phmmer, jackhmmer and hmmscan.
+ */
+#ifndef P7_WORKPOOL_INCLUDED
+#define P7_WORKPOOL_INCLUDED
+
+#include <p7_config.h>
+
+#ifdef HMMER_THREADS
+#include <stdint.h>
+#include <pthread.h>
+
+#define p7_WORKPOOL_NSPLIT 4	/* by default, split each block into about 4 ranges per worker */
+
+/* A range of targets [start..end-1] in one of the pool's blocks. */
+typedef struct {
+  void *blk;			/* the block                                    */
+  int   slot;			/* its index in the pool's <bk> array           */
+  int   start;			/* first target in the range, 0..n-1            */
+  int   end;			/* one past the last target                     */
+} P7_WORKRANGE;
+
+/* One worker's deque of ranges. The owner pushes and pops at the
+ * bottom; thieves steal from the top, where the older, bigger ranges
+ * are.
+ */
+typedef struct {
+  P7_WORKRANGE   *r;		/* circular array of ranges                     */
+  int             top;		/* index in <r> of the top (oldest) range       */
+  int             n;		/* number of ranges in the deque                */
+  int             nalloc;	/* allocated size of <r>                        */
+  int64_t         ntaken;	/* statistics: ranges the owner popped          */
+  int64_t         nstolen;	/*   ranges other workers stole from here       */
+  int64_t         nsplit;	/*   ranges the owner split off and pushed      */
+  pthread_mutex_t mutex;
+} P7_WORKDEQUE;
+
+/* One of the pool's blocks. */
+typedef struct {
+  void    *blk;			/* the caller's block (ESL_SQ_BLOCK, P7_OM_BLOCK...); NULL if removed */
+  int      n;			/* number of targets in it, as submitted        */
+  int      remaining;		/* number of targets not done yet               */
+  int64_t  grain;		/* ranges weighing more than this get split     */
+} P7_WORKBLOCK;
+
+typedef struct p7_workpool_s {
+  int             nworkers;	/* number of worker threads, deques             */
+  P7_WORKDEQUE   *dq;		/* [0..nworkers-1]                              */
+
+  P7_WORKBLOCK   *bk;		/* [0..nblocks-1] blocks given by _Init()       */
+  int             nblocks;
+  int             balloc;	/* allocated size of <bk>, <freeq>              */
+  int            *freeq;	/* FIFO of free block slots, circular           */
+  int             fhead;	/* index in <freeq> of the first free slot      */
+  int             nfree;	/* number of free slots                         */
+
+  int             nextw;	/* deque that _ReaderPut() gives the next block */
+  int             nsplit;	/* split blocks into ~ nworkers*nsplit ranges; 0 = don't split */
+  int64_t       (*weight)(const void *blk, int i); /* cost of target <i> in <blk>, e.g. its length */
+
+  pthread_mutex_t mutex;	/* guards block accounting and idling, below    */
+  pthread_cond_t  work_cv;	/* idle workers wait here for work, or the end  */
+  pthread_cond_t  free_cv;	/* the reader waits here for a free block       */
+  int             nidle;	/* number of workers waiting on <work_cv>       */
+  int             nout;		/* number of blocks submitted and not finished  */
+  int             is_done;	/* TRUE once the reader has no more blocks      */
+} P7_WORKPOOL;
+
+extern P7_WORKPOOL *p7_workpool_Create (int nworkers, int64_t (*weight)(const void *blk, int i));
+extern int          p7_workpool_Init   (P7_WORKPOOL *wp, void *blk);
+extern int          p7_workpool_Reset  (P7_WORKPOOL *wp);
+extern int          p7_workpool_Remove (P7_WORKPOOL *wp, void **ret_blk);
+extern void         p7_workpool_Destroy(P7_WORKPOOL *wp);
+
+extern int          p7_workpool_ReaderGet (P7_WORKPOOL *wp, void **ret_blk);
+extern int          p7_workpool_ReaderPut (P7_WORKPOOL *wp, void *blk, int n);
+extern int          p7_workpool_ReaderDone(P7_WORKPOOL *wp);
+
+extern int          p7_workpool_WorkerNext(P7_WORKPOOL *wp, int w, P7_WORKRANGE *rng);
+extern int          p7_workpool_WorkerDone(P7_WORKPOOL *wp, const P7_WORKRANGE *rng);
+
+extern int64_t      p7_workpool_SeqWeight  (const void *blk, int i);
+extern int64_t      p7_workpool_ModelWeight(const void *blk, int i);
+
+#endif /*HMMER_THREADS*/
+#endif /*P7_WORKPOOL_INCLUDED*/
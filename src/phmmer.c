@@ -25,14 +25,17 @@
 #ifdef HMMER_THREADS
 #include <unistd.h>
 #include "esl_threads.h"
-#include "esl_workqueue.h"
 #endif
 
 #include "hmmer.h"
+#ifdef HMMER_THREADS
+#include "p7_sqreader.h"
+#include "p7_workpool.h"
+#endif
 
 typedef struct {
 #ifdef HMMER_THREADS
-  ESL_WORK_QUEUE   *queue;
+  P7_WORKPOOL      *pool;
 #endif
   P7_BG            *bg;
   P7_PIPELINE      *pli;
@@ -92,6 +95,17 @@ static ESL_OPTIONS options[] = {
   { "--F2",         eslARG_REAL,       "1e-3", NULL, NULL,      NULL,  NULL, "--max",            "Stage 2 (Vit) threshold: promote hits w/ P <= F2",             7 },
   { "--F3",         eslARG_REAL,       "1e-5", NULL, NULL,      NULL,  NULL, "--max",            "Stage 3 (Fwd) threshold: promote hits w/ P <= F3",             7 },
   { "--nobias",     eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL, "--max",            "turn off composition bias filter",                             7 },
+#if defined (eslENABLE_SSE)
+/* Control of FM pruning/extension, for a makehmmerdb target */
+  { "--seed_max_depth",    eslARG_INT,          "15", NULL, NULL,    NULL,  NULL, NULL,          "seed length at which bit threshold must be met",             9 },
+  { "--seed_sc_thresh",    eslARG_REAL,         "14", NULL, NULL,    NULL,  NULL, NULL,          "Default req. score for FM seed (bits)",                      9 },
+  { "--seed_sc_density",   eslARG_REAL,       "0.75", NULL, NULL,    NULL,  NULL, NULL,          "seed must maintain this bit density from one of two ends",   9 },
+  { "--seed_drop_max_len", eslARG_INT,           "4", NULL, NULL,    NULL,  NULL, NULL,          "maximum run length with score under (max - [fm_drop_lim])",  9 },
+  { "--seed_drop_lim",     eslARG_REAL,        "0.3", NULL, NULL,    NULL,  NULL, NULL,          "in seed, max drop in a run of length [fm_drop_max_len]",     9 },
+  { "--seed_req_pos",      eslARG_INT,           "5", NULL, NULL,    NULL,  NULL, NULL,          "minimum number consecutive positive scores in seed" ,        9 },
+  { "--seed_consens_match", eslARG_INT,         "11", NULL, NULL,    NULL,  NULL, NULL,          "<n> consecutive matches to consensus will override score threshold" , 9 },
+  { "--seed_ssv_length",   eslARG_INT,         "100", NULL, NULL,    NULL,  NULL, NULL,          "length of window around FM seed to get full SSV diagonal",   9 },
+#endif
 /* Control of E-value calibration */
   { "--EmL",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "length of sequences for MSV Gumbel mu fit",                   11 },   
   { "--EmN",        eslARG_INT,         "200", NULL,"n>0",      NULL,  NULL,  NULL,              "number of sequences for MSV Gumbel mu fit",                   11 },   
@@ -102,6 +116,7 @@ static ESL_OPTIONS options[] = {
   { "--Eft",        eslARG_REAL,       "0.04", NULL,"0<x<1",    NULL,  NULL,  NULL,              "tail mass for Forward exponential tail tau fit",              11 },   
 /* other options */
   { "--nonull2",    eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL,  NULL,              "turn off biased composition score corrections",               12 },
+  { "--bands",      eslARG_NONE,        NULL,  NULL, NULL,      NULL,  NULL, "--max",            "decode domains inside their posterior bands",                 12 },
   { "-Z",           eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of comparisons done, for E-value calculation",          12 },
   { "--domZ",       eslARG_REAL,       FALSE, NULL, "x>0",     NULL,  NULL,  NULL,              "set # of significant seqs, for domain E-value calculation",   12 },
   { "--seed",       eslARG_INT,         "42",  NULL, "n>=0",    NULL,  NULL,  NULL,              "set RNG seed to <n> (if 0: one-time arbitrary seed)",         12 },
@@ -146,13 +161,21 @@ struct cfg_s {
   int              n_targetseq;       /* number of sequences in the restricted range */
 };
 
+#define BLOCK_SIZE 1000		/* targets per block, read and searched together */
+
 static int  serial_master(ESL_GETOPTS *go, struct cfg_s *cfg);
 static int  serial_loop  (WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs);
+#if defined (eslENABLE_SSE)
+static int  seed_FM       (WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata, const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded);
+static int  serial_loop_FM(WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata, const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded);
+#endif
 
 #ifdef HMMER_THREADS
-#define BLOCK_SIZE 1000
-
-static int  thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs);
+static int  thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_SQREADER *rdr, ESL_SQFILE *dbfp, int n_targetseqs);
+#if defined (eslENABLE_SSE)
+static int  thread_loop_FM(ESL_THREADS *obj, P7_WORKPOOL *pool, WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata,
+                           const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded);
+#endif
 static void pipeline_thread(void *arg);
 #endif 
 
@@ -198,6 +221,11 @@ process_commandline(int argc, char **argv, ESL_GETOPTS **ret_go, char **ret_qfil
       if (puts("\nOptions controlling acceleration heuristics:")             < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 7, 2, 80); 
 
+#if defined (eslENABLE_SSE)
+      if (puts("\nOptions controlling seed search heuristic (makehmmerdb targets):") < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
+      esl_opt_DisplayHelp(stdout, go, 9, 2, 80);
+#endif
+
       if (puts("\nOptions controlling E value calibration:")                 < 0) ESL_XEXCEPTION_SYS(eslEWRITE, "write failed");
       esl_opt_DisplayHelp(stdout, go, 11, 2, 80); 
 
@@ -267,11 +295,22 @@ output_header(FILE *ofp, ESL_GETOPTS *go, char *qfile, char *dbfile)
   if (esl_opt_IsUsed(go, "--F2")        && fprintf(ofp, "# Vit filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F2"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--F3")        && fprintf(ofp, "# Fwd filter P threshold:       <= %g\n",             esl_opt_GetReal(go, "--F3"))          < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--nobias")    && fprintf(ofp, "# biased composition HMM filter:   off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#if defined (eslENABLE_SSE)
+  if (esl_opt_IsUsed(go, "--seed_max_depth")    && fprintf(ofp, "# FM Seed length:                  %d\n",             esl_opt_GetInteger(go, "--seed_max_depth"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_sc_thresh")    && fprintf(ofp, "# FM score threshold (bits):       %g\n",             esl_opt_GetReal(go, "--seed_sc_thresh"))    < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_sc_density")   && fprintf(ofp, "# FM score density (bits/pos):     %g\n",             esl_opt_GetReal(go, "--seed_sc_density"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_drop_max_len") && fprintf(ofp, "# FM max neg-growth length:        %d\n",             esl_opt_GetInteger(go, "--seed_drop_max_len")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_drop_lim")     && fprintf(ofp, "# FM max run drop:                 %g\n",             esl_opt_GetReal(go, "--seed_drop_lim"))        < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_req_pos")      && fprintf(ofp, "# FM req positive run length:      %d\n",             esl_opt_GetInteger(go, "--seed_req_pos"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_consens_match") && fprintf(ofp, "# FM consec consensus match req:   %d\n",             esl_opt_GetInteger(go, "--seed_consens_match"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--seed_ssv_length")   && fprintf(ofp, "# FM len used for Vit window:      %d\n",             esl_opt_GetInteger(go, "--seed_ssv_length"))   < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+#endif
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") && fprintf(ofp, "# Restrict db to start at seq key: %s\n",            esl_opt_GetString(go, "--restrictdb_stkey"))  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--restrictdb_n")     && fprintf(ofp, "# Restrict db to # target seqs:    %d\n",            esl_opt_GetInteger(go, "--restrictdb_n")) < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--ssifile")          && fprintf(ofp, "# Override ssi file to:            %s\n",            esl_opt_GetString(go, "--ssifile"))       < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
 
   if (esl_opt_IsUsed(go, "--nonull2")   && fprintf(ofp, "# null2 bias corrections:          off\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
+  if (esl_opt_IsUsed(go, "--bands")     && fprintf(ofp, "# banded domain decoding:          on\n")                                                  < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmL")       && fprintf(ofp, "# seq length, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EmN")       && fprintf(ofp, "# seq number, MSV Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EmN"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
   if (esl_opt_IsUsed(go, "--EvL")       && fprintf(ofp, "# seq length, Vit Gumbel mu fit:   %d\n",             esl_opt_GetInteger(go, "--EvL"))      < 0) ESL_EXCEPTION_SYS(eslEWRITE, "write failed");
@@ -406,8 +445,16 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   ESL_SQ_BLOCK    *block    = NULL;
   ESL_THREADS     *threadObj= NULL;
-  ESL_WORK_QUEUE  *queue    = NULL;
+  P7_WORKPOOL     *pool     = NULL;
+  P7_SQREADER     *rdr      = NULL;
 #endif
+  /* these variables are only used if the target is a protein FM-index (makehmmerdb --amino) */
+  FM_CFG          *fm_cfg    = NULL;
+  FM_METADATA     *fm_meta   = NULL;
+  FM_DATA         *fm_fwd    = NULL;              /* all blocks of the index, read once                */
+  FM_DATA         *fm_bwd    = NULL;
+  uint8_t         *fm_seeded = NULL;              /* flags of segments seeded for this query           */
+  int64_t          fm_nseqs  = 0;
 
   /* Initializations */
   abc     = esl_alphabet_Create(eslAMINO);
@@ -454,12 +501,62 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (esl_opt_IsOn(go, "--domtblout")) { if ((domtblfp = fopen(esl_opt_GetString(go, "--domtblout"), "w")) == NULL)  p7_Fail("Failed to open tabular per-dom output file %s for writing\n", esl_opt_GetString(go, "--domtblfp")); }
   if (esl_opt_IsOn(go, "--pfamtblout")){ if ((pfamtblfp = fopen(esl_opt_GetString(go, "--pfamtblout"), "w")) == NULL)  esl_fatal("Failed to open pfam-style tabular output file %s for writing\n", esl_opt_GetString(go, "--pfamtblout")); }
 
-  /* Open the target sequence database for sequential access. */
-  status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
-  if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
-  else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
-  else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
-  else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  /* Open the target sequence database for sequential access. If it isn't a
+   * sequence file, it may be a protein FM-index built by makehmmerdb (the
+   * "fmindex" format).
+   */
+  if (dbformat != eslSQFILE_FMINDEX) {
+    status =  esl_sqfile_OpenDigital(abc, cfg->dbfile, dbformat, p7_SEQDBENV, &dbfp);
+    if      (status == eslENOTFOUND) p7_Fail("Failed to open target sequence database %s for reading\n",      cfg->dbfile);
+    else if (status == eslEFORMAT && dbformat == eslSQFILE_UNKNOWN && strcmp(cfg->dbfile, "-") != 0) {
+      esl_sqfile_Close(dbfp);   /* try it as an FM-index, below */
+      dbfp = NULL;
+    }
+    else if (status == eslEFORMAT)   p7_Fail("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
+    else if (status == eslEINVAL)    p7_Fail("Can't autodetect format of a stdin or .gz seqfile");
+    else if (status != eslOK)        p7_Fail("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
+  }
+
+  if (dbfp == NULL) {
+#if defined (eslENABLE_SSE)
+    if (esl_opt_IsOn(go, "--max"))
+      p7_Fail("--max flag is incompatible with the fmindex target type\n");
+    if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n"))
+      p7_Fail("--restrictdb_stkey and --restrictdb_n flags are incompatible with the fmindex target type\n");
+
+    if (fm_configAlloc(&fm_cfg) != eslOK) p7_Fail("unable to allocate memory to store FM meta data\n");
+    fm_meta = fm_cfg->meta;
+
+    if ((fm_meta->fp = fopen(cfg->dbfile, "rb")) == NULL)
+      p7_Fail("Failed to open target sequence database %s for reading\n", cfg->dbfile);
+
+    if (fm_readFMmeta(fm_meta) != eslOK) {
+      if (dbformat == eslSQFILE_FMINDEX) p7_Fail("Failed to read FM meta data from target sequence database %s\n", cfg->dbfile);
+      else                               p7_Fail("Target sequence database file %s is empty or misformatted\n",     cfg->dbfile);
+    }
+    if (fm_meta->alph_type != fm_AMINO)
+      p7_Fail("FM-index %s does not hold protein sequences; search it with nhmmer\n", cfg->dbfile);
+    if (fm_meta->fwd_only)
+      p7_Fail("FM-index %s was built for forward search only; rebuild it with this version of makehmmerdb\n", cfg->dbfile);
+
+    if (fm_configInit(fm_cfg, go) != eslOK)
+      p7_Fail("Failed to initialize FM configuration for target sequence database %s\n", cfg->dbfile);
+    if (fm_alphabetCreate(fm_meta, NULL) != eslOK)
+      p7_Fail("Failed to create FM alphabet for target sequence database %s\n", cfg->dbfile);
+
+    status = fm_FM_mmap(fm_meta);
+    if (status != eslOK && status != eslENORESULT) p7_Fail("Unexpected error %d in mapping target sequence database %s\n", status, cfg->dbfile);
+
+    if (fm_FM_readBlocks(fm_meta, &fm_fwd, &fm_bwd) != eslOK)
+      p7_Fail("Failed to read FM-index %s\n", cfg->dbfile);
+
+    fm_nseqs = fm_meta->seq_data[fm_meta->seq_count-1].target_id + 1;
+    ESL_ALLOC(fm_seeded, sizeof(uint8_t) * fm_meta->seq_count);
+#else
+    if (dbformat == eslSQFILE_FMINDEX) p7_Fail("fmindex is a valid sequence database file format only on systems supporting SSE vector instructions\n");
+    else                               p7_Fail("Target sequence database file %s is empty or misformatted\n", cfg->dbfile);
+#endif
+  }
 
 
   if (esl_opt_IsUsed(go, "--restrictdb_stkey") || esl_opt_IsUsed(go, "--restrictdb_n")) {
@@ -484,7 +581,8 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
   if (ncpus > 0)
     {
       threadObj = esl_threads_Create(&pipeline_thread);
-      queue = esl_workqueue_Create(ncpus * 2);
+      pool      = p7_workpool_Create(ncpus, p7_workpool_SeqWeight);
+      if (pool == NULL) p7_Fail("Failed to create work pool");
     }
 #endif
 
@@ -501,7 +599,7 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       info[i].om    = NULL;
       info[i].bg    = p7_bg_Clone(bg);
 #ifdef HMMER_THREADS
-      info[i].queue = queue;
+      info[i].pool  = pool;
 #endif
     }
 
@@ -514,18 +612,25 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  p7_Fail("Failed to allocate sequence block");
 	}
 
-      status = esl_workqueue_Init(queue, block);
+      status = p7_workpool_Init(pool, block);
       if (status != eslOK) 
 	{
-	  p7_Fail("Failed to add block to work queue");
+	  p7_Fail("Failed to add block to work pool");
 	}
     }
+
+  /* A plain FASTA target file is parsed and digitized by several reader threads at once */
+  if (ncpus > 0 && dbfp != NULL && cfg->n_targetseq == -1 && cfg->firstseq_key == NULL && p7_sqreader_IsUsable(dbfp))
+    rdr = p7_sqreader_Create(dbfp->filename, abc, 1 + ncpus / p7_SQREADER_CPUS_PER_THREAD);
 #endif
 
   /* Outer loop over sequence queries */
   while ((qstatus = esl_sqio_Read(qfp, qsq)) == eslOK)
     {
       P7_OPROFILE     *om       = NULL;           /* optimized query profile                  */
+      P7_HMM          *hmm      = NULL;           /* query model; only kept for FM seeding    */
+      P7_PROFILE      *gm       = NULL;           /* query profile; only kept for FM seeding  */
+      P7_SCOREDATA    *scoredata = NULL;          /* SSV scores for FM seeding                */
 
       nquery++;
       if (qsq->n == 0) continue; /* skip zero length seqs as if they aren't even present */
@@ -533,7 +638,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       esl_stopwatch_Start(w);
 
       /* seqfile may need to be rewound (multiquery mode) */
-      if (nquery > 1)
+      if (fm_cfg != NULL)
+        memset(fm_seeded, 0, sizeof(uint8_t) * fm_meta->seq_count);
+      else if (nquery > 1)
       {
         if (! esl_sqfile_IsRewindable(dbfp)) p7_Fail("Target sequence file %s isn't rewindable; can't search it with multiple queries", cfg->dbfile);
 
@@ -554,7 +661,18 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 
 
       /* Build the model */
-      p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+      if (fm_cfg == NULL)
+        p7_SingleBuilder(bld, qsq, info[0].bg, NULL, NULL, NULL, &om); /* bypass HMM - only need model */
+      else
+        {
+          /* FM seeding also needs the profile, and a max length, which the builder only sets for DNA */
+          p7_SingleBuilder(bld, qsq, info[0].bg, &hmm, NULL, &gm, &om);
+          p7_Builder_MaxLength(hmm, p7_DEFAULT_WINDOW_BETA);
+          gm->max_length = om->max_length = hmm->max_length;
+
+          fm_setThreshRatio(fm_cfg, gm);
+          scoredata = p7_hmm_ScoreDataCreate(om, gm);
+        }
 
       for (i = 0; i < infocnt; ++i)
       {
@@ -569,13 +687,29 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #endif
       }
 
+#if defined (eslENABLE_SSE)
+      if (fm_cfg != NULL)
+      {
+#ifdef HMMER_THREADS
+        if (ncpus > 0) sstatus = thread_loop_FM(threadObj, pool, info, fm_cfg, scoredata, fm_fwd, fm_bwd, fm_seeded);
+        else           sstatus = serial_loop_FM(info, fm_cfg, scoredata, fm_fwd, fm_bwd, fm_seeded);
+#else
+        sstatus = serial_loop_FM(info, fm_cfg, scoredata, fm_fwd, fm_bwd, fm_seeded);
+#endif
+      }
+      else
+#endif
 #ifdef HMMER_THREADS
-      if (ncpus > 0) sstatus = thread_loop(threadObj, queue, dbfp, cfg->n_targetseq);
+      if (ncpus > 0) sstatus = thread_loop(threadObj, pool, rdr, dbfp, cfg->n_targetseq);
       else           sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
 #else
       sstatus = serial_loop(info, dbfp, cfg->n_targetseq);
 #endif
-      switch(sstatus)
+      if (fm_cfg != NULL)
+      {
+        if (sstatus != eslEOF) p7_Fail("Unexpected error %d searching FM-index %s", sstatus, cfg->dbfile);
+      }
+      else switch(sstatus)
       {
       case eslEFORMAT:
         p7_Fail("Parse failed (sequence file %s):\n%s\n",
@@ -601,6 +735,13 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
         p7_oprofile_Destroy(info[i].om);
       }
 
+      /* Only targets with a seed were scored; the search space is the whole index */
+      if (fm_cfg != NULL) {
+        info->pli->nseqs = fm_nseqs;
+        info->pli->nres  = fm_meta->char_count;
+        if (info->pli->Z_setby == p7_ZSETBY_NTARGETS) info->pli->Z = fm_nseqs;
+      }
+
       /* Print the results.  */
       p7_tophits_SortBySortkey(info->th);
       p7_tophits_Threshold(info->th, info->pli);
@@ -641,6 +782,9 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
       p7_pipeline_Destroy(info->pli);
       p7_oprofile_Destroy(info->om);
       p7_oprofile_Destroy(om);
+      if (scoredata) p7_hmm_ScoreDataDestroy(scoredata);
+      if (gm)        p7_profile_Destroy(gm);
+      if (hmm)       p7_hmm_Destroy(hmm);
       esl_sq_Reuse(qsq);
     } /* end outer loop over query sequences */
   if      (qstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n",
@@ -664,16 +808,23 @@ serial_master(ESL_GETOPTS *go, struct cfg_s *cfg)
 #ifdef HMMER_THREADS
   if (ncpus > 0)
     {
-      esl_workqueue_Reset(queue);
-      while (esl_workqueue_Remove(queue, (void **) &block) == eslOK)
+      p7_workpool_Reset(pool);
+      while (p7_workpool_Remove(pool, (void **) &block) == eslOK)
 	esl_sq_DestroyBlock(block);
-      esl_workqueue_Destroy(queue);
+      p7_workpool_Destroy(pool);
+      if (rdr) p7_sqreader_Destroy(rdr);
       esl_threads_Destroy(threadObj);
     }
 #endif
 
   free(info);
-  esl_sqfile_Close(dbfp);
+  if (dbfp) esl_sqfile_Close(dbfp);
+  if (fm_fwd) fm_FM_destroyBlocks(fm_meta, fm_fwd, fm_bwd, fm_meta->block_count);
+  if (fm_cfg) {
+    fclose(fm_meta->fp);
+    fm_configDestroy(fm_cfg); // will cascade to destroy meta and alphabet, too
+  }
+  if (fm_seeded) free(fm_seeded);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
   esl_sq_Destroy(qsq);
@@ -1226,6 +1377,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   int              dbformat = eslSQFILE_UNKNOWN;  /* format of dbfile                                 */
   ESL_SQFILE      *dbfp     = NULL;               /* open dbfile                                      */
   ESL_SQ          *dbsq     = NULL;               /* target sequence                                  */
+  ESL_SQ_BLOCK    *sqblock  = NULL;               /* target sequences, BLOCK_SIZE at a time           */
   ESL_ALPHABET    *abc      = NULL;               /* sequence alphabet                                */
   P7_BUILDER      *bld      = NULL;               /* HMM construction configuration                   */
   ESL_STOPWATCH   *w        = NULL;               /* for timing                                       */
@@ -1281,7 +1433,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   else if (status == eslEFORMAT)   mpi_failure("Target sequence database file %s is empty or misformatted\n",   cfg->dbfile);
   else if (status == eslEINVAL)    mpi_failure("Can't autodetect format of a stdin or .gz seqfile");
   else if (status != eslOK)        mpi_failure("Unexpected error %d opening target sequence database file %s\n", status, cfg->dbfile);
-  dbsq = esl_sq_CreateDigital(abc);
+  sqblock = esl_sq_CreateDigitalBlock(BLOCK_SIZE, abc);
 
   /* Open the query sequence file  */
   status = esl_sqfile_OpenDigital(abc, cfg->qfile, qformat, NULL, &qfp);
@@ -1327,20 +1479,23 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 	  status = esl_sqfile_Position(dbfp, block.offset);
 	  if (status != eslOK) mpi_failure("Cannot position sequence database to %ld\n", block.offset);
 
-	  while (count > 0 && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+	  /* read the range a block at a time, and search each block as the threaded workers do */
+	  sstatus = eslOK;
+	  while (count > 0 && sstatus == eslOK)
 	    {
-	      length = dbsq->eoff - block.offset + 1;
-
-	      p7_pli_NewSeq(pli, dbsq);
-	      p7_bg_SetLength(bg, dbsq->n);
-	      p7_oprofile_ReconfigLength(om, dbsq->n);
-      
-	      p7_Pipeline(pli, om, bg, dbsq, NULL, th);
-
-	      esl_sq_Reuse(dbsq);
-	      p7_pipeline_Reuse(pli);
-
-	      --count;
+	      sqblock->count = 0;
+	      while (count > 0 && sqblock->count < sqblock->listSize)
+		{
+		  dbsq = sqblock->list + sqblock->count;
+		  if ((sstatus = esl_sqio_Read(dbfp, dbsq)) != eslOK) break;
+		  length = dbsq->eoff - block.offset + 1;
+
+		  sqblock->count++;
+		  --count;
+		}
+
+	      status = p7_Pipeline_Block(pli, om, bg, sqblock, 0, sqblock->count, th);
+	      if (status != eslOK) mpi_failure("Pipeline failed (error %d): %s\n", status, pli->errbuf);
 	    }
 
 	  /* lets do a little bit of sanity checking here to make sure the blocks are the same */
@@ -1381,7 +1536,7 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
   esl_sqfile_Close(dbfp);
   esl_sqfile_Close(qfp);
   esl_stopwatch_Destroy(w);
-  esl_sq_Destroy(dbsq);
+  esl_sq_DestroyBlock(sqblock);
   esl_sq_Destroy(qsq);
   p7_builder_Destroy(bld);
   esl_alphabet_Destroy(abc);
@@ -1393,53 +1548,102 @@ mpi_worker(ESL_GETOPTS *go, struct cfg_s *cfg)
 static int
 serial_loop(WORKER_INFO *info, ESL_SQFILE *dbfp, int n_targetseqs)
 {
-  int      sstatus   = eslOK;
-  ESL_SQ   *dbsq     = NULL;   /* one target sequence (digital)  */
-  int seq_cnt = 0;
+  int           sstatus = eslOK;
+  int           status;
+  ESL_SQ_BLOCK *block   = NULL;   /* target sequences (digital), BLOCK_SIZE at a time */
 
-  dbsq = esl_sq_CreateDigital(info->om->abc);
+  block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, info->om->abc);
 
-  /* Main loop: */
-  while ((n_targetseqs==-1 || seq_cnt<n_targetseqs) && (sstatus = esl_sqio_Read(dbfp, dbsq)) == eslOK)
+  /* Main loop: searched a block at a time, as the threaded workers do */
+  while (n_targetseqs != 0 && (sstatus = esl_sqio_ReadBlock(dbfp, block, -1, n_targetseqs, /*max_init_window=*/FALSE, FALSE)) == eslOK)
     {
-      p7_pli_NewSeq(info->pli, dbsq);
-      p7_bg_SetLength(info->bg, dbsq->n);
-      p7_oprofile_ReconfigLength(info->om, dbsq->n);
-      
-      p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-
-      seq_cnt++;
-      esl_sq_Reuse(dbsq);
-      p7_pipeline_Reuse(info->pli);
+      status = p7_Pipeline_Block(info->pli, info->om, info->bg, block, 0, block->count, info->th);
+      if (status != eslOK) p7_Fail("Pipeline failed (error %d): %s\n", status, info->pli->errbuf);
+
+      if (n_targetseqs != -1) n_targetseqs -= block->count;
     }
 
-  if (n_targetseqs!=-1 && seq_cnt==n_targetseqs)
+  if (n_targetseqs == 0)
     sstatus = eslEOF;
 
-  esl_sq_Destroy(dbsq);
+  esl_sq_DestroyBlock(block);
+
+  return sstatus;
+}
 
+#if defined (eslENABLE_SSE)
+/* seed_FM()
+ * Seed every block of a protein FM-index for the current query, and
+ * flag the segments to score in <seeded>; see p7_Pipeline_FMSeed().
+ * Uses <info>'s pipeline, so no worker may be scoring with it.
+ */
+static int
+seed_FM(WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata, const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded)
+{
+  int status;
+  int b;
+
+  for (b = 0; b < fm_cfg->meta->block_count; b++)
+    {
+      status = p7_Pipeline_FMSeed(info->pli, info->om, scoredata, info->bg, fm_fwd + b, fm_bwd + b, fm_cfg, seeded);
+      if (status != eslOK) p7_Fail("Failed to search block %d of FM-index (error %d)\n", b, status);
+    }
+  return eslOK;
+}
+
+/* serial_loop_FM()
+ * Search a protein FM-index: seed all its blocks, then score the
+ * seeded targets, whole, a block of them at a time.
+ * Returns eslEOF once all are scored, like serial_loop().
+ */
+static int
+serial_loop_FM(WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata, const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded)
+{
+  ESL_SQ_BLOCK *block = NULL;
+  uint32_t      idx   = 0;
+  int           sstatus;
+  int           status;
+
+  seed_FM(info, fm_cfg, scoredata, fm_fwd, fm_bwd, seeded);
+
+  block = esl_sq_CreateDigitalBlock(BLOCK_SIZE, info->om->abc);
+  while ((sstatus = fm_readSeeded(fm_fwd, fm_cfg->meta, seeded, &idx, block)) == eslOK)
+    {
+      status = p7_Pipeline_Block(info->pli, info->om, info->bg, block, 0, block->count, info->th);
+      if (status != eslOK) p7_Fail("Pipeline failed (error %d): %s\n", status, info->pli->errbuf);
+    }
+
+  esl_sq_DestroyBlock(block);
   return sstatus;
 }
+#endif /*eslENABLE_SSE*/
 
 #ifdef HMMER_THREADS
 static int
-thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_targetseqs)
+thread_loop(ESL_THREADS *obj, P7_WORKPOOL *pool, P7_SQREADER *rdr, ESL_SQFILE *dbfp, int n_targetseqs)
 {
   int  status  = eslOK;
   int  sstatus = eslOK;
-  int  eofCount = 0;
   ESL_SQ_BLOCK *block;
   void         *newBlock;
 
-  esl_workqueue_Reset(queue);
+  p7_workpool_Reset(pool);
   esl_threads_WaitForStart(obj);
 
-  status = esl_workqueue_ReaderUpdate(queue, NULL, &newBlock);
-  if (status != eslOK) p7_Fail("Work queue reader failed");
-      
-  /* Main loop: */
-  while (sstatus == eslOK)
+  /* A plain FASTA file is read and digitized by the P7_SQREADER's own threads. */
+  if (rdr != NULL)
+    {
+      sstatus = p7_sqreader_Run(rdr, pool);
+      if (sstatus == eslEFORMAT) p7_Fail("Parse failed (sequence file %s):\n%s\n", rdr->filename, rdr->errbuf);
+    }
+
+  /* Main loop: the reader fills free blocks and hands them to the
+   * pool, where the workers split them up and steal from each other.
+   */
+  while (rdr == NULL && sstatus == eslOK)
     {
+      status = p7_workpool_ReaderGet(pool, &newBlock);
+      if (status != eslOK) p7_Fail("Work pool reader failed");
       block = (ESL_SQ_BLOCK *) newBlock;
 
       if (n_targetseqs == 0)
@@ -1451,42 +1655,70 @@ thread_loop(ESL_THREADS *obj, ESL_WORK_QUEUE *queue, ESL_SQFILE *dbfp, int n_tar
         n_targetseqs -= block->count;
       }
 
-      if (sstatus == eslEOF)
-      {
-        if (eofCount < esl_threads_GetWorkerCount(obj)) sstatus = eslOK;
-        ++eofCount;
-      }
-	  
-      if (sstatus == eslOK)
-      {
-        status = esl_workqueue_ReaderUpdate(queue, block, &newBlock);
-        if (status != eslOK) p7_Fail("Work queue reader failed");
-      }
+      status = p7_workpool_ReaderPut(pool, block, (sstatus == eslOK ? block->count : 0));
+      if (status != eslOK) p7_Fail("Work pool reader failed");
     }
 
-  status = esl_workqueue_ReaderUpdate(queue, block, NULL);
-  if (status != eslOK) p7_Fail("Work queue reader failed");
+  /* wait for the workers to finish the blocks, then for the threads to exit */
+  status = p7_workpool_ReaderDone(pool);
+  if (status != eslOK) p7_Fail("Work pool reader failed");
+  esl_threads_WaitForFinish(obj);
 
-  if (sstatus == eslEOF)
+  return sstatus;
+}
+
+#if defined (eslENABLE_SSE)
+/* thread_loop_FM()
+ * Search a protein FM-index with the worker threads: seed all its
+ * blocks here, with the first worker's pipeline before any work is
+ * handed out, then feed the seeded targets to the pool, like
+ * thread_loop().
+ */
+static int
+thread_loop_FM(ESL_THREADS *obj, P7_WORKPOOL *pool, WORKER_INFO *info, FM_CFG *fm_cfg, P7_SCOREDATA *scoredata,
+               const FM_DATA *fm_fwd, const FM_DATA *fm_bwd, uint8_t *seeded)
+{
+  int           status  = eslOK;
+  int           sstatus = eslOK;
+  uint32_t      idx     = 0;
+  ESL_SQ_BLOCK *block;
+  void         *newBlock;
+
+  p7_workpool_Reset(pool);
+  esl_threads_WaitForStart(obj);
+
+  seed_FM(info, fm_cfg, scoredata, fm_fwd, fm_bwd, seeded);
+
+  while (sstatus == eslOK)
     {
-      /* wait for all the threads to complete */
-      esl_threads_WaitForFinish(obj);
-      esl_workqueue_Complete(queue);  
+      status = p7_workpool_ReaderGet(pool, &newBlock);
+      if (status != eslOK) p7_Fail("Work pool reader failed");
+      block = (ESL_SQ_BLOCK *) newBlock;
+
+      sstatus = fm_readSeeded(fm_fwd, fm_cfg->meta, seeded, &idx, block);
+
+      status = p7_workpool_ReaderPut(pool, block, (sstatus == eslOK ? block->count : 0));
+      if (status != eslOK) p7_Fail("Work pool reader failed");
     }
 
+  status = p7_workpool_ReaderDone(pool);
+  if (status != eslOK) p7_Fail("Work pool reader failed");
+  esl_threads_WaitForFinish(obj);
+
   return sstatus;
 }
+#endif /*eslENABLE_SSE*/
 
 static void 
 pipeline_thread(void *arg)
 {
-  int i;
   int status;
   int workeridx;
   WORKER_INFO   *info;
   ESL_THREADS   *obj;
+
   ESL_SQ_BLOCK  *block = NULL;
-  void          *newBlock;
+  P7_WORKRANGE   rng;
   
   impl_Init();
 
@@ -1495,36 +1727,18 @@ pipeline_thread(void *arg)
 
   info = (WORKER_INFO *) esl_threads_GetData(obj, workeridx);
 
-  status = esl_workqueue_WorkerUpdate(info->queue, NULL, &newBlock);
-  if (status != eslOK) p7_Fail("Work queue worker failed");
-
-  /* loop until all blocks have been processed */
-  block = (ESL_SQ_BLOCK *) newBlock;
-  while (block->count > 0)
+  /* loop over ranges of targets, taken from our deque or stolen, until all blocks have been processed */
+  while ((status = p7_workpool_WorkerNext(info->pool, workeridx, &rng)) == eslOK)
     {
-      /* Main loop: */
-      for (i = 0; i < block->count; ++i)
-	{
-	  ESL_SQ *dbsq = block->list + i;
+      block = (ESL_SQ_BLOCK *) rng.blk;
 
-	  p7_pli_NewSeq(info->pli, dbsq);
-	  p7_bg_SetLength(info->bg, dbsq->n);
-	  p7_oprofile_ReconfigLength(info->om, dbsq->n);
-	  
-	  p7_Pipeline(info->pli, info->om, info->bg, dbsq, NULL, info->th);
-	  
-	  esl_sq_Reuse(dbsq);
-	  p7_pipeline_Reuse(info->pli);
-	}
+      status = p7_Pipeline_Block(info->pli, info->om, info->bg, block, rng.start, rng.end, info->th);
+      if (status != eslOK) p7_Fail("Pipeline failed (error %d): %s\n", status, info->pli->errbuf);
 
-      status = esl_workqueue_WorkerUpdate(info->queue, block, &newBlock);
-      if (status != eslOK) p7_Fail("Work queue worker failed");
-
-      block = (ESL_SQ_BLOCK *) newBlock;
+      status = p7_workpool_WorkerDone(info->pool, &rng);
+      if (status != eslOK) p7_Fail("Work pool worker failed");
     }
-
-  status = esl_workqueue_WorkerUpdate(info->queue, block, NULL);
-  if (status != eslOK) p7_Fail("Work queue worker failed");
+  if (status != eslEOD) p7_Fail("Work pool worker failed");
 
   esl_threads_Finished(obj, workeridx);
   return;